@@ -0,0 +1,76 @@
+// Throughput of headless batch rendering: pages per second rendering the
+// same set of snapshot jobs on one thread and on every core.
+//
+//   batch_render_bench [pages] [rows] [png directory]
+//
+// Each page is a list of styled rows under a header, sharing one
+// stylesheet; with a directory given every page is also written as PNG.
+
+#include "browser/batch_renderer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+using namespace browser;
+
+namespace {
+
+const char* pageStyle =
+    "body { margin: 8px; font-size: 14px }"
+    ".header { height: 48px; background-color: #203040; color: white }"
+    ".row { height: 22px; border: 1px solid #c0c0c8; background-color: #f4f4f8 }"
+    ".row:nth-child(odd) { background-color: #ffffff }";
+
+std::vector<BatchJob> snapshotJobs(int pages, int rows, const std::string& directory) {
+    std::vector<BatchJob> jobs;
+    for (int p = 0; p < pages; ++p) {
+        BatchJob job;
+        job.html = "<html><head><style>" + std::string(pageStyle) + "</style></head><body>"
+                   "<div class=\"header\">Snapshot " + std::to_string(p) + "</div>";
+        for (int r = 0; r < rows; ++r) {
+            job.html += "<div class=\"row\">Page " + std::to_string(p) + " row " + std::to_string(r) +
+                        " with a line of text</div>";
+        }
+        job.html += "</body></html>";
+        job.width = 1024;
+        job.height = 768;
+        job.keepPixels = false;
+        if (!directory.empty()) {
+            job.pngPath = directory + "/page" + std::to_string(p) + ".png";
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+void run(const char* label, size_t threads, const std::vector<BatchJob>& jobs) {
+    BatchRenderer renderer(threads);
+    std::vector<BatchResult> results = renderer.render(jobs);
+    size_t failed = std::count_if(results.begin(), results.end(),
+                                  [](const BatchResult& result) { return !result.success; });
+    std::printf("%-12s %2zu threads %9.1f pages/s  %8.3f s", label, renderer.threadCount(),
+                renderer.pagesPerSecond(), renderer.lastSeconds());
+    if (failed > 0) {
+        std::printf("  (%zu failed: %s)", failed,
+                    std::find_if(results.begin(), results.end(),
+                                 [](const BatchResult& result) { return !result.success; })->error.c_str());
+    }
+    std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int pages = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200;
+    int rows = argc > 2 ? std::max(1, std::atoi(argv[2])) : 60;
+    std::string directory = argc > 3 ? argv[3] : "";
+
+    std::vector<BatchJob> jobs = snapshotJobs(pages, rows, directory);
+    std::printf("%d pages of %d rows, 1024x768%s\n\n", pages, rows, directory.empty() ? "" : ", PNG output");
+
+    run("serial", 1, jobs);
+    run("concurrent", std::max(1u, std::thread::hardware_concurrency()), jobs);
+    return 0;
+}
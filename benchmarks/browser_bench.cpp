@@ -0,0 +1,444 @@
+// End-to-end pipeline timings: parse, style, layout, display list generation
+// and rasterization, measured separately over a corpus of fixtures.
+//
+//   browser_bench [--iterations n] [--json file] [--label name]
+//                 [--resources dir] [file.html ...]
+//
+// The corpus holds synthetic documents of varying size, nesting depth and
+// stylesheet rule count, resources/default.html with default.css, and any
+// HTML files given (with a .css of the same name next to them, if any).
+// Each iteration runs the whole pipeline from the source text. Per stage it
+// reports wall time percentiles and the heap allocations made, as a table on
+// stdout and, with --json, as a JSON document to compare across commits
+// (--label tags the run, e.g. with the commit hash). Built with
+// ENABLE_ALLOC_TRACKING the JSON also splits each stage's allocations by
+// the subsystem they were charged to.
+
+#include "css/css_parser.h"
+#include "css/style_resolver.h"
+#include "html/html_parser.h"
+#include "layout/layout_engine.h"
+#include "rendering/custom_render_target.h"
+#include "rendering/paint_system.h"
+#include "tracing/alloc_tracker.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace browser;
+
+using tracing::AllocStats;
+using tracing::AllocTracker;
+
+#ifndef BROWSER_ALLOC_TRACKING
+
+// Heap allocations made by the whole process; stages read the difference.
+// With allocation tracking the library counts them instead.
+namespace {
+std::atomic<size_t> g_allocations(0);
+std::atomic<size_t> g_allocatedBytes(0);
+
+// Both sides go through these out-of-line helpers; with the replacements
+// inlined into their callers GCC pairs new with free() and warns
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE void* allocate(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void release(void* p) noexcept {
+    std::free(p);
+}
+
+#undef BENCH_NOINLINE
+}
+
+void* operator new(size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+    release(p);
+}
+
+void operator delete[](void* p) noexcept {
+    release(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    release(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    release(p);
+}
+
+#endif // BROWSER_ALLOC_TRACKING
+
+namespace {
+
+const float viewportWidth = 1024;
+const float viewportHeight = 768;
+
+struct Fixture {
+    std::string name;
+    std::string html;
+    std::string css;
+};
+
+enum Stage { PARSE, STYLE, LAYOUT, PAINT, RASTER, STAGE_COUNT };
+const char* const stageNames[STAGE_COUNT] = { "parse", "style", "layout", "paint", "raster" };
+
+struct StageSamples {
+    std::vector<double> seconds;
+    AllocStats allocations[AllocTracker::tagCount];  // Summed over runs, by subsystem
+
+    AllocStats total() const {
+        AllocStats sum;
+        for (const AllocStats& stats : allocations) {
+            sum.allocations += stats.allocations;
+            sum.bytes += stats.bytes;
+        }
+        return sum;
+    }
+};
+
+struct FixtureResult {
+    const Fixture* fixture;
+    size_t boxes = 0;
+    size_t displayItems = 0;
+    StageSamples stages[STAGE_COUNT];
+};
+
+// Nested sections depth levels deep, each leaf a paragraph of wrapped text,
+// styled by rules class selectors (most of which match something)
+Fixture syntheticFixture(const std::string& name, int sections, int depth, int rules) {
+    Fixture fixture;
+    fixture.name = name;
+
+    std::string& html = fixture.html;
+    html = "<html><head><title>" + name + "</title></head><body>";
+    for (int s = 0; s < sections; ++s) {
+        for (int d = 0; d < depth; ++d) {
+            html += "<div class=\"c" + std::to_string((s + d) % std::max(1, rules)) + "\">";
+        }
+        html += "<h2>Section " + std::to_string(s) + "</h2>"
+                "<p>Paragraph text with <a href=\"#s" + std::to_string(s) + "\">a link</a>,"
+                " <em>emphasis</em> and enough words to wrap over a few lines of the"
+                " viewport once the boxes are laid out.</p>"
+                "<ul><li>First item</li><li>Second item</li></ul>";
+        for (int d = 0; d < depth; ++d) {
+            html += "</div>";
+        }
+    }
+    html += "</body></html>";
+
+    std::string& css = fixture.css;
+    css = "body { margin: 8px } h2 { margin-bottom: 4px } p { margin-top: 6px; color: #333 }\n";
+    for (int r = 0; r < rules; ++r) {
+        css += ".c" + std::to_string(r) + " { padding-left: " + std::to_string(r % 3) +
+               "px; border-width: " + std::to_string(r % 2) + "px; background-color: #" +
+               (r % 2 ? "eee" : "fff") + " }\n";
+    }
+    return fixture;
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream oss;
+    oss << in.rdbuf();
+    contents = oss.str();
+    return true;
+}
+
+// Fixture from an HTML file and the .css beside it, if there is one
+bool fileFixture(const std::string& htmlPath, Fixture& fixture) {
+    if (!readFile(htmlPath, fixture.html)) {
+        return false;
+    }
+    std::string base = htmlPath.substr(0, htmlPath.rfind('.'));
+    readFile(base + ".css", fixture.css);
+    size_t slash = base.find_last_of('/');
+    fixture.name = slash == std::string::npos ? base : base.substr(slash + 1);
+    return true;
+}
+
+// Allocations so far; all charged to "other" without allocation tracking
+void allocationSnapshot(AllocStats (&stats)[AllocTracker::tagCount]) {
+#ifdef BROWSER_ALLOC_TRACKING
+    AllocTracker::snapshot(stats);
+#else
+    stats[0].allocations = g_allocations.load(std::memory_order_relaxed);
+    stats[0].bytes = g_allocatedBytes.load(std::memory_order_relaxed);
+#endif
+}
+
+// Wall time and allocations of one stage run
+template <typename Fn>
+void measure(StageSamples& samples, Fn&& fn) {
+    AllocStats before[AllocTracker::tagCount];
+    AllocStats after[AllocTracker::tagCount];
+    allocationSnapshot(before);
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    allocationSnapshot(after);
+    samples.seconds.push_back(std::chrono::duration<double>(end - start).count());
+    for (size_t i = 0; i < AllocTracker::tagCount; ++i) {
+        samples.allocations[i].allocations += after[i].allocations - before[i].allocations;
+        samples.allocations[i].bytes += after[i].bytes - before[i].bytes;
+    }
+}
+
+FixtureResult run(const Fixture& fixture, int iterations, rendering::PaintSystem& paintSystem,
+                  rendering::CustomRenderTarget& target) {
+    FixtureResult result;
+    result.fixture = &fixture;
+
+    css::CSSParser cssParser;
+    std::shared_ptr<css::StyleSheet> styleSheet = cssParser.parseStylesheet(fixture.css);
+
+    for (int i = 0; i < iterations; ++i) {
+        html::HTMLParser parser;
+        parser.initialize();
+        html::DOMTree tree;
+        css::StyleResolver resolver;
+        layout::LayoutEngine engine;
+        engine.initialize();
+
+        measure(result.stages[PARSE], [&] {
+            tree = parser.parse(fixture.html);
+        });
+        measure(result.stages[STYLE], [&] {
+            resolver.setDocument(tree.document());
+            resolver.addStyleSheet(*styleSheet);
+            resolver.resolveStyles();
+        });
+        measure(result.stages[LAYOUT], [&] {
+            engine.layoutDocument(tree.document(), &resolver, viewportWidth, viewportHeight);
+        });
+
+        layout::Box* root = engine.layoutRoot();
+        if (!root) {
+            continue;
+        }
+        std::unique_ptr<rendering::PaintContext> context;
+        measure(result.stages[PAINT], [&] {
+            context.reset(new rendering::PaintContext(paintSystem.createContext(root)));
+            paintSystem.paintBox(root, *context);
+        });
+        measure(result.stages[RASTER], [&] {
+            target.rasterize(context->displayList());
+        });
+
+        result.boxes = engine.layoutTree().liveCount();
+        result.displayItems = context->displayList().size();
+    }
+    return result;
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(p / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+}
+
+double mean(const std::vector<double>& samples) {
+    double sum = 0;
+    for (double s : samples) {
+        sum += s;
+    }
+    return samples.empty() ? 0 : sum / samples.size();
+}
+
+void printTable(const std::vector<FixtureResult>& results, int iterations) {
+    for (const FixtureResult& result : results) {
+        std::printf("%s: %zu bytes HTML, %zu bytes CSS, %zu boxes, %zu display items\n",
+                    result.fixture->name.c_str(), result.fixture->html.size(),
+                    result.fixture->css.size(), result.boxes, result.displayItems);
+        std::printf("  %-8s %10s %10s %10s %10s %12s %14s\n", "stage", "p50 ms", "p90 ms",
+                    "p99 ms", "mean ms", "allocs/run", "bytes/run");
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            const StageSamples& samples = result.stages[s];
+            size_t runs = std::max<size_t>(1, samples.seconds.size());
+            AllocStats total = samples.total();
+            std::printf("  %-8s %10.3f %10.3f %10.3f %10.3f %12zu %14zu\n", stageNames[s],
+                        percentile(samples.seconds, 50) * 1000.0,
+                        percentile(samples.seconds, 90) * 1000.0,
+                        percentile(samples.seconds, 99) * 1000.0,
+                        mean(samples.seconds) * 1000.0,
+                        static_cast<size_t>(total.allocations / runs),
+                        static_cast<size_t>(total.bytes / runs));
+        }
+        std::printf("\n");
+    }
+    std::printf("%d iterations per fixture\n", iterations);
+}
+
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+void writeJSON(std::ostream& out, const std::vector<FixtureResult>& results, int iterations,
+               const std::string& label) {
+    char buf[64];
+    auto ms = [&](double seconds) {
+        std::snprintf(buf, sizeof(buf), "%.4f", seconds * 1000.0);
+        return std::string(buf);
+    };
+
+    out << "{\n  \"benchmark\": \"browser_bench\",\n";
+    out << "  \"label\": " << jsonString(label) << ",\n";
+    out << "  \"iterations\": " << iterations << ",\n";
+    out << "  \"alloc_tracking\": " << (AllocTracker::isCompiledIn() ? "true" : "false") << ",\n";
+    out << "  \"fixtures\": [";
+    for (size_t f = 0; f < results.size(); ++f) {
+        const FixtureResult& result = results[f];
+        out << (f ? ",\n" : "\n") << "    {\n";
+        out << "      \"name\": " << jsonString(result.fixture->name) << ",\n";
+        out << "      \"html_bytes\": " << result.fixture->html.size() << ",\n";
+        out << "      \"css_bytes\": " << result.fixture->css.size() << ",\n";
+        out << "      \"boxes\": " << result.boxes << ",\n";
+        out << "      \"display_items\": " << result.displayItems << ",\n";
+        out << "      \"stages\": {";
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            const StageSamples& samples = result.stages[s];
+            size_t runs = std::max<size_t>(1, samples.seconds.size());
+            AllocStats total = samples.total();
+            out << (s ? ",\n" : "\n") << "        \"" << stageNames[s] << "\": {"
+                << "\"p50_ms\": " << ms(percentile(samples.seconds, 50))
+                << ", \"p90_ms\": " << ms(percentile(samples.seconds, 90))
+                << ", \"p99_ms\": " << ms(percentile(samples.seconds, 99))
+                << ", \"mean_ms\": " << ms(mean(samples.seconds))
+                << ", \"allocations\": " << total.allocations / runs
+                << ", \"allocated_bytes\": " << total.bytes / runs;
+            if (AllocTracker::isCompiledIn()) {
+                out << ", \"subsystems\": {";
+                for (size_t i = 0; i < AllocTracker::tagCount; ++i) {
+                    out << (i ? ", \"" : "\"") << AllocTracker::tagName(static_cast<tracing::AllocTag>(i))
+                        << "\": {\"allocations\": " << samples.allocations[i].allocations / runs
+                        << ", \"allocated_bytes\": " << samples.allocations[i].bytes / runs << "}";
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+        out << "\n      }\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = 20;
+    std::string jsonPath;
+    std::string label;
+    std::string resources = "resources";
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--iterations" && hasValue) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json" && hasValue) {
+            jsonPath = argv[++i];
+        } else if (arg == "--label" && hasValue) {
+            label = argv[++i];
+        } else if (arg == "--resources" && hasValue) {
+            resources = argv[++i];
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::fprintf(stderr, "Usage: %s [--iterations n] [--json file] [--label name] "
+                                 "[--resources dir] [file.html ...]\n", argv[0]);
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    std::vector<Fixture> corpus;
+    corpus.push_back(syntheticFixture("small", 20, 3, 10));
+    corpus.push_back(syntheticFixture("large", 1000, 3, 50));
+    corpus.push_back(syntheticFixture("deep", 50, 64, 10));
+    corpus.push_back(syntheticFixture("many-rules", 200, 4, 2000));
+
+    Fixture fixture;
+    if (fileFixture(resources + "/default.html", fixture)) {
+        corpus.push_back(fixture);
+    } else {
+        std::fprintf(stderr, "Skipping %s/default.html: not found\n", resources.c_str());
+    }
+    for (const std::string& file : files) {
+        if (!fileFixture(file, fixture)) {
+            std::fprintf(stderr, "Cannot read %s\n", file.c_str());
+            return 1;
+        }
+        corpus.push_back(fixture);
+    }
+
+    rendering::PaintSystem paintSystem;
+    paintSystem.initialize();
+    rendering::CustomRenderTarget target(static_cast<int>(viewportWidth), static_cast<int>(viewportHeight));
+
+    std::vector<FixtureResult> results;
+    for (const Fixture& f : corpus) {
+        results.push_back(run(f, iterations, paintSystem, target));
+    }
+
+    printTable(results, iterations);
+
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        if (!out) {
+            std::fprintf(stderr, "Cannot write %s\n", jsonPath.c_str());
+            return 1;
+        }
+        writeJSON(out, results, iterations, label);
+    }
+    return 0;
+}
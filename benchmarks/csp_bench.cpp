@@ -0,0 +1,90 @@
+// Content Security Policy checks per second against a policy with many
+// host sources.
+//
+//   csp_bench [sources] [iterations]
+//
+// URLs that once matched the wrong source are checked first; a wrong
+// answer fails the run.
+
+#include "security/content_security_policy.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace browser::security;
+
+namespace {
+
+// Whether script-src 'self' https://cdn.example.com lets each load
+struct Expectation {
+    const char* url;
+    bool allowed;
+};
+
+const Expectation expectations[] = {
+    {"/app.js", true},
+    {"https://site.com/app.js", true},
+    {"https://cdn.example.com/lib.js", true},
+    {"https://evil.com/x.js", false},
+    {"//evil.com/x.js", false},
+    {"\\\\evil.com/x.js", false},
+    {"//site.com/x.js", true},
+    {"https://evil.com\\@site.com/", false},
+    {"https://evil.com\\@cdn.example.com/", false},
+    {"https://user@site.com/app.js", true},
+};
+
+std::string policyWithSources(size_t sources) {
+    std::string policy = "script-src 'self' https://cdn.example.com";
+    for (size_t i = 0; i < sources; ++i) {
+        policy += " https://host" + std::to_string(i) + ".example.org";
+        if (i % 10 == 0) {
+            policy += " *.wild" + std::to_string(i) + ".example.net";
+        }
+    }
+    return policy;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t sources = argc > 1 ? static_cast<size_t>(std::max(1, std::atoi(argv[1]))) : 1000;
+    int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+    Origin page("https", "site.com", 443);
+
+    ContentSecurityPolicy policy;
+    policy.parse(policyWithSources(sources));
+    for (const Expectation& expectation : expectations) {
+        if (policy.allowsResource(CspResourceType::SCRIPT, expectation.url, page) != expectation.allowed) {
+            std::fprintf(stderr, "Wrong answer for %s: expected %s\n", expectation.url,
+                         expectation.allowed ? "allowed" : "blocked");
+            return 1;
+        }
+    }
+
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < 1000; ++i) {
+        urls.push_back("https://host" + std::to_string(i * 7 % (sources * 2)) + ".example.org/lib.js");
+        urls.push_back("https://a.wild" + std::to_string(i % sources) + ".example.net/x.js");
+        urls.push_back("/static/" + std::to_string(i) + ".js");
+    }
+
+    double best = 1e30;
+    size_t allowed = 0;
+    for (int run = 0; run < iterations; ++run) {
+        allowed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const std::string& url : urls) {
+            allowed += policy.allowsResource(CspResourceType::SCRIPT, url, page);
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+
+    std::printf("%zu sources, %zu URLs: %.3f ms, %.0f checks/s, %zu allowed\n", sources, urls.size(),
+                best * 1000.0, urls.size() / best, allowed);
+    return 0;
+}
@@ -0,0 +1,177 @@
+// Serialization throughput: recursive string concatenation (the previous
+// Node::toString scheme) vs HTMLSerializer into one buffer and to a sink.
+//
+//   html_serializer_bench [file.html] [copies] [iterations]
+//
+// The input (resources/default.html by default) is repeated copies times
+// inside one body to make a large document. Serializing must also be
+// stable: parsing the output again and serializing it gives the same text.
+
+#include "html/html_parser.h"
+#include "html/html_serializer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+
+using namespace browser::html;
+
+namespace {
+
+// Reference: one ostringstream and string temporary per node, as before
+std::string concatenate(const Node* node) {
+    std::ostringstream oss;
+    switch (node->nodeType()) {
+        case NodeType::ELEMENT_NODE: {
+            const Element* element = static_cast<const Element*>(node);
+            oss << "<" << element->tagName();
+            for (const auto& attr : element->attributes()) {
+                std::string value;
+                HTMLSerializer::appendEscapedAttribute(attr.value, value);
+                oss << " " << element->attributeName(attr) << "=\"" << value << "\"";
+            }
+            if (!element->hasChildNodes() && HTMLSerializer::isVoidElement(element)) {
+                oss << " />";
+                break;
+            }
+            oss << ">";
+            for (const auto& child : element->childNodes()) {
+                oss << concatenate(child.get());
+            }
+            oss << "</" << element->tagName() << ">";
+            break;
+        }
+        case NodeType::TEXT_NODE: {
+            const Element* parent = node->parentElement();
+            if (parent && HTMLSerializer::isRawTextElement(parent)) {
+                oss << node->nodeValue();
+                break;
+            }
+            std::string text;
+            HTMLSerializer::appendEscapedText(node->nodeValue(), text);
+            oss << text;
+            break;
+        }
+        case NodeType::DOCUMENT_NODE:
+            for (const auto& child : node->childNodes()) {
+                oss << concatenate(child.get());
+            }
+            break;
+        default:
+            oss << node->toString();
+            break;
+    }
+    return oss.str();
+}
+
+std::string scaledDocument(const std::string& source, int copies) {
+    // Repeat the body content; the head is kept once
+    size_t bodyStart = source.find("<body");
+    size_t bodyEnd = source.rfind("</body>");
+    if (bodyStart == std::string::npos || bodyEnd == std::string::npos) {
+        std::string html;
+        for (int i = 0; i < copies; ++i) {
+            html += source;
+        }
+        return html;
+    }
+
+    bodyStart = source.find('>', bodyStart) + 1;
+    std::string content = source.substr(bodyStart, bodyEnd - bodyStart);
+    std::string html = source.substr(0, bodyStart);
+    for (int i = 0; i < copies; ++i) {
+        html += content;
+    }
+    html += source.substr(bodyEnd);
+    return html;
+}
+
+// Best wall time of several runs, in seconds
+double bestOf(int iterations, const std::function<size_t()>& run, size_t& bytes) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        bytes = run();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+void report(const char* label, size_t bytes, double seconds) {
+    double mbPerSecond = (bytes / (1024.0 * 1024.0)) / seconds;
+    std::printf("%-28s %9.2f MB/s  %8.3f ms\n", label, mbPerSecond, seconds * 1000.0);
+}
+
+// Character references, quotes and bare ampersands, which must come
+// through a parse and serialize unchanged after the first
+const char* roundTripDocument =
+    "<html><body><p title=\"a &amp; b &quot;c&quot; &#39;d&#x27; &copy; R&D\" data-q='say \"hi\"'>"
+    "Fish &amp; chips &lt;3 &#169; 3 > 2 & AT&T</p></body></html>";
+
+std::string parseAndSerialize(const std::string& html) {
+    HTMLParser parser;
+    parser.initialize();
+    DOMTree tree = parser.parse(html);
+    return HTMLSerializer::serialize(tree.document());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "resources/default.html";
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    int copies = argc > 2 ? std::max(1, std::atoi(argv[2])) : 500;
+    int iterations = argc > 3 ? std::max(1, std::atoi(argv[3])) : 10;
+
+    HTMLParser parser;
+    parser.initialize();
+    parser.setTokenizerMode(TokenizerMode::ZERO_COPY);
+    DOMTree tree = parser.parse(scaledDocument(buffer.str(), copies));
+    const Document* document = tree.document();
+
+    size_t bytes = 0;
+    std::string expected = HTMLSerializer::serialize(document);
+    std::printf("Output: %zu bytes (%d copies of %s), best of %d runs\n\n",
+                expected.size(), copies, path, iterations);
+
+    double concatenated = bestOf(iterations, [&]() { return concatenate(document).size(); }, bytes);
+    report("recursive concatenation", bytes, concatenated);
+
+    double buffered = bestOf(iterations, [&]() { return HTMLSerializer::serialize(document).size(); }, bytes);
+    report("single buffer", bytes, buffered);
+
+    double streamed = bestOf(iterations, [&]() {
+        size_t total = 0;
+        HTMLSerializer::serialize(document, [&total](const char*, size_t length) { total += length; });
+        return total;
+    }, bytes);
+    report("streaming sink", bytes, streamed);
+
+    if (concatenate(document) != expected) {
+        std::fprintf(stderr, "Output mismatch\n");
+        return 1;
+    }
+
+    std::string once = parseAndSerialize(roundTripDocument);
+    std::string twice = parseAndSerialize(once);
+    if (twice != once || parseAndSerialize(expected) != expected) {
+        std::fprintf(stderr, "Serializing again changed the output:\n  %s\n  %s\n", once.c_str(), twice.c_str());
+        return 1;
+    }
+
+    std::printf("  speedup: %.2fx (buffer), %.2fx (sink)\n",
+                concatenated / buffered, concatenated / streamed);
+    return 0;
+}
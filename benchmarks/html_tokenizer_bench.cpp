@@ -0,0 +1,122 @@
+// Tokenizer throughput: HTMLParser's incremental tokenizer vs HTMLTokenizer.
+//
+//   html_tokenizer_bench [file.html] [iterations]
+//
+// Without a file a synthetic document of roughly 4 MB is used.
+
+#include "html/html_parser.h"
+#include "html/html_tokenizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+
+using namespace browser::html;
+
+namespace {
+
+std::string syntheticDocument(size_t targetSize) {
+    std::string html = "<!DOCTYPE html>\n<html><head><title>Benchmark</title>\n"
+                       "<style>body { margin: 0 } .item a { color: #336 }</style></head>\n<body>\n";
+    size_t i = 0;
+    while (html.size() < targetSize) {
+        html += "<div class=\"item row-" + std::to_string(i % 7) + "\" id=\"item" + std::to_string(i) + "\">\n"
+                "  <h2>Item " + std::to_string(i) + "</h2>\n"
+                "  <p>Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+                "incididunt ut labore et dolore magna aliqua &amp; ut enim ad minim veniam.</p>\n"
+                "  <a href=\"/items/" + std::to_string(i) + "\" title='details'>Details</a><br/>\n"
+                "  <img src=item.png width=32 height=32 alt=\"\">\n"
+                "  <!-- item " + std::to_string(i) + " -->\n"
+                "</div>\n";
+        if (i % 50 == 0) {
+            html += "<script>var x = 1; if (x < 2 && x > 0) { console.log('<div>'); }</script>\n";
+        }
+        ++i;
+    }
+    html += "</body></html>\n";
+    return html;
+}
+
+// Best wall time of several runs, in seconds
+double bestOf(int iterations, const std::function<size_t()>& run, size_t& tokens) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        tokens = run();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+void report(const char* label, size_t bytes, double seconds, size_t tokens) {
+    double mbPerSecond = (bytes / (1024.0 * 1024.0)) / seconds;
+    std::printf("%-28s %9.2f MB/s  %8.3f ms", label, mbPerSecond, seconds * 1000.0);
+    if (tokens > 0) {
+        std::printf("  %zu tokens", tokens);
+    }
+    std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string html;
+    if (argc > 1) {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (!file) {
+            std::fprintf(stderr, "Cannot open %s\n", argv[1]);
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        html = buffer.str();
+    } else {
+        html = syntheticDocument(4 * 1024 * 1024);
+    }
+    int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+
+    std::printf("Input: %zu bytes, best of %d runs\n\n", html.size(), iterations);
+
+    HTMLParser parser;
+    parser.initialize();
+    size_t tokens = 0;
+
+    double incremental = bestOf(iterations, [&]() { return parser.countTokens(html); }, tokens);
+    report("incremental tokenizer", html.size(), incremental, tokens);
+
+    double zeroCopy = bestOf(iterations, [&]() {
+        HTMLTokenizer tokenizer(html);
+        TokenView token;
+        size_t count = 0;
+        while (tokenizer.next(token)) {
+            ++count;
+        }
+        return count;
+    }, tokens);
+    report("zero-copy tokenizer", html.size(), zeroCopy, tokens);
+
+    std::printf("  speedup: %.2fx\n\n", incremental / zeroCopy);
+
+    // End to end, including tree construction
+    parser.setTokenizerMode(TokenizerMode::INCREMENTAL);
+    double parseIncremental = bestOf(iterations, [&]() {
+        parser.parse(html);
+        return size_t(0);
+    }, tokens);
+    report("parse (incremental)", html.size(), parseIncremental, 0);
+
+    parser.setTokenizerMode(TokenizerMode::ZERO_COPY);
+    double parseZeroCopy = bestOf(iterations, [&]() {
+        parser.parse(html);
+        return size_t(0);
+    }, tokens);
+    report("parse (zero-copy)", html.size(), parseZeroCopy, 0);
+
+    std::printf("  speedup: %.2fx\n", parseIncremental / parseZeroCopy);
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Script execution time with the tree-walking interpreter and with the
+// bytecode VM, on loop-, call- and array-heavy scripts, after the size of a
+// JSValue and the rate of numeric JSValue operations, then how long
+// collecting a script's garbage cycles takes, and how long getting a large
+// script's program takes by parsing, eagerly and lazily, and from the
+// script cache.
+//
+//   js_bench [scale]
+//
+// Each script returns a value; both modes must agree on it.
+
+#include "custom_js/js_engine.h"
+#include "custom_js/js_heap.h"
+#include "custom_js/script_cache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace browser::custom_js;
+
+namespace {
+
+struct Script {
+    const char* name;
+    std::string source;
+};
+
+double runScript(ExecutionMode mode, const std::string& source, std::string& result) {
+    JSEngine engine;
+    engine.initialize();
+    engine.setExecutionMode(mode);
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!engine.executeScript(source, result, error)) {
+        result = "error: " + error;
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Adds, multiplies and copies numbers through JSValues
+double valueArithmetic(size_t count, double& result) {
+    std::vector<JSValue> values(64, JSValue(1.5));
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        JSValue& a = values[i & 63];
+        const JSValue& b = values[(i + 17) & 63];
+        a = JSValue(a.toNumber() * 0.5 + b.toNumber() * 0.25 + 1);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result = values[0].toNumber();
+    return ms;
+}
+
+// Milliseconds per call of get, over a few calls
+template <typename Get>
+double timeProgram(Get get) {
+    const int runs = 5;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+        get();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int scale = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1;
+    std::string n = std::to_string(200000 * scale);
+    std::string rows = std::to_string(300 * scale);
+
+    Script scripts[] = {
+        {"for loop", "var sum = 0; for (var i = 0; i < " + n + "; i = i + 1) { sum = sum + i % 7; } return sum;"},
+        {"arithmetic", "var x = 0.5; var y = 1; for (var i = 0; i < " + n + "; ++i)"
+                       " { x = x * 0.75 + y / 3 - i % 5; y = -y; } return x;"},
+        {"while loop", "var i = 0; var x = 1; while (i < " + n + ") { x = x * 3 % 1000; ++i; } return x;"},
+        {"nested loops", "function grid(rows) { var cells = 0; for (var r = 0; r < rows; ++r) {"
+                         " for (var c = 0; c < rows; ++c) { if ((r + c) % 2 == 0) { cells = cells + 1; } } }"
+                         " return cells; } return grid(" + rows + ");"},
+        {"fib(22)", "function fib(k) { if (k < 2) { return k; } return fib(k - 1) + fib(k - 2); } return fib(22);"},
+        {"objects", "var o = {count: 0}; for (var i = 0; i < " + std::to_string(50000 * scale) + "; ++i)"
+                    " { o.count = o.count + 1; o['k'] = i; } return o.count;"},
+        {"shapes", "function norm(p) { return p.x * p.x + p.y * p.y; } var s = 0;"
+                   " for (var i = 0; i < " + std::to_string(20000 * scale) + "; ++i)"
+                   " { var a = {x: i % 7, y: 1, z: 2, w: 3}; var b = {w: 0, z: 0, y: i % 5, x: 2};"
+                   " a.z = a.w + b.z; s = s + norm(a) + norm(b); } return s;"},
+        {"array sum", "var a = []; for (var i = 0; i < " + std::to_string(50000 * scale) + "; ++i)"
+                      " { a[i] = i * 0.5; } var s = 0; for (var r = 0; r < 4; ++r)"
+                      " { for (var i = 0; i < a.length; ++i) { s = s + a[i]; } } return s;"},
+        {"dot product", "var x = []; var y = []; for (var i = 0; i < " + std::to_string(1000 * scale) + "; ++i)"
+                        " { x[i] = i % 13; y[i] = 1 / (i + 1); } var d = 0; for (var r = 0; r < 50; ++r)"
+                        " { for (var i = 0; i < x.length; ++i) { d = d + x[i] * y[i]; } } return d;"},
+        {"sieve", "var n = " + std::to_string(50000 * scale) + "; var p = []; for (var i = 0; i < n; ++i)"
+                  " { p[i] = 1; } p[0] = 0; p[1] = 0; for (var i = 2; i * i < n; ++i) { if (p[i] == 1)"
+                  " { for (var j = i * i; j < n; j = j + i) { p[j] = 0; } } } var c = 0;"
+                  " for (var i = 0; i < n; ++i) { c = c + p[i]; } return c;"},
+    };
+
+    size_t operations = 20000000 * static_cast<size_t>(scale);
+    double arithmeticResult;
+    double arithmeticMs = valueArithmetic(operations, arithmeticResult);
+    std::printf("sizeof(JSValue) = %zu bytes; %.0f M value ops/s (%g)\n\n", sizeof(JSValue),
+                operations / (arithmeticMs * 1000.0), arithmeticResult);
+
+    std::printf("%-14s %12s %12s %9s  result\n", "script", "interp (ms)", "bytecode (ms)", "speedup");
+    for (const Script& script : scripts) {
+        std::string interpreted, compiled;
+        double interpreterMs = runScript(ExecutionMode::INTERPRETER, script.source, interpreted);
+        double bytecodeMs = runScript(ExecutionMode::BYTECODE, script.source, compiled);
+        std::printf("%-14s %12.2f %12.2f %8.1fx  %s%s\n", script.name, interpreterMs, bytecodeMs,
+                    interpreterMs / std::max(bytecodeMs, 1e-6), compiled.c_str(),
+                    interpreted == compiled ? "" : " (MISMATCH)");
+    }
+
+    // Pairs of objects that refer to each other, which only the collector frees
+    JSEngine engine;
+    engine.initialize();
+    engine.setExecutionMode(ExecutionMode::BYTECODE);
+    std::string result, error;
+    JSHeap::Stats before = JSHeap::current().stats();
+    engine.executeScript("function pair() { var a = {}; var b = {other: a}; a.other = b; return 0; }"
+                         " for (var i = 0; i < " + std::to_string(50000 * scale) + "; ++i) { pair(); } return 0;",
+                         result, error);
+    engine.collectGarbage();
+    const JSHeap::Stats& after = JSHeap::current().stats();
+    std::printf("\ncycles: %zu collections freed %zu objects, longest pause %.2f ms\n",
+                after.collections - before.collections, after.freed - before.freed, after.longestMilliseconds);
+
+    // A library-sized script: many small functions over objects and arrays
+    std::string library;
+    for (int i = 0; i < 2000 * scale; ++i) {
+        std::string k = std::to_string(i);
+        library += "function f" + k + "(a, b) { var o = {x: a, y: [b, " + k + ", 'str" + k + "']};"
+                   " if (o.x > b) { return o.y[0] * 2 + f" + k + ".length; } return o.x + b; }\n";
+    }
+    std::string directory = (std::filesystem::temp_directory_path() / "js_bench_scripts").string();
+    std::error_code removeError;
+    std::filesystem::remove_all(directory, removeError);
+    ScriptCache memoryCache;
+    memoryCache.get(library);
+    ScriptCache writer;
+    writer.setDirectory(directory);
+    writer.get(library);
+
+    double parseMs = timeProgram([&] { JSParser().parse(library); });
+    double lazyMs = timeProgram([&] {
+        JSParser parser;
+        parser.setLazyFunctions(true);
+        parser.parse(library);
+    });
+    std::printf("\nparsing (%zu KB source): eager %.2f ms, lazy functions %.2f ms\n",
+                library.size() / 1024, parseMs, lazyMs);
+
+    double memoryMs = timeProgram([&] { memoryCache.get(library); });
+    double diskMs = timeProgram([&] {
+        ScriptCache reader;
+        reader.setDirectory(directory);
+        reader.get(library);
+    });
+    std::printf("script cache: memory hit %.3f ms, disk hit %.2f ms\n", memoryMs, diskMs);
+    std::filesystem::remove_all(directory, removeError);
+    return 0;
+}
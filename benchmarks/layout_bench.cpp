@@ -0,0 +1,116 @@
+// Layout time of a wide multi-column document: serial vs parallel layout of
+// the independent column subtrees on the shared work pool.
+//
+//   layout_bench [columns] [paragraphs] [iterations]
+//
+// Each column is a block holding paragraphs of wrapped text. The viewport
+// width alternates between runs so every run lays the whole tree out again.
+
+#include "css/css_parser.h"
+#include "css/style_resolver.h"
+#include "html/html_parser.h"
+#include "layout/layout_engine.h"
+#include "threading/work_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <string>
+
+using namespace browser;
+
+namespace {
+
+std::string columnsDocument(int columns, int paragraphs) {
+    std::string html = "<html><body>";
+    for (int c = 0; c < columns; ++c) {
+        html += "<div class=\"column\">";
+        for (int p = 0; p < paragraphs; ++p) {
+            html += "<p>Column " + std::to_string(c) + " paragraph " + std::to_string(p) +
+                    " has enough words in it to wrap across several lines of the column"
+                    " <span>with an inline run</span> and a little more text after it.</p>";
+        }
+        html += "</div>";
+    }
+    html += "</body></html>";
+    return html;
+}
+
+// Best wall time of several runs, in seconds
+double bestOf(int iterations, const std::function<void(int)>& run) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run(i);
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+void report(const char* label, size_t boxes, double seconds) {
+    double boxesPerSecond = boxes / seconds;
+    std::printf("%-28s %9.2f Mbox/s  %8.3f ms\n", label, boxesPerSecond / 1e6, seconds * 1000.0);
+}
+
+std::string dump(const layout::LayoutEngine& engine) {
+    std::ostringstream oss;
+    engine.printLayoutTree(oss);
+    return oss.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int columns = argc > 1 ? std::max(1, std::atoi(argv[1])) : 16;
+    int paragraphs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 200;
+    int iterations = argc > 3 ? std::max(1, std::atoi(argv[3])) : 10;
+
+    html::HTMLParser parser;
+    parser.initialize();
+    html::DOMTree tree = parser.parse(columnsDocument(columns, paragraphs));
+
+    css::CSSParser cssParser;
+    css::StyleResolver resolver;
+    resolver.setDocument(tree.document());
+    resolver.addStyleSheet(*cssParser.parseStylesheet(
+        ".column { margin: 4px; padding: 8px; border-width: 1px } p { margin-top: 6px }"));
+
+    layout::LayoutEngine engine;
+    engine.initialize();
+    engine.layoutDocument(tree.document(), &resolver, 1000, 800);
+    size_t boxes = engine.layoutTree().liveCount();
+
+    std::printf("Layout: %zu boxes (%d columns of %d paragraphs), %zu workers, best of %d runs\n\n",
+                boxes, columns, paragraphs, threading::WorkPool::shared().workerCount(), iterations);
+
+    // Alternate the width so nothing is reused
+    float width = 1000;
+    auto relayout = [&](int) {
+        width = width == 1000 ? 1001 : 1000;
+        engine.layoutDocument(tree.document(), &resolver, width, 800);
+    };
+
+    engine.setParallelLayout(false);
+    double serial = bestOf(iterations, relayout);
+    report("serial", boxes, serial);
+    std::string expected = dump(engine);
+    float expectedWidth = width;
+
+    engine.setParallelLayout(true);
+    double parallel = bestOf(iterations, relayout);
+    report("parallel", boxes, parallel);
+    if (width != expectedWidth) {
+        relayout(0);
+    }
+
+    if (dump(engine) != expected) {
+        std::fprintf(stderr, "Layout mismatch\n");
+        return 1;
+    }
+
+    std::printf("  speedup: %.2fx\n", serial / parallel);
+    return 0;
+}
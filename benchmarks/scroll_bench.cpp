@@ -0,0 +1,107 @@
+// Frame time of scrolling a long page: compositing retained layers at each
+// new offset against painting and rasterizing the whole view every frame.
+//
+//   scroll_bench [rows] [frames] [step]
+//
+// The page is rows of bordered text blocks under a fixed header, with a
+// translucent and a translated block every so often. Each frame scrolls
+// step pixels further down a 1280 x 800 view.
+
+#include "css/css_parser.h"
+#include "css/style_resolver.h"
+#include "html/html_parser.h"
+#include "layout/layout_engine.h"
+#include "rendering/compositor.h"
+#include "rendering/paint_system.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+using namespace browser;
+using namespace browser::rendering;
+
+namespace {
+
+const int viewWidth = 1280;
+const int viewHeight = 800;
+
+std::string scrollDocument(int rows) {
+    std::string html = "<html><body>"
+                       "<div class=\"header\" style=\"position: fixed\">Fixed header</div>";
+    for (int r = 0; r < rows; ++r) {
+        const char* style = r % 25 == 7 ? " style=\"opacity: 0.6\""
+                          : r % 25 == 19 ? " style=\"transform: translate(12px, 0)\"" : "";
+        html += "<div class=\"row\"" + std::string(style) + ">Row " + std::to_string(r) +
+                " holds a line of text long enough to cover most of the view's width</div>";
+    }
+    html += "</body></html>";
+    return html;
+}
+
+// Wall time of a run, in seconds
+double timed(const std::function<void()>& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void report(const char* label, int frames, double seconds) {
+    std::printf("%-28s %9.3f ms/frame  %8.1f fps\n", label, seconds * 1000.0 / frames, frames / seconds);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int rows = argc > 1 ? std::max(1, std::atoi(argv[1])) : 2000;
+    int frames = argc > 2 ? std::max(1, std::atoi(argv[2])) : 300;
+    float step = argc > 3 ? static_cast<float>(std::max(1, std::atoi(argv[3]))) : 16.0f;
+
+    html::HTMLParser parser;
+    auto dom = parser.parse(scrollDocument(rows));
+    css::CSSParser cssParser;
+    css::StyleResolver resolver;
+    resolver.setDocument(dom.document());
+    resolver.addStyleSheet(*cssParser.parseStylesheet(
+        ".row { height: 24px; border: 1px solid #888888; background-color: #f4f4f8 }"
+        ".header { height: 40px; background-color: #203040; color: white }"));
+    layout::LayoutEngine engine;
+    engine.layoutDocument(dom.document(), &resolver, viewWidth, viewHeight);
+
+    PaintSystem paintSystem;
+    LayerTree layers;
+    paintSystem.paintLayers(engine.layoutRoot(), layers);
+    std::printf("%d rows, %zu layers, %d frames scrolling %.0f px each, %dx%d view\n\n",
+                rows, layers.size(), frames, step, viewWidth, viewHeight);
+
+    Framebuffer target(viewWidth, viewHeight);
+
+    // Repaint and rasterize everything visible each frame
+    TileRasterizer rasterizer;
+    double full = timed([&]() {
+        for (int frame = 0; frame < frames; ++frame) {
+            PaintContext context;
+            context.transform(0, -frame * step);
+            paintSystem.paintBox(engine.layoutRoot(), context);
+            rasterizer.rasterize(context.displayList(), target, Color(255, 255, 255));
+        }
+    });
+
+    // Blend the retained layers at the new offset
+    Compositor compositor;
+    size_t rasterized = 0;
+    double composited = timed([&]() {
+        for (int frame = 0; frame < frames; ++frame) {
+            compositor.composite(layers, target, 0, frame * step);
+            rasterized += compositor.layersRasterized();
+        }
+    });
+
+    report("paint + rasterize", frames, full);
+    report("composite layers", frames, composited);
+    std::printf("\n%zu layer rasterizations over %d frames; %.2fx faster\n", rasterized, frames, full / composited);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "back_forward_cache.h"
+#include "../tracing/trace.h"
+#include <iterator>
+#include <utility>
+
+namespace browser {
+
+//-----------------------------------------------------------------------------
+// BackForwardCache Implementation
+//-----------------------------------------------------------------------------
+
+BackForwardCache::BackForwardCache()
+    : m_bytes(0)
+    , m_maxPages(defaultMaxPages)
+    , m_maxBytes(defaultMaxBytes)
+    , m_hits(0)
+    , m_evictions(0)
+{
+}
+
+void BackForwardCache::put(std::unique_ptr<Page> page) {
+    if (!page) {
+        return;
+    }
+    erase(page->id);
+
+    size_t bytes = page->estimatedBytes();
+    if (m_maxPages == 0 || bytes > m_maxBytes) {
+        ++m_evictions;
+        return;
+    }
+
+    // Make room first, so the new page is never the one dropped
+    evictTo(m_maxPages - 1, m_maxBytes - bytes);
+    uint64_t id = page->id;
+    m_pages.push_back({id, std::move(page), bytes});
+    m_index[id] = std::prev(m_pages.end());
+    m_bytes += bytes;
+    TRACE_COUNTER("navigation", "backForwardCacheBytes", static_cast<int64_t>(m_bytes));
+}
+
+std::unique_ptr<Page> BackForwardCache::take(uint64_t id) {
+    auto found = m_index.find(id);
+    if (found == m_index.end()) {
+        return nullptr;
+    }
+    std::unique_ptr<Page> page = std::move(found->second->page);
+    remove(found->second);
+    ++m_hits;
+    return page;
+}
+
+void BackForwardCache::erase(uint64_t id) {
+    auto found = m_index.find(id);
+    if (found != m_index.end()) {
+        remove(found->second);
+    }
+}
+
+void BackForwardCache::clear() {
+    m_pages.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void BackForwardCache::setMaxPages(size_t pages) {
+    m_maxPages = pages;
+    evictTo(m_maxPages, m_maxBytes);
+}
+
+void BackForwardCache::setMaxBytes(size_t bytes) {
+    m_maxBytes = bytes;
+    evictTo(m_maxPages, m_maxBytes);
+}
+
+void BackForwardCache::evictTo(size_t pages, size_t bytes) {
+    while (!m_pages.empty() && (m_pages.size() > pages || m_bytes > bytes)) {
+        remove(m_pages.begin());
+        ++m_evictions;
+    }
+}
+
+void BackForwardCache::remove(EntryList::iterator it) {
+    m_bytes -= it->bytes;
+    m_index.erase(it->id);
+    m_pages.erase(it);
+}
+
+} // namespace browser
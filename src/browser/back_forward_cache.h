@@ -0,0 +1,77 @@
+#ifndef BROWSER_BACK_FORWARD_CACHE_H
+#define BROWSER_BACK_FORWARD_CACHE_H
+
+#include "page.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace browser {
+
+// Pages navigated away from, kept whole so going back or forward to them
+// shows them again without fetching, parsing, styling or laying them out.
+// Bounded by a page count and by the pages' estimated size; past either,
+// the least recently stored pages are dropped. Main thread only.
+class BackForwardCache {
+public:
+    BackForwardCache();
+
+    BackForwardCache(const BackForwardCache&) = delete;
+    BackForwardCache& operator=(const BackForwardCache&) = delete;
+
+    // Keep a page for its history entry, replacing one stored before. A
+    // page larger than the whole budget isn't kept.
+    void put(std::unique_ptr<Page> page);
+
+    // Take the page with this id out of the cache; null if it isn't there
+    std::unique_ptr<Page> take(uint64_t id);
+
+    bool contains(uint64_t id) const { return m_index.count(id) != 0; }
+
+    // Drop the page of a history entry that can't be visited again
+    void erase(uint64_t id);
+    void clear();
+
+    // Drop least recently stored pages until at most bytes are held
+    void trim(size_t bytes) { evictTo(m_maxPages, bytes); }
+
+    void setMaxPages(size_t pages);
+    void setMaxBytes(size_t bytes);
+    size_t maxPages() const { return m_maxPages; }
+    size_t maxBytes() const { return m_maxBytes; }
+
+    size_t size() const { return m_pages.size(); }
+    size_t bytes() const { return m_bytes; }
+
+    // Pages shown from the cache, and pages dropped to stay in budget
+    size_t hits() const { return m_hits; }
+    size_t evictions() const { return m_evictions; }
+
+    static constexpr size_t defaultMaxPages = 6;
+    static constexpr size_t defaultMaxBytes = 64 * 1024 * 1024;
+
+private:
+    struct Entry {
+        uint64_t id;
+        std::unique_ptr<Page> page;
+        size_t bytes;
+    };
+    using EntryList = std::list<Entry>;
+
+    void evictTo(size_t pages, size_t bytes);
+    void remove(EntryList::iterator it);
+
+    EntryList m_pages;                                          // Least recently stored first
+    std::unordered_map<uint64_t, EntryList::iterator> m_index;
+    size_t m_bytes;
+    size_t m_maxPages;
+    size_t m_maxBytes;
+    size_t m_hits;
+    size_t m_evictions;
+};
+
+} // namespace browser
+
+#endif // BROWSER_BACK_FORWARD_CACHE_H
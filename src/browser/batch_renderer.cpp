@@ -0,0 +1,162 @@
+#include "batch_renderer.h"
+#include "../css/style_resolver.h"
+#include "../html/dom_traversal.h"
+#include "../html/html_parser.h"
+#include "../layout/layout_engine.h"
+#include "../rendering/image_encoder.h"
+#include "../rendering/paint_system.h"
+#include "../rendering/tile_rasterizer.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <thread>
+
+namespace browser {
+
+//-----------------------------------------------------------------------------
+// Pipeline Implementation
+//-----------------------------------------------------------------------------
+
+// Renders one page at a time on the calling thread. Styles and layout are
+// built afresh for each page; the parser, paint system, rasterizer (with
+// its glyph atlas) and framebuffer carry over.
+class BatchRenderer::Pipeline {
+public:
+    explicit Pipeline(css::StyleSheetCache& styleSheetCache)
+        : m_styleSheetCache(styleSheetCache)
+    {
+        m_rasterizer.setWorkPool(nullptr);
+    }
+
+    void render(const BatchJob& job, BatchResult& result);
+
+private:
+    css::StyleSheetCache& m_styleSheetCache;
+    html::HTMLParser m_parser;
+    rendering::PaintSystem m_paintSystem;
+    rendering::TileRasterizer m_rasterizer;
+    rendering::Framebuffer m_framebuffer;
+};
+
+void BatchRenderer::Pipeline::render(const BatchJob& job, BatchResult& result) {
+    TRACE_SCOPE("batch", "BatchRenderer::Pipeline::render");
+
+    if (job.width <= 0 || job.height <= 0) {
+        result.error = "Empty viewport";
+        return;
+    }
+
+    try {
+        html::DOMTree domTree = m_parser.parse(job.html);
+        html::Document* document = domTree.document();
+        if (!document) {
+            result.error = "Failed to parse document";
+            return;
+        }
+
+        // The pages are styled and laid out in parallel already
+        css::StyleResolver styleResolver;
+        styleResolver.setWorkPool(nullptr);
+        for (html::Element* element : html::elementsOf(document)) {
+            if (element->tagAtom() != html::atoms::STYLE) continue;
+            if (auto sheet = m_styleSheetCache.get(element->textContent())) {
+                styleResolver.addStyleSheet(*sheet);
+            }
+        }
+        if (!job.css.empty()) {
+            if (auto sheet = m_styleSheetCache.get(job.css)) {
+                styleResolver.addStyleSheet(*sheet);
+            }
+        }
+        styleResolver.setDocument(document);
+        styleResolver.resolveStyles();
+
+        layout::LayoutEngine layoutEngine;
+        layoutEngine.setWorkPool(nullptr);
+        layoutEngine.layoutDocument(document, &styleResolver,
+                                    static_cast<float>(job.width), static_cast<float>(job.height));
+
+        rendering::PaintContext context;
+        m_paintSystem.paintBox(layoutEngine.layoutRoot(), context);
+        result.displayItems = context.displayList().size();
+
+        if (m_framebuffer.width() != job.width || m_framebuffer.height() != job.height) {
+            m_framebuffer.resize(job.width, job.height);
+        }
+        m_rasterizer.rasterize(context.displayList(), m_framebuffer, rendering::Color(255, 255, 255));
+
+        if (!job.pngPath.empty() && !rendering::writePNG(m_framebuffer, job.pngPath)) {
+            result.error = "Failed to write " + job.pngPath;
+            return;
+        }
+        if (job.keepPixels) {
+            // The next page reallocates
+            std::swap(result.pixels, m_framebuffer);
+        }
+        result.success = true;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+}
+
+//-----------------------------------------------------------------------------
+// BatchRenderer Implementation
+//-----------------------------------------------------------------------------
+
+namespace {
+
+size_t resolveThreadCount(size_t threadCount) {
+    if (threadCount > 0) {
+        return threadCount;
+    }
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+} // namespace
+
+BatchRenderer::BatchRenderer(size_t threadCount)
+    : m_pool(resolveThreadCount(threadCount) - 1)
+    , m_lastPages(0)
+    , m_lastSeconds(0)
+{
+    for (size_t i = 0; i < resolveThreadCount(threadCount); ++i) {
+        m_pipelines.push_back(std::make_unique<Pipeline>(m_styleSheetCache));
+    }
+}
+
+BatchRenderer::~BatchRenderer() {
+}
+
+std::vector<BatchResult> BatchRenderer::render(const std::vector<BatchJob>& jobs) {
+    TRACE_SCOPE("batch", "BatchRenderer::render");
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<BatchResult> results(jobs.size());
+    std::atomic<size_t> nextJob{0};
+    {
+        threading::TaskGroup group(m_pool);
+        size_t pipelines = std::min(m_pipelines.size(), jobs.size());
+        for (size_t i = 0; i < pipelines; ++i) {
+            Pipeline* pipeline = m_pipelines[i].get();
+            group.run([pipeline, &jobs, &results, &nextJob]() {
+                for (size_t job = nextJob++; job < jobs.size(); job = nextJob++) {
+                    pipeline->render(jobs[job], results[job]);
+                }
+            });
+        }
+        group.wait();
+    }
+
+    m_lastPages = jobs.size();
+    m_lastSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    TRACE_COUNTER("batch", "pagesPerSecond", static_cast<int64_t>(pagesPerSecond()));
+    return results;
+}
+
+double BatchRenderer::pagesPerSecond() const {
+    return m_lastSeconds > 0 ? m_lastPages / m_lastSeconds : 0;
+}
+
+} // namespace browser
@@ -0,0 +1,72 @@
+#ifndef BROWSER_BATCH_RENDERER_H
+#define BROWSER_BATCH_RENDERER_H
+
+#include "../css/stylesheet_cache.h"
+#include "../rendering/framebuffer.h"
+#include "../threading/work_pool.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace browser {
+
+// A page to render headless: markup, extra CSS applied after the
+// document's <style> sheets, and the viewport it's laid out in and drawn at
+struct BatchJob {
+    std::string html;
+    std::string css;
+    int width = 1024;
+    int height = 768;
+    std::string pngPath;     // Written when set
+    bool keepPixels = true;  // Return the pixels in BatchResult::pixels
+};
+
+struct BatchResult {
+    bool success = false;
+    std::string error;
+    rendering::Framebuffer pixels;
+    size_t displayItems = 0;
+};
+
+// Renders batches of pages offscreen for snapshot workloads, with no
+// window, scripts or network. Each thread owns a pipeline (parser, paint
+// system, rasterizer and framebuffer) that is reused from page to page and
+// takes the next job when it finishes one, so pages render concurrently
+// without sharing state; only the parsed stylesheets, keyed by their text,
+// are shared between pipelines. Styling, layout and rasterization of a
+// page stay on its pipeline's thread.
+class BatchRenderer {
+public:
+    // threadCount 0 uses one per core
+    explicit BatchRenderer(size_t threadCount = 0);
+    ~BatchRenderer();
+
+    BatchRenderer(const BatchRenderer&) = delete;
+    BatchRenderer& operator=(const BatchRenderer&) = delete;
+
+    // Render every job; results are in job order. Blocks until done.
+    std::vector<BatchResult> render(const std::vector<BatchJob>& jobs);
+
+    size_t threadCount() const { return m_pipelines.size(); }
+
+    // Stylesheets parsed so far, e.g. to set a directory for compiled sheets
+    css::StyleSheetCache& styleSheetCache() { return m_styleSheetCache; }
+
+    // Wall time and throughput of the last render()
+    double lastSeconds() const { return m_lastSeconds; }
+    double pagesPerSecond() const;
+
+private:
+    class Pipeline;
+
+    css::StyleSheetCache m_styleSheetCache;
+    std::vector<std::unique_ptr<Pipeline>> m_pipelines;
+    threading::WorkPool m_pool;  // The calling thread runs one pipeline
+    size_t m_lastPages;
+    double m_lastSeconds;
+};
+
+} // namespace browser
+
+#endif // BROWSER_BATCH_RENDERER_H
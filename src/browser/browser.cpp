@@ -2,26 +2,85 @@
 #include "browser.h"
 #include "../networking/http_client.h"
 #include "../storage/local_storage.h"
+#include "../html/dom_traversal.h"
+#include "../rendering/image_cache.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <cctype>
 #include <chrono>
 
 namespace browser {
 
-Browser::Browser() 
-    : m_resourceLoader(std::make_unique<networking::ResourceLoader>())
-    , m_securityManager(std::make_unique<security::SecurityManager>()) {
+namespace {
+
+// Whether a response's Cache-Control forbids keeping it
+bool hasNoStore(const std::map<std::string, std::string>& headers) {
+    auto found = headers.find("Cache-Control");
+    if (found == headers.end()) {
+        return false;
+    }
+    std::string value = found->second;
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return value.find("no-store") != std::string::npos;
+}
+
+} // namespace
+
+Browser::Browser(std::shared_ptr<EngineContext> context) 
+    : m_context(context ? std::move(context) : std::make_shared<EngineContext>())
+    , m_styleSheetCache(m_context->styleSheetCache())
+    , m_scriptCache(std::make_shared<custom_js::ScriptCache>())
+    , m_resourceLoader(m_context->resourceLoader())
+    , m_securityManager(std::make_unique<security::SecurityManager>())
+    , m_page(std::make_unique<Page>(1))
+    , m_nextPageId(2)
+    , m_initialized(false)
+    , m_scriptingInitialized(false)
+    , m_scriptingReady(false)
+    , m_viewportWidth(1024)
+    , m_viewportHeight(768) {
+    m_context->attach();
+    registerCaches();
 }
 
 Browser::~Browser() {
-    // Cleanup in reverse order of initialization
+    // Cleanup in reverse order of initialization; queued scripts don't run
+    if (m_scriptThread) {
+        m_scriptThread->cancelPending();
+    }
+    
+    // The context's loader goes on serving other browsers; only this one's
+    // loads stop
+    cancelPreloads();
+    for (const auto& entry : m_page->imageRequests) {
+        if (!entry.second->isComplete()) {
+            m_resourceLoader->cancel(entry.second);
+        }
+    }
+    m_context->detach();
+}
+
+void Browser::setCacheDirectory(const std::string& directory) {
+    m_cacheDirectory = directory;
+    m_context->setCacheDirectory(directory);
 }
 
 bool Browser::initialize() {
+    if (m_initialized) {
+        return true;
+    }
+    TRACE_SCOPE("startup", "Browser::initialize");
     std::cout << "Initializing browser components..." << std::endl;
     
+    // Networking isn't needed to show the first page, which is local; it
+    // comes up meanwhile, unless another browser started it already
+    m_context->initialize();
+    
     // Initialize HTML parser
     if (!m_htmlParser.initialize()) {
         std::cerr << "Failed to initialize HTML parser" << std::endl;
@@ -29,19 +88,13 @@ bool Browser::initialize() {
     }
     
     // Initialize CSS style resolver
-    if (!m_styleResolver.initialize()) {
+    if (!m_page->styleResolver.initialize()) {
         std::cerr << "Failed to initialize style resolver" << std::endl;
         return false;
     }
     
-    // Initialize JavaScript engine
-    if (!m_jsEngine.initialize()) {
-        std::cerr << "Failed to initialize JavaScript engine" << std::endl;
-        return false;
-    }
-    
     // Initialize layout engine
-    if (!m_layoutEngine.initialize()) {
+    if (!m_page->layoutEngine.initialize()) {
         std::cerr << "Failed to initialize layout engine" << std::endl;
         return false;
     }
@@ -52,10 +105,11 @@ bool Browser::initialize() {
         return false;
     }
     
-    // Initialize resource loader
-    if (!m_resourceLoader->initialize()) {
-        std::cerr << "Failed to initialize resource loader" << std::endl;
-        return false;
+    // Compiled scripts are read back from the start, the first page's
+    // included, without waiting for the HTTP cache; the context does the
+    // same for stylesheets
+    if (!m_cacheDirectory.empty()) {
+        m_scriptCache->setDirectory(m_cacheDirectory + "/scripts");
     }
     
     // Initialize security manager
@@ -64,91 +118,149 @@ bool Browser::initialize() {
         return false;
     }
     
-    // Start resource loader thread
-    m_resourceLoader->start();
-    
-    // Set up JavaScript bindings
-    setupJavaScriptBindings();
+    // The JavaScript engine is set up on the script thread while the first
+    // page loads; without one, before the first script runs
+    if (m_scriptThread) {
+        m_scriptThread->post([this] { ensureScripting(); });
+    }
     
+    m_initialized = true;
     std::cout << "Browser components initialized successfully" << std::endl;
     return true;
 }
 
+bool Browser::ensureScripting() {
+    if (!m_scriptingInitialized) {
+        TRACE_SCOPE("startup", "Browser::initializeScripting");
+        m_scriptingInitialized = true;
+        m_scriptingReady = initializeScripting();
+        if (!m_scriptingReady) {
+            std::cerr << "Failed to initialize JavaScript engine" << std::endl;
+        }
+    }
+    return m_scriptingReady;
+}
+
 bool Browser::loadUrl(const std::string& url, std::string& error) {
+    TRACE_SCOPE_DETAIL("navigation", "Browser::loadUrl", url);
     std::cout << "Loading URL: " << url << std::endl;
     
     // Clear pending navigation
     m_pendingNavigationUrl.clear();
     
+    // The previous document's scripts stop before it goes away
+    stopScripts();
+    cancelPreloads();
+    
     try {
         // Special handling for about: URLs
         if (url.substr(0, 6) == "about:") {
             return loadAboutPage(url, error);
         }
         
-        // Parse URL to get origin
-        security::Origin targetOrigin(url);
+        // Parse URL to get origin; resources of the page are resolved
+        // against it without parsing it again
+        security::Url targetUrl(url);
+        const security::Origin& targetOrigin = targetUrl.origin();
         
         // Security check for navigation
-        if (m_currentOrigin.toString() != "null") {
-            if (!m_securityManager->canMakeRequest(m_currentOrigin, targetOrigin, "GET", "")) {
+        if (!m_page->origin.isNull()) {
+            if (!m_securityManager->canMakeRequest(m_page->origin, targetOrigin, "GET", "")) {
                 error = "Navigation blocked by security policy";
                 return false;
             }
         }
         
-        // Load the resource
-        std::vector<uint8_t> data;
-        std::map<std::string, std::string> headers;
-        
-        if (!m_resourceLoader->loadResource(url, data, headers, error)) {
+        if (!m_context->waitForNetworking()) {
+            error = "Networking is not available";
             return false;
         }
         
-        // Process security headers
-        processSecurityHeaders(headers, url);
-        
-        // Convert data to string (assuming UTF-8)
-        std::string html(data.begin(), data.end());
+        // Load the resource, tokenizing the body as it arrives
+        networking::ResourceBody data;
+        std::map<std::string, std::string> headers;
+        size_t streamedBytes = 0;
+        std::unique_ptr<Page> page = createPage(targetUrl);
+        bool headersProcessed = false;
         
-        // Parse HTML
         std::cout << "Parsing HTML..." << std::endl;
-        m_domTree = m_htmlParser.parse(html);
+        {
+            TRACE_SCOPE("navigation", "Browser::fetchDocument");
+            
+            // Subresources start loading as the parser reaches them, so
+            // they arrive while the rest of the document still streams in.
+            // Only once the document's security headers are in force.
+            m_htmlParser.beginParse();
+            m_htmlParser.setElementInsertedCallback([this, &page, &headersProcessed](html::Element* element) {
+                if (!headersProcessed || !preloadFor(element, *page)) {
+                    prefetchDnsFor(element, page->url);
+                }
+            });
+            
+            auto onHeaders = [this, &url, &headersProcessed](const std::map<std::string, std::string>& responseHeaders) {
+                processSecurityHeaders(responseHeaders, url);
+                headersProcessed = true;
+            };
+            auto onData = [this, &streamedBytes](const uint8_t* bytes, size_t length) {
+                m_htmlParser.feed(reinterpret_cast<const char*>(bytes), length);
+                streamedBytes += length;
+            };
+            
+            if (!m_resourceLoader->loadResource(url, data, headers, error, onData, onHeaders)) {
+                m_htmlParser.setElementInsertedCallback(nullptr);
+                m_htmlParser.finish();
+                return false;
+            }
+            
+            // Cached responses' headers only come with the whole body
+            if (!headersProcessed) {
+                processSecurityHeaders(headers, url);
+                headersProcessed = true;
+            }
+            
+            // Cached or non-streamable responses arrive in one piece
+            if (streamedBytes == 0 && !data->empty()) {
+                m_htmlParser.feed(reinterpret_cast<const char*>(data->data()), data->size());
+            }
+            
+            page->domTree = m_htmlParser.finish();
+            m_htmlParser.setElementInsertedCallback(nullptr);
+        }
         
-        if (!m_domTree.document()) {
+        if (!page->domTree.document()) {
             error = "Failed to parse HTML";
             return false;
         }
         
-        // Update current URL and origin
-        m_currentUrl = url;
-        m_currentOrigin = targetOrigin;
+        TRACE_COUNTER("navigation", "documentBytes", static_cast<int64_t>(streamedBytes > 0 ? streamedBytes : data->size()));
+        
+        // The new document replaces the current one, which is kept for
+        // history navigation unless the server asked not to store it
+        page->cacheable = !hasNoStore(headers);
+        showPage(std::move(page));
+        
+        // Start fetching stylesheets, scripts and images together
+        std::shared_ptr<SubresourceLoad> subresources = startSubresourceLoads(m_page->url);
         
         // Load stylesheets
         std::cout << "Loading stylesheets..." << std::endl;
-        if (!loadStylesheets(url)) {
+        if (!applyStylesheets(*subresources)) {
             std::cerr << "Warning: Some stylesheets failed to load" << std::endl;
         }
         
         // Resolve styles
         std::cout << "Resolving styles..." << std::endl;
-        m_styleResolver.setDocument(m_domTree.document());
-        m_styleResolver.resolveStyles();
+        m_page->styleResolver.setDocument(m_page->domTree.document());
+        m_page->styleResolver.resolveStyles();
         
         // Calculate layout
         std::cout << "Calculating layout..." << std::endl;
-        m_layoutEngine.layoutDocument(
-            m_domTree.document(),
-            &m_styleResolver,
-            1024, // Default viewport width
-            768   // Default viewport height
-        );
+        layoutPage();
+        prioritizeVisibleImages();
         
         // Execute scripts
         std::cout << "Executing scripts..." << std::endl;
-        if (!loadScripts(url)) {
-            std::cerr << "Warning: Some scripts failed to load" << std::endl;
-        }
+        runScripts(subresources);
         
         // Check for pending navigation from JavaScript
         if (!m_pendingNavigationUrl.empty()) {
@@ -160,9 +272,7 @@ bool Browser::loadUrl(const std::string& url, std::string& error) {
             return loadUrl(pendingUrl, error);
         }
         
-        // Load images (asynchronously)
-        loadImages(url);
-        
+        tracing::AllocTracker::reportCounters();
         std::cout << "Page loaded successfully" << std::endl;
         return true;
         
@@ -644,40 +754,48 @@ bool Browser::loadAboutPage(const std::string& url, std::string& error) {
 </body>
 </html>
 )HTML";
+    } else if (url == "about:tracing") {
+        // Rolling summary of page-load stage timings
+        html = tracing::Tracer::instance().summaryHtml();
+    } else if (url == "about:memory") {
+        // What each cache holds against its budget
+        size_t browsers = m_context->browserCount();
+        html = MemoryManager::pageHtml(
+            m_memoryManager.summaryHtml("This browser") +
+            m_context->memoryManager()->summaryHtml("Shared by " + std::to_string(browsers) +
+                                                    (browsers == 1 ? " browser" : " browsers")));
     } else {
         error = "Unknown about: page";
         return false;
     }
     
     // Parse the about page HTML
-    m_domTree = m_htmlParser.parse(html);
-    m_currentUrl = url;
-    m_currentOrigin = security::Origin::null();
+    // Cheap to build again, and some show live data, so they aren't cached
+    std::unique_ptr<Page> page = createPage(security::Url(url));
+    page->domTree = m_htmlParser.parse(html);
+    page->cacheable = false;
+    showPage(std::move(page));
+    
+    std::shared_ptr<SubresourceLoad> subresources = startSubresourceLoads(m_page->url);
     
     // Load stylesheets (including inline styles)
     std::cout << "Loading stylesheets for about page..." << std::endl;
-    if (!loadStylesheets(url)) {
+    if (!applyStylesheets(*subresources)) {
         std::cerr << "Warning: Failed to load stylesheets for about page" << std::endl;
     }
     
     // Resolve styles
     std::cout << "Resolving styles..." << std::endl;
-    m_styleResolver.setDocument(m_domTree.document());
-    m_styleResolver.resolveStyles();
+    m_page->styleResolver.setDocument(m_page->domTree.document());
+    m_page->styleResolver.resolveStyles();
     
     // Calculate layout
     std::cout << "Calculating layout..." << std::endl;
-    m_layoutEngine.layoutDocument(
-        m_domTree.document(),
-        &m_styleResolver,
-        1024, 768
-    );
+    layoutPage();
     
     // Execute scripts for interactivity - THIS IS CRITICAL!
     std::cout << "Loading scripts for about page..." << std::endl;
-    if (!loadScripts(url)) {
-        std::cerr << "Warning: Failed to load scripts for about page" << std::endl;
-    }
+    runScripts(subresources);
     
     // Check for pending navigation from JavaScript
     if (!m_pendingNavigationUrl.empty()) {
@@ -693,169 +811,330 @@ bool Browser::loadAboutPage(const std::string& url, std::string& error) {
 }
 
 std::string Browser::resolveUrl(const std::string& baseUrl, const std::string& relativeUrl) {
-    // Check if already absolute
-    if (relativeUrl.find("://") != std::string::npos) {
-        return relativeUrl;
+    return resolveUrl(security::Url(baseUrl), relativeUrl);
+}
+
+std::string Browser::resolveUrl(const security::Url& baseUrl, const std::string& relativeUrl) const {
+    return baseUrl.resolve(relativeUrl).spec();
+}
+
+void Browser::prefetchDnsFor(html::Element* element, const security::Url& baseUrl) {
+    std::string reference;
+    if (element->tagAtom() == html::atoms::LINK) {
+        std::string rel = element->getAttribute(html::atoms::REL);
+        if (rel == "stylesheet" || rel == "dns-prefetch" || rel == "preconnect") {
+            reference = element->getAttribute(html::atoms::HREF);
+        }
+    } else if (element->tagAtom() == html::atoms::SCRIPT || element->tagAtom() == html::atoms::IMG) {
+        reference = element->getAttribute(html::atoms::SRC);
     }
     
-    try {
-        // Parse base URL
-        size_t schemeEnd = baseUrl.find("://");
-        if (schemeEnd == std::string::npos) {
-            return relativeUrl; // Invalid base URL
-        }
-        
-        std::string scheme = baseUrl.substr(0, schemeEnd + 3);
-        std::string baseWithoutScheme = baseUrl.substr(schemeEnd + 3);
-        
-        // Handle absolute paths
-        if (relativeUrl[0] == '/') {
-            size_t pathStart = baseWithoutScheme.find('/');
-            if (pathStart == std::string::npos) {
-                return scheme + baseWithoutScheme + relativeUrl;
-            } else {
-                return scheme + baseWithoutScheme.substr(0, pathStart) + relativeUrl;
-            }
-        } 
-        
-        // Handle relative paths
-        size_t lastSlash = baseUrl.find_last_of('/');
-        if (lastSlash == std::string::npos || lastSlash < schemeEnd + 3) {
-            return baseUrl + "/" + relativeUrl;
-        } else {
-            return baseUrl.substr(0, lastSlash + 1) + relativeUrl;
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error resolving URL: " << e.what() << std::endl;
-        return relativeUrl;
+    if (!reference.empty()) {
+        m_resourceLoader->prefetchDns(baseUrl.resolve(reference));
     }
 }
 
-bool Browser::loadStylesheets(const std::string& baseUrl) {
-    auto links = m_domTree.document()->getElementsByTagName("link");
-    bool allLoaded = true;
+std::shared_ptr<Browser::SubresourceLoad> Browser::startSubresourceLoads(const security::Url& baseUrl) {
+    auto load = std::make_shared<SubresourceLoad>();
+    html::Document* document = m_page->domTree.document();
+    if (!document) {
+        return load;
+    }
     
-    for (html::Element* link : links) {
-        if (link->getAttribute("rel") == "stylesheet") {
-            std::string href = link->getAttribute("href");
+    // Collect stylesheets and scripts in document order
+    for (html::Element* element : html::elementsOf(document)) {
+        if (element->tagAtom() == html::atoms::LINK) {
+            if (element->getAttribute(html::atoms::REL) != "stylesheet") continue;
+            std::string href = element->getAttribute(html::atoms::HREF);
             if (href.empty()) continue;
             
             std::string fullUrl = resolveUrl(baseUrl, href);
             
             // Check CSP
-            if (!m_securityManager->isAllowedByCSP(fullUrl, security::CspResourceType::STYLE, m_currentOrigin)) {
+            if (!m_securityManager->isAllowedByCSP(fullUrl, security::CspResourceType::STYLE, m_page->origin)) {
                 std::cerr << "Stylesheet blocked by CSP: " << fullUrl << std::endl;
                 continue;
             }
             
-            // Load stylesheet
-            std::vector<uint8_t> data;
-            std::map<std::string, std::string> headers;
-            std::string error;
-
-            if (m_resourceLoader->loadResource(fullUrl, data, headers, error)) {
-                std::string css(data.begin(), data.end());
+            Subresource sheet;
+            sheet.url = fullUrl;
+            load->styleSheets.push_back(std::move(sheet));
+        } else if (element->tagAtom() == html::atoms::STYLE) {
+            Subresource sheet;
+            sheet.text = element->textContent();
+            sheet.done = true;
+            if (!sheet.text.empty()) {
+                load->styleSheets.push_back(std::move(sheet));
+            }
+        } else if (element->tagAtom() == html::atoms::SCRIPT) {
+            Subresource script;
+            std::string src = element->getAttribute(html::atoms::SRC);
+            
+            if (!src.empty()) {
+                std::string fullUrl = resolveUrl(baseUrl, src);
                 
-                // Parse and add stylesheet
-                try {
-                    // Create a CSS parser
-                    css::CSSParser parser;
-                    
-                    // Parse the CSS text
-                    auto stylesheet = parser.parseStylesheet(css);
-                    
-                    if (stylesheet) {
-                        m_styleResolver.addStyleSheet(*stylesheet);
-                        std::cout << "Successfully loaded external stylesheet: " << fullUrl 
-                                << " with " << stylesheet->rules().size() << " rules" << std::endl;
-                    } else {
-                        std::cerr << "Failed to parse stylesheet from: " << fullUrl << std::endl;
-                        allLoaded = false;
-                    }
-                } catch (const std::exception& e) {
-                    std::cerr << "Failed to parse stylesheet: " << e.what() << std::endl;
-                    allLoaded = false;
+                // Check CSP
+                if (!m_securityManager->isAllowedByCSP(fullUrl, security::CspResourceType::SCRIPT, m_page->origin)) {
+                    std::cerr << "Script blocked by CSP: " << fullUrl << std::endl;
+                    continue;
                 }
+                script.url = fullUrl;
+                
+                // Scripts that don't block the parser can wait for fonts
+                script.async = element->hasAttribute("async") || element->hasAttribute("defer");
             } else {
-                std::cerr << "Failed to load stylesheet: " << error << std::endl;
-                allLoaded = false;
+                script.text = element->textContent();
+                script.done = true;
             }
+            load->scripts.push_back(std::move(script));
         }
     }
     
-    // Also process inline styles
-    auto styles = m_domTree.document()->getElementsByTagName("style");
-    for (html::Element* style : styles) {
-        std::string css = style->textContent();
-        if (!css.empty()) {
-            try {
-                // Create a CSS parser
-                css::CSSParser parser;
-                
-                // Parse the CSS text into a stylesheet
-                auto stylesheet = parser.parseStylesheet(css);
+    // Issue every external fetch before waiting on any of them. Slots are
+    // only written under the load's mutex once the vectors are complete.
+    for (size_t i = 0; i < load->styleSheets.size(); ++i) {
+        if (load->styleSheets[i].done) continue;
+        
+        std::shared_ptr<css::StyleSheetCache> styleSheetCache = m_styleSheetCache;
+        fetchSubresource(load->styleSheets[i].url,
+            [load, i, styleSheetCache](bool success, const networking::ResourceBody& body,
+                      const std::map<std::string, std::string>& /*headers*/, const std::string& error) {
+                // Parse (or load the compiled sheet) on the worker thread
+                std::shared_ptr<const css::StyleSheet> styleSheet;
+                if (success) {
+                    styleSheet = styleSheetCache->get(
+                        std::string_view(reinterpret_cast<const char*>(body->data()), body->size()));
+                }
                 
-                if (stylesheet) {
-                    // Add the parsed stylesheet to the style resolver
-                    m_styleResolver.addStyleSheet(*stylesheet);
-                    std::cout << "Successfully parsed inline stylesheet with " 
-                              << stylesheet->rules().size() << " rules" << std::endl;
-                } else {
-                    std::cerr << "Failed to parse inline style content" << std::endl;
-                    allLoaded = false;
+                std::lock_guard<std::mutex> lock(load->mutex);
+                Subresource& sheet = load->styleSheets[i];
+                sheet.styleSheet = styleSheet;
+                sheet.loaded = styleSheet != nullptr;
+                sheet.error = success ? (styleSheet ? "" : "parse failed") : error;
+                sheet.done = true;
+                load->ready.notify_all();
+            }, networking::ResourceType::CSS);
+    }
+    
+    for (size_t i = 0; i < load->scripts.size(); ++i) {
+        if (load->scripts[i].done) continue;
+        
+        std::shared_ptr<networking::ResourceRequest> request = fetchSubresource(load->scripts[i].url,
+            [load, i](bool success, const networking::ResourceBody& body,
+                      const std::map<std::string, std::string>& /*headers*/, const std::string& error) {
+                std::lock_guard<std::mutex> lock(load->mutex);
+                Subresource& script = load->scripts[i];
+                if (success) {
+                    script.text.assign(body->begin(), body->end());
                 }
-            } catch (const std::exception& e) {
-                std::cerr << "Failed to parse inline style: " << e.what() << std::endl;
-                allLoaded = false;
-            }
+                script.loaded = success;
+                script.error = error;
+                script.done = true;
+                load->ready.notify_all();
+            }, networking::ResourceType::JAVASCRIPT);
+        if (request && load->scripts[i].async) {
+            m_resourceLoader->setPriority(request, networking::PRIORITY_MEDIUM);
         }
     }
     
-    return allLoaded;
+    cancelPreloads();
+    
+    // Images are decoded as they arrive and never block the page
+    loadImages(baseUrl);
+    
+    return load;
 }
 
-bool Browser::loadScripts(const std::string& baseUrl) {
-    // Clear pending navigation
-    m_pendingNavigationUrl.clear();
+bool Browser::preloadFor(html::Element* element, Page& page) {
+    std::string reference;
+    networking::ResourceType type;
+    security::CspResourceType cspType;
+    if (element->tagAtom() == html::atoms::LINK) {
+        if (element->getAttribute(html::atoms::REL) != "stylesheet") return false;
+        reference = element->getAttribute(html::atoms::HREF);
+        type = networking::ResourceType::CSS;
+        cspType = security::CspResourceType::STYLE;
+    } else if (element->tagAtom() == html::atoms::SCRIPT) {
+        reference = element->getAttribute(html::atoms::SRC);
+        type = networking::ResourceType::JAVASCRIPT;
+        cspType = security::CspResourceType::SCRIPT;
+    } else if (element->tagAtom() == html::atoms::IMG) {
+        reference = element->getAttribute(html::atoms::SRC);
+        type = networking::ResourceType::IMAGE;
+        cspType = security::CspResourceType::IMG;
+    } else {
+        return false;
+    }
+    if (reference.empty()) {
+        return false;
+    }
+    
+    // Blocked loads are reported when the document's own loads are made
+    std::string url = resolveUrl(page.url, reference);
+    if (!m_securityManager->isAllowedByCSP(url, cspType, page.origin)) {
+        return false;
+    }
     
-    auto scripts = m_domTree.document()->getElementsByTagName("script");
+    if (type == networking::ResourceType::IMAGE) {
+        if (page.imageRequests.count(element) == 0) {
+            page.imageRequests[element] = queueImageLoad(url);
+        }
+        return true;
+    }
+    if (m_preloads.count(url) != 0) {
+        return true;
+    }
+    
+    auto preload = std::make_shared<Preload>();
+    preload->request = m_resourceLoader->fetch(url,
+        [preload](bool success, const networking::ResourceBody& body,
+                  const std::map<std::string, std::string>& headers, const std::string& error) {
+            networking::FetchCallback callback;
+            {
+                std::lock_guard<std::mutex> lock(preload->mutex);
+                preload->success = success;
+                preload->body = body;
+                preload->headers = headers;
+                preload->error = error;
+                preload->done = true;
+                callback = std::move(preload->callback);
+            }
+            if (callback) {
+                callback(success, body, headers, error);
+            }
+        }, type);
+    
+    // Scripts that don't block the parser can wait for fonts
+    if (preload->request && (element->hasAttribute("async") || element->hasAttribute("defer"))) {
+        m_resourceLoader->setPriority(preload->request, networking::PRIORITY_MEDIUM);
+    }
+    m_preloads[url] = preload;
+    return true;
+}
+
+std::shared_ptr<networking::ResourceRequest> Browser::fetchSubresource(const std::string& url,
+                                                                       networking::FetchCallback callback,
+                                                                       networking::ResourceType type) {
+    auto found = m_preloads.find(url);
+    if (found == m_preloads.end()) {
+        m_context->waitForNetworking();
+        return m_resourceLoader->fetch(url, std::move(callback), type);
+    }
+    
+    // A second reference to the URL fetches again, sharing the first load
+    // or its cache entry
+    std::shared_ptr<Preload> preload = found->second;
+    m_preloads.erase(found);
+    
+    std::unique_lock<std::mutex> lock(preload->mutex);
+    if (!preload->done) {
+        preload->callback = std::move(callback);
+        return preload->request;
+    }
+    lock.unlock();
+    callback(preload->success, preload->body, preload->headers, preload->error);
+    return preload->request;
+}
+
+void Browser::cancelPreloads() {
+    for (const auto& entry : m_preloads) {
+        const auto& request = entry.second->request;
+        if (request && !request->isComplete()) {
+            m_resourceLoader->cancel(request);
+        }
+    }
+    m_preloads.clear();
+}
+
+bool Browser::applyStylesheets(SubresourceLoad& load) {
+    TRACE_SCOPE("navigation", "Browser::applyStylesheets");
     bool allLoaded = true;
     
-    for (html::Element* script : scripts) {
-        std::string src = script->getAttribute("src");
-        std::string scriptContent;
+    // Merge in document order, waiting for each sheet in turn
+    for (size_t i = 0; i < load.styleSheets.size(); ++i) {
+        std::shared_ptr<const css::StyleSheet> styleSheet;
+        std::string url, text, error;
+        {
+            std::unique_lock<std::mutex> lock(load.mutex);
+            Subresource& sheet = load.styleSheets[i];
+            load.ready.wait(lock, [&sheet] { return sheet.done; });
+            styleSheet = sheet.styleSheet;
+            url = sheet.url;
+            text = std::move(sheet.text);
+            error = sheet.error;
+        }
         
-        if (!src.empty()) {
-            // External script
-            std::string fullUrl = resolveUrl(baseUrl, src);
-            
-            // Check CSP
-            if (!m_securityManager->isAllowedByCSP(fullUrl, security::CspResourceType::SCRIPT, m_currentOrigin)) {
-                std::cerr << "Script blocked by CSP: " << fullUrl << std::endl;
-                continue;
+        if (!url.empty()) {
+            if (styleSheet) {
+                m_page->styleResolver.addStyleSheet(*styleSheet);
+                std::cout << "Successfully loaded external stylesheet: " << url 
+                          << " with " << styleSheet->rules().size() << " rules" << std::endl;
+            } else {
+                std::cerr << "Failed to load stylesheet " << url << ": " << error << std::endl;
+                allLoaded = false;
             }
+            continue;
+        }
+        
+        // Inline style
+        try {
+            auto inlineSheet = m_styleSheetCache->get(text);
             
-            // Load script
-            std::vector<uint8_t> data;
-            std::map<std::string, std::string> headers;
-            std::string error;
-            
-            if (m_resourceLoader->loadResource(fullUrl, data, headers, error)) {
-                scriptContent = std::string(data.begin(), data.end());
-                std::cout << "Loaded external script from: " << fullUrl << std::endl;
+            if (inlineSheet) {
+                m_page->styleResolver.addStyleSheet(*inlineSheet);
+                std::cout << "Successfully parsed inline stylesheet with " 
+                          << inlineSheet->rules().size() << " rules" << std::endl;
             } else {
+                std::cerr << "Failed to parse inline style content" << std::endl;
+                allLoaded = false;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to parse inline style: " << e.what() << std::endl;
+            allLoaded = false;
+        }
+    }
+    
+    TRACE_COUNTER("css", "styleSheetCacheMemoryHits", static_cast<int64_t>(m_styleSheetCache->memoryHits()));
+    TRACE_COUNTER("css", "styleSheetCacheDiskHits", static_cast<int64_t>(m_styleSheetCache->diskHits()));
+    TRACE_COUNTER("css", "styleSheetCacheMisses", static_cast<int64_t>(m_styleSheetCache->misses()));
+    return allLoaded;
+}
+
+bool Browser::executeScripts(SubresourceLoad& load) {
+    TRACE_SCOPE("navigation", "Browser::executeScripts");
+    if (!ensureScripting()) {
+        return false;
+    }
+    bool allLoaded = true;
+    
+    // Execute in document order, waiting for each script in turn
+    for (size_t i = 0; i < load.scripts.size(); ++i) {
+        std::string url, scriptContent, error;
+        bool loaded;
+        {
+            std::unique_lock<std::mutex> lock(load.mutex);
+            Subresource& script = load.scripts[i];
+            load.ready.wait(lock, [&script] { return script.done; });
+            url = script.url;
+            scriptContent = std::move(script.text);
+            error = script.error;
+            loaded = script.loaded;
+        }
+        
+        if (!url.empty()) {
+            if (!loaded) {
                 std::cerr << "Failed to load script: " << error << std::endl;
                 allLoaded = false;
                 continue;
             }
+            std::cout << "Loaded external script from: " << url << std::endl;
         } else {
-            // Inline script - THIS IS THE FIX!
+            // Inline script
             if (!m_securityManager->contentSecurityPolicy()->allowsInlineScript()) {
                 std::cerr << "Inline script blocked by CSP" << std::endl;
                 continue;
             }
             
-            scriptContent = script->textContent();
             if (!scriptContent.empty()) {
                 std::cout << "Found inline script with " << scriptContent.length() << " characters" << std::endl;
             }
@@ -864,9 +1143,9 @@ bool Browser::loadScripts(const std::string& baseUrl) {
         // Execute script
         if (!scriptContent.empty()) {
             std::cout << "Executing script..." << std::endl;
-            std::string result, error;
-            if (!m_jsEngine.executeScript(scriptContent, result, error)) {
-                std::cerr << "Script execution error: " << error << std::endl;
+            std::string result, scriptError;
+            if (!m_jsEngine.executeScript(scriptContent, result, scriptError)) {
+                std::cerr << "Script execution error: " << scriptError << std::endl;
                 allLoaded = false;
             } else {
                 std::cout << "Script executed successfully" << std::endl;
@@ -874,48 +1153,266 @@ bool Browser::loadScripts(const std::string& baseUrl) {
                     std::cout << "Script result: " << result << std::endl;
                 }
             }
+            
+            // Without a script thread, the next script sees this one's
+            // mutations; with it, the main thread applies them each frame
+            if (!m_scriptThread) {
+                commitDOMMutations();
+            }
         }
     }
     
-    // After all scripts are executed, check for pending navigation
-    if (!m_pendingNavigationUrl.empty()) {
-        std::cout << "Pending navigation detected: " << m_pendingNavigationUrl << std::endl;
-        // Navigation will be handled by the caller
+    TRACE_COUNTER("js", "scriptCacheMemoryHits", static_cast<int64_t>(m_scriptCache->memoryHits()));
+    TRACE_COUNTER("js", "scriptCacheDiskHits", static_cast<int64_t>(m_scriptCache->diskHits()));
+    TRACE_COUNTER("js", "scriptCacheMisses", static_cast<int64_t>(m_scriptCache->misses()));
+    return allLoaded;
+}
+
+void Browser::runScripts(std::shared_ptr<SubresourceLoad> load) {
+    if (!m_scriptThread) {
+        if (!executeScripts(*load)) {
+            std::cerr << "Warning: Some scripts failed to load" << std::endl;
+        }
+        return;
     }
     
-    return allLoaded;
+    // The caller goes on while the scripts wait for their fetches and run
+    m_scriptThread->post([this, load] {
+        if (!executeScripts(*load)) {
+            std::cerr << "Warning: Some scripts failed to load" << std::endl;
+        }
+    });
+}
+
+void Browser::stopScripts() {
+    if (m_scriptThread) {
+        size_t cancelled = m_scriptThread->cancelPending();
+        if (cancelled > 0) {
+            std::cout << "Cancelled scripts of the previous page" << std::endl;
+        }
+        m_scriptThread->waitIdle();
+    }
+    m_domMutations.clear();
+}
+
+bool Browser::commitDOMMutations() {
+    std::vector<DOMMutation> mutations = m_domMutations.take();
+    if (mutations.empty()) {
+        return false;
+    }
+    TRACE_SCOPE("js", "Browser::commitDOMMutations");
+    
+    std::string navigationUrl;
+    {
+        std::lock_guard<std::mutex> lock(m_documentMutex);
+        bool changed = false;
+        for (const DOMMutation& mutation : mutations) {
+            switch (mutation.type) {
+                case DOMMutation::Type::SET_ATTRIBUTE:
+                    mutation.element->setAttribute(mutation.name, mutation.value);
+                    changed = true;
+                    break;
+                case DOMMutation::Type::REMOVE_ATTRIBUTE:
+                    mutation.element->removeAttribute(mutation.name);
+                    changed = true;
+                    break;
+                case DOMMutation::Type::NAVIGATE:
+                    navigationUrl = mutation.value;
+                    break;
+            }
+        }
+        
+        // One restyle and layout for the whole batch, limited to what the
+        // mutations dirtied
+        if (changed && m_page->domTree.document()) {
+            m_page->styleResolver.updateStyles();
+            layoutPage();
+            prioritizeVisibleImages();
+        }
+    }
+    TRACE_COUNTER("js", "domMutationsApplied", static_cast<int64_t>(mutations.size()));
+    TRACE_COUNTER("js", "domMutationsCoalesced", static_cast<int64_t>(m_domMutations.coalescedCount()));
+    
+    if (!navigationUrl.empty()) {
+        if (!m_scriptThread) {
+            // loadUrl() follows it once the scripts are done
+            m_pendingNavigationUrl = navigationUrl;
+        } else {
+            std::cout << "Executing pending navigation to: " << navigationUrl << std::endl;
+            std::string error;
+            if (!loadUrl(navigationUrl, error)) {
+                std::cerr << "Navigation failed: " << error << std::endl;
+            }
+        }
+    }
+    return true;
+}
+
+void Browser::setScriptThreadEnabled(bool enabled) {
+    if (enabled && !m_scriptThread) {
+        m_scriptThread = std::make_unique<threading::TaskThread>();
+    } else if (!enabled) {
+        m_scriptThread.reset();
+    }
+}
+
+void Browser::setViewportSize(float width, float height) {
+    m_viewportWidth = width;
+    m_viewportHeight = height;
+}
+
+std::unique_ptr<Page> Browser::createPage(const security::Url& url) {
+    auto page = std::make_unique<Page>(m_nextPageId++);
+    page->url = url;
+    page->origin = url.origin();
+    page->styleResolver.initialize();
+    page->layoutEngine.initialize();
+    
+    // Settings made through layoutEngine() hold for the pages after it
+    const layout::LayoutEngine& current = m_page->layoutEngine;
+    page->layoutEngine.setParallelLayout(current.parallelLayout());
+    page->layoutEngine.setLazyLayout(current.lazyLayout());
+    page->layoutEngine.setLayoutCaching(current.layoutCaching());
+    return page;
+}
+
+void Browser::showPage(std::unique_ptr<Page> page) {
+    std::unique_ptr<Page> previous;
+    {
+        std::lock_guard<std::mutex> lock(m_documentMutex);
+        previous = std::move(m_page);
+        m_page = std::move(page);
+    }
+    
+    // Images the page left hasn't got yet aren't needed now
+    for (const auto& entry : previous->imageRequests) {
+        if (!entry.second->isComplete()) {
+            m_resourceLoader->cancel(entry.second);
+        }
+    }
+    if (previous->cacheable && previous->domTree.document()) {
+        m_backForwardCache.put(std::move(previous));
+    }
+    m_memoryManager.enforceBudget();
+    m_context->memoryManager()->enforceBudget();
+}
+
+void Browser::layoutPage() {
+    m_page->layoutEngine.layoutDocument(m_page->domTree.document(), &m_page->styleResolver,
+                                        m_viewportWidth, m_viewportHeight);
+}
+
+bool Browser::restorePage(uint64_t pageId) {
+    std::unique_ptr<Page> page = m_backForwardCache.take(pageId);
+    if (!page) {
+        return false;
+    }
+    TRACE_SCOPE_DETAIL("navigation", "Browser::restorePage", page->url.spec());
+    std::cout << "Restoring page from the back/forward cache: " << page->url.spec() << std::endl;
+    
+    m_pendingNavigationUrl.clear();
+    stopScripts();
+    showPage(std::move(page));
+    
+    std::lock_guard<std::mutex> lock(m_documentMutex);
+    
+    // The window may have been resized while the page was away
+    layout::LayoutEngine& layoutEngine = m_page->layoutEngine;
+    if (layoutEngine.viewportWidth() != m_viewportWidth || layoutEngine.viewportHeight() != m_viewportHeight) {
+        layoutPage();
+    }
+    
+    // Start the image loads cancelled when the page was left again
+    for (auto& entry : m_page->imageRequests) {
+        if (entry.second->isCancelled()) {
+            entry.second = queueImageLoad(entry.second->url());
+        }
+    }
+    prioritizeVisibleImages();
+    return true;
+}
+
+void Browser::onMemoryPressure() {
+    size_t freed = m_memoryManager.onMemoryPressure() + m_context->memoryManager()->onMemoryPressure();
+    std::cout << "Memory pressure: freed " << freed / 1024 << " KB from caches" << std::endl;
+}
+
+void Browser::registerCaches() {
+    // Pages navigated away from go first, the shown page's layout last
+    m_memoryManager.registerCache("Back/forward cache", MemoryPriority::LOW,
+        [this] { return m_backForwardCache.bytes(); },
+        [this](size_t bytes) { m_backForwardCache.trim(bytes); });
+    m_memoryManager.registerCache("Layout cache", MemoryPriority::HIGH,
+        [this] { return m_page->layoutEngine.layoutCache().bytes(); },
+        [this](size_t bytes) { m_page->layoutEngine.layoutCache().trim(bytes); });
+}
+
+bool Browser::initializeScripting() {
+    if (!m_jsEngine.initialize()) {
+        return false;
+    }
+    m_jsEngine.setScriptCache(m_scriptCache);
+    setupJavaScriptBindings();
+    return true;
 }
 
-bool Browser::loadImages(const std::string& baseUrl) {
-    auto images = m_domTree.document()->getElementsByTagName("img");
+bool Browser::loadImages(const security::Url& baseUrl) {
+    auto images = m_page->domTree.document()->getElementsByTagName("img");
     
     for (html::Element* img : images) {
         std::string src = img->getAttribute("src");
-        if (src.empty()) continue;
+        if (src.empty() || m_page->imageRequests.count(img) != 0) continue;
         
         std::string fullUrl = resolveUrl(baseUrl, src);
         
         // Check CSP
-        if (!m_securityManager->isAllowedByCSP(fullUrl, security::CspResourceType::IMG, m_currentOrigin)) {
+        if (!m_securityManager->isAllowedByCSP(fullUrl, security::CspResourceType::IMG, m_page->origin)) {
             std::cerr << "Image blocked by CSP: " << fullUrl << std::endl;
             continue;
         }
         
-        // Queue image loading asynchronously
-        auto request = std::make_shared<networking::ResourceRequest>(fullUrl, networking::ResourceType::IMAGE);
-        request->setCompletionCallback(
-            [img, fullUrl](const std::vector<uint8_t>& data, const std::map<std::string, std::string>& headers) {
-                // In a real implementation, you would decode the image and store it
-                std::cout << "Image loaded: " << fullUrl << " (" << data.size() << " bytes)" << std::endl;
-            }
-        );
-        
-        m_resourceLoader->queueRequest(request);
+        m_page->imageRequests[img] = queueImageLoad(fullUrl);
     }
     
     return true;
 }
 
+std::shared_ptr<networking::ResourceRequest> Browser::queueImageLoad(const std::string& url) {
+    // Queue image loading asynchronously; the bytes go to the image cache,
+    // which decodes them when the image is first painted. They start at low
+    // priority until layout shows which are in view.
+    m_context->waitForNetworking();
+    auto request = std::make_shared<networking::ResourceRequest>(url, networking::ResourceType::IMAGE);
+    request->setCompletionCallback(
+        [url](const networking::ResourceBody& data, const std::map<std::string, std::string>& headers) {
+            rendering::ImageCache::shared().setEncoded(url, data);
+        }
+    );
+    
+    m_resourceLoader->queueRequest(request);
+    return request;
+}
+
+void Browser::prioritizeVisibleImages() {
+    if (m_page->imageRequests.empty() || !m_page->layoutEngine.layoutRoot()) {
+        return;
+    }
+    
+    layout::Rect viewport(0, m_page->layoutEngine.scrollY(), m_viewportWidth, m_viewportHeight);
+    std::vector<layout::Box*> boxes;
+    m_page->layoutEngine.boxesInRect(viewport, boxes);
+    for (layout::Box* box : boxes) {
+        auto found = m_page->imageRequests.find(box->element());
+        if (found == m_page->imageRequests.end()) {
+            continue;
+        }
+        const auto& request = found->second;
+        if (!request->isComplete() && request->priority() < networking::PRIORITY_MEDIUM) {
+            m_resourceLoader->setPriority(request, networking::PRIORITY_MEDIUM);
+        }
+    }
+}
+
 void Browser::processSecurityHeaders(const std::map<std::string, std::string>& headers, const std::string& url) {
     // Process Content-Security-Policy
     auto cspIt = headers.find("Content-Security-Policy");
@@ -949,40 +1446,44 @@ void Browser::setupJavaScriptBindings() {
     // Create document object
     auto docObj = std::make_shared<custom_js::JSObject>();
     
-    // Store DOM element references
-    std::map<std::string, html::Element*> elementMap;
+    // Bindings may run on the script thread: they read the document under
+    // m_documentMutex and queue their changes in m_domMutations for the
+    // main thread to apply
+    
+    // Element and style wrappers start with the same properties in the same
+    // order, so they share shapes and scripts' property caches stay hot
+    auto makeElementObject = [](html::Element* element) {
+        auto elementObj = std::make_shared<custom_js::JSObject>();
+        elementObj->set("tagName", custom_js::JSValue(element->tagName()));
+        elementObj->set("id", custom_js::JSValue(element->getAttribute("id")));
+        elementObj->set("className", custom_js::JSValue(element->className()));
+        return elementObj;
+    };
+    auto makeStyleObject = []() {
+        auto styleObj = std::make_shared<custom_js::JSObject>();
+        styleObj->set("transform", custom_js::JSValue(""));
+        styleObj->set("background", custom_js::JSValue(""));
+        styleObj->set("cssText", custom_js::JSValue(""));
+        return styleObj;
+    };
     
     // document.getElementById
     docObj->set("getElementById", custom_js::JSValue(
         std::make_shared<custom_js::JSFunction>(
-            [this, &elementMap](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) -> custom_js::JSValue {
+            [this, makeElementObject, makeStyleObject](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) -> custom_js::JSValue {
                 if (args.empty()) return custom_js::JSValue();
                 
+                std::lock_guard<std::mutex> lock(m_documentMutex);
                 std::string id = args[0].toString();
                 std::cout << "getElementById called with: " << id << std::endl;
                 
-                html::Element* element = m_domTree.document()->getElementById(id);
+                html::Element* element = m_page->domTree.document()->getElementById(id);
                 
                 if (element) {
                     std::cout << "Found element with id: " << id << std::endl;
                     
-                    // Create element wrapper
-                    auto elementObj = std::make_shared<custom_js::JSObject>();
-                    
-                    // Store element reference
-                    elementMap[id] = element;
-                    
-                    // Basic properties
-                    elementObj->set("tagName", custom_js::JSValue(element->tagName()));
-                    elementObj->set("id", custom_js::JSValue(element->getAttribute("id")));
-                    elementObj->set("className", custom_js::JSValue(element->className()));
-                    
-                    // Value property for input elements
-                    if (element->tagName() == "input" || element->tagName() == "INPUT") {
-                        // Create a proper value property
-                        std::string value = element->getAttribute("value");
-                        elementObj->set("value", custom_js::JSValue(value));
-                    }
+                    // Create element wrapper with its basic properties
+                    auto elementObj = makeElementObject(element);
                     
                     // textContent property
                     elementObj->set("textContent", custom_js::JSValue(element->textContent()));
@@ -991,10 +1492,7 @@ void Browser::setupJavaScriptBindings() {
                     elementObj->set("innerHTML", custom_js::JSValue(element->innerHTML()));
                     
                     // style property
-                    auto styleObj = std::make_shared<custom_js::JSObject>();
-                    styleObj->set("transform", custom_js::JSValue(""));
-                    styleObj->set("background", custom_js::JSValue(""));
-                    styleObj->set("cssText", custom_js::JSValue(""));
+                    auto styleObj = makeStyleObject();
                     elementObj->set("style", custom_js::JSValue(styleObj));
                     
                     // addEventListener method
@@ -1005,18 +1503,23 @@ void Browser::setupJavaScriptBindings() {
                                     std::string event = args[0].toString();
                                     auto handler = args[1].toFunction();
                                     
-                                    std::cout << "addEventListener called: " << event << " on " << element->id() << std::endl;
+                                    std::string id;
+                                    {
+                                        std::lock_guard<std::mutex> lock(m_documentMutex);
+                                        id = element->id();
+                                    }
+                                    std::cout << "addEventListener called: " << event << " on " << id << std::endl;
                                     
                                     // Store event handlers (simplified - in real browser this would be more complex)
-                                    if (event == "keypress" && element->id() == "searchBox") {
+                                    if (event == "keypress" && id == "searchBox") {
                                         // Special handling for search box
-                                        element->setAttribute("onkeypress", "true");
+                                        m_domMutations.setAttribute(element, "onkeypress", "true");
                                     } else if (event == "click") {
-                                        element->setAttribute("onclick", "true");
+                                        m_domMutations.setAttribute(element, "onclick", "true");
                                     } else if (event == "focus") {
-                                        element->setAttribute("onfocus", "true");
+                                        m_domMutations.setAttribute(element, "onfocus", "true");
                                     } else if (event == "blur") {
-                                        element->setAttribute("onblur", "true");
+                                        m_domMutations.setAttribute(element, "onblur", "true");
                                     }
                                 }
                                 return custom_js::JSValue();
@@ -1027,7 +1530,8 @@ void Browser::setupJavaScriptBindings() {
                     // focus() method
                     elementObj->set("focus", custom_js::JSValue(
                         std::make_shared<custom_js::JSFunction>(
-                            [element](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+                            [element, this](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+                                std::lock_guard<std::mutex> lock(m_documentMutex);
                                 std::cout << "focus() called on element: " << element->id() << std::endl;
                                 // In a real browser, this would actually focus the element
                                 return custom_js::JSValue();
@@ -1035,6 +1539,39 @@ void Browser::setupJavaScriptBindings() {
                         )
                     ));
                     
+                    // setAttribute() and removeAttribute(), applied with
+                    // the rest of the batch
+                    elementObj->set("setAttribute", custom_js::JSValue(
+                        std::make_shared<custom_js::JSFunction>(
+                            [element, this](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+                                if (args.size() >= 2) {
+                                    m_domMutations.setAttribute(element, args[0].toString(), args[1].toString());
+                                }
+                                return custom_js::JSValue();
+                            }
+                        )
+                    ));
+                    elementObj->set("removeAttribute", custom_js::JSValue(
+                        std::make_shared<custom_js::JSFunction>(
+                            [element, this](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+                                if (!args.empty()) {
+                                    m_domMutations.removeAttribute(element, args[0].toString());
+                                }
+                                return custom_js::JSValue();
+                            }
+                        )
+                    ));
+                    
+                    // Properties only some elements have come last, so they
+                    // don't split the shapes of the ones above
+                    
+                    // Value property for input elements
+                    if (element->tagName() == "input" || element->tagName() == "INPUT") {
+                        // Create a proper value property
+                        std::string value = element->getAttribute("value");
+                        elementObj->set("value", custom_js::JSValue(value));
+                    }
+                    
                     // For links, add href property
                     if (element->tagName() == "a" || element->tagName() == "A") {
                         elementObj->set("href", custom_js::JSValue(element->getAttribute("href")));
@@ -1060,25 +1597,24 @@ void Browser::setupJavaScriptBindings() {
     // document.getElementsByTagName
     docObj->set("getElementsByTagName", custom_js::JSValue(
         std::make_shared<custom_js::JSFunction>(
-            [this](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+            [this, makeElementObject](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
                 if (args.empty()) return custom_js::JSValue();
                 
+                std::lock_guard<std::mutex> lock(m_documentMutex);
                 std::string tagName = args[0].toString();
-                std::vector<html::Element*> elements = m_domTree.document()->getElementsByTagName(tagName);
+                std::vector<html::Element*> elements = m_page->domTree.document()->getElementsByTagName(tagName);
                 
                 // Create array of elements
                 std::vector<custom_js::JSValue> jsElements;
                 for (html::Element* elem : elements) {
-                    auto elementObj = std::make_shared<custom_js::JSObject>();
-                    elementObj->set("tagName", custom_js::JSValue(elem->tagName()));
-                    elementObj->set("id", custom_js::JSValue(elem->getAttribute("id")));
-                    elementObj->set("className", custom_js::JSValue(elem->className()));
+                    auto elementObj = makeElementObject(elem);
                     
                     // Add getAttribute method
                     elementObj->set("getAttribute", custom_js::JSValue(
                         std::make_shared<custom_js::JSFunction>(
-                            [elem](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+                            [elem, this](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
                                 if (args.empty()) return custom_js::JSValue();
+                                std::lock_guard<std::mutex> lock(m_documentMutex);
                                 return custom_js::JSValue(elem->getAttribute(args[0].toString()));
                             }
                         )
@@ -1095,9 +1631,10 @@ void Browser::setupJavaScriptBindings() {
     // document.querySelectorAll
     docObj->set("querySelectorAll", custom_js::JSValue(
         std::make_shared<custom_js::JSFunction>(
-            [this](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+            [this, makeElementObject, makeStyleObject](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
                 if (args.empty()) return custom_js::JSValue();
                 
+                std::lock_guard<std::mutex> lock(m_documentMutex);
                 std::string selector = args[0].toString();
                 std::vector<custom_js::JSValue> jsElements;
                 
@@ -1105,13 +1642,11 @@ void Browser::setupJavaScriptBindings() {
                 if (selector.size() > 0 && selector[0] == '.') {
                     // Class selector
                     std::string className = selector.substr(1);
-                    std::vector<html::Element*> allElements = m_domTree.document()->getElementsByTagName("*");
+                    std::vector<html::Element*> allElements = m_page->domTree.document()->getElementsByTagName("*");
                     
                     for (html::Element* elem : allElements) {
                         if (elem->className() == className) {
-                            auto elementObj = std::make_shared<custom_js::JSObject>();
-                            elementObj->set("tagName", custom_js::JSValue(elem->tagName()));
-                            elementObj->set("className", custom_js::JSValue(elem->className()));
+                            auto elementObj = makeElementObject(elem);
                             
                             // Add addEventListener
                             elementObj->set("addEventListener", custom_js::JSValue(
@@ -1126,16 +1661,14 @@ void Browser::setupJavaScriptBindings() {
                                 )
                             ));
                             
+                            // Add style property
+                            elementObj->set("style", custom_js::JSValue(makeStyleObject()));
+                            
                             // Add href for links
                             if (elem->tagName() == "a" || elem->tagName() == "A") {
                                 elementObj->set("href", custom_js::JSValue(elem->getAttribute("href")));
                             }
                             
-                            // Add style property
-                            auto styleObj = std::make_shared<custom_js::JSObject>();
-                            styleObj->set("transform", custom_js::JSValue(""));
-                            elementObj->set("style", custom_js::JSValue(styleObj));
-                            
                             jsElements.push_back(custom_js::JSValue(elementObj));
                         }
                     }
@@ -1158,19 +1691,17 @@ void Browser::setupJavaScriptBindings() {
     // document.createElement
     docObj->set("createElement", custom_js::JSValue(
         std::make_shared<custom_js::JSFunction>(
-            [this](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
+            [this, makeElementObject, makeStyleObject](const std::vector<custom_js::JSValue>& args, custom_js::JSValue thisValue) {
                 if (args.empty()) return custom_js::JSValue();
                 
+                std::lock_guard<std::mutex> lock(m_documentMutex);
                 std::string tagName = args[0].toString();
-                auto element = m_domTree.document()->createElement(tagName);
+                auto element = m_page->domTree.document()->createElement(tagName);
                 
-                auto elementObj = std::make_shared<custom_js::JSObject>();
-                elementObj->set("tagName", custom_js::JSValue(tagName));
+                auto elementObj = makeElementObject(element.get());
                 
                 // Style object
-                auto styleObj = std::make_shared<custom_js::JSObject>();
-                styleObj->set("cssText", custom_js::JSValue(""));
-                elementObj->set("style", custom_js::JSValue(styleObj));
+                elementObj->set("style", custom_js::JSValue(makeStyleObject()));
                 
                 return custom_js::JSValue(elementObj);
             }
@@ -1178,7 +1709,7 @@ void Browser::setupJavaScriptBindings() {
     ));
     
     // document.head
-    auto headElement = m_domTree.document()->getElementsByTagName("head");
+    auto headElement = m_page->domTree.document()->getElementsByTagName("head");
     if (!headElement.empty()) {
         auto headObj = std::make_shared<custom_js::JSObject>();
         headObj->set("appendChild", custom_js::JSValue(
@@ -1193,7 +1724,7 @@ void Browser::setupJavaScriptBindings() {
     }
     
     // document.body
-    auto bodyElement = m_domTree.document()->getElementsByTagName("body");
+    auto bodyElement = m_page->domTree.document()->getElementsByTagName("body");
     if (!bodyElement.empty()) {
         auto bodyObj = std::make_shared<custom_js::JSObject>();
         bodyObj->set("appendChild", custom_js::JSValue(
@@ -1232,7 +1763,7 @@ void Browser::setupJavaScriptBindings() {
     auto locationObj = std::make_shared<custom_js::JSObject>();
     
     // Create href property with getter/setter
-    locationObj->set("href", custom_js::JSValue(m_currentUrl));
+    locationObj->set("href", custom_js::JSValue(m_page->url.spec()));
     
     // Add a special property for navigation
     locationObj->set("__setHref__", custom_js::JSValue(
@@ -1241,7 +1772,7 @@ void Browser::setupJavaScriptBindings() {
                 if (!args.empty()) {
                     std::string newUrl = args[0].toString();
                     std::cout << "JavaScript navigation to: " << newUrl << std::endl;
-                    m_pendingNavigationUrl = newUrl;
+                    m_domMutations.navigate(newUrl);
                 }
                 return custom_js::JSValue();
             }
@@ -1421,13 +1952,13 @@ void Browser::setupJavaScriptBindings() {
 }
 
 std::string Browser::renderToASCII(int width, int height) {
-    auto layoutRoot = m_layoutEngine.layoutRoot();
+    layout::Box* layoutRoot = m_page->layoutEngine.layoutRoot();
     if (!layoutRoot) {
         return "No page loaded\n";
     }
     
     // Use the renderer to create ASCII output
-    return m_renderer.renderToASCII(layoutRoot.get(), width, height);
+    return m_renderer.renderToASCII(layoutRoot, width, height);
 }
 
 } // namespace browser
\ No newline at end of file
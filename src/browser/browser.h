@@ -3,74 +3,263 @@
 
 #include "../html/html_parser.h"
 #include "../css/style_resolver.h"
+#include "../css/stylesheet_cache.h"
 #include "../layout/layout_engine.h"
 #include "../rendering/renderer.h"
 #include "../custom_js/js_engine.h"
+#include "../custom_js/script_cache.h"
 #include "../networking/resource_loader.h"
 #include "../security/security_manager.h"
+#include "../security/url.h"
+#include "../threading/task_thread.h"
+#include "back_forward_cache.h"
+#include "dom_mutation_queue.h"
+#include "engine_context.h"
+#include "memory_manager.h"
+#include "page.h"
 #include <string>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <vector>
+#include <map>
 
 namespace browser {
 
 // Browser class - main entry point
 class Browser {
 public:
-    Browser();
+    // A browser shares networking, parsed stylesheets and their memory
+    // budget with the others on the same context; without one it gets a
+    // context of its own
+    explicit Browser(std::shared_ptr<EngineContext> context = nullptr);
     ~Browser();
     
-    // Initialize browser components
+    std::shared_ptr<EngineContext> context() const { return m_context; }
+    
+    // Directory for the HTTP cache and for compiled stylesheets and
+    // scripts; empty, the default, keeps them in memory. Set before
+    // initialize(); a shared context keeps the directory it started with.
+    void setCacheDirectory(const std::string& directory);
+    
+    // Initialize browser components. Only what showing a page needs is set
+    // up before this returns: networking comes up on a thread of its own,
+    // which the first network load waits for, and the JavaScript engine on
+    // the thread scripts run on, before the first script at the latest.
+    // Later calls do nothing.
     bool initialize();
     
+    // Whether networking is up yet
+    bool networkingReady() const { return m_context->networkingReady(); }
+    
     // Load a URL
     bool loadUrl(const std::string& url, std::string& error);
     
     // Get browser components
     html::HTMLParser* htmlParser() { return &m_htmlParser; }
-    css::StyleResolver* styleResolver() { return &m_styleResolver; }
-    layout::LayoutEngine* layoutEngine() { return &m_layoutEngine; }
+    css::StyleResolver* styleResolver() { return &m_page->styleResolver; }
+    layout::LayoutEngine* layoutEngine() { return &m_page->layoutEngine; }
     rendering::Renderer* renderer() { return &m_renderer; }
     custom_js::JSEngine* jsEngine() { return &m_jsEngine; }
-    networking::ResourceLoader* resourceLoader() { return m_resourceLoader.get(); }
+    networking::ResourceLoader* resourceLoader() { m_context->waitForNetworking(); return m_resourceLoader; }
     security::SecurityManager* securityManager() { return m_securityManager.get(); }
     
     // Get current document
-    html::Document* currentDocument() const { return m_domTree.document(); }
+    html::Document* currentDocument() const { return m_page->domTree.document(); }
     
     // Get layout tree root
-    std::shared_ptr<layout::Box> layoutRoot() const { return m_layoutEngine.layoutRoot(); }
+    layout::Box* layoutRoot() const { return m_page->layoutEngine.layoutRoot(); }
     std::string resolveUrl(const std::string& baseUrl, const std::string& relativeUrl);
+    std::string resolveUrl(const security::Url& baseUrl, const std::string& relativeUrl) const;
     
     // Render current page to ASCII art (for terminal viewing)
     std::string renderToASCII(int width, int height);
     
+    // Run scripts on a script thread of their own instead of inside
+    // loadUrl(), so a long script doesn't hold up the caller; the engine and
+    // its bindings then live on that thread. Set before initialize().
+    void setScriptThreadEnabled(bool enabled);
+    bool scriptThreadEnabled() const { return m_scriptThread != nullptr; }
+    
+    // Scripts queued or running on the script thread
+    bool scriptsRunning() const { return m_scriptThread && !m_scriptThread->idle(); }
+    
+    // Apply the DOM mutations scripts queued, restyle and lay out once for
+    // all of them, and follow a navigation they asked for. Call from the
+    // main thread once per frame when the script thread is on; without it
+    // scripts' mutations are applied after each script. False if nothing
+    // was queued.
+    bool commitDOMMutations();
+    
+    // Called on the script thread when scripts queue DOM mutations after
+    // the last commit; a window uses it to schedule a frame
+    void setDOMMutationsQueuedCallback(std::function<void()> callback) {
+        m_domMutations.setQueuedCallback(std::move(callback));
+    }
+    
+    // Held by the bindings while they read the document on the script
+    // thread. The main thread must hold it while it lays out, hit tests or
+    // paints the document, but not while it loads a URL.
+    std::unique_lock<std::mutex> lockDocument() { return std::unique_lock<std::mutex>(m_documentMutex); }
+    
+    // Viewport that loads and committed mutations lay out in
+    void setViewportSize(float width, float height);
+    
+    // Move the loads of images in the viewport ahead of those below the
+    // fold. Called after layout; call after scrolling, with the document
+    // locked.
+    void prioritizeVisibleImages();
+    
+    // Id of the page shown. A history entry keeps it, to show the page
+    // again from the back/forward cache when the entry is revisited.
+    uint64_t currentPageId() const { return m_page->id; }
+    
+    // Show a page kept in the back/forward cache as it was left: document,
+    // styles, layout, scroll position and what scripts did to the DOM.
+    // Scripts don't run again. False if the page isn't cached, in which
+    // case the caller loads its URL.
+    bool restorePage(uint64_t pageId);
+    
+    // Pages navigated away from; the layout settings of the shown page
+    // carry over to the pages loaded after it
+    BackForwardCache* backForwardCache() { return &m_backForwardCache; }
+    
+    // The budget of this browser's page caches; the shared caches have the
+    // context's. about:memory shows what each holds.
+    MemoryManager* memoryManager() { return &m_memoryManager; }
+    
+    // Free what can be rebuilt when the system runs low on memory
+    void onMemoryPressure();
+    
 private:
     // Browser components
+    std::shared_ptr<EngineContext> m_context;
     html::HTMLParser m_htmlParser;
-    css::StyleResolver m_styleResolver;
-    layout::LayoutEngine m_layoutEngine;
+    std::shared_ptr<css::StyleSheetCache> m_styleSheetCache;  // shared with fetch callbacks
     rendering::Renderer m_renderer;
+    std::shared_ptr<custom_js::ScriptCache> m_scriptCache;
     custom_js::JSEngine m_jsEngine;
-    std::unique_ptr<networking::ResourceLoader> m_resourceLoader;
+    networking::ResourceLoader* m_resourceLoader;  // The context's
     std::unique_ptr<security::SecurityManager> m_securityManager;
     
     // Current document state
-    html::DOMTree m_domTree;
-    std::string m_currentUrl;
+    std::unique_ptr<Page> m_page;
+    BackForwardCache m_backForwardCache;
+    MemoryManager m_memoryManager;
+    uint64_t m_nextPageId;
     std::string m_pendingNavigationUrl;  // Add this
-    security::Origin m_currentOrigin{security::Origin::null()};  // Initialize inline
     
-    // Load and process resources
-    bool loadStylesheets(const std::string& baseUrl);
-    bool loadScripts(const std::string& baseUrl);
-    bool loadImages(const std::string& baseUrl);
+    // A stylesheet or script of the current document. External ones are
+    // fetched (and stylesheets parsed) on the resource loader's workers.
+    struct Subresource {
+        std::string url;                           // empty for inline content
+        std::string text;                          // script source or inline CSS
+        std::shared_ptr<const css::StyleSheet> styleSheet;
+        std::string error;
+        bool done = false;
+        bool loaded = false;
+        bool async = false;                        // async or defer script
+    };
+    
+    // Subresource loads for one document, kept in document order
+    struct SubresourceLoad {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::vector<Subresource> styleSheets;
+        std::vector<Subresource> scripts;
+    };
+    
+    // A stylesheet or script fetched as soon as the parser inserted its
+    // element, while the rest of the document was still arriving. The
+    // fetch that startSubresourceLoads() would make takes it over.
+    struct Preload {
+        std::mutex mutex;
+        bool done = false;
+        bool success = false;
+        networking::ResourceBody body;
+        std::map<std::string, std::string> headers;
+        std::string error;
+        networking::FetchCallback callback;        // The taker's, if it came first
+        std::shared_ptr<networking::ResourceRequest> request;
+    };
+    
+    // Preloads of the document being loaded, by URL
+    std::map<std::string, std::shared_ptr<Preload>> m_preloads;
+    
+    // Start fetching what element refers to, if it's a stylesheet, script
+    // or image the page's policy allows. Images go straight into the
+    // page's image loads. False if nothing was fetched.
+    bool preloadFor(html::Element* element, Page& page);
+    
+    // Fetch a stylesheet or script, taking over its preload if there is one
+    std::shared_ptr<networking::ResourceRequest> fetchSubresource(const std::string& url,
+                                                                  networking::FetchCallback callback,
+                                                                  networking::ResourceType type);
+    
+    // Drop preloads nothing took over
+    void cancelPreloads();
+    
+    // Load and process resources. startSubresourceLoads issues every fetch
+    // at once; the others wait for each resource in document order.
+    std::shared_ptr<SubresourceLoad> startSubresourceLoads(const security::Url& baseUrl);
+    bool applyStylesheets(SubresourceLoad& load);
+    bool executeScripts(SubresourceLoad& load);
+    bool loadImages(const security::Url& baseUrl);
+    std::shared_ptr<networking::ResourceRequest> queueImageLoad(const std::string& url);
     bool loadAboutPage(const std::string& url, std::string& error);
     
+    // Start resolving the host of a resource element refers to as soon as
+    // the parser inserts it, ahead of the fetch
+    void prefetchDnsFor(html::Element* element, const security::Url& baseUrl);
+    
+    // A new page for url, with the shown page's layout settings
+    std::unique_ptr<Page> createPage(const security::Url& url);
+    
+    // Make page the one shown. The page left goes to the back/forward
+    // cache, its unfinished image loads cancelled; the loads start again
+    // if it's restored. The caches are then brought back within budget.
+    void showPage(std::unique_ptr<Page> page);
+    
+    // Lay the page out in the current viewport
+    void layoutPage();
+    
+    // Put the page caches under m_memoryManager's budget
+    void registerCaches();
+    
     // Process security headers
     void processSecurityHeaders(const std::map<std::string, std::string>& headers, const std::string& url);
     
     // Setup JavaScript bindings
     void setupJavaScriptBindings();
+    
+    // Set up the engine and its bindings, on the thread that runs scripts
+    bool initializeScripting();
+    
+    // initializeScripting() the first time; whether the engine is ready
+    bool ensureScripting();
+    
+    // Run the document's scripts: on the script thread when it's on,
+    // otherwise before returning
+    void runScripts(std::shared_ptr<SubresourceLoad> load);
+    
+    // Drop the previous document's queued scripts and mutations, and wait
+    // for a running script to finish
+    void stopScripts();
+    
+    std::string m_cacheDirectory;
+    bool m_initialized;
+    bool m_scriptingInitialized;        // Only touched on the thread running scripts
+    bool m_scriptingReady;
+    
+    DOMMutationQueue m_domMutations;
+    std::mutex m_documentMutex;
+    float m_viewportWidth;
+    float m_viewportHeight;
+    
+    // Last, so it's joined before the state its tasks use is destroyed
+    std::unique_ptr<threading::TaskThread> m_scriptThread;
 };
 
 } // namespace browser
@@ -0,0 +1,90 @@
+#include "dom_mutation_queue.h"
+#include <utility>
+
+namespace browser {
+
+//-----------------------------------------------------------------------------
+// DOMMutationQueue Implementation
+//-----------------------------------------------------------------------------
+
+void DOMMutationQueue::setAttribute(html::Element* element, const std::string& name, const std::string& value) {
+    push({DOMMutation::Type::SET_ATTRIBUTE, element, name, value});
+}
+
+void DOMMutationQueue::removeAttribute(html::Element* element, const std::string& name) {
+    push({DOMMutation::Type::REMOVE_ATTRIBUTE, element, name, std::string()});
+}
+
+void DOMMutationQueue::navigate(const std::string& url) {
+    push({DOMMutation::Type::NAVIGATE, nullptr, std::string(), url});
+}
+
+std::vector<DOMMutation> DOMMutationQueue::take() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<DOMMutation> mutations;
+    mutations.swap(m_mutations);
+    m_positions.clear();
+    return mutations;
+}
+
+void DOMMutationQueue::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mutations.clear();
+    m_positions.clear();
+}
+
+bool DOMMutationQueue::empty() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_mutations.empty();
+}
+
+size_t DOMMutationQueue::queuedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queued;
+}
+
+size_t DOMMutationQueue::coalescedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_coalesced;
+}
+
+DOMMutationQueue::Key DOMMutationQueue::keyFor(const DOMMutation& mutation) {
+    switch (mutation.type) {
+        case DOMMutation::Type::SET_ATTRIBUTE:
+        case DOMMutation::Type::REMOVE_ATTRIBUTE:
+            return Key(mutation.element, 0, mutation.name);
+        case DOMMutation::Type::NAVIGATE:
+        default:
+            return Key(nullptr, 1, std::string());
+    }
+}
+
+void DOMMutationQueue::setQueuedCallback(std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queuedCallback = std::move(callback);
+}
+
+void DOMMutationQueue::push(DOMMutation mutation) {
+    Key key = keyFor(mutation);
+    std::function<void()> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_queued;
+        auto found = m_positions.find(key);
+        if (found != m_positions.end()) {
+            m_mutations[found->second] = std::move(mutation);
+            ++m_coalesced;
+            return;
+        }
+        if (m_mutations.empty()) {
+            callback = m_queuedCallback;
+        }
+        m_positions.emplace(std::move(key), m_mutations.size());
+        m_mutations.push_back(std::move(mutation));
+    }
+    if (callback) {
+        callback();
+    }
+}
+
+} // namespace browser
@@ -0,0 +1,83 @@
+#ifndef BROWSER_DOM_MUTATION_QUEUE_H
+#define BROWSER_DOM_MUTATION_QUEUE_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace browser {
+
+namespace html {
+class Element;
+}
+
+// A change a script asked for, applied to the document later
+struct DOMMutation {
+    enum class Type {
+        SET_ATTRIBUTE,
+        REMOVE_ATTRIBUTE,
+        NAVIGATE            // value is the URL; element is null
+    };
+    
+    Type type;
+    html::Element* element;
+    std::string name;
+    std::string value;
+};
+
+// DOM changes made by JavaScript bindings, queued by the thread running the
+// scripts and taken by the main thread, which applies them together and
+// restyles and lays out once for the lot. Writes that replace an earlier
+// queued one, such as the same attribute set twice, keep only the last
+// value, in the first write's place.
+class DOMMutationQueue {
+public:
+    DOMMutationQueue() = default;
+    
+    DOMMutationQueue(const DOMMutationQueue&) = delete;
+    DOMMutationQueue& operator=(const DOMMutationQueue&) = delete;
+    
+    void setAttribute(html::Element* element, const std::string& name, const std::string& value);
+    void removeAttribute(html::Element* element, const std::string& name);
+    void navigate(const std::string& url);
+    
+    // The queued mutations in order, leaving the queue empty
+    std::vector<DOMMutation> take();
+    
+    // Drop the queued mutations, as when their document goes away
+    void clear();
+    
+    bool empty() const;
+    
+    // Called on the queuing thread when a mutation goes into an empty
+    // queue, so the consumer can pick the batch up without polling
+    void setQueuedCallback(std::function<void()> callback);
+    
+    // Mutations queued since construction, and those that replaced an
+    // earlier one instead of adding to the queue
+    size_t queuedCount() const;
+    size_t coalescedCount() const;
+    
+private:
+    // Which earlier write a mutation replaces: the same element and
+    // attribute, or any navigation
+    using Key = std::tuple<html::Element*, int, std::string>;
+    static Key keyFor(const DOMMutation& mutation);
+    
+    void push(DOMMutation mutation);
+    
+    mutable std::mutex m_mutex;
+    std::vector<DOMMutation> m_mutations;
+    std::map<Key, size_t> m_positions;
+    size_t m_queued = 0;
+    size_t m_coalesced = 0;
+    std::function<void()> m_queuedCallback;
+};
+
+} // namespace browser
+
+#endif // BROWSER_DOM_MUTATION_QUEUE_H
@@ -0,0 +1,109 @@
+#include "engine_context.h"
+#include "../rendering/image_cache.h"
+#include "../tracing/trace.h"
+#include <iostream>
+
+namespace browser {
+
+//-----------------------------------------------------------------------------
+// EngineContext Implementation
+//-----------------------------------------------------------------------------
+
+EngineContext::EngineContext()
+    : m_initialized(false)
+    , m_styleSheetCache(std::make_shared<css::StyleSheetCache>())
+    , m_resourceLoader(std::make_unique<networking::ResourceLoader>())
+    , m_networkingReady(false)
+    , m_browserCount(0)
+{
+    registerCaches();
+}
+
+EngineContext::~EngineContext() {
+    // Before the validator goes: HTTPS loads use it
+    if (m_startupThread) {
+        m_startupThread->waitIdle();
+    }
+    m_resourceLoader->stop();
+}
+
+void EngineContext::setCacheDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_initialized) {
+        m_cacheDirectory = directory;
+    }
+}
+
+void EngineContext::initialize() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_initialized) {
+        return;
+    }
+    m_initialized = true;
+    
+    // Compiled stylesheets are read back from the start, without waiting
+    // for the HTTP cache
+    if (!m_cacheDirectory.empty()) {
+        m_styleSheetCache->setDirectory(m_cacheDirectory + "/stylesheets");
+    }
+    
+    m_startupThread = std::make_unique<threading::TaskThread>();
+    m_startupThread->post([this] { initializeNetworking(); });
+}
+
+bool EngineContext::waitForNetworking() {
+    if (!m_networkingReady) {
+        threading::TaskThread* startupThread;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            startupThread = m_startupThread.get();
+        }
+        if (startupThread) {
+            startupThread->waitIdle();
+        }
+    }
+    return m_networkingReady;
+}
+
+void EngineContext::initializeNetworking() {
+    TRACE_SCOPE("startup", "EngineContext::initializeNetworking");
+    
+    // Fall back to a cache in memory if the one on disk can't be opened
+    std::string httpCacheDirectory = m_cacheDirectory.empty() ? std::string() : m_cacheDirectory + "/http";
+    bool ready = m_resourceLoader->initialize(httpCacheDirectory) ||
+                 (!httpCacheDirectory.empty() && m_resourceLoader->initialize());
+    if (!ready) {
+        std::cerr << "Failed to initialize resource loader" << std::endl;
+        return;
+    }
+    
+    if (!m_certificateValidator.initialize()) {
+        std::cerr << "Failed to initialize certificate validator" << std::endl;
+        return;
+    }
+    m_resourceLoader->tlsContext()->setCertificateValidator(&m_certificateValidator);
+    m_resourceLoader->start();
+    m_networkingReady = true;
+    TRACE_COUNTER("startup", "networkingReadyMs", static_cast<int64_t>(tracing::Tracer::now() / 1000));
+}
+
+void EngineContext::registerCaches() {
+    // What's backed by a copy on disk or by encoded bytes; each browser
+    // registers its pages' caches with a manager of its own. The HTTP
+    // cache is off limits until the startup thread has opened it.
+    m_memoryManager.registerCache("HTTP memory cache", MemoryPriority::NORMAL,
+        [this] { return m_networkingReady ? m_resourceLoader->cacheStats().memoryBytes : 0; },
+        [this](size_t bytes) {
+            if (m_networkingReady) {
+                m_resourceLoader->trimMemoryCache(bytes);
+            }
+        });
+    m_memoryManager.registerCache("Stylesheets", MemoryPriority::NORMAL,
+        [this] { return m_styleSheetCache->bytes(); },
+        [this](size_t bytes) { m_styleSheetCache->trim(bytes); });
+    m_memoryManager.registerCache("Images", MemoryPriority::NORMAL,
+        [] { return rendering::ImageCache::shared().bytes(); },
+        [](size_t bytes) { rendering::ImageCache::shared().trim(bytes); });
+}
+
+} // namespace browser
@@ -0,0 +1,81 @@
+#ifndef BROWSER_ENGINE_CONTEXT_H
+#define BROWSER_ENGINE_CONTEXT_H
+
+#include "../css/stylesheet_cache.h"
+#include "../networking/resource_loader.h"
+#include "../security/certificate_validator.h"
+#include "../threading/task_thread.h"
+#include "memory_manager.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace browser {
+
+// What the Browser instances of a process share: one resource loader, and
+// with it one HTTP cache, connection pool, DNS cache and set of TLS
+// sessions; the parsed stylesheets; the certificate validator; and a memory
+// budget for those caches. Decoded images and text measurements are shared
+// process-wide already. Documents, styles, layout, scripts and the
+// back/forward cache stay with each Browser.
+//
+// Everything here is safe to use from the threads of several browsers. A
+// Browser created without a context makes one of its own.
+class EngineContext {
+public:
+    EngineContext();
+    ~EngineContext();
+
+    EngineContext(const EngineContext&) = delete;
+    EngineContext& operator=(const EngineContext&) = delete;
+
+    // Directory for the HTTP cache and compiled stylesheets; empty, the
+    // default, keeps them in memory. Ignored once initialized.
+    void setCacheDirectory(const std::string& directory);
+
+    // Start networking on a thread of its own; what doesn't touch the
+    // network can be used meanwhile. Later calls do nothing.
+    void initialize();
+
+    // Whether networking is up yet, and waiting for it; false if it didn't
+    // come up
+    bool networkingReady() const { return m_networkingReady; }
+    bool waitForNetworking();
+
+    // Loads go through the resource loader once waitForNetworking() is true
+    networking::ResourceLoader* resourceLoader() { return m_resourceLoader.get(); }
+    std::shared_ptr<css::StyleSheetCache> styleSheetCache() const { return m_styleSheetCache; }
+    MemoryManager* memoryManager() { return &m_memoryManager; }
+
+    // Browsers using the context, counted by Browser
+    void attach() { ++m_browserCount; }
+    void detach() { --m_browserCount; }
+    size_t browserCount() const { return m_browserCount; }
+
+private:
+    // Bring the resource loader up: the HTTP cache, then its threads.
+    // Runs on m_startupThread.
+    void initializeNetworking();
+
+    void registerCaches();
+
+    std::mutex m_mutex;  // Guards the two below
+    std::string m_cacheDirectory;
+    bool m_initialized;
+
+    std::shared_ptr<css::StyleSheetCache> m_styleSheetCache;
+    security::CertificateValidator m_certificateValidator;
+    std::unique_ptr<networking::ResourceLoader> m_resourceLoader;  // Uses the validator
+    std::atomic<bool> m_networkingReady;
+    MemoryManager m_memoryManager;
+    std::atomic<size_t> m_browserCount;
+
+    // Last, so it's joined before the state its task uses is destroyed
+    std::unique_ptr<threading::TaskThread> m_startupThread;
+};
+
+} // namespace browser
+
+#endif // BROWSER_ENGINE_CONTEXT_H
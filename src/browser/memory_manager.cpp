@@ -0,0 +1,189 @@
+#include "memory_manager.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <sstream>
+
+namespace browser {
+
+namespace {
+
+const char* priorityName(MemoryPriority priority) {
+    switch (priority) {
+        case MemoryPriority::LOW: return "low";
+        case MemoryPriority::NORMAL: return "normal";
+        case MemoryPriority::HIGH: return "high";
+    }
+    return "";
+}
+
+std::string formatBytes(size_t bytes) {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(1);
+    if (bytes >= 1024 * 1024) {
+        out << bytes / (1024.0 * 1024.0) << " MB";
+    } else {
+        out << bytes / 1024.0 << " KB";
+    }
+    return out.str();
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// MemoryManager Implementation
+//-----------------------------------------------------------------------------
+
+MemoryManager::MemoryManager()
+    : m_nextId(1)
+    , m_budget(defaultBudget)
+    , m_trims(0)
+    , m_pressureEvents(0)
+{
+}
+
+MemoryManager::ConsumerId MemoryManager::registerCache(std::string name, MemoryPriority priority,
+                                                       UsageFunction usage, TrimFunction trim) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ConsumerId id = m_nextId++;
+    m_consumers.push_back({id, std::move(name), priority, std::move(usage), std::move(trim)});
+    return id;
+}
+
+void MemoryManager::unregisterCache(ConsumerId id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_consumers.erase(std::remove_if(m_consumers.begin(), m_consumers.end(),
+                                     [id](const Consumer& consumer) { return consumer.id == id; }),
+                      m_consumers.end());
+}
+
+void MemoryManager::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    trimTo(m_budget);
+}
+
+size_t MemoryManager::budget() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+size_t MemoryManager::usage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return usageLocked();
+}
+
+std::vector<MemoryManager::Usage> MemoryManager::report() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Usage> usages;
+    usages.reserve(m_consumers.size());
+    for (const Consumer& consumer : m_consumers) {
+        usages.push_back({consumer.name, consumer.priority, consumer.usage()});
+    }
+    return usages;
+}
+
+size_t MemoryManager::enforceBudget() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return trimTo(m_budget);
+}
+
+size_t MemoryManager::onMemoryPressure() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_pressureEvents;
+    return trimTo(m_budget / 4);
+}
+
+size_t MemoryManager::trims() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_trims;
+}
+
+size_t MemoryManager::pressureEvents() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pressureEvents;
+}
+
+size_t MemoryManager::usageLocked() const {
+    size_t bytes = 0;
+    for (const Consumer& consumer : m_consumers) {
+        bytes += consumer.usage();
+    }
+    return bytes;
+}
+
+size_t MemoryManager::trimTo(size_t bytes) {
+    size_t total = usageLocked();
+    size_t freed = 0;
+    if (total > bytes) {
+        // Lowest priority first, and among equals the first registered
+        std::vector<Consumer*> order;
+        for (Consumer& consumer : m_consumers) {
+            order.push_back(&consumer);
+        }
+        std::stable_sort(order.begin(), order.end(), [](const Consumer* a, const Consumer* b) {
+            return a->priority < b->priority;
+        });
+
+        for (Consumer* consumer : order) {
+            if (total <= bytes) {
+                break;
+            }
+            size_t held = consumer->usage();
+            if (held == 0) {
+                continue;
+            }
+
+            // Only the excess; a cache that can't shrink that far frees what
+            // it can and the next one makes up the rest
+            size_t excess = total - bytes;
+            consumer->trim(held > excess ? held - excess : 0);
+            size_t after = std::min(consumer->usage(), held);
+            total -= held - after;
+            freed += held - after;
+            ++m_trims;
+        }
+    }
+    TRACE_COUNTER("memory", "cacheBytes", static_cast<int64_t>(total));
+    return freed;
+}
+
+std::string MemoryManager::summaryHtml(const std::string& heading) const {
+    std::vector<Usage> usages = report();
+    size_t total = 0;
+
+    std::ostringstream rows;
+    for (const Usage& entry : usages) {
+        total += entry.bytes;
+        rows << "        <tr><td>" << entry.name << "</td><td>" << priorityName(entry.priority)
+             << "</td><td>" << formatBytes(entry.bytes) << "</td></tr>\n";
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string html = "    <h2>" + heading + "</h2>\n";
+    html += "    <p>" + formatBytes(total) + " of a " + formatBytes(m_budget) + " budget; " +
+            std::to_string(m_trims) + " trims, " + std::to_string(m_pressureEvents) +
+            " memory pressure signals.</p>\n";
+    html += "    <table>\n        <tr><th>Cache</th><th>Priority</th><th>Size</th></tr>\n";
+    html += rows.str();
+    html += "    </table>\n";
+    return html;
+}
+
+std::string MemoryManager::pageHtml(const std::string& sections) {
+    std::string html =
+        "<!DOCTYPE html>\n<html>\n<head>\n    <title>Memory</title>\n"
+        "    <style>\n"
+        "        body { font-family: Arial, sans-serif; margin: 20px; }\n"
+        "        table { border-collapse: collapse; }\n"
+        "        th, td { border: 1px solid #ccc; padding: 4px 8px; text-align: left; }\n"
+        "        th { background: #eee; }\n"
+        "    </style>\n</head>\n<body>\n    <h1>Memory</h1>\n";
+    html += "    <p>Low priority caches are trimmed first when a budget is exceeded or the "
+            "system is low on memory.</p>\n";
+    html += sections;
+    html += "</body>\n</html>\n";
+    return html;
+}
+
+} // namespace browser
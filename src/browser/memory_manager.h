@@ -0,0 +1,97 @@
+#ifndef BROWSER_MEMORY_MANAGER_H
+#define BROWSER_MEMORY_MANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace browser {
+
+// How readily a cache gives up memory; lower priorities are trimmed first
+enum class MemoryPriority : uint8_t {
+    LOW,      // Kept in case it's wanted again, e.g. pages navigated away from
+    NORMAL,   // Saves work that can be redone from a copy elsewhere
+    HIGH      // Used by the page on screen
+};
+
+// One budget for the caches of every subsystem. Each registers how to
+// measure and how to shrink itself; when together they hold more than the
+// budget, or the OS reports memory pressure, the lowest priority caches are
+// trimmed first, and only as far as needed. Caches keep their own limits
+// too. Safe to use from several threads; the callbacks are called on the
+// thread that measures or trims, with the manager's lock held.
+class MemoryManager {
+public:
+    using ConsumerId = uint64_t;
+    using UsageFunction = std::function<size_t()>;
+    using TrimFunction = std::function<void(size_t bytes)>;  // Shrink to at most bytes
+
+    struct Usage {
+        std::string name;
+        MemoryPriority priority;
+        size_t bytes;
+    };
+
+    static constexpr size_t defaultBudget = 192 * 1024 * 1024;
+
+    MemoryManager();
+
+    MemoryManager(const MemoryManager&) = delete;
+    MemoryManager& operator=(const MemoryManager&) = delete;
+
+    ConsumerId registerCache(std::string name, MemoryPriority priority,
+                             UsageFunction usage, TrimFunction trim);
+    void unregisterCache(ConsumerId id);
+
+    // Bytes the registered caches may hold together; lowering it trims
+    void setBudget(size_t bytes);
+    size_t budget() const;
+
+    // Bytes held now, in all and by each cache in registration order
+    size_t usage() const;
+    std::vector<Usage> report() const;
+
+    // Trim until usage() is within the budget; the bytes freed
+    size_t enforceBudget();
+
+    // Trim to a quarter of the budget, for when the OS is low on memory;
+    // the bytes freed
+    size_t onMemoryPressure();
+
+    // Times a cache was trimmed, and pressure signals handled
+    size_t trims() const;
+    size_t pressureEvents() const;
+
+    // A section of about:memory: usage by cache against the budget
+    std::string summaryHtml(const std::string& heading) const;
+
+    // about:memory around the given sections
+    static std::string pageHtml(const std::string& sections);
+
+private:
+    struct Consumer {
+        ConsumerId id;
+        std::string name;
+        MemoryPriority priority;
+        UsageFunction usage;
+        TrimFunction trim;
+    };
+
+    // With m_mutex held
+    size_t usageLocked() const;
+    size_t trimTo(size_t bytes);
+
+    mutable std::mutex m_mutex;
+    std::vector<Consumer> m_consumers;  // Registration order
+    ConsumerId m_nextId;
+    size_t m_budget;
+    size_t m_trims;
+    size_t m_pressureEvents;
+};
+
+} // namespace browser
+
+#endif // BROWSER_MEMORY_MANAGER_H
@@ -0,0 +1,30 @@
+#include "page.h"
+#include "../html/dom_traversal.h"
+
+namespace browser {
+
+//-----------------------------------------------------------------------------
+// Page Implementation
+//-----------------------------------------------------------------------------
+
+size_t Page::estimatedBytes() const {
+    size_t bytes = sizeof(Page);
+    html::Document* document = domTree.document();
+    if (document) {
+        // Each node with its text, and each element with its attributes and
+        // resolved style
+        for (html::Node* node : html::preOrder(document)) {
+            bytes += sizeof(html::Element) + node->nodeValue().capacity();
+            if (node->nodeType() == html::NodeType::ELEMENT_NODE) {
+                bytes += sizeof(css::ComputedStyle);
+                for (const html::Attribute& attribute : static_cast<html::Element*>(node)->attributes()) {
+                    bytes += sizeof(html::Attribute) + attribute.value.capacity();
+                }
+            }
+        }
+    }
+    bytes += layoutEngine.layoutTree().size() * sizeof(layout::Box);
+    return bytes;
+}
+
+} // namespace browser
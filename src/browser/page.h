@@ -0,0 +1,45 @@
+#ifndef BROWSER_PAGE_H
+#define BROWSER_PAGE_H
+
+#include "../html/dom_tree.h"
+#include "../css/style_resolver.h"
+#include "../layout/layout_engine.h"
+#include "../networking/resource_request.h"
+#include "../security/url.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+namespace browser {
+
+// A loaded document and what the browser built from it: resolved styles,
+// the layout tree with its scroll position, and the image loads it started.
+// Browser shows one at a time; the ones navigated away from can wait in the
+// BackForwardCache to be shown again just as they were left.
+struct Page {
+    explicit Page(uint64_t id) : id(id) {}
+
+    Page(const Page&) = delete;
+    Page& operator=(const Page&) = delete;
+
+    uint64_t id;
+    html::DOMTree domTree;
+    css::StyleResolver styleResolver;
+    layout::LayoutEngine layoutEngine;
+    security::Url url;
+    security::Origin origin{security::Origin::null()};
+
+    // Image loads by element, for reprioritizing and restarting
+    std::map<html::Element*, std::shared_ptr<networking::ResourceRequest>> imageRequests;
+
+    // False for documents served with Cache-Control: no-store
+    bool cacheable = true;
+
+    // Rough heap size of the document, its styles and its boxes
+    size_t estimatedBytes() const;
+};
+
+} // namespace browser
+
+#endif // BROWSER_PAGE_H
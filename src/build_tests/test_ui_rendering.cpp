@@ -294,7 +294,7 @@ bool testPaintSystem() {
     style.setProperty("margin-left", css::Value("50px"));
     style.setProperty("margin-top", css::Value("50px"));
     
-    auto box = std::make_shared<BlockBox>(nullptr, style);
+    auto box = std::make_shared<BlockBox>(nullptr, std::make_shared<const css::ComputedStyle>(style));
     box->layout(800); // Available width
     
     // Create paint system
@@ -313,7 +313,7 @@ bool testPaintSystem() {
     // Get display list
     const DisplayList& displayList = context.displayList();
     
-    std::cout << "Display list has " << displayList.items().size() << " items" << std::endl;
+    std::cout << "Display list has " << displayList.size() << " items" << std::endl;
     
     // Create render target
     auto renderTarget = std::make_shared<CustomRenderTarget>(800, 600);
@@ -391,30 +391,28 @@ bool testFullRenderingPipeline() {
             canvas->clear(Canvas::rgb(255, 255, 255));
             
             // Create paint context
-            PaintContext context = paintSystem->createContext(layoutEngine.layoutRoot().get());
-            paintSystem->paintBox(layoutEngine.layoutRoot().get(), context);
+            PaintContext context = paintSystem->createContext(layoutEngine.layoutRoot());
+            paintSystem->paintBox(layoutEngine.layoutRoot(), context);
             
             // Render display list to canvas
             const DisplayList& displayList = context.displayList();
             
-            for (const auto& item : displayList.items()) {
-                if (!item) continue;
-                
-                if (item->type() == DisplayItemType::BACKGROUND) {
-                    auto bgItem = static_cast<BackgroundDisplayItem*>(item.get());
+            for (const DisplayItem& item : displayList) {
+                if (item.type == DisplayItemType::BACKGROUND) {
+                    const auto& bgItem = item.as<BackgroundDisplayItem>();
                     canvas->drawRect(
-                        static_cast<int>(bgItem->rect().x),
-                        static_cast<int>(bgItem->rect().y),
-                        static_cast<int>(bgItem->rect().width),
-                        static_cast<int>(bgItem->rect().height),
-                        Canvas::rgb(bgItem->color().r, bgItem->color().g, bgItem->color().b),
+                        static_cast<int>(bgItem.rect.x),
+                        static_cast<int>(bgItem.rect.y),
+                        static_cast<int>(bgItem.rect.width),
+                        static_cast<int>(bgItem.rect.height),
+                        Canvas::rgb(bgItem.color.r, bgItem.color.g, bgItem.color.b),
                         true
                     );
                 }
             }
             
             // Also show ASCII representation
-            std::string ascii = renderer->renderToASCII(layoutEngine.layoutRoot().get(), 80, 24);
+            std::string ascii = renderer->renderToASCII(layoutEngine.layoutRoot(), 80, 24);
             std::cout << "ASCII Render:\n" << ascii << std::endl;
         }
         
@@ -0,0 +1,62 @@
+#ifndef BROWSER_BLOOM_FILTER_H
+#define BROWSER_BLOOM_FILTER_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace browser {
+namespace css {
+
+// Counting Bloom filter over 32-bit hashes, probed at two slots taken from
+// the low and high bits of each hash. A counter that overflows stays
+// saturated, so removing keys can only leave false positives behind.
+class CountingBloomFilter {
+public:
+    static constexpr unsigned keyBits = 12;
+
+    CountingBloomFilter() { clear(); }
+
+    void add(uint32_t hash) {
+        increment(m_counters[firstSlot(hash)]);
+        increment(m_counters[secondSlot(hash)]);
+    }
+
+    void remove(uint32_t hash) {
+        decrement(m_counters[firstSlot(hash)]);
+        decrement(m_counters[secondSlot(hash)]);
+    }
+
+    // False means the hash was definitely never added (or was removed)
+    bool mayContain(uint32_t hash) const {
+        return m_counters[firstSlot(hash)] && m_counters[secondSlot(hash)];
+    }
+
+    void clear() { std::memset(m_counters, 0, sizeof(m_counters)); }
+
+private:
+    static constexpr uint32_t tableSize = 1u << keyBits;
+    static constexpr uint32_t keyMask = tableSize - 1;
+    static constexpr uint8_t saturated = 0xff;
+
+    static uint32_t firstSlot(uint32_t hash) { return hash & keyMask; }
+    static uint32_t secondSlot(uint32_t hash) { return (hash >> 16) & keyMask; }
+
+    static void increment(uint8_t& counter) {
+        if (counter != saturated) {
+            ++counter;
+        }
+    }
+
+    static void decrement(uint8_t& counter) {
+        if (counter != saturated) {
+            --counter;
+        }
+    }
+
+    uint8_t m_counters[tableSize];
+};
+
+} // namespace css
+} // namespace browser
+
+#endif // BROWSER_BLOOM_FILTER_H
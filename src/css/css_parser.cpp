@@ -1,144 +1,16 @@
 #include "css_parser.h"
+#include "../threading/work_pool.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
-#include <regex>
 #include <cctype>
-#include <map>
+#include <iterator>
 
 namespace browser {
 namespace css {
 
-//-----------------------------------------------------------------------------
-// Value Implementation
-//-----------------------------------------------------------------------------
-
-Value::Value()
-    : m_type(ValueType::UNKNOWN)
-    , m_numericValue(0.0)
-    , m_unit(Unit::NONE)
-{
-}
-
-Value::Value(const std::string& value)
-    : m_type(ValueType::UNKNOWN)
-    , m_numericValue(0.0)
-    , m_unit(Unit::NONE)
-{
-    parse(value);
-}
-
-Value::~Value() {
-}
-
-void Value::parse(const std::string& value) {
-    // Store original value
-    m_stringValue = value;
-    
-    // Try to parse as different value types
-    if (parseLength(value)) {
-        m_type = ValueType::LENGTH;
-    } else if (parseColor(value)) {
-        m_type = ValueType::COLOR;
-    } else if (parsePercentage(value)) {
-        m_type = ValueType::PERCENTAGE;
-    } else {
-        // Default to keyword or string
-        m_type = ValueType::KEYWORD;
-    }
-}
-
-bool Value::parseLength(const std::string& value) {
-    std::regex lengthRegex("([0-9]*\\.?[0-9]+)(px|em|rem|vh|vw|%)");
-    std::smatch match;
-    
-    if (std::regex_match(value, match, lengthRegex)) {
-        m_numericValue = std::stod(match[1].str());
-        
-        std::string unit = match[2].str();
-        if (unit == "px") {
-            m_unit = Unit::PX;
-        } else if (unit == "em") {
-            m_unit = Unit::EM;
-        } else if (unit == "rem") {
-            m_unit = Unit::REM;
-        } else if (unit == "vh") {
-            m_unit = Unit::VH;
-        } else if (unit == "vw") {
-            m_unit = Unit::VW;
-        } else if (unit == "%") {
-            m_unit = Unit::PERCENTAGE;
-            m_type = ValueType::PERCENTAGE;
-        }
-        
-        return true;
-    }
-    
-    // Check for zero without unit
-    std::regex zeroRegex("^(0)$");
-    if (std::regex_match(value, match, zeroRegex)) {
-        m_numericValue = 0.0;
-        m_unit = Unit::PX;
-        return true;
-    }
-    
-    return false;
-}
-
-bool Value::parseColor(const std::string& value) {
-    // Check for hex colors
-    std::regex hexRegex("#([0-9a-fA-F]{3}|[0-9a-fA-F]{6})");
-    
-    // Check for named colors
-    static const std::map<std::string, std::string> namedColors = {
-        {"black", "#000000"},
-        {"white", "#ffffff"},
-        {"red", "#ff0000"},
-        {"green", "#008000"},
-        {"blue", "#0000ff"},
-        {"yellow", "#ffff00"},
-        {"gray", "#808080"},
-        {"purple", "#800080"},
-        // Add more named colors as needed
-    };
-    
-    // Check for rgba/rgb
-    std::regex rgbaRegex("rgba?\\((\\d+),\\s*(\\d+),\\s*(\\d+)(?:,\\s*([0-9]*\\.?[0-9]+))?\\)");
-    
-    if (std::regex_match(value, hexRegex)) {
-        return true;
-    }
-    
-    auto it = namedColors.find(value);
-    if (it != namedColors.end()) {
-        return true;
-    }
-    
-    std::smatch match;
-    if (std::regex_match(value, match, rgbaRegex)) {
-        return true;
-    }
-    
-    return false;
-}
-
-bool Value::parsePercentage(const std::string& value) {
-    std::regex percentRegex("([0-9]*\\.?[0-9]+)%");
-    std::smatch match;
-    
-    if (std::regex_match(value, match, percentRegex)) {
-        m_numericValue = std::stod(match[1].str());
-        m_unit = Unit::PERCENTAGE;
-        return true;
-    }
-    
-    return false;
-}
-
-std::string Value::toString() const {
-    return m_stringValue;
-}
-
 //-----------------------------------------------------------------------------
 // Declaration Implementation
 //-----------------------------------------------------------------------------
@@ -167,153 +39,319 @@ Selector::Selector(const std::string& selectorText) {
 Selector::~Selector() {
 }
 
+namespace {
+
+bool isSelectorSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+bool isIdentChar(char c) {
+    unsigned char u = static_cast<unsigned char>(c);
+    return std::isalnum(u) || c == '-' || c == '_' || u >= 0x80;
+}
+
+bool skipSelectorSpace(const std::string& text, size_t& pos) {
+    size_t start = pos;
+    while (pos < text.size() && isSelectorSpace(text[pos])) {
+        ++pos;
+    }
+    return pos > start;
+}
+
+// Identifier with backslash escapes taken literally
+std::string readIdent(const std::string& text, size_t& pos) {
+    std::string ident;
+    while (pos < text.size()) {
+        if (text[pos] == '\\' && pos + 1 < text.size()) {
+            ident += text[pos + 1];
+            pos += 2;
+        } else if (isIdentChar(text[pos])) {
+            ident += text[pos++];
+        } else {
+            break;
+        }
+    }
+    return ident;
+}
+
+std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+        [](unsigned char c) { return static_cast<char>(::tolower(c)); });
+    return text;
+}
+
+// True if value contains token as a whitespace-separated word
+bool containsWord(const std::string& value, const std::string& token) {
+    if (token.empty()) {
+        return false;
+    }
+    size_t pos = 0;
+    while ((pos = value.find(token, pos)) != std::string::npos) {
+        bool startOk = pos == 0 || isSelectorSpace(value[pos - 1]);
+        size_t end = pos + token.size();
+        bool endOk = end == value.size() || isSelectorSpace(value[end]);
+        if (startOk && endOk) {
+            return true;
+        }
+        pos = end;
+    }
+    return false;
+}
+
+} // namespace
+
 bool Selector::parse(const std::string& selectorText) {
     // Clear any existing components
-    m_components.clear();
-    
-    // Split by combinators (space, >, +, ~)
-    std::string text = selectorText;
-    std::string::size_type pos = 0;
-    
-    // Simple implementation for basic selectors
-    // In a real browser, use a proper tokenizer and parser for complex selectors
-    
-    // Replace multiple spaces with a single space
-    std::regex multiSpace("\\s+");
-    text = std::regex_replace(text, multiSpace, " ");
-    
-    // Trim leading/trailing spaces
-    text = text.substr(text.find_first_not_of(" "), text.find_last_not_of(" ") - text.find_first_not_of(" ") + 1);
-    
-    // Check for descendant selectors (space)
-    if (text.find(" ") != std::string::npos) {
-        // Split by space and create descendant components
-        std::istringstream iss(text);
-        std::string part;
-        std::vector<std::string> parts;
+    m_compounds.clear();
+    m_ancestorHashes.clear();
+    m_dependsOnSiblings = false;
+    m_hasSubjectAttributeSelector = false;
+    m_usesSiblingRelations = false;
+    m_hasAncestorAttributeSelector = false;
+    
+    const std::string& text = selectorText;
+    size_t pos = 0;
+    skipSelectorSpace(text, pos);
+    
+    SelectorType combinator = SelectorType::DESCENDANT;
+    while (pos < text.size()) {
+        Compound compound;
+        compound.combinator = combinator;
+        if (!parseCompound(text, pos, compound)) {
+            m_compounds.clear();
+            return false;
+        }
+        m_compounds.push_back(std::move(compound));
         
-        while (std::getline(iss, part, ' ')) {
-            if (!part.empty()) {
-                parts.push_back(part);
-            }
+        // Combinator, or the end of the selector
+        bool sawSpace = skipSelectorSpace(text, pos);
+        if (pos >= text.size()) {
+            break;
         }
         
-        // Create components for each part
-        for (size_t i = 0; i < parts.size(); ++i) {
-            Component component;
-            if (!parseComponent(parts[i], component)) {
+        char c = text[pos];
+        if (c == '>' || c == '+' || c == '~') {
+            combinator = c == '>' ? SelectorType::CHILD :
+                         c == '+' ? SelectorType::ADJACENT_SIBLING : SelectorType::GENERAL_SIBLING;
+            ++pos;
+            skipSelectorSpace(text, pos);
+            if (pos >= text.size()) {
+                // Dangling combinator
+                m_compounds.clear();
                 return false;
             }
-            
-            if (i > 0) {
-                // Add a descendant combinator
-                Component combinator;
-                combinator.type = SelectorType::DESCENDANT;
-                combinator.subSelectors.push_back(m_components.back());
-                combinator.subSelectors.push_back(component);
-                
-                // Replace the last component with the combinator
-                m_components.pop_back();
-                m_components.push_back(combinator);
-            } else {
-                m_components.push_back(component);
-            }
+        } else if (sawSpace) {
+            combinator = SelectorType::DESCENDANT;
+        } else {
+            m_compounds.clear();
+            return false;
         }
-        
-        return true;
     }
     
-    // Check for direct child selector (>)
-    if (text.find(">") != std::string::npos) {
-        // Split by > and create child components
-        // Similar to descendant implementation
-        return true;
-    }
-    
-    // Check for adjacent sibling selector (+)
-    if (text.find("+") != std::string::npos) {
-        // Similar implementation
-        return true;
-    }
-    
-    // Check for general sibling selector (~)
-    if (text.find("~") != std::string::npos) {
-        // Similar implementation
-        return true;
-    }
-    
-    // Simple selector (no combinators)
-    Component component;
-    return parseComponent(text, component) && (m_components.push_back(component), true);
+    collectAncestorHashes();
+    collectDependencyFlags();
+    return !m_compounds.empty();
 }
 
-bool Selector::parseComponent(const std::string& text, Component& component) {
-    if (text.empty()) {
-        return false;
+void Selector::collectDependencyFlags() {
+    for (size_t index = 0; index < m_compounds.size(); ++index) {
+        const Compound& compound = m_compounds[index];
+        bool isSubject = index + 1 == m_compounds.size();
+        
+        if (index > 0 &&
+            (compound.combinator == SelectorType::ADJACENT_SIBLING ||
+             compound.combinator == SelectorType::GENERAL_SIBLING)) {
+            m_usesSiblingRelations = true;
+            if (isSubject) {
+                m_dependsOnSiblings = true;
+            }
+        }
+        
+        for (const auto& component : compound.components) {
+            if (component.type == SelectorType::ATTRIBUTE) {
+                if (isSubject) {
+                    m_hasSubjectAttributeSelector = true;
+                } else {
+                    m_hasAncestorAttributeSelector = true;
+                }
+            } else if (component.type == SelectorType::PSEUDO_CLASS &&
+                       (component.value == "first-child" || component.value == "last-child" ||
+                        component.value == "only-child" || component.value == "empty")) {
+                m_usesSiblingRelations = true;
+                if (isSubject) {
+                    m_dependsOnSiblings = true;
+                }
+            }
+        }
     }
-    
-    // Check for ID selector
-    if (text[0] == '#') {
-        component.type = SelectorType::ID;
-        component.value = text.substr(1);
-        return true;
+}
+
+void Selector::collectAncestorHashes() {
+    // A compound left of a descendant or child combinator matches a proper
+    // ancestor of the subject: the element on its right is the subject, an
+    // ancestor of it, or a sibling of one of those
+    for (size_t index = 1; index < m_compounds.size(); ++index) {
+        SelectorType combinator = m_compounds[index].combinator;
+        if (combinator != SelectorType::DESCENDANT && combinator != SelectorType::CHILD) {
+            continue;
+        }
+        
+        for (const auto& component : m_compounds[index - 1].components) {
+            uint32_t hash;
+            switch (component.type) {
+                case SelectorType::TYPE:
+                    hash = ancestorHash(component.type, toLower(component.value));
+                    break;
+                case SelectorType::ID:
+                case SelectorType::CLASS:
+                    hash = ancestorHash(component.type, component.value);
+                    break;
+                default:
+                    continue;
+            }
+            if (std::find(m_ancestorHashes.begin(), m_ancestorHashes.end(), hash) == m_ancestorHashes.end()) {
+                m_ancestorHashes.push_back(hash);
+            }
+        }
     }
-    
-    // Check for class selector
-    if (text[0] == '.') {
-        component.type = SelectorType::CLASS;
-        component.value = text.substr(1);
-        return true;
+}
+
+uint32_t Selector::ancestorHash(SelectorType type, const std::string& value) {
+    // FNV-1a, salted with the type so tag "a" and class "a" differ, and
+    // mixed so the high bits are as good as the low ones
+    uint32_t hash = 2166136261u ^ static_cast<uint32_t>(type);
+    for (char c : value) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
     }
-    
-    // Check for universal selector
-    if (text[0] == '*') {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+bool Selector::parseCompound(const std::string& text, size_t& pos, Compound& compound) {
+    // Type or universal selector may only come first
+    if (pos < text.size() && text[pos] == '*') {
+        Component component;
         component.type = SelectorType::UNIVERSAL;
-        return true;
-    }
-    
-    // Check for attribute selector
-    if (text[0] == '[' && text.back() == ']') {
-        component.type = SelectorType::ATTRIBUTE;
-        
-        // Extract attribute name and value
-        std::string attrText = text.substr(1, text.length() - 2);
-        
-        // Handle different attribute selectors ([attr], [attr=value], etc.)
-        size_t eqPos = attrText.find('=');
-        if (eqPos != std::string::npos) {
-            component.attributeName = attrText.substr(0, eqPos);
-            component.attributeValue = attrText.substr(eqPos + 1);
+        compound.components.push_back(component);
+        ++pos;
+    } else if (pos < text.size() && (isIdentChar(text[pos]) || text[pos] == '\\')) {
+        Component component;
+        component.type = SelectorType::TYPE;
+        component.value = readIdent(text, pos);
+        compound.components.push_back(component);
+    }
+    
+    while (pos < text.size()) {
+        char c = text[pos];
+        Component component;
+        
+        if (c == '#' || c == '.') {
+            ++pos;
+            component.type = c == '#' ? SelectorType::ID : SelectorType::CLASS;
+            component.value = readIdent(text, pos);
+            if (component.value.empty()) {
+                return false;
+            }
+        } else if (c == '[') {
+            ++pos;
+            component.type = SelectorType::ATTRIBUTE;
+            skipSelectorSpace(text, pos);
+            component.attributeName = toLower(readIdent(text, pos));
+            if (component.attributeName.empty()) {
+                return false;
+            }
+            skipSelectorSpace(text, pos);
+            if (pos >= text.size()) {
+                return false;
+            }
             
-            // Remove quotes if present
-            if ((component.attributeValue.front() == '"' && component.attributeValue.back() == '"') ||
-                (component.attributeValue.front() == '\'' && component.attributeValue.back() == '\'')) {
-                component.attributeValue = component.attributeValue.substr(1, component.attributeValue.length() - 2);
+            if (text[pos] != ']') {
+                // Operator
+                char op = text[pos];
+                if (op == '=') {
+                    component.attributeMatch = AttributeMatch::EQUALS;
+                    ++pos;
+                } else if (pos + 1 < text.size() && text[pos + 1] == '=') {
+                    switch (op) {
+                        case '~': component.attributeMatch = AttributeMatch::INCLUDES; break;
+                        case '|': component.attributeMatch = AttributeMatch::DASH_MATCH; break;
+                        case '^': component.attributeMatch = AttributeMatch::PREFIX; break;
+                        case '$': component.attributeMatch = AttributeMatch::SUFFIX; break;
+                        case '*': component.attributeMatch = AttributeMatch::SUBSTRING; break;
+                        default: return false;
+                    }
+                    pos += 2;
+                } else {
+                    return false;
+                }
+                
+                // Value, quoted or bare
+                skipSelectorSpace(text, pos);
+                if (pos < text.size() && (text[pos] == '"' || text[pos] == '\'')) {
+                    char quote = text[pos];
+                    size_t end = text.find(quote, pos + 1);
+                    if (end == std::string::npos) {
+                        return false;
+                    }
+                    component.attributeValue = text.substr(pos + 1, end - pos - 1);
+                    pos = end + 1;
+                } else {
+                    component.attributeValue = readIdent(text, pos);
+                }
+                skipSelectorSpace(text, pos);
+                
+                // Case-insensitivity flag is accepted but not honoured
+                if (pos < text.size() && (text[pos] == 'i' || text[pos] == 'I' || text[pos] == 's' || text[pos] == 'S')) {
+                    ++pos;
+                    skipSelectorSpace(text, pos);
+                }
+            }
+            
+            if (pos >= text.size() || text[pos] != ']') {
+                return false;
+            }
+            ++pos;
+        } else if (c == ':') {
+            ++pos;
+            component.type = SelectorType::PSEUDO_CLASS;
+            if (pos < text.size() && text[pos] == ':') {
+                component.type = SelectorType::PSEUDO_ELEMENT;
+                ++pos;
+            }
+            component.value = toLower(readIdent(text, pos));
+            if (component.value.empty()) {
+                return false;
+            }
+            
+            // Functional pseudo-classes keep their argument unparsed
+            if (pos < text.size() && text[pos] == '(') {
+                int depth = 0;
+                size_t start = pos + 1;
+                for (; pos < text.size(); ++pos) {
+                    if (text[pos] == '(') {
+                        depth++;
+                    } else if (text[pos] == ')' && --depth == 0) {
+                        break;
+                    }
+                }
+                if (pos >= text.size()) {
+                    return false;
+                }
+                component.attributeValue = text.substr(start, pos - start);
+                ++pos;
             }
         } else {
-            component.attributeName = attrText;
+            break;
         }
         
-        return true;
-    }
-    
-    // Check for pseudo-class and pseudo-element
-    if (text[0] == ':') {
-        // Double colon for pseudo-element (::before)
-        if (text.length() > 1 && text[1] == ':') {
-            component.type = SelectorType::PSEUDO_ELEMENT;
-            component.value = text.substr(2);
-        } else {
-            component.type = SelectorType::PSEUDO_CLASS;
-            component.value = text.substr(1);
-        }
-        return true;
+        compound.components.push_back(component);
     }
     
-    // Must be a type selector
-    component.type = SelectorType::TYPE;
-    component.value = text;
-    return true;
+    return !compound.components.empty();
 }
 
 int Selector::specificity() const {
@@ -323,29 +361,25 @@ int Selector::specificity() const {
     // c = type selectors and pseudo-elements count
     int a = 0, b = 0, c = 0;
     
-    for (const auto& component : m_components) {
-        switch (component.type) {
-            case SelectorType::ID:
-                a++;
-                break;
-            case SelectorType::CLASS:
-            case SelectorType::ATTRIBUTE:
-            case SelectorType::PSEUDO_CLASS:
-                b++;
-                break;
-            case SelectorType::TYPE:
-            case SelectorType::PSEUDO_ELEMENT:
-                c++;
-                break;
-            case SelectorType::DESCENDANT:
-            case SelectorType::CHILD:
-            case SelectorType::ADJACENT_SIBLING:
-            case SelectorType::GENERAL_SIBLING:
-                // Combinators don't affect specificity
-                break;
-            case SelectorType::UNIVERSAL:
-                // Universal selector doesn't affect specificity
-                break;
+    for (const auto& compound : m_compounds) {
+        for (const auto& component : compound.components) {
+            switch (component.type) {
+                case SelectorType::ID:
+                    a++;
+                    break;
+                case SelectorType::CLASS:
+                case SelectorType::ATTRIBUTE:
+                case SelectorType::PSEUDO_CLASS:
+                    b++;
+                    break;
+                case SelectorType::TYPE:
+                case SelectorType::PSEUDO_ELEMENT:
+                    c++;
+                    break;
+                default:
+                    // Universal selector and combinators don't affect specificity
+                    break;
+            }
         }
     }
     
@@ -353,123 +387,248 @@ int Selector::specificity() const {
 }
 
 bool Selector::matches(html::Element* element) const {
-    if (!element) {
+    if (!element || m_compounds.empty()) {
         return false;
     }
     
-    // Match each component against the element
-    for (const auto& component : m_components) {
-        switch (component.type) {
-            case SelectorType::TYPE:
-                if (component.value != element->tagName() && component.value != "*") {
-                    return false;
-                }
-                break;
-            case SelectorType::CLASS: {
-                std::string classes = element->className();
-                std::istringstream iss(classes);
-                std::string cls;
-                bool found = false;
-                
-                while (std::getline(iss, cls, ' ')) {
-                    if (cls == component.value) {
-                        found = true;
-                        break;
-                    }
-                }
-                
-                if (!found) {
-                    return false;
+    return matchesFrom(element, m_compounds.size() - 1);
+}
+
+bool Selector::matchesFrom(html::Element* element, size_t index) const {
+    // All simple selectors of this compound, cheapest rejection first
+    const Compound& compound = m_compounds[index];
+    for (const auto& component : compound.components) {
+        if (!matchesComponent(component, element)) {
+            return false;
+        }
+    }
+    
+    if (index == 0) {
+        return true;
+    }
+    
+    // Walk left through the combinator
+    switch (compound.combinator) {
+        case SelectorType::CHILD: {
+            html::Element* parent = element->parentElement();
+            return parent && matchesFrom(parent, index - 1);
+        }
+        case SelectorType::ADJACENT_SIBLING: {
+            html::Element* sibling = element->previousElementSibling();
+            return sibling && matchesFrom(sibling, index - 1);
+        }
+        case SelectorType::GENERAL_SIBLING:
+            for (html::Element* sibling = element->previousElementSibling(); sibling;
+                 sibling = sibling->previousElementSibling()) {
+                if (matchesFrom(sibling, index - 1)) {
+                    return true;
                 }
-                break;
             }
-            case SelectorType::ID:
-                if (element->id() != component.value) {
-                    return false;
+            return false;
+        default:
+            for (html::Element* ancestor = element->parentElement(); ancestor;
+                 ancestor = ancestor->parentElement()) {
+                if (matchesFrom(ancestor, index - 1)) {
+                    return true;
                 }
-                break;
-            case SelectorType::ATTRIBUTE:
-                if (!element->hasAttribute(component.attributeName)) {
-                    return false;
-                }
-                
-                if (!component.attributeValue.empty() && 
-                    element->getAttribute(component.attributeName) != component.attributeValue) {
-                    return false;
+            }
+            return false;
+    }
+}
+
+bool Selector::matchesComponent(const Component& component, html::Element* element) const {
+    html::AtomTable* table = element->atomTable();
+    if (component.atomTableSerial != table->serial()) {
+        resolveAtoms(component, table);
+    }
+    
+    switch (component.type) {
+        case SelectorType::TYPE:
+            return element->tagAtom() == component.atom;
+        case SelectorType::CLASS:
+            return element->hasClass(component.atom);
+        case SelectorType::ID:
+            return element->idAtom() == component.atom;
+        case SelectorType::ATTRIBUTE: {
+            if (!element->hasAttribute(component.attributeAtom)) {
+                return false;
+            }
+            if (component.attributeMatch == AttributeMatch::EXISTS) {
+                return true;
+            }
+            
+            std::string value = element->getAttribute(component.attributeAtom);
+            const std::string& expected = component.attributeValue;
+            switch (component.attributeMatch) {
+                case AttributeMatch::EQUALS:
+                    return value == expected;
+                case AttributeMatch::INCLUDES:
+                    return containsWord(value, expected);
+                case AttributeMatch::DASH_MATCH:
+                    return value == expected ||
+                           (value.size() > expected.size() && value.compare(0, expected.size(), expected) == 0 &&
+                            value[expected.size()] == '-');
+                case AttributeMatch::PREFIX:
+                    return !expected.empty() && value.compare(0, expected.size(), expected) == 0;
+                case AttributeMatch::SUFFIX:
+                    return !expected.empty() && value.size() >= expected.size() &&
+                           value.compare(value.size() - expected.size(), expected.size(), expected) == 0;
+                case AttributeMatch::SUBSTRING:
+                    return !expected.empty() && value.find(expected) != std::string::npos;
+                default:
+                    return true;
+            }
+        }
+        case SelectorType::PSEUDO_CLASS:
+            // Structural pseudo-classes; dynamic state (hover, focus, ...)
+            // isn't tracked, so those match as before
+            if (component.value == "first-child") {
+                return !element->previousElementSibling();
+            }
+            if (component.value == "last-child") {
+                return !element->nextElementSibling();
+            }
+            if (component.value == "only-child") {
+                return !element->previousElementSibling() && !element->nextElementSibling();
+            }
+            if (component.value == "root") {
+                return element->parentNode() && element->parentNode()->nodeType() == html::NodeType::DOCUMENT_NODE;
+            }
+            if (component.value == "empty") {
+                for (const auto& child : element->childNodes()) {
+                    if (child->nodeType() == html::NodeType::ELEMENT_NODE ||
+                        (child->nodeType() == html::NodeType::TEXT_NODE && !child->nodeValue().empty())) {
+                        return false;
+                    }
                 }
-                break;
-            case SelectorType::DESCENDANT:
-                // Not implemented in this simple version
-                break;
-            case SelectorType::CHILD:
-                // Not implemented in this simple version
-                break;
-            case SelectorType::ADJACENT_SIBLING:
-                // Not implemented in this simple version
-                break;
-            case SelectorType::GENERAL_SIBLING:
-                // Not implemented in this simple version
-                break;
-            case SelectorType::PSEUDO_CLASS:
-                // Not implemented in this simple version
-                // Would need state information (hover, active, etc.)
-                break;
-            case SelectorType::PSEUDO_ELEMENT:
-                // Not relevant for element matching
-                break;
-            case SelectorType::UNIVERSAL:
-                // Always matches
-                break;
+                return true;
+            }
+            return true;
+        case SelectorType::PSEUDO_ELEMENT:
+            // Pseudo-elements are not elements
+            return false;
+        default:
+            return true;
+    }
+}
+
+SelectorType Selector::subjectKey(std::string& value) const {
+    value.clear();
+    if (m_compounds.empty()) {
+        return SelectorType::UNIVERSAL;
+    }
+    
+    SelectorType key = SelectorType::UNIVERSAL;
+    for (const auto& component : m_compounds.back().components) {
+        if (component.type == SelectorType::ID) {
+            value = component.value;
+            return SelectorType::ID;
+        }
+        if (component.type == SelectorType::CLASS && key != SelectorType::CLASS) {
+            key = SelectorType::CLASS;
+            value = component.value;
+        } else if (component.type == SelectorType::TYPE && key == SelectorType::UNIVERSAL) {
+            key = SelectorType::TYPE;
+            value = toLower(component.value);
+        }
+    }
+    return key;
+}
+
+void Selector::bindAtoms(html::AtomTable* table) const {
+    for (const Compound& compound : m_compounds) {
+        for (const Component& component : compound.components) {
+            if (component.atomTableSerial != table->serial()) {
+                resolveAtoms(component, table);
+            }
         }
     }
+}
+
+void Selector::resolveAtoms(const Component& component, html::AtomTable* table) const {
+    component.atomTableSerial = table->serial();
+    component.atom = html::atoms::NONE;
+    component.attributeAtom = html::atoms::NONE;
     
-    return true;
+    switch (component.type) {
+        case SelectorType::TYPE: {
+            // Tag atoms are interned lowercased
+            std::string tag = component.value;
+            std::transform(tag.begin(), tag.end(), tag.begin(),
+                [](unsigned char c) { return static_cast<char>(::tolower(c)); });
+            component.atom = table->intern(tag);
+            break;
+        }
+        case SelectorType::CLASS:
+        case SelectorType::ID:
+            component.atom = table->intern(component.value);
+            break;
+        case SelectorType::ATTRIBUTE:
+            component.attributeAtom = table->intern(component.attributeName);
+            break;
+        default:
+            break;
+    }
 }
 
 std::string Selector::toString() const {
     std::string result;
     
-    for (size_t i = 0; i < m_components.size(); ++i) {
-        const auto& component = m_components[i];
+    for (size_t i = 0; i < m_compounds.size(); ++i) {
+        const Compound& compound = m_compounds[i];
+        
+        if (i > 0) {
+            switch (compound.combinator) {
+                case SelectorType::CHILD:
+                    result += " > ";
+                    break;
+                case SelectorType::ADJACENT_SIBLING:
+                    result += " + ";
+                    break;
+                case SelectorType::GENERAL_SIBLING:
+                    result += " ~ ";
+                    break;
+                default:
+                    result += " ";
+                    break;
+            }
+        }
         
-        switch (component.type) {
-            case SelectorType::TYPE:
-                result += component.value;
-                break;
-            case SelectorType::CLASS:
-                result += "." + component.value;
-                break;
-            case SelectorType::ID:
-                result += "#" + component.value;
-                break;
-            case SelectorType::UNIVERSAL:
-                result += "*";
-                break;
-            case SelectorType::ATTRIBUTE:
-                result += "[" + component.attributeName;
-                if (!component.attributeValue.empty()) {
-                    result += "=\"" + component.attributeValue + "\"";
+        for (const auto& component : compound.components) {
+            switch (component.type) {
+                case SelectorType::TYPE:
+                    result += component.value;
+                    break;
+                case SelectorType::CLASS:
+                    result += "." + component.value;
+                    break;
+                case SelectorType::ID:
+                    result += "#" + component.value;
+                    break;
+                case SelectorType::UNIVERSAL:
+                    result += "*";
+                    break;
+                case SelectorType::ATTRIBUTE: {
+                    static const char* const kOperators[] = { "", "=", "~=", "|=", "^=", "$=", "*=" };
+                    result += "[" + component.attributeName;
+                    if (component.attributeMatch != AttributeMatch::EXISTS) {
+                        result += kOperators[static_cast<int>(component.attributeMatch)];
+                        result += "\"" + component.attributeValue + "\"";
+                    }
+                    result += "]";
+                    break;
                 }
-                result += "]";
-                break;
-            case SelectorType::PSEUDO_CLASS:
-                result += ":" + component.value;
-                break;
-            case SelectorType::PSEUDO_ELEMENT:
-                result += "::" + component.value;
-                break;
-            case SelectorType::DESCENDANT:
-                if (i > 0) result += " ";
-                break;
-            case SelectorType::CHILD:
-                result += " > ";
-                break;
-            case SelectorType::ADJACENT_SIBLING:
-                result += " + ";
-                break;
-            case SelectorType::GENERAL_SIBLING:
-                result += " ~ ";
-                break;
+                case SelectorType::PSEUDO_CLASS:
+                case SelectorType::PSEUDO_ELEMENT:
+                    result += component.type == SelectorType::PSEUDO_ELEMENT ? "::" : ":";
+                    result += component.value;
+                    if (!component.attributeValue.empty()) {
+                        result += "(" + component.attributeValue + ")";
+                    }
+                    break;
+                default:
+                    break;
+            }
         }
     }
     
@@ -508,6 +667,10 @@ void StyleSheet::addRule(const StyleRule& rule) {
     m_rules.push_back(rule);
 }
 
+void StyleSheet::addRule(StyleRule&& rule) {
+    m_rules.push_back(std::move(rule));
+}
+
 bool StyleSheet::parse(const std::string& cssText) {
     // Create a CSS parser and parse the stylesheet
     CSSParser parser;
@@ -614,247 +777,124 @@ bool StyleSheet::parseDeclarationBlock(const std::string& blockText, StyleRule&
 // CSSParser Implementation
 //-----------------------------------------------------------------------------
 
-CSSParser::CSSParser() {
+CSSParser::CSSParser()
+    : m_workPool(&threading::WorkPool::shared())
+{
 }
 
 CSSParser::~CSSParser() {
 }
 
 std::shared_ptr<StyleSheet> CSSParser::parseStylesheet(const std::string& css) {
+    ALLOC_SCOPE(CSS);
     auto sheet = std::make_shared<StyleSheet>();
+    std::vector<StyleRule> rules;
     
-    // Tokenize the CSS
-    std::vector<Token> tokens = tokenize(css);
-    
-    // Parse the tokens into rules
-    size_t pos = 0;
-    while (pos < tokens.size()) {
-        // Skip whitespace and comments
-        while (pos < tokens.size() && 
-              (tokens[pos].type == TokenType::WHITESPACE || 
-               tokens[pos].type == TokenType::COMMENT)) {
-            pos++;
+    if (css.size() < parallelParseThreshold || !m_workPool || m_workPool->workerCount() == 0) {
+        parseRules(css, rules);
+    } else {
+        TRACE_SCOPE("css", "CSSParser::parseStylesheetInParallel");
+        
+        // A few chunks per thread, so that stealing can even them out
+        size_t threads = m_workPool->workerCount() + 1;
+        size_t chunkSize = std::max<size_t>(16 * 1024, css.size() / (threads * 4));
+        std::vector<size_t> boundaries = findChunkBoundaries(css, chunkSize);
+        boundaries.push_back(css.size());
+        
+        std::vector<std::vector<StyleRule>> chunks(boundaries.size() - 1);
+        {
+            std::string_view source(css);
+            threading::TaskGroup group(*m_workPool);
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                group.run([this, source, &boundaries, &chunks, i] {
+                    parseRules(source.substr(boundaries[i], boundaries[i + 1] - boundaries[i]), chunks[i]);
+                });
+            }
+            group.wait();
         }
         
-        if (pos >= tokens.size()) {
-            break;
+        for (std::vector<StyleRule>& chunk : chunks) {
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(rules));
+        }
+    }
+    
+    for (StyleRule& rule : rules) {
+        sheet->addRule(std::move(rule));
+    }
+    return sheet;
+}
+
+void CSSParser::parseRules(std::string_view css, std::vector<StyleRule>& rules) {
+    // Tokens are pulled as the rules are parsed
+    CSSTokenizer tokenizer(css);
+    TokenView token;
+    tokenizer.next(token);
+    
+    while (token.type != TokenType::EOF_TOKEN) {
+        // Skip whitespace and comments
+        if (token.type == TokenType::WHITESPACE || token.type == TokenType::COMMENT) {
+            tokenizer.next(token);
+            continue;
         }
         
         // Parse a rule
-        StyleRule rule = parseRuleFromTokens(tokens, pos);
+        StyleRule rule = parseRule(tokenizer, token);
         
-        // Add the rule to the stylesheet
+        // Keep it if it is complete
         if (!rule.selectors().empty() && !rule.declarations().empty()) {
-            sheet->addRule(rule);
+            rules.push_back(std::move(rule));
         }
     }
+}
+
+std::vector<size_t> CSSParser::findChunkBoundaries(std::string_view css, size_t minChunkSize) {
+    // Rules run from their selectors to the first '{' and from there to the
+    // first '}', so parsing resumes at top level after each closing brace
+    std::vector<size_t> boundaries = {0};
+    CSSTokenizer tokenizer(css);
+    TokenView token;
+    bool inBlock = false;
     
-    return sheet;
+    while (tokenizer.next(token) && token.type != TokenType::EOF_TOKEN) {
+        if (!inBlock && token.type == TokenType::BRACE_OPEN) {
+            inBlock = true;
+        } else if (inBlock && token.type == TokenType::BRACE_CLOSE) {
+            inBlock = false;
+            if (tokenizer.position() - boundaries.back() >= minChunkSize && tokenizer.position() < css.size()) {
+                boundaries.push_back(tokenizer.position());
+            }
+        }
+    }
+    return boundaries;
 }
 
 std::vector<Declaration> CSSParser::parseDeclarations(const std::string& css) {
-    // Tokenize the CSS
-    std::vector<Token> tokens = tokenize(css);
+    CSSTokenizer tokenizer(css);
+    TokenView token;
+    tokenizer.next(token);
     
     // Parse declarations directly
-    size_t pos = 0;
-    return parseDeclarationsFromTokens(tokens, pos);
+    return parseDeclarationList(tokenizer, token);
 }
 
-std::vector<CSSParser::Token> CSSParser::tokenize(const std::string& css) {
-    std::vector<Token> tokens;
-    
-    // Simple tokenizer for demonstration
-    // In a real browser, would use a more sophisticated tokenizer
-    
-    const char* input = css.c_str();
-    size_t length = css.length();
-    size_t pos = 0;
-    
-    while (pos < length) {
-        // Skip whitespace
-        if (std::isspace(input[pos])) {
-            size_t start = pos;
-            while (pos < length && std::isspace(input[pos])) {
-                pos++;
-            }
-            tokens.push_back({TokenType::WHITESPACE, css.substr(start, pos - start)});
-            continue;
-        }
-        
-        // Comments
-        if (pos + 1 < length && input[pos] == '/' && input[pos + 1] == '*') {
-            size_t start = pos;
-            pos += 2;  // Skip /*
-            
-            while (pos + 1 < length && !(input[pos] == '*' && input[pos + 1] == '/')) {
-                pos++;
-            }
-            
-            if (pos + 1 < length) {
-                pos += 2;  // Skip */
-            }
-            
-            tokens.push_back({TokenType::COMMENT, css.substr(start, pos - start)});
-            continue;
-        }
-        
-        // Identifiers
-        if (std::isalpha(input[pos]) || input[pos] == '_' || input[pos] == '-') {
-            size_t start = pos;
-            while (pos < length && (std::isalnum(input[pos]) || input[pos] == '_' || input[pos] == '-')) {
-                pos++;
-            }
-            tokens.push_back({TokenType::IDENT, css.substr(start, pos - start)});
-            continue;
-        }
-        
-        // Numbers
-        if (std::isdigit(input[pos]) || (input[pos] == '.' && pos + 1 < length && std::isdigit(input[pos + 1]))) {
-            size_t start = pos;
-            if (input[pos] == '.') {
-                pos++;
-            } else {
-                while (pos < length && std::isdigit(input[pos])) {
-                    pos++;
-                }
-                
-                if (pos < length && input[pos] == '.') {
-                    pos++;
-                    while (pos < length && std::isdigit(input[pos])) {
-                        pos++;
-                    }
-                }
-            }
-            
-            // Check for percentage
-            if (pos < length && input[pos] == '%') {
-                pos++;
-                tokens.push_back({TokenType::PERCENTAGE, css.substr(start, pos - start)});
-            }
-            // Check for dimension
-            else if (pos < length && (std::isalpha(input[pos]) || input[pos] == '_' || input[pos] == '-')) {
-                size_t unitStart = pos;
-                while (pos < length && (std::isalnum(input[pos]) || input[pos] == '_' || input[pos] == '-')) {
-                    pos++;
-                }
-                tokens.push_back({TokenType::DIMENSION, css.substr(start, pos - start)});
-            } else {
-                tokens.push_back({TokenType::NUMBER, css.substr(start, pos - start)});
-            }
-            continue;
-        }
-        
-        // Strings
-        if (input[pos] == '"' || input[pos] == '\'') {
-            char quote = input[pos];
-            size_t start = pos;
-            pos++;  // Skip the opening quote
-            
-            while (pos < length && input[pos] != quote) {
-                if (input[pos] == '\\' && pos + 1 < length) {
-                    pos += 2;  // Skip escape sequence
-                } else {
-                    pos++;
-                }
-            }
-            
-            if (pos < length) {
-                pos++;  // Skip the closing quote
-            }
-            
-            tokens.push_back({TokenType::STRING, css.substr(start, pos - start)});
-            continue;
-        }
-        
-        // Hash
-        if (input[pos] == '#') {
-            size_t start = pos;
-            pos++;  // Skip #
-            
-            while (pos < length && (std::isalnum(input[pos]) || input[pos] == '_' || input[pos] == '-')) {
-                pos++;
-            }
-            
-            tokens.push_back({TokenType::HASH, css.substr(start, pos - start)});
-            continue;
-        }
-        
-        // Delimiters
-        switch (input[pos]) {
-            case '{':
-                tokens.push_back({TokenType::BRACE_OPEN, "{"});
-                pos++;
-                break;
-            case '}':
-                tokens.push_back({TokenType::BRACE_CLOSE, "}"});
-                pos++;
-                break;
-            case '(':
-                tokens.push_back({TokenType::PAREN_OPEN, "("});
-                pos++;
-                break;
-            case ')':
-                tokens.push_back({TokenType::PAREN_CLOSE, ")"});
-                pos++;
-                break;
-            case '[':
-                tokens.push_back({TokenType::BRACKET_OPEN, "["});
-                pos++;
-                break;
-            case ']':
-                tokens.push_back({TokenType::BRACKET_CLOSE, "]"});
-                pos++;
-                break;
-            case ':':
-                tokens.push_back({TokenType::COLON, ":"});
-                pos++;
-                break;
-            case ';':
-                tokens.push_back({TokenType::SEMICOLON, ";"});
-                pos++;
-                break;
-            case ',':
-                tokens.push_back({TokenType::COMMA, ","});
-                pos++;
-                break;
-            default:
-                // Other delimiters
-                tokens.push_back({TokenType::DELIM, std::string(1, input[pos])});
-                pos++;
-                break;
-        }
-    }
-    
-    // Add EOF token
-    tokens.push_back({TokenType::EOF_TOKEN, ""});
-    
-    return tokens;
-}
-
-StyleRule CSSParser::parseRuleFromTokens(const std::vector<Token>& tokens, size_t& pos) {
+StyleRule CSSParser::parseRule(CSSTokenizer& tokenizer, TokenView& token) {
     StyleRule rule;
     
-    // Parse selectors
-    std::vector<Selector> selectors = parseSelectorsFromTokens(tokens, pos);
+    // Parse selectors, up to the opening brace
+    std::vector<Selector> selectors = parseSelectors(tokenizer, token);
     for (const auto& selector : selectors) {
         rule.addSelector(selector);
     }
     
-    // Skip to opening brace
-    while (pos < tokens.size() && tokens[pos].type != TokenType::BRACE_OPEN) {
-        pos++;
-    }
-    
-    if (pos >= tokens.size()) {
+    if (token.type != TokenType::BRACE_OPEN) {
         return rule;
     }
     
     // Skip opening brace
-    pos++;
+    tokenizer.next(token);
     
     // Parse declarations
-    std::vector<Declaration> declarations = parseDeclarationsFromTokens(tokens, pos);
+    std::vector<Declaration> declarations = parseDeclarationList(tokenizer, token);
     for (const auto& declaration : declarations) {
         rule.addDeclaration(declaration);
     }
@@ -862,108 +902,102 @@ StyleRule CSSParser::parseRuleFromTokens(const std::vector<Token>& tokens, size_
     return rule;
 }
 
-std::vector<Selector> CSSParser::parseSelectorsFromTokens(const std::vector<Token>& tokens, size_t& pos) {
+std::vector<Selector> CSSParser::parseSelectors(CSSTokenizer& tokenizer, TokenView& token) {
     std::vector<Selector> selectors;
     std::string currentSelector;
     
-    while (pos < tokens.size() && tokens[pos].type != TokenType::BRACE_OPEN) {
-        if (tokens[pos].type == TokenType::COMMA) {
+    for (; token.type != TokenType::BRACE_OPEN && token.type != TokenType::EOF_TOKEN; tokenizer.next(token)) {
+        if (token.type == TokenType::COMMA) {
             // End of selector, start a new one
             if (!currentSelector.empty()) {
-                Selector selector(currentSelector);
-                selectors.push_back(selector);
+                selectors.emplace_back(currentSelector);
                 currentSelector.clear();
             }
-        } else if (tokens[pos].type != TokenType::WHITESPACE) {
-            currentSelector += tokens[pos].value;
+        } else if (token.type != TokenType::WHITESPACE) {
+            currentSelector.append(token.text.data(), token.text.size());
         } else if (!currentSelector.empty()) {
             // Add a space for descendant selectors, but only if we have content already
-            currentSelector += " ";
+            currentSelector += ' ';
         }
-        
-        pos++;
     }
     
     // Add the last selector
     if (!currentSelector.empty()) {
-        Selector selector(currentSelector);
-        selectors.push_back(selector);
+        selectors.emplace_back(currentSelector);
     }
     
     return selectors;
 }
 
-std::vector<Declaration> CSSParser::parseDeclarationsFromTokens(const std::vector<Token>& tokens, size_t& pos) {
+std::vector<Declaration> CSSParser::parseDeclarationList(CSSTokenizer& tokenizer, TokenView& token) {
     std::vector<Declaration> declarations;
     std::string currentProperty;
     std::string currentValue;
+    TokenView valueToken;       // The value's last token
+    size_t valueTokenCount = 0;
     bool inProperty = true;
     bool important = false;
     
-    while (pos < tokens.size() && tokens[pos].type != TokenType::BRACE_CLOSE) {
-        if (tokens[pos].type == TokenType::WHITESPACE) {
+    auto addDeclaration = [&]() {
+        if (!currentProperty.empty() && !currentValue.empty()) {
+            // A one-token value (the usual case) comes decoded
+            Declaration declaration(currentProperty, valueTokenCount == 1 ? Value::fromToken(valueToken)
+                                                                          : Value(currentValue));
+            declaration.setImportant(important);
+            declarations.push_back(std::move(declaration));
+        }
+        
+        // Reset
+        currentProperty.clear();
+        currentValue.clear();
+        valueTokenCount = 0;
+        inProperty = true;
+        important = false;
+    };
+    
+    for (; token.type != TokenType::BRACE_CLOSE && token.type != TokenType::EOF_TOKEN; tokenizer.next(token)) {
+        if (token.type == TokenType::WHITESPACE) {
             // Skip whitespace
-            pos++;
             continue;
         }
         
-        if (tokens[pos].type == TokenType::SEMICOLON) {
+        if (token.type == TokenType::SEMICOLON) {
             // End of declaration
-            if (!currentProperty.empty() && !currentValue.empty()) {
-                // Create value and declaration
-                Value value(currentValue);
-                Declaration declaration(currentProperty, value);
-                declaration.setImportant(important);
-                
-                declarations.push_back(declaration);
-            }
-            
-            // Reset
-            currentProperty.clear();
-            currentValue.clear();
-            inProperty = true;
-            important = false;
-            
-            pos++;
+            addDeclaration();
             continue;
         }
         
-        if (tokens[pos].type == TokenType::COLON && inProperty) {
+        if (token.type == TokenType::COLON && inProperty) {
             inProperty = false;
-            pos++;
             continue;
         }
         
         if (inProperty) {
-            currentProperty += tokens[pos].value;
-        } else {
-            // Check for !important
-            if (tokens[pos].type == TokenType::DELIM && tokens[pos].value == "!" &&
-                pos + 1 < tokens.size() && tokens[pos + 1].type == TokenType::IDENT && 
-                tokens[pos + 1].value == "important") {
+            currentProperty.append(token.text.data(), token.text.size());
+            continue;
+        }
+        
+        // Check for !important
+        if (token.type == TokenType::DELIM && token.text == "!") {
+            TokenView next = tokenizer.peek();
+            if (next.type == TokenType::IDENT && next.text == "important") {
                 important = true;
-                pos += 2;
+                tokenizer.next(token);
                 continue;
             }
-            
-            currentValue += tokens[pos].value;
         }
         
-        pos++;
+        currentValue.append(token.text.data(), token.text.size());
+        valueToken = token;
+        ++valueTokenCount;
     }
     
     // Add the last declaration
-    if (!currentProperty.empty() && !currentValue.empty()) {
-        Value value(currentValue);
-        Declaration declaration(currentProperty, value);
-        declaration.setImportant(important);
-        
-        declarations.push_back(declaration);
-    }
+    addDeclaration();
     
     // Skip closing brace
-    if (pos < tokens.size() && tokens[pos].type == TokenType::BRACE_CLOSE) {
-        pos++;
+    if (token.type == TokenType::BRACE_CLOSE) {
+        tokenizer.next(token);
     }
     
     return declarations;
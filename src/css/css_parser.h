@@ -2,12 +2,19 @@
 #ifndef BROWSER_CSS_PARSER_H
 #define BROWSER_CSS_PARSER_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
+#include "css_tokenizer.h"
+#include "css_value.h"
 #include "../html/dom_tree.h"
 
 namespace browser {
+namespace threading {
+class WorkPool;
+}
+
 namespace css {
 
 // Forward declarations
@@ -15,61 +22,7 @@ class StyleSheet;
 class StyleRule;
 class Selector;
 class Declaration;
-
-// CSS value types
-enum class ValueType {
-    KEYWORD,
-    LENGTH,
-    PERCENTAGE,
-    COLOR,
-    STRING,
-    URL,
-    NUMBER,
-    ANGLE,
-    TIME,
-    UNKNOWN
-};
-
-// CSS units
-enum class Unit {
-    PX,
-    EM,
-    REM,
-    VW,
-    VH,
-    PERCENTAGE,
-    NONE  // For unitless values
-};
-
-// CSS value class
-class Value {
-public:
-    Value();
-    Value(const std::string& value);
-    ~Value();
-    
-    ValueType type() const { return m_type; }
-    double numericValue() const { return m_numericValue; }
-    std::string stringValue() const { return m_stringValue; }
-    Unit unit() const { return m_unit; }
-    
-    // Parse and set value from string
-    void parse(const std::string& value);
-    
-    // Convert to string
-    std::string toString() const;
-    
-private:
-    ValueType m_type;
-    std::string m_stringValue;
-    double m_numericValue;
-    Unit m_unit;
-    
-    // Helper methods
-    bool parseLength(const std::string& value);
-    bool parseColor(const std::string& value);
-    bool parsePercentage(const std::string& value);
-};
+class StyleSheetCache;
 
 // CSS declaration (property-value pair)
 class Declaration {
@@ -77,8 +30,8 @@ public:
     Declaration(const std::string& property, const Value& value);
     ~Declaration();
     
-    std::string property() const { return m_property; }
-    Value value() const { return m_value; }
+    const std::string& property() const { return m_property; }
+    const Value& value() const { return m_value; }
     bool important() const { return m_important; }
     
     // Set importance flag
@@ -105,15 +58,28 @@ enum class SelectorType {
     GENERAL_SIBLING   // ~
 };
 
-// CSS selector
+// Attribute selector operators
+enum class AttributeMatch {
+    EXISTS,     // [attr]
+    EQUALS,     // [attr=value]
+    INCLUDES,   // [attr~=value]
+    DASH_MATCH, // [attr|=value]
+    PREFIX,     // [attr^=value]
+    SUFFIX,     // [attr$=value]
+    SUBSTRING   // [attr*=value]
+};
+
+// CSS selector: compound selectors joined by combinators, matched right to
+// left starting from the candidate element
 class Selector {
 public:
     Selector();
     Selector(const std::string& selectorText);
     ~Selector();
     
-    // Parse selector text
+    // Parse selector text; on failure the selector matches nothing
     bool parse(const std::string& selectorText);
+    bool isValid() const { return !m_compounds.empty(); }
     
     // Calculate specificity
     int specificity() const;
@@ -121,25 +87,79 @@ public:
     // Match selector against an element
     bool matches(html::Element* element) const;
     
+    // Intern the selector's names into an element atom table ahead of
+    // matching, which then only reads them and can run on several threads
+    void bindAtoms(html::AtomTable* table) const;
+    
+    // A simple selector of the rightmost compound that every match must
+    // satisfy, preferring ID over CLASS over TYPE; UNIVERSAL if there is none
+    SelectorType subjectKey(std::string& value) const;
+    
+    // Hashes of the tags, ids and classes that some ancestor of every
+    // matching element must have, for rejection with an ancestor filter
+    const std::vector<uint32_t>& ancestorHashes() const { return m_ancestorHashes; }
+    
+    // Hash of a TYPE, ID or CLASS value; tag names must be lowercase
+    static uint32_t ancestorHash(SelectorType type, const std::string& value);
+    
+    // Whether matching looks at the subject's siblings or children (sibling
+    // combinators, :first-child, :empty, ...), not just the subject's own
+    // tag, id, classes and attributes and its ancestors
+    bool dependsOnSiblings() const { return m_dependsOnSiblings; }
+    
+    // Whether an attribute selector applies to the subject itself
+    bool hasSubjectAttributeSelector() const { return m_hasSubjectAttributeSelector; }
+    
+    // Whether any compound uses a sibling combinator or a structural
+    // pseudo-class, so inserting or removing an element can change which
+    // of its siblings (and their descendants) match
+    bool usesSiblingRelations() const { return m_usesSiblingRelations; }
+    
+    // Whether an attribute selector applies to a compound left of the subject
+    bool hasAncestorAttributeSelector() const { return m_hasAncestorAttributeSelector; }
+    
     // Convert to string
     std::string toString() const;
     
 private:
     // Internal representation of selector components
     struct Component {
-        SelectorType type;
+        SelectorType type = SelectorType::UNIVERSAL;
         std::string value;
         std::string attributeName;  // For attribute selectors
         std::string attributeValue;  // For attribute selectors
+        AttributeMatch attributeMatch = AttributeMatch::EXISTS;
         
-        // For combinators
-        std::vector<Component> subSelectors;
+        // Interned value/attribute name, cached per element atom table
+        mutable uint64_t atomTableSerial = 0;
+        mutable html::Atom atom = html::atoms::NONE;
+        mutable html::Atom attributeAtom = html::atoms::NONE;
     };
     
-    std::vector<Component> m_components;
+    // Simple selectors that must all match one element, and the combinator
+    // relating it to the compound on its left
+    struct Compound {
+        std::vector<Component> components;
+        SelectorType combinator = SelectorType::DESCENDANT;
+    };
+    
+    // Left to right, as written
+    std::vector<Compound> m_compounds;
+    std::vector<uint32_t> m_ancestorHashes;
+    bool m_dependsOnSiblings = false;
+    bool m_hasSubjectAttributeSelector = false;
+    bool m_usesSiblingRelations = false;
+    bool m_hasAncestorAttributeSelector = false;
     
     // Helper methods
-    bool parseComponent(const std::string& text, Component& component);
+    bool parseCompound(const std::string& text, size_t& pos, Compound& compound);
+    void collectAncestorHashes();
+    void collectDependencyFlags();
+    bool matchesFrom(html::Element* element, size_t index) const;
+    bool matchesComponent(const Component& component, html::Element* element) const;
+    void resolveAtoms(const Component& component, html::AtomTable* table) const;
+    
+    friend class StyleSheetCache;
 };
 
 // CSS rule (selector + declarations)
@@ -171,6 +191,7 @@ public:
     
     // Add a rule
     void addRule(const StyleRule& rule);
+    void addRule(StyleRule&& rule);
     
     // Parse a complete stylesheet
     bool parse(const std::string& cssText);
@@ -198,47 +219,29 @@ public:
     // Parse a CSS declaration block (like inline style)
     std::vector<Declaration> parseDeclarations(const std::string& css);
     
+    // Pool that large stylesheets are parsed on, split at rule boundaries;
+    // null parses on the calling thread. Defaults to WorkPool::shared().
+    void setWorkPool(threading::WorkPool* pool) { m_workPool = pool; }
+    
+    // Stylesheets smaller than this are parsed on the calling thread
+    static constexpr size_t parallelParseThreshold = 64 * 1024;
+    
 private:
-    // CSS tokenization
-    enum class TokenType {
-        IDENT,
-        STRING,
-        NUMBER,
-        PERCENTAGE,
-        DIMENSION,
-        HASH,
-        DELIM,
-        WHITESPACE,
-        COLON,
-        SEMICOLON,
-        COMMA,
-        BRACKET_OPEN,
-        BRACKET_CLOSE,
-        PAREN_OPEN,
-        PAREN_CLOSE,
-        BRACE_OPEN,
-        BRACE_CLOSE,
-        COMMENT,
-        AT_KEYWORD,
-        FUNCTION,
-        URL,
-        CDO,
-        CDC,
-        EOF_TOKEN
-    };
+    threading::WorkPool* m_workPool;
     
-    struct Token {
-        TokenType type;
-        std::string value;
-    };
+    // Parse rules from css, appending the ones to keep
+    void parseRules(std::string_view css, std::vector<StyleRule>& rules);
     
-    // Tokenization methods
-    std::vector<Token> tokenize(const std::string& css);
+    // Offsets that split css into chunks of at least minChunkSize, each
+    // starting where a rule may start; the first is 0
+    static std::vector<size_t> findChunkBoundaries(std::string_view css, size_t minChunkSize);
     
-    // Parsing helpers
-    StyleRule parseRuleFromTokens(const std::vector<Token>& tokens, size_t& pos);
-    std::vector<Selector> parseSelectorsFromTokens(const std::vector<Token>& tokens, size_t& pos);
-    std::vector<Declaration> parseDeclarationsFromTokens(const std::vector<Token>& tokens, size_t& pos);
+
+    // Parsing helpers; token is the current token, and each consumes the
+    // tokens it parses
+    StyleRule parseRule(CSSTokenizer& tokenizer, TokenView& token);
+    std::vector<Selector> parseSelectors(CSSTokenizer& tokenizer, TokenView& token);
+    std::vector<Declaration> parseDeclarationList(CSSTokenizer& tokenizer, TokenView& token);
 };
 
 } // namespace css
@@ -0,0 +1,111 @@
+#include "css_properties.h"
+#include "css_parser.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace css {
+
+namespace {
+
+struct PropertyInfo {
+    std::string name;
+    bool inherited;
+    const char* initial;    // nullptr if there is no initial value
+};
+
+// Indexed by PropertyId
+const std::vector<PropertyInfo>& propertyTable() {
+    static const std::vector<PropertyInfo> table = {
+        {"display", false, "inline"},
+        {"position", false, "static"},
+        {"float", false, nullptr},
+        {"width", false, "auto"},
+        {"height", false, "auto"},
+        {"margin-top", false, "0"},
+        {"margin-right", false, "0"},
+        {"margin-bottom", false, "0"},
+        {"margin-left", false, "0"},
+        {"padding-top", false, "0"},
+        {"padding-right", false, "0"},
+        {"padding-bottom", false, "0"},
+        {"padding-left", false, "0"},
+        {"border-top-width", false, "0"},
+        {"border-right-width", false, "0"},
+        {"border-bottom-width", false, "0"},
+        {"border-left-width", false, "0"},
+        {"border-color", false, nullptr},
+        {"color", true, "black"},
+        {"background-color", false, "transparent"},
+        {"font-family", true, "Times New Roman"},
+        {"font-size", true, "16px"},
+        {"font-weight", true, "normal"},
+        {"line-height", true, nullptr},
+        {"text-align", true, "left"},
+    };
+    return table;
+}
+
+} // namespace
+
+bool lookupPropertyId(const std::string& name, PropertyId& id) {
+    static const std::unordered_map<std::string, PropertyId> ids = [] {
+        std::unordered_map<std::string, PropertyId> map;
+        const std::vector<PropertyInfo>& table = propertyTable();
+        for (size_t i = 0; i < table.size(); ++i) {
+            map.emplace(table[i].name, static_cast<PropertyId>(i));
+        }
+        return map;
+    }();
+
+    auto it = ids.find(name);
+    if (it == ids.end()) {
+        return false;
+    }
+    id = it->second;
+    return true;
+}
+
+const std::string& propertyName(PropertyId id) {
+    return propertyTable()[static_cast<size_t>(id)].name;
+}
+
+bool isInheritedProperty(PropertyId id) {
+    return propertyTable()[static_cast<size_t>(id)].inherited;
+}
+
+bool isInheritedProperty(const std::string& name) {
+    PropertyId id;
+    if (lookupPropertyId(name, id)) {
+        return isInheritedProperty(id);
+    }
+
+    // Inherited properties without an inline slot
+    static const std::vector<std::string> others = {
+        "list-style",
+        "text-indent",
+        "text-transform",
+        "visibility",
+        "white-space",
+        "word-spacing"
+    };
+    return std::find(others.begin(), others.end(), name) != others.end();
+}
+
+const Value* initialValue(PropertyId id) {
+    // Parsed once rather than for every element
+    static const std::vector<Value> values = [] {
+        std::vector<Value> parsed;
+        for (const PropertyInfo& info : propertyTable()) {
+            parsed.push_back(info.initial ? Value(info.initial) : Value());
+        }
+        return parsed;
+    }();
+
+    size_t index = static_cast<size_t>(id);
+    return propertyTable()[index].initial ? &values[index] : nullptr;
+}
+
+} // namespace css
+} // namespace browser
@@ -0,0 +1,64 @@
+// css_properties.h
+#ifndef BROWSER_CSS_PROPERTIES_H
+#define BROWSER_CSS_PROPERTIES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace browser {
+namespace css {
+
+class Value;
+
+// Properties that ComputedStyle stores inline, indexed by id. Others are
+// kept by name in its side table.
+enum class PropertyId : uint8_t {
+    DISPLAY,
+    POSITION,
+    FLOAT,
+    WIDTH,
+    HEIGHT,
+    MARGIN_TOP,
+    MARGIN_RIGHT,
+    MARGIN_BOTTOM,
+    MARGIN_LEFT,
+    PADDING_TOP,
+    PADDING_RIGHT,
+    PADDING_BOTTOM,
+    PADDING_LEFT,
+    BORDER_TOP_WIDTH,
+    BORDER_RIGHT_WIDTH,
+    BORDER_BOTTOM_WIDTH,
+    BORDER_LEFT_WIDTH,
+    BORDER_COLOR,
+    COLOR,
+    BACKGROUND_COLOR,
+    FONT_FAMILY,
+    FONT_SIZE,
+    FONT_WEIGHT,
+    LINE_HEIGHT,
+    TEXT_ALIGN,
+    COUNT
+};
+
+constexpr size_t propertyCount = static_cast<size_t>(PropertyId::COUNT);
+
+// Id for a property name; false if it isn't stored inline
+bool lookupPropertyId(const std::string& name, PropertyId& id);
+
+// CSS name of an inline property
+const std::string& propertyName(PropertyId id);
+
+// Whether a property is inherited by default
+bool isInheritedProperty(PropertyId id);
+bool isInheritedProperty(const std::string& name);
+
+// Initial value applied by ComputedStyle::applyInitialValues, or nullptr
+// if the property is left unset
+const Value* initialValue(PropertyId id);
+
+} // namespace css
+} // namespace browser
+
+#endif // BROWSER_CSS_PROPERTIES_H
@@ -0,0 +1,163 @@
+#include "css_tokenizer.h"
+#include <charconv>
+
+namespace browser {
+namespace css {
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool isNameStart(char c) {
+    return isAlpha(c) || c == '_' || c == '-';
+}
+
+bool isNameChar(char c) {
+    return isAlpha(c) || isDigit(c) || c == '_' || c == '-';
+}
+
+} // namespace
+
+CSSTokenizer::CSSTokenizer(std::string_view input)
+    : m_input(input)
+    , m_position(0)
+    , m_done(false)
+{
+}
+
+bool CSSTokenizer::next(TokenView& token) {
+    if (m_done) {
+        return false;
+    }
+    
+    token = scan(m_position);
+    if (token.type == TokenType::EOF_TOKEN) {
+        m_done = true;
+    }
+    return true;
+}
+
+TokenView CSSTokenizer::peek() const {
+    size_t position = m_position;
+    return scan(position);
+}
+
+TokenView CSSTokenizer::scan(size_t& pos) const {
+    const std::string_view input = m_input;
+    const size_t length = input.size();
+    TokenView token;
+    
+    if (pos >= length) {
+        token.type = TokenType::EOF_TOKEN;
+        token.text = input.substr(length);
+        return token;
+    }
+    
+    size_t start = pos;
+    char c = input[pos];
+    auto finish = [&](TokenType type) {
+        token.type = type;
+        token.text = input.substr(start, pos - start);
+        return token;
+    };
+    
+    // Whitespace
+    if (isSpace(c)) {
+        while (pos < length && isSpace(input[pos])) {
+            pos++;
+        }
+        return finish(TokenType::WHITESPACE);
+    }
+    
+    // Comments; an unterminated one runs to the end of the input
+    if (c == '/' && pos + 1 < length && input[pos + 1] == '*') {
+        size_t end = input.find("*/", pos + 2);
+        pos = end == std::string_view::npos ? length : end + 2;
+        return finish(TokenType::COMMENT);
+    }
+    
+    // Identifiers
+    if (isNameStart(c)) {
+        while (pos < length && isNameChar(input[pos])) {
+            pos++;
+        }
+        return finish(TokenType::IDENT);
+    }
+    
+    // Numbers, decoded here so values need not be re-parsed
+    if (isDigit(c) || (c == '.' && pos + 1 < length && isDigit(input[pos + 1]))) {
+        while (pos < length && isDigit(input[pos])) {
+            pos++;
+        }
+        if (pos < length && input[pos] == '.') {
+            pos++;
+            while (pos < length && isDigit(input[pos])) {
+                pos++;
+            }
+        }
+        std::from_chars(input.data() + start, input.data() + pos, token.number);
+        
+        size_t unitStart = pos;
+        TokenType type = TokenType::NUMBER;
+        if (pos < length && input[pos] == '%') {
+            pos++;
+            type = TokenType::PERCENTAGE;
+        } else if (pos < length && isNameStart(input[pos])) {
+            while (pos < length && isNameChar(input[pos])) {
+                pos++;
+            }
+            type = TokenType::DIMENSION;
+        }
+        token.unit = input.substr(unitStart, pos - unitStart);
+        return finish(type);
+    }
+    
+    // Strings, with escapes skipped
+    if (c == '"' || c == '\'') {
+        pos++;
+        while (pos < length && input[pos] != c) {
+            pos += input[pos] == '\\' && pos + 1 < length ? 2 : 1;
+        }
+        if (pos < length) {
+            pos++;  // Closing quote
+        }
+        return finish(TokenType::STRING);
+    }
+    
+    // Hash
+    if (c == '#') {
+        pos++;
+        while (pos < length && isNameChar(input[pos])) {
+            pos++;
+        }
+        return finish(TokenType::HASH);
+    }
+    
+    // Single-character tokens
+    pos++;
+    switch (c) {
+        case '{': return finish(TokenType::BRACE_OPEN);
+        case '}': return finish(TokenType::BRACE_CLOSE);
+        case '(': return finish(TokenType::PAREN_OPEN);
+        case ')': return finish(TokenType::PAREN_CLOSE);
+        case '[': return finish(TokenType::BRACKET_OPEN);
+        case ']': return finish(TokenType::BRACKET_CLOSE);
+        case ':': return finish(TokenType::COLON);
+        case ';': return finish(TokenType::SEMICOLON);
+        case ',': return finish(TokenType::COMMA);
+        default: return finish(TokenType::DELIM);
+    }
+}
+
+} // namespace css
+} // namespace browser
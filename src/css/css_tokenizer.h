@@ -0,0 +1,78 @@
+#ifndef BROWSER_CSS_TOKENIZER_H
+#define BROWSER_CSS_TOKENIZER_H
+
+#include <cstddef>
+#include <string_view>
+
+namespace browser {
+namespace css {
+
+// CSS token types
+enum class TokenType {
+    IDENT,
+    STRING,
+    NUMBER,
+    PERCENTAGE,
+    DIMENSION,
+    HASH,
+    DELIM,
+    WHITESPACE,
+    COLON,
+    SEMICOLON,
+    COMMA,
+    BRACKET_OPEN,
+    BRACKET_CLOSE,
+    PAREN_OPEN,
+    PAREN_CLOSE,
+    BRACE_OPEN,
+    BRACE_CLOSE,
+    COMMENT,
+    AT_KEYWORD,
+    FUNCTION,
+    URL,
+    CDO,
+    CDC,
+    EOF_TOKEN
+};
+
+// Token whose strings are slices into the tokenizer input
+struct TokenView {
+    TokenType type = TokenType::EOF_TOKEN;
+    std::string_view text;      // The token as written, quotes and all
+    
+    // NUMBER, PERCENTAGE and DIMENSION: the decoded number, and the unit
+    // following it ("%" for percentages, empty for plain numbers)
+    double number = 0.0;
+    std::string_view unit;
+    
+    // Leading digits, e.g. "1.5" of "1.5em"
+    std::string_view numberText() const { return text.substr(0, text.size() - unit.size()); }
+};
+
+// Pull tokenizer over a complete input buffer, which must outlive it.
+// Tokens are produced one at a time without copying.
+class CSSTokenizer {
+public:
+    explicit CSSTokenizer(std::string_view input);
+    
+    // Advance to the next token; returns false once EOF has been returned
+    bool next(TokenView& token);
+    
+    // The token next() would return, without consuming it
+    TokenView peek() const;
+    
+    size_t position() const { return m_position; }
+    
+private:
+    // Token starting at position; advances position past it
+    TokenView scan(size_t& position) const;
+    
+    std::string_view m_input;
+    size_t m_position;
+    bool m_done;
+};
+
+} // namespace css
+} // namespace browser
+
+#endif // BROWSER_CSS_TOKENIZER_H
@@ -0,0 +1,403 @@
+#include "css_value.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+
+namespace browser {
+namespace css {
+
+static_assert(std::is_trivially_copyable<Value>::value, "Values are copied as plain words");
+
+namespace {
+
+// Append-only table of value texts. Ids index fixed-size chunks that never
+// move, so lookups take no lock; interning does.
+class TextTable {
+public:
+    static TextTable& instance() {
+        // Never destroyed: values in other statics may outlive any order
+        static TextTable* table = new TextTable();
+        return *table;
+    }
+    
+    uint32_t intern(std::string_view text) {
+        if (text.empty()) {
+            return 0;
+        }
+        
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_ids.find(text);
+        if (it != m_ids.end()) {
+            return it->second;
+        }
+        
+        uint32_t id = m_count;
+        size_t chunk = id >> chunkBits;
+        if (chunk >= maxChunks) {
+            return 0;  // Full; the text is dropped rather than the value
+        }
+        std::string* slots = m_chunks[chunk].load(std::memory_order_relaxed);
+        if (!slots) {
+            slots = new std::string[chunkSize];
+            m_chunks[chunk].store(slots, std::memory_order_release);
+        }
+        std::string& slot = slots[id & chunkMask];
+        slot.assign(text.data(), text.size());
+        m_ids.emplace(slot, id);
+        ++m_count;
+        return id;
+    }
+    
+    const std::string& text(uint32_t id) const {
+        return m_chunks[id >> chunkBits].load(std::memory_order_acquire)[id & chunkMask];
+    }
+    
+private:
+    static constexpr uint32_t chunkBits = 12;
+    static constexpr uint32_t chunkSize = 1u << chunkBits;
+    static constexpr uint32_t chunkMask = chunkSize - 1;
+    static constexpr size_t maxChunks = 1u << 14;
+    
+    TextTable() : m_count(1) {
+        for (auto& chunk : m_chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+        m_chunks[0].store(new std::string[chunkSize], std::memory_order_release);
+    }
+    
+    std::atomic<std::string*> m_chunks[maxChunks];
+    std::unordered_map<std::string_view, uint32_t> m_ids;
+    uint32_t m_count;
+    std::mutex m_mutex;
+};
+
+char lowerAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Lowercased copy of a short identifier; false if it is too long to be
+// any name looked up here
+bool lowerIdent(std::string_view text, char (&buffer)[16], std::string_view& lowered) {
+    if (text.size() > sizeof(buffer)) {
+        return false;
+    }
+    std::transform(text.begin(), text.end(), buffer, lowerAscii);
+    lowered = std::string_view(buffer, text.size());
+    return true;
+}
+
+Keyword lookupKeyword(std::string_view text) {
+    static const std::unordered_map<std::string_view, Keyword> keywords = {
+        {"auto", Keyword::AUTO}, {"none", Keyword::NONE}, {"normal", Keyword::NORMAL},
+        {"inherit", Keyword::INHERIT}, {"initial", Keyword::INITIAL},
+        {"transparent", Keyword::TRANSPARENT},
+        {"block", Keyword::BLOCK}, {"inline", Keyword::INLINE}, {"inline-block", Keyword::INLINE_BLOCK},
+        {"list-item", Keyword::LIST_ITEM}, {"flex", Keyword::FLEX}, {"grid", Keyword::GRID},
+        {"table", Keyword::TABLE}, {"table-row", Keyword::TABLE_ROW}, {"table-cell", Keyword::TABLE_CELL},
+        {"static", Keyword::STATIC}, {"relative", Keyword::RELATIVE}, {"absolute", Keyword::ABSOLUTE},
+        {"fixed", Keyword::FIXED}, {"sticky", Keyword::STICKY},
+        {"left", Keyword::LEFT}, {"right", Keyword::RIGHT}, {"center", Keyword::CENTER},
+        {"justify", Keyword::JUSTIFY},
+        {"bold", Keyword::BOLD}, {"bolder", Keyword::BOLDER}, {"lighter", Keyword::LIGHTER},
+        {"visible", Keyword::VISIBLE}, {"hidden", Keyword::HIDDEN},
+        {"solid", Keyword::SOLID}, {"dashed", Keyword::DASHED}, {"dotted", Keyword::DOTTED},
+    };
+    
+    char buffer[16];
+    std::string_view lowered;
+    if (!lowerIdent(text, buffer, lowered)) {
+        return Keyword::UNKNOWN;
+    }
+    auto it = keywords.find(lowered);
+    return it != keywords.end() ? it->second : Keyword::UNKNOWN;
+}
+
+bool namedColor(std::string_view text, uint32_t& rgba) {
+    static const std::unordered_map<std::string_view, uint32_t> colors = {
+        {"black", 0x000000ff},
+        {"white", 0xffffffff},
+        {"red", 0xff0000ff},
+        {"green", 0x008000ff},
+        {"blue", 0x0000ffff},
+        {"yellow", 0xffff00ff},
+        {"gray", 0x808080ff},
+        {"grey", 0x808080ff},
+        {"purple", 0x800080ff},
+        {"transparent", 0x00000000},
+        // Add more named colors as needed
+    };
+    
+    char buffer[16];
+    std::string_view lowered;
+    if (!lowerIdent(text, buffer, lowered)) {
+        return false;
+    }
+    auto it = colors.find(lowered);
+    if (it == colors.end()) {
+        return false;
+    }
+    rgba = it->second;
+    return true;
+}
+
+bool lengthUnit(std::string_view text, Unit& unit) {
+    if (text == "px") {
+        unit = Unit::PX;
+    } else if (text == "em") {
+        unit = Unit::EM;
+    } else if (text == "rem") {
+        unit = Unit::REM;
+    } else if (text == "vh") {
+        unit = Unit::VH;
+    } else if (text == "vw") {
+        unit = Unit::VW;
+    } else if (text == "%") {
+        unit = Unit::PERCENTAGE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+int hexDigit(char c) {
+    if (isDigit(c)) return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// #rgb or #rrggbb
+bool hexColor(std::string_view text, uint32_t& rgba) {
+    if (text.empty() || text[0] != '#') {
+        return false;
+    }
+    std::string_view digits = text.substr(1);
+    if ((digits.size() != 3 && digits.size() != 6) ||
+        !std::all_of(digits.begin(), digits.end(), [](char c) { return hexDigit(c) >= 0; })) {
+        return false;
+    }
+    
+    uint32_t rgb = 0;
+    for (char c : digits) {
+        int digit = hexDigit(c);
+        rgb = digits.size() == 3 ? (rgb << 8) | static_cast<uint32_t>(digit * 17) : (rgb << 4) | static_cast<uint32_t>(digit);
+    }
+    rgba = (rgb << 8) | 0xff;
+    return true;
+}
+
+// [0-9]*\.?[0-9]+ at pos
+bool scanNumber(std::string_view text, size_t& pos) {
+    size_t start = pos;
+    while (pos < text.size() && isDigit(text[pos])) ++pos;
+    bool integerDigits = pos > start;
+    if (pos < text.size() && text[pos] == '.') {
+        size_t fraction = ++pos;
+        while (pos < text.size() && isDigit(text[pos])) ++pos;
+        return pos > fraction;
+    }
+    return integerDigits;
+}
+
+double toNumber(std::string_view text) {
+    double number = 0.0;
+    std::from_chars(text.data(), text.data() + text.size(), number);
+    return number;
+}
+
+// [0-9]+, saturating at 255
+bool scanChannel(std::string_view text, size_t& pos, uint32_t& channel) {
+    size_t start = pos;
+    channel = 0;
+    while (pos < text.size() && isDigit(text[pos])) {
+        channel = std::min<uint32_t>(255, channel * 10 + static_cast<uint32_t>(text[pos] - '0'));
+        ++pos;
+    }
+    return pos > start;
+}
+
+bool isRegexSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// ",\s*" at pos
+bool scanSeparator(std::string_view text, size_t& pos) {
+    if (pos >= text.size() || text[pos] != ',') {
+        return false;
+    }
+    ++pos;
+    while (pos < text.size() && isRegexSpace(text[pos])) ++pos;
+    return true;
+}
+
+// rgb(r,g,b) or rgba(r,g,b,a); whitespace only after the commas
+bool functionalColor(std::string_view text, uint32_t& rgba) {
+    size_t pos;
+    if (text.compare(0, 4, "rgb(") == 0) {
+        pos = 4;
+    } else if (text.compare(0, 5, "rgba(") == 0) {
+        pos = 5;
+    } else {
+        return false;
+    }
+    
+    uint32_t r, g, b, a = 255;
+    if (!scanChannel(text, pos, r) || !scanSeparator(text, pos) ||
+        !scanChannel(text, pos, g) || !scanSeparator(text, pos) ||
+        !scanChannel(text, pos, b)) {
+        return false;
+    }
+    if (pos < text.size() && text[pos] == ',') {
+        scanSeparator(text, pos);
+        size_t start = pos;
+        if (!scanNumber(text, pos)) {
+            return false;
+        }
+        double alpha = std::min(1.0, toNumber(text.substr(start, pos - start)));
+        a = static_cast<uint32_t>(std::lround(alpha * 255.0));
+    }
+    if (pos + 1 != text.size() || text[pos] != ')') {
+        return false;
+    }
+    
+    rgba = (r << 24) | (g << 16) | (b << 8) | a;
+    return true;
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// Value Implementation
+//-----------------------------------------------------------------------------
+
+Value::Value()
+    : m_type(ValueType::UNKNOWN)
+    , m_unit(Unit::NONE)
+    , m_keyword(Keyword::UNKNOWN)
+    , m_text(0)
+    , m_number(0.0)
+{
+}
+
+Value::Value(const std::string& value)
+    : Value()
+{
+    parse(value);
+}
+
+const std::string& Value::stringValue() const {
+    return TextTable::instance().text(m_text);
+}
+
+void Value::setText(std::string_view text) {
+    m_text = TextTable::instance().intern(text);
+}
+
+void Value::parse(const std::string& value) {
+    // Store original value
+    setText(value);
+    m_unit = Unit::NONE;
+    m_keyword = Keyword::UNKNOWN;
+    m_number = 0.0;
+    
+    // Try to parse as different value types. A percentage counts as a
+    // LENGTH with unit PERCENTAGE.
+    if (parseLength(value)) {
+        m_type = ValueType::LENGTH;
+    } else if (parseColor(value)) {
+        m_type = ValueType::COLOR;
+        m_keyword = lookupKeyword(value);
+    } else {
+        // Default to keyword or string
+        m_type = ValueType::KEYWORD;
+        m_keyword = lookupKeyword(value);
+    }
+}
+
+bool Value::parseLength(std::string_view value) {
+    // [0-9]*\.?[0-9]+ followed by a unit
+    size_t pos = 0;
+    Unit unit;
+    if (scanNumber(value, pos) && lengthUnit(value.substr(pos), unit)) {
+        m_number = toNumber(value.substr(0, pos));
+        m_unit = unit;
+        return true;
+    }
+    
+    // Check for zero without unit
+    if (value == "0") {
+        m_number = 0.0;
+        m_unit = Unit::PX;
+        return true;
+    }
+    
+    return false;
+}
+
+bool Value::parseColor(std::string_view value) {
+    uint32_t rgba;
+    if (hexColor(value, rgba) || namedColor(value, rgba) || functionalColor(value, rgba)) {
+        m_rgba = rgba;
+        return true;
+    }
+    return false;
+}
+
+Value Value::fromToken(const TokenView& token) {
+    Value value;
+    value.setText(token.text);
+    value.m_type = ValueType::KEYWORD;
+    
+    switch (token.type) {
+        case TokenType::DIMENSION:
+        case TokenType::PERCENTAGE: {
+            // parseLength() wants [0-9]*\.?[0-9]+ and a known unit
+            Unit unit;
+            if (token.numberText().back() != '.' && lengthUnit(token.unit, unit)) {
+                value.m_type = ValueType::LENGTH;
+                value.m_number = token.number;
+                value.m_unit = unit;
+            }
+            return value;
+        }
+        case TokenType::NUMBER:
+            // Only a bare zero is a length
+            if (token.text == "0") {
+                value.m_type = ValueType::LENGTH;
+                value.m_unit = Unit::PX;
+            }
+            return value;
+        case TokenType::IDENT: {
+            uint32_t rgba;
+            value.m_keyword = lookupKeyword(token.text);
+            if (namedColor(token.text, rgba)) {
+                value.m_type = ValueType::COLOR;
+                value.m_rgba = rgba;
+            }
+            return value;
+        }
+        case TokenType::HASH: {
+            uint32_t rgba;
+            if (hexColor(token.text, rgba)) {
+                value.m_type = ValueType::COLOR;
+                value.m_rgba = rgba;
+            }
+            return value;
+        }
+        default:
+            value.parse(value.stringValue());
+            return value;
+    }
+}
+
+} // namespace css
+} // namespace browser
@@ -0,0 +1,134 @@
+// css_value.h
+#ifndef BROWSER_CSS_VALUE_H
+#define BROWSER_CSS_VALUE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "css_tokenizer.h"
+
+namespace browser {
+namespace css {
+
+// CSS value types
+enum class ValueType : uint8_t {
+    KEYWORD,
+    LENGTH,
+    PERCENTAGE,
+    COLOR,
+    STRING,
+    URL,
+    NUMBER,
+    ANGLE,
+    TIME,
+    UNKNOWN
+};
+
+// CSS units
+enum class Unit : uint8_t {
+    PX,
+    EM,
+    REM,
+    VW,
+    VH,
+    PERCENTAGE,
+    NONE  // For unitless values
+};
+
+// Identifiers that layout and paint act on, matched ASCII
+// case-insensitively; any other identifier is UNKNOWN
+enum class Keyword : uint8_t {
+    UNKNOWN,
+    AUTO,
+    NONE,
+    NORMAL,
+    INHERIT,
+    INITIAL,
+    TRANSPARENT,
+    BLOCK,
+    INLINE,
+    INLINE_BLOCK,
+    LIST_ITEM,
+    FLEX,
+    GRID,
+    TABLE,
+    TABLE_ROW,
+    TABLE_CELL,
+    STATIC,
+    RELATIVE,
+    ABSOLUTE,
+    FIXED,
+    STICKY,
+    LEFT,
+    RIGHT,
+    CENTER,
+    JUSTIFY,
+    BOLD,
+    BOLDER,
+    LIGHTER,
+    VISIBLE,
+    HIDDEN,
+    SOLID,
+    DASHED,
+    DOTTED
+};
+
+// CSS value, classified once when parsed: a keyword id, a number with its
+// unit, or a packed color, plus the source text. The text is interned in a
+// process-wide table that is never freed, so a Value is a few words,
+// trivially copyable, and reading it never parses or allocates.
+class Value {
+public:
+    Value();
+    Value(const std::string& value);
+    
+    ValueType type() const { return m_type; }
+    Unit unit() const { return m_unit; }
+    
+    // Number of a LENGTH (or bare zero), 0 otherwise
+    double numericValue() const { return m_type == ValueType::COLOR ? 0.0 : m_number; }
+    
+    // Identifier id; UNKNOWN unless the value is a single known identifier
+    Keyword keyword() const { return m_keyword; }
+    bool isKeyword(Keyword keyword) const { return m_keyword == keyword; }
+    
+    // Color as 0xRRGGBBAA; opaque black unless type() is COLOR
+    uint32_t rgba() const { return m_type == ValueType::COLOR ? m_rgba : 0x000000ff; }
+    
+    // Source text of the value; empty if nothing was set
+    const std::string& stringValue() const;
+    const std::string& toString() const { return stringValue(); }
+    
+    // Parse and set value from string
+    void parse(const std::string& value);
+    
+    // Value of a single token, decoded from the token instead of re-parsing
+    // its text; the same as Value(std::string(token.text))
+    static Value fromToken(const TokenView& token);
+    
+    // Values are derived from their text, so equal text means equal values
+    bool operator==(const Value& other) const { return m_text == other.m_text && m_type == other.m_type; }
+    bool operator!=(const Value& other) const { return !(*this == other); }
+    
+private:
+    ValueType m_type;
+    Unit m_unit;
+    Keyword m_keyword;
+    uint32_t m_text;    // Interned text id; 0 is the empty string
+    union {
+        double m_number;
+        uint32_t m_rgba;
+    };
+    
+    // Helper methods
+    void setText(std::string_view text);
+    bool parseLength(std::string_view value);
+    bool parseColor(std::string_view value);
+    
+    friend class StyleSheetCache;
+};
+
+} // namespace css
+} // namespace browser
+
+#endif // BROWSER_CSS_VALUE_H
@@ -0,0 +1,51 @@
+#include "inline_style_cache.h"
+
+namespace browser {
+namespace css {
+
+InlineStyleCache::InlineStyleCache(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+InlineStyleCache::~InlineStyleCache() {
+}
+
+const std::vector<Declaration>& InlineStyleCache::declarations(const std::string& styleText) {
+    auto it = m_index.find(styleText);
+    if (it != m_index.end()) {
+        ++m_hits;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->declarations;
+    }
+    
+    ++m_misses;
+    if (m_entries.size() >= m_capacity) {
+        m_index.erase(m_entries.back().text);
+        m_entries.pop_back();
+    }
+    
+    m_entries.push_front({styleText, m_parser.parseDeclarations(styleText)});
+    m_index.emplace(m_entries.front().text, m_entries.begin());
+    return m_entries.front().declarations;
+}
+
+double InlineStyleCache::hitRate() const {
+    size_t lookups = m_hits + m_misses;
+    return lookups ? static_cast<double>(m_hits) / lookups : 0.0;
+}
+
+void InlineStyleCache::resetCounters() {
+    m_hits = 0;
+    m_misses = 0;
+}
+
+void InlineStyleCache::clear() {
+    m_index.clear();
+    m_entries.clear();
+}
+
+} // namespace css
+} // namespace browser
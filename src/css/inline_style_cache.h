@@ -0,0 +1,59 @@
+// inline_style_cache.h
+#ifndef BROWSER_INLINE_STYLE_CACHE_H
+#define BROWSER_INLINE_STYLE_CACHE_H
+
+#include "css_parser.h"
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace css {
+
+// Parsed declarations of style attributes, keyed by the attribute text.
+// Generated markup repeats a few inline styles many times, so each distinct
+// string is parsed once; past the capacity the least recently used entry is
+// evicted. A changed attribute value is simply a different key.
+class InlineStyleCache {
+public:
+    static constexpr size_t defaultCapacity = 1024;
+    
+    explicit InlineStyleCache(size_t capacity = defaultCapacity);
+    ~InlineStyleCache();
+    
+    // Declarations for a style attribute value, parsed on a miss. The
+    // reference is valid until the next call.
+    const std::vector<Declaration>& declarations(const std::string& styleText);
+    
+    // Lookup counters since construction or resetCounters()
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    double hitRate() const;
+    void resetCounters();
+    
+    size_t size() const { return m_entries.size(); }
+    size_t capacity() const { return m_capacity; }
+    void clear();
+    
+private:
+    struct Entry {
+        std::string text;
+        std::vector<Declaration> declarations;
+    };
+    
+    // Most recently used first; the index keys view into the entries' text
+    std::list<Entry> m_entries;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> m_index;
+    size_t m_capacity;
+    size_t m_hits;
+    size_t m_misses;
+    CSSParser m_parser;
+};
+
+} // namespace css
+} // namespace browser
+
+#endif // BROWSER_INLINE_STYLE_CACHE_H
@@ -0,0 +1,152 @@
+#include "selector_query.h"
+#include "../html/dom_traversal.h"
+#include <unordered_map>
+
+namespace browser {
+namespace css {
+
+namespace {
+
+// Split a selector list on top-level commas
+std::vector<std::string> splitSelectorList(const std::string& text) {
+    std::vector<std::string> parts;
+    std::string current;
+    int depth = 0;
+    char quote = 0;
+    
+    for (char c : text) {
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '(' || c == '[') {
+            depth++;
+        } else if ((c == ')' || c == ']') && depth > 0) {
+            depth--;
+        } else if (c == ',' && depth == 0) {
+            parts.push_back(current);
+            current.clear();
+            continue;
+        }
+        current += c;
+    }
+    parts.push_back(current);
+    
+    return parts;
+}
+
+bool isDescendantOf(const html::Node* node, const html::Node* ancestor) {
+    for (const html::Node* parent = node->parentNode(); parent; parent = parent->parentNode()) {
+        if (parent == ancestor) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// SelectorQuery Implementation
+//-----------------------------------------------------------------------------
+
+SelectorQuery::SelectorQuery(const std::string& selectorText)
+    : m_valid(true)
+    , m_keyType(SelectorType::UNIVERSAL)
+{
+    for (const std::string& part : splitSelectorList(selectorText)) {
+        Selector selector;
+        if (!selector.parse(part)) {
+            m_valid = false;
+            m_selectors.clear();
+            return;
+        }
+        m_selectors.push_back(selector);
+    }
+    
+    if (m_selectors.size() == 1) {
+        m_keyType = m_selectors.front().subjectKey(m_keyValue);
+    }
+}
+
+std::shared_ptr<const SelectorQuery> SelectorQuery::compile(const std::string& selectorText) {
+    // Scripts tend to reuse a handful of selectors; bound the cache anyway
+    static thread_local std::unordered_map<std::string, std::shared_ptr<const SelectorQuery>> cache;
+    
+    auto it = cache.find(selectorText);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    
+    if (cache.size() >= 256) {
+        cache.clear();
+    }
+    
+    auto query = std::make_shared<const SelectorQuery>(selectorText);
+    cache.emplace(selectorText, query);
+    return query;
+}
+
+bool SelectorQuery::matches(html::Element* element) const {
+    for (const auto& selector : m_selectors) {
+        if (selector.matches(element)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Visit>
+void SelectorQuery::forEachMatch(const html::Node* scope, Visit visit) const {
+    if (!scope || !m_valid) {
+        return;
+    }
+    
+    // Start from the document index for the subject's id, class or tag
+    html::Document* document = scope->ownerDocument();
+    if (m_keyType != SelectorType::UNIVERSAL && document && scope->isConnected()) {
+        const std::vector<html::Element*>& candidates =
+            m_keyType == SelectorType::ID ? document->elementsWithId(m_keyValue) :
+            m_keyType == SelectorType::CLASS ? document->elementsWithClass(m_keyValue) :
+            document->elementsWithTag(m_keyValue);
+        
+        bool wholeDocument = scope == document;
+        for (html::Element* element : candidates) {
+            if ((wholeDocument || isDescendantOf(element, scope)) &&
+                m_selectors.front().matches(element) && !visit(element)) {
+                return;
+            }
+        }
+        return;
+    }
+    
+    // Otherwise test every descendant, in document order
+    for (html::Element* element : html::descendantElementsOf(scope)) {
+        if (matches(element) && !visit(element)) {
+            return;
+        }
+    }
+}
+
+html::Element* SelectorQuery::first(const html::Node* scope) const {
+    html::Element* result = nullptr;
+    forEachMatch(scope, [&result](html::Element* element) {
+        result = element;
+        return false;
+    });
+    return result;
+}
+
+std::vector<html::Element*> SelectorQuery::all(const html::Node* scope) const {
+    std::vector<html::Element*> results;
+    forEachMatch(scope, [&results](html::Element* element) {
+        results.push_back(element);
+        return true;
+    });
+    return results;
+}
+
+} // namespace css
+} // namespace browser
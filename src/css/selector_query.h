@@ -0,0 +1,50 @@
+#ifndef BROWSER_SELECTOR_QUERY_H
+#define BROWSER_SELECTOR_QUERY_H
+
+#include "css_parser.h"
+#include "../html/dom_tree.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace browser {
+namespace css {
+
+// Compiled selector list for querySelector/querySelectorAll. Compiled
+// queries are cached by selector text, so repeated calls skip parsing.
+class SelectorQuery {
+public:
+    explicit SelectorQuery(const std::string& selectorText);
+
+    // Cached compiled query for a selector string
+    static std::shared_ptr<const SelectorQuery> compile(const std::string& selectorText);
+
+    // False if any selector in the list failed to parse; matches nothing
+    bool isValid() const { return m_valid; }
+
+    // First matching descendant of scope in document order, or null
+    html::Element* first(const html::Node* scope) const;
+
+    // All matching descendants of scope in document order
+    std::vector<html::Element*> all(const html::Node* scope) const;
+
+    bool matches(html::Element* element) const;
+
+private:
+    // Visit candidate descendants of scope in document order until visit
+    // returns false
+    template <typename Visit>
+    void forEachMatch(const html::Node* scope, Visit visit) const;
+
+    std::vector<Selector> m_selectors;
+    bool m_valid;
+
+    // Index key shared by a single-selector list
+    SelectorType m_keyType;
+    std::string m_keyValue;
+};
+
+} // namespace css
+} // namespace browser
+
+#endif // BROWSER_SELECTOR_QUERY_H
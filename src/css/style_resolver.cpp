@@ -1,5 +1,10 @@
 #include "style_resolver.h"
+#include "../html/dom_traversal.h"
+#include "../threading/work_pool.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 
 namespace browser {
@@ -9,217 +14,588 @@ namespace css {
 // ComputedStyle Implementation
 //-----------------------------------------------------------------------------
 
-ComputedStyle::ComputedStyle() {
+static_assert(propertyCount <= 32, "ComputedStyle tracks set properties in a 32-bit mask");
+
+ComputedStyle::ComputedStyle()
+    : m_setMask(0)
+{
 }
 
 ComputedStyle::~ComputedStyle() {
 }
 
-Value ComputedStyle::getProperty(const std::string& property) const {
-    auto it = m_properties.find(property);
-    if (it != m_properties.end()) {
-        return it->second;
+const Value& ComputedStyle::getProperty(PropertyId property) const {
+    static const Value unset;
+    return hasProperty(property) ? m_values[static_cast<size_t>(property)] : unset;
+}
+
+const Value& ComputedStyle::getProperty(const std::string& property) const {
+    PropertyId id;
+    if (lookupPropertyId(property, id)) {
+        return getProperty(id);
     }
     
-    // Return a default value
-    return Value();
+    static const Value unset;
+    auto it = findOther(property);
+    if (it != m_otherProperties.end() && it->first == property) {
+        return it->second;
+    }
+    return unset;
+}
+
+void ComputedStyle::setProperty(PropertyId property, const Value& value) {
+    m_values[static_cast<size_t>(property)] = value;
+    m_setMask |= bit(property);
 }
 
 void ComputedStyle::setProperty(const std::string& property, const Value& value) {
-    m_properties[property] = value;
+    PropertyId id;
+    if (lookupPropertyId(property, id)) {
+        setProperty(id, value);
+        return;
+    }
+    
+    auto it = findOther(property);
+    if (it != m_otherProperties.end() && it->first == property) {
+        m_otherProperties[it - m_otherProperties.begin()].second = value;
+    } else {
+        m_otherProperties.emplace(it, property, value);
+    }
 }
 
 bool ComputedStyle::hasProperty(const std::string& property) const {
-    return m_properties.find(property) != m_properties.end();
+    PropertyId id;
+    if (lookupPropertyId(property, id)) {
+        return hasProperty(id);
+    }
+    
+    auto it = findOther(property);
+    return it != m_otherProperties.end() && it->first == property;
+}
+
+std::vector<std::pair<std::string, Value>>::const_iterator ComputedStyle::findOther(const std::string& property) const {
+    return std::lower_bound(m_otherProperties.begin(), m_otherProperties.end(), property,
+        [](const std::pair<std::string, Value>& entry, const std::string& name) {
+            return entry.first < name;
+        });
 }
 
 void ComputedStyle::inheritFrom(const ComputedStyle& parentStyle) {
     // Inherit properties from parent style if they are inheritable
-    for (const auto& prop : parentStyle.properties()) {
-        if (isInherited(prop.first) && !hasProperty(prop.first)) {
-            setProperty(prop.first, prop.second);
+    for (size_t i = 0; i < propertyCount; ++i) {
+        PropertyId id = static_cast<PropertyId>(i);
+        if (parentStyle.hasProperty(id) && isInheritedProperty(id) && !hasProperty(id)) {
+            setProperty(id, parentStyle.m_values[i]);
+        }
+    }
+    for (const auto& property : parentStyle.m_otherProperties) {
+        if (isInheritedProperty(property.first) && !hasProperty(property.first)) {
+            setProperty(property.first, property.second);
+        }
+    }
+}
+
+bool ComputedStyle::inheritedPropertiesEqual(const ComputedStyle& other) const {
+    for (size_t i = 0; i < propertyCount; ++i) {
+        PropertyId id = static_cast<PropertyId>(i);
+        if (!isInheritedProperty(id)) {
+            continue;
+        }
+        if (hasProperty(id) != other.hasProperty(id) ||
+            (hasProperty(id) && m_values[i] != other.m_values[i])) {
+            return false;
         }
     }
+    
+    // Both side tables are sorted by name, so step through their inherited
+    // entries together
+    auto nextInherited = [](const std::vector<std::pair<std::string, Value>>& properties, size_t index) {
+        while (index < properties.size() && !isInheritedProperty(properties[index].first)) {
+            ++index;
+        }
+        return index;
+    };
+    size_t mine = nextInherited(m_otherProperties, 0);
+    size_t theirs = nextInherited(other.m_otherProperties, 0);
+    while (mine < m_otherProperties.size() && theirs < other.m_otherProperties.size()) {
+        if (m_otherProperties[mine] != other.m_otherProperties[theirs]) {
+            return false;
+        }
+        mine = nextInherited(m_otherProperties, mine + 1);
+        theirs = nextInherited(other.m_otherProperties, theirs + 1);
+    }
+    return mine == m_otherProperties.size() && theirs == other.m_otherProperties.size();
 }
 
 void ComputedStyle::applyInitialValues() {
     // Set initial values for common CSS properties
     // This is a simplified list, a real browser would have many more properties
-    
-    if (!hasProperty("display")) {
-        setProperty("display", Value("inline"));
+    for (size_t i = 0; i < propertyCount; ++i) {
+        PropertyId id = static_cast<PropertyId>(i);
+        const Value* initial = initialValue(id);
+        if (initial && !hasProperty(id)) {
+            setProperty(id, *initial);
+        }
     }
-    
-    if (!hasProperty("color")) {
-        setProperty("color", Value("black"));
+}
+
+//-----------------------------------------------------------------------------
+// StyleResolver Implementation
+//-----------------------------------------------------------------------------
+
+StyleResolver::StyleResolver()
+    : m_document(nullptr)
+    , m_needsFullResolve(true)
+    , m_restyledElementCount(0)
+    , m_workPool(&threading::WorkPool::shared())
+    , m_rulesDependOnSiblings(false)
+    , m_rulesTestAttributes(false)
+    , m_sharedStyleCount(0)
+    , m_rulesUseSiblingRelations(false)
+    , m_rulesTestAncestorAttributes(false)
+    , m_styleGeneration(0)
+{
+}
+
+StyleResolver::~StyleResolver() {
+}
+
+void StyleResolver::addStyleSheet(const StyleSheet& styleSheet) {
+    m_styleSheets.push_back(styleSheet);
+    indexStyleSheet(static_cast<uint32_t>(m_styleSheets.size() - 1));
+    m_needsFullResolve = true;
+}
+
+void StyleResolver::indexStyleSheet(uint32_t sheetIndex) {
+    const std::vector<StyleRule>& rules = m_styleSheets[sheetIndex].rules();
+    std::string key;
+    
+    for (uint32_t ruleIndex = 0; ruleIndex < rules.size(); ++ruleIndex) {
+        const std::vector<Selector>& selectors = rules[ruleIndex].selectors();
+        for (uint32_t selectorIndex = 0; selectorIndex < selectors.size(); ++selectorIndex) {
+            const Selector& selector = selectors[selectorIndex];
+            if (!selector.isValid()) {
+                continue;  // Matches nothing
+            }
+            
+            m_rulesDependOnSiblings |= selector.dependsOnSiblings();
+            m_rulesTestAttributes |= selector.hasSubjectAttributeSelector();
+            m_rulesUseSiblingRelations |= selector.usesSiblingRelations();
+            m_rulesTestAncestorAttributes |= selector.hasAncestorAttributeSelector();
+            m_ancestorKeyHashes.insert(selector.ancestorHashes().begin(), selector.ancestorHashes().end());
+            
+            RuleEntry entry = {sheetIndex, ruleIndex, selectorIndex};
+            switch (selector.subjectKey(key)) {
+                case SelectorType::ID:
+                    m_idRules[key].push_back(entry);
+                    break;
+                case SelectorType::CLASS:
+                    m_classRules[key].push_back(entry);
+                    break;
+                case SelectorType::TYPE:
+                    m_tagRules[key].push_back(entry);
+                    break;
+                default:
+                    m_universalRules.push_back(entry);
+                    break;
+            }
+        }
     }
-    
-    if (!hasProperty("background-color")) {
-        setProperty("background-color", Value("transparent"));
+}
+
+void StyleResolver::resolveStyles() {
+    if (!m_document) {
+        return;
     }
     
-    if (!hasProperty("font-family")) {
-        setProperty("font-family", Value("Times New Roman"));
-    }
+    TRACE_SCOPE("css", "StyleResolver::resolveStyles");
+    ALLOC_SCOPE(CSS);
     
-    if (!hasProperty("font-size")) {
-        setProperty("font-size", Value("16px"));
-    }
+    // Clear previous styles; pending removals no longer matter
+    m_elementStyles.clear();
+    bool overflowed;
+    m_document->takeRemovedElements(overflowed);
+    m_needsFullResolve = false;
+    ++m_styleGeneration;
     
-    if (!hasProperty("font-weight")) {
-        setProperty("font-weight", Value("normal"));
+    if (!resolveStylesInParallel()) {
+        restyleTree(true);
     }
     
-    if (!hasProperty("text-align")) {
-        setProperty("text-align", Value("left"));
+    TRACE_COUNTER("css", "styledElements", static_cast<int64_t>(m_elementStyles.size()));
+    TRACE_COUNTER("css", "sharedStyles", static_cast<int64_t>(m_sharedStyleCount));
+    TRACE_COUNTER("css", "inlineStyleCacheHits", static_cast<int64_t>(m_inlineStyleCache.hits()));
+    TRACE_COUNTER("css", "inlineStyleCacheMisses", static_cast<int64_t>(m_inlineStyleCache.misses()));
+}
+
+void StyleResolver::updateStyles() {
+    if (!m_document) {
+        return;
     }
     
-    if (!hasProperty("margin-top")) {
-        setProperty("margin-top", Value("0"));
+    bool overflowed = false;
+    std::vector<html::Element*> removed = m_document->takeRemovedElements(overflowed);
+    if (m_needsFullResolve || overflowed) {
+        resolveStyles();
+        return;
     }
     
-    if (!hasProperty("margin-right")) {
-        setProperty("margin-right", Value("0"));
+    // Removals mark their parents, so a clean document means no mutations
+    if (!m_document->styleDirtyFlags()) {
+        m_restyledElementCount = 0;
+        m_sharedStyleCount = 0;
+        return;
     }
     
-    if (!hasProperty("margin-bottom")) {
-        setProperty("margin-bottom", Value("0"));
-    }
+    TRACE_SCOPE("css", "StyleResolver::updateStyles");
+    ALLOC_SCOPE(CSS);
     
-    if (!hasProperty("margin-left")) {
-        setProperty("margin-left", Value("0"));
+    // Drop removed elements' styles; any that were put back are dirty and
+    // get restyled below
+    for (html::Element* element : removed) {
+        m_elementStyles.erase(element);
     }
     
-    if (!hasProperty("padding-top")) {
-        setProperty("padding-top", Value("0"));
-    }
+    restyleTree(false);
     
-    if (!hasProperty("padding-right")) {
-        setProperty("padding-right", Value("0"));
-    }
+    TRACE_COUNTER("css", "restyledElements", static_cast<int64_t>(m_restyledElementCount));
+    TRACE_COUNTER("css", "inlineStyleCacheHits", static_cast<int64_t>(m_inlineStyleCache.hits()));
+    TRACE_COUNTER("css", "inlineStyleCacheMisses", static_cast<int64_t>(m_inlineStyleCache.misses()));
+}
+
+void StyleResolver::restyleTree(bool full) {
+    m_sharedStyleCount = 0;
+    m_restyledElementCount = 0;
     
-    if (!hasProperty("padding-bottom")) {
-        setProperty("padding-bottom", Value("0"));
+    // Resolve the root element and its descendants in document order, so
+    // each parent's style is computed before its children's
+    html::Element* root = m_document->documentElement();
+    if (root) {
+        // Create a default style for the root
+        ComputedStyle rootStyle;
+        rootStyle.applyInitialValues();
+        
+        // What an element's restyle forces on the rest of its subtree. Kept
+        // per ancestor, alongside the ancestor filter.
+        struct Reach {
+            bool descendants;       // restyle every descendant
+            bool children;          // restyle the children (inherited values changed)
+            bool laterChildren;     // restyle the remaining children's subtrees
+        };
+        std::vector<Reach> reaches;
+        const uint8_t ownChangeFlags = html::STYLE_SELF_DIRTY | html::STYLE_SUBTREE_DIRTY |
+                                       (m_rulesUseSiblingRelations ? html::STYLE_CHILDREN_CHANGED : 0);
+        
+        // Filter the rules by the ancestors of each element; leaving a
+        // subtree pops its elements again
+        m_context.ancestorFilterActive = true;
+        auto elements = html::elementsOf(root);
+        for (auto it = elements.begin(); it != elements.end();) {
+            html::Element* element = *it;
+            while (!m_context.ancestors.empty() && m_context.ancestors.back() != element->parentElement()) {
+                popAncestor(m_context);
+                reaches.pop_back();
+            }
+            
+            uint8_t flags = element->styleDirtyFlags();
+            element->clearStyleDirty();
+            
+            Reach* parentReach = reaches.empty() ? nullptr : &reaches.back();
+            bool forcedSubtree = full || (parentReach && (parentReach->descendants || parentReach->laterChildren));
+            bool ownChange = (flags & ownChangeFlags) != 0;
+            Reach reach = {forcedSubtree, false, false};
+            
+            if (forcedSubtree || ownChange || (parentReach && parentReach->children)) {
+                ComputedStylePtr oldStyle;
+                bool keyedBefore = false;
+                auto existing = m_elementStyles.find(element);
+                if (existing != m_elementStyles.end()) {
+                    oldStyle = existing->second.style;
+                    keyedBefore = existing->second.keysDescendantRules;
+                }
+                
+                const ComputedStyle& parentStyle =
+                    element == root ? rootStyle : *m_elementStyles[element->parentElement()].style;
+                ElementStyle& entry = m_elementStyles[element];
+                resolveStyleForElement(element, parentStyle, entry, m_context);
+                entry.keysDescendantRules = keysDescendantRules(element);
+                ++m_restyledElementCount;
+                
+                // New subtrees, attribute changes that descendant selectors
+                // test, and child list changes under sibling-sensitive rules
+                // can affect any descendant; other changes only reach the
+                // children through inherited values
+                if ((flags & (html::STYLE_SUBTREE_DIRTY | (ownChangeFlags & html::STYLE_CHILDREN_CHANGED))) ||
+                    ((flags & html::STYLE_SELF_DIRTY) && (keyedBefore || entry.keysDescendantRules))) {
+                    reach.descendants = true;
+                }
+                reach.children = !oldStyle || !oldStyle->inheritedPropertiesEqual(*entry.style);
+                
+                // A new style means a new box; full resolves bump the
+                // generation instead
+                if (!full && oldStyle != entry.style) {
+                    element->markLayoutDirty(html::LAYOUT_SELF_DIRTY);
+                }
+                
+                // Sibling combinators and structural pseudo-classes let the
+                // element's own changes reach its later siblings
+                if (ownChange && m_rulesUseSiblingRelations && parentReach) {
+                    parentReach->laterChildren = true;
+                }
+            }
+            
+            pushAncestor(m_context, element);
+            reaches.push_back(reach);
+            
+            // Skip subtrees nothing reaches into
+            if (reach.descendants || reach.children || (flags & html::STYLE_DESCENDANT_DIRTY)) {
+                ++it;
+            } else {
+                it.skipChildren();
+            }
+        }
+        
+        while (!m_context.ancestors.empty()) {
+            popAncestor(m_context);
+        }
+        m_context.ancestorFilterActive = false;
     }
     
-    if (!hasProperty("padding-left")) {
-        setProperty("padding-left", Value("0"));
+    m_sharedStyleCount = m_context.sharedStyleCount;
+    m_context.sharedStyleCount = 0;
+    m_document->clearStyleDirty();
+}
+
+// Elements in document order, each with its parent's index and the index
+// one past its last descendant, so that a subtree is a range
+struct StyleResolver::ParallelResolve {
+    std::vector<html::Element*> elements;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> subtreeEnds;
+    std::vector<ElementStyle*> slots;
+    std::atomic<size_t> sharedStyleCount{0};
+};
+
+bool StyleResolver::resolveStylesInParallel() {
+    html::Element* root = m_document->documentElement();
+    if (!root || !m_workPool || m_workPool->workerCount() == 0) {
+        return false;
+    }
+    
+    ParallelResolve plan;
+    std::vector<uint32_t> open;
+    html::AtomTable* table = root->atomTable();
+    for (html::Element* element : html::elementsOf(root)) {
+        uint32_t index = static_cast<uint32_t>(plan.elements.size());
+        while (!open.empty() && plan.elements[open.back()] != element->parentElement()) {
+            plan.subtreeEnds[open.back()] = index;
+            open.pop_back();
+        }
+        if (element->atomTable() != table) {
+            return false;  // Binding selector atoms to one table must suffice
+        }
+        
+        plan.elements.push_back(element);
+        plan.parents.push_back(open.empty() ? index : open.back());
+        plan.subtreeEnds.push_back(0);
+        open.push_back(index);
     }
-    
-    if (!hasProperty("border-top-width")) {
-        setProperty("border-top-width", Value("0"));
+    for (uint32_t index : open) {
+        plan.subtreeEnds[index] = static_cast<uint32_t>(plan.elements.size());
     }
-    
-    if (!hasProperty("border-right-width")) {
-        setProperty("border-right-width", Value("0"));
+    if (plan.elements.size() < parallelResolveThreshold) {
+        return false;
     }
     
-    if (!hasProperty("border-bottom-width")) {
-        setProperty("border-bottom-width", Value("0"));
-    }
+    TRACE_SCOPE("css", "StyleResolver::resolveStylesInParallel");
     
-    if (!hasProperty("border-left-width")) {
-        setProperty("border-left-width", Value("0"));
+    // Create every entry now; tasks then only look the map up and write
+    // their own elements' entries
+    m_elementStyles.reserve(plan.elements.size());
+    plan.slots.reserve(plan.elements.size());
+    for (html::Element* element : plan.elements) {
+        plan.slots.push_back(&m_elementStyles[element]);
     }
-    
-    if (!hasProperty("width")) {
-        setProperty("width", Value("auto"));
+    for (const StyleSheet& sheet : m_styleSheets) {
+        for (const StyleRule& rule : sheet.rules()) {
+            for (const Selector& selector : rule.selectors()) {
+                selector.bindAtoms(table);
+            }
+        }
     }
     
-    if (!hasProperty("height")) {
-        setProperty("height", Value("auto"));
-    }
+    ComputedStyle rootStyle;
+    rootStyle.applyInitialValues();
+    MatchContext rootContext;
+    rootContext.ancestorFilterActive = true;
+    resolveStyleForElement(root, rootStyle, *plan.slots[0], rootContext);
+    plan.slots[0]->keysDescendantRules = keysDescendantRules(root);
+    root->clearStyleDirty();
+    plan.sharedStyleCount += rootContext.sharedStyleCount;
     
-    if (!hasProperty("position")) {
-        setProperty("position", Value("static"));
+    {
+        threading::TaskGroup group(*m_workPool);
+        resolveSubtree(plan, 0, group);
+        group.wait();
     }
+    
+    m_sharedStyleCount = plan.sharedStyleCount;
+    m_restyledElementCount = plan.elements.size();
+    m_document->clearStyleDirty();
+    return true;
 }
 
-bool ComputedStyle::isInherited(const std::string& property) const {
-    // List of properties that are inherited
-    // This is a simplified list, a real browser would have many more properties
-    static const std::vector<std::string> inheritedProperties = {
-        "color",
-        "font-family",
-        "font-size",
-        "font-weight",
-        "line-height",
-        "list-style",
-        "text-align",
-        "text-indent",
-        "text-transform",
-        "visibility",
-        "white-space",
-        "word-spacing"
-    };
+void StyleResolver::resolveSubtree(ParallelResolve& plan, uint32_t root, threading::TaskGroup& group) {
+    // Resolve the descendants of a resolved element, handing large child
+    // subtrees to other tasks once their own root is resolved
+    MatchContext context;
+    context.ancestorFilterActive = true;
+    std::vector<html::Element*> chain;
+    for (html::Element* ancestor = plan.elements[root]; ancestor; ancestor = ancestor->parentElement()) {
+        chain.push_back(ancestor);
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        pushAncestor(context, *it);
+    }
+    
+    for (uint32_t index = root + 1; index < plan.subtreeEnds[root];) {
+        html::Element* element = plan.elements[index];
+        while (context.ancestors.back() != element->parentElement()) {
+            popAncestor(context);
+        }
+        
+        ElementStyle& entry = *plan.slots[index];
+        resolveStyleForElement(element, *plan.slots[plan.parents[index]]->style, entry, context);
+        entry.keysDescendantRules = keysDescendantRules(element);
+        element->clearStyleDirty();
+        
+        uint32_t end = plan.subtreeEnds[index];
+        if (end - index > minTaskElements) {
+            group.run([this, &plan, index, &group] {
+                resolveSubtree(plan, index, group);
+            });
+            index = end;
+        } else {
+            pushAncestor(context, element);
+            ++index;
+        }
+    }
     
-    return std::find(inheritedProperties.begin(), inheritedProperties.end(), property) != inheritedProperties.end();
+    plan.sharedStyleCount += context.sharedStyleCount;
 }
 
-//-----------------------------------------------------------------------------
-// StyleResolver Implementation
-//-----------------------------------------------------------------------------
+bool StyleResolver::keysDescendantRules(const html::Element* element) const {
+    if (m_rulesTestAncestorAttributes && !element->attributes().empty()) {
+        return true;
+    }
+    
+    const html::AtomTable* table = element->atomTable();
+    if (element->idAtom() != html::atoms::NONE &&
+        m_ancestorKeyHashes.count(Selector::ancestorHash(SelectorType::ID, table->name(element->idAtom())))) {
+        return true;
+    }
+    for (html::Atom classAtom : element->classAtoms()) {
+        if (m_ancestorKeyHashes.count(Selector::ancestorHash(SelectorType::CLASS, table->name(classAtom)))) {
+            return true;
+        }
+    }
+    return false;
+}
 
-StyleResolver::StyleResolver()
-    : m_document(nullptr)
-{
+const ComputedStyle& StyleResolver::getComputedStyle(html::Element* element) const {
+    return *computedStyle(element);
 }
 
-StyleResolver::~StyleResolver() {
+ComputedStylePtr StyleResolver::computedStyle(html::Element* element) const {
+    auto it = m_elementStyles.find(element);
+    if (it != m_elementStyles.end()) {
+        return it->second.style;
+    }
+    
+    // Return a default style if not found
+    static const ComputedStylePtr defaultStyle = [] {
+        auto style = std::make_shared<ComputedStyle>();
+        style->applyInitialValues();
+        return style;
+    }();
+    return defaultStyle;
 }
 
-void StyleResolver::addStyleSheet(const StyleSheet& styleSheet) {
-    m_styleSheets.push_back(styleSheet);
+ComputedStylePtr StyleResolver::findSharedStyle(html::Element* element) const {
+    if (m_rulesDependOnSiblings || element->idAtom() != html::atoms::NONE ||
+        element->hasAttribute(html::atoms::STYLE)) {
+        return nullptr;
+    }
+    
+    // Siblings precede the element in document order, so they are resolved
+    int candidates = 0;
+    for (html::Element* sibling = element->previousElementSibling();
+         sibling && candidates < maxSharingCandidates;
+         sibling = sibling->previousElementSibling(), ++candidates) {
+        if (canShareStyle(element, sibling)) {
+            auto it = m_elementStyles.find(sibling);
+            if (it != m_elementStyles.end()) {
+                return it->second.style;
+            }
+        }
+    }
+    return nullptr;
 }
 
-void StyleResolver::resolveStyles() {
-    if (!m_document) {
-        return;
+bool StyleResolver::canShareStyle(const html::Element* element, const html::Element* sibling) const {
+    if (sibling->tagAtom() != element->tagAtom() || sibling->classAtoms() != element->classAtoms() ||
+        sibling->idAtom() != html::atoms::NONE || sibling->hasAttribute(html::atoms::STYLE)) {
+        return false;
     }
     
-    // Clear previous styles
-    m_elementStyles.clear();
+    if (!m_rulesTestAttributes) {
+        return true;
+    }
     
-    // Start with the root element and apply styles recursively
-    html::Element* root = m_document->documentElement();
-    if (root) {
-        // Create a default style for the root
-        ComputedStyle rootStyle;
-        rootStyle.applyInitialValues();
-        
-        resolveStyleForElement(root, rootStyle);
+    const auto& attributes = element->attributes();
+    const auto& siblingAttributes = sibling->attributes();
+    if (attributes.size() != siblingAttributes.size()) {
+        return false;
     }
-}
-
-ComputedStyle StyleResolver::getComputedStyle(html::Element* element) const {
-    auto it = m_elementStyles.find(element);
-    if (it != m_elementStyles.end()) {
-        return it->second;
+    for (size_t i = 0; i < attributes.size(); ++i) {
+        if (attributes[i].name != siblingAttributes[i].name || attributes[i].value != siblingAttributes[i].value) {
+            return false;
+        }
     }
-    
-    // Return a default style if not found
-    ComputedStyle defaultStyle;
-    defaultStyle.applyInitialValues();
-    return defaultStyle;
+    return true;
 }
 
-void StyleResolver::resolveStyleForElement(html::Element* element, const ComputedStyle& parentStyle) {
+void StyleResolver::resolveStyleForElement(html::Element* element, const ComputedStyle& parentStyle,
+                                           ElementStyle& slot, MatchContext& context) {
     if (!element) {
         return;
     }
     
+    // Siblings matched by the same rules share one style object
+    if (ComputedStylePtr shared = findSharedStyle(element)) {
+        slot.style = std::move(shared);
+        ++context.sharedStyleCount;
+        return;
+    }
+    
     // Create a new style object for this element
     ComputedStyle style;
     
     // 1. Apply initial values
     style.applyInitialValues();
 
-    std::string tagName = element->tagName();
-    if (tagName == "div" || tagName == "p" || tagName == "h1" || tagName == "h2" || 
-        tagName == "ul" || tagName == "li" || tagName == "body" || tagName == "html") {
-        style.setProperty("display", Value("block"));
-    } else if (tagName == "span" || tagName == "a" || tagName == "strong" || tagName == "em") {
-        style.setProperty("display", Value("inline"));
+    static const Value blockDisplay("block");
+    static const Value inlineDisplay("inline");
+    switch (element->tagAtom()) {
+        case html::atoms::DIV: case html::atoms::P: case html::atoms::H1: case html::atoms::H2:
+        case html::atoms::UL: case html::atoms::LI: case html::atoms::BODY: case html::atoms::HTML:
+            style.setProperty(PropertyId::DISPLAY, blockDisplay);
+            break;
+        case html::atoms::SPAN: case html::atoms::A: case html::atoms::STRONG: case html::atoms::EM:
+            style.setProperty(PropertyId::DISPLAY, inlineDisplay);
+            break;
+        default:
+            break;
     }
     
     
@@ -227,25 +603,18 @@ void StyleResolver::resolveStyleForElement(html::Element* element, const Compute
     style.inheritFrom(parentStyle);
     
     // 3. Apply matching style rules
-    applyMatchingRules(element, style);
+    applyMatchingRules(element, style, context);
     
     // 4. Apply inline style (highest precedence)
     applyInlineStyle(element, style);
     
     // Store the computed style
-    m_elementStyles[element] = style;
-    
-    // Process children
-    for (const auto& child : element->childNodes()) {
-        if (child->nodeType() == html::NodeType::ELEMENT_NODE) {
-            resolveStyleForElement(static_cast<html::Element*>(child.get()), style);
-        }
-    }
+    slot.style = std::make_shared<const ComputedStyle>(std::move(style));
 }
 
-void StyleResolver::applyMatchingRules(html::Element* element, ComputedStyle& style) {
+void StyleResolver::applyMatchingRules(html::Element* element, ComputedStyle& style, MatchContext& context) {
     // Find all matching rules
-    std::vector<MatchedRule> matchedRules = findMatchingRules(element);
+    std::vector<MatchedRule> matchedRules = findMatchingRules(element, context);
     
     // Sort by specificity
     sortRulesBySpecificity(matchedRules);
@@ -264,32 +633,99 @@ void StyleResolver::applyMatchingRules(html::Element* element, ComputedStyle& st
 
 void StyleResolver::applyInlineStyle(html::Element* element, ComputedStyle& style) {
     // Check for the style attribute
-    if (element->hasAttribute("style")) {
-        std::string inlineStyle = element->getAttribute("style");
-        
-        // Parse the inline style
-        CSSParser parser;
-        std::vector<Declaration> declarations = parser.parseDeclarations(inlineStyle);
-        
-        // Apply declarations
-        for (const auto& declaration : declarations) {
-            style.setProperty(declaration.property(), declaration.value());
+    for (const html::Attribute& attribute : element->attributes()) {
+        if (attribute.name == html::atoms::STYLE) {
+            // Apply declarations, parsed once per distinct style text. The
+            // cache is shared by parallel resolution.
+            std::lock_guard<std::mutex> lock(m_inlineStyleMutex);
+            for (const auto& declaration : m_inlineStyleCache.declarations(attribute.value)) {
+                style.setProperty(declaration.property(), declaration.value());
+            }
+            return;
         }
     }
 }
 
-std::vector<StyleResolver::MatchedRule> StyleResolver::findMatchingRules(html::Element* element) {
-    std::vector<MatchedRule> matchedRules;
+void StyleResolver::pushAncestor(MatchContext& context, html::Element* element) {
+    const html::AtomTable* table = element->atomTable();
+    size_t count = context.ancestorHashes.size();
     
-    // Check all style sheets
-    for (const auto& styleSheet : m_styleSheets) {
-        for (const auto& rule : styleSheet.rules()) {
-            for (const auto& selector : rule.selectors()) {
-                if (selector.matches(element)) {
-                    matchedRules.push_back({&rule, &selector, selector.specificity()});
-                    break;  // One matching selector per rule is enough
-                }
-            }
+    context.ancestorHashes.push_back(Selector::ancestorHash(SelectorType::TYPE, table->name(element->tagAtom())));
+    if (element->idAtom() != html::atoms::NONE) {
+        context.ancestorHashes.push_back(Selector::ancestorHash(SelectorType::ID, table->name(element->idAtom())));
+    }
+    for (html::Atom classAtom : element->classAtoms()) {
+        context.ancestorHashes.push_back(Selector::ancestorHash(SelectorType::CLASS, table->name(classAtom)));
+    }
+    
+    for (size_t i = count; i < context.ancestorHashes.size(); ++i) {
+        context.ancestorFilter.add(context.ancestorHashes[i]);
+    }
+    context.ancestors.push_back(element);
+    context.ancestorHashCounts.push_back(count);
+}
+
+void StyleResolver::popAncestor(MatchContext& context) {
+    size_t count = context.ancestorHashCounts.back();
+    for (size_t i = count; i < context.ancestorHashes.size(); ++i) {
+        context.ancestorFilter.remove(context.ancestorHashes[i]);
+    }
+    context.ancestorHashes.resize(count);
+    context.ancestorHashCounts.pop_back();
+    context.ancestors.pop_back();
+}
+
+bool StyleResolver::mayMatchAncestors(const MatchContext& context, const Selector& selector) {
+    for (uint32_t hash : selector.ancestorHashes()) {
+        if (!context.ancestorFilter.mayContain(hash)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StyleResolver::collectCandidates(const RuleBuckets& buckets, const std::string& key, MatchContext& context) const {
+    auto it = buckets.find(key);
+    if (it != buckets.end()) {
+        context.candidates.insert(context.candidates.end(), it->second.begin(), it->second.end());
+    }
+}
+
+std::vector<StyleResolver::MatchedRule> StyleResolver::findMatchingRules(html::Element* element, MatchContext& context) {
+    std::vector<MatchedRule> matchedRules;
+    std::vector<RuleEntry>& candidates = context.candidates;
+    
+    // Gather the selectors filed under the element's id, classes and tag
+    const html::AtomTable* table = element->atomTable();
+    candidates.assign(m_universalRules.begin(), m_universalRules.end());
+    if (element->idAtom() != html::atoms::NONE) {
+        collectCandidates(m_idRules, table->name(element->idAtom()), context);
+    }
+    for (html::Atom classAtom : element->classAtoms()) {
+        collectCandidates(m_classRules, table->name(classAtom), context);
+    }
+    collectCandidates(m_tagRules, table->name(element->tagAtom()), context);
+    
+    // Test them in document order, as a scan of every rule would
+    std::sort(candidates.begin(), candidates.end());
+    const RuleEntry* matchedEntry = nullptr;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const RuleEntry& entry = candidates[i];
+        if (matchedEntry && matchedEntry->sheet == entry.sheet && matchedEntry->rule == entry.rule) {
+            continue;  // One matching selector per rule is enough
+        }
+        if (i > 0 && entry == candidates[i - 1]) {
+            continue;  // Repeated class token
+        }
+        
+        const StyleRule& rule = m_styleSheets[entry.sheet].rules()[entry.rule];
+        const Selector& selector = rule.selectors()[entry.selector];
+        if (context.ancestorFilterActive && !mayMatchAncestors(context, selector)) {
+            continue;  // A required ancestor is missing
+        }
+        if (selector.matches(element)) {
+            matchedRules.push_back({&rule, &selector, selector.specificity()});
+            matchedEntry = &entry;
         }
     }
     
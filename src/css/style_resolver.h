@@ -3,45 +3,81 @@
 #define BROWSER_STYLE_RESOLVER_H
 
 #include "css_parser.h"
+#include "css_properties.h"
+#include "bloom_filter.h"
+#include "inline_style_cache.h"
 #include "../html/dom_tree.h"
-#include <map>
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace browser {
+namespace threading {
+class WorkPool;
+class TaskGroup;
+}
+
 namespace css {
 
-// Computed style for an element
+// Computed style for an element. Properties with a PropertyId live in a
+// fixed array; any others go in a small side table sorted by name.
 class ComputedStyle {
 public:
     ComputedStyle();
     ~ComputedStyle();
     
-    // Get a property value
-    Value getProperty(const std::string& property) const;
+    // Get a property value; an empty Value if it isn't set
+    const Value& getProperty(PropertyId property) const;
+    const Value& getProperty(const std::string& property) const;
     
     // Set a property value
+    void setProperty(PropertyId property, const Value& value);
     void setProperty(const std::string& property, const Value& value);
     
     // Check if a property exists
+    bool hasProperty(PropertyId property) const { return (m_setMask & bit(property)) != 0; }
     bool hasProperty(const std::string& property) const;
     
-    // Get all properties
-    const std::map<std::string, Value>& properties() const { return m_properties; }
+    // Visit every set property as (name, value)
+    template <typename Visit>
+    void forEachProperty(Visit visit) const {
+        for (size_t i = 0; i < propertyCount; ++i) {
+            if (m_setMask & (1u << i)) {
+                visit(propertyName(static_cast<PropertyId>(i)), m_values[i]);
+            }
+        }
+        for (const auto& property : m_otherProperties) {
+            visit(property.first, property.second);
+        }
+    }
     
     // Inherit properties from parent style
     void inheritFrom(const ComputedStyle& parentStyle);
     
+    // Whether both styles hand the same values down to their children
+    bool inheritedPropertiesEqual(const ComputedStyle& other) const;
+    
     // Apply initial values for properties
     void applyInitialValues();
     
 private:
-    std::map<std::string, Value> m_properties;
+    static uint32_t bit(PropertyId property) { return 1u << static_cast<uint32_t>(property); }
     
-    // Helper methods
-    bool isInherited(const std::string& property) const;
+    std::vector<std::pair<std::string, Value>>::const_iterator findOther(const std::string& property) const;
+    
+    Value m_values[propertyCount];
+    uint32_t m_setMask;
+    std::vector<std::pair<std::string, Value>> m_otherProperties;
 };
 
+// Computed styles are immutable once resolved and shared between elements
+// (and layout boxes) that resolve to the same style
+using ComputedStylePtr = std::shared_ptr<const ComputedStyle>;
+
 // Style resolver class
 class StyleResolver {
 public:
@@ -49,8 +85,11 @@ public:
     ~StyleResolver();
     
     bool initialize() { return true; }  // Simple initialization
-    // Set the document to style
-    void setDocument(html::Document* document) { m_document = document; }
+    // Set the document to style; the next updateStyles() resolves it fully
+    void setDocument(html::Document* document) {
+        m_document = document;
+        m_needsFullResolve = true;
+    }
     
     // Add a stylesheet to the resolver
     void addStyleSheet(const StyleSheet& styleSheet);
@@ -58,19 +97,128 @@ public:
     // Resolve styles for the entire document
     void resolveStyles();
     
+    // Restyle only the elements that DOM mutations since the last resolve
+    // may have affected (see html::StyleDirtyFlag); resolves the entire
+    // document when the document or the stylesheets changed
+    void updateStyles();
+    
     // Get computed style for an element
-    ComputedStyle getComputedStyle(html::Element* element) const;
+    const ComputedStyle& getComputedStyle(html::Element* element) const;
+    
+    // Shared computed style for an element; the initial style if the
+    // element hasn't been resolved
+    ComputedStylePtr computedStyle(html::Element* element) const;
+    
+    // Elements that reused a sibling's style, and elements resolved, in the
+    // last resolveStyles() or updateStyles()
+    size_t sharedStyleCount() const { return m_sharedStyleCount; }
+    size_t restyledElementCount() const { return m_restyledElementCount; }
+    
+    // Bumped by every full resolve, after which no element's style can be
+    // assumed unchanged; incremental updates mark html::LAYOUT_SELF_DIRTY on
+    // the elements whose style they replace instead
+    uint64_t styleGeneration() const { return m_styleGeneration; }
+    
+    // Parsed style attributes, with hit and miss counts
+    const InlineStyleCache& inlineStyleCache() const { return m_inlineStyleCache; }
+    
+    // Pool that resolveStyles() fans subtrees out on; null resolves on the
+    // calling thread. Defaults to WorkPool::shared().
+    void setWorkPool(threading::WorkPool* pool) { m_workPool = pool; }
+    
+    // Documents with fewer elements are resolved on the calling thread
+    static constexpr size_t parallelResolveThreshold = 2048;
     
 private:
+    // Resolved style, and whether some rule tests the element's id, class
+    // or attributes from a descendant's point of view
+    struct ElementStyle {
+        ComputedStylePtr style;
+        bool keysDescendantRules = false;
+    };
+    
     html::Document* m_document;
     std::vector<StyleSheet> m_styleSheets;
-    std::map<html::Element*, ComputedStyle> m_elementStyles;
+    std::unordered_map<html::Element*, ElementStyle> m_elementStyles;
+    bool m_needsFullResolve;
+    size_t m_restyledElementCount;
+    
+    // Rule index entry, ordered as the rules appear in the stylesheets
+    struct RuleEntry {
+        uint32_t sheet;
+        uint32_t rule;
+        uint32_t selector;
+        
+        bool operator<(const RuleEntry& other) const {
+            if (sheet != other.sheet) return sheet < other.sheet;
+            if (rule != other.rule) return rule < other.rule;
+            return selector < other.selector;
+        }
+        bool operator==(const RuleEntry& other) const {
+            return sheet == other.sheet && rule == other.rule && selector == other.selector;
+        }
+    };
+    
+    // State of one walk over (part of) the document: the tag, id and class
+    // hashes of the current element's ancestors, scratch space and counts.
+    // Parallel resolution gives each task its own.
+    struct MatchContext {
+        CountingBloomFilter ancestorFilter;
+        bool ancestorFilterActive = false;
+        std::vector<html::Element*> ancestors;
+        std::vector<size_t> ancestorHashCounts;
+        std::vector<uint32_t> ancestorHashes;
+        
+        // Scratch list reused across elements
+        std::vector<RuleEntry> candidates;
+        
+        size_t sharedStyleCount = 0;
+    };
     
     // Helper methods
-    void resolveStyleForElement(html::Element* element, const ComputedStyle& parentStyle);
-    void applyMatchingRules(html::Element* element, ComputedStyle& style);
+    void resolveStyleForElement(html::Element* element, const ComputedStyle& parentStyle,
+                                ElementStyle& slot, MatchContext& context);
+    
+    // Walk the document, restyling every element (full) or only dirty ones
+    // and those their changes can reach
+    void restyleTree(bool full);
+    bool keysDescendantRules(const html::Element* element) const;
+    
+    // Full resolve with subtrees fanned out on the work pool. Styles of all
+    // elements are inserted up front and selector atoms bound, so matching
+    // only reads shared state; false if the document is too small.
+    struct ParallelResolve;
+    bool resolveStylesInParallel();
+    void resolveSubtree(ParallelResolve& plan, uint32_t root, threading::TaskGroup& group);
+    static constexpr uint32_t minTaskElements = 128;
+    
+    threading::WorkPool* m_workPool;
+    
+    // Style sharing: an element takes a recent sibling's style when no rule
+    // could tell them apart (same tag and classes, no id or inline style,
+    // equal attributes if any rule tests the subject's attributes)
+    ComputedStylePtr findSharedStyle(html::Element* element) const;
+    bool canShareStyle(const html::Element* element, const html::Element* sibling) const;
+    static constexpr int maxSharingCandidates = 8;
+    
+    bool m_rulesDependOnSiblings;
+    bool m_rulesTestAttributes;
+    size_t m_sharedStyleCount;
+    
+    // What the rules depend on beyond each element's own attributes, for
+    // deciding how far a mutation's restyle has to reach
+    bool m_rulesUseSiblingRelations;
+    bool m_rulesTestAncestorAttributes;
+    std::unordered_set<uint32_t> m_ancestorKeyHashes;
+    
+    uint64_t m_styleGeneration;
+    
+    void applyMatchingRules(html::Element* element, ComputedStyle& style, MatchContext& context);
     void applyInlineStyle(html::Element* element, ComputedStyle& style);
     
+    InlineStyleCache m_inlineStyleCache;
+    std::mutex m_inlineStyleMutex;
+    
     // Rule matching
     struct MatchedRule {
         const StyleRule* rule;
@@ -78,8 +226,29 @@ private:
         int specificity;
     };
     
-    std::vector<MatchedRule> findMatchingRules(html::Element* element);
+    std::vector<MatchedRule> findMatchingRules(html::Element* element, MatchContext& context);
     void sortRulesBySpecificity(std::vector<MatchedRule>& rules);
+    
+    // Rule index: each selector is filed under the id, class or tag its
+    // subject must have (see Selector::subjectKey), so an element only
+    // tests selectors that can match it. Entries sort in document order.
+    using RuleBuckets = std::unordered_map<std::string, std::vector<RuleEntry>>;
+    
+    void indexStyleSheet(uint32_t sheetIndex);
+    void collectCandidates(const RuleBuckets& buckets, const std::string& key, MatchContext& context) const;
+    
+    RuleBuckets m_idRules;
+    RuleBuckets m_classRules;
+    RuleBuckets m_tagRules;
+    std::vector<RuleEntry> m_universalRules;
+    
+    // Ancestor filter upkeep while walking the document
+    static void pushAncestor(MatchContext& context, html::Element* element);
+    static void popAncestor(MatchContext& context);
+    static bool mayMatchAncestors(const MatchContext& context, const Selector& selector);
+    
+    // Context of the serial walks
+    MatchContext m_context;
 };
 
 } // namespace css
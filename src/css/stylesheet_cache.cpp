@@ -0,0 +1,629 @@
+#include "stylesheet_cache.h"
+#include "../tracing/trace.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace browser {
+namespace css {
+
+namespace {
+
+// "BCSS" read as a little-endian word; files written on a machine of the
+// other byte order fail this check
+constexpr uint32_t fileMagic = 0x53534342;
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+            return;
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) {
+            return;
+        }
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        m_size = m_data ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                m_data = static_cast<const uint8_t*>(data);
+                m_size = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+#endif
+    }
+    
+    ~MappedFile() {
+#ifdef _WIN32
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+        if (m_data) {
+            ::munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+#endif
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
+} // namespace
+
+// Appends fixed-size words in host byte order, LEB128 integers, and
+// strings as indices into a table written ahead of the rules, since
+// property names and keywords repeat throughout a sheet
+class StyleSheetCache::Writer {
+public:
+    void byte(uint8_t value) { m_body.push_back(value); }
+    
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            m_body.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        m_body.push_back(static_cast<uint8_t>(value));
+    }
+    
+    void number(double value) {
+        uint8_t bytes[sizeof(double)];
+        std::memcpy(bytes, &value, sizeof(bytes));
+        m_body.insert(m_body.end(), bytes, bytes + sizeof(bytes));
+    }
+    
+    void string(const std::string& value) {
+        auto inserted = m_stringIndex.emplace(value, m_strings.size());
+        if (inserted.second) {
+            m_strings.push_back(&inserted.first->first);
+        }
+        varint(inserted.first->second);
+    }
+    
+    // Header, the text the sheet was parsed from, then the string table
+    // and body, which the header's checksum covers
+    std::vector<uint8_t> finish(std::string_view css, uint64_t ruleCount) {
+        std::vector<uint8_t> body;
+        body.swap(m_body);
+        varint(m_strings.size());
+        for (const std::string* value : m_strings) {
+            varint(value->size());
+            m_body.insert(m_body.end(), value->begin(), value->end());
+        }
+        varint(ruleCount);
+        m_body.insert(m_body.end(), body.begin(), body.end());
+        
+        std::vector<uint8_t> out;
+        appendWord(out, fileMagic);
+        appendWord(out, formatVersion);
+        appendWord(out, StyleSheetCache::contentHash(css));
+        appendWord(out, static_cast<uint64_t>(css.size()));
+        appendWord(out, StyleSheetCache::contentHash(
+            std::string_view(reinterpret_cast<const char*>(m_body.data()), m_body.size())));
+        out.insert(out.end(), css.begin(), css.end());
+        out.insert(out.end(), m_body.begin(), m_body.end());
+        return out;
+    }
+    
+private:
+    template <typename T>
+    static void appendWord(std::vector<uint8_t>& out, T value) {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+    
+    std::vector<uint8_t> m_body;
+    std::unordered_map<std::string, uint64_t> m_stringIndex;
+    std::vector<const std::string*> m_strings;
+};
+
+// Reads what Writer wrote, failing on anything out of bounds
+class StyleSheetCache::Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : m_pos(data), m_end(data + size) {}
+    
+    template <typename T>
+    bool word(T& value) {
+        if (static_cast<size_t>(m_end - m_pos) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+    }
+    
+    bool byte(uint8_t& value) { return word(value); }
+    bool number(double& value) { return word(value); }
+    
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (m_pos == m_end) {
+                return false;
+            }
+            uint8_t b = *m_pos++;
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // A count of items that each take at least one byte
+    bool count(size_t& value) {
+        uint64_t raw;
+        if (!varint(raw) || raw > static_cast<uint64_t>(m_end - m_pos)) {
+            return false;
+        }
+        value = static_cast<size_t>(raw);
+        return true;
+    }
+    
+    bool readStrings() {
+        size_t stringCount;
+        if (!count(stringCount)) {
+            return false;
+        }
+        m_strings.reserve(stringCount);
+        for (size_t i = 0; i < stringCount; ++i) {
+            uint64_t size;
+            if (!varint(size) || size > static_cast<uint64_t>(m_end - m_pos)) {
+                return false;
+            }
+            m_strings.emplace_back(reinterpret_cast<const char*>(m_pos), static_cast<size_t>(size));
+            m_pos += size;
+        }
+        return true;
+    }
+    
+    bool string(std::string& value) {
+        uint64_t index;
+        if (!varint(index) || index >= m_strings.size()) {
+            return false;
+        }
+        value = m_strings[static_cast<size_t>(index)];
+        return true;
+    }
+    
+    // The next size bytes, as they are
+    bool bytes(uint64_t size, std::string_view& value) {
+        if (size > static_cast<uint64_t>(m_end - m_pos)) {
+            return false;
+        }
+        value = std::string_view(reinterpret_cast<const char*>(m_pos), static_cast<size_t>(size));
+        m_pos += size;
+        return true;
+    }
+    
+    bool atEnd() const { return m_pos == m_end; }
+    
+    // What's left to read
+    std::string_view rest() const {
+        return std::string_view(reinterpret_cast<const char*>(m_pos), static_cast<size_t>(m_end - m_pos));
+    }
+    
+private:
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+    std::vector<std::string> m_strings;
+};
+
+//-----------------------------------------------------------------------------
+// StyleSheetCache Implementation
+//-----------------------------------------------------------------------------
+
+StyleSheetCache::StyleSheetCache(size_t memoryCapacity)
+    : m_capacity(memoryCapacity > 0 ? memoryCapacity : 1)
+    , m_bytes(0)
+    , m_memoryHits(0)
+    , m_diskHits(0)
+    , m_misses(0)
+{
+}
+
+StyleSheetCache::~StyleSheetCache() {
+}
+
+bool StyleSheetCache::setDirectory(const std::string& directory) {
+    if (!directory.empty()) {
+        std::error_code error;
+        fs::create_directories(directory, error);
+        if (!fs::is_directory(directory, error)) {
+            std::cerr << "Failed to create stylesheet cache directory: " << directory << std::endl;
+            return false;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directory = directory;
+    return true;
+}
+
+std::string StyleSheetCache::directory() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_directory;
+}
+
+std::shared_ptr<const StyleSheet> StyleSheetCache::get(std::string_view css) {
+    uint64_t hash = contentHash(css);
+    if (std::shared_ptr<const StyleSheet> sheet = findInMemory(hash, css)) {
+        return sheet;
+    }
+    
+    std::string path = compiledPath(hash);
+    if (!path.empty()) {
+        TRACE_SCOPE("css", "StyleSheetCache::loadCompiled");
+        if (std::shared_ptr<StyleSheet> sheet = loadCompiled(path, css)) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_diskHits;
+            }
+            storeInMemory(hash, css, sheet);
+            return sheet;
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_misses;
+    }
+    CSSParser parser;
+    std::shared_ptr<StyleSheet> sheet = parser.parseStylesheet(std::string(css));
+    if (!path.empty()) {
+        storeCompiled(path, serialize(*sheet, css));
+    }
+    storeInMemory(hash, css, sheet);
+    return sheet;
+}
+
+size_t StyleSheetCache::memoryHits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryHits;
+}
+
+size_t StyleSheetCache::diskHits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_diskHits;
+}
+
+size_t StyleSheetCache::misses() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+void StyleSheetCache::resetCounters() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_memoryHits = 0;
+    m_diskHits = 0;
+    m_misses = 0;
+}
+
+void StyleSheetCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_entries.clear();
+    m_bytes = 0;
+}
+
+size_t StyleSheetCache::bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+void StyleSheetCache::trim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (m_bytes > bytes && !m_entries.empty()) {
+        m_bytes -= m_entries.back().css.size();
+        m_index.erase(m_entries.back().hash);
+        m_entries.pop_back();
+    }
+}
+
+std::shared_ptr<const StyleSheet> StyleSheetCache::findInMemory(uint64_t hash, std::string_view css) {
+    // The hash is easy to collide on purpose, so only the same text is a hit
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(hash);
+    if (it == m_index.end() || it->second->css != css) {
+        return nullptr;
+    }
+    ++m_memoryHits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->sheet;
+}
+
+void StyleSheetCache::storeInMemory(uint64_t hash, std::string_view css, std::shared_ptr<const StyleSheet> sheet) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(hash);
+    if (it != m_index.end()) {
+        // Another thread got here first, or another sheet with the same hash
+        m_bytes = m_bytes - it->second->css.size() + css.size();
+        it->second->css.assign(css.data(), css.size());
+        it->second->sheet = std::move(sheet);
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+    
+    if (m_entries.size() >= m_capacity) {
+        m_bytes -= m_entries.back().css.size();
+        m_index.erase(m_entries.back().hash);
+        m_entries.pop_back();
+    }
+    m_entries.push_front({hash, std::string(css), std::move(sheet)});
+    m_bytes += css.size();
+    m_index.emplace(hash, m_entries.begin());
+}
+
+std::string StyleSheetCache::compiledPath(uint64_t hash) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_directory.empty()) {
+        return "";
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.cssc", static_cast<unsigned long long>(hash));
+    return m_directory + "/" + name;
+}
+
+std::shared_ptr<StyleSheet> StyleSheetCache::loadCompiled(const std::string& path, std::string_view css) const {
+    MappedFile file(path);
+    if (!file.data()) {
+        return nullptr;
+    }
+    return deserialize(file.data(), file.size(), css);
+}
+
+bool StyleSheetCache::storeCompiled(const std::string& path, const std::vector<uint8_t>& data) const {
+    // Write under a name of our own and rename, so readers never map a
+    // partly written file
+    static std::atomic<unsigned> nextTemporary{0};
+    std::string temporary = path + "." +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+        std::to_string(nextTemporary++) + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            return false;
+        }
+    }
+    
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+uint64_t StyleSheetCache::contentHash(std::string_view css) {
+    // FNV-1a; picks the entry and file, but a hit still compares the text
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : css) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::vector<uint8_t> StyleSheetCache::serialize(const StyleSheet& sheet, std::string_view css) {
+    Writer writer;
+    for (const StyleRule& rule : sheet.rules()) {
+        writer.varint(rule.selectors().size());
+        for (const Selector& selector : rule.selectors()) {
+            writeSelector(writer, selector);
+        }
+        writer.varint(rule.declarations().size());
+        for (const Declaration& declaration : rule.declarations()) {
+            writer.string(declaration.property());
+            writer.byte(declaration.important() ? 1 : 0);
+            writeValue(writer, declaration.value());
+        }
+    }
+    return writer.finish(css, sheet.rules().size());
+}
+
+std::shared_ptr<StyleSheet> StyleSheetCache::deserialize(const uint8_t* data, size_t size, std::string_view css) {
+    Reader reader(data, size);
+    uint32_t magic, version;
+    uint64_t fileHash, fileLength, checksum;
+    std::string_view fileCss;
+    if (!reader.word(magic) || magic != fileMagic || !reader.word(version) || version != formatVersion ||
+        !reader.word(fileHash) || !reader.word(fileLength) || fileLength != css.size() ||
+        !reader.word(checksum)) {
+        return nullptr;
+    }
+    
+    // A sheet crafted to share another's hash must not get its rules
+    if (!reader.bytes(fileLength, fileCss) || fileCss != css ||
+        fileHash != contentHash(css)) {
+        return nullptr;
+    }
+    
+    // A damaged file could otherwise decode as some other sheet
+    if (checksum != contentHash(reader.rest())) {
+        return nullptr;
+    }
+    if (!reader.readStrings()) {
+        return nullptr;
+    }
+    
+    auto sheet = std::make_shared<StyleSheet>();
+    size_t ruleCount;
+    if (!reader.count(ruleCount)) {
+        return nullptr;
+    }
+    for (size_t r = 0; r < ruleCount; ++r) {
+        StyleRule rule;
+        size_t selectorCount;
+        if (!reader.count(selectorCount)) {
+            return nullptr;
+        }
+        for (size_t s = 0; s < selectorCount; ++s) {
+            Selector selector;
+            if (!readSelector(reader, selector)) {
+                return nullptr;
+            }
+            rule.addSelector(selector);
+        }
+        
+        size_t declarationCount;
+        if (!reader.count(declarationCount)) {
+            return nullptr;
+        }
+        for (size_t d = 0; d < declarationCount; ++d) {
+            std::string property;
+            uint8_t important;
+            Value value;
+            if (!reader.string(property) || !reader.byte(important) || !readValue(reader, value)) {
+                return nullptr;
+            }
+            Declaration declaration(property, value);
+            declaration.setImportant(important != 0);
+            rule.addDeclaration(declaration);
+        }
+        sheet->addRule(std::move(rule));
+    }
+    
+    if (!reader.atEnd()) {
+        return nullptr;
+    }
+    return sheet;
+}
+
+void StyleSheetCache::writeValue(Writer& writer, const Value& value) {
+    writer.byte(static_cast<uint8_t>(value.m_type));
+    writer.byte(static_cast<uint8_t>(value.m_unit));
+    writer.byte(static_cast<uint8_t>(value.m_keyword));
+    if (value.m_type == ValueType::COLOR) {
+        writer.varint(value.m_rgba);
+    } else {
+        writer.number(value.m_number);
+    }
+    writer.string(value.stringValue());
+}
+
+bool StyleSheetCache::readValue(Reader& reader, Value& value) {
+    uint8_t type, unit, keyword;
+    if (!reader.byte(type) || type > static_cast<uint8_t>(ValueType::UNKNOWN) ||
+        !reader.byte(unit) || unit > static_cast<uint8_t>(Unit::NONE) ||
+        !reader.byte(keyword) || keyword > static_cast<uint8_t>(Keyword::DOTTED)) {
+        return false;
+    }
+    value.m_type = static_cast<ValueType>(type);
+    value.m_unit = static_cast<Unit>(unit);
+    value.m_keyword = static_cast<Keyword>(keyword);
+    
+    if (value.m_type == ValueType::COLOR) {
+        uint64_t rgba;
+        if (!reader.varint(rgba) || rgba > 0xffffffffu) {
+            return false;
+        }
+        value.m_rgba = static_cast<uint32_t>(rgba);
+    } else if (!reader.number(value.m_number)) {
+        return false;
+    }
+    
+    std::string text;
+    if (!reader.string(text)) {
+        return false;
+    }
+    value.setText(text);
+    return true;
+}
+
+void StyleSheetCache::writeSelector(Writer& writer, const Selector& selector) {
+    writer.varint(selector.m_compounds.size());
+    for (const Selector::Compound& compound : selector.m_compounds) {
+        writer.byte(static_cast<uint8_t>(compound.combinator));
+        writer.varint(compound.components.size());
+        for (const Selector::Component& component : compound.components) {
+            writer.byte(static_cast<uint8_t>(component.type));
+            writer.byte(static_cast<uint8_t>(component.attributeMatch));
+            writer.string(component.value);
+            writer.string(component.attributeName);
+            writer.string(component.attributeValue);
+        }
+    }
+}
+
+bool StyleSheetCache::readSelector(Reader& reader, Selector& selector) {
+    size_t compoundCount;
+    if (!reader.count(compoundCount)) {
+        return false;
+    }
+    selector.m_compounds.resize(compoundCount);
+    for (Selector::Compound& compound : selector.m_compounds) {
+        uint8_t combinator;
+        size_t componentCount;
+        if (!reader.byte(combinator) || combinator > static_cast<uint8_t>(SelectorType::GENERAL_SIBLING) ||
+            !reader.count(componentCount)) {
+            return false;
+        }
+        compound.combinator = static_cast<SelectorType>(combinator);
+        compound.components.resize(componentCount);
+        for (Selector::Component& component : compound.components) {
+            uint8_t type, match;
+            if (!reader.byte(type) || type > static_cast<uint8_t>(SelectorType::GENERAL_SIBLING) ||
+                !reader.byte(match) || match > static_cast<uint8_t>(AttributeMatch::SUBSTRING) ||
+                !reader.string(component.value) || !reader.string(component.attributeName) ||
+                !reader.string(component.attributeValue)) {
+                return false;
+            }
+            component.type = static_cast<SelectorType>(type);
+            component.attributeMatch = static_cast<AttributeMatch>(match);
+        }
+    }
+    
+    // Derived from the compounds, as parse() does
+    selector.collectAncestorHashes();
+    selector.collectDependencyFlags();
+    return true;
+}
+
+} // namespace css
+} // namespace browser
@@ -0,0 +1,104 @@
+// stylesheet_cache.h
+#ifndef BROWSER_STYLESHEET_CACHE_H
+#define BROWSER_STYLESHEET_CACHE_H
+
+#include "css_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace css {
+
+// Parsed stylesheets keyed by a hash of their text. Recently used sheets
+// stay in memory; with a directory set, each sheet is also written there in
+// a compact binary form (rules, compiled selectors and typed values) and
+// later visits map that file instead of running the parser. Safe to use
+// from several threads.
+class StyleSheetCache {
+public:
+    // Bump when the binary layout or the parser's output changes; files of
+    // other versions are ignored and rewritten
+    static constexpr uint32_t formatVersion = 4;
+    static constexpr size_t defaultMemoryCapacity = 64;
+    
+    explicit StyleSheetCache(size_t memoryCapacity = defaultMemoryCapacity);
+    ~StyleSheetCache();
+    
+    // Directory for compiled sheets, created if missing; empty keeps them
+    // in memory only. False if the directory can't be created.
+    bool setDirectory(const std::string& directory);
+    std::string directory() const;
+    
+    // Stylesheet for css: from memory, from a compiled file, or parsed and
+    // then stored in both. A memory hit doesn't copy the text.
+    std::shared_ptr<const StyleSheet> get(std::string_view css);
+    
+    // Lookup counters since construction or resetCounters()
+    size_t memoryHits() const;
+    size_t diskHits() const;
+    size_t misses() const;
+    void resetCounters();
+    
+    // Drop the sheets held in memory; compiled files are kept
+    void clear();
+    
+    // Length of the source text of the sheets held in memory, a rough
+    // measure of their size
+    size_t bytes() const;
+    
+    // Drop least recently used sheets from memory until bytes() is at most
+    // bytes
+    void trim(size_t bytes);
+    
+    // Binary form of a sheet parsed from css, which it carries;
+    // deserialize() returns null unless the data is a well-formed sheet of
+    // this format version parsed from that same text, and matches the
+    // checksum written with it
+    static uint64_t contentHash(std::string_view css);
+    static std::vector<uint8_t> serialize(const StyleSheet& sheet, std::string_view css);
+    static std::shared_ptr<StyleSheet> deserialize(const uint8_t* data, size_t size, std::string_view css);
+    
+private:
+    struct Entry {
+        uint64_t hash;
+        std::string css;
+        std::shared_ptr<const StyleSheet> sheet;
+    };
+    
+    std::shared_ptr<const StyleSheet> findInMemory(uint64_t hash, std::string_view css);
+    void storeInMemory(uint64_t hash, std::string_view css, std::shared_ptr<const StyleSheet> sheet);
+    
+    std::shared_ptr<StyleSheet> loadCompiled(const std::string& path, std::string_view css) const;
+    bool storeCompiled(const std::string& path, const std::vector<uint8_t>& data) const;
+    std::string compiledPath(uint64_t hash) const;
+    
+    class Writer;
+    class Reader;
+    static void writeValue(Writer& writer, const Value& value);
+    static bool readValue(Reader& reader, Value& value);
+    static void writeSelector(Writer& writer, const Selector& selector);
+    static bool readSelector(Reader& reader, Selector& selector);
+    
+    // Most recently used first
+    std::list<Entry> m_entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+    size_t m_capacity;
+    size_t m_bytes;
+    std::string m_directory;
+    size_t m_memoryHits;
+    size_t m_diskHits;
+    size_t m_misses;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace css
+} // namespace browser
+
+#endif // BROWSER_STYLESHEET_CACHE_H
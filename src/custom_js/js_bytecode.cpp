@@ -0,0 +1,726 @@
+#include "js_bytecode.h"
+#include "js_interpreter.h"
+#include <algorithm>
+#include <limits>
+
+namespace browser {
+namespace custom_js {
+
+namespace {
+
+const uint16_t maxRegisters = std::numeric_limits<uint16_t>::max();
+const uint32_t openEnd = std::numeric_limits<uint32_t>::max();
+
+OpCode binaryOpCode(BinaryExpr::Operator op) {
+    switch (op) {
+        case BinaryExpr::Operator::PLUS: return OpCode::ADD;
+        case BinaryExpr::Operator::MINUS: return OpCode::SUBTRACT;
+        case BinaryExpr::Operator::MULTIPLY: return OpCode::MULTIPLY;
+        case BinaryExpr::Operator::DIVIDE: return OpCode::DIVIDE;
+        case BinaryExpr::Operator::MODULO: return OpCode::MODULO;
+        case BinaryExpr::Operator::POWER: return OpCode::POWER;
+        case BinaryExpr::Operator::EQUAL: return OpCode::EQUAL;
+        case BinaryExpr::Operator::NOT_EQUAL: return OpCode::NOT_EQUAL;
+        case BinaryExpr::Operator::STRICT_EQUAL: return OpCode::STRICT_EQUAL;
+        case BinaryExpr::Operator::STRICT_NOT_EQUAL: return OpCode::STRICT_NOT_EQUAL;
+        case BinaryExpr::Operator::LESS: return OpCode::LESS;
+        case BinaryExpr::Operator::LESS_EQUAL: return OpCode::LESS_EQUAL;
+        case BinaryExpr::Operator::GREATER: return OpCode::GREATER;
+        case BinaryExpr::Operator::GREATER_EQUAL: return OpCode::GREATER_EQUAL;
+        case BinaryExpr::Operator::AND: return OpCode::AND;
+        case BinaryExpr::Operator::OR: return OpCode::OR;
+    }
+    return OpCode::ADD;
+}
+
+bool isIncrementOrDecrement(const ExpressionNode& expression) {
+    if (expression.getType() != ExpressionType::UNARY) {
+        return false;
+    }
+    UnaryExpr::Operator op = static_cast<const UnaryExpr&>(expression).op;
+    return op == UnaryExpr::Operator::INCREMENT || op == UnaryExpr::Operator::DECREMENT;
+}
+
+} // namespace
+
+BytecodeCompiler::BytecodeCompiler() : m_function(nullptr) {
+}
+
+std::shared_ptr<const FunctionProto> BytecodeCompiler::compile(const Program& program) {
+    m_localNames.clear();
+    for (const auto& statement : program.statements) {
+        collectLocalNames(*statement, true);
+    }
+
+    FunctionState state;
+    state.proto = std::make_shared<FunctionProto>();
+    state.proto->name = "<script>";
+    state.script = true;
+    m_function = &state;
+
+    for (const auto& statement : program.statements) {
+        compileStatement(*statement);
+    }
+    emit(OpCode::RETURN_UNDEFINED);
+    finishFunction(state);
+
+    m_function = nullptr;
+    return state.proto;
+}
+
+void BytecodeCompiler::collectLocalNames(const StatementNode& statement, bool topLevel) {
+    switch (statement.getType()) {
+        case StatementType::VARIABLE:
+            if (!topLevel) {
+                m_localNames.insert(static_cast<const VariableStmt&>(statement).name);
+            }
+            break;
+        case StatementType::BLOCK:
+            for (const auto& child : static_cast<const BlockStmt&>(statement).statements) {
+                collectLocalNames(*child, false);
+            }
+            break;
+        case StatementType::IF: {
+            const auto& ifStmt = static_cast<const IfStmt&>(statement);
+            collectLocalNames(*ifStmt.thenBranch, false);
+            if (ifStmt.elseBranch) {
+                collectLocalNames(*ifStmt.elseBranch, false);
+            }
+            break;
+        }
+        case StatementType::WHILE:
+            collectLocalNames(*static_cast<const WhileStmt&>(statement).body, false);
+            break;
+        case StatementType::FOR: {
+            const auto& forStmt = static_cast<const ForStmt&>(statement);
+            if (forStmt.initializer) {
+                collectLocalNames(*forStmt.initializer, false);
+            }
+            collectLocalNames(*forStmt.body, false);
+            break;
+        }
+        case StatementType::FUNCTION: {
+            const auto& function = static_cast<const FunctionStmt&>(statement);
+            if (!topLevel) {
+                m_localNames.insert(function.name);
+            }
+            m_localNames.insert(function.parameters.begin(), function.parameters.end());
+            collectLocalNames(*function.body, false);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void BytecodeCompiler::compileFunction(const FunctionStmt& function, uint16_t dst) {
+    FunctionState state;
+    state.proto = std::make_shared<FunctionProto>();
+    state.proto->name = function.name;
+    state.proto->parameterCount = static_cast<uint16_t>(
+        std::min<size_t>(function.parameters.size(), maxRegisters));
+
+    FunctionState* enclosing = m_function;
+    m_function = &state;
+
+    // Parameters and the body's own declarations share a scope
+    pushScope();
+    for (const std::string& parameter : function.parameters) {
+        declareLocal(parameter, allocateRegister());
+    }
+    for (const auto& statement : function.body->statements) {
+        compileStatement(*statement);
+    }
+    emit(OpCode::RETURN_UNDEFINED);
+    popScope();
+    finishFunction(state);
+
+    m_function = enclosing;
+    uint32_t index = static_cast<uint32_t>(m_function->proto->functions.size());
+    m_function->proto->functions.push_back(state.proto);
+    emit(OpCode::CLOSURE, dst, index);
+}
+
+void BytecodeCompiler::finishFunction(FunctionState& state) {
+    state.proto->globalSlots.assign(state.proto->names.size(), nullptr);
+}
+
+//-----------------------------------------------------------------------------
+// Statements
+//-----------------------------------------------------------------------------
+
+void BytecodeCompiler::compileStatement(const StatementNode& statement) {
+    uint16_t top = m_function->top;
+
+    switch (statement.getType()) {
+        case StatementType::EXPRESSION:
+            compileEffect(*static_cast<const ExpressionStmt&>(statement).expression);
+            break;
+
+        case StatementType::VARIABLE:
+            compileVariable(static_cast<const VariableStmt&>(statement));
+            return;
+
+        case StatementType::BLOCK:
+            pushScope();
+            for (const auto& child : static_cast<const BlockStmt&>(statement).statements) {
+                compileStatement(*child);
+            }
+            popScope();
+            break;
+
+        case StatementType::IF: {
+            const auto& ifStmt = static_cast<const IfStmt&>(statement);
+            size_t skipThen = compileJumpIfFalse(*ifStmt.condition);
+            compileStatement(*ifStmt.thenBranch);
+            if (ifStmt.elseBranch) {
+                size_t skipElse = emit(OpCode::JUMP);
+                patchJump(skipThen, currentPc());
+                compileStatement(*ifStmt.elseBranch);
+                patchJump(skipElse, currentPc());
+            } else {
+                patchJump(skipThen, currentPc());
+            }
+            break;
+        }
+
+        case StatementType::WHILE: {
+            const auto& whileStmt = static_cast<const WhileStmt&>(statement);
+            size_t start = currentPc();
+            size_t exit = compileJumpIfFalse(*whileStmt.condition);
+            compileStatement(*whileStmt.body);
+            emit(OpCode::JUMP, 0, static_cast<uint32_t>(start));
+            patchJump(exit, currentPc());
+            break;
+        }
+
+        case StatementType::FOR:
+            compileFor(static_cast<const ForStmt&>(statement));
+            break;
+
+        case StatementType::FUNCTION: {
+            const auto& function = static_cast<const FunctionStmt&>(statement);
+            if (m_function->script && m_function->scopes.empty()) {
+                uint16_t value = allocateRegister();
+                compileFunction(function, value);
+                emit(OpCode::DEFINE_GLOBAL, value, addName(function.name));
+                break;
+            }
+            // A redeclaration in the same scope overwrites the variable
+            for (const auto& name : m_function->scopes.back().names) {
+                if (name.first == function.name) {
+                    compileFunction(function, name.second);
+                    m_function->top = top;
+                    return;
+                }
+            }
+            uint16_t reg = allocateRegister();
+            compileFunction(function, reg);
+            declareLocal(function.name, reg);
+            return;
+        }
+
+        case StatementType::RETURN: {
+            const auto& returnStmt = static_cast<const ReturnStmt&>(statement);
+            if (returnStmt.value) {
+                emit(OpCode::RETURN, compileOperand(*returnStmt.value, false));
+            } else {
+                emit(OpCode::RETURN_UNDEFINED);
+            }
+            break;
+        }
+    }
+
+    m_function->top = top;
+}
+
+void BytecodeCompiler::compileVariable(const VariableStmt& statement) {
+    uint16_t top = m_function->top;
+
+    // The script's top-level declarations are globals
+    if (m_function->script && m_function->scopes.empty()) {
+        uint16_t value = allocateRegister();
+        if (statement.initializer) {
+            compileExpression(*statement.initializer, value);
+        } else {
+            emit(OpCode::LOAD_UNDEFINED, value);
+        }
+        emit(OpCode::DEFINE_GLOBAL, value, addName(statement.name));
+        m_function->top = top;
+        return;
+    }
+
+    // A redeclaration in the same scope overwrites the variable
+    uint16_t reg = 0;
+    bool redeclared = false;
+    for (const auto& name : m_function->scopes.back().names) {
+        if (name.first == statement.name) {
+            reg = name.second;
+            redeclared = true;
+            break;
+        }
+    }
+    if (!redeclared) {
+        reg = allocateRegister();
+    }
+
+    if (statement.initializer) {
+        compileExpression(*statement.initializer, reg);
+    } else {
+        emit(OpCode::LOAD_UNDEFINED, reg);
+    }
+
+    if (redeclared) {
+        m_function->top = top;
+    } else {
+        m_function->top = reg + 1;
+        declareLocal(statement.name, reg);
+    }
+}
+
+void BytecodeCompiler::compileFor(const ForStmt& statement) {
+    // The loop's own scope holds the initializer's declarations
+    pushScope();
+    if (statement.initializer) {
+        compileStatement(*statement.initializer);
+    }
+
+    size_t start = currentPc();
+    size_t exit = 0;
+    if (statement.condition) {
+        exit = compileJumpIfFalse(*statement.condition);
+    }
+    compileStatement(*statement.body);
+    if (statement.increment) {
+        compileEffect(*statement.increment);
+    }
+    emit(OpCode::JUMP, 0, static_cast<uint32_t>(start));
+    if (statement.condition) {
+        patchJump(exit, currentPc());
+    }
+    popScope();
+}
+
+size_t BytecodeCompiler::compileJumpIfFalse(const ExpressionNode& condition) {
+    uint16_t top = m_function->top;
+    size_t jump;
+    if (condition.getType() == ExpressionType::BINARY &&
+        static_cast<const BinaryExpr&>(condition).op == BinaryExpr::Operator::LESS) {
+        // Loop conditions compare and branch in one instruction
+        const auto& less = static_cast<const BinaryExpr&>(condition);
+        uint16_t left = compileOperand(*less.left, hasSideEffects(*less.right));
+        uint16_t right = compileOperand(*less.right, false);
+        jump = emit(OpCode::LESS_JUMP, left, right);
+    } else {
+        jump = emit(OpCode::JUMP_IF_FALSE, compileOperand(condition, false));
+    }
+    m_function->top = top;
+    return jump;
+}
+
+//-----------------------------------------------------------------------------
+// Expressions
+//-----------------------------------------------------------------------------
+
+void BytecodeCompiler::compileExpression(const ExpressionNode& expression, uint16_t dst) {
+    uint16_t top = m_function->top;
+
+    switch (expression.getType()) {
+        case ExpressionType::LITERAL: {
+            const auto& literal = static_cast<const LiteralExpr&>(expression);
+            switch (literal.literalType) {
+                case LiteralExpr::LiteralType::NUMBER:
+                    emit(OpCode::LOAD_CONST, dst, addConstant(JSValue(std::stod(literal.value))));
+                    break;
+                case LiteralExpr::LiteralType::STRING:
+                    emit(OpCode::LOAD_CONST, dst, addConstant(JSValue(literal.value)));
+                    break;
+                case LiteralExpr::LiteralType::BOOLEAN:
+                    emit(OpCode::LOAD_CONST, dst, addConstant(JSValue(literal.value == "true")));
+                    break;
+                case LiteralExpr::LiteralType::NULL_TYPE:
+                    emit(OpCode::LOAD_CONST, dst, addConstant(JSValue(nullptr)));
+                    break;
+                default:
+                    emit(OpCode::LOAD_UNDEFINED, dst);
+                    break;
+            }
+            break;
+        }
+
+        case ExpressionType::VARIABLE: {
+            const std::string& name = static_cast<const VariableExpr&>(expression).name;
+            uint16_t reg;
+            if (resolveLocal(name, reg)) {
+                if (reg != dst) {
+                    emit(OpCode::MOVE, dst, reg);
+                }
+            } else {
+                emitGetName(name, dst);
+            }
+            break;
+        }
+
+        case ExpressionType::UNARY:
+            compileUnary(static_cast<const UnaryExpr&>(expression), dst);
+            break;
+
+        case ExpressionType::BINARY:
+            compileBinary(static_cast<const BinaryExpr&>(expression), dst);
+            break;
+
+        case ExpressionType::CALL:
+            compileCall(static_cast<const CallExpr&>(expression), dst);
+            break;
+
+        case ExpressionType::ASSIGN:
+            compileAssign(static_cast<const AssignExpr&>(expression), dst);
+            break;
+
+        case ExpressionType::OBJECT: {
+            // Built aside when the values might read the variable in dst
+            uint16_t object = isLocalRegister(dst) ? allocateRegister() : dst;
+            emit(OpCode::NEW_OBJECT, object);
+            for (const auto& property : static_cast<const ObjectExpr&>(expression).properties) {
+                uint16_t propertyTop = m_function->top;
+                uint16_t value = compileOperand(*property.value, false);
+                emit(OpCode::SET_MEMBER_CONST, object, addPropertySite(property.key), value);
+                m_function->top = propertyTop;
+            }
+            if (object != dst) {
+                emit(OpCode::MOVE, dst, object);
+            }
+            break;
+        }
+
+        case ExpressionType::ARRAY: {
+            const auto& elements = static_cast<const ArrayExpr&>(expression).elements;
+            uint16_t first = m_function->top;
+            for (const auto& element : elements) {
+                compileExpression(*element, allocateRegister());
+            }
+            emit(OpCode::NEW_ARRAY, dst, first, static_cast<uint32_t>(elements.size()));
+            break;
+        }
+
+        case ExpressionType::MEMBER: {
+            const auto& member = static_cast<const MemberExpr&>(expression);
+            if (!member.computed) {
+                uint16_t object = compileOperand(*member.object, false);
+                if (member.property->getType() != ExpressionType::LITERAL) {
+                    emit(OpCode::THROW, 0, addConstant(JSValue("Invalid property access.")));
+                    break;
+                }
+                const std::string& key = static_cast<const LiteralExpr&>(*member.property).value;
+                emit(OpCode::GET_MEMBER_CONST, dst, object, addPropertySite(key));
+                break;
+            }
+            bool propertyEffects = hasSideEffects(*member.property);
+            uint16_t object = compileOperand(*member.object, propertyEffects);
+            if (propertyEffects) {
+                // The object is checked before the property is evaluated
+                emit(OpCode::CHECK_OBJECT, object, addConstant(JSValue("Cannot access property of non-object.")));
+            }
+            uint16_t property = compileOperand(*member.property, false);
+            emit(OpCode::GET_MEMBER, dst, object, property);
+            break;
+        }
+    }
+
+    m_function->top = top;
+}
+
+void BytecodeCompiler::compileUnary(const UnaryExpr& expression, uint16_t dst) {
+    if (expression.op == UnaryExpr::Operator::MINUS || expression.op == UnaryExpr::Operator::NOT) {
+        uint16_t operand = compileOperand(*expression.operand, false);
+        emit(expression.op == UnaryExpr::Operator::MINUS ? OpCode::NEGATE : OpCode::NOT, dst, operand);
+        return;
+    }
+
+    bool increment = expression.op == UnaryExpr::Operator::INCREMENT;
+    OpCode op = increment ? OpCode::INCREMENT : OpCode::DECREMENT;
+    if (expression.operand->getType() != ExpressionType::VARIABLE) {
+        compileOperand(*expression.operand, false);
+        emit(OpCode::THROW, 0, addConstant(JSValue(increment ? "Invalid increment target."
+                                                             : "Invalid decrement target.")));
+        return;
+    }
+
+    const std::string& name = static_cast<const VariableExpr&>(*expression.operand).name;
+    uint16_t reg;
+    if (resolveLocal(name, reg)) {
+        if (expression.isPrefix) {
+            emit(op, reg, reg);
+            if (reg != dst) {
+                emit(OpCode::MOVE, dst, reg);
+            }
+        } else {
+            uint16_t old = allocateRegister();
+            emit(OpCode::MOVE, old, reg);
+            emit(op, reg, reg);
+            emit(OpCode::MOVE, dst, old);
+        }
+        return;
+    }
+
+    uint16_t old = allocateRegister();
+    uint16_t updated = allocateRegister();
+    emitGetName(name, old);
+    emit(op, updated, old);
+    emitSetName(name, updated);
+    emit(OpCode::MOVE, dst, expression.isPrefix ? updated : old);
+}
+
+void BytecodeCompiler::compileBinary(const BinaryExpr& expression, uint16_t dst) {
+    uint16_t left = compileOperand(*expression.left, hasSideEffects(*expression.right));
+    uint16_t right = compileOperand(*expression.right, false);
+    emit(binaryOpCode(expression.op), dst, left, right);
+}
+
+void BytecodeCompiler::compileCall(const CallExpr& expression, uint16_t dst) {
+    // The callee and arguments fill consecutive registers
+    uint16_t base = allocateRegister();
+    compileExpression(*expression.callee, base);
+
+    bool argumentEffects = false;
+    for (const auto& argument : expression.arguments) {
+        argumentEffects = argumentEffects || hasSideEffects(*argument);
+    }
+    if (argumentEffects) {
+        // The callee is checked before the arguments are evaluated
+        emit(OpCode::CHECK_FUNCTION, base);
+    }
+
+    for (const auto& argument : expression.arguments) {
+        compileExpression(*argument, allocateRegister());
+    }
+    emit(OpCode::CALL, dst, base, static_cast<uint32_t>(expression.arguments.size()));
+}
+
+void BytecodeCompiler::compileAssign(const AssignExpr& expression, uint16_t dst) {
+    if (expression.target->getType() == ExpressionType::VARIABLE) {
+        const std::string& name = static_cast<const VariableExpr&>(*expression.target).name;
+        uint16_t reg;
+        if (resolveLocal(name, reg)) {
+            compileExpression(*expression.value, reg);
+            if (reg != dst) {
+                emit(OpCode::MOVE, dst, reg);
+            }
+            return;
+        }
+        uint16_t value = isLocalRegister(dst) ? allocateRegister() : dst;
+        compileExpression(*expression.value, value);
+        emitSetName(name, value);
+        if (value != dst) {
+            emit(OpCode::MOVE, dst, value);
+        }
+        return;
+    }
+
+    if (expression.target->getType() != ExpressionType::MEMBER) {
+        compileOperand(*expression.value, false);
+        emit(OpCode::THROW, 0, addConstant(JSValue("Invalid assignment target.")));
+        return;
+    }
+
+    // The value is evaluated before the object and property
+    const auto& member = static_cast<const MemberExpr&>(*expression.target);
+    bool propertyEffects = member.computed && hasSideEffects(*member.property);
+    uint16_t value = compileOperand(*expression.value, hasSideEffects(*member.object) || propertyEffects);
+    uint16_t object = compileOperand(*member.object, propertyEffects);
+    if (!member.computed) {
+        if (member.property->getType() != ExpressionType::LITERAL) {
+            emit(OpCode::THROW, 0, addConstant(JSValue("Invalid property access.")));
+            return;
+        }
+        const std::string& key = static_cast<const LiteralExpr&>(*member.property).value;
+        emit(OpCode::SET_MEMBER_CONST, object, addPropertySite(key), value);
+    } else {
+        if (propertyEffects) {
+            emit(OpCode::CHECK_OBJECT, object, addConstant(JSValue("Cannot set property on non-object.")));
+        }
+        uint16_t property = compileOperand(*member.property, false);
+        emit(OpCode::SET_MEMBER, object, property, value);
+    }
+    if (value != dst) {
+        emit(OpCode::MOVE, dst, value);
+    }
+}
+
+void BytecodeCompiler::compileEffect(const ExpressionNode& expression) {
+    uint16_t top = m_function->top;
+    uint16_t reg;
+
+    // Updates of a local needn't copy their result anywhere
+    if (expression.getType() == ExpressionType::ASSIGN) {
+        const auto& assign = static_cast<const AssignExpr&>(expression);
+        if (assign.target->getType() == ExpressionType::VARIABLE &&
+            resolveLocal(static_cast<const VariableExpr&>(*assign.target).name, reg)) {
+            compileExpression(*assign.value, reg);
+            return;
+        }
+    } else if (isIncrementOrDecrement(expression)) {
+        const auto& unary = static_cast<const UnaryExpr&>(expression);
+        if (unary.operand->getType() == ExpressionType::VARIABLE &&
+            resolveLocal(static_cast<const VariableExpr&>(*unary.operand).name, reg)) {
+            emit(unary.op == UnaryExpr::Operator::INCREMENT ? OpCode::INCREMENT : OpCode::DECREMENT, reg, reg);
+            return;
+        }
+    }
+
+    compileExpression(expression, allocateRegister());
+    m_function->top = top;
+}
+
+uint16_t BytecodeCompiler::compileOperand(const ExpressionNode& expression, bool laterSideEffects) {
+    uint16_t reg;
+    if (expression.getType() == ExpressionType::VARIABLE && !laterSideEffects &&
+        resolveLocal(static_cast<const VariableExpr&>(expression).name, reg)) {
+        return reg;
+    }
+    reg = allocateRegister();
+    compileExpression(expression, reg);
+    return reg;
+}
+
+//-----------------------------------------------------------------------------
+// Names and registers
+//-----------------------------------------------------------------------------
+
+bool BytecodeCompiler::resolveLocal(const std::string& name, uint16_t& reg) const {
+    for (auto scope = m_function->scopes.rbegin(); scope != m_function->scopes.rend(); ++scope) {
+        for (auto local = scope->names.rbegin(); local != scope->names.rend(); ++local) {
+            if (local->first == name) {
+                reg = local->second;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool BytecodeCompiler::isLocalRegister(uint16_t reg) const {
+    for (const Scope& scope : m_function->scopes) {
+        for (const auto& local : scope.names) {
+            if (local.second == reg) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void BytecodeCompiler::emitGetName(const std::string& name, uint16_t dst) {
+    // Scopes are dynamic: a function sees its callers' variables
+    bool dynamic = !m_function->script && m_localNames.count(name) > 0;
+    emit(dynamic ? OpCode::GET_NAME : OpCode::GET_GLOBAL, dst, addName(name));
+}
+
+void BytecodeCompiler::emitSetName(const std::string& name, uint16_t src) {
+    bool dynamic = !m_function->script && m_localNames.count(name) > 0;
+    emit(dynamic ? OpCode::SET_NAME : OpCode::SET_GLOBAL, src, addName(name));
+}
+
+void BytecodeCompiler::declareLocal(const std::string& name, uint16_t reg) {
+    m_function->scopes.back().names.emplace_back(name, reg);
+    m_function->proto->locals.push_back(
+        FunctionProto::Local{addName(name), reg, static_cast<uint32_t>(currentPc()), openEnd});
+}
+
+void BytecodeCompiler::pushScope() {
+    m_function->scopes.push_back(Scope{{}, m_function->proto->locals.size(), m_function->top});
+}
+
+void BytecodeCompiler::popScope() {
+    Scope& scope = m_function->scopes.back();
+    std::vector<FunctionProto::Local>& locals = m_function->proto->locals;
+    for (size_t i = scope.firstLocal; i < locals.size(); ++i) {
+        if (locals[i].endPc == openEnd) {
+            locals[i].endPc = static_cast<uint32_t>(currentPc());
+        }
+    }
+    m_function->top = scope.firstRegister;
+    m_function->scopes.pop_back();
+}
+
+uint16_t BytecodeCompiler::allocateRegister() {
+    if (m_function->top == maxRegisters) {
+        throw RuntimeError("Too many registers in function '" + m_function->proto->name + "'.");
+    }
+    uint16_t reg = m_function->top++;
+    m_function->proto->registerCount = std::max(m_function->proto->registerCount, m_function->top);
+    return reg;
+}
+
+uint32_t BytecodeCompiler::addConstant(const JSValue& value) {
+    m_function->proto->constants.push_back(value);
+    return static_cast<uint32_t>(m_function->proto->constants.size() - 1);
+}
+
+uint32_t BytecodeCompiler::addName(const std::string& name) {
+    auto found = m_function->nameIndex.find(name);
+    if (found != m_function->nameIndex.end()) {
+        return found->second;
+    }
+    uint32_t index = static_cast<uint32_t>(m_function->proto->names.size());
+    m_function->proto->names.push_back(name);
+    m_function->nameIndex.emplace(name, index);
+    return index;
+}
+
+uint32_t BytecodeCompiler::addPropertySite(const std::string& key) {
+    m_function->proto->propertySites.push_back(FunctionProto::PropertySite{addName(key), PropertyCache()});
+    return static_cast<uint32_t>(m_function->proto->propertySites.size() - 1);
+}
+
+size_t BytecodeCompiler::emit(OpCode op, uint32_t a, uint32_t b, uint32_t c) {
+    m_function->proto->code.push_back(Instruction{op, static_cast<uint16_t>(a), b, c});
+    return m_function->proto->code.size() - 1;
+}
+
+void BytecodeCompiler::patchJump(size_t instruction, size_t target) {
+    Instruction& jump = m_function->proto->code[instruction];
+    if (jump.op == OpCode::LESS_JUMP) {
+        jump.c = static_cast<uint32_t>(target);
+    } else {
+        jump.b = static_cast<uint32_t>(target);
+    }
+}
+
+size_t BytecodeCompiler::currentPc() const {
+    return m_function->proto->code.size();
+}
+
+bool BytecodeCompiler::hasSideEffects(const ExpressionNode& expression) {
+    switch (expression.getType()) {
+        case ExpressionType::CALL:
+        case ExpressionType::ASSIGN:
+            return true;
+        case ExpressionType::UNARY:
+            return isIncrementOrDecrement(expression) ||
+                   hasSideEffects(*static_cast<const UnaryExpr&>(expression).operand);
+        case ExpressionType::BINARY: {
+            const auto& binary = static_cast<const BinaryExpr&>(expression);
+            return hasSideEffects(*binary.left) || hasSideEffects(*binary.right);
+        }
+        case ExpressionType::OBJECT:
+            for (const auto& property : static_cast<const ObjectExpr&>(expression).properties) {
+                if (hasSideEffects(*property.value)) return true;
+            }
+            return false;
+        case ExpressionType::ARRAY:
+            for (const auto& element : static_cast<const ArrayExpr&>(expression).elements) {
+                if (hasSideEffects(*element)) return true;
+            }
+            return false;
+        case ExpressionType::MEMBER: {
+            const auto& member = static_cast<const MemberExpr&>(expression);
+            return hasSideEffects(*member.object) || hasSideEffects(*member.property);
+        }
+        default:
+            return false;
+    }
+}
+
+} // namespace custom_js
+} // namespace browser
@@ -0,0 +1,193 @@
+// js_bytecode.h - Compiles the JavaScript AST to register bytecode
+#ifndef CUSTOM_JS_BYTECODE_H
+#define CUSTOM_JS_BYTECODE_H
+
+#include "js_parser.h"
+#include "js_value.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace browser {
+namespace custom_js {
+
+// Opcodes; a, b and c name an instruction's operands. r(x) is register x
+// of the running function, k(x) its constant x, n(x) its name x and p(x)
+// the name of its property site x.
+#define JS_OPCODES(X)                                                          \
+    X(LOAD_CONST)       /* r(a) = k(b) */                                      \
+    X(LOAD_UNDEFINED)   /* r(a) = undefined */                                 \
+    X(MOVE)             /* r(a) = r(b) */                                      \
+    X(GET_GLOBAL)       /* r(a) = global n(b) */                               \
+    X(SET_GLOBAL)       /* global n(b) = r(a), which must exist */             \
+    X(DEFINE_GLOBAL)    /* define global n(b) = r(a) */                        \
+    X(GET_NAME)         /* r(a) = n(b) looked up through the calling frames */ \
+    X(SET_NAME)         /* n(b) = r(a) through the calling frames */           \
+    X(ADD)              /* r(a) = r(b) op r(c) */                              \
+    X(SUBTRACT)                                                                \
+    X(MULTIPLY)                                                                \
+    X(DIVIDE)                                                                  \
+    X(MODULO)                                                                  \
+    X(POWER)                                                                   \
+    X(EQUAL)                                                                   \
+    X(NOT_EQUAL)                                                               \
+    X(STRICT_EQUAL)                                                            \
+    X(STRICT_NOT_EQUAL)                                                        \
+    X(LESS)                                                                    \
+    X(LESS_EQUAL)                                                              \
+    X(GREATER)                                                                 \
+    X(GREATER_EQUAL)                                                           \
+    X(AND)                                                                     \
+    X(OR)                                                                      \
+    X(NEGATE)           /* r(a) = op r(b) */                                   \
+    X(NOT)                                                                     \
+    X(INCREMENT)                                                               \
+    X(DECREMENT)                                                               \
+    X(JUMP)             /* to instruction b */                                 \
+    X(JUMP_IF_FALSE)    /* to instruction b unless r(a) is truthy */           \
+    X(LESS_JUMP)        /* to instruction c unless r(a) < r(b) */              \
+    X(CHECK_FUNCTION)   /* throw unless r(a) is a function */                  \
+    X(CHECK_OBJECT)     /* throw k(b) unless r(a) is an object */              \
+    X(CALL)             /* r(a) = r(b)(r(b + 1) ... r(b + c)) */               \
+    X(GET_MEMBER)       /* r(a) = r(b)[r(c)] */                                \
+    X(GET_MEMBER_CONST) /* r(a) = r(b)[p(c)] */                                \
+    X(SET_MEMBER)       /* r(a)[r(b)] = r(c) */                                \
+    X(SET_MEMBER_CONST) /* r(a)[p(b)] = r(c) */                                \
+    X(NEW_OBJECT)       /* r(a) = {} */                                        \
+    X(NEW_ARRAY)        /* r(a) = [r(b) ... r(b + c - 1)] */                   \
+    X(CLOSURE)          /* r(a) = function of nested prototype b */            \
+    X(RETURN)           /* return r(a) */                                      \
+    X(RETURN_UNDEFINED)                                                        \
+    X(THROW)            /* throw a RuntimeError with message k(b) */
+
+enum class OpCode : uint8_t {
+#define JS_OPCODE_ENUM(name) name,
+    JS_OPCODES(JS_OPCODE_ENUM)
+#undef JS_OPCODE_ENUM
+};
+
+struct Instruction {
+    OpCode op;
+    uint16_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+// A compiled function, or a script's top level. Variables declared inside
+// it live in registers; other names are globals or, in functions, resolved
+// through the calling frames' variables as the tree-walking interpreter's
+// environments would.
+struct FunctionProto {
+    // A variable's register and the instructions it's visible to
+    struct Local {
+        uint32_t name;      // In names
+        uint16_t reg;
+        uint32_t startPc;
+        uint32_t endPc;
+    };
+
+    // An obj.prop in the source, with its inline cache
+    struct PropertySite {
+        uint32_t name;      // In names
+        PropertyCache cache;
+    };
+
+    std::string name;
+    std::vector<Instruction> code;
+    std::vector<JSValue> constants;
+    std::vector<std::string> names;         // Variables and property keys
+    std::vector<Local> locals;
+    std::vector<std::shared_ptr<const FunctionProto>> functions;
+    uint16_t parameterCount = 0;
+    uint16_t registerCount = 0;
+
+    // Global variable slots by name index, filled in as they're first found
+    mutable std::vector<JSValue*> globalSlots;
+
+    mutable std::vector<PropertySite> propertySites;
+};
+
+// Compiles a parsed program to bytecode. Throws RuntimeError if a function
+// needs more registers than an instruction can address.
+class BytecodeCompiler {
+public:
+    BytecodeCompiler();
+
+    std::shared_ptr<const FunctionProto> compile(const Program& program);
+
+private:
+    struct Scope {
+        std::vector<std::pair<std::string, uint16_t>> names;  // Name, register
+        size_t firstLocal;       // In proto->locals
+        uint16_t firstRegister;
+    };
+
+    struct FunctionState {
+        std::shared_ptr<FunctionProto> proto;
+        std::vector<Scope> scopes;
+        std::unordered_map<std::string, uint32_t> nameIndex;
+        uint16_t top = 0;        // First free register
+        bool script = false;
+    };
+
+    // Names declared anywhere but a script's top level
+    void collectLocalNames(const StatementNode& statement, bool topLevel);
+
+    void compileFunction(const FunctionStmt& function, uint16_t dst);
+    void finishFunction(FunctionState& state);
+
+    void compileStatement(const StatementNode& statement);
+    void compileVariable(const VariableStmt& statement);
+    void compileFor(const ForStmt& statement);
+
+    // Jump past what follows unless condition is truthy; returns the jump
+    // to patch
+    size_t compileJumpIfFalse(const ExpressionNode& condition);
+
+    // Compile expression into dst; dst is only written by the last
+    // instruction, so it may be a variable the expression reads
+    void compileExpression(const ExpressionNode& expression, uint16_t dst);
+    void compileUnary(const UnaryExpr& expression, uint16_t dst);
+    void compileBinary(const BinaryExpr& expression, uint16_t dst);
+    void compileCall(const CallExpr& expression, uint16_t dst);
+    void compileAssign(const AssignExpr& expression, uint16_t dst);
+
+    // Compile an expression only for its effects
+    void compileEffect(const ExpressionNode& expression);
+
+    // A register holding the expression's value: a variable's own register
+    // when it can't change before it's used, or a new temporary
+    uint16_t compileOperand(const ExpressionNode& expression, bool laterSideEffects);
+
+    // Name lookups
+    bool resolveLocal(const std::string& name, uint16_t& reg) const;
+    bool isLocalRegister(uint16_t reg) const;
+    void emitGetName(const std::string& name, uint16_t dst);
+    void emitSetName(const std::string& name, uint16_t src);
+    void declareLocal(const std::string& name, uint16_t reg);
+
+    void pushScope();
+    void popScope();
+
+    uint16_t allocateRegister();
+    uint32_t addConstant(const JSValue& value);
+    uint32_t addName(const std::string& name);
+    uint32_t addPropertySite(const std::string& key);
+    size_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+    void patchJump(size_t instruction, size_t target);
+    size_t currentPc() const;
+
+    static bool hasSideEffects(const ExpressionNode& expression);
+
+    FunctionState* m_function;
+    std::unordered_set<std::string> m_localNames;
+};
+
+} // namespace custom_js
+} // namespace browser
+
+#endif // CUSTOM_JS_BYTECODE_H
@@ -1,7 +1,11 @@
 // js_engine.cpp - Fixed implementation
 #include "js_engine.h"
 #include "js_value.h"  // Include the actual JSValue definitions
+#include "js_heap.h"
 #include "js_interpreter.h"
+#include "js_vm.h"
+#include "script_cache.h"
+#include "../tracing/alloc_tracker.h"
 #include <iostream>
 #include <sstream>
 #include <limits>   // For std::numeric_limits
@@ -11,15 +15,21 @@ namespace browser {
 namespace custom_js {
 
 // JSEngine Implementation
-JSEngine::JSEngine() : m_interpreter(nullptr) {
+JSEngine::JSEngine() : m_interpreter(nullptr), m_executionMode(ExecutionMode::INTERPRETER) {
 }
 
 JSEngine::~JSEngine() {
+    // Free the cycles left among the scripts' objects
+    m_globalObject.reset();
+    m_vm.reset();
+    m_interpreter.reset();
+    JSHeap::current().collect();
 }
 
 bool JSEngine::initialize() {
     // Initialize the interpreter
     m_interpreter = std::make_unique<JSInterpreter>();
+    m_vm = std::make_unique<JSVirtualMachine>(m_interpreter->global());
     
     // Create global object
     m_globalObject = std::make_shared<JSObject>();
@@ -31,15 +41,30 @@ bool JSEngine::initialize() {
 }
 
 bool JSEngine::executeScript(const std::string& script, std::string& result, std::string& error) {
+    ALLOC_SCOPE(JS);
     if (!m_interpreter) {
         error = "JavaScript engine not initialized";
         return false;
     }
     
     try {
-        // Execute the script using the interpreter
-        JSValue resultValue = m_interpreter->execute(script);
+        // Parse, or reuse the program parsed from the same source. The
+        // interpreter parses each function when it's first called; the VM
+        // compiles them all anyway.
+        std::shared_ptr<Program> program;
+        if (m_scriptCache) {
+            program = m_scriptCache->get(script);
+        } else {
+            JSParser parser;
+            parser.setLazyFunctions(m_executionMode == ExecutionMode::INTERPRETER);
+            program = parser.parse(script);
+        }
+        
+        // Execute the script using the interpreter or the VM
+        JSValue resultValue = m_executionMode == ExecutionMode::BYTECODE ? m_vm->execute(*program)
+                                                                         : m_interpreter->execute(program);
         result = resultValue.toString();
+        JSHeap::current().collectIfNeeded();
         return true;
     } catch (const std::exception& e) {
         error = e.what();
@@ -47,6 +72,10 @@ bool JSEngine::executeScript(const std::string& script, std::string& result, std
     }
 }
 
+size_t JSEngine::collectGarbage() {
+    return JSHeap::current().collect();
+}
+
 void JSEngine::defineGlobalVariable(const std::string& name, const JSValue& value) {
     if (m_globalObject) {
         m_globalObject->set(name, value);
@@ -6,6 +6,7 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include <utility>
 #include "js_value.h"  // Include the actual JSValue definitions
 
 namespace browser {
@@ -13,6 +14,14 @@ namespace custom_js {
 
 // Forward declaration
 class JSInterpreter;
+class JSVirtualMachine;
+class ScriptCache;
+
+// How scripts run. Both share the global environment.
+enum class ExecutionMode {
+    INTERPRETER,  // Walk the syntax tree
+    BYTECODE      // Compile to bytecode for the register VM
+};
 
 // JavaScript Engine
 class JSEngine {
@@ -26,6 +35,18 @@ public:
     // Execute JavaScript code
     bool executeScript(const std::string& script, std::string& result, std::string& error);
     
+    // Choose how later scripts run
+    void setExecutionMode(ExecutionMode mode) { m_executionMode = mode; }
+    ExecutionMode executionMode() const { return m_executionMode; }
+    
+    // Share parsed programs through cache, so scripts seen before aren't
+    // parsed again; null parses every script
+    void setScriptCache(std::shared_ptr<ScriptCache> cache) { m_scriptCache = std::move(cache); }
+    
+    // Free objects no script can reach any more, even ones that refer to
+    // each other; returns how many. Also happens as scripts allocate.
+    size_t collectGarbage();
+    
     // Define global variables
     void defineGlobalVariable(const std::string& name, const JSValue& value);
     
@@ -34,7 +55,10 @@ public:
     
 private:
     std::unique_ptr<JSInterpreter> m_interpreter;
+    std::unique_ptr<JSVirtualMachine> m_vm;
+    ExecutionMode m_executionMode;
     std::shared_ptr<JSObject> m_globalObject;
+    std::shared_ptr<ScriptCache> m_scriptCache;
     
     // Add built-in functions
     void addBuiltinFunctions();
@@ -0,0 +1,180 @@
+#include "js_heap.h"
+#include "js_value.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace browser {
+namespace custom_js {
+
+namespace {
+
+// Calls a function with each reference an object shows
+template <typename Function>
+class VisitorFunction : public JSObject::ReferenceVisitor {
+public:
+    explicit VisitorFunction(Function function) : m_function(function) {}
+
+    void visit(JSObject* object) override { m_function(object); }
+
+private:
+    Function m_function;
+};
+
+template <typename Function>
+VisitorFunction<Function> makeVisitor(Function function) {
+    return VisitorFunction<Function>(function);
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// JSHeap Implementation
+//-----------------------------------------------------------------------------
+
+JSHeap& JSHeap::current() {
+    static thread_local JSHeap heap;
+    return heap;
+}
+
+JSHeap::JSHeap()
+    : m_first(nullptr)
+    , m_count(0)
+    , m_allocated(0)
+    , m_threshold(minimumThreshold)
+    , m_collecting(false)
+{
+}
+
+JSHeap::~JSHeap() {
+    // Objects that outlive the thread's heap stop being tracked
+    for (JSObject* object = m_first; object; object = object->m_heapNext) {
+        object->m_heap = nullptr;
+    }
+}
+
+const std::shared_ptr<Shape>& JSHeap::emptyShape() {
+    if (!m_emptyShape) {
+        m_emptyShape = std::make_shared<Shape>();
+    }
+    return m_emptyShape;
+}
+
+size_t JSHeap::collect() {
+    if (m_collecting) {
+        return 0;
+    }
+    TRACE_SCOPE("js", "JSHeap::collect");
+    auto start = std::chrono::steady_clock::now();
+    m_collecting = true;
+
+    std::vector<JSObject*> objects;
+    objects.reserve(m_count);
+    for (JSObject* object = m_first; object; object = object->m_heapNext) {
+        objects.push_back(object);
+    }
+
+    // Count every reference to each object: values, and shared_ptrs but
+    // its own m_self. One not owned through a shared_ptr at all lives on
+    // the stack or inside something else, and is always kept.
+    for (JSObject* object : objects) {
+        long owners = object->weak_from_this().use_count();
+        if (owners == 0) {
+            object->m_gcRefs = std::numeric_limits<long>::max() / 2;
+        } else {
+            object->m_gcRefs = static_cast<long>(object->m_valueRefs) + owners - (object->m_self ? 1 : 0);
+        }
+        object->m_gcMarked = false;
+    }
+
+    // What's left after references between objects is held from outside:
+    // the roots
+    auto subtractor = makeVisitor([this](JSObject* object) {
+        if (object->m_heap == this) {
+            --object->m_gcRefs;
+        }
+    });
+    for (JSObject* object : objects) {
+        object->visitReferences(subtractor);
+    }
+
+    std::vector<JSObject*> stack;
+    auto marker = makeVisitor([this, &stack](JSObject* object) {
+        if (object->m_heap == this && !object->m_gcMarked) {
+            object->m_gcMarked = true;
+            stack.push_back(object);
+        }
+    });
+    for (JSObject* object : objects) {
+        if (object->m_gcRefs > 0 && !object->m_gcMarked) {
+            object->m_gcMarked = true;
+            stack.push_back(object);
+        }
+    }
+    while (!stack.empty()) {
+        JSObject* object = stack.back();
+        stack.pop_back();
+        object->visitReferences(marker);
+    }
+
+    // Hold the unreachable objects while their references are dropped, so
+    // none is freed halfway through another's clearing
+    std::vector<std::shared_ptr<JSObject>> garbage;
+    for (JSObject* object : objects) {
+        if (!object->m_gcMarked) {
+            garbage.push_back(object->shared_from_this());
+        }
+    }
+    objects.clear();
+    for (const std::shared_ptr<JSObject>& object : garbage) {
+        object->clearReferences();
+    }
+    size_t freed = garbage.size();
+    garbage.clear();
+
+    m_allocated = 0;
+    m_threshold = std::max(minimumThreshold, m_count);
+    m_collecting = false;
+
+    ++m_stats.collections;
+    m_stats.freed += freed;
+    m_stats.lastMilliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_stats.longestMilliseconds = std::max(m_stats.longestMilliseconds, m_stats.lastMilliseconds);
+    return freed;
+}
+
+size_t JSHeap::collectIfNeeded() {
+    return m_allocated >= m_threshold ? collect() : 0;
+}
+
+void JSHeap::track(JSObject* object) {
+    object->m_heap = this;
+    object->m_heapPrevious = nullptr;
+    object->m_heapNext = m_first;
+    if (m_first) {
+        m_first->m_heapPrevious = object;
+    }
+    m_first = object;
+    ++m_count;
+    ++m_allocated;
+}
+
+void JSHeap::untrack(JSObject* object) {
+    if (object->m_heapPrevious) {
+        object->m_heapPrevious->m_heapNext = object->m_heapNext;
+    } else {
+        m_first = object->m_heapNext;
+    }
+    if (object->m_heapNext) {
+        object->m_heapNext->m_heapPrevious = object->m_heapPrevious;
+    }
+    object->m_heap = nullptr;
+    --m_count;
+}
+
+} // namespace custom_js
+} // namespace browser
@@ -0,0 +1,76 @@
+// js_heap.h - Tracks JavaScript objects and frees unreachable cycles
+#ifndef CUSTOM_JS_HEAP_H
+#define CUSTOM_JS_HEAP_H
+
+#include <cstddef>
+#include <memory>
+
+namespace browser {
+namespace custom_js {
+
+class JSObject;
+class Shape;
+
+// Every JSObject made on a thread is tracked by that thread's heap.
+// Objects are still freed by reference counting the moment nothing refers
+// to them; the heap's collector finds the groups that only refer to each
+// other, which counting never frees, and breaks them up.
+//
+// Roots aren't enumerated. References the collector can't see, from
+// environments, VM registers, native code or any shared_ptr, show up as
+// counts that references between objects don't account for, and the
+// objects they reach are kept.
+class JSHeap {
+public:
+    struct Stats {
+        size_t collections = 0;
+        size_t freed = 0;           // Objects, over all collections
+        double lastMilliseconds = 0;
+        double longestMilliseconds = 0;
+    };
+
+    // The current thread's heap
+    static JSHeap& current();
+
+    JSHeap();
+    ~JSHeap();
+
+    JSHeap(const JSHeap&) = delete;
+    JSHeap& operator=(const JSHeap&) = delete;
+
+    // Free every unreachable object; returns how many
+    size_t collect();
+
+    // Collect once as many objects have been made since the last
+    // collection as survived it, so collecting costs amortized constant
+    // time per object
+    size_t collectIfNeeded();
+
+    // The root of the thread's shape tree: the shape of objects with no
+    // properties
+    const std::shared_ptr<Shape>& emptyShape();
+
+    size_t objectCount() const { return m_count; }
+    const Stats& stats() const { return m_stats; }
+
+    static constexpr size_t minimumThreshold = 10000;
+
+private:
+    friend class JSObject;
+
+    void track(JSObject* object);
+    void untrack(JSObject* object);
+
+    JSObject* m_first;
+    size_t m_count;
+    size_t m_allocated;     // Since the last collection
+    size_t m_threshold;
+    bool m_collecting;
+    Stats m_stats;
+    std::shared_ptr<Shape> m_emptyShape;
+};
+
+} // namespace custom_js
+} // namespace browser
+
+#endif // CUSTOM_JS_HEAP_H
@@ -1,4 +1,5 @@
 #include "js_interpreter.h"
+#include "js_resolver.h"
 #include <iostream>
 #include <sstream>
 #include <cmath>
@@ -10,10 +11,15 @@ namespace custom_js {
 // Environment Implementation
 //-----------------------------------------------------------------------------
 
-Environment::Environment() : m_enclosing(nullptr) {
+Environment::Environment() : m_scope(nullptr), m_defined(0), m_enclosing(nullptr) {
 }
 
-Environment::Environment(std::shared_ptr<Environment> enclosing) : m_enclosing(enclosing) {
+Environment::Environment(std::shared_ptr<Environment> enclosing)
+    : m_scope(nullptr), m_defined(0), m_enclosing(enclosing) {
+}
+
+Environment::Environment(std::shared_ptr<Environment> enclosing, const ScopeLayout& scope)
+    : m_slots(scope.names.size()), m_scope(&scope), m_defined(0), m_enclosing(enclosing) {
 }
 
 void Environment::define(const std::string& name, const JSValue& value) {
@@ -21,13 +27,8 @@ void Environment::define(const std::string& name, const JSValue& value) {
 }
 
 JSValue Environment::get(const std::string& name) {
-    auto it = m_values.find(name);
-    if (it != m_values.end()) {
-        return it->second;
-    }
-    
-    if (m_enclosing) {
-        return m_enclosing->get(name);
+    if (JSValue* value = lookup(name)) {
+        return *value;
     }
     
     std::stringstream ss;
@@ -36,14 +37,8 @@ JSValue Environment::get(const std::string& name) {
 }
 
 void Environment::assign(const std::string& name, const JSValue& value) {
-    auto it = m_values.find(name);
-    if (it != m_values.end()) {
-        it->second = value;
-        return;
-    }
-    
-    if (m_enclosing) {
-        m_enclosing->assign(name, value);
+    if (JSValue* variable = lookup(name)) {
+        *variable = value;
         return;
     }
     
@@ -53,17 +48,42 @@ void Environment::assign(const std::string& name, const JSValue& value) {
 }
 
 bool Environment::exists(const std::string& name) const {
-    if (m_values.find(name) != m_values.end()) {
-        return true;
-    }
-    
-    if (m_enclosing) {
-        return m_enclosing->exists(name);
+    for (const Environment* environment = this; environment; environment = environment->m_enclosing.get()) {
+        if (environment->slotOf(name) >= 0 || environment->m_values.count(name) > 0) {
+            return true;
+        }
     }
-    
     return false;
 }
 
+JSValue* Environment::find(const std::string& name) {
+    int slot = slotOf(name);
+    if (slot >= 0) {
+        return &m_slots[slot];
+    }
+    auto it = m_values.find(name);
+    return it != m_values.end() ? &it->second : nullptr;
+}
+
+JSValue* Environment::lookup(const std::string& name) {
+    for (Environment* environment = this; environment; environment = environment->m_enclosing.get()) {
+        if (JSValue* value = environment->find(name)) {
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+int Environment::slotOf(const std::string& name) const {
+    // Only what's been declared so far, the latest first
+    for (size_t i = m_defined; i > 0; --i) {
+        if (m_scope->names[i - 1] == name) {
+            return static_cast<int>(i - 1);
+        }
+    }
+    return -1;
+}
+
 //-----------------------------------------------------------------------------
 // JSInterpreter Implementation
 //-----------------------------------------------------------------------------
@@ -105,6 +125,9 @@ JSInterpreter::JSInterpreter() : m_hasReturnValue(false) {
 JSValue JSInterpreter::execute(std::shared_ptr<Program> program) {
     if (!program) return JSValue();
     
+    // Point variable references at their slots
+    JSResolver().resolve(*program);
+    
     try {
         for (const auto& statement : program->statements) {
             execute(statement);
@@ -164,23 +187,36 @@ JSValue JSInterpreter::visitExpressionNode(std::shared_ptr<ExpressionNode> node)
 }
 
 JSValue JSInterpreter::visitLiteralExpr(std::shared_ptr<LiteralExpr> expr) {
+    if (expr->evaluated) {
+        return expr->constant;
+    }
+    
     switch (expr->literalType) {
         case LiteralExpr::LiteralType::NUMBER:
-            return JSValue(std::stod(expr->value));
+            expr->constant = JSValue(std::stod(expr->value));
+            break;
         case LiteralExpr::LiteralType::STRING:
-            return JSValue(expr->value);
+            expr->constant = JSValue(expr->value);
+            break;
         case LiteralExpr::LiteralType::BOOLEAN:
-            return JSValue(expr->value == "true");
+            expr->constant = JSValue(expr->value == "true");
+            break;
         case LiteralExpr::LiteralType::NULL_TYPE:
-            return JSValue(nullptr);
+            expr->constant = JSValue(nullptr);
+            break;
         case LiteralExpr::LiteralType::UNDEFINED:
-            return JSValue(); // undefined
         default:
-            return JSValue(); // undefined
+            expr->constant = JSValue(); // undefined
+            break;
     }
+    expr->evaluated = true;
+    return expr->constant;
 }
 
 JSValue JSInterpreter::visitVariableExpr(std::shared_ptr<VariableExpr> expr) {
+    if (expr->slot >= 0) {
+        return m_environment->slot(expr->depth, expr->slot);
+    }
     return lookUpVariable(expr->name);
 }
 
@@ -201,7 +237,7 @@ JSValue JSInterpreter::visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) {
                 double value = operand.toNumber();
                 JSValue newValue(value + 1.0);
                 
-                m_environment->assign(varExpr->name, newValue);
+                assignVariable(*varExpr, newValue);
                 
                 return expr->isPrefix ? newValue : operand;
             }
@@ -214,7 +250,7 @@ JSValue JSInterpreter::visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) {
                 double value = operand.toNumber();
                 JSValue newValue(value - 1.0);
                 
-                m_environment->assign(varExpr->name, newValue);
+                assignVariable(*varExpr, newValue);
                 
                 return expr->isPrefix ? newValue : operand;
             }
@@ -303,11 +339,16 @@ JSValue JSInterpreter::visitAssignExpr(std::shared_ptr<AssignExpr> expr) {
     
     if (expr->target->getType() == ExpressionType::VARIABLE) {
         auto varExpr = std::dynamic_pointer_cast<VariableExpr>(expr->target);
-        m_environment->assign(varExpr->name, value);
+        assignVariable(*varExpr, value);
     } else if (expr->target->getType() == ExpressionType::MEMBER) {
         auto memberExpr = std::dynamic_pointer_cast<MemberExpr>(expr->target);
         JSValue object = evaluate(memberExpr->object);
         
+        if (JSArray* array = object.asArray()) {
+            setArrayMember(*array, *memberExpr, value);
+            return value;
+        }
+        
         if (!object.isObject()) {
             throw error("Cannot set property on non-object.");
         }
@@ -327,7 +368,7 @@ JSValue JSInterpreter::visitAssignExpr(std::shared_ptr<AssignExpr> expr) {
             if (!propExpr) {
                 throw error("Invalid property access.");
             }
-            obj->set(propExpr->value, value);
+            obj->set(propExpr->value, value, memberExpr->cache);
         }
     } else {
         throw error("Invalid assignment target.");
@@ -339,9 +380,9 @@ JSValue JSInterpreter::visitAssignExpr(std::shared_ptr<AssignExpr> expr) {
 JSValue JSInterpreter::visitObjectExpr(std::shared_ptr<ObjectExpr> expr) {
     auto object = std::make_shared<JSObject>();
     
-    for (const auto& prop : expr->properties) {
+    for (auto& prop : expr->properties) {
         JSValue value = evaluate(prop.value);
-        object->set(prop.key, value);
+        object->set(prop.key, value, prop.cache);
     }
     
     return JSValue(object);
@@ -359,6 +400,10 @@ JSValue JSInterpreter::visitArrayExpr(std::shared_ptr<ArrayExpr> expr) {
 JSValue JSInterpreter::visitMemberExpr(std::shared_ptr<MemberExpr> expr) {
     JSValue object = evaluate(expr->object);
     
+    if (JSArray* array = object.asArray()) {
+        return getArrayMember(*array, *expr);
+    }
+    
     if (!object.isObject()) {
         throw error("Cannot access property of non-object.");
     }
@@ -378,7 +423,44 @@ JSValue JSInterpreter::visitMemberExpr(std::shared_ptr<MemberExpr> expr) {
         if (!propExpr) {
             throw error("Invalid property access.");
         }
-        return obj->get(propExpr->value);
+        return obj->get(propExpr->value, expr->cache);
+    }
+}
+
+JSValue JSInterpreter::getArrayMember(JSArray& array, const MemberExpr& expr) {
+    if (!expr.computed) {
+        auto propExpr = std::dynamic_pointer_cast<LiteralExpr>(expr.property);
+        if (!propExpr) {
+            throw error("Invalid property access.");
+        }
+        return array.getProperty(propExpr->value);
+    }
+    
+    // Numeric indexes skip the string-keyed path
+    JSValue property = evaluate(expr.property);
+    size_t index;
+    if (JSArray::toIndex(property, index)) {
+        return array.get(index);
+    }
+    return array.getProperty(property.toString());
+}
+
+void JSInterpreter::setArrayMember(JSArray& array, const MemberExpr& expr, const JSValue& value) {
+    if (!expr.computed) {
+        auto propExpr = std::dynamic_pointer_cast<LiteralExpr>(expr.property);
+        if (!propExpr) {
+            throw error("Invalid property access.");
+        }
+        array.setProperty(propExpr->value, value);
+        return;
+    }
+    
+    JSValue property = evaluate(expr.property);
+    size_t index;
+    if (JSArray::toIndex(property, index)) {
+        array.set(index, value);
+    } else {
+        array.setProperty(property.toString(), value);
     }
 }
 
@@ -424,11 +506,15 @@ void JSInterpreter::visitVariableStmt(std::shared_ptr<VariableStmt> stmt) {
         value = evaluate(stmt->initializer);
     }
     
-    m_environment->define(stmt->name, value);
+    if (stmt->slot >= 0) {
+        m_environment->defineSlot(stmt->slot, value);
+    } else {
+        m_environment->define(stmt->name, value);
+    }
 }
 
 void JSInterpreter::visitBlockStmt(std::shared_ptr<BlockStmt> stmt) {
-    auto environment = std::make_shared<Environment>(m_environment);
+    auto environment = std::make_shared<Environment>(m_environment, stmt->scope);
     executeBlock(stmt, environment);
 }
 
@@ -452,7 +538,7 @@ void JSInterpreter::visitWhileStmt(std::shared_ptr<WhileStmt> stmt) {
 
 void JSInterpreter::visitForStmt(std::shared_ptr<ForStmt> stmt) {
     // Create a new scope for the loop
-    auto environment = std::make_shared<Environment>(m_environment);
+    auto environment = std::make_shared<Environment>(m_environment, stmt->scope);
     std::shared_ptr<Environment> previousEnvironment = m_environment;
     m_environment = environment;
     
@@ -495,18 +581,22 @@ void JSInterpreter::visitForStmt(std::shared_ptr<ForStmt> stmt) {
 void JSInterpreter::visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt) {
     // Create a function object that captures the current environment
     auto function = std::make_shared<JSFunction>([this, stmt](const std::vector<JSValue>& args, JSValue thisValue) {
+        if (!stmt->body) {
+            parseFunction(*stmt);
+        }
+        
         // Create a new environment with the closure
-        auto environment = std::make_shared<Environment>(m_environment);
+        auto environment = std::make_shared<Environment>(m_environment, stmt->scope);
         std::shared_ptr<Environment> previousEnvironment = m_environment;
         m_environment = environment;
         
-        // Bind parameters to arguments
+        // Bind parameters to arguments; they take the first slots
         for (size_t i = 0; i < stmt->parameters.size(); i++) {
             if (i < args.size()) {
-                environment->define(stmt->parameters[i], args[i]);
+                environment->defineSlot(static_cast<int>(i), args[i]);
             } else {
                 // Default to undefined
-                environment->define(stmt->parameters[i], JSValue());
+                environment->defineSlot(static_cast<int>(i), JSValue());
             }
         }
         
@@ -533,7 +623,20 @@ void JSInterpreter::visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt) {
     });
     
     // Define the function in the current environment
-    m_environment->define(stmt->name, JSValue(function));
+    if (stmt->slot >= 0) {
+        m_environment->defineSlot(stmt->slot, JSValue(function));
+    } else {
+        m_environment->define(stmt->name, JSValue(function));
+    }
+}
+
+void JSInterpreter::parseFunction(FunctionStmt& function) {
+    try {
+        JSParser::parseBody(function);
+    } catch (const ParseError& parseError) {
+        throw error("Syntax error in function " + function.name + ": " + parseError.what());
+    }
+    JSResolver().resolve(function);
 }
 
 void JSInterpreter::visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) {
@@ -602,13 +705,13 @@ RuntimeError JSInterpreter::error(const std::string& message) {
 
 JSValue JSInterpreter::lookUpVariable(const std::string& name) {
     // Check if variable exists in the environment
-    if (m_environment->exists(name)) {
-        return m_environment->get(name);
+    if (JSValue* value = m_environment->lookup(name)) {
+        return *value;
     }
     
     // Check global environment
-    if (m_globals->exists(name)) {
-        return m_globals->get(name);
+    if (JSValue* value = m_globals->find(name)) {
+        return *value;
     }
     
     std::stringstream ss;
@@ -616,5 +719,13 @@ JSValue JSInterpreter::lookUpVariable(const std::string& name) {
     throw error(ss.str());
 }
 
+void JSInterpreter::assignVariable(const VariableExpr& variable, const JSValue& value) {
+    if (variable.slot >= 0) {
+        m_environment->slot(variable.depth, variable.slot) = value;
+    } else {
+        m_environment->assign(variable.name, value);
+    }
+}
+
 } // namespace custom_js
 } // namespace browser
\ No newline at end of file
@@ -4,10 +4,12 @@
 
 #include "js_parser.h"
 #include "js_value.h"
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <stack>
 #include <stdexcept>
+#include <vector>
 
 namespace browser {
 namespace custom_js {
@@ -18,15 +20,32 @@ public:
     RuntimeError(const std::string& message) : std::runtime_error(message) {}
 };
 
-// Environment for variable scope
+// Environment for variable scope. A resolved scope's variables live in
+// slots, declared in slot order; the global scope keeps a map by name.
 class Environment {
 public:
     Environment();
     Environment(std::shared_ptr<Environment> enclosing);
+    Environment(std::shared_ptr<Environment> enclosing, const ScopeLayout& scope);
     
     // Define a new variable
     void define(const std::string& name, const JSValue& value);
     
+    // Define the variable in slot
+    void defineSlot(int slot, const JSValue& value) {
+        m_slots[slot] = value;
+        m_defined = std::max(m_defined, static_cast<size_t>(slot) + 1);
+    }
+    
+    // A resolved variable, depth environments out
+    JSValue& slot(int depth, int slot) {
+        Environment* environment = this;
+        for (; depth > 0; --depth) {
+            environment = environment->m_enclosing.get();
+        }
+        return environment->m_slots[slot];
+    }
+    
     // Get a variable
     JSValue get(const std::string& name);
     
@@ -36,11 +55,24 @@ public:
     // Check if a variable exists
     bool exists(const std::string& name) const;
     
+    // Storage of a variable defined in this environment itself, or null;
+    // it stays put as long as the environment does
+    JSValue* find(const std::string& name);
+    
+    // The same through the enclosing environments
+    JSValue* lookup(const std::string& name);
+    
     // Get enclosing environment
     std::shared_ptr<Environment> enclosing() const { return m_enclosing; }
     
 private:
+    // Declared slot holding name, or -1
+    int slotOf(const std::string& name) const;
+    
     std::map<std::string, JSValue> m_values;
+    std::vector<JSValue> m_slots;
+    const ScopeLayout* m_scope;
+    size_t m_defined;   // Slots declared so far
     std::shared_ptr<Environment> m_enclosing;
 };
 
@@ -84,6 +116,10 @@ private:
     JSValue visitArrayExpr(std::shared_ptr<ArrayExpr> expr);
     JSValue visitMemberExpr(std::shared_ptr<MemberExpr> expr);
     
+    // Array elements and "length", without the object property map
+    JSValue getArrayMember(JSArray& array, const MemberExpr& expr);
+    void setArrayMember(JSArray& array, const MemberExpr& expr, const JSValue& value);
+    
     void executeStatementNode(std::shared_ptr<StatementNode> node);
     void visitExpressionStmt(std::shared_ptr<ExpressionStmt> stmt);
     void visitVariableStmt(std::shared_ptr<VariableStmt> stmt);
@@ -92,6 +128,9 @@ private:
     void visitWhileStmt(std::shared_ptr<WhileStmt> stmt);
     void visitForStmt(std::shared_ptr<ForStmt> stmt);
     void visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt);
+    
+    // Parse and resolve a function skipped by a lazy parse
+    void parseFunction(FunctionStmt& function);
     void visitReturnStmt(std::shared_ptr<ReturnStmt> stmt);
     
     // Helper for evaluating
@@ -108,8 +147,9 @@ private:
     // Runtime error handling
     RuntimeError error(const std::string& message);
     
-    // Helper for resolving variable references
+    // Helpers for resolving variable references
     JSValue lookUpVariable(const std::string& name);
+    void assignVariable(const VariableExpr& variable, const JSValue& value);
 };
 
 } // namespace custom_js
@@ -1,237 +1,246 @@
 #include "js_lexer.h"
-#include <iostream>
 #include <sstream>
 
 namespace browser {
 namespace custom_js {
 
-// Token to string conversion
-std::string Token::toString() const {
-    std::stringstream ss;
-    ss << "Token[type=" << static_cast<int>(type) << ", lexeme='" << lexeme << "', line=" << line << "]";
-    return ss.str();
-}
+namespace {
 
-// JSLexer implementation
-JSLexer::JSLexer() {
-    initKeywords();
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
 }
 
-void JSLexer::initKeywords() {
-    m_keywords["var"] = TokenType::VAR;
-    m_keywords["let"] = TokenType::LET;
-    m_keywords["const"] = TokenType::CONST;
-    m_keywords["if"] = TokenType::IF;
-    m_keywords["else"] = TokenType::ELSE;
-    m_keywords["for"] = TokenType::FOR;
-    m_keywords["while"] = TokenType::WHILE;
-    m_keywords["do"] = TokenType::DO;
-    m_keywords["function"] = TokenType::FUNCTION;
-    m_keywords["return"] = TokenType::RETURN;
-    m_keywords["true"] = TokenType::TRUE;
-    m_keywords["false"] = TokenType::FALSE;
-    m_keywords["null"] = TokenType::NULL_TOKEN;
-    m_keywords["undefined"] = TokenType::UNDEFINED;
-    m_keywords["this"] = TokenType::THIS;
-    m_keywords["new"] = TokenType::NEW;
+bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') ||
+           c == '_' || c == '$';
 }
 
-std::vector<Token> JSLexer::tokenize(const std::string& source) {
-    m_source = source;
-    m_tokens.clear();
-    m_start = 0;
-    m_current = 0;
-    m_line = 1;
-    
-    while (!isAtEnd()) {
-        m_start = m_current;
-        scanToken();
-    }
-    
-    // Add EOF token
-    m_tokens.push_back(Token(TokenType::EOF_TOKEN, "", m_line));
-    return m_tokens;
+bool isAlphaNumeric(char c) {
+    return isAlpha(c) || isDigit(c);
 }
 
-bool JSLexer::isAtEnd() const {
-    return m_current >= m_source.length();
-}
+struct Keyword {
+    const char* text;
+    TokenType type;
+};
+
+// Keywords by perfect hash: no two share (first + 20 * last + length) % 32
+constexpr Keyword keywordTable[32] = {
+    {"while", TokenType::WHILE},        // 0
+    {"var", TokenType::VAR},            // 1
+    {"null", TokenType::NULL_TOKEN},    // 2
+    {"if", TokenType::IF},              // 3
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {"function", TokenType::FUNCTION},  // 6
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {"else", TokenType::ELSE},          // 13
+    {"undefined", TokenType::UNDEFINED},// 14
+    {"false", TokenType::FALSE},        // 15
+    {"return", TokenType::RETURN},      // 16
+    {"for", TokenType::FOR},            // 17
+    {"do", TokenType::DO},              // 18
+    {nullptr, TokenType::IDENTIFIER},
+    {"this", TokenType::THIS},          // 20
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {"const", TokenType::CONST},        // 24
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {nullptr, TokenType::IDENTIFIER},
+    {"true", TokenType::TRUE},          // 28
+    {"new", TokenType::NEW},            // 29
+    {nullptr, TokenType::IDENTIFIER},
+    {"let", TokenType::LET},            // 31
+};
 
-char JSLexer::advance() {
-    return m_source[m_current++];
+} // namespace
+
+// Token to string conversion
+std::string Token::toString() const {
+    std::stringstream ss;
+    ss << "Token[type=" << static_cast<int>(type) << ", lexeme='" << lexeme << "', line=" << line << "]";
+    return ss.str();
 }
 
-char JSLexer::peek() const {
-    if (isAtEnd()) return '\0';
-    return m_source[m_current];
+//-----------------------------------------------------------------------------
+// JSLexer Implementation
+//-----------------------------------------------------------------------------
+
+JSLexer::JSLexer(std::string_view source, size_t position, int line)
+    : m_source(source)
+    , m_start(position)
+    , m_current(position)
+    , m_line(line)
+{
 }
 
-char JSLexer::peekNext() const {
-    if (m_current + 1 >= m_source.length()) return '\0';
-    return m_source[m_current + 1];
+TokenType JSLexer::keyword(std::string_view identifier) {
+    // Keywords are 2 to 9 letters
+    if (identifier.size() < 2 || identifier.size() > 9) {
+        return TokenType::IDENTIFIER;
+    }
+    size_t hash = (static_cast<unsigned char>(identifier.front()) +
+                   20 * static_cast<unsigned char>(identifier.back()) + identifier.size()) % 32;
+    const Keyword& entry = keywordTable[hash];
+    if (entry.text && identifier == entry.text) {
+        return entry.type;
+    }
+    return TokenType::IDENTIFIER;
 }
 
 bool JSLexer::match(char expected) {
     if (isAtEnd() || m_source[m_current] != expected) return false;
-    
+
     m_current++;
     return true;
 }
 
-void JSLexer::scanToken() {
+void JSLexer::skipTrivia() {
+    while (!isAtEnd()) {
+        switch (peek()) {
+            case ' ':
+            case '\r':
+            case '\t':
+                advance();
+                break;
+            case '\n':
+                m_line++;
+                advance();
+                break;
+            case '/':
+                if (peekNext() == '/') {
+                    // Comment - consume until end of line
+                    while (peek() != '\n' && !isAtEnd()) advance();
+                } else if (peekNext() == '*') {
+                    // Multiline comment
+                    m_current += 2;
+                    while (!isAtEnd() && !(peek() == '*' && peekNext() == '/')) {
+                        if (peek() == '\n') m_line++;
+                        advance();
+                    }
+
+                    // Consume the closing */
+                    if (!isAtEnd()) {
+                        m_current += 2;
+                    }
+                } else {
+                    return;
+                }
+                break;
+            default:
+                return;
+        }
+    }
+}
+
+Token JSLexer::next() {
+    skipTrivia();
+    m_start = m_current;
+    if (isAtEnd()) {
+        return makeToken(TokenType::EOF_TOKEN);
+    }
+
     char c = advance();
-    
     switch (c) {
         // Single-character tokens
-        case '(': addToken(TokenType::LEFT_PAREN); break;
-        case ')': addToken(TokenType::RIGHT_PAREN); break;
-        case '{': addToken(TokenType::LEFT_BRACE); break;
-        case '}': addToken(TokenType::RIGHT_BRACE); break;
-        case '[': addToken(TokenType::LEFT_BRACKET); break;
-        case ']': addToken(TokenType::RIGHT_BRACKET); break;
-        case ',': addToken(TokenType::COMMA); break;
-        case '.': addToken(TokenType::DOT); break;
-        case ';': addToken(TokenType::SEMICOLON); break;
-        case ':': addToken(TokenType::COLON); break;
-        
+        case '(': return makeToken(TokenType::LEFT_PAREN);
+        case ')': return makeToken(TokenType::RIGHT_PAREN);
+        case '{': return makeToken(TokenType::LEFT_BRACE);
+        case '}': return makeToken(TokenType::RIGHT_BRACE);
+        case '[': return makeToken(TokenType::LEFT_BRACKET);
+        case ']': return makeToken(TokenType::RIGHT_BRACKET);
+        case ',': return makeToken(TokenType::COMMA);
+        case '.': return makeToken(TokenType::DOT);
+        case ';': return makeToken(TokenType::SEMICOLON);
+        case ':': return makeToken(TokenType::COLON);
+        case '/': return makeToken(TokenType::SLASH);
+        case '%': return makeToken(TokenType::PERCENT);
+
         // One or two character tokens
-        case '+':
-            if (match('+')) {
-                addToken(TokenType::PLUS_PLUS);
-            } else {
-                addToken(TokenType::PLUS);
-            }
-            break;
-        case '-':
-            if (match('-')) {
-                addToken(TokenType::MINUS_MINUS);
-            } else {
-                addToken(TokenType::MINUS);
-            }
-            break;
-        case '*':
-            if (match('*')) {
-                addToken(TokenType::STAR_STAR);
-            } else {
-                addToken(TokenType::STAR);
-            }
-            break;
-        case '/':
-            if (match('/')) {
-                // Comment - consume until end of line
-                while (peek() != '\n' && !isAtEnd()) advance();
-            } else if (match('*')) {
-                // Multiline comment
-                while (!isAtEnd() && !(peek() == '*' && peekNext() == '/')) {
-                    if (peek() == '\n') m_line++;
-                    advance();
-                }
-                
-                // Consume the closing */
-                if (!isAtEnd()) {
-                    advance(); // *
-                    advance(); // /
-                }
-            } else {
-                addToken(TokenType::SLASH);
-            }
-            break;
-        case '%': addToken(TokenType::PERCENT); break;
+        case '+': return makeToken(match('+') ? TokenType::PLUS_PLUS : TokenType::PLUS);
+        case '-': return makeToken(match('-') ? TokenType::MINUS_MINUS : TokenType::MINUS);
+        case '*': return makeToken(match('*') ? TokenType::STAR_STAR : TokenType::STAR);
         case '=':
             if (match('=')) {
-                if (match('=')) {
-                    addToken(TokenType::EQUAL_EQUAL_EQUAL);
-                } else {
-                    addToken(TokenType::EQUAL_EQUAL);
-                }
-            } else {
-                addToken(TokenType::EQUAL);
+                return makeToken(match('=') ? TokenType::EQUAL_EQUAL_EQUAL : TokenType::EQUAL_EQUAL);
             }
-            break;
+            return makeToken(TokenType::EQUAL);
         case '!':
             if (match('=')) {
-                if (match('=')) {
-                    addToken(TokenType::BANG_EQUAL_EQUAL);
-                } else {
-                    addToken(TokenType::BANG_EQUAL);
-                }
-            } else {
-                addToken(TokenType::BANG);
+                return makeToken(match('=') ? TokenType::BANG_EQUAL_EQUAL : TokenType::BANG_EQUAL);
             }
-            break;
-        case '<':
-            addToken(match('=') ? TokenType::LESS_EQUAL : TokenType::LESS);
-            break;
-        case '>':
-            addToken(match('=') ? TokenType::GREATER_EQUAL : TokenType::GREATER);
-            break;
-        case '&':
-            addToken(match('&') ? TokenType::AMPERSAND_AMPERSAND : TokenType::AMPERSAND);
-            break;
-        case '|':
-            addToken(match('|') ? TokenType::PIPE_PIPE : TokenType::PIPE);
-            break;
-            
+            return makeToken(TokenType::BANG);
+        case '<': return makeToken(match('=') ? TokenType::LESS_EQUAL : TokenType::LESS);
+        case '>': return makeToken(match('=') ? TokenType::GREATER_EQUAL : TokenType::GREATER);
+        case '&': return makeToken(match('&') ? TokenType::AMPERSAND_AMPERSAND : TokenType::AMPERSAND);
+        case '|': return makeToken(match('|') ? TokenType::PIPE_PIPE : TokenType::PIPE);
+
         // String literals
-        case '"': scanString(); break;
-        case '\'': scanString(); break;
-            
-        // Whitespace
-        case ' ':
-        case '\r':
-        case '\t':
-            // Ignore whitespace
-            break;
-        case '\n':
-            m_line++;
-            break;
-            
+        case '"':
+        case '\'':
+            return scanString();
+
         // Numbers and identifiers
         default:
             if (isDigit(c)) {
-                scanNumber();
-            } else if (isAlpha(c)) {
-                scanIdentifier();
-            } else {
-                // Error - unexpected character
-                std::string errorMsg = "Unexpected character: ";
-                errorMsg += c;
-                addToken(TokenType::ERROR, errorMsg);
+                return scanNumber();
+            }
+            if (isAlpha(c)) {
+                return scanIdentifier();
             }
-            break;
+            return makeError("Unexpected character.");
     }
 }
 
-void JSLexer::scanString() {
+Token JSLexer::scanString() {
     // Remember the quote type (' or ")
     char quoteType = m_source[m_start];
-    
-    // Capture the string content
+    bool escaped = false;
+
     while (peek() != quoteType && !isAtEnd()) {
         if (peek() == '\n') m_line++;
-        
-        // Handle escaped characters
-        if (peek() == '\\' && !isAtEnd()) {
-            advance(); // Consume the backslash
+
+        // Skip the escaped character
+        if (peek() == '\\') {
+            escaped = true;
+            advance();
+            if (isAtEnd()) break;
         }
-        
+
         advance();
     }
-    
+
     // Unterminated string
     if (isAtEnd()) {
-        addToken(TokenType::ERROR, "Unterminated string.");
-        return;
+        return makeError("Unterminated string.");
     }
-    
+
     // Consume the closing quote
     advance();
-    
-    // Extract the string value (without the quotes)
-    std::string value = m_source.substr(m_start + 1, m_current - m_start - 2);
-    
-    // Process escape sequences
+
+    // The text between the quotes
+    Token token = makeToken(TokenType::STRING);
+    token.lexeme = token.lexeme.substr(1, token.lexeme.size() - 2);
+    token.escaped = escaped;
+    return token;
+}
+
+std::string JSLexer::stringValue(const Token& token) {
+    if (!token.escaped) {
+        return std::string(token.lexeme);
+    }
+
+    std::string_view value = token.lexeme;
     std::string processed;
+    processed.reserve(value.size());
     for (size_t i = 0; i < value.length(); i++) {
         if (value[i] == '\\' && i + 1 < value.length()) {
             switch (value[i + 1]) {
@@ -249,81 +258,61 @@ void JSLexer::scanString() {
             processed += value[i];
         }
     }
-    
-    addToken(TokenType::STRING, processed);
+    return processed;
 }
 
-void JSLexer::scanNumber() {
+Token JSLexer::scanNumber() {
     // Consume integer part
     while (isDigit(peek())) advance();
-    
+
     // Look for a decimal point
     if (peek() == '.' && isDigit(peekNext())) {
         // Consume the dot
         advance();
-        
+
         // Consume fractional part
         while (isDigit(peek())) advance();
     }
-    
+
     // Look for exponent
     if (peek() == 'e' || peek() == 'E') {
         advance();
-        
+
         // Optional sign
         if (peek() == '+' || peek() == '-') advance();
-        
+
         // Exponent digits
-        if (isDigit(peek())) {
-            while (isDigit(peek())) advance();
-        } else {
-            // Invalid exponent
-            addToken(TokenType::ERROR, "Invalid number format.");
-            return;
+        if (!isDigit(peek())) {
+            return makeError("Invalid number format.");
         }
+        while (isDigit(peek())) advance();
     }
-    
-    // Extract the number as a string
-    std::string numberStr = m_source.substr(m_start, m_current - m_start);
-    addToken(TokenType::NUMBER, numberStr);
-}
-
-void JSLexer::scanIdentifier() {
-    while (isAlphaNumeric(peek())) advance();
-    
-    // Extract the identifier
-    std::string identifier = m_source.substr(m_start, m_current - m_start);
-    
-    // Check if it's a keyword
-    auto it = m_keywords.find(identifier);
-    if (it != m_keywords.end()) {
-        addToken(it->second);
-    } else {
-        addToken(TokenType::IDENTIFIER, identifier);
-    }
-}
 
-void JSLexer::addToken(TokenType type) {
-    addToken(type, m_source.substr(m_start, m_current - m_start));
+    return makeToken(TokenType::NUMBER);
 }
 
-void JSLexer::addToken(TokenType type, const std::string& lexeme) {
-    m_tokens.push_back(Token(type, lexeme, m_line));
-}
+Token JSLexer::scanIdentifier() {
+    while (isAlphaNumeric(peek())) advance();
 
-bool JSLexer::isDigit(char c) const {
-    return c >= '0' && c <= '9';
+    Token token = makeToken(TokenType::IDENTIFIER);
+    token.type = keyword(token.lexeme);
+    return token;
 }
 
-bool JSLexer::isAlpha(char c) const {
-    return (c >= 'a' && c <= 'z') || 
-           (c >= 'A' && c <= 'Z') || 
-           c == '_' || c == '$';
+Token JSLexer::makeToken(TokenType type) const {
+    Token token;
+    token.type = type;
+    token.lexeme = m_source.substr(m_start, m_current - m_start);
+    token.line = m_line;
+    token.offset = m_start;
+    return token;
 }
 
-bool JSLexer::isAlphaNumeric(char c) const {
-    return isAlpha(c) || isDigit(c);
+Token JSLexer::makeError(const char* message) const {
+    Token token = makeToken(TokenType::ERROR);
+    token.message = message;
+    return token;
 }
 
 } // namespace custom_js
-} // namespace browser
\ No newline at end of file
+} // namespace browser
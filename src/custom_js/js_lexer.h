@@ -2,10 +2,9 @@
 #ifndef CUSTOM_JS_LEXER_H
 #define CUSTOM_JS_LEXER_H
 
+#include <cstddef>
 #include <string>
-#include <vector>
-#include <map>
-#include <set>
+#include <string_view>
 
 namespace browser {
 namespace custom_js {
@@ -47,58 +46,58 @@ enum class TokenType {
     ERROR
 };
 
-// Represents a token in the source code
+// Represents a token in the source code. Its text is a slice of the
+// source, which must outlive it.
 struct Token {
-    TokenType type;
-    std::string lexeme;  // The actual text
-    int line;            // Line number
-    
-    Token(TokenType type, const std::string& lexeme, int line) 
-        : type(type), lexeme(lexeme), line(line) {}
+    TokenType type = TokenType::EOF_TOKEN;
+    std::string_view lexeme;  // As written; a string's is between its quotes
+    int line = 1;             // Line number
+    size_t offset = 0;        // Of the first character in the source
+    bool escaped = false;     // STRING: has escape sequences to decode
+    const char* message = nullptr;  // ERROR: what's wrong
     
     std::string toString() const;
 };
 
-// JavaScript lexer class
+// Pull lexer over a complete source buffer, which must outlive it. Tokens
+// are produced one at a time without copying.
 class JSLexer {
 public:
-    JSLexer();
+    // Lex source from position, which is on line
+    explicit JSLexer(std::string_view source = {}, size_t position = 0, int line = 1);
+    
+    // The next token; EOF_TOKEN once the source runs out, and from then on
+    Token next();
     
-    // Tokenize source code
-    std::vector<Token> tokenize(const std::string& source);
+    // A STRING token's value, escape sequences decoded
+    static std::string stringValue(const Token& token);
+    
+    // Keyword for an identifier, or IDENTIFIER
+    static TokenType keyword(std::string_view identifier);
     
 private:
-    std::string m_source;
-    std::vector<Token> m_tokens;
-    int m_start;        // Start of current lexeme
-    int m_current;      // Current position
+    std::string_view m_source;
+    size_t m_start;     // Start of current lexeme
+    size_t m_current;   // Current position
     int m_line;         // Current line
     
     // Helper methods
-    bool isAtEnd() const;
-    char advance();
-    char peek() const;
-    char peekNext() const;
+    bool isAtEnd() const { return m_current >= m_source.size(); }
+    char advance() { return m_source[m_current++]; }
+    char peek() const { return isAtEnd() ? '\0' : m_source[m_current]; }
+    char peekNext() const { return m_current + 1 >= m_source.size() ? '\0' : m_source[m_current + 1]; }
     bool match(char expected);
     
-    // Token recognition
-    void scanToken();
-    void scanString();
-    void scanNumber();
-    void scanIdentifier();
-    
-    // Add tokens
-    void addToken(TokenType type);
-    void addToken(TokenType type, const std::string& lexeme);
+    // Skip whitespace and comments
+    void skipTrivia();
     
-    // Character checks
-    bool isDigit(char c) const;
-    bool isAlpha(char c) const;
-    bool isAlphaNumeric(char c) const;
+    // Token recognition, with the first character consumed
+    Token scanString();
+    Token scanNumber();
+    Token scanIdentifier();
     
-    // Keyword mapping
-    std::map<std::string, TokenType> m_keywords;
-    void initKeywords();
+    Token makeToken(TokenType type) const;
+    Token makeError(const char* message) const;
 };
 
 } // namespace custom_js
@@ -102,13 +102,58 @@ Program::Program(std::vector<std::shared_ptr<StatementNode>> statements)
 // Parser Implementation
 //-----------------------------------------------------------------------------
 
-JSParser::JSParser() : m_current(0) {
+namespace {
+
+void parseBodiesIn(StatementNode& statement) {
+    switch (statement.getType()) {
+        case StatementType::BLOCK:
+            for (const auto& child : static_cast<BlockStmt&>(statement).statements) {
+                parseBodiesIn(*child);
+            }
+            break;
+        case StatementType::IF: {
+            auto& ifStmt = static_cast<IfStmt&>(statement);
+            parseBodiesIn(*ifStmt.thenBranch);
+            if (ifStmt.elseBranch) {
+                parseBodiesIn(*ifStmt.elseBranch);
+            }
+            break;
+        }
+        case StatementType::WHILE:
+            parseBodiesIn(*static_cast<WhileStmt&>(statement).body);
+            break;
+        case StatementType::FOR: {
+            auto& forStmt = static_cast<ForStmt&>(statement);
+            if (forStmt.initializer) {
+                parseBodiesIn(*forStmt.initializer);
+            }
+            parseBodiesIn(*forStmt.body);
+            break;
+        }
+        case StatementType::FUNCTION: {
+            auto& function = static_cast<FunctionStmt&>(statement);
+            JSParser::parseBody(function);
+            parseBodiesIn(*function.body);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+} // namespace
+
+JSParser::JSParser()
+    : m_lazyFunctions(false)
+    , m_text(nullptr)
+{
 }
 
 std::shared_ptr<Program> JSParser::parse(const std::string& source) {
-    JSLexer lexer;
-    m_tokens = lexer.tokenize(source);
-    m_current = 0;
+    m_lexer = JSLexer(source);
+    m_next = m_lexer.next();
+    m_text = &source;
+    m_source = nullptr;
     
     try {
         return program();
@@ -118,20 +163,40 @@ std::shared_ptr<Program> JSParser::parse(const std::string& source) {
     }
 }
 
-bool JSParser::isAtEnd() const {
-    return peek().type == TokenType::EOF_TOKEN;
-}
-
-Token JSParser::peek() const {
-    return m_tokens[m_current];
+void JSParser::parseBody(FunctionStmt& function) {
+    if (function.body) {
+        return;
+    }
+    
+    // Lex the body alone, where it is in the whole source
+    std::shared_ptr<const std::string> source = function.source;
+    JSParser parser;
+    parser.m_lexer = JSLexer(std::string_view(*source).substr(0, function.bodyEnd), function.bodyBegin,
+                             function.bodyLine);
+    parser.m_next = parser.m_lexer.next();
+    parser.m_lazyFunctions = true;
+    parser.m_source = source;
+    
+    parser.consume(TokenType::LEFT_BRACE, "Expect '{' before function body.");
+    std::shared_ptr<BlockStmt> body = parser.block();
+    if (!parser.isAtEnd()) {
+        throw parser.error(parser.peek(), "Expect end of function body.");
+    }
+    function.body = body;
+    function.source = nullptr;
 }
 
-Token JSParser::previous() const {
-    return m_tokens[m_current - 1];
+void JSParser::parseBodies(Program& program) {
+    for (const auto& statement : program.statements) {
+        parseBodiesIn(*statement);
+    }
 }
 
-Token JSParser::advance() {
-    if (!isAtEnd()) m_current++;
+const Token& JSParser::advance() {
+    if (!isAtEnd()) {
+        m_previous = m_next;
+        m_next = m_lexer.next();
+    }
     return previous();
 }
 
@@ -155,18 +220,24 @@ bool JSParser::match(std::initializer_list<TokenType> types) {
     return false;
 }
 
-Token JSParser::consume(TokenType type, const std::string& message) {
+const Token& JSParser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
     
     throw error(peek(), message);
 }
 
-ParseError JSParser::error(Token token, const std::string& message) {
-    std::string errorMsg = "Error at line " + std::to_string(token.line) + ": " + message;
+ParseError JSParser::error(const Token& token, const std::string& message) {
+    std::string errorMsg = "Error at line " + std::to_string(token.line) + ": ";
+    if (token.type == TokenType::ERROR) {
+        // The lexer's complaint explains more than what the parser expected
+        errorMsg += token.message;
+    } else {
+        errorMsg += message;
+    }
     if (token.type == TokenType::EOF_TOKEN) {
         errorMsg += " at end";
     } else {
-        errorMsg += " at '" + token.lexeme + "'";
+        errorMsg += " at '" + std::string(token.lexeme) + "'";
     }
     return ParseError(errorMsg);
 }
@@ -237,16 +308,46 @@ std::shared_ptr<FunctionStmt> JSParser::functionDeclaration(const std::string& k
             }
             
             Token param = consume(TokenType::IDENTIFIER, "Expect parameter name.");
-            parameters.push_back(param.lexeme);
+            parameters.emplace_back(param.lexeme);
         } while (match(TokenType::COMMA));
     }
     
     consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
     
     consume(TokenType::LEFT_BRACE, "Expect '{' before " + kind + " body.");
+    if (m_lazyFunctions) {
+        auto function = std::make_shared<FunctionStmt>(std::string(name.lexeme), parameters, nullptr);
+        skipFunctionBody(*function);
+        return function;
+    }
     std::shared_ptr<BlockStmt> body = block();
     
-    return std::make_shared<FunctionStmt>(name.lexeme, parameters, body);
+    return std::make_shared<FunctionStmt>(std::string(name.lexeme), parameters, body);
+}
+
+// Past the '}' matching the '{' just consumed, noting where the body is
+void JSParser::skipFunctionBody(FunctionStmt& function) {
+    Token open = previous();
+    int depth = 1;
+    while (depth > 0) {
+        if (isAtEnd()) {
+            throw error(peek(), "Expect '}' after block.");
+        }
+        TokenType type = advance().type;
+        if (type == TokenType::LEFT_BRACE) {
+            ++depth;
+        } else if (type == TokenType::RIGHT_BRACE) {
+            --depth;
+        }
+    }
+    
+    if (!m_source) {
+        m_source = std::make_shared<const std::string>(*m_text);
+    }
+    function.source = m_source;
+    function.bodyBegin = open.offset;
+    function.bodyEnd = previous().offset + 1;
+    function.bodyLine = open.line;
 }
 
 // VariableDecl -> ("var" | "let" | "const") IDENTIFIER ("=" Expression)? ";"
@@ -272,7 +373,7 @@ std::shared_ptr<VariableStmt> JSParser::variableDeclaration() {
     }
     
     consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
-    return std::make_shared<VariableStmt>(declType, name.lexeme, initializer);
+    return std::make_shared<VariableStmt>(declType, std::string(name.lexeme), initializer);
 }
 
 // Statement -> ExpressionStmt | BlockStmt | IfStmt | WhileStmt | ForStmt | ReturnStmt
@@ -562,7 +663,7 @@ std::shared_ptr<ExpressionNode> JSParser::call() {
             expr = finishCall(expr);
         } else if (match(TokenType::DOT)) {
             Token name = consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
-            auto property = std::make_shared<LiteralExpr>(LiteralExpr::LiteralType::STRING, name.lexeme);
+            auto property = std::make_shared<LiteralExpr>(LiteralExpr::LiteralType::STRING, std::string(name.lexeme));
             expr = std::make_shared<MemberExpr>(expr, property, false);
         } else if (match(TokenType::LEFT_BRACKET)) {
             std::shared_ptr<ExpressionNode> index = expression();
@@ -579,11 +680,11 @@ std::shared_ptr<ExpressionNode> JSParser::call() {
 // Primary -> NUMBER | STRING | "true" | "false" | "null" | "undefined" | IDENTIFIER | "(" Expression ")" | "{" ObjectProps "}" | "[" ArrayElements "]"
 std::shared_ptr<ExpressionNode> JSParser::primary() {
     if (match(TokenType::NUMBER)) {
-        return std::make_shared<LiteralExpr>(LiteralExpr::LiteralType::NUMBER, previous().lexeme);
+        return std::make_shared<LiteralExpr>(LiteralExpr::LiteralType::NUMBER, std::string(previous().lexeme));
     }
     
     if (match(TokenType::STRING)) {
-        return std::make_shared<LiteralExpr>(LiteralExpr::LiteralType::STRING, previous().lexeme);
+        return std::make_shared<LiteralExpr>(LiteralExpr::LiteralType::STRING, JSLexer::stringValue(previous()));
     }
     
     if (match(TokenType::TRUE)) {
@@ -603,7 +704,7 @@ std::shared_ptr<ExpressionNode> JSParser::primary() {
     }
     
     if (match(TokenType::IDENTIFIER)) {
-        return std::make_shared<VariableExpr>(previous().lexeme);
+        return std::make_shared<VariableExpr>(std::string(previous().lexeme));
     }
     
     if (match(TokenType::LEFT_PAREN)) {
@@ -621,9 +722,11 @@ std::shared_ptr<ExpressionNode> JSParser::primary() {
                 // Parse property
                 if (check(TokenType::STRING) || check(TokenType::IDENTIFIER)) {
                     Token key = advance();
+                    std::string name = key.type == TokenType::STRING ? JSLexer::stringValue(key)
+                                                                      : std::string(key.lexeme);
                     consume(TokenType::COLON, "Expect ':' after property name.");
                     std::shared_ptr<ExpressionNode> value = expression();
-                    properties.push_back(ObjectExpr::Property(key.lexeme, value));
+                    properties.push_back(ObjectExpr::Property(name, value));
                 } else {
                     throw error(peek(), "Expect property name.");
                 }
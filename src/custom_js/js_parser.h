@@ -3,6 +3,7 @@
 #define CUSTOM_JS_PARSER_H
 
 #include "js_lexer.h"
+#include "js_value.h"
 #include <memory>
 #include <vector>
 #include <string>
@@ -21,6 +22,11 @@ public:
     ParseError(const std::string& message) : std::runtime_error(message) {}
 };
 
+// Variables a scope declares, in slot order; filled in by JSResolver
+struct ScopeLayout {
+    std::vector<std::string> names;
+};
+
 // AST base node
 class ASTNode {
 public:
@@ -62,6 +68,10 @@ public:
     
     LiteralType literalType;
     std::string value;
+
+    // The interpreter's value for it, made on first evaluation
+    JSValue constant;
+    bool evaluated = false;
 };
 
 // Variable reference expression
@@ -71,6 +81,11 @@ public:
     ExpressionType getType() const override { return ExpressionType::VARIABLE; }
     
     std::string name;
+    
+    // Set by JSResolver: environments out from the current one and slot
+    // in it, or -1 when the name is looked up at runtime
+    int depth = -1;
+    int slot = -1;
 };
 
 // Unary expression
@@ -147,6 +162,7 @@ public:
     struct Property {
         std::string key;
         std::shared_ptr<ExpressionNode> value;
+        PropertyCache cache;
         
         Property(const std::string& k, std::shared_ptr<ExpressionNode> v)
             : key(k), value(v) {}
@@ -176,6 +192,9 @@ public:
     std::shared_ptr<ExpressionNode> object;
     std::shared_ptr<ExpressionNode> property;
     bool computed; // true for obj["prop"], false for obj.prop
+
+    // Inline cache for obj.prop, whether it's read or assigned to
+    PropertyCache cache;
 };
 
 // Statement node types
@@ -220,6 +239,7 @@ public:
     DeclarationType declarationType;
     std::string name;
     std::shared_ptr<ExpressionNode> initializer; // Can be nullptr
+    int slot = -1; // In the current environment; -1 defines by name
 };
 
 // Block statement
@@ -229,6 +249,7 @@ public:
     StatementType getType() const override { return StatementType::BLOCK; }
     
     std::vector<std::shared_ptr<StatementNode>> statements;
+    ScopeLayout scope;
 };
 
 // If statement
@@ -267,6 +288,7 @@ public:
     std::shared_ptr<ExpressionNode> condition;  // Can be nullptr (infinite loop)
     std::shared_ptr<ExpressionNode> increment;  // Can be nullptr
     std::shared_ptr<StatementNode> body;
+    ScopeLayout scope;                          // The initializer's declarations
 };
 
 // Function declaration statement
@@ -279,7 +301,16 @@ public:
     
     std::string name;
     std::vector<std::string> parameters;
-    std::shared_ptr<BlockStmt> body;
+    std::shared_ptr<BlockStmt> body;  // Null until parsed when parsing lazily
+    ScopeLayout scope;  // Parameters first, then the body's declarations
+    int slot = -1;      // Of the name in the current environment; -1 defines by name
+
+    // Where a body that hasn't been parsed is: the source it's in, the
+    // offsets of its braces, and the line it starts on
+    std::shared_ptr<const std::string> source;
+    size_t bodyBegin = 0;
+    size_t bodyEnd = 0;
+    int bodyLine = 1;
 };
 
 // Return statement
@@ -307,26 +338,49 @@ public:
     // Parse source code into an AST
     std::shared_ptr<Program> parse(const std::string& source);
     
+    // Only find where each function body ends, skipping over it, and
+    // parse it when it's first needed. Scripts whose functions aren't all
+    // called parse faster and make smaller trees, but a syntax error in a
+    // function surfaces only once the function is parsed.
+    void setLazyFunctions(bool lazy) { m_lazyFunctions = lazy; }
+    bool lazyFunctions() const { return m_lazyFunctions; }
+    
+    // Parse a body skipped by a lazy parse; functions declared in it are
+    // skipped in turn. Does nothing if the body is parsed. Throws
+    // ParseError for a syntax error.
+    static void parseBody(FunctionStmt& function);
+    
+    // Parse every skipped body in program, however deeply nested
+    static void parseBodies(Program& program);
+    
 private:
-    std::vector<Token> m_tokens;
-    int m_current;
+    JSLexer m_lexer;
+    Token m_previous;
+    Token m_next;
+    bool m_lazyFunctions;
+    
+    // While parsing lazily: the text being parsed, and a shared copy of
+    // it made for the first skipped body. Token offsets are into both.
+    const std::string* m_text;
+    std::shared_ptr<const std::string> m_source;
     
     // Helper methods
-    bool isAtEnd() const;
-    Token peek() const;
-    Token previous() const;
-    Token advance();
+    bool isAtEnd() const { return m_next.type == TokenType::EOF_TOKEN; }
+    const Token& peek() const { return m_next; }
+    const Token& previous() const { return m_previous; }
+    const Token& advance();
     bool check(TokenType type) const;
     bool match(TokenType type);
     bool match(std::initializer_list<TokenType> types);
-    Token consume(TokenType type, const std::string& message);
-    ParseError error(Token token, const std::string& message);
+    const Token& consume(TokenType type, const std::string& message);
+    ParseError error(const Token& token, const std::string& message);
     void synchronize();
     
     // Grammar rules
     std::shared_ptr<Program> program();
     std::shared_ptr<StatementNode> declaration();
     std::shared_ptr<FunctionStmt> functionDeclaration(const std::string& kind);
+    void skipFunctionBody(FunctionStmt& function);
     std::shared_ptr<VariableStmt> variableDeclaration();
     std::shared_ptr<StatementNode> statement();
     std::shared_ptr<ExpressionStmt> expressionStatement();
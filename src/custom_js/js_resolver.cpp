@@ -0,0 +1,226 @@
+#include "js_resolver.h"
+
+namespace browser {
+namespace custom_js {
+
+namespace {
+
+// Latest slot of name in scope, or -1
+int findSlot(const ScopeLayout& scope, const std::string& name) {
+    for (size_t i = scope.names.size(); i > 0; --i) {
+        if (scope.names[i - 1] == name) {
+            return static_cast<int>(i - 1);
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+void JSResolver::resolve(Program& program) {
+    m_scopes.clear();
+    m_functionScopes.clear();
+    for (const auto& statement : program.statements) {
+        resolveStatement(*statement);
+    }
+}
+
+void JSResolver::resolve(FunctionStmt& function) {
+    // Nothing outside a function resolves its references
+    m_scopes.clear();
+    m_functionScopes.clear();
+    resolveFunction(function);
+}
+
+void JSResolver::resolveStatement(StatementNode& statement) {
+    switch (statement.getType()) {
+        case StatementType::EXPRESSION:
+            resolveExpression(*static_cast<ExpressionStmt&>(statement).expression);
+            break;
+
+        case StatementType::VARIABLE: {
+            auto& variable = static_cast<VariableStmt&>(statement);
+            // The initializer can't see the variable it declares
+            if (variable.initializer) {
+                resolveExpression(*variable.initializer);
+            }
+            variable.slot = declare(variable.name);
+            break;
+        }
+
+        case StatementType::BLOCK: {
+            auto& block = static_cast<BlockStmt&>(statement);
+            beginScope(block.scope);
+            for (const auto& child : block.statements) {
+                resolveStatement(*child);
+            }
+            endScope();
+            break;
+        }
+
+        case StatementType::IF: {
+            auto& ifStmt = static_cast<IfStmt&>(statement);
+            resolveExpression(*ifStmt.condition);
+            resolveStatement(*ifStmt.thenBranch);
+            if (ifStmt.elseBranch) {
+                resolveStatement(*ifStmt.elseBranch);
+            }
+            break;
+        }
+
+        case StatementType::WHILE: {
+            auto& whileStmt = static_cast<WhileStmt&>(statement);
+            resolveExpression(*whileStmt.condition);
+            resolveStatement(*whileStmt.body);
+            break;
+        }
+
+        case StatementType::FOR: {
+            auto& forStmt = static_cast<ForStmt&>(statement);
+            beginScope(forStmt.scope);
+            if (forStmt.initializer) {
+                resolveStatement(*forStmt.initializer);
+            }
+            if (forStmt.condition) {
+                resolveExpression(*forStmt.condition);
+            }
+            if (forStmt.increment) {
+                resolveExpression(*forStmt.increment);
+            }
+            resolveStatement(*forStmt.body);
+            endScope();
+            break;
+        }
+
+        case StatementType::FUNCTION: {
+            auto& function = static_cast<FunctionStmt&>(statement);
+            resolveFunction(function);
+            function.slot = declare(function.name);
+            break;
+        }
+
+        case StatementType::RETURN: {
+            auto& returnStmt = static_cast<ReturnStmt&>(statement);
+            if (returnStmt.value) {
+                resolveExpression(*returnStmt.value);
+            }
+            break;
+        }
+    }
+}
+
+void JSResolver::resolveExpression(ExpressionNode& expression) {
+    switch (expression.getType()) {
+        case ExpressionType::LITERAL:
+            break;
+
+        case ExpressionType::VARIABLE:
+            resolveName(static_cast<VariableExpr&>(expression));
+            break;
+
+        case ExpressionType::UNARY:
+            resolveExpression(*static_cast<UnaryExpr&>(expression).operand);
+            break;
+
+        case ExpressionType::BINARY: {
+            auto& binary = static_cast<BinaryExpr&>(expression);
+            resolveExpression(*binary.left);
+            resolveExpression(*binary.right);
+            break;
+        }
+
+        case ExpressionType::CALL: {
+            auto& call = static_cast<CallExpr&>(expression);
+            resolveExpression(*call.callee);
+            for (const auto& argument : call.arguments) {
+                resolveExpression(*argument);
+            }
+            break;
+        }
+
+        case ExpressionType::ASSIGN: {
+            auto& assign = static_cast<AssignExpr&>(expression);
+            resolveExpression(*assign.value);
+            resolveExpression(*assign.target);
+            break;
+        }
+
+        case ExpressionType::OBJECT:
+            for (const auto& property : static_cast<ObjectExpr&>(expression).properties) {
+                resolveExpression(*property.value);
+            }
+            break;
+
+        case ExpressionType::ARRAY:
+            for (const auto& element : static_cast<ArrayExpr&>(expression).elements) {
+                resolveExpression(*element);
+            }
+            break;
+
+        case ExpressionType::MEMBER: {
+            auto& member = static_cast<MemberExpr&>(expression);
+            resolveExpression(*member.object);
+            resolveExpression(*member.property);
+            break;
+        }
+    }
+}
+
+void JSResolver::resolveFunction(FunctionStmt& function) {
+    if (!function.body) {
+        return;
+    }
+    // Parameters and the body's declarations share the call's environment
+    m_functionScopes.push_back(m_scopes.size());
+    beginScope(function.scope);
+    for (const std::string& parameter : function.parameters) {
+        function.scope.names.push_back(parameter);
+    }
+    for (const auto& statement : function.body->statements) {
+        resolveStatement(*statement);
+    }
+    endScope();
+    m_functionScopes.pop_back();
+}
+
+void JSResolver::resolveName(VariableExpr& variable) {
+    variable.depth = -1;
+    variable.slot = -1;
+
+    // Out to the function's own scope; beyond it are the callers'
+    size_t boundary = m_functionScopes.empty() ? 0 : m_functionScopes.back();
+    for (size_t i = m_scopes.size(); i > boundary; --i) {
+        int slot = findSlot(*m_scopes[i - 1], variable.name);
+        if (slot >= 0) {
+            variable.depth = static_cast<int>(m_scopes.size() - i);
+            variable.slot = slot;
+            return;
+        }
+    }
+}
+
+int JSResolver::declare(const std::string& name) {
+    if (m_scopes.empty()) {
+        return -1;
+    }
+    // Declaring a name again overwrites it
+    ScopeLayout& scope = *m_scopes.back();
+    int slot = findSlot(scope, name);
+    if (slot >= 0) {
+        return slot;
+    }
+    scope.names.push_back(name);
+    return static_cast<int>(scope.names.size() - 1);
+}
+
+void JSResolver::beginScope(ScopeLayout& scope) {
+    scope.names.clear();
+    m_scopes.push_back(&scope);
+}
+
+void JSResolver::endScope() {
+    m_scopes.pop_back();
+}
+
+} // namespace custom_js
+} // namespace browser
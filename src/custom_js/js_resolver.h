@@ -0,0 +1,43 @@
+// js_resolver.h - Resolves variable references to environment slots
+#ifndef CUSTOM_JS_RESOLVER_H
+#define CUSTOM_JS_RESOLVER_H
+
+#include "js_parser.h"
+#include <string>
+#include <vector>
+
+namespace browser {
+namespace custom_js {
+
+// Lays out the slots of each block, loop and function scope, and points
+// each variable reference at the slot it reads. Functions see their
+// callers' variables, so a reference resolves only within its own
+// function, to a declaration made before it; the rest (globals, and names
+// from the calling scopes) stay looked up by name. Resolving a program
+// again lays it out afresh. Functions whose bodies haven't been parsed are
+// left for resolve(FunctionStmt&) once they are.
+class JSResolver {
+public:
+    void resolve(Program& program);
+    void resolve(FunctionStmt& function);
+
+private:
+    void resolveStatement(StatementNode& statement);
+    void resolveExpression(ExpressionNode& expression);
+    void resolveFunction(FunctionStmt& function);
+    void resolveName(VariableExpr& variable);
+
+    // Slot for a declaration in the innermost scope, or -1 at top level
+    int declare(const std::string& name);
+
+    void beginScope(ScopeLayout& scope);
+    void endScope();
+
+    std::vector<ScopeLayout*> m_scopes;      // Innermost last
+    std::vector<size_t> m_functionScopes;    // Index of each function's own scope
+};
+
+} // namespace custom_js
+} // namespace browser
+
+#endif // CUSTOM_JS_RESOLVER_H
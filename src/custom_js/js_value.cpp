@@ -1,6 +1,10 @@
 #include "js_value.h"
-#include <iostream>
+#include "js_heap.h"
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <iostream>
+#include <limits>
 
 namespace browser {
 namespace custom_js {
@@ -9,95 +13,76 @@ namespace custom_js {
 // JSValue Implementation
 //-----------------------------------------------------------------------------
 
-JSValue::JSValue() : m_type(JSValueType::UNDEFINED) {
-    m_value = nullptr;
-}
-
-JSValue::JSValue(std::nullptr_t) : m_type(JSValueType::NULL_TYPE) {
-    m_value = nullptr;
-}
-
-JSValue::JSValue(bool value) : m_type(JSValueType::BOOLEAN) {
-    m_value = value;
-}
-
-JSValue::JSValue(int value) : m_type(JSValueType::NUMBER) {
-    m_value = static_cast<double>(value);
-}
-
-JSValue::JSValue(double value) : m_type(JSValueType::NUMBER) {
-    m_value = value;
-}
-
-JSValue::JSValue(const std::string& value) : m_type(JSValueType::STRING) {
-    m_value = value;
-}
-
-JSValue::JSValue(const char* value) : m_type(JSValueType::STRING) {
-    m_value = std::string(value);
+JSValue::JSValue(const std::string& value) {
+    setCell(stringBits, new StringCell{1, value});
 }
 
-JSValue::JSValue(std::shared_ptr<JSObject> obj) : m_type(JSValueType::OBJECT) {
-    m_value = obj;
+JSValue::JSValue(std::string&& value) {
+    setCell(stringBits, new StringCell{1, std::move(value)});
 }
 
-JSValue::JSValue(std::shared_ptr<JSFunction> func) : m_type(JSValueType::FUNCTION) {
-    m_value = func;
+JSValue::JSValue(const char* value) {
+    setCell(stringBits, new StringCell{1, std::string(value)});
 }
 
-JSValue::JSValue(std::shared_ptr<JSArray> array) : m_type(JSValueType::ARRAY) {
-    m_value = array;
+JSValue::JSValue(std::shared_ptr<JSObject> obj) {
+    JSObject* object = obj.get();
+    setObject(objectBits, object, std::move(obj));
 }
 
-JSValueType JSValue::type() const {
-    return m_type;
+JSValue::JSValue(std::shared_ptr<JSFunction> func) {
+    JSObject* object = func.get();
+    setObject(functionBits, object, std::move(func));
 }
 
-bool JSValue::isUndefined() const {
-    return m_type == JSValueType::UNDEFINED;
+JSValue::JSValue(std::shared_ptr<JSArray> array) {
+    JSObject* object = array.get();
+    setObject(arrayBits, object, std::move(array));
 }
 
-bool JSValue::isNull() const {
-    return m_type == JSValueType::NULL_TYPE;
+void JSValue::setCell(uint64_t tagBits, const void* cell) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(cell);
+    assert((address & ~payloadMask) == 0 && "pointer doesn't fit a NaN's payload");
+    m_bits = tagBits | address;
 }
 
-bool JSValue::isBoolean() const {
-    return m_type == JSValueType::BOOLEAN;
-}
-
-bool JSValue::isNumber() const {
-    return m_type == JSValueType::NUMBER;
-}
-
-bool JSValue::isString() const {
-    return m_type == JSValueType::STRING;
-}
-
-bool JSValue::isObject() const {
-    return m_type == JSValueType::OBJECT;
+void JSValue::setObject(uint64_t tagBits, JSObject* object, std::shared_ptr<JSObject> owner) {
+    if (object && object->m_valueRefs++ == 0) {
+        object->m_self = std::move(owner);
+    }
+    setCell(tagBits, object);
 }
 
-bool JSValue::isFunction() const {
-    return m_type == JSValueType::FUNCTION;
-}
+void JSValue::releaseCell(uint64_t bits) {
+    void* cell = reinterpret_cast<void*>(static_cast<uintptr_t>(bits & payloadMask));
+    if ((bits & tagMask) == stringBits) {
+        StringCell* string = static_cast<StringCell*>(cell);
+        if (--string->refs == 0) {
+            delete string;
+        }
+        return;
+    }
 
-bool JSValue::isArray() const {
-    return m_type == JSValueType::ARRAY;
+    JSObject* object = static_cast<JSObject*>(cell);
+    if (--object->m_valueRefs == 0) {
+        // May destroy the object, so nothing touches it after
+        std::shared_ptr<JSObject> self = std::move(object->m_self);
+    }
 }
 
-bool JSValue::toBoolean() const {
-    switch (m_type) {
+bool JSValue::toBooleanSlow() const {
+    switch (type()) {
         case JSValueType::UNDEFINED:
         case JSValueType::NULL_TYPE:
             return false;
         case JSValueType::BOOLEAN:
-            return std::get<bool>(m_value);
+            return (m_bits & 1) != 0;
         case JSValueType::NUMBER: {
-            double num = std::get<double>(m_value);
+            double num = toNumber();
             return num != 0 && !std::isnan(num);
         }
         case JSValueType::STRING:
-            return !std::get<std::string>(m_value).empty();
+            return !stringCell().value.empty();
         case JSValueType::OBJECT:
         case JSValueType::FUNCTION:
         case JSValueType::ARRAY:
@@ -107,19 +92,17 @@ bool JSValue::toBoolean() const {
     }
 }
 
-double JSValue::toNumber() const {
-    switch (m_type) {
+double JSValue::toNumberSlow() const {
+    switch (type()) {
         case JSValueType::UNDEFINED:
             return std::numeric_limits<double>::quiet_NaN();
         case JSValueType::NULL_TYPE:
             return 0.0;
         case JSValueType::BOOLEAN:
-            return std::get<bool>(m_value) ? 1.0 : 0.0;
-        case JSValueType::NUMBER:
-            return std::get<double>(m_value);
+            return (m_bits & 1) ? 1.0 : 0.0;
         case JSValueType::STRING: {
             try {
-                return std::stod(std::get<std::string>(m_value));
+                return std::stod(stringCell().value);
             } catch (...) {
                 return std::numeric_limits<double>::quiet_NaN();
             }
@@ -134,15 +117,15 @@ double JSValue::toNumber() const {
 }
 
 std::string JSValue::toString() const {
-    switch (m_type) {
+    switch (type()) {
         case JSValueType::UNDEFINED:
             return "undefined";
         case JSValueType::NULL_TYPE:
             return "null";
         case JSValueType::BOOLEAN:
-            return std::get<bool>(m_value) ? "true" : "false";
+            return (m_bits & 1) ? "true" : "false";
         case JSValueType::NUMBER: {
-            double num = std::get<double>(m_value);
+            double num = toNumber();
             if (std::isnan(num)) return "NaN";
             if (std::isinf(num)) return num > 0 ? "Infinity" : "-Infinity";
             
@@ -156,7 +139,7 @@ std::string JSValue::toString() const {
             return result;
         }
         case JSValueType::STRING:
-            return std::get<std::string>(m_value);
+            return stringCell().value;
         case JSValueType::OBJECT:
             return "[object Object]";
         case JSValueType::FUNCTION:
@@ -169,28 +152,30 @@ std::string JSValue::toString() const {
 }
 
 std::shared_ptr<JSObject> JSValue::toObject() const {
-    if (m_type == JSValueType::OBJECT) {
-        return std::get<std::shared_ptr<JSObject>>(m_value);
+    if (isObject() && pointer()) {
+        return static_cast<JSObject*>(pointer())->m_self;
     }
     return nullptr;
 }
 
 std::shared_ptr<JSFunction> JSValue::toFunction() const {
-    if (m_type == JSValueType::FUNCTION) {
-        return std::get<std::shared_ptr<JSFunction>>(m_value);
+    if (isFunction() && pointer()) {
+        return std::static_pointer_cast<JSFunction>(static_cast<JSObject*>(pointer())->m_self);
     }
     return nullptr;
 }
 
 std::shared_ptr<JSArray> JSValue::toArray() const {
-    if (m_type == JSValueType::ARRAY) {
-        return std::get<std::shared_ptr<JSArray>>(m_value);
+    if (isArray() && pointer()) {
+        return std::static_pointer_cast<JSArray>(static_cast<JSObject*>(pointer())->m_self);
     }
     return nullptr;
 }
 
 bool JSValue::operator==(const JSValue& other) const {
-    if (m_type != other.m_type) {
+    JSValueType leftType = type();
+    JSValueType rightType = other.type();
+    if (leftType != rightType) {
         // Different types, try type conversion
         if (isNumber() && other.isString()) {
             return toNumber() == other.toNumber();
@@ -203,27 +188,19 @@ bool JSValue::operator==(const JSValue& other) const {
     }
 
     // Same type
-    switch (m_type) {
-        case JSValueType::UNDEFINED:
-        case JSValueType::NULL_TYPE:
-            return true; // undefined == undefined, null == null
-        case JSValueType::BOOLEAN:
-            return std::get<bool>(m_value) == std::get<bool>(other.m_value);
+    switch (leftType) {
         case JSValueType::NUMBER: {
-            double a = std::get<double>(m_value);
-            double b = std::get<double>(other.m_value);
+            double a = toNumber();
+            double b = other.toNumber();
             if (std::isnan(a) && std::isnan(b)) return true;
             return a == b;
         }
         case JSValueType::STRING:
-            return std::get<std::string>(m_value) == std::get<std::string>(other.m_value);
-        case JSValueType::OBJECT:
-        case JSValueType::FUNCTION:
-        case JSValueType::ARRAY:
-            // Object equality is by reference
-            return std::get<std::shared_ptr<JSObject>>(m_value) == std::get<std::shared_ptr<JSObject>>(other.m_value);
+            return m_bits == other.m_bits || stringCell().value == other.stringCell().value;
         default:
-            return false;
+            // undefined == undefined, null == null, booleans by value and
+            // objects by reference
+            return m_bits == other.m_bits;
     }
 }
 
@@ -231,20 +208,105 @@ bool JSValue::operator!=(const JSValue& other) const {
     return !(*this == other);
 }
 
+//-----------------------------------------------------------------------------
+// Shape Implementation
+//-----------------------------------------------------------------------------
+
+Shape::Shape() : m_dictionary(false) {
+}
+
+Shape::~Shape() {
+    // Unlink from the parent, unless the key has been given a new shape
+    if (m_parent) {
+        auto it = m_parent->m_transitions.find(m_keys.back());
+        if (it != m_parent->m_transitions.end() && it->second.expired()) {
+            m_parent->m_transitions.erase(it);
+        }
+    }
+}
+
+std::shared_ptr<Shape> Shape::empty() {
+    return JSHeap::current().emptyShape();
+}
+
+int Shape::find(const std::string& key) const {
+    auto it = m_slots.find(key);
+    return it != m_slots.end() ? static_cast<int>(it->second) : -1;
+}
+
+std::shared_ptr<Shape> Shape::withProperty(const std::string& key) {
+    std::weak_ptr<Shape>& transition = m_transitions[key];
+    std::shared_ptr<Shape> next = transition.lock();
+    if (!next) {
+        // Not make_shared, whose one allocation the weak_ptr would keep
+        next = std::shared_ptr<Shape>(new Shape());
+        next->m_keys = m_keys;
+        next->m_slots = m_slots;
+        next->addKey(key);
+        next->m_parent = shared_from_this();
+        transition = next;
+    }
+    return next;
+}
+
+std::shared_ptr<Shape> Shape::toDictionary() const {
+    auto dictionary = std::make_shared<Shape>();
+    dictionary->m_keys = m_keys;
+    dictionary->m_slots = m_slots;
+    dictionary->m_dictionary = true;
+    return dictionary;
+}
+
+void Shape::addKey(const std::string& key) {
+    m_slots[key] = static_cast<uint32_t>(m_keys.size());
+    m_keys.push_back(key);
+}
+
+void Shape::removeSlot(uint32_t slot) {
+    m_slots.erase(m_keys[slot]);
+    m_keys.erase(m_keys.begin() + slot);
+    for (uint32_t i = slot; i < m_keys.size(); ++i) {
+        m_slots[m_keys[i]] = i;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// PropertyCache Implementation
+//-----------------------------------------------------------------------------
+
+void PropertyCache::add(std::shared_ptr<Shape> shape, std::shared_ptr<Shape> transition, uint32_t slot) {
+    // Dictionary shapes change in place, so a slot found in one can move
+    if (m_count == maxEntries || shape->isDictionary()) {
+        return;
+    }
+    m_entries[m_count++] = Entry{std::move(shape), std::move(transition), slot};
+}
+
 //-----------------------------------------------------------------------------
 // JSObject Implementation
 //-----------------------------------------------------------------------------
 
-JSObject::JSObject() {
+JSObject::JSObject()
+    : m_shape(Shape::empty())
+    , m_heap(nullptr)
+    , m_heapPrevious(nullptr)
+    , m_heapNext(nullptr)
+    , m_gcRefs(0)
+    , m_gcMarked(false)
+{
+    JSHeap::current().track(this);
 }
 
 JSObject::~JSObject() {
+    if (m_heap) {
+        m_heap->untrack(this);
+    }
 }
 
 JSValue JSObject::get(const std::string& key) const {
-    auto it = m_properties.find(key);
-    if (it != m_properties.end()) {
-        return it->second;
+    int slot = m_shape->find(key);
+    if (slot >= 0) {
+        return m_slots[slot];
     }
 
     // Look up prototype chain
@@ -256,11 +318,16 @@ JSValue JSObject::get(const std::string& key) const {
 }
 
 void JSObject::set(const std::string& key, const JSValue& value) {
-    m_properties[key] = value;
+    int slot = m_shape->find(key);
+    if (slot >= 0) {
+        m_slots[slot] = value;
+    } else {
+        addProperty(key, value);
+    }
 }
 
 bool JSObject::has(const std::string& key) const {
-    if (m_properties.find(key) != m_properties.end()) {
+    if (m_shape->find(key) >= 0) {
         return true;
     }
 
@@ -273,21 +340,21 @@ bool JSObject::has(const std::string& key) const {
 }
 
 bool JSObject::remove(const std::string& key) {
-    auto it = m_properties.find(key);
-    if (it != m_properties.end()) {
-        m_properties.erase(it);
-        return true;
+    int slot = m_shape->find(key);
+    if (slot < 0) {
+        return false;
     }
-    return false;
+    if (!m_shape->isDictionary()) {
+        m_shape = m_shape->toDictionary();
+    }
+    m_shape->removeSlot(slot);
+    m_slots.erase(m_slots.begin() + slot);
+    return true;
 }
 
 std::vector<std::string> JSObject::getPropertyNames() const {
-    std::vector<std::string> names;
-    
     // Get own properties
-    for (const auto& pair : m_properties) {
-        names.push_back(pair.first);
-    }
+    std::vector<std::string> names = m_shape->keys();
     
     // Get prototype properties
     if (m_prototype) {
@@ -298,6 +365,62 @@ std::vector<std::string> JSObject::getPropertyNames() const {
     return names;
 }
 
+void JSObject::visitReferences(ReferenceVisitor& visitor) const {
+    for (const JSValue& value : m_slots) {
+        if (JSObject* object = value.asObject()) {
+            visitor.visit(object);
+        }
+    }
+    if (m_prototype) {
+        visitor.visit(m_prototype.get());
+    }
+}
+
+void JSObject::clearReferences() {
+    // Released when these go out of scope, after the object is consistent
+    std::vector<JSValue> slots;
+    slots.swap(m_slots);
+    std::shared_ptr<JSObject> prototype = std::move(m_prototype);
+    m_shape = Shape::empty();
+}
+
+void JSObject::addProperty(const std::string& key, const JSValue& value) {
+    if (m_shape->isDictionary()) {
+        m_shape->addKey(key);
+    } else if (m_shape->size() >= Shape::maxSharedProperties) {
+        m_shape = m_shape->toDictionary();
+        m_shape->addKey(key);
+    } else {
+        m_shape = m_shape->withProperty(key);
+    }
+    m_slots.push_back(value);
+}
+
+JSValue JSObject::getUncached(const std::string& key, PropertyCache& cache) const {
+    // Only own properties are cached; the prototype's can change under it
+    int slot = m_shape->find(key);
+    if (slot >= 0) {
+        cache.add(m_shape, nullptr, slot);
+        return m_slots[slot];
+    }
+    return m_prototype ? m_prototype->get(key) : JSValue();
+}
+
+void JSObject::setUncached(const std::string& key, const JSValue& value, PropertyCache& cache) {
+    int slot = m_shape->find(key);
+    if (slot >= 0) {
+        cache.add(m_shape, nullptr, slot);
+        m_slots[slot] = value;
+        return;
+    }
+
+    std::shared_ptr<Shape> before = m_shape;
+    addProperty(key, value);
+    if (!m_shape->isDictionary()) {
+        cache.add(std::move(before), m_shape, static_cast<uint32_t>(m_slots.size() - 1));
+    }
+}
+
 void JSObject::setPrototype(std::shared_ptr<JSObject> prototype) {
     m_prototype = prototype;
 }
@@ -324,18 +447,56 @@ JSValue JSFunction::call(const std::vector<JSValue>& args, JSValue thisValue) {
 // JSArray Implementation
 //-----------------------------------------------------------------------------
 
-JSArray::JSArray() : JSObject() {
-    // Set special "length" property
-    JSObject::set("length", JSValue(0.0));
+namespace {
+
+// Highest index plus one, as arrays allow
+constexpr double maxArrayLength = 4294967295.0;
+
+JSArray::ElementKind kindFor(const JSValue& value) {
+    if (value.isNumber()) {
+        return JSArray::ElementKind::DOUBLES;
+    }
+    if (value.asObject()) {
+        return JSArray::ElementKind::OBJECTS;
+    }
+    return JSArray::ElementKind::GENERIC;
 }
 
-JSArray::JSArray(const std::vector<JSValue>& elements) : JSObject(), m_elements(elements) {
-    // Set length property
-    JSObject::set("length", JSValue(static_cast<double>(elements.size())));
-    
-    // Set indexed properties
-    for (size_t i = 0; i < elements.size(); i++) {
-        JSObject::set(std::to_string(i), elements[i]);
+bool holds(JSArray::ElementKind kind, const JSValue& value) {
+    switch (kind) {
+        case JSArray::ElementKind::DOUBLES:
+            return value.isNumber();
+        case JSArray::ElementKind::OBJECTS:
+            return value.asObject() != nullptr;
+        default:
+            return true;
+    }
+}
+
+} // namespace
+
+JSArray::JSArray() : JSObject(), m_kind(ElementKind::DOUBLES), m_sparseLength(0) {
+}
+
+JSArray::JSArray(const std::vector<JSValue>& elements)
+    : JSObject(), m_kind(ElementKind::DOUBLES), m_sparseLength(0) {
+    if (!elements.empty()) {
+        m_kind = kindFor(elements[0]);
+        for (const JSValue& element : elements) {
+            if (!holds(m_kind, element)) {
+                m_kind = ElementKind::GENERIC;
+                break;
+            }
+        }
+    }
+
+    if (m_kind == ElementKind::DOUBLES) {
+        m_doubles.reserve(elements.size());
+        for (const JSValue& element : elements) {
+            m_doubles.push_back(element.toNumber());
+        }
+    } else {
+        m_elements = elements;
     }
 }
 
@@ -343,48 +504,217 @@ JSArray::~JSArray() {
 }
 
 JSValue JSArray::get(size_t index) const {
-    if (index < m_elements.size()) {
+    if (m_kind == ElementKind::SPARSE) {
+        auto it = m_sparse.find(index);
+        if (it != m_sparse.end()) {
+            return it->second;
+        }
+    } else if (m_kind == ElementKind::DOUBLES) {
+        if (index < m_doubles.size()) {
+            return JSValue(m_doubles[index]);
+        }
+    } else if (index < m_elements.size()) {
         return m_elements[index];
     }
     return JSValue(); // undefined
 }
 
 void JSArray::set(size_t index, const JSValue& value) {
+    size_t size = length();
+    if (m_kind == ElementKind::SPARSE || (index > size && sparsifyFor(index + 1))) {
+        m_sparse[index] = value;
+        m_sparseLength = std::max(m_sparseLength, index + 1);
+        return;
+    }
+    
+    if (size == 0 && index == 0) {
+        // An empty array takes the kind of its first element
+        m_kind = kindFor(value);
+    } else if (index > size || !holds(m_kind, value)) {
+        generalize();
+    }
+
+    if (m_kind == ElementKind::DOUBLES) {
+        if (index == m_doubles.size()) {
+            m_doubles.push_back(value.toNumber());
+        } else {
+            m_doubles[index] = value.toNumber();
+        }
+        return;
+    }
     if (index >= m_elements.size()) {
         m_elements.resize(index + 1);
     }
     m_elements[index] = value;
-    
-    // Update length property
-    JSObject::set("length", JSValue(static_cast<double>(m_elements.size())));
 }
 
 void JSArray::push(const JSValue& value) {
-    m_elements.push_back(value);
-    
-    // Update length property
-    JSObject::set("length", JSValue(static_cast<double>(m_elements.size())));
-    
-    // Set indexed property
-    set(m_elements.size() - 1, value);
+    set(length(), value);
 }
 
 JSValue JSArray::pop() {
-    if (m_elements.empty()) {
+    if (length() == 0) {
         return JSValue(); // undefined
     }
     
-    JSValue last = m_elements.back();
-    m_elements.pop_back();
-    
-    // Update length property
-    JSObject::set("length", JSValue(static_cast<double>(m_elements.size())));
-    
+    JSValue last;
+    if (m_kind == ElementKind::SPARSE) {
+        --m_sparseLength;
+        auto it = m_sparse.find(m_sparseLength);
+        if (it != m_sparse.end()) {
+            last = std::move(it->second);
+            m_sparse.erase(it);
+        }
+    } else if (m_kind == ElementKind::DOUBLES) {
+        last = JSValue(m_doubles.back());
+        m_doubles.pop_back();
+    } else {
+        last = std::move(m_elements.back());
+        m_elements.pop_back();
+    }
     return last;
 }
 
 size_t JSArray::length() const {
-    return m_elements.size();
+    switch (m_kind) {
+        case ElementKind::DOUBLES: return m_doubles.size();
+        case ElementKind::SPARSE: return m_sparseLength;
+        default: return m_elements.size();
+    }
+}
+
+void JSArray::setLength(size_t length) {
+    if (m_kind == ElementKind::SPARSE || sparsifyFor(length)) {
+        // Only the length is kept; shrinking drops the elements past it
+        m_sparse.erase(m_sparse.lower_bound(length), m_sparse.end());
+        m_sparseLength = length;
+        return;
+    }
+    if (length > this->length()) {
+        // Growing leaves holes
+        generalize();
+    }
+    if (m_kind == ElementKind::DOUBLES) {
+        m_doubles.resize(length);
+    } else {
+        m_elements.resize(length);
+    }
+}
+
+JSValue JSArray::getProperty(const std::string& key) const {
+    size_t index;
+    if (toIndex(key, index)) {
+        return get(index);
+    }
+    if (key == "length") {
+        return JSValue(static_cast<double>(length()));
+    }
+    return JSObject::get(key);
+}
+
+void JSArray::setProperty(const std::string& key, const JSValue& value) {
+    size_t index;
+    if (toIndex(key, index)) {
+        set(index, value);
+        return;
+    }
+    if (key == "length") {
+        double number = value.toNumber();
+        if (number >= 0 && number <= maxArrayLength && number == std::floor(number)) {
+            setLength(static_cast<size_t>(number));
+        }
+        return;
+    }
+    JSObject::set(key, value);
+}
+
+bool JSArray::toIndex(const JSValue& key, size_t& index) {
+    if (key.isNumber()) {
+        double number = key.toNumber();
+        if (number >= 0 && number < maxArrayLength && number == std::floor(number)) {
+            index = static_cast<size_t>(number);
+            return true;
+        }
+        return false;
+    }
+    return key.isString() && toIndex(key.toString(), index);
+}
+
+bool JSArray::toIndex(const std::string& key, size_t& index) {
+    // Canonical form only: "01" and "1.0" name properties, not elements
+    if (key.empty() || key.size() > 10 || (key[0] == '0' && key.size() > 1)) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (char c : key) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    if (value >= static_cast<uint64_t>(maxArrayLength)) {
+        return false;
+    }
+    index = static_cast<size_t>(value);
+    return true;
+}
+
+void JSArray::generalize() {
+    if (m_kind == ElementKind::SPARSE) {
+        return;
+    }
+    if (m_kind == ElementKind::DOUBLES) {
+        m_elements.reserve(m_doubles.size());
+        for (double value : m_doubles) {
+            m_elements.push_back(JSValue(value));
+        }
+        std::vector<double>().swap(m_doubles);
+    }
+    m_kind = ElementKind::GENERIC;
+}
+
+bool JSArray::sparsifyFor(size_t length) {
+    size_t size = this->length();
+    if (length <= size * 2 + 1024) {
+        return false;
+    }
+    
+    generalize();
+    for (size_t i = 0; i < m_elements.size(); ++i) {
+        if (!m_elements[i].isUndefined()) {
+            m_sparse.emplace(i, std::move(m_elements[i]));
+        }
+    }
+    std::vector<JSValue>().swap(m_elements);
+    m_sparseLength = size;
+    m_kind = ElementKind::SPARSE;
+    return true;
+}
+
+void JSArray::visitReferences(ReferenceVisitor& visitor) const {
+    JSObject::visitReferences(visitor);
+    // Doubles refer to nothing
+    for (const JSValue& value : m_elements) {
+        if (JSObject* object = value.asObject()) {
+            visitor.visit(object);
+        }
+    }
+    for (const auto& entry : m_sparse) {
+        if (JSObject* object = entry.second.asObject()) {
+            visitor.visit(object);
+        }
+    }
+}
+
+void JSArray::clearReferences() {
+    JSObject::clearReferences();
+    std::vector<JSValue> elements;
+    elements.swap(m_elements);
+    std::map<size_t, JSValue> sparse;
+    sparse.swap(m_sparse);
+    std::vector<double>().swap(m_doubles);
+    m_sparseLength = 0;
+    m_kind = ElementKind::DOUBLES;
 }
 
 } // namespace custom_js
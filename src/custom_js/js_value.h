@@ -2,12 +2,14 @@
 #ifndef CUSTOM_JS_VALUE_H
 #define CUSTOM_JS_VALUE_H
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
+#include <unordered_map>
 #include <functional>
-#include <variant>
 
 namespace browser {
 namespace custom_js {
@@ -29,7 +31,12 @@ enum class JSValueType {
     ARRAY
 };
 
-// JavaScript value class
+// JavaScript value class. A value is 8 bytes, NaN-boxed: a number is
+// stored as its double, and every other type in the payload of a NaN that
+// arithmetic never produces. Strings are immutable ref-counted cells and
+// objects are counted through JSObject, so copying a value never
+// allocates and numbers never touch the heap. The counts aren't atomic;
+// values stay on their engine's thread.
 class JSValue {
 public:
     // Constructors for different JS types
@@ -39,11 +46,18 @@ public:
     JSValue(int value);  // number
     JSValue(double value);  // number
     JSValue(const std::string& value);  // string
+    JSValue(std::string&& value);  // string
     JSValue(const char* value);  // string
     JSValue(std::shared_ptr<JSObject> obj);  // object
     JSValue(std::shared_ptr<JSFunction> func);  // function
     JSValue(std::shared_ptr<JSArray> array);  // array
 
+    JSValue(const JSValue& other);
+    JSValue(JSValue&& other) noexcept;
+    JSValue& operator=(const JSValue& other);
+    JSValue& operator=(JSValue&& other) noexcept;
+    ~JSValue();
+
     // Type checking
     JSValueType type() const;
     bool isUndefined() const;
@@ -63,50 +77,215 @@ public:
     std::shared_ptr<JSFunction> toFunction() const;
     std::shared_ptr<JSArray> toArray() const;
 
+    // The object, function or array, borrowed for as long as the value
+    // holds it; null for other types
+    JSObject* asObject() const;
+    JSFunction* asFunction() const;
+    JSArray* asArray() const;
+
     // Operators
     bool operator==(const JSValue& other) const;
     bool operator!=(const JSValue& other) const;
     
 private:
-    // We use std::variant to store different possible types
-    using ValueVariant = std::variant<
-        std::nullptr_t,          // null
-        bool,                    // boolean
-        double,                  // number
-        std::string,             // string
-        std::shared_ptr<JSObject>,  // object
-        std::shared_ptr<JSFunction>, // function
-        std::shared_ptr<JSArray>    // array
-    >;
-    
-    ValueVariant m_value;
-    JSValueType m_type;
+    // Non-number types are tagged in the top 16 bits, above any NaN
+    // arithmetic produces; tags 4 and up point at heap cells
+    static constexpr int tagShift = 48;
+    static constexpr uint64_t payloadMask = (1ull << tagShift) - 1;
+    static constexpr uint64_t tagMask = ~payloadMask;
+    static constexpr uint64_t boxed = 0xFFF8000000000000ull;
+    static constexpr uint64_t undefinedBits = boxed | (1ull << tagShift);
+    static constexpr uint64_t nullBits = boxed | (2ull << tagShift);
+    static constexpr uint64_t booleanBits = boxed | (3ull << tagShift);
+    static constexpr uint64_t stringBits = boxed | (4ull << tagShift);
+    static constexpr uint64_t objectBits = boxed | (5ull << tagShift);
+    static constexpr uint64_t functionBits = boxed | (6ull << tagShift);
+    static constexpr uint64_t arrayBits = boxed | (7ull << tagShift);
+    static constexpr uint64_t canonicalNaN = 0x7FF8000000000000ull;
+
+    struct StringCell {
+        uint32_t refs;
+        std::string value;
+    };
+
+    static bool isCell(uint64_t bits) { return bits >= stringBits && (bits & payloadMask) != 0; }
+    static void retainCell(uint64_t bits);
+    static void releaseCell(uint64_t bits);
+
+    void* pointer() const { return reinterpret_cast<void*>(static_cast<uintptr_t>(m_bits & payloadMask)); }
+    const StringCell& stringCell() const { return *static_cast<const StringCell*>(pointer()); }
+    void setCell(uint64_t tagBits, const void* cell);
+    void setObject(uint64_t tagBits, JSObject* object, std::shared_ptr<JSObject> owner);
+
+    bool toBooleanSlow() const;
+    double toNumberSlow() const;
+
+    uint64_t m_bits;
+};
+
+// A hidden class: the names of an object's own properties and the slot
+// each one's value is stored in. Objects that gain the same properties in
+// the same order share a shape, so comparing shapes tells where a property
+// is without looking its name up.
+//
+// Each thread's JSHeap roots a tree of shapes of its own. A shape keeps the
+// one it was made from alive, but not those made from it, so shapes no
+// object or inline cache uses are freed along with their transitions.
+class Shape : public std::enable_shared_from_this<Shape> {
+public:
+    // Objects with more properties than this, or that have one removed, get
+    // a dictionary shape of their own that changes in place
+    static constexpr size_t maxSharedProperties = 64;
+
+    Shape();
+    ~Shape();
+
+    // The current thread's shape of objects with no properties
+    static std::shared_ptr<Shape> empty();
+
+    // The property's slot, or -1
+    int find(const std::string& key) const;
+
+    // The shared shape with key added in the next slot
+    std::shared_ptr<Shape> withProperty(const std::string& key);
+
+    // An unshared copy, and the changes only a dictionary allows
+    std::shared_ptr<Shape> toDictionary() const;
+    void addKey(const std::string& key);
+    void removeSlot(uint32_t slot);
+
+    bool isDictionary() const { return m_dictionary; }
+    size_t size() const { return m_keys.size(); }
+    const std::vector<std::string>& keys() const { return m_keys; }
+
+private:
+    std::vector<std::string> m_keys;    // By slot
+    std::unordered_map<std::string, uint32_t> m_slots;
+    // While in use, so objects built the same way find the same shapes
+    std::unordered_map<std::string, std::weak_ptr<Shape>> m_transitions;
+    std::shared_ptr<Shape> m_parent;    // Made from it by adding m_keys.back()
+    bool m_dictionary;
 };
 
-// JavaScript object class
-class JSObject {
+// An inline cache for one property access site: the slot the property is
+// in for each shape seen there, up to maxEntries. Past that the site is
+// megamorphic and looks properties up by name.
+class PropertyCache {
+public:
+    static constexpr size_t maxEntries = 4;
+
+    size_t size() const { return m_count; }
+
+private:
+    friend class JSObject;
+
+    struct Entry {
+        std::shared_ptr<Shape> shape;       // Held so its address isn't reused
+        std::shared_ptr<Shape> transition;  // For stores that add the property
+        uint32_t slot;
+    };
+
+    void add(std::shared_ptr<Shape> shape, std::shared_ptr<Shape> transition, uint32_t slot);
+
+    Entry m_entries[maxEntries];
+    uint8_t m_count = 0;
+};
+
+class JSHeap;
+
+// JavaScript object class. Objects are owned through shared_ptr and
+// tracked by the current thread's JSHeap, which frees unreachable cycles.
+class JSObject : public std::enable_shared_from_this<JSObject> {
 public:
     JSObject();
     virtual ~JSObject();
 
+    JSObject(const JSObject&) = delete;
+    JSObject& operator=(const JSObject&) = delete;
+
     // Property access
     JSValue get(const std::string& key) const;
     void set(const std::string& key, const JSValue& value);
     bool has(const std::string& key) const;
     bool remove(const std::string& key);
+
+    // Property access through an access site's inline cache
+    JSValue get(const std::string& key, PropertyCache& cache) const;
+    void set(const std::string& key, const JSValue& value, PropertyCache& cache);
+
+    const std::shared_ptr<Shape>& shape() const { return m_shape; }
     
-    // Get all property names
+    // Get all property names, own ones in the order they were added
     std::vector<std::string> getPropertyNames() const;
 
     // Prototype chain
     void setPrototype(std::shared_ptr<JSObject> prototype);
     std::shared_ptr<JSObject> getPrototype() const;
 
+    // The objects this one refers to, for the collector; a reference the
+    // collector isn't shown keeps its target alive
+    class ReferenceVisitor {
+    public:
+        virtual ~ReferenceVisitor() = default;
+        virtual void visit(JSObject* object) = 0;
+    };
+    virtual void visitReferences(ReferenceVisitor& visitor) const;
+
+    // Drop the references visitReferences shows, to break a dead cycle
+    virtual void clearReferences();
+
 protected:
-    std::map<std::string, JSValue> m_properties;
+    std::shared_ptr<Shape> m_shape;
+    std::vector<JSValue> m_slots;       // Property values by shape slot
     std::shared_ptr<JSObject> m_prototype;
+
+private:
+    friend class JSValue;
+    friend class JSHeap;
+
+    // Values referring to the object; while there are any, m_self keeps
+    // it alive
+    uint32_t m_valueRefs = 0;
+    std::shared_ptr<JSObject> m_self;
+
+    // Tracking by the heap, and a collection's scratch state
+    JSHeap* m_heap;
+    JSObject* m_heapPrevious;
+    JSObject* m_heapNext;
+    long m_gcRefs;
+    bool m_gcMarked;
+
+    void addProperty(const std::string& key, const JSValue& value);
+    JSValue getUncached(const std::string& key, PropertyCache& cache) const;
+    void setUncached(const std::string& key, const JSValue& value, PropertyCache& cache);
 };
 
+inline JSValue JSObject::get(const std::string& key, PropertyCache& cache) const {
+    for (uint8_t i = 0; i < cache.m_count; ++i) {
+        const PropertyCache::Entry& entry = cache.m_entries[i];
+        if (entry.shape == m_shape && !entry.transition) {
+            return m_slots[entry.slot];
+        }
+    }
+    return getUncached(key, cache);
+}
+
+inline void JSObject::set(const std::string& key, const JSValue& value, PropertyCache& cache) {
+    for (uint8_t i = 0; i < cache.m_count; ++i) {
+        const PropertyCache::Entry& entry = cache.m_entries[i];
+        if (entry.shape == m_shape) {
+            if (entry.transition) {
+                m_shape = entry.transition;
+                m_slots.push_back(value);
+            } else {
+                m_slots[entry.slot] = value;
+            }
+            return;
+        }
+    }
+    setUncached(key, value, cache);
+}
+
 // JavaScript function
 class JSFunction : public JSObject {
 public:
@@ -122,9 +301,19 @@ private:
     NativeFunction m_function;
 };
 
-// JavaScript array
+// JavaScript array. Elements are kept apart from named properties, in the
+// most compact form that holds them all: unboxed doubles, objects, or any
+// values. Storing one the current kind can't hold, or leaving a hole, moves
+// the array to a more general kind for good.
 class JSArray : public JSObject {
 public:
+    enum class ElementKind {
+        DOUBLES,    // Numbers only
+        OBJECTS,    // Objects, functions and arrays only
+        GENERIC,    // Anything; holes read as undefined
+        SPARSE      // By index in a map, for an index or length far past the end
+    };
+
     JSArray();
     JSArray(const std::vector<JSValue>& elements);
     virtual ~JSArray();
@@ -135,11 +324,180 @@ public:
     void push(const JSValue& value);
     JSValue pop();
     size_t length() const;
+    void setLength(size_t length);
+    ElementKind elementKind() const { return m_kind; }
+
+    // Property access by name: "length", an index, or a named property
+    JSValue getProperty(const std::string& key) const;
+    void setProperty(const std::string& key, const JSValue& value);
+
+    // Whether key is a whole number or canonical numeric string naming an
+    // element, so indexing can skip the string-keyed path
+    static bool toIndex(const JSValue& key, size_t& index);
+    static bool toIndex(const std::string& key, size_t& index);
+
+    void visitReferences(ReferenceVisitor& visitor) const override;
+    void clearReferences() override;
     
 private:
-    std::vector<JSValue> m_elements;
+    // Move to GENERIC, keeping the elements
+    void generalize();
+
+    // Move to SPARSE, keeping the elements, if growing to length would
+    // leave mostly holes; a store to a[4e9] mustn't allocate 4e9 slots
+    bool sparsifyFor(size_t length);
+
+    ElementKind m_kind;
+    std::vector<double> m_doubles;      // DOUBLES
+    std::vector<JSValue> m_elements;    // OBJECTS and GENERIC
+    std::map<size_t, JSValue> m_sparse; // SPARSE
+    size_t m_sparseLength;              // SPARSE
 };
 
+//-----------------------------------------------------------------------------
+// JSValue inline members, for arithmetic and copying
+//-----------------------------------------------------------------------------
+
+inline JSValue::JSValue() : m_bits(undefinedBits) {
+}
+
+inline JSValue::JSValue(std::nullptr_t) : m_bits(nullBits) {
+}
+
+inline JSValue::JSValue(bool value) : m_bits(booleanBits | (value ? 1 : 0)) {
+}
+
+inline JSValue::JSValue(int value) : JSValue(static_cast<double>(value)) {
+}
+
+inline JSValue::JSValue(double value) {
+    if (value != value) {
+        m_bits = canonicalNaN;
+    } else {
+        std::memcpy(&m_bits, &value, sizeof(value));
+    }
+}
+
+inline JSValue::JSValue(const JSValue& other) : m_bits(other.m_bits) {
+    if (isCell(m_bits)) {
+        retainCell(m_bits);
+    }
+}
+
+inline JSValue::JSValue(JSValue&& other) noexcept : m_bits(other.m_bits) {
+    other.m_bits = undefinedBits;
+}
+
+inline JSValue& JSValue::operator=(const JSValue& other) {
+    // Releasing the old value can free the object other lives in
+    uint64_t bits = other.m_bits;
+    if (isCell(bits)) {
+        retainCell(bits);
+    }
+    uint64_t old = m_bits;
+    m_bits = bits;
+    if (isCell(old)) {
+        releaseCell(old);
+    }
+    return *this;
+}
+
+inline JSValue& JSValue::operator=(JSValue&& other) noexcept {
+    if (this != &other) {
+        uint64_t old = m_bits;
+        m_bits = other.m_bits;
+        other.m_bits = undefinedBits;
+        if (isCell(old)) {
+            releaseCell(old);
+        }
+    }
+    return *this;
+}
+
+inline JSValue::~JSValue() {
+    if (isCell(m_bits)) {
+        releaseCell(m_bits);
+    }
+}
+
+inline void JSValue::retainCell(uint64_t bits) {
+    void* cell = reinterpret_cast<void*>(static_cast<uintptr_t>(bits & payloadMask));
+    if ((bits & tagMask) == stringBits) {
+        ++static_cast<StringCell*>(cell)->refs;
+    } else {
+        ++static_cast<JSObject*>(cell)->m_valueRefs;
+    }
+}
+
+inline JSValueType JSValue::type() const {
+    if (isNumber()) {
+        return JSValueType::NUMBER;
+    }
+    // Tags 1 .. 3 are UNDEFINED .. BOOLEAN; 4 .. 7 match their types
+    int tag = static_cast<int>((m_bits >> tagShift) & 7);
+    return static_cast<JSValueType>(tag <= 3 ? tag - 1 : tag);
+}
+
+inline bool JSValue::isUndefined() const {
+    return m_bits == undefinedBits;
+}
+
+inline bool JSValue::isNull() const {
+    return m_bits == nullBits;
+}
+
+inline bool JSValue::isBoolean() const {
+    return (m_bits & tagMask) == booleanBits;
+}
+
+inline bool JSValue::isNumber() const {
+    return m_bits < undefinedBits;
+}
+
+inline bool JSValue::isString() const {
+    return (m_bits & tagMask) == stringBits;
+}
+
+inline bool JSValue::isObject() const {
+    return (m_bits & tagMask) == objectBits;
+}
+
+inline bool JSValue::isFunction() const {
+    return (m_bits & tagMask) == functionBits;
+}
+
+inline bool JSValue::isArray() const {
+    return (m_bits & tagMask) == arrayBits;
+}
+
+inline bool JSValue::toBoolean() const {
+    if (isBoolean()) {
+        return (m_bits & 1) != 0;
+    }
+    return toBooleanSlow();
+}
+
+inline double JSValue::toNumber() const {
+    if (isNumber()) {
+        double value;
+        std::memcpy(&value, &m_bits, sizeof(value));
+        return value;
+    }
+    return toNumberSlow();
+}
+
+inline JSObject* JSValue::asObject() const {
+    return m_bits >= objectBits ? static_cast<JSObject*>(pointer()) : nullptr;
+}
+
+inline JSFunction* JSValue::asFunction() const {
+    return isFunction() ? static_cast<JSFunction*>(static_cast<JSObject*>(pointer())) : nullptr;
+}
+
+inline JSArray* JSValue::asArray() const {
+    return isArray() ? static_cast<JSArray*>(static_cast<JSObject*>(pointer())) : nullptr;
+}
+
 } // namespace custom_js
 } // namespace browser
 
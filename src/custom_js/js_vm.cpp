@@ -0,0 +1,537 @@
+#include "js_vm.h"
+#include <cmath>
+#include <iostream>
+
+// Threaded dispatch: each handler jumps straight to the next one's label
+#if defined(__GNUC__) || defined(__clang__)
+#define JS_VM_COMPUTED_GOTO 1
+#endif
+
+namespace browser {
+namespace custom_js {
+
+namespace {
+
+// As JSInterpreter::isEqual
+bool looselyEqual(const JSValue& a, const JSValue& b) {
+    if ((a.isNumber() && b.isString()) || (a.isString() && b.isNumber())) {
+        return a.toNumber() == b.toNumber();
+    }
+    return a == b;
+}
+
+RuntimeError undefinedVariable(const std::string& name) {
+    return RuntimeError("Undefined variable '" + name + "'.");
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// BytecodeFunction Implementation
+//-----------------------------------------------------------------------------
+
+BytecodeFunction::BytecodeFunction(JSVirtualMachine* vm, std::shared_ptr<const FunctionProto> proto)
+    : JSFunction([vm, proto](const std::vector<JSValue>& args, JSValue) { return vm->call(*proto, args); })
+    , m_vm(vm)
+    , m_proto(std::move(proto))
+{
+}
+
+//-----------------------------------------------------------------------------
+// JSVirtualMachine Implementation
+//-----------------------------------------------------------------------------
+
+JSVirtualMachine::JSVirtualMachine(std::shared_ptr<Environment> globals)
+    : m_globals(std::move(globals))
+{
+}
+
+JSVirtualMachine::~JSVirtualMachine() {
+}
+
+JSValue JSVirtualMachine::execute(const std::string& source) {
+    JSParser parser;
+    std::shared_ptr<Program> program = parser.parse(source);
+    if (!program) return JSValue();
+    return execute(*program);
+}
+
+JSValue JSVirtualMachine::execute(Program& program) {
+    std::shared_ptr<const FunctionProto> script;
+    try {
+        // Everything is compiled up front, so lazily parsed bodies are too
+        JSParser::parseBodies(program);
+        script = BytecodeCompiler().compile(program);
+    } catch (const ParseError& error) {
+        std::cerr << "Runtime error: Syntax error: " << error.what() << std::endl;
+        return JSValue();
+    } catch (const RuntimeError& error) {
+        std::cerr << "Runtime error: " << error.what() << std::endl;
+        return JSValue();
+    }
+    return execute(script);
+}
+
+JSValue JSVirtualMachine::execute(std::shared_ptr<const FunctionProto> script) {
+    size_t depth = m_frames.size();
+    size_t base = depth > 0 ? m_frames.back().base + m_frames.back().proto->registerCount : 0;
+
+    JSValue result;
+    try {
+        pushFrame(*script, base, 0, 0, true);
+        result = runGuarded(depth);
+    } catch (const RuntimeError& error) {
+        std::cerr << "Runtime error: " << error.what() << std::endl;
+        result = JSValue();
+    }
+
+    if (depth == 0) {
+        // Let go of what the script left in registers
+        std::fill(m_registers.begin(), m_registers.end(), JSValue());
+    }
+    return result;
+}
+
+JSValue JSVirtualMachine::call(const FunctionProto& proto, const std::vector<JSValue>& args) {
+    size_t depth = m_frames.size();
+    size_t base = depth > 0 ? m_frames.back().base + m_frames.back().proto->registerCount : 0;
+    size_t argc = std::min<size_t>(args.size(), proto.parameterCount);
+
+    pushFrame(proto, base, argc, 0, true);
+    std::copy(args.begin(), args.begin() + argc, m_registers.begin() + base);
+    return runGuarded(depth);
+}
+
+void JSVirtualMachine::pushFrame(const FunctionProto& proto, size_t base, size_t argc,
+                                 uint16_t returnRegister, bool entry) {
+    if (m_frames.size() >= maxCallDepth) {
+        throw RuntimeError("Maximum call stack size exceeded.");
+    }
+
+    size_t needed = base + proto.registerCount;
+    if (m_registers.size() < needed) {
+        m_registers.resize(std::max(needed, m_registers.size() * 2));
+    }
+    // Missing arguments are undefined
+    for (size_t i = argc; i < proto.parameterCount; ++i) {
+        m_registers[base + i] = JSValue();
+    }
+    m_frames.push_back(Frame{&proto, base, proto.code.data(), returnRegister, entry});
+}
+
+JSValue JSVirtualMachine::runGuarded(size_t depth) {
+    try {
+        return run();
+    } catch (...) {
+        m_frames.erase(m_frames.begin() + depth, m_frames.end());
+        throw;
+    }
+}
+
+JSValue* JSVirtualMachine::globalSlot(const FunctionProto& proto, uint32_t name) {
+    JSValue* slot = m_globals->find(proto.names[name]);
+    if (!slot) {
+        throw undefinedVariable(proto.names[name]);
+    }
+    proto.globalSlots[name] = slot;
+    return slot;
+}
+
+JSValue* JSVirtualMachine::dynamicSlot(const FunctionProto& proto, uint32_t name) {
+    // The innermost variable of the name live in any frame, as the
+    // interpreter's environment chain runs from callee to caller
+    const std::string& wanted = proto.names[name];
+    for (auto frame = m_frames.rbegin(); frame != m_frames.rend(); ++frame) {
+        const FunctionProto& frameProto = *frame->proto;
+        uint32_t pc = static_cast<uint32_t>(frame->ip - frameProto.code.data());
+        for (auto local = frameProto.locals.rbegin(); local != frameProto.locals.rend(); ++local) {
+            if (local->startPc <= pc && pc < local->endPc && frameProto.names[local->name] == wanted) {
+                return &m_registers[frame->base + local->reg];
+            }
+        }
+    }
+    if (JSValue* slot = m_globals->find(wanted)) {
+        return slot;
+    }
+    throw undefinedVariable(wanted);
+}
+
+JSValue JSVirtualMachine::run() {
+    Frame* frame = &m_frames.back();
+    const Instruction* code = frame->proto->code.data();
+    const JSValue* constants = frame->proto->constants.data();
+    JSValue* regs = m_registers.data() + frame->base;
+    const Instruction* ip = code;
+
+    // After frames are pushed or popped, or registers may have moved
+#define JS_LOAD_FRAME()                                 \
+    do {                                                \
+        frame = &m_frames.back();                       \
+        code = frame->proto->code.data();               \
+        constants = frame->proto->constants.data();     \
+        regs = m_registers.data() + frame->base;        \
+    } while (0)
+
+#ifdef JS_VM_COMPUTED_GOTO
+    // Labels as values are a GNU extension, used knowingly; the pragma is
+    // popped after the handlers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    static const void* const dispatchTable[] = {
+#define JS_OPCODE_LABEL(name) &&op_##name,
+        JS_OPCODES(JS_OPCODE_LABEL)
+#undef JS_OPCODE_LABEL
+    };
+#define DISPATCH() goto *dispatchTable[static_cast<size_t>(ip->op)]
+#define CASE(name) op_##name:
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case OpCode::name:
+#endif
+#define NEXT()     \
+    do {           \
+        ++ip;      \
+        DISPATCH(); \
+    } while (0)
+
+#ifdef JS_VM_COMPUTED_GOTO
+    DISPATCH();
+    {
+#else
+dispatch:
+    switch (ip->op) {
+#endif
+        CASE(LOAD_CONST) {
+            regs[ip->a] = constants[ip->b];
+        } NEXT();
+
+        CASE(LOAD_UNDEFINED) {
+            regs[ip->a] = JSValue();
+        } NEXT();
+
+        CASE(MOVE) {
+            regs[ip->a] = regs[ip->b];
+        } NEXT();
+
+        CASE(GET_GLOBAL) {
+            JSValue* slot = frame->proto->globalSlots[ip->b];
+            if (!slot) {
+                slot = globalSlot(*frame->proto, ip->b);
+            }
+            regs[ip->a] = *slot;
+        } NEXT();
+
+        CASE(SET_GLOBAL) {
+            JSValue* slot = frame->proto->globalSlots[ip->b];
+            if (!slot) {
+                slot = globalSlot(*frame->proto, ip->b);
+            }
+            *slot = regs[ip->a];
+        } NEXT();
+
+        CASE(DEFINE_GLOBAL) {
+            const std::string& name = frame->proto->names[ip->b];
+            m_globals->define(name, regs[ip->a]);
+            frame->proto->globalSlots[ip->b] = m_globals->find(name);
+        } NEXT();
+
+        CASE(GET_NAME) {
+            frame->ip = ip;
+            regs[ip->a] = *dynamicSlot(*frame->proto, ip->b);
+        } NEXT();
+
+        CASE(SET_NAME) {
+            frame->ip = ip;
+            *dynamicSlot(*frame->proto, ip->b) = regs[ip->a];
+        } NEXT();
+
+        CASE(ADD) {
+            const JSValue& left = regs[ip->b];
+            const JSValue& right = regs[ip->c];
+            if (left.isNumber() && right.isNumber()) {
+                regs[ip->a] = JSValue(left.toNumber() + right.toNumber());
+            } else if (left.isString() || right.isString()) {
+                regs[ip->a] = JSValue(left.toString() + right.toString());
+            } else {
+                regs[ip->a] = JSValue(left.toNumber() + right.toNumber());
+            }
+        } NEXT();
+
+        CASE(SUBTRACT) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() - regs[ip->c].toNumber());
+        } NEXT();
+
+        CASE(MULTIPLY) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() * regs[ip->c].toNumber());
+        } NEXT();
+
+        CASE(DIVIDE) {
+            double divisor = regs[ip->c].toNumber();
+            if (divisor == 0.0) {
+                throw RuntimeError("Division by zero.");
+            }
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() / divisor);
+        } NEXT();
+
+        CASE(MODULO) {
+            double divisor = regs[ip->c].toNumber();
+            if (divisor == 0.0) {
+                throw RuntimeError("Modulo by zero.");
+            }
+            regs[ip->a] = JSValue(std::fmod(regs[ip->b].toNumber(), divisor));
+        } NEXT();
+
+        CASE(POWER) {
+            regs[ip->a] = JSValue(std::pow(regs[ip->b].toNumber(), regs[ip->c].toNumber()));
+        } NEXT();
+
+        CASE(EQUAL) {
+            regs[ip->a] = JSValue(looselyEqual(regs[ip->b], regs[ip->c]));
+        } NEXT();
+
+        CASE(NOT_EQUAL) {
+            regs[ip->a] = JSValue(!looselyEqual(regs[ip->b], regs[ip->c]));
+        } NEXT();
+
+        CASE(STRICT_EQUAL) {
+            regs[ip->a] = JSValue(regs[ip->b] == regs[ip->c]);
+        } NEXT();
+
+        CASE(STRICT_NOT_EQUAL) {
+            regs[ip->a] = JSValue(regs[ip->b] != regs[ip->c]);
+        } NEXT();
+
+        CASE(LESS) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() < regs[ip->c].toNumber());
+        } NEXT();
+
+        CASE(LESS_EQUAL) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() <= regs[ip->c].toNumber());
+        } NEXT();
+
+        CASE(GREATER) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() > regs[ip->c].toNumber());
+        } NEXT();
+
+        CASE(GREATER_EQUAL) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() >= regs[ip->c].toNumber());
+        } NEXT();
+
+        CASE(AND) {
+            regs[ip->a] = JSValue(regs[ip->b].toBoolean() && regs[ip->c].toBoolean());
+        } NEXT();
+
+        CASE(OR) {
+            regs[ip->a] = JSValue(regs[ip->b].toBoolean() || regs[ip->c].toBoolean());
+        } NEXT();
+
+        CASE(NEGATE) {
+            regs[ip->a] = JSValue(-regs[ip->b].toNumber());
+        } NEXT();
+
+        CASE(NOT) {
+            regs[ip->a] = JSValue(!regs[ip->b].toBoolean());
+        } NEXT();
+
+        CASE(INCREMENT) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() + 1.0);
+        } NEXT();
+
+        CASE(DECREMENT) {
+            regs[ip->a] = JSValue(regs[ip->b].toNumber() - 1.0);
+        } NEXT();
+
+        CASE(JUMP) {
+            ip = code + ip->b;
+        } DISPATCH();
+
+        CASE(JUMP_IF_FALSE) {
+            if (!regs[ip->a].toBoolean()) {
+                ip = code + ip->b;
+                DISPATCH();
+            }
+        } NEXT();
+
+        CASE(LESS_JUMP) {
+            if (!(regs[ip->a].toNumber() < regs[ip->b].toNumber())) {
+                ip = code + ip->c;
+                DISPATCH();
+            }
+        } NEXT();
+
+        CASE(CHECK_FUNCTION) {
+            if (!regs[ip->a].isFunction()) {
+                throw RuntimeError("Can only call functions.");
+            }
+        } NEXT();
+
+        CASE(CHECK_OBJECT) {
+            if (!regs[ip->a].isObject() && !regs[ip->a].isArray()) {
+                throw RuntimeError(constants[ip->b].toString());
+            }
+        } NEXT();
+
+        CASE(CALL) {
+            const JSValue& callee = regs[ip->b];
+            if (!callee.isFunction()) {
+                throw RuntimeError("Can only call functions.");
+            }
+            // The callee register keeps the function alive until it
+            // returns. Held raw, as dispatching from inside this block
+            // skips destructors.
+            JSFunction* function = callee.asFunction();
+            if (!function) {
+                throw RuntimeError("Invalid function call.");
+            }
+            frame->ip = ip;
+
+            // The arguments become the callee's first registers
+            auto* bytecode = dynamic_cast<BytecodeFunction*>(function);
+            if (bytecode && bytecode->vm() == this) {
+                pushFrame(bytecode->proto(), frame->base + ip->b + 1, ip->c, ip->a, false);
+                JS_LOAD_FRAME();
+                ip = code;
+                DISPATCH();
+            }
+
+            std::vector<JSValue> args(regs + ip->b + 1, regs + ip->b + 1 + ip->c);
+            JSValue result = function->call(args, JSValue());
+            JS_LOAD_FRAME();
+            regs[ip->a] = std::move(result);
+        } NEXT();
+
+        CASE(GET_MEMBER) {
+            const JSValue& object = regs[ip->b];
+            if (JSArray* array = object.asArray()) {
+                // Numeric indexes skip the string-keyed path
+                size_t index;
+                const JSValue& property = regs[ip->c];
+                regs[ip->a] = JSArray::toIndex(property, index) ? array->get(index)
+                                                               : array->getProperty(property.toString());
+                NEXT();
+            }
+            if (!object.isObject()) {
+                throw RuntimeError("Cannot access property of non-object.");
+            }
+            JSObject* obj = object.asObject();
+            if (!obj) {
+                throw RuntimeError("Invalid object for property access.");
+            }
+            regs[ip->a] = obj->get(regs[ip->c].toString());
+        } NEXT();
+
+        CASE(GET_MEMBER_CONST) {
+            const JSValue& object = regs[ip->b];
+            if (JSArray* array = object.asArray()) {
+                const FunctionProto::PropertySite& site = frame->proto->propertySites[ip->c];
+                regs[ip->a] = array->getProperty(frame->proto->names[site.name]);
+                NEXT();
+            }
+            if (!object.isObject()) {
+                throw RuntimeError("Cannot access property of non-object.");
+            }
+            JSObject* obj = object.asObject();
+            if (!obj) {
+                throw RuntimeError("Invalid object for property access.");
+            }
+            FunctionProto::PropertySite& site = frame->proto->propertySites[ip->c];
+            regs[ip->a] = obj->get(frame->proto->names[site.name], site.cache);
+        } NEXT();
+
+        CASE(SET_MEMBER) {
+            const JSValue& object = regs[ip->a];
+            if (JSArray* array = object.asArray()) {
+                size_t index;
+                const JSValue& property = regs[ip->b];
+                if (JSArray::toIndex(property, index)) {
+                    array->set(index, regs[ip->c]);
+                } else {
+                    array->setProperty(property.toString(), regs[ip->c]);
+                }
+                NEXT();
+            }
+            if (!object.isObject()) {
+                throw RuntimeError("Cannot set property on non-object.");
+            }
+            JSObject* obj = object.asObject();
+            if (!obj) {
+                throw RuntimeError("Invalid object for property assignment.");
+            }
+            obj->set(regs[ip->b].toString(), regs[ip->c]);
+        } NEXT();
+
+        CASE(SET_MEMBER_CONST) {
+            const JSValue& object = regs[ip->a];
+            if (JSArray* array = object.asArray()) {
+                const FunctionProto::PropertySite& site = frame->proto->propertySites[ip->b];
+                array->setProperty(frame->proto->names[site.name], regs[ip->c]);
+                NEXT();
+            }
+            if (!object.isObject()) {
+                throw RuntimeError("Cannot set property on non-object.");
+            }
+            JSObject* obj = object.asObject();
+            if (!obj) {
+                throw RuntimeError("Invalid object for property assignment.");
+            }
+            FunctionProto::PropertySite& site = frame->proto->propertySites[ip->b];
+            obj->set(frame->proto->names[site.name], regs[ip->c], site.cache);
+        } NEXT();
+
+        CASE(NEW_OBJECT) {
+            regs[ip->a] = JSValue(std::make_shared<JSObject>());
+        } NEXT();
+
+        CASE(NEW_ARRAY) {
+            std::vector<JSValue> elements(regs + ip->b, regs + ip->b + ip->c);
+            regs[ip->a] = JSValue(std::make_shared<JSArray>(elements));
+        } NEXT();
+
+        CASE(CLOSURE) {
+            std::shared_ptr<JSFunction> function =
+                std::make_shared<BytecodeFunction>(this, frame->proto->functions[ip->b]);
+            regs[ip->a] = JSValue(function);
+        } NEXT();
+
+        CASE(RETURN) {
+            JSValue result = std::move(regs[ip->a]);
+            if (frame->entry) {
+                m_frames.pop_back();
+                return result;
+            }
+            uint16_t target = frame->returnRegister;
+            m_frames.pop_back();
+            JS_LOAD_FRAME();
+            ip = frame->ip;
+            regs[target] = std::move(result);
+        } NEXT();
+
+        CASE(RETURN_UNDEFINED) {
+            if (frame->entry) {
+                m_frames.pop_back();
+                return JSValue();
+            }
+            uint16_t target = frame->returnRegister;
+            m_frames.pop_back();
+            JS_LOAD_FRAME();
+            ip = frame->ip;
+            regs[target] = JSValue();
+        } NEXT();
+
+        CASE(THROW) {
+            throw RuntimeError(constants[ip->b].toString());
+        }
+    }
+
+#ifdef JS_VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+#undef NEXT
+#undef CASE
+#undef DISPATCH
+#undef JS_LOAD_FRAME
+    return JSValue();
+}
+
+} // namespace custom_js
+} // namespace browser
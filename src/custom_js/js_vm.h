@@ -0,0 +1,86 @@
+// js_vm.h - Runs compiled JavaScript bytecode on a register machine
+#ifndef CUSTOM_JS_VM_H
+#define CUSTOM_JS_VM_H
+
+#include "js_bytecode.h"
+#include "js_interpreter.h"
+#include "js_value.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace browser {
+namespace custom_js {
+
+class JSVirtualMachine;
+
+// A function compiled to bytecode. Calls from bytecode run in the calling
+// loop; anyone else calls through JSFunction::call.
+class BytecodeFunction : public JSFunction {
+public:
+    BytecodeFunction(JSVirtualMachine* vm, std::shared_ptr<const FunctionProto> proto);
+
+    JSVirtualMachine* vm() const { return m_vm; }
+    const FunctionProto& proto() const { return *m_proto; }
+
+private:
+    JSVirtualMachine* m_vm;
+    std::shared_ptr<const FunctionProto> m_proto;
+};
+
+// Executes scripts compiled by BytecodeCompiler. Variables the scripts
+// declare at top level are globals in the given environment, which it
+// shares with the tree-walking interpreter, and runtime errors are
+// reported the same way.
+class JSVirtualMachine {
+public:
+    static constexpr size_t maxCallDepth = 10000;
+
+    explicit JSVirtualMachine(std::shared_ptr<Environment> globals);
+    ~JSVirtualMachine();
+
+    JSVirtualMachine(const JSVirtualMachine&) = delete;
+    JSVirtualMachine& operator=(const JSVirtualMachine&) = delete;
+
+    // Parse, compile and run a source string
+    JSValue execute(const std::string& source);
+
+    // Compile and run a parsed program, parsing any bodies it skipped
+    JSValue execute(Program& program);
+
+    // Run a compiled script
+    JSValue execute(std::shared_ptr<const FunctionProto> script);
+
+    // Call a compiled function
+    JSValue call(const FunctionProto& proto, const std::vector<JSValue>& args);
+
+private:
+    struct Frame {
+        const FunctionProto* proto;
+        size_t base;                // Of its registers in m_registers
+        const Instruction* ip;      // Saved while it calls out
+        uint16_t returnRegister;    // In the caller
+        bool entry;                 // Returns out of run()
+    };
+
+    // Push a frame whose first argc registers hold the arguments
+    void pushFrame(const FunctionProto& proto, size_t base, size_t argc, uint16_t returnRegister, bool entry);
+
+    // Run from the top frame until its entry frame returns
+    JSValue run();
+
+    // Run the top frame, popping frames down to depth if it throws
+    JSValue runGuarded(size_t depth);
+
+    JSValue* globalSlot(const FunctionProto& proto, uint32_t name);
+    JSValue* dynamicSlot(const FunctionProto& proto, uint32_t name);
+
+    std::shared_ptr<Environment> m_globals;
+    std::vector<JSValue> m_registers;
+    std::vector<Frame> m_frames;
+};
+
+} // namespace custom_js
+} // namespace browser
+
+#endif // CUSTOM_JS_VM_H
@@ -0,0 +1,770 @@
+#include "script_cache.h"
+#include "../tracing/trace.h"
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace browser {
+namespace custom_js {
+
+namespace {
+
+// "BJSC" read as a little-endian word; files written on a machine of the
+// other byte order fail this check
+constexpr uint32_t fileMagic = 0x43534a42;
+
+// Node tags; 0 stands for a missing child
+constexpr uint8_t nullNode = 0;
+
+} // namespace
+
+// Appends fixed-size words in host byte order, LEB128 integers, and
+// strings as indices into a table written ahead of the statements, since
+// names repeat throughout a script
+class ScriptCache::Writer {
+public:
+    void byte(uint8_t value) { m_body.push_back(value); }
+
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            m_body.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        m_body.push_back(static_cast<uint8_t>(value));
+    }
+
+    void string(const std::string& value) {
+        auto inserted = m_stringIndex.emplace(value, m_strings.size());
+        if (inserted.second) {
+            m_strings.push_back(&inserted.first->first);
+        }
+        varint(inserted.first->second);
+    }
+
+    // Header, the source the program was parsed from, then the string
+    // table and body, which the header's checksum covers
+    std::vector<uint8_t> finish(std::string_view source, uint64_t statementCount) {
+        std::vector<uint8_t> body;
+        body.swap(m_body);
+        varint(m_strings.size());
+        for (const std::string* value : m_strings) {
+            varint(value->size());
+            m_body.insert(m_body.end(), value->begin(), value->end());
+        }
+        varint(statementCount);
+        m_body.insert(m_body.end(), body.begin(), body.end());
+
+        std::vector<uint8_t> out;
+        appendWord(out, fileMagic);
+        appendWord(out, formatVersion);
+        appendWord(out, ScriptCache::contentHash(source));
+        appendWord(out, static_cast<uint64_t>(source.size()));
+        appendWord(out, ScriptCache::contentHash(
+            std::string_view(reinterpret_cast<const char*>(m_body.data()), m_body.size())));
+        out.insert(out.end(), source.begin(), source.end());
+        out.insert(out.end(), m_body.begin(), m_body.end());
+        return out;
+    }
+
+private:
+    template <typename T>
+    static void appendWord(std::vector<uint8_t>& out, T value) {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    std::vector<uint8_t> m_body;
+    std::unordered_map<std::string, uint64_t> m_stringIndex;
+    std::vector<const std::string*> m_strings;
+};
+
+// Reads what Writer wrote, failing on anything out of bounds
+class ScriptCache::Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : m_pos(data), m_end(data + size) {}
+
+    template <typename T>
+    bool word(T& value) {
+        if (static_cast<size_t>(m_end - m_pos) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+    }
+
+    bool byte(uint8_t& value) { return word(value); }
+
+    // A byte no greater than last, for enumerators
+    bool byte(uint8_t& value, uint8_t last) { return word(value) && value <= last; }
+
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (m_pos == m_end) {
+                return false;
+            }
+            uint8_t b = *m_pos++;
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A count of items that each take at least one byte
+    bool count(size_t& value) {
+        uint64_t raw;
+        if (!varint(raw) || raw > static_cast<uint64_t>(m_end - m_pos)) {
+            return false;
+        }
+        value = static_cast<size_t>(raw);
+        return true;
+    }
+
+    bool readStrings() {
+        size_t stringCount;
+        if (!count(stringCount)) {
+            return false;
+        }
+        m_strings.reserve(stringCount);
+        for (size_t i = 0; i < stringCount; ++i) {
+            uint64_t size;
+            if (!varint(size) || size > static_cast<uint64_t>(m_end - m_pos)) {
+                return false;
+            }
+            m_strings.emplace_back(reinterpret_cast<const char*>(m_pos), static_cast<size_t>(size));
+            m_pos += size;
+        }
+        return true;
+    }
+
+    bool string(std::string& value) {
+        uint64_t index;
+        if (!varint(index) || index >= m_strings.size()) {
+            return false;
+        }
+        value = m_strings[static_cast<size_t>(index)];
+        return true;
+    }
+
+    // The next size bytes, as they are
+    bool bytes(uint64_t size, std::string_view& value) {
+        if (size > static_cast<uint64_t>(m_end - m_pos)) {
+            return false;
+        }
+        value = std::string_view(reinterpret_cast<const char*>(m_pos), static_cast<size_t>(size));
+        m_pos += size;
+        return true;
+    }
+
+    bool atEnd() const { return m_pos == m_end; }
+
+    // What's left to read
+    std::string_view rest() const {
+        return std::string_view(reinterpret_cast<const char*>(m_pos), static_cast<size_t>(m_end - m_pos));
+    }
+
+private:
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+    std::vector<std::string> m_strings;
+};
+
+//-----------------------------------------------------------------------------
+// ScriptCache Implementation
+//-----------------------------------------------------------------------------
+
+ScriptCache::ScriptCache(size_t memoryCapacity)
+    : m_capacity(memoryCapacity > 0 ? memoryCapacity : 1)
+    , m_memoryHits(0)
+    , m_diskHits(0)
+    , m_misses(0)
+{
+}
+
+ScriptCache::~ScriptCache() {
+}
+
+bool ScriptCache::setDirectory(const std::string& directory) {
+    if (!directory.empty()) {
+        std::error_code error;
+        fs::create_directories(directory, error);
+        if (!fs::is_directory(directory, error)) {
+            std::cerr << "Failed to create script cache directory: " << directory << std::endl;
+            return false;
+        }
+    }
+    m_directory = directory;
+    return true;
+}
+
+std::shared_ptr<Program> ScriptCache::get(const std::string& source) {
+    uint64_t hash = contentHash(source);
+    if (std::shared_ptr<Program> program = findInMemory(hash, source)) {
+        return program;
+    }
+
+    std::string path = compiledPath(hash);
+    if (!path.empty()) {
+        TRACE_SCOPE("js", "ScriptCache::loadCompiled");
+        if (std::shared_ptr<Program> program = loadCompiled(path, source)) {
+            ++m_diskHits;
+            storeInMemory(hash, source, program);
+            return program;
+        }
+    }
+
+    ++m_misses;
+    JSParser parser;
+    parser.setLazyFunctions(true);
+    std::shared_ptr<Program> program = parser.parse(source);
+    if (!path.empty()) {
+        storeCompiled(path, serialize(*program, source));
+    }
+    storeInMemory(hash, source, program);
+    return program;
+}
+
+void ScriptCache::resetCounters() {
+    m_memoryHits = 0;
+    m_diskHits = 0;
+    m_misses = 0;
+}
+
+void ScriptCache::clear() {
+    m_index.clear();
+    m_entries.clear();
+}
+
+std::shared_ptr<Program> ScriptCache::findInMemory(uint64_t hash, const std::string& source) {
+    // The hash is easy to collide on purpose, so only the same text is a hit
+    auto it = m_index.find(hash);
+    if (it == m_index.end() || it->second->source != source) {
+        return nullptr;
+    }
+    ++m_memoryHits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->program;
+}
+
+void ScriptCache::storeInMemory(uint64_t hash, const std::string& source, std::shared_ptr<Program> program) {
+    auto it = m_index.find(hash);
+    if (it != m_index.end()) {
+        // Another script with the same hash
+        it->second->source = source;
+        it->second->program = std::move(program);
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+
+    if (m_entries.size() >= m_capacity) {
+        m_index.erase(m_entries.back().hash);
+        m_entries.pop_back();
+    }
+    m_entries.push_front({hash, source, std::move(program)});
+    m_index.emplace(hash, m_entries.begin());
+}
+
+std::string ScriptCache::compiledPath(uint64_t hash) const {
+    if (m_directory.empty()) {
+        return "";
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.jsc", static_cast<unsigned long long>(hash));
+    return m_directory + "/" + name;
+}
+
+std::shared_ptr<Program> ScriptCache::loadCompiled(const std::string& path, std::string_view source) const {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return deserialize(data.data(), data.size(), source);
+}
+
+bool ScriptCache::storeCompiled(const std::string& path, const std::vector<uint8_t>& data) const {
+    // Write under a name of our own and rename, so readers never see a
+    // partly written file
+    static std::atomic<unsigned> nextTemporary{0};
+    std::string temporary = path + "." +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+        std::to_string(nextTemporary++) + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+uint64_t ScriptCache::contentHash(std::string_view source) {
+    // FNV-1a; picks the entry and file, but a hit still compares the source
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : source) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::vector<uint8_t> ScriptCache::serialize(const Program& program, std::string_view source) {
+    Writer writer;
+    for (const auto& statement : program.statements) {
+        writeStatement(writer, statement.get());
+    }
+    return writer.finish(source, program.statements.size());
+}
+
+std::shared_ptr<Program> ScriptCache::deserialize(const uint8_t* data, size_t size, std::string_view source) {
+    Reader reader(data, size);
+    uint32_t magic, version;
+    uint64_t fileHash, fileLength, checksum;
+    std::string_view fileSource;
+    if (!reader.word(magic) || magic != fileMagic || !reader.word(version) || version != formatVersion ||
+        !reader.word(fileHash) || !reader.word(fileLength) || fileLength != source.size() ||
+        !reader.word(checksum)) {
+        return nullptr;
+    }
+
+    // A script crafted to share another's hash must not get its program
+    if (!reader.bytes(fileLength, fileSource) || fileSource != source ||
+        fileHash != contentHash(source)) {
+        return nullptr;
+    }
+
+    // A damaged file could otherwise decode as some other program, and run
+    if (checksum != contentHash(reader.rest())) {
+        return nullptr;
+    }
+    if (!reader.readStrings()) {
+        return nullptr;
+    }
+
+    size_t statementCount;
+    if (!reader.count(statementCount)) {
+        return nullptr;
+    }
+    std::vector<std::shared_ptr<StatementNode>> statements(statementCount);
+    for (auto& statement : statements) {
+        if (!readStatement(reader, statement) || !statement) {
+            return nullptr;
+        }
+    }
+
+    if (!reader.atEnd()) {
+        return nullptr;
+    }
+    // Variable slots aren't stored; the interpreter resolves each program
+    // before running it, and each lazily parsed function once it's parsed
+    return std::make_shared<Program>(std::move(statements));
+}
+
+// Each node is its type plus one, then its fields and children in the
+// order the constructors take them
+
+void ScriptCache::writeExpression(Writer& writer, const ExpressionNode* expression) {
+    if (!expression) {
+        writer.byte(nullNode);
+        return;
+    }
+    writer.byte(static_cast<uint8_t>(expression->getType()) + 1);
+
+    switch (expression->getType()) {
+        case ExpressionType::LITERAL: {
+            auto& literal = static_cast<const LiteralExpr&>(*expression);
+            writer.byte(static_cast<uint8_t>(literal.literalType));
+            writer.string(literal.value);
+            break;
+        }
+        case ExpressionType::VARIABLE:
+            writer.string(static_cast<const VariableExpr&>(*expression).name);
+            break;
+        case ExpressionType::UNARY: {
+            auto& unary = static_cast<const UnaryExpr&>(*expression);
+            writer.byte(static_cast<uint8_t>(unary.op));
+            writeExpression(writer, unary.operand.get());
+            writer.byte(unary.isPrefix ? 1 : 0);
+            break;
+        }
+        case ExpressionType::BINARY: {
+            auto& binary = static_cast<const BinaryExpr&>(*expression);
+            writer.byte(static_cast<uint8_t>(binary.op));
+            writeExpression(writer, binary.left.get());
+            writeExpression(writer, binary.right.get());
+            break;
+        }
+        case ExpressionType::CALL: {
+            auto& call = static_cast<const CallExpr&>(*expression);
+            writeExpression(writer, call.callee.get());
+            writer.varint(call.arguments.size());
+            for (const auto& argument : call.arguments) {
+                writeExpression(writer, argument.get());
+            }
+            break;
+        }
+        case ExpressionType::ASSIGN: {
+            auto& assign = static_cast<const AssignExpr&>(*expression);
+            writeExpression(writer, assign.target.get());
+            writeExpression(writer, assign.value.get());
+            break;
+        }
+        case ExpressionType::OBJECT: {
+            auto& object = static_cast<const ObjectExpr&>(*expression);
+            writer.varint(object.properties.size());
+            for (const ObjectExpr::Property& property : object.properties) {
+                writer.string(property.key);
+                writeExpression(writer, property.value.get());
+            }
+            break;
+        }
+        case ExpressionType::ARRAY: {
+            auto& array = static_cast<const ArrayExpr&>(*expression);
+            writer.varint(array.elements.size());
+            for (const auto& element : array.elements) {
+                writeExpression(writer, element.get());
+            }
+            break;
+        }
+        case ExpressionType::MEMBER: {
+            auto& member = static_cast<const MemberExpr&>(*expression);
+            writeExpression(writer, member.object.get());
+            writeExpression(writer, member.property.get());
+            writer.byte(member.computed ? 1 : 0);
+            break;
+        }
+    }
+}
+
+bool ScriptCache::readExpression(Reader& reader, std::shared_ptr<ExpressionNode>& expression) {
+    expression = nullptr;
+    uint8_t tag;
+    if (!reader.byte(tag, static_cast<uint8_t>(ExpressionType::MEMBER) + 1)) {
+        return false;
+    }
+    if (tag == nullNode) {
+        return true;
+    }
+
+    switch (static_cast<ExpressionType>(tag - 1)) {
+        case ExpressionType::LITERAL: {
+            uint8_t type;
+            std::string value;
+            if (!reader.byte(type, static_cast<uint8_t>(LiteralExpr::LiteralType::UNDEFINED)) ||
+                !reader.string(value)) {
+                return false;
+            }
+            expression = std::make_shared<LiteralExpr>(static_cast<LiteralExpr::LiteralType>(type), value);
+            return true;
+        }
+        case ExpressionType::VARIABLE: {
+            std::string name;
+            if (!reader.string(name)) {
+                return false;
+            }
+            expression = std::make_shared<VariableExpr>(name);
+            return true;
+        }
+        case ExpressionType::UNARY: {
+            uint8_t op, prefix;
+            std::shared_ptr<ExpressionNode> operand;
+            if (!reader.byte(op, static_cast<uint8_t>(UnaryExpr::Operator::DECREMENT)) ||
+                !readExpression(reader, operand) || !operand || !reader.byte(prefix, 1)) {
+                return false;
+            }
+            expression = std::make_shared<UnaryExpr>(static_cast<UnaryExpr::Operator>(op), operand, prefix != 0);
+            return true;
+        }
+        case ExpressionType::BINARY: {
+            uint8_t op;
+            std::shared_ptr<ExpressionNode> left, right;
+            if (!reader.byte(op, static_cast<uint8_t>(BinaryExpr::Operator::OR)) ||
+                !readExpression(reader, left) || !left || !readExpression(reader, right) || !right) {
+                return false;
+            }
+            expression = std::make_shared<BinaryExpr>(static_cast<BinaryExpr::Operator>(op), left, right);
+            return true;
+        }
+        case ExpressionType::CALL: {
+            std::shared_ptr<ExpressionNode> callee;
+            size_t argumentCount;
+            if (!readExpression(reader, callee) || !callee || !reader.count(argumentCount)) {
+                return false;
+            }
+            std::vector<std::shared_ptr<ExpressionNode>> arguments(argumentCount);
+            for (auto& argument : arguments) {
+                if (!readExpression(reader, argument) || !argument) {
+                    return false;
+                }
+            }
+            expression = std::make_shared<CallExpr>(callee, std::move(arguments));
+            return true;
+        }
+        case ExpressionType::ASSIGN: {
+            std::shared_ptr<ExpressionNode> target, value;
+            if (!readExpression(reader, target) || !target || !readExpression(reader, value) || !value) {
+                return false;
+            }
+            expression = std::make_shared<AssignExpr>(target, value);
+            return true;
+        }
+        case ExpressionType::OBJECT: {
+            size_t propertyCount;
+            if (!reader.count(propertyCount)) {
+                return false;
+            }
+            std::vector<ObjectExpr::Property> properties;
+            properties.reserve(propertyCount);
+            for (size_t i = 0; i < propertyCount; ++i) {
+                std::string key;
+                std::shared_ptr<ExpressionNode> value;
+                if (!reader.string(key) || !readExpression(reader, value) || !value) {
+                    return false;
+                }
+                properties.emplace_back(key, value);
+            }
+            expression = std::make_shared<ObjectExpr>(std::move(properties));
+            return true;
+        }
+        case ExpressionType::ARRAY: {
+            size_t elementCount;
+            if (!reader.count(elementCount)) {
+                return false;
+            }
+            std::vector<std::shared_ptr<ExpressionNode>> elements(elementCount);
+            for (auto& element : elements) {
+                if (!readExpression(reader, element) || !element) {
+                    return false;
+                }
+            }
+            expression = std::make_shared<ArrayExpr>(std::move(elements));
+            return true;
+        }
+        case ExpressionType::MEMBER: {
+            std::shared_ptr<ExpressionNode> object, property;
+            uint8_t computed;
+            if (!readExpression(reader, object) || !object || !readExpression(reader, property) || !property ||
+                !reader.byte(computed, 1)) {
+                return false;
+            }
+            expression = std::make_shared<MemberExpr>(object, property, computed != 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScriptCache::writeStatement(Writer& writer, const StatementNode* statement) {
+    if (!statement) {
+        writer.byte(nullNode);
+        return;
+    }
+    writer.byte(static_cast<uint8_t>(statement->getType()) + 1);
+
+    switch (statement->getType()) {
+        case StatementType::EXPRESSION:
+            writeExpression(writer, static_cast<const ExpressionStmt&>(*statement).expression.get());
+            break;
+        case StatementType::VARIABLE: {
+            auto& variable = static_cast<const VariableStmt&>(*statement);
+            writer.byte(static_cast<uint8_t>(variable.declarationType));
+            writer.string(variable.name);
+            writeExpression(writer, variable.initializer.get());
+            break;
+        }
+        case StatementType::BLOCK: {
+            auto& block = static_cast<const BlockStmt&>(*statement);
+            writer.varint(block.statements.size());
+            for (const auto& child : block.statements) {
+                writeStatement(writer, child.get());
+            }
+            break;
+        }
+        case StatementType::IF: {
+            auto& branch = static_cast<const IfStmt&>(*statement);
+            writeExpression(writer, branch.condition.get());
+            writeStatement(writer, branch.thenBranch.get());
+            writeStatement(writer, branch.elseBranch.get());
+            break;
+        }
+        case StatementType::WHILE: {
+            auto& loop = static_cast<const WhileStmt&>(*statement);
+            writeExpression(writer, loop.condition.get());
+            writeStatement(writer, loop.body.get());
+            break;
+        }
+        case StatementType::FOR: {
+            auto& loop = static_cast<const ForStmt&>(*statement);
+            writeStatement(writer, loop.initializer.get());
+            writeExpression(writer, loop.condition.get());
+            writeExpression(writer, loop.increment.get());
+            writeStatement(writer, loop.body.get());
+            break;
+        }
+        case StatementType::FUNCTION: {
+            auto& function = static_cast<const FunctionStmt&>(*statement);
+            writer.string(function.name);
+            writer.varint(function.parameters.size());
+            for (const std::string& parameter : function.parameters) {
+                writer.string(parameter);
+            }
+            // A body not parsed yet is kept as its source
+            writer.byte(function.body ? 1 : 0);
+            if (function.body) {
+                writeStatement(writer, function.body.get());
+            } else {
+                writer.varint(function.bodyLine);
+                writer.string(function.source->substr(function.bodyBegin, function.bodyEnd - function.bodyBegin));
+            }
+            break;
+        }
+        case StatementType::RETURN:
+            writeExpression(writer, static_cast<const ReturnStmt&>(*statement).value.get());
+            break;
+    }
+}
+
+bool ScriptCache::readStatement(Reader& reader, std::shared_ptr<StatementNode>& statement) {
+    statement = nullptr;
+    uint8_t tag;
+    if (!reader.byte(tag, static_cast<uint8_t>(StatementType::RETURN) + 1)) {
+        return false;
+    }
+    if (tag == nullNode) {
+        return true;
+    }
+
+    switch (static_cast<StatementType>(tag - 1)) {
+        case StatementType::EXPRESSION: {
+            std::shared_ptr<ExpressionNode> expression;
+            if (!readExpression(reader, expression) || !expression) {
+                return false;
+            }
+            statement = std::make_shared<ExpressionStmt>(expression);
+            return true;
+        }
+        case StatementType::VARIABLE: {
+            uint8_t type;
+            std::string name;
+            std::shared_ptr<ExpressionNode> initializer;
+            if (!reader.byte(type, static_cast<uint8_t>(VariableStmt::DeclarationType::CONST)) ||
+                !reader.string(name) || !readExpression(reader, initializer)) {
+                return false;
+            }
+            statement = std::make_shared<VariableStmt>(static_cast<VariableStmt::DeclarationType>(type),
+                                                       name, initializer);
+            return true;
+        }
+        case StatementType::BLOCK: {
+            size_t statementCount;
+            if (!reader.count(statementCount)) {
+                return false;
+            }
+            std::vector<std::shared_ptr<StatementNode>> statements(statementCount);
+            for (auto& child : statements) {
+                if (!readStatement(reader, child) || !child) {
+                    return false;
+                }
+            }
+            statement = std::make_shared<BlockStmt>(std::move(statements));
+            return true;
+        }
+        case StatementType::IF: {
+            std::shared_ptr<ExpressionNode> condition;
+            std::shared_ptr<StatementNode> thenBranch, elseBranch;
+            if (!readExpression(reader, condition) || !condition ||
+                !readStatement(reader, thenBranch) || !thenBranch || !readStatement(reader, elseBranch)) {
+                return false;
+            }
+            statement = std::make_shared<IfStmt>(condition, thenBranch, elseBranch);
+            return true;
+        }
+        case StatementType::WHILE: {
+            std::shared_ptr<ExpressionNode> condition;
+            std::shared_ptr<StatementNode> body;
+            if (!readExpression(reader, condition) || !condition || !readStatement(reader, body) || !body) {
+                return false;
+            }
+            statement = std::make_shared<WhileStmt>(condition, body);
+            return true;
+        }
+        case StatementType::FOR: {
+            std::shared_ptr<StatementNode> initializer, body;
+            std::shared_ptr<ExpressionNode> condition, increment;
+            if (!readStatement(reader, initializer) || !readExpression(reader, condition) ||
+                !readExpression(reader, increment) || !readStatement(reader, body) || !body) {
+                return false;
+            }
+            statement = std::make_shared<ForStmt>(initializer, condition, increment, body);
+            return true;
+        }
+        case StatementType::FUNCTION: {
+            std::string name;
+            size_t parameterCount;
+            if (!reader.string(name) || !reader.count(parameterCount)) {
+                return false;
+            }
+            std::vector<std::string> parameters(parameterCount);
+            for (std::string& parameter : parameters) {
+                if (!reader.string(parameter)) {
+                    return false;
+                }
+            }
+            uint8_t parsed;
+            if (!reader.byte(parsed, 1)) {
+                return false;
+            }
+            if (!parsed) {
+                uint64_t line;
+                std::string source;
+                if (!reader.varint(line) || line > static_cast<uint64_t>(INT_MAX) || !reader.string(source)) {
+                    return false;
+                }
+                auto function = std::make_shared<FunctionStmt>(name, std::move(parameters), nullptr);
+                function->bodyEnd = source.size();
+                function->bodyLine = static_cast<int>(line);
+                function->source = std::make_shared<const std::string>(std::move(source));
+                statement = function;
+                return true;
+            }
+            std::shared_ptr<StatementNode> body;
+            if (!readStatement(reader, body) || !body || body->getType() != StatementType::BLOCK) {
+                return false;
+            }
+            statement = std::make_shared<FunctionStmt>(name, std::move(parameters),
+                                                       std::static_pointer_cast<BlockStmt>(body));
+            return true;
+        }
+        case StatementType::RETURN: {
+            std::shared_ptr<ExpressionNode> value;
+            if (!readExpression(reader, value)) {
+                return false;
+            }
+            statement = std::make_shared<ReturnStmt>(value);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace custom_js
+} // namespace browser
@@ -0,0 +1,101 @@
+// script_cache.h - Keeps parsed scripts so repeat runs skip the parser
+#ifndef CUSTOM_JS_SCRIPT_CACHE_H
+#define CUSTOM_JS_SCRIPT_CACHE_H
+
+#include "js_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace custom_js {
+
+// Parsed programs keyed by a hash of their source. Recently used programs
+// stay in memory; with a directory set, each is also written there as a
+// compact binary syntax tree, and later runs read that instead of lexing
+// and parsing. Function bodies are parsed lazily, and a body not yet
+// parsed is stored as its source.
+//
+// A cached program is run again and again, and keeps the inline caches and
+// literal values its runs leave in it, so a cache belongs to the engines
+// of one thread.
+class ScriptCache {
+public:
+    // Bump when the binary layout or the parser's output changes; files of
+    // other versions are ignored and rewritten
+    static constexpr uint32_t formatVersion = 4;
+    static constexpr size_t defaultMemoryCapacity = 64;
+
+    explicit ScriptCache(size_t memoryCapacity = defaultMemoryCapacity);
+    ~ScriptCache();
+
+    ScriptCache(const ScriptCache&) = delete;
+    ScriptCache& operator=(const ScriptCache&) = delete;
+
+    // Directory for compiled scripts, created if missing; empty keeps them
+    // in memory only. False if the directory can't be created.
+    bool setDirectory(const std::string& directory);
+    const std::string& directory() const { return m_directory; }
+
+    // Program for source: from memory, from a compiled file, or parsed and
+    // then stored in both. Throws ParseError as JSParser does; scripts that
+    // fail to parse aren't cached.
+    std::shared_ptr<Program> get(const std::string& source);
+
+    // Lookup counters since construction or resetCounters()
+    size_t memoryHits() const { return m_memoryHits; }
+    size_t diskHits() const { return m_diskHits; }
+    size_t misses() const { return m_misses; }
+    void resetCounters();
+
+    // Drop the programs held in memory; compiled files are kept
+    void clear();
+
+    // Binary form of a program parsed from source, which it carries;
+    // deserialize() returns null unless the data is a well-formed program
+    // of this format version parsed from that same source, and matches the
+    // checksum written with it
+    static uint64_t contentHash(std::string_view source);
+    static std::vector<uint8_t> serialize(const Program& program, std::string_view source);
+    static std::shared_ptr<Program> deserialize(const uint8_t* data, size_t size, std::string_view source);
+
+private:
+    struct Entry {
+        uint64_t hash;
+        std::string source;
+        std::shared_ptr<Program> program;
+    };
+
+    std::shared_ptr<Program> findInMemory(uint64_t hash, const std::string& source);
+    void storeInMemory(uint64_t hash, const std::string& source, std::shared_ptr<Program> program);
+
+    std::shared_ptr<Program> loadCompiled(const std::string& path, std::string_view source) const;
+    bool storeCompiled(const std::string& path, const std::vector<uint8_t>& data) const;
+    std::string compiledPath(uint64_t hash) const;
+
+    class Writer;
+    class Reader;
+    static void writeExpression(Writer& writer, const ExpressionNode* expression);
+    static bool readExpression(Reader& reader, std::shared_ptr<ExpressionNode>& expression);
+    static void writeStatement(Writer& writer, const StatementNode* statement);
+    static bool readStatement(Reader& reader, std::shared_ptr<StatementNode>& statement);
+
+    // Most recently used first
+    std::list<Entry> m_entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+    size_t m_capacity;
+    std::string m_directory;
+    size_t m_memoryHits;
+    size_t m_diskHits;
+    size_t m_misses;
+};
+
+} // namespace custom_js
+} // namespace browser
+
+#endif // CUSTOM_JS_SCRIPT_CACHE_H
@@ -0,0 +1,80 @@
+#include "atom_table.h"
+#include <atomic>
+
+namespace browser {
+namespace html {
+
+namespace {
+
+// Must match the order of the atoms enum
+const char* const kWellKnownNames[] = {
+    "",
+    "html", "head", "body", "title", "meta", "link", "style", "script",
+    "div", "span", "p", "a", "img", "br", "hr",
+    "ul", "ol", "li", "h1", "h2", "h3", "h4", "h5", "h6",
+    "strong", "em", "b", "i", "pre", "code", "blockquote",
+    "table", "tr", "td", "th", "form", "input", "button", "textarea", "select", "option", "label",
+    "section", "article", "nav", "header", "footer", "main", "aside",
+    "id", "class", "href", "src", "rel", "type", "name", "value"
+};
+
+static_assert(sizeof(kWellKnownNames) / sizeof(kWellKnownNames[0]) == atoms::WELL_KNOWN_COUNT,
+              "well-known atom names out of sync with atoms enum");
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// AtomTable Implementation
+//-----------------------------------------------------------------------------
+
+AtomTable::AtomTable() {
+    static std::atomic<uint64_t> nextSerial{1};
+    m_serial = nextSerial++;
+    
+    m_names.reserve(atoms::WELL_KNOWN_COUNT * 2);
+    m_names.emplace_back();
+
+    for (Atom atom = 1; atom < atoms::WELL_KNOWN_COUNT; ++atom) {
+        m_names.emplace_back(kWellKnownNames[atom]);
+        m_atoms.emplace(m_names.back(), atom);
+    }
+}
+
+AtomTable::~AtomTable() {
+}
+
+Atom AtomTable::intern(const std::string& str) {
+    if (str.empty()) {
+        return atoms::NONE;
+    }
+
+    auto it = m_atoms.find(str);
+    if (it != m_atoms.end()) {
+        return it->second;
+    }
+
+    Atom atom = static_cast<Atom>(m_names.size());
+    m_names.push_back(str);
+    m_atoms.emplace(str, atom);
+    return atom;
+}
+
+Atom AtomTable::lookup(const std::string& str) const {
+    auto it = m_atoms.find(str);
+    return it != m_atoms.end() ? it->second : atoms::NONE;
+}
+
+const std::string& AtomTable::name(Atom atom) const {
+    if (atom >= m_names.size()) {
+        return m_names[atoms::NONE];
+    }
+    return m_names[atom];
+}
+
+std::shared_ptr<AtomTable> AtomTable::detached() {
+    static thread_local std::shared_ptr<AtomTable> table = std::make_shared<AtomTable>();
+    return table;
+}
+
+} // namespace html
+} // namespace browser
@@ -0,0 +1,75 @@
+#ifndef BROWSER_ATOM_TABLE_H
+#define BROWSER_ATOM_TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace html {
+
+// Interned string identifier. Atoms are only meaningful relative to the
+// AtomTable that produced them, except for the well-known atoms below which
+// have the same value in every table.
+using Atom = uint32_t;
+
+namespace atoms {
+
+// Well-known tag and attribute names, pre-interned in this order by every
+// AtomTable so they can be compared without a table lookup
+enum : Atom {
+    NONE = 0,
+    // Tags
+    HTML, HEAD, BODY, TITLE, META, LINK, STYLE, SCRIPT,
+    DIV, SPAN, P, A, IMG, BR, HR,
+    UL, OL, LI, H1, H2, H3, H4, H5, H6,
+    STRONG, EM, B, I, PRE, CODE, BLOCKQUOTE,
+    TABLE, TR, TD, TH, FORM, INPUT, BUTTON, TEXTAREA, SELECT, OPTION, LABEL,
+    SECTION, ARTICLE, NAV, HEADER, FOOTER, MAIN, ASIDE,
+    // Attributes ("style" shares the tag atom)
+    ID, CLASS, HREF, SRC, REL, TYPE, NAME, VALUE,
+    WELL_KNOWN_COUNT
+};
+
+} // namespace atoms
+
+// String interning table. Each Document owns one; tag names, attribute names,
+// ids and class tokens of its elements are stored as atoms from it.
+class AtomTable {
+public:
+    AtomTable();
+    ~AtomTable();
+
+    AtomTable(const AtomTable&) = delete;
+    AtomTable& operator=(const AtomTable&) = delete;
+
+    // Return the atom for a string, adding it if necessary
+    Atom intern(const std::string& str);
+
+    // Return the atom for a string, or atoms::NONE if it was never interned
+    Atom lookup(const std::string& str) const;
+
+    // Return the string for an atom
+    const std::string& name(Atom atom) const;
+
+    size_t size() const { return m_names.size(); }
+    
+    // Unique per table for the life of the process, unlike its address;
+    // lets callers cache atoms across tables safely
+    uint64_t serial() const { return m_serial; }
+
+    // Table used by elements that don't belong to a document
+    static std::shared_ptr<AtomTable> detached();
+
+private:
+    uint64_t m_serial;
+    std::unordered_map<std::string, Atom> m_atoms;
+    std::vector<std::string> m_names;
+};
+
+} // namespace html
+} // namespace browser
+
+#endif // BROWSER_ATOM_TABLE_H
@@ -0,0 +1,187 @@
+#ifndef BROWSER_DOM_TRAVERSAL_H
+#define BROWSER_DOM_TRAVERSAL_H
+
+#include "dom_tree.h"
+#include <cstddef>
+#include <iterator>
+
+namespace browser {
+namespace html {
+
+// Allocation-free tree walks over the parent/sibling links. Ranges include
+// their root unless named descendant*. The tree must not be modified while
+// a walk is in progress, except below a node that is skipped with
+// skipChildren().
+//
+//   for (Element* element : elementsOf(document)) { ... }
+
+// Next node after node in pre-order, staying inside root's subtree
+inline Node* nextPreOrderSkippingChildren(const Node* node, const Node* root) {
+    while (node && node != root) {
+        if (Node* sibling = node->nextSibling()) {
+            return sibling;
+        }
+        node = node->parentNode();
+    }
+    return nullptr;
+}
+
+inline Node* nextPreOrder(const Node* node, const Node* root) {
+    if (Node* child = node->firstChild()) {
+        return child;
+    }
+    return nextPreOrderSkippingChildren(node, root);
+}
+
+// First node of root's subtree in post-order (its deepest first descendant)
+inline Node* firstPostOrder(const Node* root) {
+    Node* node = const_cast<Node*>(root);
+    while (Node* child = node->firstChild()) {
+        node = child;
+    }
+    return node;
+}
+
+inline Node* nextPostOrder(const Node* node, const Node* root) {
+    if (!node || node == root) {
+        return nullptr;
+    }
+    if (Node* sibling = node->nextSibling()) {
+        return firstPostOrder(sibling);
+    }
+    return node->parentNode();
+}
+
+// Node filters
+struct AllNodes {
+    bool operator()(const Node*) const { return true; }
+};
+
+struct ElementNodes {
+    bool operator()(const Node* node) const { return node->nodeType() == NodeType::ELEMENT_NODE; }
+};
+
+enum class TraversalOrder {
+    PRE_ORDER,
+    POST_ORDER
+};
+
+// Forward iterator yielding T* for nodes accepted by Filter
+template <typename T, TraversalOrder Order, typename Filter>
+class TreeIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T*;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T**;
+    using reference = T*;
+
+    TreeIterator(Node* node, const Node* root, const Filter& filter)
+        : m_node(node), m_root(root), m_filter(filter) { skipRejected(); }
+
+    T* operator*() const { return static_cast<T*>(m_node); }
+
+    TreeIterator& operator++() {
+        advance();
+        skipRejected();
+        return *this;
+    }
+
+    TreeIterator operator++(int) {
+        TreeIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    // Pre-order only: continue after the current node's subtree
+    void skipChildren() {
+        static_assert(Order == TraversalOrder::PRE_ORDER, "skipChildren() needs a pre-order walk");
+        m_node = nextPreOrderSkippingChildren(m_node, m_root);
+        skipRejected();
+    }
+
+    bool operator==(const TreeIterator& other) const { return m_node == other.m_node; }
+    bool operator!=(const TreeIterator& other) const { return m_node != other.m_node; }
+
+private:
+    void advance() {
+        m_node = Order == TraversalOrder::PRE_ORDER ? nextPreOrder(m_node, m_root)
+                                                    : nextPostOrder(m_node, m_root);
+    }
+
+    void skipRejected() {
+        while (m_node && !m_filter(m_node)) {
+            advance();
+        }
+    }
+
+    Node* m_node;
+    const Node* m_root;
+    Filter m_filter;
+};
+
+template <typename T, TraversalOrder Order, typename Filter>
+class TreeRange {
+public:
+    using iterator = TreeIterator<T, Order, Filter>;
+
+    TreeRange(Node* first, const Node* root, const Filter& filter)
+        : m_first(first), m_root(root), m_filter(filter) {}
+
+    iterator begin() const { return iterator(m_first, m_root, m_filter); }
+    iterator end() const { return iterator(nullptr, m_root, m_filter); }
+
+private:
+    Node* m_first;
+    const Node* m_root;
+    Filter m_filter;
+};
+
+// All nodes of root's subtree
+inline TreeRange<Node, TraversalOrder::PRE_ORDER, AllNodes> preOrder(const Node* root) {
+    return {const_cast<Node*>(root), root, AllNodes()};
+}
+
+inline TreeRange<Node, TraversalOrder::POST_ORDER, AllNodes> postOrder(const Node* root) {
+    return {root ? firstPostOrder(root) : nullptr, root, AllNodes()};
+}
+
+// Elements of root's subtree
+inline TreeRange<Element, TraversalOrder::PRE_ORDER, ElementNodes> elementsOf(const Node* root) {
+    return {const_cast<Node*>(root), root, ElementNodes()};
+}
+
+inline TreeRange<Element, TraversalOrder::POST_ORDER, ElementNodes> postOrderElementsOf(const Node* root) {
+    return {root ? firstPostOrder(root) : nullptr, root, ElementNodes()};
+}
+
+// Elements below root, excluding root itself
+inline TreeRange<Element, TraversalOrder::PRE_ORDER, ElementNodes> descendantElementsOf(const Node* root) {
+    return {root ? nextPreOrder(root, root) : nullptr, root, ElementNodes()};
+}
+
+// Nodes of root's subtree accepted by filter, as T* (T must match what the
+// filter accepts)
+template <typename T = Node, typename Filter>
+TreeRange<T, TraversalOrder::PRE_ORDER, Filter> filteredPreOrder(const Node* root, Filter filter) {
+    return {const_cast<Node*>(root), root, filter};
+}
+
+template <typename T = Node, typename Filter>
+TreeRange<T, TraversalOrder::POST_ORDER, Filter> filteredPostOrder(const Node* root, Filter filter) {
+    return {root ? firstPostOrder(root) : nullptr, root, filter};
+}
+
+// Elements of root's subtree for which filter(const Element*) holds
+template <typename Filter>
+auto filteredElementsOf(const Node* root, Filter filter) {
+    auto accept = [filter](const Node* node) {
+        return node->nodeType() == NodeType::ELEMENT_NODE && filter(static_cast<const Element*>(node));
+    };
+    return TreeRange<Element, TraversalOrder::PRE_ORDER, decltype(accept)>(const_cast<Node*>(root), root, accept);
+}
+
+} // namespace html
+} // namespace browser
+
+#endif // BROWSER_DOM_TRAVERSAL_H
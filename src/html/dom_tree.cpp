@@ -1,13 +1,29 @@
 #include "dom_tree.h"
+#include "dom_traversal.h"
+#include "html_parser.h"
+#include "html_serializer.h"
+#include "../css/selector_query.h"
 #include <iostream>
-#include <sstream>
 #include <algorithm>
-#include <stack>
-#include <queue>
+#include <unordered_set>
 
 namespace browser {
 namespace html {
 
+namespace {
+
+// True if nothing follows node in document order except its descendants
+bool isAtDocumentEnd(const Node* node) {
+    for (; node && node->nodeType() != NodeType::DOCUMENT_NODE; node = node->parentNode()) {
+        if (node->nextSibling()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
 //-----------------------------------------------------------------------------
 // Node Implementation
 //-----------------------------------------------------------------------------
@@ -20,6 +36,9 @@ Node::Node(NodeType type)
     , m_parentNode(nullptr)
     , m_previousSibling(nullptr)
     , m_nextSibling(nullptr)
+    , m_styleDirtyFlags(0)
+    , m_layoutDirtyFlags(0)
+    , m_layoutBoxIndex(UINT32_MAX)
 {
 }
 
@@ -50,7 +69,7 @@ std::shared_ptr<Node> Node::appendChild(std::shared_ptr<Node> newChild) {
     
     // Set the owner document
     if (m_ownerDocument && newChild->m_ownerDocument != m_ownerDocument) {
-        newChild->m_ownerDocument = m_ownerDocument;
+        newChild->setOwnerDocument(m_ownerDocument);
     }
     
     // Add to child nodes
@@ -62,12 +81,9 @@ std::shared_ptr<Node> Node::appendChild(std::shared_ptr<Node> newChild) {
     newChild->m_nextSibling = nullptr;
     m_childNodes.push_back(newChild);
     
-    // Update ID mappings if this is an element with an ID
-    if (newChild->nodeType() == NodeType::ELEMENT_NODE) {
-        Element* element = static_cast<Element*>(newChild.get());
-        if (element->hasAttribute("id") && m_ownerDocument) {
-            m_ownerDocument->registerElementId(element->id(), element);
-        }
+    // Index the new subtree's elements
+    if (m_ownerDocument && isConnected()) {
+        m_ownerDocument->subtreeInserted(newChild.get());
     }
     
     return newChild;
@@ -104,7 +120,7 @@ std::shared_ptr<Node> Node::insertBefore(std::shared_ptr<Node> newChild, std::sh
     
     // Set the owner document
     if (m_ownerDocument && newChild->m_ownerDocument != m_ownerDocument) {
-        newChild->m_ownerDocument = m_ownerDocument;
+        newChild->setOwnerDocument(m_ownerDocument);
     }
     
     // Insert before refChild
@@ -113,12 +129,9 @@ std::shared_ptr<Node> Node::insertBefore(std::shared_ptr<Node> newChild, std::sh
     // Update sibling pointers
     updateSiblingPointers();
     
-    // Update ID mappings if this is an element with an ID
-    if (newChild->nodeType() == NodeType::ELEMENT_NODE) {
-        Element* element = static_cast<Element*>(newChild.get());
-        if (element->hasAttribute("id") && m_ownerDocument) {
-            m_ownerDocument->registerElementId(element->id(), element);
-        }
+    // Index the new subtree's elements
+    if (m_ownerDocument && isConnected()) {
+        m_ownerDocument->subtreeInserted(newChild.get());
     }
     
     return newChild;
@@ -140,16 +153,15 @@ std::shared_ptr<Node> Node::removeChild(std::shared_ptr<Node> child) {
         return nullptr;
     }
     
-    // Update ID mappings if this is an element with an ID
-    if (child->nodeType() == NodeType::ELEMENT_NODE) {
-        Element* element = static_cast<Element*>(child.get());
-        if (element->hasAttribute("id") && m_ownerDocument) {
-            m_ownerDocument->unregisterElementId(element->id());
-        }
+    // Drop the subtree's elements from the indexes
+    if (m_ownerDocument && isConnected()) {
+        m_ownerDocument->subtreeRemoved(child.get());
     }
     
-    // Clear parent and owner document
+    // Detach from the parent and siblings
     child->m_parentNode = nullptr;
+    child->m_previousSibling = nullptr;
+    child->m_nextSibling = nullptr;
     
     // Remove from child nodes
     m_childNodes.erase(it);
@@ -181,18 +193,16 @@ std::shared_ptr<Node> Node::replaceChild(std::shared_ptr<Node> newChild, std::sh
         newChild->m_parentNode->removeChild(newChild);
     }
     
-    // Update ID mappings for old child
-    if (oldChild->nodeType() == NodeType::ELEMENT_NODE) {
-        Element* element = static_cast<Element*>(oldChild.get());
-        if (element->hasAttribute("id") && m_ownerDocument) {
-            m_ownerDocument->unregisterElementId(element->id());
-        }
+    // Drop the old subtree's elements from the indexes
+    bool connected = m_ownerDocument && isConnected();
+    if (connected) {
+        m_ownerDocument->subtreeRemoved(oldChild.get());
     }
     
     // Set the new parent and owner document for new child
     newChild->m_parentNode = this;
     if (m_ownerDocument && newChild->m_ownerDocument != m_ownerDocument) {
-        newChild->m_ownerDocument = m_ownerDocument;
+        newChild->setOwnerDocument(m_ownerDocument);
     }
     
     // Replace the child
@@ -201,12 +211,9 @@ std::shared_ptr<Node> Node::replaceChild(std::shared_ptr<Node> newChild, std::sh
     // Update sibling pointers
     updateSiblingPointers();
     
-    // Update ID mappings for new child
-    if (newChild->nodeType() == NodeType::ELEMENT_NODE) {
-        Element* element = static_cast<Element*>(newChild.get());
-        if (element->hasAttribute("id") && m_ownerDocument) {
-            m_ownerDocument->registerElementId(element->id(), element);
-        }
+    // Index the new subtree's elements
+    if (connected) {
+        m_ownerDocument->subtreeInserted(newChild.get());
     }
     
     // Clear parent for old child
@@ -217,6 +224,55 @@ std::shared_ptr<Node> Node::replaceChild(std::shared_ptr<Node> newChild, std::sh
     return oldChild;
 }
 
+bool Node::isConnected() const {
+    const Node* node = this;
+    while (node->m_parentNode) {
+        node = node->m_parentNode;
+    }
+    return node->m_nodeType == NodeType::DOCUMENT_NODE;
+}
+
+void Node::markStyleDirty(uint8_t flags) {
+    m_styleDirtyFlags |= flags;
+    
+    // Ancestors that already have the flag have had theirs set too
+    for (Node* ancestor = m_parentNode;
+         ancestor && !(ancestor->m_styleDirtyFlags & STYLE_DESCENDANT_DIRTY);
+         ancestor = ancestor->m_parentNode) {
+        ancestor->m_styleDirtyFlags |= STYLE_DESCENDANT_DIRTY;
+    }
+}
+
+void Node::markLayoutDirty(uint8_t flags) {
+    m_layoutDirtyFlags |= flags;
+    
+    for (Node* ancestor = m_parentNode;
+         ancestor && !(ancestor->m_layoutDirtyFlags & LAYOUT_DESCENDANT_DIRTY);
+         ancestor = ancestor->m_parentNode) {
+        ancestor->m_layoutDirtyFlags |= LAYOUT_DESCENDANT_DIRTY;
+    }
+}
+
+void Node::setNodeValue(const std::string& value) {
+    m_nodeValue = value;
+    
+    // Text is laid out; other node values aren't
+    if (m_nodeType == NodeType::TEXT_NODE) {
+        markLayoutDirty(LAYOUT_SELF_DIRTY);
+    }
+}
+
+void Node::setOwnerDocument(Document* document) {
+    if (m_ownerDocument != document) {
+        m_ownerDocument = document;
+        ownerDocumentChanged();
+    }
+    
+    for (auto& child : m_childNodes) {
+        child->setOwnerDocument(document);
+    }
+}
+
 void Node::updateSiblingPointers() {
     Node* prev = nullptr;
     
@@ -237,210 +293,239 @@ void Node::updateSiblingPointers() {
 // Element Implementation
 //-----------------------------------------------------------------------------
 
-Element::Element(const std::string& tagName)
+Element::Element(const std::string& tagName, std::shared_ptr<AtomTable> atomTable)
     : Node(NodeType::ELEMENT_NODE)
     , m_tagName(tagName)
+    , m_atomTable(atomTable ? std::move(atomTable) : AtomTable::detached())
+    , m_tagAtom(atoms::NONE)
+    , m_idAtom(atoms::NONE)
 {
     m_nodeName = tagName;
+    
+    std::string lowerTag = tagName;
+    std::transform(lowerTag.begin(), lowerTag.end(), lowerTag.begin(), 
+        [](unsigned char c) { return static_cast<char>(::tolower(c)); });
+    m_tagAtom = m_atomTable->intern(lowerTag);
 }
 
 Element::~Element() {
 }
 
 std::string Element::id() const {
-    return getAttribute("id");
+    return getAttribute(atoms::ID);
 }
 
 std::string Element::className() const {
-    return getAttribute("class");
+    return getAttribute(atoms::CLASS);
+}
+
+bool Element::hasClass(Atom className) const {
+    return std::find(m_classAtoms.begin(), m_classAtoms.end(), className) != m_classAtoms.end();
+}
+
+const Attribute* Element::findAttribute(Atom name) const {
+    if (name == atoms::NONE) {
+        return nullptr;
+    }
+    
+    for (const auto& attr : m_attributes) {
+        if (attr.name == name) {
+            return &attr;
+        }
+    }
+    return nullptr;
 }
 
 bool Element::hasAttribute(const std::string& name) const {
-    return m_attributes.find(name) != m_attributes.end();
+    return findAttribute(m_atomTable->lookup(name)) != nullptr;
+}
+
+bool Element::hasAttribute(Atom name) const {
+    return findAttribute(name) != nullptr;
 }
 
 std::string Element::getAttribute(const std::string& name) const {
-    auto it = m_attributes.find(name);
-    if (it != m_attributes.end()) {
-        return it->second;
-    }
-    return "";
+    return getAttribute(m_atomTable->lookup(name));
+}
+
+std::string Element::getAttribute(Atom name) const {
+    const Attribute* attr = findAttribute(name);
+    return attr ? attr->value : std::string();
 }
 
 void Element::setAttribute(const std::string& name, const std::string& value) {
-    // Check if this is an ID change
-    if (name == "id" && m_ownerDocument) {
-        // Unregister old ID if any
-        if (hasAttribute("id")) {
-            m_ownerDocument->unregisterElementId(getAttribute("id"));
-        }
-        
-        // Register new ID
-        m_ownerDocument->registerElementId(value, this);
+    Atom atom = m_atomTable->intern(name);
+    if (atom == atoms::NONE) {
+        return;
+    }
+    
+    Attribute* existing = const_cast<Attribute*>(findAttribute(atom));
+    if (existing && existing->value == value) {
+        return;
     }
     
-    m_attributes[name] = value;
+    // Id and class changes move the element between index keys
+    bool connected = m_ownerDocument && isConnected();
+    bool indexed = (atom == atoms::ID || atom == atoms::CLASS) && connected;
+    if (indexed) {
+        m_ownerDocument->attributeChanging(this, atom);
+    }
+    
+    if (existing) {
+        existing->value = value;
+    } else {
+        m_attributes.push_back({atom, value});
+    }
+    
+    if (atom == atoms::ID) {
+        m_idAtom = m_atomTable->intern(value);
+    } else if (atom == atoms::CLASS) {
+        updateClassAtoms();
+    }
+    
+    if (indexed) {
+        m_ownerDocument->attributeChanged(this, atom);
+    }
+    if (connected) {
+        markStyleDirty(STYLE_SELF_DIRTY);
+    }
 }
 
 void Element::removeAttribute(const std::string& name) {
-    // Unregister ID if removing id attribute
-    if (name == "id" && hasAttribute("id") && m_ownerDocument) {
-        m_ownerDocument->unregisterElementId(getAttribute("id"));
+    Atom atom = m_atomTable->lookup(name);
+    if (!findAttribute(atom)) {
+        return;
+    }
+    
+    bool connected = m_ownerDocument && isConnected();
+    bool indexed = (atom == atoms::ID || atom == atoms::CLASS) && connected;
+    if (indexed) {
+        m_ownerDocument->attributeChanging(this, atom);
     }
     
-    m_attributes.erase(name);
+    m_attributes.erase(std::remove_if(m_attributes.begin(), m_attributes.end(),
+                                      [atom](const Attribute& attr) { return attr.name == atom; }),
+                       m_attributes.end());
+    
+    if (atom == atoms::ID) {
+        m_idAtom = atoms::NONE;
+    } else if (atom == atoms::CLASS) {
+        m_classAtoms.clear();
+    }
+    
+    if (indexed) {
+        m_ownerDocument->attributeChanged(this, atom);
+    }
+    if (connected) {
+        markStyleDirty(STYLE_SELF_DIRTY);
+    }
 }
 
-std::vector<Element*> Element::getElementsByTagName(const std::string& tagName) const {
-    std::vector<Element*> elements;
+void Element::updateClassAtoms() {
+    m_classAtoms.clear();
     
-    // Use BFS to traverse the tree
-    std::queue<Node*> queue;
-    for (const auto& child : m_childNodes) {
-        queue.push(child.get());
+    const Attribute* attr = findAttribute(atoms::CLASS);
+    if (!attr) {
+        return;
     }
     
-    while (!queue.empty()) {
-        Node* node = queue.front();
-        queue.pop();
-        
-        if (node->nodeType() == NodeType::ELEMENT_NODE) {
-            Element* element = static_cast<Element*>(node);
-            
-            // Check if tag name matches (case insensitive)
-            std::string elementTag = element->tagName();
-            std::string targetTag = tagName;
-            std::transform(elementTag.begin(), elementTag.end(), elementTag.begin(), 
-                [](unsigned char c) { return static_cast<char>(::tolower(c)); });
-            std::transform(targetTag.begin(), targetTag.end(), targetTag.begin(), 
-                [](unsigned char c) { return static_cast<char>(::tolower(c)); });
-            
-            if (targetTag == "*" || elementTag == targetTag) {
-                elements.push_back(element);
-            }
-            
-            // Add children to queue
-            for (const auto& child : element->childNodes()) {
-                queue.push(child.get());
+    // Split on whitespace and intern each token
+    const std::string& classes = attr->value;
+    size_t pos = 0;
+    while (pos < classes.size()) {
+        while (pos < classes.size() && ::isspace(static_cast<unsigned char>(classes[pos]))) {
+            pos++;
+        }
+        size_t start = pos;
+        while (pos < classes.size() && !::isspace(static_cast<unsigned char>(classes[pos]))) {
+            pos++;
+        }
+        if (pos > start) {
+            // Repeated tokens are one class, as in classList
+            Atom atom = m_atomTable->intern(classes.substr(start, pos - start));
+            if (!hasClass(atom)) {
+                m_classAtoms.push_back(atom);
             }
         }
     }
-    
-    return elements;
 }
 
-std::vector<Element*> Element::getElementsByClassName(const std::string& className) const {
-    std::vector<Element*> elements;
+void Element::ownerDocumentChanged() {
+    std::shared_ptr<AtomTable> table = m_ownerDocument ? m_ownerDocument->atomTable() : AtomTable::detached();
+    if (!table || table == m_atomTable) {
+        return;
+    }
     
-    // Use BFS to traverse the tree
-    std::queue<Node*> queue;
-    for (const auto& child : m_childNodes) {
-        queue.push(child.get());
+    // Re-intern all names into the new document's table
+    std::shared_ptr<AtomTable> oldTable = m_atomTable;
+    m_atomTable = table;
+    
+    m_tagAtom = m_atomTable->intern(oldTable->name(m_tagAtom));
+    for (auto& attr : m_attributes) {
+        attr.name = m_atomTable->intern(oldTable->name(attr.name));
     }
+    if (m_idAtom != atoms::NONE) {
+        m_idAtom = m_atomTable->intern(oldTable->name(m_idAtom));
+    }
+    for (auto& cls : m_classAtoms) {
+        cls = m_atomTable->intern(oldTable->name(cls));
+    }
+}
+
+std::vector<Element*> Element::getElementsByTagName(const std::string& tagName) const {
+    std::vector<Element*> elements;
     
-    while (!queue.empty()) {
-        Node* node = queue.front();
-        queue.pop();
+    std::string targetTag = tagName;
+    std::transform(targetTag.begin(), targetTag.end(), targetTag.begin(), 
+        [](unsigned char c) { return static_cast<char>(::tolower(c)); });
+    bool matchAll = targetTag == "*";
+    const AtomTable* table = m_atomTable.get();
+    Atom targetAtom = table->lookup(targetTag);
+    
+    // Descendants in document order
+    for (Element* element : descendantElementsOf(this)) {
+        // Check if tag name matches (case insensitive)
+        if (element->atomTable() != table) {
+            table = element->atomTable();
+            targetAtom = table->lookup(targetTag);
+        }
         
-        if (node->nodeType() == NodeType::ELEMENT_NODE) {
-            Element* element = static_cast<Element*>(node);
-            
-            // Check if class name matches
-            std::string classes = element->className();
-            std::istringstream iss(classes);
-            std::string cls;
-            while (std::getline(iss, cls, ' ')) {
-                if (cls == className) {
-                    elements.push_back(element);
-                    break;
-                }
-            }
-            
-            // Add children to queue
-            for (const auto& child : element->childNodes()) {
-                queue.push(child.get());
-            }
+        if (matchAll || (targetAtom != atoms::NONE && element->tagAtom() == targetAtom)) {
+            elements.push_back(element);
         }
     }
     
     return elements;
 }
 
-Element* Element::querySelector(const std::string& selector) const {
-    // Simplified selector implementation (only supports tag, class, and ID selectors)
-    // For real browser, would use a full CSS selector engine
-    
-    // Check if it's an ID selector (#id)
-    if (selector.size() > 1 && selector[0] == '#') {
-        std::string id = selector.substr(1);
-        if (m_ownerDocument) {
-            return m_ownerDocument->getElementById(id);
-        }
-        
-        // Fallback to manual search
-        std::queue<Node*> queue;
-        for (const auto& child : m_childNodes) {
-            queue.push(child.get());
+std::vector<Element*> Element::getElementsByClassName(const std::string& className) const {
+    std::vector<Element*> elements;
+    
+    const AtomTable* table = m_atomTable.get();
+    Atom classAtom = table->lookup(className);
+    
+    // Descendants in document order
+    for (Element* element : descendantElementsOf(this)) {
+        // Check if class name matches
+        if (element->atomTable() != table) {
+            table = element->atomTable();
+            classAtom = table->lookup(className);
         }
         
-        while (!queue.empty()) {
-            Node* node = queue.front();
-            queue.pop();
-            
-            if (node->nodeType() == NodeType::ELEMENT_NODE) {
-                Element* element = static_cast<Element*>(node);
-                if (element->id() == id) {
-                    return element;
-                }
-                
-                // Add children to queue
-                for (const auto& child : element->childNodes()) {
-                    queue.push(child.get());
-                }
-            }
-        }
-    }
-    
-    // Check if it's a class selector (.class)
-    if (selector.size() > 1 && selector[0] == '.') {
-        std::string className = selector.substr(1);
-        std::vector<Element*> elements = getElementsByClassName(className);
-        if (!elements.empty()) {
-            return elements[0];
+        if (classAtom != atoms::NONE && element->hasClass(classAtom)) {
+            elements.push_back(element);
         }
-        return nullptr;
-    }
-    
-    // Assume it's a tag selector
-    std::vector<Element*> elements = getElementsByTagName(selector);
-    if (!elements.empty()) {
-        return elements[0];
     }
     
-    return nullptr;
+    return elements;
+}
+
+Element* Element::querySelector(const std::string& selector) const {
+    return css::SelectorQuery::compile(selector)->first(this);
 }
 
 std::vector<Element*> Element::querySelectorAll(const std::string& selector) const {
-    // Simplified selector implementation (only supports tag, class, and ID selectors)
-    
-    // Check if it's an ID selector (#id)
-    if (selector.size() > 1 && selector[0] == '#') {
-        std::string id = selector.substr(1);
-        Element* element = querySelector(selector);
-        if (element) {
-            return {element};
-        }
-        return {};
-    }
-    
-    // Check if it's a class selector (.class)
-    if (selector.size() > 1 && selector[0] == '.') {
-        std::string className = selector.substr(1);
-        return getElementsByClassName(className);
-    }
-    
-    // Assume it's a tag selector
-    return getElementsByTagName(selector);
+    return css::SelectorQuery::compile(selector)->all(this);
 }
 
 Element* Element::firstElementChild() const {
@@ -478,13 +563,7 @@ Element* Element::nextElementSibling() const {
 }
 
 std::string Element::innerHTML() const {
-    std::ostringstream oss;
-    
-    for (const auto& child : m_childNodes) {
-        oss << child->toString();
-    }
-    
-    return oss.str();
+    return HTMLSerializer::serializeChildren(this);
 }
 
 void Element::setInnerHTML(const std::string& html) {
@@ -500,18 +579,16 @@ void Element::setInnerHTML(const std::string& html) {
 }
 
 std::string Element::textContent() const {
-    std::ostringstream oss;
+    std::string text;
     
-    // Recursively get text content
-    for (const auto& child : m_childNodes) {
-        if (child->nodeType() == NodeType::TEXT_NODE) {
-            oss << child->nodeValue();
-        } else if (child->nodeType() == NodeType::ELEMENT_NODE) {
-            oss << static_cast<Element*>(child.get())->textContent();
+    // Concatenate descendant text nodes in document order
+    for (Node* node : preOrder(this)) {
+        if (node->nodeType() == NodeType::TEXT_NODE) {
+            text += node->m_nodeValue;
         }
     }
     
-    return oss.str();
+    return text;
 }
 
 void Element::setTextContent(const std::string& text) {
@@ -527,11 +604,11 @@ void Element::setTextContent(const std::string& text) {
 }
 
 std::shared_ptr<Node> Element::cloneNode(bool deep) const {
-    auto clone = std::make_shared<Element>(m_tagName);
+    auto clone = std::make_shared<Element>(m_tagName, m_atomTable);
     
     // Copy attributes
     for (const auto& attr : m_attributes) {
-        clone->setAttribute(attr.first, attr.second);
+        clone->setAttribute(attributeName(attr), attr.value);
     }
     
     // Clone children if deep
@@ -545,38 +622,7 @@ std::shared_ptr<Node> Element::cloneNode(bool deep) const {
 }
 
 std::string Element::toString() const {
-    std::ostringstream oss;
-    
-    // Opening tag
-    oss << "<" << m_tagName;
-    
-    // Attributes
-    for (const auto& attr : m_attributes) {
-        oss << " " << attr.first << "=\"" << attr.second << "\"";
-    }
-    
-    // Self-closing or content
-    bool selfClosing = m_tagName == "area" || m_tagName == "base" || m_tagName == "br" || 
-                       m_tagName == "col" || m_tagName == "embed" || m_tagName == "hr" || 
-                       m_tagName == "img" || m_tagName == "input" || m_tagName == "link" || 
-                       m_tagName == "meta" || m_tagName == "param" || m_tagName == "source" || 
-                       m_tagName == "track" || m_tagName == "wbr";
-    
-    if (selfClosing && m_childNodes.empty()) {
-        oss << " />";
-    } else {
-        oss << ">";
-        
-        // Children
-        for (const auto& child : m_childNodes) {
-            oss << child->toString();
-        }
-        
-        // Closing tag
-        oss << "</" << m_tagName << ">";
-    }
-    
-    return oss.str();
+    return HTMLSerializer::serialize(this);
 }
 
 //-----------------------------------------------------------------------------
@@ -603,6 +649,7 @@ std::string Text::substringData(size_t offset, size_t count) const {
 
 void Text::appendData(const std::string& data) {
     m_nodeValue += data;
+    markLayoutDirty(LAYOUT_SELF_DIRTY);
 }
 
 void Text::insertData(size_t offset, const std::string& data) {
@@ -611,6 +658,7 @@ void Text::insertData(size_t offset, const std::string& data) {
     }
     
     m_nodeValue.insert(offset, data);
+    markLayoutDirty(LAYOUT_SELF_DIRTY);
 }
 
 void Text::deleteData(size_t offset, size_t count) {
@@ -619,6 +667,7 @@ void Text::deleteData(size_t offset, size_t count) {
     }
     
     m_nodeValue.erase(offset, count);
+    markLayoutDirty(LAYOUT_SELF_DIRTY);
 }
 
 void Text::replaceData(size_t offset, size_t count, const std::string& data) {
@@ -627,6 +676,7 @@ void Text::replaceData(size_t offset, size_t count, const std::string& data) {
     }
     
     m_nodeValue.replace(offset, count, data);
+    markLayoutDirty(LAYOUT_SELF_DIRTY);
 }
 
 std::shared_ptr<Node> Text::cloneNode(bool /*deep*/) const {
@@ -634,31 +684,7 @@ std::shared_ptr<Node> Text::cloneNode(bool /*deep*/) const {
 }
 
 std::string Text::toString() const {
-    // Escape special characters for HTML output
-    std::string escaped = m_nodeValue;
-    size_t pos = 0;
-    
-    // Replace & with &amp;
-    while ((pos = escaped.find("&", pos)) != std::string::npos) {
-        escaped.replace(pos, 1, "&amp;");
-        pos += 5;
-    }
-    
-    // Replace < with &lt;
-    pos = 0;
-    while ((pos = escaped.find("<", pos)) != std::string::npos) {
-        escaped.replace(pos, 1, "&lt;");
-        pos += 4;
-    }
-    
-    // Replace > with &gt;
-    pos = 0;
-    while ((pos = escaped.find(">", pos)) != std::string::npos) {
-        escaped.replace(pos, 1, "&gt;");
-        pos += 4;
-    }
-    
-    return escaped;
+    return HTMLSerializer::serialize(this);
 }
 
 //-----------------------------------------------------------------------------
@@ -680,7 +706,7 @@ std::shared_ptr<Node> Comment::cloneNode(bool deep) const {
 }
 
 std::string Comment::toString() const {
-    return "<!--" + m_nodeValue + "-->";
+    return HTMLSerializer::serialize(this);
 }
 
 //-----------------------------------------------------------------------------
@@ -706,30 +732,18 @@ std::shared_ptr<Node> DocumentType::cloneNode(bool deep) const {
 }
 
 std::string DocumentType::toString() const {
-    std::ostringstream oss;
-    oss << "<!DOCTYPE " << m_name;
-    
-    if (!m_publicId.empty() || !m_systemId.empty()) {
-        if (!m_publicId.empty()) {
-            oss << " PUBLIC \"" << m_publicId << "\"";
-            if (!m_systemId.empty()) {
-                oss << " \"" << m_systemId << "\"";
-            }
-        } else if (!m_systemId.empty()) {
-            oss << " SYSTEM \"" << m_systemId << "\"";
-        }
-    }
-    
-    oss << ">";
-    return oss.str();
+    return HTMLSerializer::serialize(this);
 }
 
 //-----------------------------------------------------------------------------
 // Document Implementation
 //-----------------------------------------------------------------------------
 
-Document::Document()
+Document::Document(bool useArena)
     : Node(NodeType::DOCUMENT_NODE)
+    , m_arena(useArena ? std::make_shared<NodeArena>() : nullptr)
+    , m_atomTable(std::make_shared<AtomTable>())
+    , m_removedElementsOverflowed(false)
 {
     m_nodeName = "#document";
     m_ownerDocument = this;
@@ -822,171 +836,253 @@ void Document::setTitle(const std::string& title) {
     titleElement->setTextContent(title);
 }
 
+template <typename T, typename... Args>
+std::shared_ptr<T> Document::allocateNode(Args&&... args) {
+    std::shared_ptr<T> node;
+    if (m_arena) {
+        node = std::allocate_shared<T>(ArenaAllocator<T>(m_arena), std::forward<Args>(args)...);
+    } else {
+        node = std::make_shared<T>(std::forward<Args>(args)...);
+    }
+    node->m_ownerDocument = this;
+    return node;
+}
+
 std::shared_ptr<Element> Document::createElement(const std::string& tagName) {
-    auto element = std::make_shared<Element>(tagName);
-    element->m_ownerDocument = this;
-    return element;
+    return allocateNode<Element>(tagName, m_atomTable);
 }
 
 std::shared_ptr<Text> Document::createTextNode(const std::string& data) {
-    auto text = std::make_shared<Text>(data);
-    text->m_ownerDocument = this;
-    return text;
+    return allocateNode<Text>(data);
 }
 
 std::shared_ptr<Comment> Document::createComment(const std::string& data) {
-    auto comment = std::make_shared<Comment>(data);
-    comment->m_ownerDocument = this;
-    return comment;
+    return allocateNode<Comment>(data);
 }
 
 std::shared_ptr<DocumentType> Document::createDocumentType(const std::string& name, 
                                                          const std::string& publicId, 
                                                          const std::string& systemId) {
-    auto doctype = std::make_shared<DocumentType>(name, publicId, systemId);
-    doctype->m_ownerDocument = this;
-    return doctype;
-}
-
-Element* Document::getElementById(const std::string& id) const {
-    auto it = m_elementsById.find(id);
-    if (it != m_elementsById.end()) {
-        return it->second;
-    }
-    return nullptr;
+    return allocateNode<DocumentType>(name, publicId, systemId);
 }
 
-std::vector<Element*> Document::getElementsByTagName(const std::string& tagName) const {
-    std::vector<Element*> elements;
+void Document::subtreeInserted(Node* root) {
+    // Appending at the end of the document (the parser's case) keeps every
+    // list in document order
+    bool atEnd = isAtDocumentEnd(root);
     
-    Element* root = documentElement();
-    if (root) {
-        // Check if the document element matches
-        std::string rootTag = root->tagName();
-        std::string targetTag = tagName;
-        std::transform(rootTag.begin(), rootTag.end(), rootTag.begin(), ::tolower);
-        std::transform(targetTag.begin(), targetTag.end(), targetTag.begin(), ::tolower);
-        
-        if (targetTag == "*" || rootTag == targetTag) {
-            elements.push_back(root);
+    auto add = [atEnd](ElementIndex& index, Atom key, Element* element) {
+        if (key == atoms::NONE) {
+            return;
+        }
+        ElementList& list = index[key];
+        if (!list.elements.empty() && !atEnd) {
+            list.ordered = false;
+        }
+        list.elements.push_back(element);
+    };
+    
+    for (Element* element : elementsOf(root)) {
+        add(m_elementsByTag, element->tagAtom(), element);
+        add(m_elementsById, element->idAtom(), element);
+        for (Atom cls : element->classAtoms()) {
+            add(m_elementsByClass, cls, element);
         }
-        
-        // Get elements from the document element
-        std::vector<Element*> childElements = root->getElementsByTagName(tagName);
-        elements.insert(elements.end(), childElements.begin(), childElements.end());
     }
     
-    return elements;
+    // New content needs styling, and may change its siblings' styles
+    if (root->nodeType() == NodeType::ELEMENT_NODE) {
+        root->markStyleDirty(STYLE_SUBTREE_DIRTY);
+    }
+    if (root->m_parentNode) {
+        root->m_parentNode->markStyleDirty(STYLE_CHILDREN_CHANGED);
+        root->m_parentNode->markLayoutDirty(LAYOUT_CHILDREN_CHANGED);
+    }
 }
 
-std::vector<Element*> Document::getElementsByClassName(const std::string& className) const {
-    std::vector<Element*> elements;
+void Document::subtreeRemoved(Node* root) {
+    std::unordered_set<Element*> removed;
+    std::vector<std::pair<ElementIndex*, Atom>> keys;
     
-    Element* root = documentElement();
-    if (root) {
-        // Check if the document element matches
-        std::string classes = root->className();
-        std::istringstream iss(classes);
-        std::string cls;
-        bool matches = false;
-        
-        while (std::getline(iss, cls, ' ')) {
-            if (cls == className) {
-                matches = true;
-                break;
-            }
+    for (Element* element : elementsOf(root)) {
+        removed.insert(element);
+        if (!m_removedElementsOverflowed) {
+            m_removedElements.push_back(element);
         }
-        
-        if (matches) {
-            elements.push_back(root);
+        keys.emplace_back(&m_elementsByTag, element->tagAtom());
+        if (element->idAtom() != atoms::NONE) {
+            keys.emplace_back(&m_elementsById, element->idAtom());
+        }
+        for (Atom cls : element->classAtoms()) {
+            keys.emplace_back(&m_elementsByClass, cls);
         }
-        
-        // Get elements from the document element
-        std::vector<Element*> childElements = root->getElementsByClassName(className);
-        elements.insert(elements.end(), childElements.begin(), childElements.end());
     }
     
-    return elements;
-}
-
-Element* Document::querySelector(const std::string& selector) const {
-    Element* root = documentElement();
-    if (!root) {
-        return nullptr;
+    // Past the cap, style state is better rebuilt than pruned
+    if (m_removedElements.size() > maxRemovedElements) {
+        m_removedElements.clear();
+        m_removedElementsOverflowed = true;
     }
-    
-    // Check if it's an ID selector
-    if (selector.size() > 1 && selector[0] == '#') {
-        std::string id = selector.substr(1);
-        return getElementById(id);
+    if (root->m_parentNode) {
+        root->m_parentNode->markStyleDirty(STYLE_CHILDREN_CHANGED);
+        root->m_parentNode->markLayoutDirty(LAYOUT_CHILDREN_CHANGED);
     }
     
-    // Check if the document element matches
-    if (selector[0] == '.') {
-        std::string className = selector.substr(1);
-        std::string classes = root->className();
-        std::istringstream iss(classes);
-        std::string cls;
-        
-        while (std::getline(iss, cls, ' ')) {
-            if (cls == className) {
-                return root;
-            }
+    // One pass per affected list, however many of its elements went
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    
+    for (const auto& key : keys) {
+        auto it = key.first->find(key.second);
+        if (it == key.first->end()) {
+            continue;
+        }
+        std::vector<Element*>& elements = it->second.elements;
+        elements.erase(std::remove_if(elements.begin(), elements.end(),
+                                      [&removed](Element* element) { return removed.count(element) > 0; }),
+                       elements.end());
+        if (elements.empty()) {
+            key.first->erase(it);
         }
-    } else if (selector == root->tagName() || selector == "*") {
-        return root;
     }
-    
-    // Try to find in children
-    return root->querySelector(selector);
 }
 
-std::vector<Element*> Document::querySelectorAll(const std::string& selector) const {
-    std::vector<Element*> elements;
+std::vector<Element*> Document::takeRemovedElements(bool& overflowed) {
+    overflowed = m_removedElementsOverflowed;
+    m_removedElementsOverflowed = false;
+    std::vector<Element*> removed;
+    removed.swap(m_removedElements);
+    return removed;
+}
+
+void Document::attributeChanging(Element* element, Atom name) {
+    auto remove = [element](ElementIndex& index, Atom key) {
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return;
+        }
+        std::vector<Element*>& elements = it->second.elements;
+        elements.erase(std::remove(elements.begin(), elements.end(), element), elements.end());
+        if (elements.empty()) {
+            index.erase(it);
+        }
+    };
     
-    Element* root = documentElement();
-    if (!root) {
-        return elements;
+    if (name == atoms::ID) {
+        remove(m_elementsById, element->idAtom());
+    } else if (name == atoms::CLASS) {
+        for (Atom cls : element->classAtoms()) {
+            remove(m_elementsByClass, cls);
+        }
     }
-    
-    // Check if it's an ID selector
-    if (selector.size() > 1 && selector[0] == '#') {
-        std::string id = selector.substr(1);
-        Element* element = getElementById(id);
-        if (element) {
-            elements.push_back(element);
+}
+
+void Document::attributeChanged(Element* element, Atom name) {
+    auto add = [element](ElementIndex& index, Atom key) {
+        if (key == atoms::NONE) {
+            return;
         }
-        return elements;
+        ElementList& list = index[key];
+        if (!list.elements.empty()) {
+            list.ordered = false;
+        }
+        list.elements.push_back(element);
+    };
+    
+    if (name == atoms::ID) {
+        add(m_elementsById, element->idAtom());
+    } else if (name == atoms::CLASS) {
+        for (Atom cls : element->classAtoms()) {
+            add(m_elementsByClass, cls);
+        }
+    }
+}
+
+template <typename Match>
+const std::vector<Element*>* Document::lookupIndex(ElementIndex& index, Atom key, Match match) const {
+    if (key == atoms::NONE) {
+        return nullptr;
     }
     
-    // Check if the document element matches
-    bool rootMatches = false;
+    auto it = index.find(key);
+    if (it == index.end() || it->second.elements.empty()) {
+        return nullptr;
+    }
     
-    if (selector[0] == '.') {
-        std::string className = selector.substr(1);
-        std::string classes = root->className();
-        std::istringstream iss(classes);
-        std::string cls;
-        
-        while (std::getline(iss, cls, ' ')) {
-            if (cls == className) {
-                rootMatches = true;
-                break;
+    ElementList& list = it->second;
+    if (!list.ordered) {
+        // Restore document order with one walk, collecting the same set
+        list.elements.clear();
+        for (Element* element : descendantElementsOf(this)) {
+            if (match(element)) {
+                list.elements.push_back(element);
             }
         }
-    } else if (selector == root->tagName() || selector == "*") {
-        rootMatches = true;
+        list.ordered = true;
     }
     
-    if (rootMatches) {
-        elements.push_back(root);
+    return &list.elements;
+}
+
+Element* Document::getElementById(const std::string& id) const {
+    const std::vector<Element*>& elements = elementsWithId(id);
+    return elements.empty() ? nullptr : elements.front();
+}
+
+std::vector<Element*> Document::getElementsByTagName(const std::string& tagName) const {
+    std::string targetTag = tagName;
+    std::transform(targetTag.begin(), targetTag.end(), targetTag.begin(), 
+        [](unsigned char c) { return static_cast<char>(::tolower(c)); });
+    
+    if (targetTag == "*") {
+        // Every element; a walk is already proportional to the result
+        std::vector<Element*> elements;
+        Element* root = documentElement();
+        if (root) {
+            elements.push_back(root);
+            std::vector<Element*> descendants = root->getElementsByTagName(targetTag);
+            elements.insert(elements.end(), descendants.begin(), descendants.end());
+        }
+        return elements;
     }
     
-    // Add elements from children
-    std::vector<Element*> childElements = root->querySelectorAll(selector);
-    elements.insert(elements.end(), childElements.begin(), childElements.end());
-    
-    return elements;
+    return elementsWithTag(targetTag);
+}
+
+std::vector<Element*> Document::getElementsByClassName(const std::string& className) const {
+    return elementsWithClass(className);
+}
+
+const std::vector<Element*>& Document::elementsWithId(const std::string& id) const {
+    static const std::vector<Element*> kNone;
+    Atom key = m_atomTable->lookup(id);
+    const std::vector<Element*>* elements = lookupIndex(m_elementsById, key,
+        [key](const Element* element) { return element->idAtom() == key; });
+    return elements ? *elements : kNone;
+}
+
+const std::vector<Element*>& Document::elementsWithClass(const std::string& className) const {
+    static const std::vector<Element*> kNone;
+    Atom key = m_atomTable->lookup(className);
+    const std::vector<Element*>* elements = lookupIndex(m_elementsByClass, key,
+        [key](const Element* element) { return element->hasClass(key); });
+    return elements ? *elements : kNone;
+}
+
+const std::vector<Element*>& Document::elementsWithTag(const std::string& tagName) const {
+    static const std::vector<Element*> kNone;
+    Atom key = m_atomTable->lookup(tagName);
+    const std::vector<Element*>* elements = lookupIndex(m_elementsByTag, key,
+        [key](const Element* element) { return element->tagAtom() == key; });
+    return elements ? *elements : kNone;
+}
+
+Element* Document::querySelector(const std::string& selector) const {
+    return css::SelectorQuery::compile(selector)->first(this);
+}
+
+std::vector<Element*> Document::querySelectorAll(const std::string& selector) const {
+    return css::SelectorQuery::compile(selector)->all(this);
 }
 
 std::shared_ptr<Node> Document::cloneNode(bool deep) const {
@@ -1003,13 +1099,7 @@ std::shared_ptr<Node> Document::cloneNode(bool deep) const {
 }
 
 std::string Document::toString() const {
-    std::ostringstream oss;
-    
-    for (const auto& child : m_childNodes) {
-        oss << child->toString();
-    }
-    
-    return oss.str();
+    return HTMLSerializer::serializeChildren(this);
 }
 
 std::vector<std::string> Document::findStylesheetLinks() const {
@@ -1040,18 +1130,6 @@ std::vector<std::string> Document::findInlineStyles() const {
     return styles;
 }
 
-void Document::registerElementId(const std::string& id, Element* element) {
-    if (!id.empty()) {
-        m_elementsById[id] = element;
-    }
-}
-
-void Document::unregisterElementId(const std::string& id) {
-    if (!id.empty()) {
-        m_elementsById.erase(id);
-    }
-}
-
 //-----------------------------------------------------------------------------
 // DOMTree Implementation
 //-----------------------------------------------------------------------------
@@ -1067,10 +1145,12 @@ void DOMTree::initialize() {
     m_document = std::make_shared<Document>();
 }
 
-void DOMTree::setContent(const std::string& /*html*/) {
-    // Parse and set content
-    // This would be done by the HTML parser
-    // Left as an exercise for the browser implementation
+void DOMTree::setContent(const std::string& html) {
+    // Parse into a fresh document; the old document's node arena is
+    // released in one go once its last node reference drops
+    HTMLParser parser;
+    parser.initialize();
+    m_document = parser.parse(html).m_document;
 }
 
 std::string DOMTree::toHTML() const {
@@ -1081,6 +1161,12 @@ std::string DOMTree::toHTML() const {
     return m_document->toString();
 }
 
+void DOMTree::toHTML(std::ostream& out) const {
+    if (m_document) {
+        HTMLSerializer::serializeChildren(m_document.get(), out);
+    }
+}
+
 std::vector<std::string> DOMTree::findStylesheetLinks() const {
     if (!m_document) {
         return {};
@@ -1140,20 +1226,8 @@ void DOMTree::traverse(const std::function<void(Node*)>& callback) const {
         return;
     }
     
-    traverseNode(m_document.get(), callback);
-}
-
-void DOMTree::traverseNode(Node* node, const std::function<void(Node*)>& callback) const {
-    if (!node) {
-        return;
-    }
-    
-    // Call the callback for this node
-    callback(node);
-    
-    // Traverse children
-    for (const auto& child : node->childNodes()) {
-        traverseNode(child.get(), callback);
+    for (Node* node : preOrder(m_document.get())) {
+        callback(node);
     }
 }
 
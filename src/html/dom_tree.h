@@ -1,11 +1,16 @@
 #ifndef BROWSER_DOM_TREE_H
 #define BROWSER_DOM_TREE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 #include <map>
+#include <unordered_map>
 #include <functional>
+#include <iosfwd>
+#include "node_arena.h"
+#include "atom_table.h"
 
 namespace browser {
 namespace html {
@@ -27,6 +32,23 @@ enum class NodeType {
     DOCUMENT_TYPE_NODE = 10
 };
 
+// Style invalidation flags, set on connected nodes as the tree mutates and
+// cleared by css::StyleResolver when it restyles them
+enum StyleDirtyFlag : uint8_t {
+    STYLE_SELF_DIRTY = 1 << 0,          // an attribute of the element changed
+    STYLE_SUBTREE_DIRTY = 1 << 1,       // the element and its descendants are new
+    STYLE_CHILDREN_CHANGED = 1 << 2,    // a child was inserted or removed
+    STYLE_DESCENDANT_DIRTY = 1 << 3     // a descendant has one of the flags above
+};
+
+// Layout invalidation flags, set as the tree mutates or restyles and
+// cleared by layout::LayoutEngine when it brings the node's boxes up to date
+enum LayoutDirtyFlag : uint8_t {
+    LAYOUT_SELF_DIRTY = 1 << 0,         // the element's style or the text changed
+    LAYOUT_CHILDREN_CHANGED = 1 << 1,   // a child was inserted or removed
+    LAYOUT_DESCENDANT_DIRTY = 1 << 2    // a descendant has one of the flags above
+};
+
 // Base Node class
 class Node {
 public:
@@ -35,9 +57,9 @@ public:
     
     // Node properties
     NodeType nodeType() const { return m_nodeType; }
-    std::string nodeName() const { return m_nodeName; }
-    std::string nodeValue() const { return m_nodeValue; }
-    void setNodeValue(const std::string& value) { m_nodeValue = value; }
+    const std::string& nodeName() const { return m_nodeName; }
+    const std::string& nodeValue() const { return m_nodeValue; }
+    void setNodeValue(const std::string& value);
     
     // Node hierarchy
     Document* ownerDocument() const { return m_ownerDocument; }
@@ -50,6 +72,26 @@ public:
     Node* previousSibling() const { return m_previousSibling; }
     Node* nextSibling() const { return m_nextSibling; }
     
+    // True if this node is in a document's tree
+    bool isConnected() const;
+    
+    // Style invalidation; marking also flags every ancestor with
+    // STYLE_DESCENDANT_DIRTY
+    uint8_t styleDirtyFlags() const { return m_styleDirtyFlags; }
+    void markStyleDirty(uint8_t flags);
+    void clearStyleDirty() { m_styleDirtyFlags = 0; }
+    
+    // Layout invalidation; marking also flags every ancestor with
+    // LAYOUT_DESCENDANT_DIRTY
+    uint8_t layoutDirtyFlags() const { return m_layoutDirtyFlags; }
+    void markLayoutDirty(uint8_t flags);
+    void clearLayoutDirty() { m_layoutDirtyFlags = 0; }
+    
+    // Index of the node's box in the layout::LayoutTree that last built
+    // one, or UINT32_MAX; the tree checks that the box is still this node's
+    uint32_t layoutBoxIndex() const { return m_layoutBoxIndex; }
+    void setLayoutBoxIndex(uint32_t index) { m_layoutBoxIndex = index; }
+    
     // DOM operations
     std::shared_ptr<Node> appendChild(std::shared_ptr<Node> newChild);
     std::shared_ptr<Node> insertBefore(std::shared_ptr<Node> newChild, std::shared_ptr<Node> refChild);
@@ -76,10 +118,19 @@ protected:
     std::vector<std::shared_ptr<Node>> m_childNodes;
     Node* m_previousSibling;
     Node* m_nextSibling;
+    uint8_t m_styleDirtyFlags;
+    uint8_t m_layoutDirtyFlags;
+    uint32_t m_layoutBoxIndex;
     
     // Update sibling pointers after child list changes
     void updateSiblingPointers();
     
+    // Set the owner document of this node and its descendants
+    void setOwnerDocument(Document* document);
+    
+    // Called after the owner document changes
+    virtual void ownerDocumentChanged() {}
+    
     friend class Document;
     friend class Element;
     friend class Text;
@@ -87,22 +138,39 @@ protected:
     friend class HTMLParser;
 };
 
+// Element attribute with an interned name
+struct Attribute {
+    Atom name;
+    std::string value;
+};
+
 // Element node representing HTML elements
 class Element : public Node {
 public:
-    Element(const std::string& tagName);
+    // Names are interned into atomTable, or the detached table if null
+    Element(const std::string& tagName, std::shared_ptr<AtomTable> atomTable = nullptr);
     virtual ~Element();
     
     // Element properties
-    std::string tagName() const { return m_tagName; }
+    const std::string& tagName() const { return m_tagName; }
     std::string id() const;
     std::string className() const;
     
+    // Interned names; the tag atom is for the lowercased tag name
+    AtomTable* atomTable() const { return m_atomTable.get(); }
+    Atom tagAtom() const { return m_tagAtom; }
+    Atom idAtom() const { return m_idAtom; }
+    const std::vector<Atom>& classAtoms() const { return m_classAtoms; }
+    bool hasClass(Atom className) const;
+    
     // Attributes
     bool hasAttributes() const { return !m_attributes.empty(); }
-    const std::map<std::string, std::string>& attributes() const { return m_attributes; }
+    const std::vector<Attribute>& attributes() const { return m_attributes; }
+    const std::string& attributeName(const Attribute& attr) const { return m_atomTable->name(attr.name); }
     bool hasAttribute(const std::string& name) const;
+    bool hasAttribute(Atom name) const;
     std::string getAttribute(const std::string& name) const;
+    std::string getAttribute(Atom name) const;
     void setAttribute(const std::string& name, const std::string& value);
     void removeAttribute(const std::string& name);
     
@@ -132,9 +200,19 @@ public:
     // Convert to string (for debugging)
     virtual std::string toString() const override;
     
+protected:
+    virtual void ownerDocumentChanged() override;
+    
 private:
+    const Attribute* findAttribute(Atom name) const;
+    void updateClassAtoms();
+    
     std::string m_tagName;
-    std::map<std::string, std::string> m_attributes;
+    std::shared_ptr<AtomTable> m_atomTable;
+    Atom m_tagAtom;
+    Atom m_idAtom;
+    std::vector<Atom> m_classAtoms;
+    std::vector<Attribute> m_attributes;
 };
 
 // Text node for text content
@@ -144,8 +222,8 @@ public:
     virtual ~Text();
     
     // Text properties
-    std::string data() const { return m_nodeValue; }
-    void setData(const std::string& data) { m_nodeValue = data; }
+    const std::string& data() const { return m_nodeValue; }
+    void setData(const std::string& data) { setNodeValue(data); }
     size_t length() const { return m_nodeValue.length(); }
     
     // Text operations
@@ -169,7 +247,7 @@ public:
     virtual ~Comment();
     
     // Comment properties
-    std::string data() const { return m_nodeValue; }
+    const std::string& data() const { return m_nodeValue; }
     void setData(const std::string& data) { m_nodeValue = data; }
     
     // Cloning
@@ -188,9 +266,9 @@ public:
     virtual ~DocumentType();
     
     // DocumentType properties
-    std::string name() const { return m_name; }
-    std::string publicId() const { return m_publicId; }
-    std::string systemId() const { return m_systemId; }
+    const std::string& name() const { return m_name; }
+    const std::string& publicId() const { return m_publicId; }
+    const std::string& systemId() const { return m_systemId; }
     
     // Cloning
     virtual std::shared_ptr<Node> cloneNode(bool deep = false) const override;
@@ -207,9 +285,18 @@ private:
 // Document node representing the entire HTML document
 class Document : public Node {
 public:
-    Document();
+    // When useArena is set, nodes created by this document are allocated
+    // from a per-document NodeArena and released together with it
+    explicit Document(bool useArena = true);
     virtual ~Document();
     
+    // Node arena (null when arena allocation is disabled)
+    NodeArena* arena() const { return m_arena.get(); }
+    bool usesArena() const { return m_arena != nullptr; }
+    
+    // Names used by this document's elements
+    const std::shared_ptr<AtomTable>& atomTable() const { return m_atomTable; }
+    
     // Document properties
     DocumentType* doctype() const;
     Element* documentElement() const;
@@ -229,6 +316,12 @@ public:
     std::vector<Element*> getElementsByTagName(const std::string& tagName) const;
     std::vector<Element*> getElementsByClassName(const std::string& className) const;
     
+    // Indexed elements in document order (empty if none); valid until the
+    // tree or an id/class attribute changes. Tag names must be lowercase.
+    const std::vector<Element*>& elementsWithId(const std::string& id) const;
+    const std::vector<Element*>& elementsWithClass(const std::string& className) const;
+    const std::vector<Element*>& elementsWithTag(const std::string& tagName) const;
+    
     // CSS selection
     virtual Element* querySelector(const std::string& selector) const override;
     virtual std::vector<Element*> querySelectorAll(const std::string& selector) const override;
@@ -243,14 +336,53 @@ public:
     std::vector<std::string> findStylesheetLinks() const;
     std::vector<std::string> findInlineStyles() const;
     
-    // Register elements with IDs - made public for HTMLParser access
-    void registerElementId(const std::string& id, Element* element);
-    void unregisterElementId(const std::string& id);
+    // Elements removed from the tree since the last call, for dropping
+    // per-element state. The pointers may dangle and are only good as
+    // keys. Returns nothing and sets overflowed if too many were removed
+    // to keep track of.
+    std::vector<Element*> takeRemovedElements(bool& overflowed);
     
 private:
-    // ID to element mapping for fast getElementById lookup
-    std::map<std::string, Element*> m_elementsById;
-    
+    // Elements sharing an index key. Kept in document order while elements
+    // are appended at the end of the document; otherwise re-sorted on the
+    // next lookup.
+    struct ElementList {
+        std::vector<Element*> elements;
+        bool ordered = true;
+    };
+    using ElementIndex = std::unordered_map<Atom, ElementList>;
+    
+    // Allocate a node from the arena, or the heap if no arena is set
+    template <typename T, typename... Args>
+    std::shared_ptr<T> allocateNode(Args&&... args);
+    
+    // Index maintenance, called by Node and Element for connected nodes
+    void subtreeInserted(Node* root);
+    void subtreeRemoved(Node* root);
+    void attributeChanging(Element* element, Atom name);
+    void attributeChanged(Element* element, Atom name);
+    
+    // Indexed elements for a key in document order, or null if none
+    template <typename Match>
+    const std::vector<Element*>* lookupIndex(ElementIndex& index, Atom key, Match match) const;
+    
+    // Id, class and tag indexes over the connected elements
+    mutable ElementIndex m_elementsById;
+    mutable ElementIndex m_elementsByClass;
+    mutable ElementIndex m_elementsByTag;
+    
+    // Backing storage for nodes created by this document
+    std::shared_ptr<NodeArena> m_arena;
+    
+    // Interned tag/attribute names, ids and class tokens
+    std::shared_ptr<AtomTable> m_atomTable;
+    
+    // Removed elements not yet taken by takeRemovedElements
+    static constexpr size_t maxRemovedElements = 4096;
+    std::vector<Element*> m_removedElements;
+    bool m_removedElementsOverflowed;
+    
+    friend class Node;
     friend class Element;
     friend class HTMLParser;
 };
@@ -272,6 +404,7 @@ public:
     
     // Render the DOM tree as HTML
     std::string toHTML() const;
+    void toHTML(std::ostream& out) const;
     
     // Find resources in the document
     std::vector<std::string> findStylesheetLinks() const;
@@ -279,13 +412,11 @@ public:
     std::vector<std::string> findScriptSources() const;
     std::vector<std::string> findImageSources() const;
     
-    // Traverse the DOM tree
+    // Traverse the DOM tree in document order (see dom_traversal.h for
+    // iterator ranges that avoid the std::function call)
     void traverse(const std::function<void(Node*)>& callback) const;
     
 private:
-    // Recursive traversal helper
-    void traverseNode(Node* node, const std::function<void(Node*)>& callback) const;
-    
     // Document root
     std::shared_ptr<Document> m_document;
 };
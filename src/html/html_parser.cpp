@@ -1,4 +1,7 @@
 #include "html_parser.h"
+#include "html_tokenizer.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
@@ -28,8 +31,17 @@ static const std::unordered_set<std::string> kSpecialElements = {
 
 HTMLParser::HTMLParser() 
     : m_position(0)
+    , m_bufferOffset(0)
     , m_state(ParserState::DATA)
-    , m_reconsumeCurrentChar(false)
+    , m_tokenReady(false)
+    , m_inputComplete(false)
+    , m_needMoreInput(false)
+    , m_isParsing(false)
+    , m_tokenizerMode(TokenizerMode::INCREMENTAL)
+    , m_currentNode(nullptr)
+    , m_htmlElement(nullptr)
+    , m_headElement(nullptr)
+    , m_bodyElement(nullptr)
     , m_isInitialized(false)
 {
 }
@@ -43,17 +55,81 @@ bool HTMLParser::initialize() {
 }
 
 DOMTree HTMLParser::parse(const std::string& html) {
-    if (!m_isInitialized) {
-        initialize();
+    TRACE_SCOPE("html", "HTMLParser::parse");
+    ALLOC_SCOPE(HTML);
+    TRACE_COUNTER("html", "parsedBytes", static_cast<int64_t>(html.size()));
+    
+    if (m_tokenizerMode == TokenizerMode::ZERO_COPY) {
+        return parseZeroCopy(html);
     }
     
-    // Reset parser state
+    beginParse();
+    feed(html);
+    return finish();
+}
+
+DOMTree HTMLParser::parseZeroCopy(const std::string& html) {
+    beginParse();
+    
+    HTMLTokenizer tokenizer(html);
+    TokenView view;
+    while (tokenizer.next(view)) {
+        // Keep parse error positions meaningful
+        m_position = tokenizer.position();
+        processTokenView(view, tokenizer.attributes());
+    }
+    
+    m_isParsing = false;
+    m_position = 0;
+    return m_document;
+}
+
+size_t HTMLParser::countTokens(const std::string& html) {
+    resetTokenizer();
     m_html = html;
+    m_inputComplete = true;
+    
+    size_t count = 0;
+    Token token;
+    while (nextToken(token)) {
+        ++count;
+        if (token.type == TokenType::EOF_TOKEN) {
+            break;
+        }
+        // Tree construction normally switches the tokenizer to raw text
+        if (token.type == TokenType::START_TAG && !token.selfClosing && isRawTextElement(token.name)) {
+            m_state = ParserState::RAWTEXT;
+            m_rawTextEndTag = token.name;
+        }
+    }
+    
+    m_html.clear();
+    m_position = 0;
+    return count;
+}
+
+void HTMLParser::resetTokenizer() {
+    m_html.clear();
     m_position = 0;
+    m_bufferOffset = 0;
     m_state = ParserState::DATA;
-    m_reconsumeCurrentChar = false;
+    m_currentToken = Token();
+    m_tokenReady = false;
+    m_inputComplete = false;
+    m_needMoreInput = false;
     m_tempBuffer.clear();
+    m_rawTextEndTag.clear();
     m_errors.clear();
+}
+
+void HTMLParser::beginParse() {
+    if (!m_isInitialized) {
+        initialize();
+    }
+    
+    // Reset parser state
+    resetTokenizer();
+    m_isParsing = true;
     
     // Initialize DOM tree
     m_document.initialize();
@@ -73,22 +149,61 @@ DOMTree HTMLParser::parse(const std::string& html) {
     auto headElement = m_document.document()->createElement("head");
     docElement->appendChild(headElement);
     m_openElements.push(headElement);
+    m_currentNode = headElement.get();
+    
+    m_htmlElement = docElement.get();
+    m_headElement = headElement.get();
+    m_bodyElement = nullptr;
+}
+
+void HTMLParser::feed(const char* data, size_t length) {
+    TRACE_SCOPE("html", "HTMLParser::feed");
+    ALLOC_SCOPE(HTML);
+    
+    if (!m_isParsing) {
+        beginParse();
+    }
+    
+    if (data && length > 0) {
+        m_html.append(data, length);
+    }
+    
+    // Commit every token that is complete with the input seen so far
+    Token token;
+    while (nextToken(token)) {
+        processToken(token);
+    }
+    
+    compactBuffer();
+}
+
+DOMTree HTMLParser::finish() {
+    TRACE_SCOPE("html", "HTMLParser::finish");
+    ALLOC_SCOPE(HTML);
+    
+    if (!m_isParsing) {
+        beginParse();
+    }
+    
+    m_inputComplete = true;
     
-    // Process all tokens until EOF
+    // Flush remaining tokens up to and including EOF
     Token token;
-    do {
-        token = nextToken();
+    while (nextToken(token)) {
         processToken(token);
-    } while (token.type != TokenType::EOF_TOKEN);
+        if (token.type == TokenType::EOF_TOKEN) {
+            break;
+        }
+    }
+    
+    m_isParsing = false;
+    m_html.clear();
+    m_position = 0;
     
     return m_document;
 }
 
 std::shared_ptr<Element> HTMLParser::parseElement(const std::string& html) {
-    // Create a temporary document to hold the element
-    DOMTree tempDoc;
-    tempDoc.initialize();
-    
     // Parse the HTML fragment
     std::string wrappedHTML = "<div>" + html + "</div>";
     DOMTree result = parse(wrappedHTML);
@@ -103,12 +218,49 @@ std::shared_ptr<Element> HTMLParser::parseElement(const std::string& html) {
     return std::dynamic_pointer_cast<Element>(div->firstElementChild()->cloneNode(true));
 }
 
-Token HTMLParser::nextToken() {
-    // Reset the current token
-    m_currentToken = Token();
-    
+void HTMLParser::compactBuffer() {
+    // Drop consumed input once it dominates the buffer
+    if (m_position >= 64 * 1024 && m_position * 2 >= m_html.size()) {
+        m_html.erase(0, m_position);
+        m_bufferOffset += m_position;
+        m_position = 0;
+    }
+}
+
+size_t HTMLParser::lookaheadFor(ParserState state) const {
+    switch (state) {
+        case ParserState::MARKUP_DECLARATION_OPEN:
+            return 7;  // "DOCTYPE"
+        case ParserState::ATTRIBUTE_VALUE_UNQUOTED:
+            return 2;  // "/>"
+        case ParserState::RAWTEXT:
+            return m_rawTextEndTag.size() + 2;  // "</tag"
+        default:
+            return 1;
+    }
+}
+
+void HTMLParser::emitToken() {
+    m_tokenReady = true;
+}
+
+void HTMLParser::emitToken(const Token& token) {
+    m_currentToken = token;
+    m_tokenReady = true;
+}
+
+bool HTMLParser::nextToken(Token& token) {
     // Process characters until we have a complete token
-    while (hasMoreChars() || m_reconsumeCurrentChar) {
+    while (!m_tokenReady) {
+        size_t available = m_html.size() - m_position;
+        
+        if (!m_inputComplete && available < lookaheadFor(m_state)) {
+            // Wait for the next chunk; partial token state is kept
+            return false;
+        }
+        
+        bool atEOF = available == 0;
+        
         // Handle the current state
         switch (m_state) {
             case ParserState::DATA:
@@ -180,6 +332,12 @@ Token HTMLParser::nextToken() {
             case ParserState::AFTER_DOCTYPE_NAME:
                 handleAfterDOCTYPENameState();
                 break;
+            case ParserState::BOGUS_DOCTYPE:
+                handleBogusDOCTYPEState();
+                break;
+            case ParserState::RAWTEXT:
+                handleRawTextState();
+                break;
             default:
                 // Unhandled state, consume the character and stay in DATA state
                 parseError("Unhandled parser state: " + std::to_string(static_cast<int>(m_state)));
@@ -188,19 +346,31 @@ Token HTMLParser::nextToken() {
                 break;
         }
         
-        // If we've constructed a complete token, return it
-        if (m_currentToken.type != TokenType::EOF_TOKEN) {
-            return m_currentToken;
+        if (m_needMoreInput) {
+            m_needMoreInput = false;
+            return false;
+        }
+        
+        if (atEOF && !m_tokenReady) {
+            // The state had nothing left to flush; end of input
+            emitToken(Token{TokenType::EOF_TOKEN, "", "", {}, false});
+        }
+        
+        if (atEOF) {
+            // Anything after a flushed token at EOF is the EOF token
+            m_state = ParserState::DATA;
         }
     }
     
-    // If we've reached the end of the input, return an EOF token
-    return Token{TokenType::EOF_TOKEN, "", "", {}, false};
+    token = std::move(m_currentToken);
+    m_currentToken = Token();
+    m_tokenReady = false;
+    return true;
 }
 
 void HTMLParser::handleDataState() {
     if (!hasMoreChars()) {
-        m_currentToken = Token{TokenType::EOF_TOKEN, "", "", {}, false};
+        emitToken(Token{TokenType::EOF_TOKEN, "", "", {}, false});
         return;
     }
     
@@ -210,20 +380,21 @@ void HTMLParser::handleDataState() {
         m_state = ParserState::TAG_OPEN;
         consumeCharacter();
     } else {
-        // Build a text token
-        std::string text;
-        while (hasMoreChars() && currentChar() != '<') {
-            text += currentChar();
-            consumeCharacter();
+        // Build a text token from everything up to the next tag (or the end
+        // of the buffered input; adjacent text nodes are merged on insert)
+        size_t end = m_html.find('<', m_position);
+        if (end == std::string::npos) {
+            end = m_html.size();
         }
-        m_currentToken = createTextToken(text);
+        emitToken(createTextToken(m_html.substr(m_position, end - m_position)));
+        m_position = end;
     }
 }
 
 void HTMLParser::handleTagOpenState() {
     if (!hasMoreChars()) {
         parseError("EOF in tag open state");
-        m_currentToken = createTextToken("<");
+        emitToken(createTextToken("<"));
         return;
     }
     
@@ -234,17 +405,18 @@ void HTMLParser::handleTagOpenState() {
     } else if (c == '/') {
         m_state = ParserState::END_TAG_OPEN;
         consumeCharacter();
-    } else if (std::isalpha(c)) {
+    } else if (std::isalpha(static_cast<unsigned char>(c))) {
         m_currentToken = createStartToken("");
         m_state = ParserState::TAG_NAME;
         reconsume();  // Don't consume the character, reprocess it in TAG_NAME state
     } else if (c == '?') {
         parseError("Unexpected '?' in tag open state");
+        m_currentToken = createCommentToken("");
         m_state = ParserState::BOGUS_COMMENT;
         consumeCharacter();
     } else {
         parseError("Invalid character in tag open state");
-        m_currentToken = createTextToken("<");
+        emitToken(createTextToken("<"));
         reconsume();  // Don't consume the character, reprocess it in DATA state
         m_state = ParserState::DATA;
     }
@@ -253,12 +425,12 @@ void HTMLParser::handleTagOpenState() {
 void HTMLParser::handleEndTagOpenState() {
     if (!hasMoreChars()) {
         parseError("EOF in end tag open state");
-        m_currentToken = createTextToken("</");
+        emitToken(createTextToken("</"));
         return;
     }
     
     char c = currentChar();
-    if (std::isalpha(c)) {
+    if (std::isalpha(static_cast<unsigned char>(c))) {
         m_currentToken = createEndToken("");
         m_state = ParserState::TAG_NAME;
         reconsume();  // Don't consume the character, reprocess it in TAG_NAME state
@@ -268,6 +440,7 @@ void HTMLParser::handleEndTagOpenState() {
         consumeCharacter();
     } else {
         parseError("Invalid character in end tag open state");
+        m_currentToken = createCommentToken("");
         m_state = ParserState::BOGUS_COMMENT;
         reconsume();  // Don't consume the character, reprocess it in BOGUS_COMMENT state
     }
@@ -280,7 +453,7 @@ void HTMLParser::handleTagNameState() {
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         m_state = ParserState::BEFORE_ATTRIBUTE_NAME;
         consumeCharacter();
     } else if (c == '/') {
@@ -289,7 +462,7 @@ void HTMLParser::handleTagNameState() {
     } else if (c == '>') {
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the token
+        emitToken();
     } else {
         // Append to tag name
         m_currentToken.name += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
@@ -304,22 +477,16 @@ void HTMLParser::handleBeforeAttributeNameState() {
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         // Skip whitespace
         consumeCharacter();
     } else if (c == '/') {
-        // Check if next character exists
-        if (hasMoreChars()) {
-            m_state = ParserState::SELF_CLOSING_START_TAG;
-            consumeCharacter();
-        } else {
-            parseError("EOF after / in tag");
-            return;
-        }
+        m_state = ParserState::SELF_CLOSING_START_TAG;
+        consumeCharacter();
     } else if (c == '>') {
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the token
+        emitToken();
     } else if (c == '=') {
         parseError("Unexpected '=' in before attribute name state");
         m_tempBuffer = "=";  // Start attribute name with =
@@ -336,12 +503,11 @@ void HTMLParser::handleBeforeAttributeNameState() {
 void HTMLParser::handleAttributeNameState() {
     if (!hasMoreChars()) {
         parseError("EOF in attribute name state");
-        m_currentToken.attributes[m_tempBuffer] = "";  // Add the attribute
         return;
     }
     
     char c = currentChar();
-    if (std::isspace(c) || c == '/' || c == '>') {
+    if (std::isspace(static_cast<unsigned char>(c)) || c == '/' || c == '>') {
         m_currentToken.attributes[m_tempBuffer] = "";  // Add the attribute with empty value
         m_state = ParserState::AFTER_ATTRIBUTE_NAME;
         reconsume();  // Reprocess in the new state
@@ -362,7 +528,7 @@ void HTMLParser::handleAfterAttributeNameState() {
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         // Skip whitespace
         consumeCharacter();
     } else if (c == '/') {
@@ -374,7 +540,7 @@ void HTMLParser::handleAfterAttributeNameState() {
     } else if (c == '>') {
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the token
+        emitToken();
     } else {
         // Start a new attribute
         m_tempBuffer.clear();
@@ -386,12 +552,11 @@ void HTMLParser::handleAfterAttributeNameState() {
 void HTMLParser::handleBeforeAttributeValueState() {
     if (!hasMoreChars()) {
         parseError("EOF in before attribute value state");
-        m_currentToken.attributes[m_tempBuffer] = "";  // Add empty value
         return;
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         // Skip whitespace
         consumeCharacter();
     } else if (c == '"') {
@@ -407,7 +572,7 @@ void HTMLParser::handleBeforeAttributeValueState() {
         m_currentToken.attributes[m_tempBuffer] = "";  // Add empty value
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the token
+        emitToken();
     } else {
         m_state = ParserState::ATTRIBUTE_VALUE_UNQUOTED;
         m_currentToken.attributes[m_tempBuffer] = "";  // Initialize with empty value
@@ -456,12 +621,12 @@ void HTMLParser::handleAttributeValueUnquotedState() {
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         m_state = ParserState::BEFORE_ATTRIBUTE_NAME;
         consumeCharacter();
     } else if (c == '/') {
         // Check if this is the start of a self-closing tag
-        if (hasMoreChars() && peekNext() == '>') {
+        if (peekNext() == '>') {
             m_state = ParserState::SELF_CLOSING_START_TAG;
             consumeCharacter();
         } else {
@@ -472,7 +637,7 @@ void HTMLParser::handleAttributeValueUnquotedState() {
     } else if (c == '>') {
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the token
+        emitToken();
     } else if (c == '"' || c == '\'' || c == '<' || c == '=' || c == '`') {
         parseError("Unexpected character in unquoted attribute value");
         // Append to attribute value anyway
@@ -492,7 +657,7 @@ void HTMLParser::handleAfterAttributeValueQuotedState() {
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         m_state = ParserState::BEFORE_ATTRIBUTE_NAME;
         consumeCharacter();
     } else if (c == '/') {
@@ -501,7 +666,7 @@ void HTMLParser::handleAfterAttributeValueQuotedState() {
     } else if (c == '>') {
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the token
+        emitToken();
     } else {
         parseError("Unexpected character after attribute value");
         m_state = ParserState::BEFORE_ATTRIBUTE_NAME;
@@ -518,15 +683,14 @@ void HTMLParser::handleSelfClosingStartTagState() {
     char c = currentChar();
     
     // Skip whitespace between / and >
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         consumeCharacter();
         // Stay in SELF_CLOSING_START_TAG state
-        return;
     } else if (c == '>') {
         m_currentToken.selfClosing = true;
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the token
+        emitToken();
     } else {
         parseError("Unexpected character in self-closing start tag");
         m_state = ParserState::BEFORE_ATTRIBUTE_NAME;
@@ -535,41 +699,52 @@ void HTMLParser::handleSelfClosingStartTagState() {
 }
 
 void HTMLParser::handleBogusCommentState() {
-    // Create a comment token
-    m_currentToken = createCommentToken("");
-    
-    // Consume characters until > or EOF
-    while (hasMoreChars() && currentChar() != '>') {
-        m_currentToken.data += currentChar();
-        consumeCharacter();
-    }
-    
-    if (hasMoreChars()) {
-        consumeCharacter();  // Consume '>'
+    // Consume characters until > or EOF; the comment token was created on
+    // entry so a chunk boundary can fall anywhere inside it
+    size_t end = m_html.find('>', m_position);
+    if (end == std::string::npos) {
+        m_currentToken.data.append(m_html, m_position, std::string::npos);
+        m_position = m_html.size();
+        if (m_inputComplete) {
+            m_state = ParserState::DATA;
+            emitToken();
+        }
+        return;
     }
     
+    m_currentToken.data.append(m_html, m_position, end - m_position);
+    m_position = end + 1;  // Consume '>'
     m_state = ParserState::DATA;
-    return;  // Return the comment token
+    emitToken();
 }
 
 void HTMLParser::handleMarkupDeclarationOpenState() {
     if (!hasMoreChars()) {
         parseError("EOF in markup declaration open state");
-        m_currentToken = createCommentToken("");
+        emitToken(createCommentToken(""));
         return;
     }
     
-    // Check for DOCTYPE
-    if (m_position + 6 <= m_html.length() && 
-        m_html.substr(m_position, 7) == "DOCTYPE") {
-        m_position += 7;  // Skip "DOCTYPE"
-        m_state = ParserState::DOCTYPE;
-        return;
+    // Check for DOCTYPE (case-insensitive)
+    if (m_position + 7 <= m_html.length()) {
+        bool isDoctype = true;
+        static const char kDoctype[] = "doctype";
+        for (size_t i = 0; i < 7; ++i) {
+            if (std::tolower(static_cast<unsigned char>(m_html[m_position + i])) != kDoctype[i]) {
+                isDoctype = false;
+                break;
+            }
+        }
+        if (isDoctype) {
+            m_position += 7;  // Skip "DOCTYPE"
+            m_state = ParserState::DOCTYPE;
+            return;
+        }
     }
     
     // Check for comment
     if (m_position + 2 <= m_html.length() && 
-        m_html.substr(m_position, 2) == "--") {
+        m_html.compare(m_position, 2, "--") == 0) {
         m_position += 2;  // Skip "--"
         m_state = ParserState::COMMENT_START;
         m_currentToken = createCommentToken("");
@@ -578,6 +753,7 @@ void HTMLParser::handleMarkupDeclarationOpenState() {
     
     // Anything else is a bogus comment
     parseError("Invalid markup declaration");
+    m_currentToken = createCommentToken("");
     m_state = ParserState::BOGUS_COMMENT;
     reconsume();  // Reprocess in BOGUS_COMMENT state
 }
@@ -585,6 +761,7 @@ void HTMLParser::handleMarkupDeclarationOpenState() {
 void HTMLParser::handleCommentStartState() {
     if (!hasMoreChars()) {
         parseError("EOF in comment start state");
+        emitToken();
         return;
     }
     
@@ -596,7 +773,7 @@ void HTMLParser::handleCommentStartState() {
         parseError("Empty comment");
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the empty comment token
+        emitToken();
     } else {
         m_state = ParserState::COMMENT;
         reconsume();  // Reprocess in COMMENT state
@@ -606,6 +783,7 @@ void HTMLParser::handleCommentStartState() {
 void HTMLParser::handleCommentState() {
     if (!hasMoreChars()) {
         parseError("EOF in comment state");
+        emitToken();
         return;
     }
     
@@ -623,6 +801,7 @@ void HTMLParser::handleCommentState() {
 void HTMLParser::handleCommentEndDashState() {
     if (!hasMoreChars()) {
         parseError("EOF in comment end dash state");
+        emitToken();
         return;
     }
     
@@ -642,6 +821,7 @@ void HTMLParser::handleCommentEndDashState() {
 void HTMLParser::handleCommentEndState() {
     if (!hasMoreChars()) {
         parseError("EOF in comment end state");
+        emitToken();
         return;
     }
     
@@ -649,7 +829,7 @@ void HTMLParser::handleCommentEndState() {
     if (c == '>') {
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the comment token
+        emitToken();
     } else if (c == '-') {
         // Another dash, append to comment data
         m_currentToken.data += '-';
@@ -666,12 +846,12 @@ void HTMLParser::handleCommentEndState() {
 void HTMLParser::handleDOCTYPEState() {
     if (!hasMoreChars()) {
         parseError("EOF in DOCTYPE state");
-        m_currentToken = createDOCTYPEToken("", "", "", true);  // Force quirks
+        emitToken(createDOCTYPEToken("", "", "", true));  // Force quirks
         return;
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         m_state = ParserState::BEFORE_DOCTYPE_NAME;
         consumeCharacter();
     } else {
@@ -684,20 +864,19 @@ void HTMLParser::handleDOCTYPEState() {
 void HTMLParser::handleBeforeDOCTYPENameState() {
     if (!hasMoreChars()) {
         parseError("EOF in before DOCTYPE name state");
-        m_currentToken = createDOCTYPEToken("", "", "", true);  // Force quirks
+        emitToken(createDOCTYPEToken("", "", "", true));  // Force quirks
         return;
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         // Skip whitespace
         consumeCharacter();
     } else if (c == '>') {
         parseError("Missing DOCTYPE name");
-        m_currentToken = createDOCTYPEToken("", "", "", true);  // Force quirks
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the DOCTYPE token
+        emitToken(createDOCTYPEToken("", "", "", true));  // Force quirks
     } else {
         // Start DOCTYPE name
         m_tempBuffer.clear();
@@ -709,20 +888,19 @@ void HTMLParser::handleBeforeDOCTYPENameState() {
 void HTMLParser::handleDOCTYPENameState() {
     if (!hasMoreChars()) {
         parseError("EOF in DOCTYPE name state");
-        m_currentToken = createDOCTYPEToken(m_tempBuffer, "", "", true);  // Force quirks
+        emitToken(createDOCTYPEToken(m_tempBuffer, "", "", true));  // Force quirks
         return;
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         m_state = ParserState::AFTER_DOCTYPE_NAME;
         m_currentToken = createDOCTYPEToken(m_tempBuffer);
         consumeCharacter();
     } else if (c == '>') {
         m_state = ParserState::DATA;
-        m_currentToken = createDOCTYPEToken(m_tempBuffer);
         consumeCharacter();
-        return;  // Return the DOCTYPE token
+        emitToken(createDOCTYPEToken(m_tempBuffer));
     } else {
         // Append to DOCTYPE name, converting to lowercase
         m_tempBuffer += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
@@ -733,32 +911,105 @@ void HTMLParser::handleDOCTYPENameState() {
 void HTMLParser::handleAfterDOCTYPENameState() {
     if (!hasMoreChars()) {
         parseError("EOF in after DOCTYPE name state");
-        m_currentToken.type = TokenType::DOCTYPE;
-        m_currentToken.name = m_tempBuffer;
+        emitToken();
         return;
     }
     
     char c = currentChar();
-    if (std::isspace(c)) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
         // Skip whitespace
         consumeCharacter();
     } else if (c == '>') {
         m_state = ParserState::DATA;
         consumeCharacter();
-        return;  // Return the DOCTYPE token
+        emitToken();
     } else {
         // We're not handling PUBLIC or SYSTEM identifiers fully
-        // Skip until '>'
-        while (hasMoreChars() && currentChar() != '>') {
-            consumeCharacter();
+        m_state = ParserState::BOGUS_DOCTYPE;
+    }
+}
+
+void HTMLParser::handleBogusDOCTYPEState() {
+    // Skip until '>'
+    size_t end = m_html.find('>', m_position);
+    if (end == std::string::npos) {
+        m_position = m_html.size();
+        if (m_inputComplete) {
+            m_state = ParserState::DATA;
+            emitToken();
+        }
+        return;
+    }
+    
+    m_position = end + 1;  // Consume '>'
+    m_state = ParserState::DATA;
+    emitToken();
+}
+
+void HTMLParser::handleRawTextState() {
+    // Find "</tag" (case-insensitive) followed by a tag terminator
+    const size_t tagLength = m_rawTextEndTag.size();
+    size_t searchFrom = m_position;
+    size_t end = std::string::npos;
+    
+    while (true) {
+        size_t candidate = m_html.find("</", searchFrom);
+        if (candidate == std::string::npos || candidate + 2 + tagLength > m_html.size()) {
+            end = candidate;
+            break;
         }
         
-        if (hasMoreChars()) {
-            consumeCharacter();  // Consume '>'
+        bool matches = true;
+        for (size_t i = 0; i < tagLength; ++i) {
+            if (std::tolower(static_cast<unsigned char>(m_html[candidate + 2 + i])) != m_rawTextEndTag[i]) {
+                matches = false;
+                break;
+            }
         }
         
-        m_state = ParserState::DATA;
-        return;  // Return the DOCTYPE token
+        size_t after = candidate + 2 + tagLength;
+        if (matches && after == m_html.size() && !m_inputComplete) {
+            // Can't tell yet whether the tag name continues
+            end = candidate;
+            break;
+        }
+        
+        if (matches && (after == m_html.size() || m_html[after] == '>' || m_html[after] == '/' ||
+                        std::isspace(static_cast<unsigned char>(m_html[after])))) {
+            // Found the end tag; hand it to the regular tag states
+            if (candidate > m_position) {
+                emitToken(createTextToken(m_html.substr(m_position, candidate - m_position)));
+            }
+            m_position = candidate;
+            m_state = ParserState::DATA;
+            m_rawTextEndTag.clear();
+            return;
+        }
+        
+        searchFrom = candidate + 2;
+    }
+    
+    if (m_inputComplete) {
+        // Unterminated raw text runs to EOF
+        if (m_position < m_html.size()) {
+            emitToken(createTextToken(m_html.substr(m_position)));
+        }
+        m_position = m_html.size();
+        return;
+    }
+    
+    // Emit what is certainly text, holding back a possible partial end tag
+    size_t safeEnd = (end == std::string::npos) ? m_html.size() : end;
+    if (end == std::string::npos && m_html.size() - m_position > 1 && m_html.back() == '<') {
+        safeEnd = m_html.size() - 1;
+    }
+    
+    if (safeEnd > m_position) {
+        emitToken(createTextToken(m_html.substr(m_position, safeEnd - m_position)));
+        m_position = safeEnd;
+    } else {
+        // Nothing safe to emit yet
+        m_needMoreInput = true;
     }
 }
 
@@ -785,7 +1036,60 @@ void HTMLParser::processToken(const Token& token) {
     }
 }
 
+void HTMLParser::processTokenView(const TokenView& view, const std::vector<AttributeView>& attributes) {
+    // Tree construction works on Tokens; reuse one so its strings keep their
+    // capacity across tokens
+    Token& token = m_viewToken;
+    token.type = view.type;
+    token.name.assign(view.name.data(), view.name.size());
+    for (char& c : token.name) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    token.data.assign(view.data.data(), view.data.size());
+    token.selfClosing = view.selfClosing;
+    token.attributes.clear();
+    
+    if (view.type == TokenType::START_TAG) {
+        std::string name;
+        for (const auto& attr : attributes) {
+            name.assign(attr.name.data(), attr.name.size());
+            for (char& c : name) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            token.attributes[name].assign(attr.value.data(), attr.value.size());
+        }
+    }
+    
+    processToken(token);
+}
+
 void HTMLParser::insertElement(const Token& token) {
+    // <html> and <head> were created up front; merge instead of nesting
+    if (token.name == "html" || (token.name == "head" && m_headElement)) {
+        Element* existing = token.name == "html" ? m_htmlElement : m_headElement;
+        for (const auto& attr : token.attributes) {
+            if (existing && !existing->hasAttribute(attr.first)) {
+                existing->setAttribute(attr.first, attr.second);
+            }
+        }
+        return;
+    }
+    
+    if (token.name == "body") {
+        if (m_bodyElement) {
+            for (const auto& attr : token.attributes) {
+                if (!m_bodyElement->hasAttribute(attr.first)) {
+                    m_bodyElement->setAttribute(attr.first, attr.second);
+                }
+            }
+            return;
+        }
+        closeHead();
+    } else if (!isHeadContent(token.name)) {
+        // Body content before <body> implies it
+        ensureBody();
+    }
+    
     // Create new element
     auto element = m_document.document()->createElement(token.name);
     
@@ -799,6 +1103,14 @@ void HTMLParser::insertElement(const Token& token) {
         m_currentNode->appendChild(element);
     }
     
+    if (token.name == "body") {
+        m_bodyElement = element.get();
+    }
+    
+    if (m_elementInsertedCallback) {
+        m_elementInsertedCallback(element.get());
+    }
+    
     // Handle self-closing tags
     if (token.selfClosing || isSelfClosingTag(token.name)) {
         // For self-closing tags, don't push to open elements stack
@@ -809,6 +1121,54 @@ void HTMLParser::insertElement(const Token& token) {
     // For non-self-closing tags, update current node and open elements
     m_currentNode = element.get();
     m_openElements.push(element);
+    
+    // Script and style contents are not markup
+    if (isRawTextElement(token.name)) {
+        m_state = ParserState::RAWTEXT;
+        m_rawTextEndTag = token.name;
+    }
+}
+
+bool HTMLParser::isHeadContent(const std::string& tagName) {
+    return tagName == "title" || tagName == "meta" || tagName == "link" || 
+           tagName == "style" || tagName == "script" || tagName == "base" || 
+           tagName == "noscript" || tagName == "template";
+}
+
+bool HTMLParser::isRawTextElement(const std::string& tagName) {
+    return tagName == "script" || tagName == "style" || 
+           tagName == "title" || tagName == "textarea";
+}
+
+void HTMLParser::closeHead() {
+    // Pop everything above <html>
+    while (m_openElements.size() > 1) {
+        m_openElements.pop();
+    }
+    m_currentNode = m_htmlElement ? static_cast<Node*>(m_htmlElement) : m_document.document();
+}
+
+void HTMLParser::ensureBody() {
+    if (m_bodyElement) {
+        return;
+    }
+    
+    // Only implied while we're still directly in <head> or <html>
+    if (m_currentNode != m_headElement && m_currentNode != m_htmlElement) {
+        return;
+    }
+    
+    closeHead();
+    
+    auto body = m_document.document()->createElement("body");
+    m_currentNode->appendChild(body);
+    m_bodyElement = body.get();
+    m_openElements.push(body);
+    m_currentNode = body.get();
+    
+    if (m_elementInsertedCallback) {
+        m_elementInsertedCallback(body.get());
+    }
 }
 
 void HTMLParser::insertComment(const Token& token) {
@@ -825,11 +1185,23 @@ void HTMLParser::insertText(const Token& token) {
         return;
     }
     
-    auto text = m_document.document()->createTextNode(token.data);
+    // Non-whitespace text before <body> implies it
+    if (!m_bodyElement && token.data.find_first_not_of(" \t\r\n\f") != std::string::npos) {
+        ensureBody();
+    }
     
-    if (m_currentNode) {
-        m_currentNode->appendChild(text);
+    if (!m_currentNode) {
+        return;
     }
+    
+    // Text split across chunks (or tokens) extends the previous text node
+    Node* last = m_currentNode->lastChild();
+    if (last && last->nodeType() == NodeType::TEXT_NODE) {
+        static_cast<Text*>(last)->appendData(token.data);
+        return;
+    }
+    
+    m_currentNode->appendChild(m_document.document()->createTextNode(token.data));
 }
 
 void HTMLParser::insertDoctype(const Token& token) {
@@ -837,7 +1209,13 @@ void HTMLParser::insertDoctype(const Token& token) {
                                                            token.attributes.count("publicid") ? token.attributes.at("publicid") : "",
                                                            token.attributes.count("systemid") ? token.attributes.at("systemid") : "");
     
-    m_document.document()->appendChild(doctype);
+    // The doctype precedes the <html> element created in beginParse()
+    Document* document = m_document.document();
+    if (document->hasChildNodes()) {
+        document->insertBefore(doctype, document->childNodes().front());
+    } else {
+        document->appendChild(doctype);
+    }
 }
 
 void HTMLParser::endTagToken(const Token& token) {
@@ -997,9 +1375,7 @@ bool HTMLParser::isSelfClosingTag(const std::string& tagName) {
 }
 
 void HTMLParser::consumeCharacter() {
-    if (m_reconsumeCurrentChar) {
-        m_reconsumeCurrentChar = false;
-    } else if (hasMoreChars()) {
+    if (hasMoreChars()) {
         m_position++;
     }
 }
@@ -1023,12 +1399,13 @@ bool HTMLParser::hasMoreChars() const {
 }
 
 void HTMLParser::reconsume() {
-    m_reconsumeCurrentChar = true;
+    // The current character is left unconsumed, so the next state sees it
 }
 
 void HTMLParser::parseError(const std::string& message) {
-    m_errors.push_back("Error at position " + std::to_string(m_position) + ": " + message);
-    std::cerr << "HTML Parser Error: " << message << " at position " << m_position << std::endl;
+    size_t position = m_bufferOffset + m_position;
+    m_errors.push_back("Error at position " + std::to_string(position) + ": " + message);
+    std::cerr << "HTML Parser Error: " << message << " at position " << position << std::endl;
 }
 
 } // namespace html
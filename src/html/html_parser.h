@@ -7,6 +7,7 @@
 #include <memory>
 #include <stack>
 #include <map>
+#include <functional>
 
 namespace browser {
 namespace html {
@@ -14,6 +15,8 @@ namespace html {
 // Forward declarations
 class Element;
 class Node;
+struct TokenView;
+struct AttributeView;
 
 // HTML token types
 enum class TokenType {
@@ -68,7 +71,14 @@ enum class ParserState {
     DOCTYPE_SYSTEM_IDENTIFIER_DOUBLE_QUOTED,
     DOCTYPE_SYSTEM_IDENTIFIER_SINGLE_QUOTED,
     AFTER_DOCTYPE_SYSTEM_IDENTIFIER,
-    BOGUS_DOCTYPE
+    BOGUS_DOCTYPE,
+    RAWTEXT         // Contents of <script>/<style> up to the matching end tag
+};
+
+// Tokenizer used by parse(); feed() always uses the incremental one
+enum class TokenizerMode {
+    INCREMENTAL,    // Character state machine, accepts input in chunks
+    ZERO_COPY       // HTMLTokenizer over the whole buffer
 };
 
 // HTML Parser class responsible for parsing HTML documents
@@ -82,6 +92,33 @@ public:
 
     // Parse HTML content and return a DOM tree
     DOMTree parse(const std::string& html);
+    
+    void setTokenizerMode(TokenizerMode mode) { m_tokenizerMode = mode; }
+    TokenizerMode tokenizerMode() const { return m_tokenizerMode; }
+    
+    // Run only the incremental tokenizer over html and return the number of
+    // tokens (for benchmarking against HTMLTokenizer)
+    size_t countTokens(const std::string& html);
+    
+    // Incremental parsing: call beginParse(), feed() chunks as they arrive,
+    // then finish() to flush the tokenizer and get the tree. Nodes are
+    // committed to document() as soon as their tokens are complete.
+    void beginParse();
+    void feed(const char* data, size_t length);
+    void feed(const std::string& chunk) { feed(chunk.data(), chunk.size()); }
+    DOMTree finish();
+    bool isParsing() const { return m_isParsing; }
+    
+    // Document under construction (valid between beginParse() and finish())
+    Document* document() const { return m_document.document(); }
+    
+    // Called for each element as it is inserted, attributes already set
+    void setElementInsertedCallback(std::function<void(Element*)> callback) {
+        m_elementInsertedCallback = callback;
+    }
+    
+    // Parse errors from the last parse
+    const std::vector<std::string>& errors() const { return m_errors; }
 
     // Parse a single HTML element (for testing/partial parsing)
     std::shared_ptr<Element> parseElement(const std::string& html);
@@ -90,8 +127,14 @@ public:
     std::string resolveUrl(const std::string& baseUrl, const std::string& relativeUrl);
 
 private:
-    // Tokenization methods
-    Token nextToken();
+    // Tokenization methods; nextToken() returns false when it needs more input
+    bool nextToken(Token& token);
+    void emitToken();
+    void emitToken(const Token& token);
+    size_t lookaheadFor(ParserState state) const;
+    void compactBuffer();
+    void resetTokenizer();
+    DOMTree parseZeroCopy(const std::string& html);
     void consumeCharacter();
     char currentChar() const;
     char peekNext() const;
@@ -110,6 +153,7 @@ private:
     
     // Tree construction
     void processToken(const Token& token);
+    void processTokenView(const TokenView& view, const std::vector<AttributeView>& attributes);
     void insertElement(const Token& token);
     void insertComment(const Token& token);
     void insertText(const Token& token);
@@ -119,6 +163,10 @@ private:
     // Special element handling
     bool isSpecialElement(const std::string& tagName);
     bool isSelfClosingTag(const std::string& tagName);
+    bool isHeadContent(const std::string& tagName);
+    static bool isRawTextElement(const std::string& tagName);
+    void closeHead();
+    void ensureBody();
     
     // State handlers for tokenization
     void handleDataState();
@@ -144,22 +192,35 @@ private:
     void handleBeforeDOCTYPENameState();
     void handleDOCTYPENameState();
     void handleAfterDOCTYPENameState();
+    void handleBogusDOCTYPEState();
+    void handleRawTextState();
     
     // Error handling
     void parseError(const std::string& message);
     
     // Members
-    std::string m_html;
-    size_t m_position;
+    std::string m_html;          // Buffered input not yet discarded
+    size_t m_position;           // Position within m_html
+    size_t m_bufferOffset;       // Bytes discarded from the front of m_html
     ParserState m_state;
     Token m_currentToken;
+    bool m_tokenReady;
+    bool m_inputComplete;
+    bool m_needMoreInput;        // Set by a state that can't progress yet
+    bool m_isParsing;
     std::string m_tempBuffer;
-    bool m_reconsumeCurrentChar;
+    std::string m_rawTextEndTag; // Tag that ends the RAWTEXT state
+    TokenizerMode m_tokenizerMode;
+    Token m_viewToken;           // Reused by processTokenView()
+    std::function<void(Element*)> m_elementInsertedCallback;
     
     // DOM construction members
     DOMTree m_document;
     std::stack<std::shared_ptr<Element>> m_openElements;
     Node* m_currentNode;
+    Element* m_htmlElement;
+    Element* m_headElement;
+    Element* m_bodyElement;
     bool m_isInitialized;
     
     // Error tracking
@@ -0,0 +1,336 @@
+#include "html_serializer.h"
+
+namespace browser {
+namespace html {
+
+namespace {
+
+// Appends markup for subtrees to a buffer, flushing it to a sink (if any)
+// whenever it grows past HTMLSerializer::chunkSize
+class MarkupWriter {
+public:
+    MarkupWriter(std::string& buffer, const HTMLSerializer::Sink* sink)
+        : m_buffer(buffer), m_sink(sink) {}
+
+    // Node and its descendants, without recursion
+    void writeSubtree(const Node* root);
+
+    void writeChildren(const Node* parent) {
+        for (const Node* child = parent->firstChild(); child; child = child->nextSibling()) {
+            writeSubtree(child);
+        }
+    }
+
+    void flush() {
+        if (m_sink && !m_buffer.empty()) {
+            (*m_sink)(m_buffer.data(), m_buffer.size());
+            m_buffer.clear();
+        }
+    }
+
+private:
+    // Writes node's opening markup; returns true if its children and end
+    // tag should follow
+    bool writeOpening(const Node* node);
+    void writeEndTag(const Element* element);
+    void writeDoctype(const DocumentType* doctype);
+
+    void flushIfFull() {
+        if (m_sink && m_buffer.size() >= HTMLSerializer::chunkSize) {
+            flush();
+        }
+    }
+
+    std::string& m_buffer;
+    const HTMLSerializer::Sink* m_sink;
+};
+
+void MarkupWriter::writeSubtree(const Node* root) {
+    const Node* node = root;
+    while (node) {
+        if (writeOpening(node)) {
+            if (const Node* child = node->firstChild()) {
+                node = child;
+                continue;
+            }
+            writeEndTag(static_cast<const Element*>(node));
+        }
+        flushIfFull();
+
+        // Close finished ancestors until one has a next sibling
+        while (node != root && !node->nextSibling()) {
+            node = node->parentNode();
+            writeEndTag(static_cast<const Element*>(node));
+            flushIfFull();
+        }
+        node = node == root ? nullptr : node->nextSibling();
+    }
+}
+
+bool MarkupWriter::writeOpening(const Node* node) {
+    switch (node->nodeType()) {
+        case NodeType::ELEMENT_NODE: {
+            const Element* element = static_cast<const Element*>(node);
+            m_buffer += '<';
+            m_buffer += element->tagName();
+            for (const auto& attr : element->attributes()) {
+                m_buffer += ' ';
+                m_buffer += element->attributeName(attr);
+                m_buffer += "=\"";
+                HTMLSerializer::appendEscapedAttribute(attr.value, m_buffer);
+                m_buffer += '"';
+            }
+            if (!element->hasChildNodes() && HTMLSerializer::isVoidElement(element)) {
+                m_buffer += " />";
+                return false;
+            }
+            m_buffer += '>';
+            return true;
+        }
+        case NodeType::TEXT_NODE: {
+            const Element* parent = node->parentElement();
+            if (parent && HTMLSerializer::isRawTextElement(parent)) {
+                m_buffer += node->nodeValue();
+            } else {
+                HTMLSerializer::appendEscapedText(node->nodeValue(), m_buffer);
+            }
+            return false;
+        }
+        case NodeType::COMMENT_NODE:
+            m_buffer += "<!--";
+            m_buffer += node->nodeValue();
+            m_buffer += "-->";
+            return false;
+        case NodeType::DOCUMENT_TYPE_NODE:
+            writeDoctype(static_cast<const DocumentType*>(node));
+            return false;
+        case NodeType::DOCUMENT_NODE:
+            // Only its children produce markup; it never has an end tag
+            writeChildren(node);
+            return false;
+    }
+    return false;
+}
+
+void MarkupWriter::writeEndTag(const Element* element) {
+    m_buffer += "</";
+    m_buffer += element->tagName();
+    m_buffer += '>';
+}
+
+void MarkupWriter::writeDoctype(const DocumentType* doctype) {
+    m_buffer += "<!DOCTYPE ";
+    m_buffer += doctype->name();
+    if (!doctype->publicId().empty()) {
+        m_buffer += " PUBLIC \"";
+        m_buffer += doctype->publicId();
+        m_buffer += '"';
+        if (!doctype->systemId().empty()) {
+            m_buffer += " \"";
+            m_buffer += doctype->systemId();
+            m_buffer += '"';
+        }
+    } else if (!doctype->systemId().empty()) {
+        m_buffer += " SYSTEM \"";
+        m_buffer += doctype->systemId();
+        m_buffer += '"';
+    }
+    m_buffer += '>';
+}
+
+// Lower bound on the serialized size of node's subtree, ignoring escapes
+size_t estimateSize(const Node* root) {
+    size_t size = 0;
+    const Node* node = root;
+    while (node) {
+        if (node->nodeType() == NodeType::ELEMENT_NODE) {
+            const Element* element = static_cast<const Element*>(node);
+            size += 2 * element->tagName().size() + 5;
+            for (const auto& attr : element->attributes()) {
+                size += element->attributeName(attr).size() + attr.value.size() + 4;
+            }
+        } else {
+            size += node->nodeValue().size() + 7;
+        }
+
+        if (const Node* child = node->firstChild()) {
+            node = child;
+            continue;
+        }
+        while (node != root && !node->nextSibling()) {
+            node = node->parentNode();
+        }
+        node = node == root ? nullptr : node->nextSibling();
+    }
+    return size;
+}
+
+// Whether the '&' at p starts a character reference: "&name;", "&#123;"
+// or "&#x1F;". The parser keeps references undecoded, so those are
+// written back as they are; escaping them would add an "amp;" on every
+// parse and serialize.
+bool startsCharacterReference(const char* p, const char* end) {
+    const char* q = p + 1;
+    auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+    auto isHexDigit = [&](char c) { return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); };
+    auto isAlpha = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
+    
+    const char* digits;
+    if (q != end && *q == '#') {
+        ++q;
+        bool hex = q != end && (*q == 'x' || *q == 'X');
+        if (hex) {
+            ++q;
+        }
+        digits = q;
+        while (q != end && (hex ? isHexDigit(*q) : isDigit(*q))) {
+            ++q;
+        }
+    } else {
+        digits = q;
+        if (q != end && isAlpha(*q)) {
+            while (q != end && (isAlpha(*q) || isDigit(*q))) {
+                ++q;
+            }
+        }
+    }
+    return q != digits && q != end && *q == ';';
+}
+
+// Escapes selected characters, copying the runs between them in bulk
+template <bool Attribute>
+void appendEscaped(std::string_view text, std::string& out) {
+    const char* run = text.data();
+    const char* end = run + text.size();
+    for (const char* p = run; p != end; ++p) {
+        const char* replacement;
+        size_t length;
+        switch (*p) {
+            case '&':
+                if (startsCharacterReference(p, end)) continue;
+                replacement = "&amp;"; length = 5; break;
+            case '<': if (Attribute) continue; replacement = "&lt;"; length = 4; break;
+            case '>': if (Attribute) continue; replacement = "&gt;"; length = 4; break;
+            case '"': if (!Attribute) continue; replacement = "&quot;"; length = 6; break;
+            default: continue;
+        }
+        out.append(run, p - run);
+        out.append(replacement, length);
+        run = p + 1;
+    }
+    out.append(run, end - run);
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// HTMLSerializer Implementation
+//-----------------------------------------------------------------------------
+
+std::string HTMLSerializer::serialize(const Node* node) {
+    std::string html;
+    if (!node) {
+        return html;
+    }
+
+    html.reserve(estimateSize(node));
+    MarkupWriter writer(html, nullptr);
+    writer.writeSubtree(node);
+    return html;
+}
+
+void HTMLSerializer::serialize(const Node* node, std::ostream& out) {
+    serialize(node, [&out](const char* data, size_t length) {
+        out.write(data, static_cast<std::streamsize>(length));
+    });
+}
+
+void HTMLSerializer::serialize(const Node* node, const Sink& sink) {
+    if (!node || !sink) {
+        return;
+    }
+
+    std::string buffer;
+    buffer.reserve(chunkSize + chunkSize / 2);
+    MarkupWriter writer(buffer, &sink);
+    writer.writeSubtree(node);
+    writer.flush();
+}
+
+std::string HTMLSerializer::serializeChildren(const Node* node) {
+    std::string html;
+    if (!node) {
+        return html;
+    }
+
+    size_t size = 0;
+    for (const Node* child = node->firstChild(); child; child = child->nextSibling()) {
+        size += estimateSize(child);
+    }
+    html.reserve(size);
+
+    MarkupWriter writer(html, nullptr);
+    writer.writeChildren(node);
+    return html;
+}
+
+void HTMLSerializer::serializeChildren(const Node* node, std::ostream& out) {
+    serializeChildren(node, [&out](const char* data, size_t length) {
+        out.write(data, static_cast<std::streamsize>(length));
+    });
+}
+
+void HTMLSerializer::serializeChildren(const Node* node, const Sink& sink) {
+    if (!node || !sink) {
+        return;
+    }
+
+    std::string buffer;
+    buffer.reserve(chunkSize + chunkSize / 2);
+    MarkupWriter writer(buffer, &sink);
+    writer.writeChildren(node);
+    writer.flush();
+}
+
+void HTMLSerializer::appendEscapedText(std::string_view text, std::string& out) {
+    appendEscaped<false>(text, out);
+}
+
+void HTMLSerializer::appendEscapedAttribute(std::string_view value, std::string& out) {
+    appendEscaped<true>(value, out);
+}
+
+bool HTMLSerializer::isVoidElement(const Element* element) {
+    Atom tag = element->tagAtom();
+    switch (tag) {
+        case atoms::META: case atoms::LINK: case atoms::IMG:
+        case atoms::BR: case atoms::HR: case atoms::INPUT:
+            return true;
+        default:
+            break;
+    }
+    if (tag < atoms::WELL_KNOWN_COUNT) {
+        return false;
+    }
+
+    const std::string& name = element->atomTable()->name(tag);
+    return name == "area" || name == "base" || name == "col" || name == "embed" ||
+           name == "param" || name == "source" || name == "track" || name == "wbr";
+}
+
+bool HTMLSerializer::isRawTextElement(const Element* element) {
+    Atom tag = element->tagAtom();
+    if (tag == atoms::SCRIPT || tag == atoms::STYLE) {
+        return true;
+    }
+    if (tag < atoms::WELL_KNOWN_COUNT) {
+        return false;
+    }
+
+    const std::string& name = element->atomTable()->name(tag);
+    return name == "xmp" || name == "iframe" || name == "noembed" ||
+           name == "noframes" || name == "noscript" || name == "plaintext";
+}
+
+} // namespace html
+} // namespace browser
@@ -0,0 +1,50 @@
+#ifndef BROWSER_HTML_SERIALIZER_H
+#define BROWSER_HTML_SERIALIZER_H
+
+#include "dom_tree.h"
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace browser {
+namespace html {
+
+// Serializes DOM subtrees to HTML without per-node temporaries. String
+// results are written into one buffer sized up front; the streaming
+// overloads hand the output to a sink in chunks of about chunkSize bytes.
+class HTMLSerializer {
+public:
+    using Sink = std::function<void(const char* data, size_t length)>;
+
+    static constexpr size_t chunkSize = 16 * 1024;
+
+    // Markup for node and its descendants (outerHTML)
+    static std::string serialize(const Node* node);
+    static void serialize(const Node* node, std::ostream& out);
+    static void serialize(const Node* node, const Sink& sink);
+
+    // Markup for node's children only (innerHTML)
+    static std::string serializeChildren(const Node* node);
+    static void serializeChildren(const Node* node, std::ostream& out);
+    static void serializeChildren(const Node* node, const Sink& sink);
+
+    // Append text with <, > and any & not starting a character reference
+    // escaped
+    static void appendEscapedText(std::string_view text, std::string& out);
+
+    // Append an attribute value with " and any & not starting a character
+    // reference escaped
+    static void appendEscapedAttribute(std::string_view value, std::string& out);
+
+    // Elements serialized without an end tag when empty
+    static bool isVoidElement(const Element* element);
+
+    // Elements whose text children are written unescaped
+    static bool isRawTextElement(const Element* element);
+};
+
+} // namespace html
+} // namespace browser
+
+#endif // BROWSER_HTML_SERIALIZER_H
@@ -0,0 +1,457 @@
+#include "html_tokenizer.h"
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BROWSER_HTML_TOKENIZER_SSE2 1
+#endif
+
+namespace browser {
+namespace html {
+
+namespace {
+
+// Same classification as the incremental tokenizer (C locale isspace)
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+inline bool isAlpha(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) != 0;
+}
+
+inline bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Elements whose content is tokenized as raw text up to the matching end tag
+inline bool isRawTextElement(std::string_view name) {
+    return equalsIgnoreCase(name, "script") || equalsIgnoreCase(name, "style") ||
+           equalsIgnoreCase(name, "title") || equalsIgnoreCase(name, "textarea");
+}
+
+inline size_t findChar(std::string_view input, char c, size_t from) {
+    if (from >= input.size()) {
+        return input.size();
+    }
+    const void* found = std::memchr(input.data() + from, c, input.size() - from);
+    return found ? static_cast<const char*>(found) - input.data() : input.size();
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// HTMLTokenizer Implementation
+//-----------------------------------------------------------------------------
+
+HTMLTokenizer::HTMLTokenizer(std::string_view input)
+    : m_input(input)
+    , m_position(0)
+    , m_done(false)
+{
+    m_attributes.reserve(8);
+}
+
+size_t HTMLTokenizer::findMarkupOrReference(std::string_view input, size_t from) {
+    const char* data = input.data();
+    const size_t size = input.size();
+    size_t i = from;
+
+#ifdef BROWSER_HTML_TOKENIZER_SSE2
+    // 16 bytes per step: compare against both delimiters and take the first hit
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i amp = _mm_set1_epi8('&');
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, amp));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long bit;
+            _BitScanForward(&bit, static_cast<unsigned long>(mask));
+            return i + bit;
+#else
+            return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+#endif
+        }
+    }
+#endif
+
+    for (; i < size; ++i) {
+        if (data[i] == '<' || data[i] == '&') {
+            return i;
+        }
+    }
+    return size;
+}
+
+bool HTMLTokenizer::next(TokenView& token) {
+    if (m_done) {
+        return false;
+    }
+
+    token = TokenView();
+
+    while (true) {
+        if (!m_rawTextEndTag.empty() && lexRawText(token)) {
+            return true;
+        }
+
+        if (m_position >= m_input.size()) {
+            token.type = TokenType::EOF_TOKEN;
+            m_done = true;
+            return true;
+        }
+
+        if (m_input[m_position] != '<') {
+            // Text runs to the next '<'; '&' only marks the run
+            size_t start = m_position;
+            size_t end = findMarkupOrReference(m_input, start);
+            while (end < m_input.size() && m_input[end] == '&') {
+                token.hasCharacterReferences = true;
+                end = findMarkupOrReference(m_input, end + 1);
+            }
+            token.type = TokenType::TEXT;
+            token.data = m_input.substr(start, end - start);
+            m_position = end;
+            return true;
+        }
+
+        if (lexTag(token)) {
+            return true;
+        }
+        // Nothing emitted (e.g. "</>"); keep going
+    }
+}
+
+bool HTMLTokenizer::lexTag(TokenView& token) {
+    size_t start = m_position;
+    size_t next = start + 1;
+
+    if (next >= m_input.size()) {
+        token.type = TokenType::TEXT;
+        token.data = m_input.substr(start, 1);
+        m_position = next;
+        return true;
+    }
+
+    char c = m_input[next];
+    if (c == '!') {
+        m_position = next + 1;
+        return lexMarkupDeclaration(token);
+    }
+    if (c == '/') {
+        m_position = next + 1;
+        return lexEndTag(token);
+    }
+    if (c == '?') {
+        lexBogusComment(token, next + 1);
+        return true;
+    }
+    if (!isAlpha(c)) {
+        // Lone '<' is text; the following character starts the next token
+        token.type = TokenType::TEXT;
+        token.data = m_input.substr(start, 1);
+        m_position = next;
+        return true;
+    }
+
+    size_t nameEnd = next;
+    while (nameEnd < m_input.size() && !isSpace(m_input[nameEnd]) &&
+           m_input[nameEnd] != '/' && m_input[nameEnd] != '>') {
+        ++nameEnd;
+    }
+
+    token.type = TokenType::START_TAG;
+    token.name = m_input.substr(next, nameEnd - next);
+    m_position = nameEnd;
+    lexAttributes(token);
+
+    if (token.type == TokenType::EOF_TOKEN) {
+        return false;
+    }
+
+    if (!token.selfClosing && isRawTextElement(token.name)) {
+        m_rawTextEndTag = token.name;
+    }
+    return true;
+}
+
+bool HTMLTokenizer::lexEndTag(TokenView& token) {
+    if (m_position >= m_input.size()) {
+        token.type = TokenType::TEXT;
+        token.data = m_input.substr(m_position - 2, 2);
+        return true;
+    }
+
+    char c = m_input[m_position];
+    if (c == '>') {
+        // "</>" produces nothing
+        ++m_position;
+        return false;
+    }
+    if (!isAlpha(c)) {
+        lexBogusComment(token, m_position);
+        return true;
+    }
+
+    size_t nameEnd = m_position;
+    while (nameEnd < m_input.size() && !isSpace(m_input[nameEnd]) &&
+           m_input[nameEnd] != '/' && m_input[nameEnd] != '>') {
+        ++nameEnd;
+    }
+
+    token.type = TokenType::END_TAG;
+    token.name = m_input.substr(m_position, nameEnd - m_position);
+    m_position = nameEnd;
+    lexAttributes(token);
+    return token.type != TokenType::EOF_TOKEN;
+}
+
+void HTMLTokenizer::lexAttributes(TokenView& token) {
+    // Scans from just after the tag name to the closing '>'. A tag that is
+    // cut off by the end of input is dropped, as in the incremental tokenizer.
+    m_attributes.clear();
+    const size_t size = m_input.size();
+    size_t i = m_position;
+
+    auto truncated = [&]() {
+        token = TokenView();
+        token.type = TokenType::EOF_TOKEN;
+        m_attributes.clear();
+        m_position = size;
+    };
+
+    auto selfClosingTail = [&](size_t slash) -> bool {
+        // After '/': optional whitespace then '>'
+        size_t j = slash + 1;
+        while (j < size && isSpace(m_input[j])) {
+            ++j;
+        }
+        if (j >= size) {
+            return false;
+        }
+        if (m_input[j] == '>') {
+            token.selfClosing = true;
+            i = j + 1;
+            return true;
+        }
+        i = j;
+        return true;
+    };
+
+    while (true) {
+        // Before attribute name
+        while (i < size && isSpace(m_input[i])) {
+            ++i;
+        }
+        if (i >= size) {
+            truncated();
+            return;
+        }
+
+        char c = m_input[i];
+        if (c == '>') {
+            m_position = i + 1;
+            return;
+        }
+        if (c == '/') {
+            if (!selfClosingTail(i)) {
+                truncated();
+                return;
+            }
+            if (token.selfClosing) {
+                m_position = i;
+                return;
+            }
+            continue;
+        }
+
+        // Attribute name; a leading '=' is part of it
+        size_t nameStart = i;
+        if (c == '=') {
+            ++i;
+        }
+        while (i < size && !isSpace(m_input[i]) && m_input[i] != '/' &&
+               m_input[i] != '>' && m_input[i] != '=') {
+            ++i;
+        }
+        if (i >= size) {
+            truncated();
+            return;
+        }
+        AttributeView attribute;
+        attribute.name = m_input.substr(nameStart, i - nameStart);
+
+        // After attribute name
+        size_t afterName = i;
+        while (afterName < size && isSpace(m_input[afterName])) {
+            ++afterName;
+        }
+        if (afterName >= size) {
+            truncated();
+            return;
+        }
+        if (m_input[afterName] != '=') {
+            m_attributes.push_back(attribute);
+            i = afterName;
+            continue;
+        }
+
+        // Before attribute value
+        i = afterName + 1;
+        while (i < size && isSpace(m_input[i])) {
+            ++i;
+        }
+        if (i >= size) {
+            truncated();
+            return;
+        }
+
+        c = m_input[i];
+        if (c == '"' || c == '\'') {
+            size_t valueEnd = findChar(m_input, c, i + 1);
+            if (valueEnd >= size) {
+                truncated();
+                return;
+            }
+            attribute.value = m_input.substr(i + 1, valueEnd - i - 1);
+            m_attributes.push_back(attribute);
+            i = valueEnd + 1;
+            // After a quoted value anything but '/' or '>' starts a new attribute
+            continue;
+        }
+        if (c == '>') {
+            m_attributes.push_back(attribute);
+            m_position = i + 1;
+            return;
+        }
+
+        // Unquoted value ends at whitespace, '>' or "/>"
+        size_t valueStart = i;
+        while (i < size) {
+            char v = m_input[i];
+            if (isSpace(v) || v == '>') {
+                break;
+            }
+            if (v == '/' && i + 1 < size && m_input[i + 1] == '>') {
+                break;
+            }
+            ++i;
+        }
+        if (i >= size) {
+            truncated();
+            return;
+        }
+        attribute.value = m_input.substr(valueStart, i - valueStart);
+        m_attributes.push_back(attribute);
+    }
+}
+
+bool HTMLTokenizer::lexMarkupDeclaration(TokenView& token) {
+    // m_position is just past "<!"
+    const size_t size = m_input.size();
+    if (m_position >= size) {
+        token.type = TokenType::COMMENT;
+        return true;
+    }
+
+    if (m_position + 7 <= size && equalsIgnoreCase(m_input.substr(m_position, 7), "doctype")) {
+        size_t i = m_position + 7;
+        while (i < size && isSpace(m_input[i])) {
+            ++i;
+        }
+        size_t nameStart = i;
+        while (i < size && !isSpace(m_input[i]) && m_input[i] != '>') {
+            ++i;
+        }
+        token.type = TokenType::DOCTYPE;
+        token.name = m_input.substr(nameStart, i - nameStart);
+
+        // Public and system identifiers are skipped
+        size_t end = findChar(m_input, '>', i);
+        m_position = end < size ? end + 1 : size;
+        return true;
+    }
+
+    if (m_position + 2 <= size && m_input.compare(m_position, 2, "--") == 0) {
+        size_t dataStart = m_position + 2;
+        token.type = TokenType::COMMENT;
+
+        if (dataStart < size && m_input[dataStart] == '>') {
+            // "<!-->"
+            m_position = dataStart + 1;
+            return true;
+        }
+
+        size_t end = m_input.find("-->", dataStart);
+        if (end == std::string_view::npos) {
+            // Unterminated; up to two trailing dashes are a partial "-->"
+            size_t dataEnd = size;
+            for (int i = 0; i < 2 && dataEnd > dataStart && m_input[dataEnd - 1] == '-'; ++i) {
+                --dataEnd;
+            }
+            token.data = m_input.substr(dataStart, dataEnd - dataStart);
+            m_position = size;
+        } else {
+            token.data = m_input.substr(dataStart, end - dataStart);
+            m_position = end + 3;
+        }
+        return true;
+    }
+
+    lexBogusComment(token, m_position);
+    return true;
+}
+
+void HTMLTokenizer::lexBogusComment(TokenView& token, size_t start) {
+    size_t end = findChar(m_input, '>', start);
+    token.type = TokenType::COMMENT;
+    token.data = m_input.substr(start, end - start);
+    m_position = end < m_input.size() ? end + 1 : end;
+}
+
+bool HTMLTokenizer::lexRawText(TokenView& token) {
+    // Text up to "</tag" followed by a tag terminator or end of input
+    const size_t size = m_input.size();
+    const size_t tagLength = m_rawTextEndTag.size();
+    size_t searchFrom = m_position;
+    size_t end = size;
+
+    while (true) {
+        size_t candidate = m_input.find("</", searchFrom);
+        if (candidate == std::string_view::npos || candidate + 2 + tagLength > size) {
+            break;
+        }
+
+        size_t after = candidate + 2 + tagLength;
+        if (equalsIgnoreCase(m_input.substr(candidate + 2, tagLength), m_rawTextEndTag) &&
+            (after == size || m_input[after] == '>' || m_input[after] == '/' || isSpace(m_input[after]))) {
+            end = candidate;
+            break;
+        }
+        searchFrom = candidate + 2;
+    }
+
+    m_rawTextEndTag = std::string_view();
+    if (end == m_position) {
+        return false;
+    }
+
+    token.type = TokenType::TEXT;
+    token.data = m_input.substr(m_position, end - m_position);
+    m_position = end;
+    return true;
+}
+
+} // namespace html
+} // namespace browser
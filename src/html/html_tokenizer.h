@@ -0,0 +1,64 @@
+#ifndef BROWSER_HTML_TOKENIZER_H
+#define BROWSER_HTML_TOKENIZER_H
+
+#include "html_parser.h"
+#include <string_view>
+#include <vector>
+
+namespace browser {
+namespace html {
+
+// Attribute slice into the tokenizer input
+struct AttributeView {
+    std::string_view name;   // As written; not lowercased
+    std::string_view value;
+};
+
+// Token whose strings are slices into the tokenizer input. Attributes of
+// a start tag are HTMLTokenizer::attributes(), valid until the next call
+// to HTMLTokenizer::next().
+struct TokenView {
+    TokenType type = TokenType::EOF_TOKEN;
+    std::string_view name;   // Tag or doctype name, as written
+    std::string_view data;   // Text or comment data
+    bool selfClosing = false;
+    bool hasCharacterReferences = false;  // Text contains '&'
+};
+
+// Zero-copy tokenizer over a complete input buffer. Produces the same token
+// stream as HTMLParser's incremental tokenizer without copying names, text
+// or attribute values, and finds text runs with a vectorized scan.
+class HTMLTokenizer {
+public:
+    explicit HTMLTokenizer(std::string_view input);
+
+    // Advance to the next token; returns false once EOF has been returned
+    bool next(TokenView& token);
+
+    // Attributes of the last start tag
+    const std::vector<AttributeView>& attributes() const { return m_attributes; }
+
+    size_t position() const { return m_position; }
+
+    // Offset of the first '<' or '&' at or after from, or size if none
+    static size_t findMarkupOrReference(std::string_view input, size_t from);
+
+private:
+    bool lexTag(TokenView& token);
+    bool lexEndTag(TokenView& token);
+    bool lexMarkupDeclaration(TokenView& token);
+    void lexBogusComment(TokenView& token, size_t start);
+    void lexAttributes(TokenView& token);
+    bool lexRawText(TokenView& token);
+
+    std::string_view m_input;
+    size_t m_position;
+    bool m_done;
+    std::vector<AttributeView> m_attributes;
+    std::string_view m_rawTextEndTag;  // Set after <script>, <style>, ...
+};
+
+} // namespace html
+} // namespace browser
+
+#endif // BROWSER_HTML_TOKENIZER_H
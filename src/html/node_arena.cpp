@@ -0,0 +1,54 @@
+#include "node_arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace browser {
+namespace html {
+
+//-----------------------------------------------------------------------------
+// NodeArena Implementation
+//-----------------------------------------------------------------------------
+
+NodeArena::NodeArena(size_t chunkSize)
+    : m_chunkSize(chunkSize > 0 ? chunkSize : 64 * 1024)
+    , m_cursor(nullptr)
+    , m_end(nullptr)
+    , m_bytesAllocated(0)
+    , m_bytesReserved(0)
+{
+}
+
+NodeArena::~NodeArena() {
+    // Chunks are released by their unique_ptrs
+}
+
+void* NodeArena::allocate(size_t size, size_t alignment) {
+    if (alignment == 0) {
+        alignment = alignof(std::max_align_t);
+    }
+
+    uintptr_t current = reinterpret_cast<uintptr_t>(m_cursor);
+    uintptr_t aligned = (current + alignment - 1) & ~(uintptr_t(alignment) - 1);
+
+    if (!m_cursor || aligned + size > reinterpret_cast<uintptr_t>(m_end)) {
+        addChunk(size + alignment);
+        current = reinterpret_cast<uintptr_t>(m_cursor);
+        aligned = (current + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    }
+
+    m_cursor = reinterpret_cast<char*>(aligned + size);
+    m_bytesAllocated += size;
+    return reinterpret_cast<void*>(aligned);
+}
+
+void NodeArena::addChunk(size_t minSize) {
+    // Oversized requests get a dedicated chunk
+    size_t size = std::max(m_chunkSize, minSize);
+    m_chunks.emplace_back(new char[size]);
+    m_cursor = m_chunks.back().get();
+    m_end = m_cursor + size;
+    m_bytesReserved += size;
+}
+
+} // namespace html
+} // namespace browser
@@ -0,0 +1,77 @@
+#ifndef BROWSER_NODE_ARENA_H
+#define BROWSER_NODE_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace browser {
+namespace html {
+
+// Bump allocator for DOM nodes. Memory is handed out from large chunks and
+// never returned individually; all chunks are released together when the
+// arena is destroyed.
+class NodeArena {
+public:
+    explicit NodeArena(size_t chunkSize = 64 * 1024);
+    ~NodeArena();
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // Allocate raw storage with the given alignment
+    void* allocate(size_t size, size_t alignment);
+
+    // Statistics
+    size_t bytesAllocated() const { return m_bytesAllocated; }
+    size_t bytesReserved() const { return m_bytesReserved; }
+    size_t chunkCount() const { return m_chunks.size(); }
+
+private:
+    void addChunk(size_t minSize);
+
+    size_t m_chunkSize;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    char* m_cursor;
+    char* m_end;
+    size_t m_bytesAllocated;
+    size_t m_bytesReserved;
+};
+
+// Standard allocator backed by a NodeArena, for use with std::allocate_shared.
+// Each allocator keeps the arena alive, so a node (and its control block)
+// that outlives its Document remains valid.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(std::shared_ptr<NodeArena> arena)
+        : m_arena(std::move(arena)) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : m_arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // Individual frees are no-ops; memory goes back with the arena
+    void deallocate(T* /*p*/, size_t /*n*/) {}
+
+    const std::shared_ptr<NodeArena>& arena() const { return m_arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.arena(); }
+
+private:
+    std::shared_ptr<NodeArena> m_arena;
+};
+
+} // namespace html
+} // namespace browser
+
+#endif // BROWSER_NODE_ARENA_H
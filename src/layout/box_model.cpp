@@ -1,4 +1,7 @@
 #include "box_model.h"
+#include "layout_cache.h"
+#include "text_metrics.h"
+#include "../threading/work_pool.h"
 #include <algorithm>
 #include <cmath>
 #include <iostream>
@@ -10,13 +13,22 @@ namespace layout {
 // Box Implementation
 //-----------------------------------------------------------------------------
 
-Box::Box(html::Element* element, const css::ComputedStyle& style)
-    : m_element(element)
-    , m_style(style)
-    , m_parent(nullptr)
-    , m_displayType(DisplayType::BLOCK)
+Box::Box(LayoutTree& tree, BoxIndex index, html::Element* element, css::ComputedStylePtr style)
+    : m_tree(&tree)
+    , m_index(index)
+    , m_element(element)
+    , m_style(style ? std::move(style) : std::make_shared<const css::ComputedStyle>())
     , m_positionType(PositionType::STATIC)
     , m_floatType(FloatType::NONE)
+    , m_needsLayout(true)
+    , m_childNeedsLayout(false)
+    , m_layoutWidth(-1)
+    , m_layoutX(0)
+    , m_layoutY(0)
+    , m_layoutDeferred(false)
+    , m_subtreeSize(1)
+    , m_containsFloats(false)
+    , m_paintGeneration(tree.paintGeneration())
 {
     initializeBoxProperties();
 }
@@ -24,110 +36,227 @@ Box::Box(html::Element* element, const css::ComputedStyle& style)
 Box::~Box() {
 }
 
-void Box::addChild(std::shared_ptr<Box> child) {
+void Box::addChild(Box* child) {
     if (child) {
-        child->setParent(this);
-        m_children.push_back(child);
+        m_tree->appendChild(m_index, child->m_index);
+    }
+}
+
+void Box::markNeedsLayout() {
+    m_needsLayout = true;
+    
+    // Cached layouts of the subtrees holding the box are stale
+    LayoutCache* cache = m_tree->layoutCache();
+    if (cache) {
+        cache->invalidate(m_index);
+    }
+    
+    // Ancestors that already have the flag have had theirs set too, and
+    // their cached layouts dropped
+    for (Box* ancestor = parent(); ancestor && !ancestor->m_childNeedsLayout; ancestor = ancestor->parent()) {
+        ancestor->m_childNeedsLayout = true;
+        if (cache) {
+            cache->invalidate(ancestor->m_index);
+        }
+    }
+}
+
+void Box::markPaintChanged() {
+    // Layout runs top down, so the ancestors of a box being laid out are
+    // stamped already and parallel layout stops at its own subtree
+    uint64_t generation = m_tree->paintGeneration();
+    for (Box* box = this; box && box->m_paintGeneration != generation; box = box->parent()) {
+        box->m_paintGeneration = generation;
+    }
+}
+
+bool Box::isLaidOut() const {
+    for (const Box* box = this; box; box = box->parent()) {
+        if (box->m_layoutDeferred) {
+            return false;
+        }
+    }
+    return true;
+}
+
+float Box::estimatedHeight() const {
+    if (m_layoutWidth >= 0) {
+        return contentRect().height;
+    }
+    return m_subtreeSize * m_tree->estimatedBoxHeight();
+}
+
+void Box::deferLayout(float availableWidth) {
+    float height = estimatedHeight();
+    
+    // Placed as BlockBox::layout would, without visiting the children
+    Box* parentBox = parent();
+    float originX = parentBox ? parentBox->contentRect().x : 0;
+    float originY = parentBox ? parentBox->contentRect().y + parentBox->contentRect().height : 0;
+    beginLayout(availableWidth, originX, originY);
+    calculateWidth(availableWidth);
+    calculatePosition(originX, originY);
+    rect().height = height;
+    
+    // Not finishLayout(): there's no layout to cache
+    m_needsLayout = false;
+    m_childNeedsLayout = false;
+    m_layoutDeferred = true;
+    m_tree->addDeferredBox(m_index);
+}
+
+void Box::updateSubtreeInfo() {
+    m_subtreeSize = 1;
+    m_containsFloats = m_floatType != FloatType::NONE;
+    for (Box* child : children()) {
+        child->updateSubtreeInfo();
+        m_subtreeSize += child->m_subtreeSize;
+        m_containsFloats |= child->m_containsFloats;
+    }
+}
+
+bool Box::reuseLayout(float availableWidth, float x, float y) {
+    if (!layoutIsCurrent(availableWidth)) {
+        // A clean subtree may have been laid out at this width before
+        LayoutCache* cache = m_tree->layoutCache();
+        if (!cache || m_needsLayout || m_childNeedsLayout || m_layoutDeferred ||
+            !cache->restore(*this, availableWidth, x, y)) {
+            return false;
+        }
+        calculatePosition(x, y);
+        return true;
+    }
+    
+    // Sizes don't depend on the origin, so the subtree only moves
+    float dx = x - m_layoutX;
+    float dy = y - m_layoutY;
+    if (dx != 0 || dy != 0) {
+        for (Box* child : children()) {
+            child->translate(dx, dy);
+        }
+        m_layoutX = x;
+        m_layoutY = y;
+    }
+    calculatePosition(x, y);
+    return true;
+}
+
+void Box::beginLayout(float availableWidth, float x, float y) {
+    markPaintChanged();
+    rect() = Rect();
+    m_layoutWidth = availableWidth;
+    m_layoutX = x;
+    m_layoutY = y;
+}
+
+void Box::finishLayout() {
+    m_needsLayout = false;
+    m_childNeedsLayout = false;
+    m_layoutDeferred = false;
+    
+    if (LayoutCache* cache = m_tree->layoutCache()) {
+        cache->store(*this);
+    }
+}
+
+void Box::translate(float dx, float dy) {
+    markPaintChanged();
+    Rect& content = rect();
+    content.x += dx;
+    content.y += dy;
+    m_layoutX += dx;
+    m_layoutY += dy;
+    if (m_layoutDeferred) {
+        return;
+    }
+    for (Box* child : children()) {
+        child->translate(dx, dy);
     }
 }
 
 Rect Box::borderBox() const {
+    const Rect& content = m_tree->contentRect(m_index);
+    const EdgeSizes& padding = m_tree->padding(m_index);
+    const EdgeSizes& border = m_tree->border(m_index);
     return Rect(
-        m_contentRect.x - m_padding.left - m_border.left,
-        m_contentRect.y - m_padding.top - m_border.top,
-        m_contentRect.width + m_padding.left + m_padding.right + m_border.left + m_border.right,
-        m_contentRect.height + m_padding.top + m_padding.bottom + m_border.top + m_border.bottom
+        content.x - padding.left - border.left,
+        content.y - padding.top - border.top,
+        content.width + padding.left + padding.right + border.left + border.right,
+        content.height + padding.top + padding.bottom + border.top + border.bottom
     );
 }
 
 Rect Box::marginBox() const {
     Rect border = borderBox();
+    const EdgeSizes& margin = m_tree->margin(m_index);
     return Rect(
-        border.x - m_margin.left,
-        border.y - m_margin.top,
-        border.width + m_margin.left + m_margin.right,
-        border.height + m_margin.top + m_margin.bottom
+        border.x - margin.left,
+        border.y - margin.top,
+        border.width + margin.left + margin.right,
+        border.height + margin.top + margin.bottom
     );
 }
 
 void Box::initializeBoxProperties() {
     // Parse display type
-    css::Value displayValue = m_style.getProperty("display");
-    std::string displayStr = displayValue.stringValue();
-    
-    if (displayStr == "none") {
-        m_displayType = DisplayType::NONE;
-    } else if (displayStr == "block") {
-        m_displayType = DisplayType::BLOCK;
-    } else if (displayStr == "inline") {
-        m_displayType = DisplayType::INLINE;
-    } else if (displayStr == "inline-block") {
-        m_displayType = DisplayType::INLINE_BLOCK;
-    } else if (displayStr == "flex") {
-        m_displayType = DisplayType::FLEX;
-    } else if (displayStr == "grid") {
-        m_displayType = DisplayType::GRID;
-    } else if (displayStr == "table") {
-        m_displayType = DisplayType::TABLE;
-    } else if (displayStr == "table-row") {
-        m_displayType = DisplayType::TABLE_ROW;
-    } else if (displayStr == "table-cell") {
-        m_displayType = DisplayType::TABLE_CELL;
-    } else {
-        // Default to block if not recognized
-        m_displayType = DisplayType::BLOCK;
+    switch (m_style->getProperty(css::PropertyId::DISPLAY).keyword()) {
+        case css::Keyword::NONE: setDisplayType(DisplayType::NONE); break;
+        case css::Keyword::INLINE: setDisplayType(DisplayType::INLINE); break;
+        case css::Keyword::INLINE_BLOCK: setDisplayType(DisplayType::INLINE_BLOCK); break;
+        case css::Keyword::FLEX: setDisplayType(DisplayType::FLEX); break;
+        case css::Keyword::GRID: setDisplayType(DisplayType::GRID); break;
+        case css::Keyword::TABLE: setDisplayType(DisplayType::TABLE); break;
+        case css::Keyword::TABLE_ROW: setDisplayType(DisplayType::TABLE_ROW); break;
+        case css::Keyword::TABLE_CELL: setDisplayType(DisplayType::TABLE_CELL); break;
+        default:
+            // Block, or not recognized
+            setDisplayType(DisplayType::BLOCK);
+            break;
     }
     
     // Parse position type
-    css::Value positionValue = m_style.getProperty("position");
-    std::string positionStr = positionValue.stringValue();
-    
-    if (positionStr == "static") {
-        m_positionType = PositionType::STATIC;
-    } else if (positionStr == "relative") {
-        m_positionType = PositionType::RELATIVE;
-    } else if (positionStr == "absolute") {
-        m_positionType = PositionType::ABSOLUTE;
-    } else if (positionStr == "fixed") {
-        m_positionType = PositionType::FIXED;
-    } else if (positionStr == "sticky") {
-        m_positionType = PositionType::STICKY;
-    } else {
-        // Default to static if not recognized
-        m_positionType = PositionType::STATIC;
+    switch (m_style->getProperty(css::PropertyId::POSITION).keyword()) {
+        case css::Keyword::RELATIVE: m_positionType = PositionType::RELATIVE; break;
+        case css::Keyword::ABSOLUTE: m_positionType = PositionType::ABSOLUTE; break;
+        case css::Keyword::FIXED: m_positionType = PositionType::FIXED; break;
+        case css::Keyword::STICKY: m_positionType = PositionType::STICKY; break;
+        default:
+            // Static, or not recognized
+            m_positionType = PositionType::STATIC;
+            break;
     }
     
     // Parse float type
-    css::Value floatValue = m_style.getProperty("float");
-    std::string floatStr = floatValue.stringValue();
-    
-    if (floatStr == "left") {
-        m_floatType = FloatType::LEFT;
-    } else if (floatStr == "right") {
-        m_floatType = FloatType::RIGHT;
-    } else {
-        m_floatType = FloatType::NONE;
+    switch (m_style->getProperty(css::PropertyId::FLOAT).keyword()) {
+        case css::Keyword::LEFT: m_floatType = FloatType::LEFT; break;
+        case css::Keyword::RIGHT: m_floatType = FloatType::RIGHT; break;
+        default: m_floatType = FloatType::NONE; break;
     }
     
     // Parse margins
-    float containerWidth = m_parent ? m_parent->contentRect().width : 0;
+    Box* parentBox = parent();
+    float containerWidth = parentBox ? parentBox->contentRect().width : 0;
+    
+    EdgeSizes& margin = margins();
+    EdgeSizes& border = borders();
+    EdgeSizes& padding = paddings();
     
-    m_margin.top = parseLength(m_style.getProperty("margin-top"), containerWidth);
-    m_margin.right = parseLength(m_style.getProperty("margin-right"), containerWidth);
-    m_margin.bottom = parseLength(m_style.getProperty("margin-bottom"), containerWidth);
-    m_margin.left = parseLength(m_style.getProperty("margin-left"), containerWidth);
+    margin.top = parseLength(m_style->getProperty(css::PropertyId::MARGIN_TOP), containerWidth);
+    margin.right = parseLength(m_style->getProperty(css::PropertyId::MARGIN_RIGHT), containerWidth);
+    margin.bottom = parseLength(m_style->getProperty(css::PropertyId::MARGIN_BOTTOM), containerWidth);
+    margin.left = parseLength(m_style->getProperty(css::PropertyId::MARGIN_LEFT), containerWidth);
     
     // Parse borders
-    m_border.top = parseLength(m_style.getProperty("border-top-width"), containerWidth);
-    m_border.right = parseLength(m_style.getProperty("border-right-width"), containerWidth);
-    m_border.bottom = parseLength(m_style.getProperty("border-bottom-width"), containerWidth);
-    m_border.left = parseLength(m_style.getProperty("border-left-width"), containerWidth);
+    border.top = parseLength(m_style->getProperty(css::PropertyId::BORDER_TOP_WIDTH), containerWidth);
+    border.right = parseLength(m_style->getProperty(css::PropertyId::BORDER_RIGHT_WIDTH), containerWidth);
+    border.bottom = parseLength(m_style->getProperty(css::PropertyId::BORDER_BOTTOM_WIDTH), containerWidth);
+    border.left = parseLength(m_style->getProperty(css::PropertyId::BORDER_LEFT_WIDTH), containerWidth);
     
     // Parse padding
-    m_padding.top = parseLength(m_style.getProperty("padding-top"), containerWidth);
-    m_padding.right = parseLength(m_style.getProperty("padding-right"), containerWidth);
-    m_padding.bottom = parseLength(m_style.getProperty("padding-bottom"), containerWidth);
-    m_padding.left = parseLength(m_style.getProperty("padding-left"), containerWidth);
+    padding.top = parseLength(m_style->getProperty(css::PropertyId::PADDING_TOP), containerWidth);
+    padding.right = parseLength(m_style->getProperty(css::PropertyId::PADDING_RIGHT), containerWidth);
+    padding.bottom = parseLength(m_style->getProperty(css::PropertyId::PADDING_BOTTOM), containerWidth);
+    padding.left = parseLength(m_style->getProperty(css::PropertyId::PADDING_LEFT), containerWidth);
 }
 
 float Box::parseLength(const css::Value& value, float containerSize, float defaultValue) {
@@ -164,65 +293,83 @@ float Box::parseLength(const css::Value& value, float containerSize, float defau
 
 void Box::calculateWidth(float availableWidth) {
     // Default implementation for width calculation
-    css::Value widthValue = m_style.getProperty("width");
+    const css::Value& widthValue = m_style->getProperty(css::PropertyId::WIDTH);
     
     float width = availableWidth;
     
-    if (widthValue.stringValue() != "auto") {
+    if (!widthValue.isKeyword(css::Keyword::AUTO)) {
         width = parseLength(widthValue, availableWidth);
     }
     
     // Account for padding and border
-    width -= (m_padding.left + m_padding.right + m_border.left + m_border.right);
+    const EdgeSizes& padding = paddings();
+    const EdgeSizes& border = borders();
+    width -= (padding.left + padding.right + border.left + border.right);
     
     // Ensure width is at least 0
     width = std::max(0.0f, width);
     
-    m_contentRect.width = width;
+    rect().width = width;
 }
 
 void Box::calculatePosition(float x, float y) {
-    m_contentRect.x = x + m_margin.left + m_border.left + m_padding.left;
-    m_contentRect.y = y + m_margin.top + m_border.top + m_padding.top;
+    const EdgeSizes& margin = margins();
+    const EdgeSizes& border = borders();
+    const EdgeSizes& padding = paddings();
+    Rect& content = rect();
+    float contentX = x + margin.left + border.left + padding.left;
+    float contentY = y + margin.top + border.top + padding.top;
+    if (contentX != content.x || contentY != content.y) {
+        markPaintChanged();
+        content.x = contentX;
+        content.y = contentY;
+    }
 }
 
 void Box::calculateHeight() {
     // Default implementation for height calculation
-    css::Value heightValue = m_style.getProperty("height");
+    const css::Value& heightValue = m_style->getProperty(css::PropertyId::HEIGHT);
     
     float height = 0;
     
-    if (heightValue.stringValue() != "auto") {
-        height = parseLength(heightValue, m_parent ? m_parent->contentRect().height : 0);
+    if (!heightValue.isKeyword(css::Keyword::AUTO)) {
+        Box* parentBox = parent();
+        height = parseLength(heightValue, parentBox ? parentBox->contentRect().height : 0);
     } else {
         // For auto height, use the heights of children
-        for (const auto& child : m_children) {
-            height = std::max(height, child->marginBox().bottom() - m_contentRect.y);
+        for (Box* child : children()) {
+            height = std::max(height, child->marginBox().bottom() - rect().y);
         }
     }
     
-    m_contentRect.height = height;
+    rect().height = height;
 }
 
 void Box::layout(float availableWidth) {
+    if (reuseLayout(availableWidth, 0, 0)) {
+        return;
+    }
+    
     // Default layout implementation
+    beginLayout(availableWidth, 0, 0);
     calculateWidth(availableWidth);
     calculatePosition(0, 0);
     
     // Layout children
-    for (const auto& child : m_children) {
-        child->layout(m_contentRect.width);
+    for (Box* child : children()) {
+        child->layout(rect().width);
     }
     
     calculateHeight();
+    finishLayout();
 }
 
 //-----------------------------------------------------------------------------
 // BlockBox Implementation
 //-----------------------------------------------------------------------------
 
-BlockBox::BlockBox(html::Element* element, const css::ComputedStyle& style)
-    : Box(element, style)
+BlockBox::BlockBox(LayoutTree& tree, BoxIndex index, html::Element* element, css::ComputedStylePtr style)
+    : Box(tree, index, element, std::move(style))
 {
 }
 
@@ -230,18 +377,19 @@ BlockBox::~BlockBox() {
 }
 
 void BlockBox::calculateWidth(float availableWidth) {
-    css::Value widthValue = m_style.getProperty("width");
+    const css::Value& widthValue = m_style->getProperty(css::PropertyId::WIDTH);
     float containerWidth = availableWidth;
     
     // Calculate width based on the CSS width property
-    float width = containerWidth - m_margin.left - m_margin.right;
+    const EdgeSizes& margin = margins();
+    float width = containerWidth - margin.left - margin.right;
     
-    if (widthValue.stringValue() != "auto") {
+    if (!widthValue.isKeyword(css::Keyword::AUTO)) {
         width = parseLength(widthValue, containerWidth);
     }
     
     // Set the content width
-    m_contentRect.width = width;
+    rect().width = width;
 }
 
 void BlockBox::calculatePosition(float x, float y) {
@@ -249,55 +397,128 @@ void BlockBox::calculatePosition(float x, float y) {
 }
 
 void BlockBox::calculateHeight() {
-    css::Value heightValue = m_style.getProperty("height");
-    float containerHeight = m_parent ? m_parent->contentRect().height : 0;
+    const css::Value& heightValue = m_style->getProperty(css::PropertyId::HEIGHT);
+    Box* parentBox = parent();
+    float containerHeight = parentBox ? parentBox->contentRect().height : 0;
     
     // Calculate height based on the CSS height property
-    if (heightValue.stringValue() != "auto") {
-        m_contentRect.height = parseLength(heightValue, containerHeight);
+    Rect& content = rect();
+    if (!heightValue.isKeyword(css::Keyword::AUTO)) {
+        content.height = parseLength(heightValue, containerHeight);
     } else {
         // For auto height, calculate based on children
-        float maxChildBottom = m_contentRect.y;
+        float maxChildBottom = content.y;
         
-        for (const auto& child : m_children) {
+        for (Box* child : children()) {
             maxChildBottom = std::max(maxChildBottom, child->marginBox().bottom());
         }
         
-        m_contentRect.height = maxChildBottom - m_contentRect.y;
+        content.height = maxChildBottom - content.y;
     }
 }
 
 void BlockBox::layout(float availableWidth) {
+    Box* parentBox = parent();
+    float originX = parentBox ? parentBox->contentRect().x : 0;
+    float originY = parentBox ? parentBox->contentRect().y + parentBox->contentRect().height : 0;
+    if (reuseLayout(availableWidth, originX, originY)) {
+        return;
+    }
+    
     // Calculate the box dimensions
+    beginLayout(availableWidth, originX, originY);
     calculateWidth(availableWidth);
-    calculatePosition(m_parent ? m_parent->contentRect().x : 0, 
-                      m_parent ? m_parent->contentRect().y + m_parent->contentRect().height : 0);
-    
-    // Layout children
-    float y = m_contentRect.y;
+    calculatePosition(originX, originY);
+    
+    // Layout children. A child's layout only depends on this box's width
+    // and origin, not on its siblings, so independent children can be laid
+    // out concurrently before the positioning pass. Boxes aren't added
+    // during layout, so the reference into the tree stays valid.
+    const Rect& content = rect();
+    bool lazy = m_tree->hasLayoutWindow();
+    threading::WorkPool* pool = m_tree->workPool();
+    if (!lazy && (!pool || !layoutChildrenInParallel(*pool))) {
+        for (Box* child : children()) {
+            child->layout(content.width);
+        }
+    }
     
-    for (const auto& child : m_children) {
-        child->layout(m_contentRect.width);
+    float y = content.y;
+    for (Box* child : children()) {
+        // Lazy layout decides once the children above are placed
+        if (lazy) {
+            layoutChildLazily(child, y);
+        }
         
         // Position the child
         if (child->displayType() == DisplayType::BLOCK) {
-            child->calculatePosition(m_contentRect.x, y);
+            child->calculatePosition(content.x, y);
             y = child->marginBox().bottom();
         }
     }
     
     // Calculate the final height
     calculateHeight();
+    finishLayout();
+}
+
+bool BlockBox::isIndependentBlock(const Box* child) const {
+    return child->displayType() == DisplayType::BLOCK &&
+           child->floatType() == FloatType::NONE &&
+           (child->positionType() == PositionType::STATIC || child->positionType() == PositionType::RELATIVE) &&
+           !child->containsFloats();
+}
+
+bool BlockBox::isParallelCandidate(const Box* child) const {
+    // Enough work left to be worth a task
+    return isIndependentBlock(child) &&
+           child->subtreeSize() >= minParallelSubtree &&
+           !child->layoutIsCurrent(contentRect().width);
+}
+
+void BlockBox::layoutChildLazily(Box* child, float y) {
+    float width = contentRect().width;
+    if (isIndependentBlock(child) && !child->layoutIsCurrent(width) &&
+        !m_tree->inLayoutWindow(y, y + child->estimatedHeight())) {
+        child->deferLayout(width);
+    } else {
+        child->layout(width);
+    }
+}
+
+bool BlockBox::layoutChildrenInParallel(threading::WorkPool& pool) {
+    size_t candidates = 0;
+    for (Box* child : children()) {
+        if (isParallelCandidate(child) && ++candidates >= 2) {
+            break;
+        }
+    }
+    if (candidates < 2) {
+        return false;
+    }
+    
+    // The small children are laid out here while the tasks run
+    float width = contentRect().width;
+    threading::TaskGroup group(pool);
+    for (Box* child : children()) {
+        if (isParallelCandidate(child)) {
+            group.run([child, width] { child->layout(width); });
+        } else {
+            child->layout(width);
+        }
+    }
+    group.wait();
+    return true;
 }
 
 //-----------------------------------------------------------------------------
 // InlineBox Implementation
 //-----------------------------------------------------------------------------
 
-InlineBox::InlineBox(html::Element* element, const css::ComputedStyle& style)
-    : Box(element, style)
+InlineBox::InlineBox(LayoutTree& tree, BoxIndex index, html::Element* element, css::ComputedStylePtr style)
+    : Box(tree, index, element, std::move(style))
 {
-    m_displayType = DisplayType::INLINE;
+    setDisplayType(DisplayType::INLINE);
 }
 
 InlineBox::~InlineBox() {
@@ -308,12 +529,12 @@ void InlineBox::calculateWidth(float availableWidth) {
     float width = 0;
     
     // Sum the widths of children for inline elements
-    for (const auto& child : m_children) {
+    for (Box* child : children()) {
         width += child->marginBox().width;
     }
     
     // Add padding and border
-    m_contentRect.width = width;
+    rect().width = width;
 }
 
 void InlineBox::calculatePosition(float x, float y) {
@@ -322,7 +543,7 @@ void InlineBox::calculatePosition(float x, float y) {
 
 void InlineBox::calculateHeight() {
     // For inline elements, height is determined by line height
-    css::Value lineHeightValue = m_style.getProperty("line-height");
+    const css::Value& lineHeightValue = m_style->getProperty(css::PropertyId::LINE_HEIGHT);
     float lineHeight = 1.2f * 16.0f; // Default line height: 1.2em
     
     if (lineHeightValue.type() == css::ValueType::LENGTH || 
@@ -332,38 +553,46 @@ void InlineBox::calculateHeight() {
     
     // For inline boxes with children, use the max height of children
     float maxHeight = 0;
-    for (const auto& child : m_children) {
+    for (Box* child : children()) {
         maxHeight = std::max(maxHeight, child->marginBox().height);
     }
     
-    m_contentRect.height = std::max(lineHeight, maxHeight);
+    rect().height = std::max(lineHeight, maxHeight);
 }
 
 void InlineBox::layout(float availableWidth) {
-    // Calculate dimensions
-    calculateWidth(availableWidth);
-    calculatePosition(m_parent ? m_parent->contentRect().x : 0, 
-                     m_parent ? m_parent->contentRect().y : 0);
+    Box* parentBox = parent();
+    float originX = parentBox ? parentBox->contentRect().x : 0;
+    float originY = parentBox ? parentBox->contentRect().y : 0;
+    if (reuseLayout(availableWidth, originX, originY)) {
+        return;
+    }
+    
+    beginLayout(availableWidth, originX, originY);
+    calculatePosition(originX, originY);
     
     // Layout children in a horizontal line
-    float x = m_contentRect.x;
+    const Rect& content = rect();
+    float x = content.x;
     
-    for (const auto& child : m_children) {
-        child->layout(availableWidth - (x - m_contentRect.x));
-        child->calculatePosition(x, m_contentRect.y);
+    for (Box* child : children()) {
+        child->layout(availableWidth - (x - content.x));
+        child->calculatePosition(x, content.y);
         x += child->marginBox().width;
     }
     
-    // Calculate final height
+    // Calculate dimensions; the width sums the laid out children
+    calculateWidth(availableWidth);
     calculateHeight();
+    finishLayout();
 }
 
 //-----------------------------------------------------------------------------
 // TextBox Implementation
 //-----------------------------------------------------------------------------
 
-TextBox::TextBox(html::Text* textNode, const css::ComputedStyle& style)
-    : InlineBox(nullptr, style)
+TextBox::TextBox(LayoutTree& tree, BoxIndex index, html::Text* textNode, css::ComputedStylePtr style)
+    : InlineBox(tree, index, nullptr, std::move(style))
     , m_textNode(textNode)
 {
 }
@@ -371,47 +600,92 @@ TextBox::TextBox(html::Text* textNode, const css::ComputedStyle& style)
 TextBox::~TextBox() {
 }
 
+html::Node* TextBox::node() const {
+    return m_textNode;
+}
+
+std::string_view TextBox::lineText(const TextLine& line) const {
+    return std::string_view(m_textNode->data()).substr(line.start, line.length);
+}
+
 void TextBox::calculateWidth(float availableWidth) {
+    m_lines.clear();
     if (!m_textNode) {
-        m_contentRect.width = 0;
+        rect().width = 0;
         return;
     }
     
-    // Get the text content
-    std::string text = m_textNode->nodeValue();
+    // Lines are ranges of the text node's data, not copies
+    const std::string& text = m_textNode->data();
     
     // Get the font properties
-    css::Value fontSizeValue = m_style.getProperty("font-size");
+    const css::Value& fontSizeValue = m_style->getProperty(css::PropertyId::FONT_SIZE);
     float fontSize = 16.0f; // Default font size
     
     if (fontSizeValue.type() == css::ValueType::LENGTH) {
         fontSize = parseLength(fontSizeValue, 0, fontSize);
     }
-    
-    // Simple text width estimation (very simplified)
-    // In a real browser, this would use font metrics
-    float averageCharWidth = fontSize * 0.5f;
-    m_contentRect.width = text.length() * averageCharWidth;
-    
-    // Text wrapping (simplified)
-    if (m_contentRect.width > availableWidth && availableWidth > 0) {
-        // Approximate how many characters fit on each line
-        int charsPerLine = std::max(1, static_cast<int>(availableWidth / averageCharWidth));
-        m_lines.clear();
+    const std::string& fontFamily = m_style->getProperty(css::PropertyId::FONT_FAMILY).stringValue();
+    
+    // Words are measured once per font and reused across boxes, layout
+    // passes and documents
+    TextMeasurementCache& metrics = TextMeasurementCache::shared();
+    float spaceWidth = metrics.measure(fontFamily, fontSize, " ");
+    bool wrap = availableWidth > 0;
+    
+    TextLine line = {0, 0, 0};
+    auto breakLine = [&](size_t next) {
+        m_lines.push_back(line);
+        line = {static_cast<uint32_t>(next), 0, 0};
+    };
+    
+    // Break greedily before a word, with the spaces after it, that doesn't
+    // fit on the line
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t wordEnd = std::min(text.find(' ', pos), text.size());
+        size_t segmentEnd = std::min(text.find_first_not_of(' ', wordEnd), text.size());
+        float spacesWidth = (segmentEnd - wordEnd) * spaceWidth;
+        float wordWidth = metrics.measure(fontFamily, fontSize, std::string_view(text).substr(pos, wordEnd - pos));
         
-        for (size_t i = 0; i < text.length(); i += charsPerLine) {
-            m_lines.push_back(text.substr(i, charsPerLine));
+        if (wrap && line.length > 0 && line.width + wordWidth > availableWidth) {
+            breakLine(pos);
         }
         
-        m_contentRect.width = availableWidth;
-    } else {
-        m_lines = {text};
+        if (wrap && wordWidth > availableWidth) {
+            // Wider than a line on its own: break between characters,
+            // keeping UTF-8 sequences together
+            for (size_t i = pos; i < wordEnd;) {
+                size_t next = i + 1;
+                while (next < wordEnd && (static_cast<unsigned char>(text[next]) & 0xC0) == 0x80) {
+                    ++next;
+                }
+                float charWidth = metrics.measure(fontFamily, fontSize, std::string_view(text).substr(i, next - i));
+                if (line.length > 0 && line.width + charWidth > availableWidth) {
+                    breakLine(i);
+                }
+                line.length += static_cast<uint32_t>(next - i);
+                line.width += charWidth;
+                i = next;
+            }
+        } else {
+            line.length += static_cast<uint32_t>(wordEnd - pos);
+            line.width += wordWidth;
+        }
+        
+        line.length += static_cast<uint32_t>(segmentEnd - wordEnd);
+        line.width += spacesWidth;
+        pos = segmentEnd;
     }
+    m_lines.push_back(line);
+    
+    // Wrapped text fills the available width
+    rect().width = m_lines.size() > 1 ? availableWidth : line.width;
 }
 
 void TextBox::calculateHeight() {
     // Get line height
-    css::Value lineHeightValue = m_style.getProperty("line-height");
+    const css::Value& lineHeightValue = m_style->getProperty(css::PropertyId::LINE_HEIGHT);
     float lineHeight = 1.2f * 16.0f; // Default line height
     
     if (lineHeightValue.type() == css::ValueType::LENGTH || 
@@ -420,38 +694,40 @@ void TextBox::calculateHeight() {
     }
     
     // Height is the line height times the number of lines
-    m_contentRect.height = lineHeight * m_lines.size();
+    rect().height = lineHeight * m_lines.size();
 }
 
 //-----------------------------------------------------------------------------
 // BoxFactory Implementation
 //-----------------------------------------------------------------------------
 
-std::shared_ptr<Box> BoxFactory::createBox(html::Node* node, const css::ComputedStyle& style) {
+Box* BoxFactory::createBox(LayoutTree& tree, html::Node* node, css::ComputedStylePtr style) {
     if (!node) {
         return nullptr;
     }
+    if (!style) {
+        style = std::make_shared<const css::ComputedStyle>();
+    }
     
     if (node->nodeType() == html::NodeType::ELEMENT_NODE) {
         html::Element* element = static_cast<html::Element*>(node);
         
         // Determine display type
-        css::Value displayValue = style.getProperty("display");
-        std::string displayStr = displayValue.stringValue();
+        css::Keyword display = style->getProperty(css::PropertyId::DISPLAY).keyword();
         
-        if (displayStr == "inline" || displayStr == "inline-block") {
-            return std::make_shared<InlineBox>(element, style);
+        if (display == css::Keyword::INLINE || display == css::Keyword::INLINE_BLOCK) {
+            return tree.create<InlineBox>(element, std::move(style));
         } else {
             // Default to block for most elements
-            return std::make_shared<BlockBox>(element, style);
+            return tree.create<BlockBox>(element, std::move(style));
         }
     } else if (node->nodeType() == html::NodeType::TEXT_NODE) {
         html::Text* textNode = static_cast<html::Text*>(node);
-        return std::make_shared<TextBox>(textNode, style);
+        return tree.create<TextBox>(textNode, std::move(style));
     }
     
     // Default to a generic box for other node types
-    return std::make_shared<Box>(nullptr, style);
+    return tree.create<Box>(nullptr, std::move(style));
 }
 
 } // namespace layout
@@ -1,45 +1,19 @@
 #ifndef BROWSER_BOX_MODEL_H
 #define BROWSER_BOX_MODEL_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <vector>
+#include <iterator>
+#include "layout_tree.h"
 #include "../html/dom_tree.h"
 #include "../css/style_resolver.h"
 
 namespace browser {
 namespace layout {
 
-// Rectangle structure for box geometry
-struct Rect {
-    float x;
-    float y;
-    float width;
-    float height;
-
-    Rect() : x(0), y(0), width(0), height(0) {}
-    Rect(float x, float y, float width, float height) 
-        : x(x), y(y), width(width), height(height) {}
-
-    // Helper to get bottom coordinate
-    float bottom() const { return y + height; }
-    // Helper to get right coordinate
-    float right() const { return x + width; }
-};
-
-// Display type enum
-enum class DisplayType {
-    NONE,
-    BLOCK,
-    INLINE,
-    INLINE_BLOCK,
-    FLEX,
-    GRID,
-    TABLE,
-    TABLE_ROW,
-    TABLE_CELL
-};
-
 // Position type enum
 enum class PositionType {
     STATIC,
@@ -56,28 +30,76 @@ enum class FloatType {
     RIGHT
 };
 
-// Box class representing a rendering box in the layout tree
+// A box's children in order, following the tree's sibling links
+class BoxChildren {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Box*;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Box* const*;
+        using reference = Box*;
+        
+        Iterator(const LayoutTree* tree, BoxIndex index) : m_tree(tree), m_index(index) {}
+        
+        Box* operator*() const { return m_tree->box(m_index); }
+        Iterator& operator++() {
+            m_index = m_tree->nextSibling(m_index);
+            return *this;
+        }
+        bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+        
+    private:
+        const LayoutTree* m_tree;
+        BoxIndex m_index;
+    };
+    
+    BoxChildren(const LayoutTree* tree, BoxIndex first) : m_tree(tree), m_first(first) {}
+    
+    Iterator begin() const { return Iterator(m_tree, m_first); }
+    Iterator end() const { return Iterator(m_tree, noBox); }
+    bool empty() const { return m_first == noBox; }
+    
+private:
+    const LayoutTree* m_tree;
+    BoxIndex m_first;
+};
+
+// Box class representing a rendering box in the layout tree. Boxes are
+// created by their LayoutTree (LayoutTree::create), which holds their
+// geometry and links.
 class Box {
+    friend class LayoutCache;
+    
 public:
-    Box(html::Element* element, const css::ComputedStyle& style);
+    Box(LayoutTree& tree, BoxIndex index, html::Element* element, css::ComputedStylePtr style);
     virtual ~Box();
+    
+    // Position in the layout tree
+    LayoutTree& tree() const { return *m_tree; }
+    BoxIndex index() const { return m_index; }
 
     // Box hierarchy
-    Box* parent() const { return m_parent; }
-    void setParent(Box* parent) { m_parent = parent; }
+    Box* parent() const { return m_tree->box(m_tree->parent(m_index)); }
     
-    const std::vector<std::shared_ptr<Box>>& children() const { return m_children; }
-    void addChild(std::shared_ptr<Box> child);
+    BoxChildren children() const { return BoxChildren(m_tree, m_tree->firstChild(m_index)); }
+    void addChild(Box* child);
 
     // Associated DOM element
     html::Element* element() const { return m_element; }
     
-    // Get computed style
-    const css::ComputedStyle& style() const { return m_style; }
+    // DOM node the box was built for: the element, or a text box's text
+    virtual html::Node* node() const { return m_element; }
+    
+    // Get computed style; shared with the resolver and other boxes
+    const css::ComputedStyle& style() const { return *m_style; }
+    const css::ComputedStylePtr& stylePtr() const { return m_style; }
 
     // Box geometry
-    const Rect& contentRect() const { return m_contentRect; }
-    void setContentRect(const Rect& rect) { m_contentRect = rect; }
+    const Rect& contentRect() const { return m_tree->contentRect(m_index); }
+    void setContentRect(const Rect& rect) { m_tree->contentRect(m_index) = rect; }
     
     // Get the full border box (content + padding + border)
     Rect borderBox() const;
@@ -86,8 +108,8 @@ public:
     Rect marginBox() const;
 
     // Display type
-    DisplayType displayType() const { return m_displayType; }
-    void setDisplayType(DisplayType type) { m_displayType = type; }
+    DisplayType displayType() const { return m_tree->displayType(m_index); }
+    void setDisplayType(DisplayType type) { m_tree->displayType(m_index) = type; }
 
     // Position type
     PositionType positionType() const { return m_positionType; }
@@ -97,6 +119,43 @@ public:
     FloatType floatType() const { return m_floatType; }
     void setFloatType(FloatType type) { m_floatType = type; }
 
+    // Incremental layout. A box needs layout when it's new or its inputs
+    // changed, and its ancestors then have a child that needs layout;
+    // layout() reuses a clean subtree's geometry when the available width
+    // is the one it was last laid out at.
+    bool needsLayout() const { return m_needsLayout; }
+    bool childNeedsLayout() const { return m_childNeedsLayout; }
+    void markNeedsLayout();
+    
+    // Whether layout(availableWidth) would keep the last layout
+    bool layoutIsCurrent(float availableWidth) const {
+        return !m_needsLayout && !m_childNeedsLayout && !m_layoutDeferred &&
+               availableWidth == m_layoutWidth;
+    }
+    
+    // Lazy layout (LayoutTree::setLayoutWindow). A deferred box is placed
+    // with an estimated height and its descendants keep stale geometry
+    // until it's laid out; isLaidOut() is false inside such a subtree.
+    bool layoutDeferred() const { return m_layoutDeferred; }
+    bool isLaidOut() const;
+    void deferLayout(float availableWidth);
+    
+    // Content height to place the box with before laying it out: the last
+    // layout's, or the tree's per-box estimate for a new subtree
+    float estimatedHeight() const;
+    
+    // Boxes in the subtree, and whether one of them floats; refreshed by
+    // updateSubtreeInfo() for deciding what to lay out in parallel or
+    // lazily, and what to cache
+    size_t subtreeSize() const { return m_subtreeSize; }
+    bool containsFloats() const { return m_containsFloats; }
+    void updateSubtreeInfo();
+    
+    // The tree's paint generation when the box or a box in its subtree was
+    // last laid out, moved or created (LayoutTree::paintGeneration). What's
+    // painted for a subtree is unchanged while this is.
+    uint64_t paintGeneration() const { return m_paintGeneration; }
+    
     // Layout calculation methods
     virtual void calculateWidth(float availableWidth);
     virtual void calculatePosition(float x, float y);
@@ -104,54 +163,73 @@ public:
     virtual void layout(float availableWidth);
 
     // Get margin, border, padding sizes
-    float marginTop() const { return m_margin.top; }
-    float marginRight() const { return m_margin.right; }
-    float marginBottom() const { return m_margin.bottom; }
-    float marginLeft() const { return m_margin.left; }
+    float marginTop() const { return m_tree->margin(m_index).top; }
+    float marginRight() const { return m_tree->margin(m_index).right; }
+    float marginBottom() const { return m_tree->margin(m_index).bottom; }
+    float marginLeft() const { return m_tree->margin(m_index).left; }
 
-    float borderTop() const { return m_border.top; }
-    float borderRight() const { return m_border.right; }
-    float borderBottom() const { return m_border.bottom; }
-    float borderLeft() const { return m_border.left; }
+    float borderTop() const { return m_tree->border(m_index).top; }
+    float borderRight() const { return m_tree->border(m_index).right; }
+    float borderBottom() const { return m_tree->border(m_index).bottom; }
+    float borderLeft() const { return m_tree->border(m_index).left; }
 
-    float paddingTop() const { return m_padding.top; }
-    float paddingRight() const { return m_padding.right; }
-    float paddingBottom() const { return m_padding.bottom; }
-    float paddingLeft() const { return m_padding.left; }
+    float paddingTop() const { return m_tree->padding(m_index).top; }
+    float paddingRight() const { return m_tree->padding(m_index).right; }
+    float paddingBottom() const { return m_tree->padding(m_index).bottom; }
+    float paddingLeft() const { return m_tree->padding(m_index).left; }
 
 protected:
+    // Tree storage and this box's index in it
+    LayoutTree* m_tree;
+    BoxIndex m_index;
+    
     // The associated DOM element
     html::Element* m_element;
     
     // The calculated style
-    css::ComputedStyle m_style;
-    
-    // Box hierarchy
-    Box* m_parent;
-    std::vector<std::shared_ptr<Box>> m_children;
-    
-    // Box geometry
-    Rect m_contentRect;
+    css::ComputedStylePtr m_style;
     
     // Box properties
-    DisplayType m_displayType;
     PositionType m_positionType;
     FloatType m_floatType;
-
-    // Box model values
-    struct EdgeSizes {
-        float top;
-        float right;
-        float bottom;
-        float left;
-        
-        EdgeSizes() : top(0), right(0), bottom(0), left(0) {}
-    };
     
-    EdgeSizes m_margin;
-    EdgeSizes m_border;
-    EdgeSizes m_padding;
+    // Writable geometry in the tree's arrays
+    Rect& rect() { return m_tree->contentRect(m_index); }
+    EdgeSizes& margins() { return m_tree->margin(m_index); }
+    EdgeSizes& borders() { return m_tree->border(m_index); }
+    EdgeSizes& paddings() { return m_tree->padding(m_index); }
 
+    // Layout state: dirty flags, and the available width and origin of
+    // the last layout
+    bool m_needsLayout;
+    bool m_childNeedsLayout;
+    float m_layoutWidth;
+    float m_layoutX;
+    float m_layoutY;
+    bool m_layoutDeferred;
+    
+    size_t m_subtreeSize;
+    bool m_containsFloats;
+    uint64_t m_paintGeneration;
+    
+    // Stamp the box and its ancestors with the tree's paint generation
+    void markPaintChanged();
+    
+    // Take the last layout when the subtree is clean and was laid out at
+    // availableWidth, or the tree's LayoutCache has its layout at that
+    // width, moving it to the origin (x, y); false if it has to be laid
+    // out again
+    bool reuseLayout(float availableWidth, float x, float y);
+    
+    // Bracket a full layout from the origin (x, y). Geometry restarts from
+    // zero, as for a new box, so the result doesn't depend on the last one.
+    void beginLayout(float availableWidth, float x, float y);
+    void finishLayout();
+    
+    // Move the box and its descendants; a deferred box's stale
+    // descendants stay where they are
+    void translate(float dx, float dy);
+    
     // Initialize box properties from style
     void initializeBoxProperties();
     
@@ -162,7 +240,7 @@ protected:
 // Block box implementation
 class BlockBox : public Box {
 public:
-    BlockBox(html::Element* element, const css::ComputedStyle& style);
+    BlockBox(LayoutTree& tree, BoxIndex index, html::Element* element, css::ComputedStylePtr style);
     virtual ~BlockBox();
     
     // Override layout methods for block layout
@@ -170,12 +248,29 @@ public:
     virtual void calculatePosition(float x, float y) override;
     virtual void calculateHeight() override;
     virtual void layout(float availableWidth) override;
+    
+    // Children with smaller subtrees are laid out on the calling thread
+    static constexpr size_t minParallelSubtree = 256;
+    
+private:
+    // Lay the children out with the large independent ones as tasks on
+    // pool; false, having done nothing, unless two or more qualify
+    bool layoutChildrenInParallel(threading::WorkPool& pool);
+    bool isParallelCandidate(const Box* child) const;
+    
+    // Lay out a child placed at y, deferring it when it lies outside the
+    // tree's layout window
+    void layoutChildLazily(Box* child, float y);
+    
+    // In-flow blocks with no floats inside them: their layout doesn't
+    // reach into their siblings
+    bool isIndependentBlock(const Box* child) const;
 };
 
 // Inline box implementation
 class InlineBox : public Box {
 public:
-    InlineBox(html::Element* element, const css::ComputedStyle& style);
+    InlineBox(LayoutTree& tree, BoxIndex index, html::Element* element, css::ComputedStylePtr style);
     virtual ~InlineBox();
     
     // Override layout methods for inline layout
@@ -185,27 +280,41 @@ public:
     virtual void layout(float availableWidth) override;
 };
 
+// A line of wrapped text: a range of the text node's data and its width
+struct TextLine {
+    uint32_t start;
+    uint32_t length;
+    float width;
+};
+
 // Text box implementation (special inline box for text nodes)
 class TextBox : public InlineBox {
 public:
-    TextBox(html::Text* textNode, const css::ComputedStyle& style);
+    TextBox(LayoutTree& tree, BoxIndex index, html::Text* textNode, css::ComputedStylePtr style);
     virtual ~TextBox();
     
     html::Text* textNode() const { return m_textNode; }
+    virtual html::Node* node() const override;
+    
+    // Lines after wrapping, and the text of one
+    const std::vector<TextLine>& lines() const { return m_lines; }
+    std::string_view lineText(const TextLine& line) const;
     
     // Override layout methods for text layout
     virtual void calculateWidth(float availableWidth) override;
     virtual void calculateHeight() override;
     
 private:
+    friend class LayoutCache;
+    
     html::Text* m_textNode;
-    std::vector<std::string> m_lines; // Text lines after wrapping
+    std::vector<TextLine> m_lines; // Text lines after wrapping
 };
 
-// Box factory to create appropriate box types
+// Box factory to create appropriate box types in a tree
 class BoxFactory {
 public:
-    static std::shared_ptr<Box> createBox(html::Node* node, const css::ComputedStyle& style);
+    static Box* createBox(LayoutTree& tree, html::Node* node, css::ComputedStylePtr style);
 };
 
 } // namespace layout
@@ -0,0 +1,214 @@
+#include "layout_cache.h"
+#include <algorithm>
+
+namespace browser {
+namespace layout {
+
+LayoutCache::LayoutCache(size_t capacity)
+    : m_bytes(0)
+    , m_capacity(capacity)
+    , m_generation(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+}
+
+LayoutCache::~LayoutCache() {
+}
+
+bool LayoutCache::restore(Box& box, float availableWidth, float x, float y) {
+    if (box.subtreeSize() < minSubtreeBoxes) {
+        return false;
+    }
+
+    LayoutTree& tree = box.tree();
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    EntryList::iterator entry = m_entries.end();
+    auto found = m_byRoot.find(box.index());
+    if (found != m_byRoot.end()) {
+        for (EntryList::iterator it : found->second) {
+            if (it->width == availableWidth && it->generation == m_generation) {
+                entry = it;
+                break;
+            }
+        }
+    }
+    if (entry == m_entries.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    // Most recently used first; list iterators stay valid
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+    ++m_hits;
+
+    // Entries are dropped before their boxes change, so the subtree is the
+    // one captured. Only this subtree's slots are written, as in layout;
+    // the lock keeps parallel layout from evicting the entry meanwhile.
+    for (const BoxState& state : entry->states) {
+        Box* target = tree.box(state.index);
+        target->rect() = Rect(state.rect.x + x, state.rect.y + y, state.rect.width, state.rect.height);
+        target->margins() = state.margin;
+        target->borders() = state.border;
+        target->paddings() = state.padding;
+        target->m_layoutWidth = state.layoutWidth;
+        target->m_layoutX = state.layoutX + x;
+        target->m_layoutY = state.layoutY + y;
+        target->m_needsLayout = false;
+        target->m_childNeedsLayout = false;
+        target->m_layoutDeferred = false;
+        target->markPaintChanged();
+        if (state.isText) {
+            static_cast<TextBox*>(target)->m_lines.assign(entry->lines.begin() + state.firstLine,
+                                                          entry->lines.begin() + state.firstLine + state.lineCount);
+        }
+    }
+    return true;
+}
+
+bool LayoutCache::capture(const LayoutTree& tree, BoxIndex index, float originX, float originY, Entry& entry) {
+    Box* box = tree.box(index);
+    if (box->m_layoutDeferred) {
+        return false;
+    }
+
+    BoxState state;
+    state.index = index;
+    state.rect = tree.contentRect(index);
+    state.rect.x -= originX;
+    state.rect.y -= originY;
+    state.margin = tree.margin(index);
+    state.border = tree.border(index);
+    state.padding = tree.padding(index);
+    state.layoutWidth = box->m_layoutWidth;
+    state.layoutX = box->m_layoutX - originX;
+    state.layoutY = box->m_layoutY - originY;
+    state.firstLine = 0;
+    state.lineCount = 0;
+    state.isText = false;
+
+    if (TextBox* text = dynamic_cast<TextBox*>(box)) {
+        state.isText = true;
+        state.firstLine = static_cast<uint32_t>(entry.lines.size());
+        state.lineCount = static_cast<uint32_t>(text->m_lines.size());
+        entry.lines.insert(entry.lines.end(), text->m_lines.begin(), text->m_lines.end());
+    }
+    entry.states.push_back(state);
+
+    for (BoxIndex child = tree.firstChild(index); child != noBox; child = tree.nextSibling(child)) {
+        if (!capture(tree, child, originX, originY, entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LayoutCache::store(Box& box) {
+    if (box.subtreeSize() < minSubtreeBoxes || m_capacity == 0) {
+        return;
+    }
+
+    // Capture outside the lock; only this subtree is being laid out
+    Entry entry;
+    entry.root = box.index();
+    entry.width = box.m_layoutWidth;
+    entry.generation = m_generation;
+    entry.states.reserve(box.subtreeSize());
+    if (!capture(box.tree(), box.index(), box.m_layoutX, box.m_layoutY, entry)) {
+        return;
+    }
+    entry.bytes = sizeof(Entry) + entry.states.capacity() * sizeof(BoxState) +
+                  entry.lines.capacity() * sizeof(TextLine);
+    if (entry.bytes > m_capacity) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Replace an entry for the same width
+    std::vector<EntryList::iterator>& entries = m_byRoot[entry.root];
+    for (EntryList::iterator it : entries) {
+        if (it->width == entry.width) {
+            erase(it);
+            break;
+        }
+    }
+
+    m_bytes += entry.bytes;
+    m_entries.push_front(std::move(entry));
+    m_byRoot[m_entries.front().root].push_back(m_entries.begin());
+    evict();
+}
+
+void LayoutCache::invalidate(BoxIndex index) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_byRoot.find(index);
+    while (found != m_byRoot.end()) {
+        erase(found->second.back());
+        found = m_byRoot.find(index);
+    }
+}
+
+void LayoutCache::erase(EntryList::iterator it) {
+    auto found = m_byRoot.find(it->root);
+    if (found != m_byRoot.end()) {
+        std::vector<EntryList::iterator>& entries = found->second;
+        entries.erase(std::find(entries.begin(), entries.end(), it));
+        if (entries.empty()) {
+            m_byRoot.erase(found);
+        }
+    }
+    m_bytes -= it->bytes;
+    m_entries.erase(it);
+}
+
+void LayoutCache::evictTo(size_t bytes) {
+    while (m_bytes > bytes && !m_entries.empty()) {
+        erase(std::prev(m_entries.end()));
+        ++m_evictions;
+    }
+}
+
+double LayoutCache::hitRate() const {
+    size_t lookups = m_hits + m_misses;
+    return lookups ? static_cast<double>(m_hits) / lookups : 0.0;
+}
+
+void LayoutCache::resetCounters() {
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+size_t LayoutCache::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+size_t LayoutCache::bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+void LayoutCache::setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    evict();
+}
+
+void LayoutCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_byRoot.clear();
+    m_bytes = 0;
+}
+
+void LayoutCache::trim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    evictTo(bytes);
+}
+
+} // namespace layout
+} // namespace browser
@@ -0,0 +1,115 @@
+#ifndef BROWSER_LAYOUT_CACHE_H
+#define BROWSER_LAYOUT_CACHE_H
+
+#include "box_model.h"
+#include "layout_tree.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace layout {
+
+// Layouts of box subtrees at the available widths they were laid out at.
+// When a clean subtree is asked for a width it has been laid out at before,
+// under the same style generation, the geometry of every box in it is
+// restored instead of laid out again (Box::reuseLayout). Only subtrees of
+// minSubtreeBoxes boxes or more are kept. Marking a box for layout drops
+// its entries and its ancestors'. Past the capacity the least recently
+// used entries are evicted.
+class LayoutCache {
+public:
+    static constexpr size_t defaultCapacity = 16 * 1024 * 1024;  // Bytes
+    static constexpr size_t minSubtreeBoxes = 64;
+
+    explicit LayoutCache(size_t capacity = defaultCapacity);
+    ~LayoutCache();
+
+    LayoutCache(const LayoutCache&) = delete;
+    LayoutCache& operator=(const LayoutCache&) = delete;
+
+    // Entries from other generations never match
+    void setGeneration(uint64_t generation) { m_generation = generation; }
+
+    // Restore box's subtree as laid out at availableWidth from the origin
+    // (x, y); false on a miss. The box must be clean.
+    bool restore(Box& box, float availableWidth, float x, float y);
+
+    // Keep the layout box's subtree just finished; skipped for small
+    // subtrees and ones holding deferred boxes
+    void store(Box& box);
+
+    // Drop the entries for a box
+    void invalidate(BoxIndex index);
+
+    // Counters since construction or resetCounters()
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    size_t evictions() const { return m_evictions; }
+    double hitRate() const;
+    void resetCounters();
+
+    // Entries and the bytes they hold
+    size_t size() const;
+    size_t bytes() const;
+    size_t capacity() const { return m_capacity; }
+    void setCapacity(size_t capacity);
+    void clear();
+    
+    // Evict least recently used entries until at most bytes are held,
+    // leaving the capacity as it is
+    void trim(size_t bytes);
+
+private:
+    // A box's layout output, with positions relative to the origin of the
+    // subtree's root
+    struct BoxState {
+        BoxIndex index;
+        Rect rect;
+        EdgeSizes margin;
+        EdgeSizes border;
+        EdgeSizes padding;
+        float layoutWidth;
+        float layoutX;
+        float layoutY;
+        uint32_t firstLine;
+        uint32_t lineCount;
+        bool isText;
+    };
+
+    struct Entry {
+        BoxIndex root;
+        float width;
+        uint64_t generation;
+        std::vector<BoxState> states;
+        std::vector<TextLine> lines;
+        size_t bytes;
+    };
+    using EntryList = std::list<Entry>;
+
+    // Append the states of index's subtree; false if it holds a deferred box
+    bool capture(const LayoutTree& tree, BoxIndex index, float originX, float originY, Entry& entry);
+
+    void erase(EntryList::iterator it);
+    void evict() { evictTo(m_capacity); }
+    void evictTo(size_t bytes);
+
+    mutable std::mutex m_mutex;
+    EntryList m_entries;  // Most recently used first
+    std::unordered_map<BoxIndex, std::vector<EntryList::iterator>> m_byRoot;
+    size_t m_bytes;
+    size_t m_capacity;
+    uint64_t m_generation;
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_misses;
+    std::atomic<size_t> m_evictions;
+};
+
+} // namespace layout
+} // namespace browser
+
+#endif // BROWSER_LAYOUT_CACHE_H
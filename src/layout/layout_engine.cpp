@@ -1,13 +1,31 @@
 #include "layout_engine.h"
+#include "../html/dom_traversal.h"
+#include "../threading/work_pool.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <unordered_set>
 
 namespace browser {
 namespace layout {
 
 LayoutEngine::LayoutEngine()
     : m_layoutRoot(nullptr)
+    , m_document(nullptr)
+    , m_styleResolver(nullptr)
+    , m_styleGeneration(0)
+    , m_builtBoxCount(0)
+    , m_parallelLayout(false)
+    , m_workPool(&threading::WorkPool::shared())
+    , m_subtreeInfoStale(true)
+    , m_lazyLayout(false)
+    , m_scrollY(0)
+    , m_viewportWidth(0)
+    , m_viewportHeight(0)
+    , m_spatialIndexStale(true)
+    , m_fullDamage(true)
 {
 }
 
@@ -24,20 +42,51 @@ bool LayoutEngine::layoutDocument(html::Document* document, css::StyleResolver*
         return false;
     }
     
-    // Clear previous layout
-    m_layoutRoot = nullptr;
-    m_nodeToBoxMap.clear();
+    TRACE_SCOPE("layout", "LayoutEngine::layoutDocument");
+    ALLOC_SCOPE(LAYOUT);
     
-    // Make sure styles are resolved
-    styleResolver->resolveStyles();
+    // Bring styles up to date with any DOM mutations
+    styleResolver->updateStyles();
     
-    // Build the layout tree
     html::Element* documentElement = document->documentElement();
-    if (!documentElement) {
-        return false;
+    m_builtBoxCount = 0;
+    
+    // Rebuild everything for another document or resolver, after a full
+    // restyle, when the root element itself changed, or when dropped boxes
+    // hold most of the tree's slots
+    bool rebuild = !m_layoutRoot || document != m_document || styleResolver != m_styleResolver ||
+                   styleResolver->styleGeneration() != m_styleGeneration ||
+                   m_layoutRoot->element() != documentElement ||
+                   (documentElement && (documentElement->layoutDirtyFlags() & html::LAYOUT_SELF_DIRTY)) ||
+                   m_layoutTree.size() > 2 * m_layoutTree.liveCount() + minCompactSlots;
+    
+    if (document != m_document) {
+        m_scrollY = 0;
+    }
+    m_document = document;
+    m_styleResolver = styleResolver;
+    m_styleGeneration = styleResolver->styleGeneration();
+    m_layoutCache.setGeneration(m_styleGeneration);
+    
+    if (rebuild) {
+        m_layoutRoot = nullptr;
+        m_layoutTree.clear();
+        m_layoutCache.clear();
+        m_spatialIndex.clear();
+        m_fullDamage = true;
+        
+        if (documentElement) {
+            m_layoutRoot = buildLayoutTree(documentElement, styleResolver, nullptr);
+        }
+        m_subtreeInfoStale = true;
+    } else if (documentElement->layoutDirtyFlags()) {
+        updateLayoutTree(documentElement, styleResolver);
+        m_subtreeInfoStale = true;
     }
+    document->clearLayoutDirty();
+    
+    TRACE_COUNTER("layout", "builtBoxes", static_cast<int64_t>(m_builtBoxCount));
     
-    m_layoutRoot = buildLayoutTree(documentElement, styleResolver, nullptr);
     if (!m_layoutRoot) {
         return false;
     }
@@ -48,59 +97,150 @@ bool LayoutEngine::layoutDocument(html::Document* document, css::StyleResolver*
     return true;
 }
 
-std::shared_ptr<Box> LayoutEngine::buildLayoutTree(html::Node* node, css::StyleResolver* styleResolver, Box* parent) {
-    if (!node) {
+Box* LayoutEngine::buildLayoutTree(html::Node* root, css::StyleResolver* styleResolver, Box* parent) {
+    if (!root) {
         return nullptr;
     }
     
-    std::shared_ptr<Box> box = nullptr;
+    TRACE_SCOPE("layout", "LayoutEngine::buildLayoutTree");
     
-    if (node->nodeType() == html::NodeType::ELEMENT_NODE) {
-        html::Element* element = static_cast<html::Element*>(node);
+    Box* rootBox = nullptr;
+    size_t boxCount = 0;
+    
+    // Pre-order walk; a node's parent box is built before the node is reached
+    auto nodes = html::preOrder(root);
+    for (auto it = nodes.begin(); it != nodes.end();) {
+        html::Node* node = *it;
         
-        // Get computed style for this element
-        css::ComputedStyle style = styleResolver->getComputedStyle(element);
+        node->clearLayoutDirty();
         
-        // Create a box for this element
-        box = BoxFactory::createBox(node, style);
+        Box* parentBox = node == root ? parent : getBoxForNode(node->parentNode());
         
-        // Skip elements with display: none
-        if (box && box->displayType() != DisplayType::NONE) {
-            // Add to parent
-            if (parent) {
-                parent->addChild(box);
+        Box* box = nullptr;
+        bool visitChildren = false;
+        
+        if (node->nodeType() == html::NodeType::ELEMENT_NODE) {
+            html::Element* element = static_cast<html::Element*>(node);
+            
+            // Create a box for this element
+            box = BoxFactory::createBox(m_layoutTree, node, styleResolver->computedStyle(element));
+            
+            // Skip elements with display: none
+            if (box && box->displayType() != DisplayType::NONE) {
+                // Add to parent
+                if (parentBox) {
+                    parentBox->addChild(box);
+                }
+                
+                // Record the box on the node
+                node->setLayoutBoxIndex(box->index());
+                ++boxCount;
+                m_spatialIndex.markChanged(box->index());
+                
+                visitChildren = true;
+            } else if (box && (node != root || parent)) {
+                m_layoutTree.destroy(box->index());
+                box = nullptr;
             }
+        } else if (node->nodeType() == html::NodeType::TEXT_NODE) {
+            html::Text* textNode = static_cast<html::Text*>(node);
             
-            // Add to node-box mapping
-            m_nodeToBoxMap[node] = box.get();
+            // For text nodes, share the parent element's style
+            static const css::ComputedStylePtr noStyle = std::make_shared<const css::ComputedStyle>();
+            const css::ComputedStylePtr& parentStyle =
+                parentBox && parentBox->element() ? parentBox->stylePtr() : noStyle;
             
-            // Process children
-            for (const auto& child : element->childNodes()) {
-                buildLayoutTree(child.get(), styleResolver, box.get());
+            // Create text box
+            box = m_layoutTree.create<TextBox>(textNode, parentStyle);
+            
+            // Add to parent
+            if (parentBox) {
+                parentBox->addChild(box);
             }
+            
+            // Record the box on the node
+            node->setLayoutBoxIndex(box->index());
+            ++boxCount;
+            m_spatialIndex.markChanged(box->index());
         }
-    } else if (node->nodeType() == html::NodeType::TEXT_NODE) {
-        html::Text* textNode = static_cast<html::Text*>(node);
         
-        // For text nodes, get style from parent element
-        css::ComputedStyle parentStyle;
-        if (parent && parent->element()) {
-            parentStyle = styleResolver->getComputedStyle(parent->element());
+        if (node == root) {
+            rootBox = box;
         }
         
-        // Create text box
-        box = std::make_shared<TextBox>(textNode, parentStyle);
-        
-        // Add to parent
-        if (parent) {
-            parent->addChild(box);
+        if (visitChildren) {
+            ++it;
+        } else {
+            it.skipChildren();
+        }
+    }
+    
+    m_builtBoxCount += boxCount;
+    TRACE_COUNTER("layout", "layoutBoxes", static_cast<int64_t>(m_layoutTree.liveCount()));
+    return rootBox;
+}
+
+void LayoutEngine::updateLayoutTree(html::Node* node, css::StyleResolver* styleResolver) {
+    uint8_t flags = node->layoutDirtyFlags();
+    node->clearLayoutDirty();
+    
+    Box* box = getBoxForNode(node);
+    if (!box) {
+        return;  // Not rendered; a change that renders it restyles it
+    }
+    
+    // A child's own change replaces its box, which is the parent's child
+    // list changing
+    bool childrenChanged = (flags & html::LAYOUT_CHILDREN_CHANGED) != 0;
+    if (!childrenChanged && (flags & html::LAYOUT_DESCENDANT_DIRTY)) {
+        for (const auto& child : node->childNodes()) {
+            if (child->layoutDirtyFlags() & html::LAYOUT_SELF_DIRTY) {
+                childrenChanged = true;
+                break;
+            }
+        }
+    }
+    if (childrenChanged) {
+        rebuildChildBoxes(node, box, styleResolver);
+    }
+    
+    if (flags & html::LAYOUT_DESCENDANT_DIRTY) {
+        for (const auto& child : node->childNodes()) {
+            if (child->layoutDirtyFlags()) {
+                updateLayoutTree(child.get(), styleResolver);
+            }
+        }
+    }
+}
+
+void LayoutEngine::rebuildChildBoxes(html::Node* node, Box* box, css::StyleResolver* styleResolver) {
+    TRACE_SCOPE("layout", "LayoutEngine::rebuildChildBoxes");
+    
+    std::vector<BoxIndex> taken;
+    m_layoutTree.takeChildren(box->index(), taken);
+    std::unordered_set<BoxIndex> oldChildren(taken.begin(), taken.end());
+    
+    for (const auto& child : node->childNodes()) {
+        Box* existing = nullptr;
+        if (!(child->layoutDirtyFlags() & html::LAYOUT_SELF_DIRTY)) {
+            existing = getBoxForNode(child.get());
         }
         
-        // Add to node-box mapping
-        m_nodeToBoxMap[node] = box.get();
+        if (existing && oldChildren.erase(existing->index())) {
+            box->addChild(existing);
+        } else if (child->nodeType() == html::NodeType::ELEMENT_NODE ||
+                   child->nodeType() == html::NodeType::TEXT_NODE) {
+            // Adds itself to box unless it's display: none
+            buildLayoutTree(child.get(), styleResolver, box);
+        }
+    }
+    
+    // Boxes of removed and replaced children
+    for (BoxIndex index : oldChildren) {
+        m_layoutTree.destroy(index);
     }
     
-    return box;
+    box->markNeedsLayout();
 }
 
 void LayoutEngine::calculateLayout(float viewportWidth, float viewportHeight) {
@@ -108,16 +248,198 @@ void LayoutEngine::calculateLayout(float viewportWidth, float viewportHeight) {
         return;
     }
     
+    TRACE_SCOPE("layout", "LayoutEngine::calculateLayout");
+    
+    m_viewportWidth = viewportWidth;
+    m_viewportHeight = viewportHeight;
+    
+    // Small trees aren't worth the tasks, or deferring
+    threading::WorkPool* pool = nullptr;
+    if (m_parallelLayout && m_workPool && m_workPool->workerCount() > 0 &&
+        m_layoutTree.liveCount() >= parallelLayoutThreshold) {
+        pool = m_workPool;
+    }
+    bool lazy = m_lazyLayout && m_layoutTree.liveCount() >= lazyLayoutThreshold;
+    
+    if ((pool || lazy || layoutCaching()) && m_subtreeInfoStale) {
+        m_layoutRoot->updateSubtreeInfo();
+        m_subtreeInfoStale = false;
+    }
+    
+    // Lay out a viewport height above and below the viewport
+    if (lazy) {
+        m_layoutTree.setLayoutWindow(m_scrollY - viewportHeight, m_scrollY + 2 * viewportHeight);
+    } else {
+        m_layoutTree.clearLayoutWindow();
+    }
+    markDeferredBoxes();
+    
     // Start layout from the root
+    m_layoutTree.setWorkPool(pool);
     m_layoutRoot->layout(viewportWidth);
+    m_layoutTree.setWorkPool(nullptr);
+    m_spatialIndexStale = true;
+    
+    if (layoutCaching()) {
+        TRACE_COUNTER("layout", "layoutCacheHits", static_cast<int64_t>(m_layoutCache.hits()));
+        TRACE_COUNTER("layout", "layoutCacheBytes", static_cast<int64_t>(m_layoutCache.bytes()));
+    }
+    
+    if (lazy) {
+        updateEstimatedBoxHeight();
+    }
+    m_scrollY = clampScrollY(m_scrollY);
+}
+
+void LayoutEngine::setLayoutCaching(bool enabled) {
+    // Entries aren't invalidated while caching is off
+    if (!enabled) {
+        m_layoutCache.clear();
+    }
+    m_layoutTree.setLayoutCache(enabled ? &m_layoutCache : nullptr);
+}
+
+void LayoutEngine::markDeferredBoxes() {
+    std::vector<BoxIndex>& deferred = m_layoutTree.deferredBoxes();
+    size_t kept = 0;
+    for (BoxIndex index : deferred) {
+        Box* box = m_layoutTree.box(index);
+        if (!box || !box->layoutDeferred()) {
+            continue;
+        }
+        
+        // Boxes that end up outside the window are deferred again
+        Rect margin = box->marginBox();
+        if (m_layoutTree.inLayoutWindow(margin.y, margin.bottom())) {
+            box->markNeedsLayout();
+        }
+        deferred[kept++] = index;
+    }
+    deferred.resize(kept);
+}
+
+void LayoutEngine::updateEstimatedBoxHeight() {
+    // Height and boxes of the deferred subtrees, skipping stale ones
+    // inside others
+    float deferredHeight = 0;
+    size_t deferredBoxes = 0;
+    for (BoxIndex index : m_layoutTree.deferredBoxes()) {
+        Box* box = m_layoutTree.box(index);
+        if (box && box->layoutDeferred() && (!box->parent() || box->parent()->isLaidOut())) {
+            deferredHeight += box->contentRect().height;
+            deferredBoxes += box->subtreeSize();
+        }
+    }
+    
+    size_t laidOutBoxes = m_layoutTree.liveCount() - std::min(deferredBoxes, m_layoutTree.liveCount());
+    float laidOutHeight = m_layoutRoot->contentRect().height - deferredHeight;
+    if (laidOutBoxes > 0 && laidOutHeight > 0) {
+        m_layoutTree.setEstimatedBoxHeight(laidOutHeight / laidOutBoxes);
+    }
+}
+
+float LayoutEngine::scrollTo(float scrollY) {
+    m_scrollY = clampScrollY(scrollY);
+    
+    // Nothing to do while the viewport stays inside the laid out window
+    if (!m_layoutRoot || !m_layoutTree.hasLayoutWindow() ||
+        (m_scrollY >= m_layoutTree.layoutWindowTop() &&
+         m_scrollY + m_viewportHeight <= m_layoutTree.layoutWindowBottom())) {
+        return m_scrollY;
+    }
+    
+    TRACE_SCOPE("layout", "LayoutEngine::scrollTo");
+    ALLOC_SCOPE(LAYOUT);
+    
+    Box* anchor = findScrollAnchor(m_scrollY);
+    float anchorOffset = anchor ? anchor->borderBox().y - m_scrollY : 0;
+    
+    calculateLayout(m_viewportWidth, m_viewportHeight);
+    
+    // Keep the anchor where it was in the viewport; the window moves with
+    // the content laid out around it
+    if (anchor) {
+        float shift = anchor->borderBox().y - anchorOffset - m_scrollY;
+        if (shift != 0 && m_layoutTree.hasLayoutWindow()) {
+            m_layoutTree.setLayoutWindow(m_layoutTree.layoutWindowTop() + shift,
+                                         m_layoutTree.layoutWindowBottom() + shift);
+        }
+        m_scrollY = clampScrollY(m_scrollY + shift);
+    }
+    return m_scrollY;
+}
+
+float LayoutEngine::documentHeight() const {
+    return m_layoutRoot ? m_layoutRoot->marginBox().bottom() : 0;
+}
+
+Box* LayoutEngine::findScrollAnchor(float scrollY) const {
+    // Descend through the first child reaching below the viewport top;
+    // a deferred box's children have no position yet
+    Box* anchor = nullptr;
+    Box* box = m_layoutRoot;
+    while (box && !box->layoutDeferred()) {
+        Box* next = nullptr;
+        for (Box* child : box->children()) {
+            if (child->displayType() != DisplayType::NONE && child->borderBox().bottom() > scrollY) {
+                next = child;
+                break;
+            }
+        }
+        if (next) {
+            anchor = next;
+        }
+        box = next;
+    }
+    return anchor;
+}
+
+float LayoutEngine::clampScrollY(float scrollY) const {
+    return std::max(0.0f, std::min(scrollY, documentHeight() - m_viewportHeight));
+}
+
+Box* LayoutEngine::hitTest(float x, float y) {
+    if (!m_layoutRoot) {
+        return nullptr;
+    }
+    updateSpatialIndex();
+    return m_spatialIndex.hitTest(m_layoutTree, x, y);
+}
+
+void LayoutEngine::boxesInRect(const Rect& rect, std::vector<Box*>& boxes) {
+    if (!m_layoutRoot) {
+        return;
+    }
+    updateSpatialIndex();
+    m_spatialIndex.query(m_layoutTree, rect, boxes);
+}
+
+bool LayoutEngine::takeDamage(Rect& damage, bool& full) {
+    if (m_layoutRoot) {
+        updateSpatialIndex();
+    }
+    damage = m_damage;
+    full = m_fullDamage;
+    m_damage = Rect();
+    m_fullDamage = false;
+    return full || !damage.isEmpty();
+}
+
+void LayoutEngine::updateSpatialIndex() {
+    if (m_spatialIndexStale) {
+        m_spatialIndex.update(m_layoutTree, m_layoutRoot->index(), &m_damage);
+        m_spatialIndexStale = false;
+    }
 }
 
 Box* LayoutEngine::getBoxForNode(html::Node* node) const {
-    auto it = m_nodeToBoxMap.find(node);
-    if (it != m_nodeToBoxMap.end()) {
-        return it->second;
+    if (!node) {
+        return nullptr;
     }
-    return nullptr;
+    
+    // The index may be stale, or from another engine's tree
+    Box* box = m_layoutTree.box(node->layoutBoxIndex());
+    return box && box->node() == node ? box : nullptr;
 }
 
 void LayoutEngine::printLayoutTree(std::ostream& stream) const {
@@ -127,7 +449,7 @@ void LayoutEngine::printLayoutTree(std::ostream& stream) const {
     }
     
     stream << "Layout Tree:" << std::endl;
-    printLayoutTreeRecursive(stream, m_layoutRoot.get(), 0);
+    printLayoutTreeRecursive(stream, m_layoutRoot, 0);
 }
 
 void LayoutEngine::printLayoutTreeRecursive(std::ostream& stream, Box* box, int depth) const {
@@ -177,8 +499,8 @@ void LayoutEngine::printLayoutTreeRecursive(std::ostream& stream, Box* box, int
     stream << std::endl;
     
     // Print children
-    for (const auto& child : box->children()) {
-        printLayoutTreeRecursive(stream, child.get(), depth + 1);
+    for (Box* child : box->children()) {
+        printLayoutTreeRecursive(stream, child, depth + 1);
     }
 }
 
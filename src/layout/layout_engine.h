@@ -2,11 +2,13 @@
 #define BROWSER_LAYOUT_ENGINE_H
 
 #include "box_model.h"
+#include "layout_cache.h"
+#include "spatial_index.h"
 #include "../html/dom_tree.h"
 #include "../css/style_resolver.h"
 #include <memory>
 #include <vector>
-#include <map>
+#include <cstdint>
 
 namespace browser {
 namespace layout {
@@ -20,34 +22,151 @@ public:
     // Initialize the layout engine
     bool initialize();
     
-    // Perform layout for a document
+    // Perform layout for a document. The box tree is kept between calls:
+    // after DOM mutations only the boxes of changed nodes are rebuilt (see
+    // html::LayoutDirtyFlag), and only dirty subtrees, or those whose
+    // available width changed, are laid out again.
     bool layoutDocument(html::Document* document, css::StyleResolver* styleResolver,
                         float viewportWidth, float viewportHeight);
     
-    // Get the layout tree root
-    std::shared_ptr<Box> layoutRoot() const { return m_layoutRoot; }
+    // Get the layout tree root; owned by the engine's tree
+    Box* layoutRoot() const { return m_layoutRoot; }
+    
+    // Storage of the boxes
+    const LayoutTree& layoutTree() const { return m_layoutTree; }
     
     // Get the box associated with a DOM node
     Box* getBoxForNode(html::Node* node) const;
     
+    // Topmost box whose border box contains (x, y), and the boxes whose
+    // border boxes intersect rect in paint order. Backed by a spatial index
+    // synced with the last layout on first use after it.
+    Box* hitTest(float x, float y);
+    void boxesInRect(const Rect& rect, std::vector<Box*>& boxes);
+    
+    // Area of the document needing repaint since the last call: the old
+    // and new border boxes of boxes that moved, resized, appeared, went
+    // away or were rebuilt. full is set instead after the whole tree was
+    // rebuilt. False when nothing changed.
+    bool takeDamage(Rect& damage, bool& full);
+    
+    // Boxes built by the last layoutDocument(); every box after a full build
+    size_t builtBoxCount() const { return m_builtBoxCount; }
+    
+    // Lay out large independent block subtrees concurrently on the work
+    // pool (see BlockBox::layout). Off by default; the result is the same
+    // either way.
+    void setParallelLayout(bool enabled) { m_parallelLayout = enabled; }
+    bool parallelLayout() const { return m_parallelLayout; }
+    
+    // Pool for parallel layout; null lays out on the calling thread.
+    // Defaults to WorkPool::shared().
+    void setWorkPool(threading::WorkPool* pool) { m_workPool = pool; }
+    
+    // Trees with fewer boxes are laid out on the calling thread
+    static constexpr size_t parallelLayoutThreshold = 2048;
+    
+    // Lay out only the blocks within a viewport height of the viewport,
+    // placing the others with estimated heights until scrolling brings
+    // them near (see LayoutTree::setLayoutWindow). Off by default; trees
+    // under lazyLayoutThreshold boxes are laid out in full.
+    void setLazyLayout(bool enabled) { m_lazyLayout = enabled; }
+    bool lazyLayout() const { return m_lazyLayout; }
+    static constexpr size_t lazyLayoutThreshold = 4096;
+    
+    // Keep the layouts of large subtrees at the widths they were laid out
+    // at, so switching between a few viewport widths restores clean
+    // subtrees instead of laying them out (see LayoutCache). Off by
+    // default; turning it off drops the cache.
+    void setLayoutCaching(bool enabled);
+    bool layoutCaching() const { return m_layoutTree.layoutCache() != nullptr; }
+    LayoutCache& layoutCache() { return m_layoutCache; }
+    
+    // Viewport size the last layoutDocument() was for
+    float viewportWidth() const { return m_viewportWidth; }
+    float viewportHeight() const { return m_viewportHeight; }
+    
+    // Top of the viewport in document coordinates; reset for a new document
+    float scrollY() const { return m_scrollY; }
+    
+    // Scroll the viewport, laying out deferred blocks that come near it.
+    // Returns the position to show: when estimated heights above the
+    // content at the top of the viewport are replaced, it follows that
+    // content (scroll anchoring).
+    float scrollTo(float scrollY);
+    
+    // Height of the laid out document, estimates included
+    float documentHeight() const;
+    
     // Helper method to print the layout tree (for debugging)
     void printLayoutTree(std::ostream& stream) const;
     
 private:
-    // Build the layout tree from the DOM tree
-    std::shared_ptr<Box> buildLayoutTree(html::Node* node, css::StyleResolver* styleResolver, Box* parent);
+    // Build the layout tree for root's subtree; returns root's box
+    Box* buildLayoutTree(html::Node* root, css::StyleResolver* styleResolver, Box* parent);
+    
+    // Rebuild the boxes of nodes under node whose layout dirty flags say
+    // they're stale, clearing the flags
+    void updateLayoutTree(html::Node* node, css::StyleResolver* styleResolver);
+    
+    // Rebuild box's children for node's current child list, keeping the
+    // boxes of children that didn't change
+    void rebuildChildBoxes(html::Node* node, Box* box, css::StyleResolver* styleResolver);
     
     // Calculate layout for the entire tree
     void calculateLayout(float viewportWidth, float viewportHeight);
     
+    // Mark the deferred boxes inside the tree's layout window, or all of
+    // them without one, for layout; prunes the deferred list
+    void markDeferredBoxes();
+    
+    // Re-derive the tree's per-box height estimate from what's laid out
+    void updateEstimatedBoxHeight();
+    
+    // Deepest box at the top of the viewport whose position scrolling
+    // follows
+    Box* findScrollAnchor(float scrollY) const;
+    float clampScrollY(float scrollY) const;
+    
+    // Sync the spatial index with the last layout if it hasn't been,
+    // gathering damage
+    void updateSpatialIndex();
+    
     // Helper method to recursively print layout tree
     void printLayoutTreeRecursive(std::ostream& stream, Box* box, int depth) const;
     
-    // Layout tree root
-    std::shared_ptr<Box> m_layoutRoot;
+    // Box storage and the root box. Nodes record their box's index
+    // (html::Node::layoutBoxIndex).
+    LayoutTree m_layoutTree;
+    Box* m_layoutRoot;
+    
+    // Trees with fewer dropped slots than this aren't rebuilt to compact
+    static constexpr size_t minCompactSlots = 1024;
+    
+    // What the current tree was built from
+    html::Document* m_document;
+    css::StyleResolver* m_styleResolver;
+    uint64_t m_styleGeneration;
+    size_t m_builtBoxCount;
+    
+    bool m_parallelLayout;
+    threading::WorkPool* m_workPool;
+    
+    // Box subtree sizes need refreshing after the tree changed
+    bool m_subtreeInfoStale;
+    
+    bool m_lazyLayout;
+    float m_scrollY;
+    float m_viewportWidth;
+    float m_viewportHeight;
+    
+    LayoutCache m_layoutCache;
+    SpatialIndex m_spatialIndex;
+    bool m_spatialIndexStale;
     
-    // Map of DOM nodes to their corresponding boxes
-    std::map<html::Node*, Box*> m_nodeToBoxMap;
+    // Damage gathered by spatial index updates since takeDamage()
+    Rect m_damage;
+    bool m_fullDamage;
 };
 
 } // namespace layout
@@ -0,0 +1,113 @@
+#include "layout_tree.h"
+#include "box_model.h"
+#include <atomic>
+
+namespace browser {
+namespace layout {
+
+namespace {
+
+// Shared by every tree, so a box never finds a generation another tree's
+// box was painted at
+std::atomic<uint64_t> nextPaintGeneration{1};
+
+} // namespace
+
+LayoutTree::LayoutTree()
+    : m_liveCount(0)
+    , m_workPool(nullptr)
+    , m_layoutCache(nullptr)
+    , m_hasLayoutWindow(false)
+    , m_layoutWindowTop(0)
+    , m_layoutWindowBottom(0)
+    , m_estimatedBoxHeight(defaultEstimatedBoxHeight)
+    , m_paintGeneration(nextPaintGeneration++)
+{
+}
+
+LayoutTree::~LayoutTree() {
+}
+
+BoxIndex LayoutTree::allocate() {
+    BoxIndex index = static_cast<BoxIndex>(m_boxes.size());
+    m_boxes.emplace_back();
+    m_contentRects.emplace_back();
+    m_margins.emplace_back();
+    m_borders.emplace_back();
+    m_paddings.emplace_back();
+    m_displayTypes.push_back(DisplayType::BLOCK);
+    m_parents.push_back(noBox);
+    m_firstChildren.push_back(noBox);
+    m_lastChildren.push_back(noBox);
+    m_nextSiblings.push_back(noBox);
+    return index;
+}
+
+void LayoutTree::clear() {
+    m_boxes.clear();
+    m_contentRects.clear();
+    m_margins.clear();
+    m_borders.clear();
+    m_paddings.clear();
+    m_displayTypes.clear();
+    m_parents.clear();
+    m_firstChildren.clear();
+    m_lastChildren.clear();
+    m_nextSiblings.clear();
+    m_deferredBoxes.clear();
+    m_liveCount = 0;
+}
+
+void LayoutTree::advancePaintGeneration() {
+    m_paintGeneration = nextPaintGeneration++;
+}
+
+void LayoutTree::setLayoutWindow(float top, float bottom) {
+    m_hasLayoutWindow = true;
+    m_layoutWindowTop = top;
+    m_layoutWindowBottom = bottom;
+}
+
+void LayoutTree::appendChild(BoxIndex parent, BoxIndex child) {
+    m_parents[child] = parent;
+    m_nextSiblings[child] = noBox;
+
+    if (m_lastChildren[parent] == noBox) {
+        m_firstChildren[parent] = child;
+    } else {
+        m_nextSiblings[m_lastChildren[parent]] = child;
+    }
+    m_lastChildren[parent] = child;
+}
+
+void LayoutTree::takeChildren(BoxIndex parent, std::vector<BoxIndex>& children) {
+    BoxIndex child = m_firstChildren[parent];
+    while (child != noBox) {
+        BoxIndex next = m_nextSiblings[child];
+        m_parents[child] = noBox;
+        m_nextSiblings[child] = noBox;
+        children.push_back(child);
+        child = next;
+    }
+    m_firstChildren[parent] = noBox;
+    m_lastChildren[parent] = noBox;
+}
+
+void LayoutTree::destroy(BoxIndex index) {
+    BoxIndex child = m_firstChildren[index];
+    while (child != noBox) {
+        BoxIndex next = m_nextSiblings[child];
+        destroy(child);
+        child = next;
+    }
+
+    m_boxes[index].reset();
+    m_parents[index] = noBox;
+    m_firstChildren[index] = noBox;
+    m_lastChildren[index] = noBox;
+    m_nextSiblings[index] = noBox;
+    --m_liveCount;
+}
+
+} // namespace layout
+} // namespace browser
@@ -0,0 +1,217 @@
+#ifndef BROWSER_LAYOUT_TREE_H
+#define BROWSER_LAYOUT_TREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace browser {
+namespace threading {
+class WorkPool;
+}
+
+namespace layout {
+
+class Box;
+class LayoutCache;
+
+// Rectangle structure for box geometry
+struct Rect {
+    float x;
+    float y;
+    float width;
+    float height;
+
+    Rect() : x(0), y(0), width(0), height(0) {}
+    Rect(float x, float y, float width, float height)
+        : x(x), y(y), width(width), height(height) {}
+
+    // Helper to get bottom coordinate
+    float bottom() const { return y + height; }
+    // Helper to get right coordinate
+    float right() const { return x + width; }
+
+    // True for rects with no area
+    bool isEmpty() const { return width <= 0 || height <= 0; }
+
+    // Grow to the smallest rect holding both; empty rects add nothing
+    void unite(const Rect& other) {
+        if (other.isEmpty()) {
+            return;
+        }
+        if (isEmpty()) {
+            *this = other;
+            return;
+        }
+        float r = std::max(right(), other.right());
+        float b = std::max(bottom(), other.bottom());
+        x = std::min(x, other.x);
+        y = std::min(y, other.y);
+        width = r - x;
+        height = b - y;
+    }
+};
+
+// Margin, border or padding widths of a box
+struct EdgeSizes {
+    float top;
+    float right;
+    float bottom;
+    float left;
+
+    EdgeSizes() : top(0), right(0), bottom(0), left(0) {}
+};
+
+// Display type enum
+enum class DisplayType : uint8_t {
+    NONE,
+    BLOCK,
+    INLINE,
+    INLINE_BLOCK,
+    FLEX,
+    GRID,
+    TABLE,
+    TABLE_ROW,
+    TABLE_CELL
+};
+
+// Index of a box in its LayoutTree
+using BoxIndex = uint32_t;
+constexpr BoxIndex noBox = UINT32_MAX;
+
+// Storage for a box tree. A box is an index into parallel arrays holding
+// the geometry, edge sizes, display type and first-child/next-sibling
+// links that layout reads and writes, so walking a subtree touches
+// contiguous memory; the Box objects keep the style and per-kind state.
+// Boxes are destroyed with their subtree; their slots aren't reused until
+// the tree is cleared.
+class LayoutTree {
+public:
+    LayoutTree();
+    ~LayoutTree();
+
+    LayoutTree(const LayoutTree&) = delete;
+    LayoutTree& operator=(const LayoutTree&) = delete;
+
+    // Construct a T at the next index; its constructor takes the tree and
+    // the index before args
+    template <typename T, typename... Args>
+    T* create(Args&&... args);
+
+    // The box at index; null for destroyed boxes and out of range indices
+    Box* box(BoxIndex index) const {
+        return index < m_boxes.size() ? m_boxes[index].get() : nullptr;
+    }
+
+    // Indices handed out, and boxes still alive
+    size_t size() const { return m_boxes.size(); }
+    size_t liveCount() const { return m_liveCount; }
+
+    // Destroy every box
+    void clear();
+
+    // Pool that block layout lays independent children out on; null lays
+    // out on the calling thread. Set by LayoutEngine for parallel layout.
+    threading::WorkPool* workPool() const { return m_workPool; }
+    void setWorkPool(threading::WorkPool* pool) { m_workPool = pool; }
+    
+    // Subtree layouts at earlier widths; null keeps none. Set by
+    // LayoutEngine when caching is on.
+    LayoutCache* layoutCache() const { return m_layoutCache; }
+    void setLayoutCache(LayoutCache* cache) { m_layoutCache = cache; }
+    
+    // Lazy layout: independent blocks entirely outside [top, bottom) that
+    // need layout are placed with an estimated height instead
+    // (Box::deferLayout). Set by LayoutEngine around the viewport.
+    bool hasLayoutWindow() const { return m_hasLayoutWindow; }
+    float layoutWindowTop() const { return m_layoutWindowTop; }
+    float layoutWindowBottom() const { return m_layoutWindowBottom; }
+    bool inLayoutWindow(float top, float bottom) const {
+        return !m_hasLayoutWindow || (bottom > m_layoutWindowTop && top < m_layoutWindowBottom);
+    }
+    void setLayoutWindow(float top, float bottom);
+    void clearLayoutWindow() { m_hasLayoutWindow = false; }
+    
+    // Content height per box that deferred subtrees never laid out are
+    // estimated with
+    float estimatedBoxHeight() const { return m_estimatedBoxHeight; }
+    void setEstimatedBoxHeight(float height) { m_estimatedBoxHeight = height; }
+    static constexpr float defaultEstimatedBoxHeight = 20.0f;
+    
+    // Boxes deferred since the list was last pruned; entries may have been
+    // laid out or destroyed since
+    std::vector<BoxIndex>& deferredBoxes() { return m_deferredBoxes; }
+    void addDeferredBox(BoxIndex index) { m_deferredBoxes.push_back(index); }
+    
+    // Boxes whose geometry changes are stamped with the tree's current
+    // paint generation (Box::paintGeneration). Painters caching display
+    // items per box advance it before reading the stamps, so changes made
+    // after a paint get a newer one. Generations are unique across trees.
+    uint64_t paintGeneration() const { return m_paintGeneration; }
+    void advancePaintGeneration();
+
+    // Links
+    BoxIndex parent(BoxIndex index) const { return m_parents[index]; }
+    BoxIndex firstChild(BoxIndex index) const { return m_firstChildren[index]; }
+    BoxIndex nextSibling(BoxIndex index) const { return m_nextSiblings[index]; }
+    void appendChild(BoxIndex parent, BoxIndex child);
+
+    // Unlink parent's children, appending them to children in order
+    void takeChildren(BoxIndex parent, std::vector<BoxIndex>& children);
+
+    // Destroy an unlinked box and its descendants. Their nodes may be gone
+    // and aren't touched; a node's stale index finds no box.
+    void destroy(BoxIndex index);
+
+    // Geometry
+    Rect& contentRect(BoxIndex index) { return m_contentRects[index]; }
+    const Rect& contentRect(BoxIndex index) const { return m_contentRects[index]; }
+    EdgeSizes& margin(BoxIndex index) { return m_margins[index]; }
+    const EdgeSizes& margin(BoxIndex index) const { return m_margins[index]; }
+    EdgeSizes& border(BoxIndex index) { return m_borders[index]; }
+    const EdgeSizes& border(BoxIndex index) const { return m_borders[index]; }
+    EdgeSizes& padding(BoxIndex index) { return m_paddings[index]; }
+    const EdgeSizes& padding(BoxIndex index) const { return m_paddings[index]; }
+    DisplayType& displayType(BoxIndex index) { return m_displayTypes[index]; }
+    DisplayType displayType(BoxIndex index) const { return m_displayTypes[index]; }
+
+private:
+    BoxIndex allocate();
+
+    std::vector<std::unique_ptr<Box>> m_boxes;
+    std::vector<Rect> m_contentRects;
+    std::vector<EdgeSizes> m_margins;
+    std::vector<EdgeSizes> m_borders;
+    std::vector<EdgeSizes> m_paddings;
+    std::vector<DisplayType> m_displayTypes;
+    std::vector<BoxIndex> m_parents;
+    std::vector<BoxIndex> m_firstChildren;
+    std::vector<BoxIndex> m_lastChildren;
+    std::vector<BoxIndex> m_nextSiblings;
+    size_t m_liveCount;
+    threading::WorkPool* m_workPool;
+    LayoutCache* m_layoutCache;
+    bool m_hasLayoutWindow;
+    float m_layoutWindowTop;
+    float m_layoutWindowBottom;
+    float m_estimatedBoxHeight;
+    std::vector<BoxIndex> m_deferredBoxes;
+    uint64_t m_paintGeneration;
+};
+
+template <typename T, typename... Args>
+T* LayoutTree::create(Args&&... args) {
+    BoxIndex index = allocate();
+    T* box = new T(*this, index, std::forward<Args>(args)...);
+    m_boxes[index].reset(box);
+    ++m_liveCount;
+    return box;
+}
+
+} // namespace layout
+} // namespace browser
+
+#endif // BROWSER_LAYOUT_TREE_H
@@ -0,0 +1,235 @@
+#include "spatial_index.h"
+#include "box_model.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <cmath>
+
+namespace browser {
+namespace layout {
+
+namespace {
+
+bool contains(const Rect& rect, float x, float y) {
+    return x >= rect.x && x < rect.right() && y >= rect.y && y < rect.bottom();
+}
+
+bool intersects(const Rect& a, const Rect& b) {
+    return a.x < b.right() && b.x < a.right() && a.y < b.bottom() && b.y < a.bottom();
+}
+
+bool sameRect(const Rect& a, const Rect& b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+} // namespace
+
+SpatialIndex::SpatialIndex(float cellSize)
+    : m_cellSize(cellSize > 0 ? cellSize : defaultCellSize)
+    , m_generation(0)
+    , m_indexedCount(0)
+{
+}
+
+SpatialIndex::~SpatialIndex() {
+}
+
+uint64_t SpatialIndex::cellKey(int64_t x, int64_t y) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+}
+
+SpatialIndex::CellRange SpatialIndex::cellRange(const Rect& rect) const {
+    CellRange range;
+    range.x0 = static_cast<int64_t>(std::floor(rect.x / m_cellSize));
+    range.y0 = static_cast<int64_t>(std::floor(rect.y / m_cellSize));
+    range.x1 = static_cast<int64_t>(std::floor(rect.right() / m_cellSize));
+    range.y1 = static_cast<int64_t>(std::floor(rect.bottom() / m_cellSize));
+    return range;
+}
+
+void SpatialIndex::update(const LayoutTree& tree, BoxIndex root, Rect* damage) {
+    TRACE_SCOPE("layout", "SpatialIndex::update");
+
+    if (m_entries.size() < tree.size()) {
+        m_entries.resize(tree.size());
+    }
+
+    ++m_generation;
+    uint32_t order = 0;
+    if (tree.box(root)) {
+        visit(tree, root, order, damage);
+    }
+
+    // Boxes destroyed, hidden or deferred since the last update
+    for (BoxIndex index = 0; index < m_entries.size(); ++index) {
+        Entry& entry = m_entries[index];
+        if (entry.indexed && entry.generation != m_generation) {
+            if (damage) {
+                damage->unite(entry.rect);
+            }
+            remove(index);
+        }
+        entry.changed = false;
+    }
+}
+
+void SpatialIndex::markChanged(BoxIndex index) {
+    if (index >= m_entries.size()) {
+        m_entries.resize(index + 1);
+    }
+    m_entries[index].changed = true;
+}
+
+void SpatialIndex::visit(const LayoutTree& tree, BoxIndex index, uint32_t& order, Rect* damage) {
+    Box* box = tree.box(index);
+    if (box->displayType() == DisplayType::NONE || box->layoutDeferred()) {
+        return;
+    }
+
+    Entry& entry = m_entries[index];
+    entry.generation = m_generation;
+    entry.order = order++;
+
+    Rect rect = box->borderBox();
+    bool moved = !entry.indexed || !sameRect(entry.rect, rect);
+    if (damage && (moved || entry.changed)) {
+        if (entry.indexed) {
+            damage->unite(entry.rect);
+        }
+        damage->unite(rect);
+    }
+    if (moved) {
+        if (entry.indexed) {
+            remove(index);
+        }
+        entry.rect = rect;
+        insert(index);
+    }
+
+    for (BoxIndex child = tree.firstChild(index); child != noBox; child = tree.nextSibling(child)) {
+        visit(tree, child, order, damage);
+    }
+}
+
+void SpatialIndex::insert(BoxIndex index) {
+    Entry& entry = m_entries[index];
+    CellRange range = cellRange(entry.rect);
+
+    entry.indexed = true;
+    entry.oversized = range.count() > maxCellsPerBox;
+    ++m_indexedCount;
+
+    if (entry.oversized) {
+        m_oversized.push_back(index);
+        return;
+    }
+    for (int64_t y = range.y0; y <= range.y1; ++y) {
+        for (int64_t x = range.x0; x <= range.x1; ++x) {
+            m_cells[cellKey(x, y)].push_back(index);
+        }
+    }
+}
+
+void SpatialIndex::remove(BoxIndex index) {
+    Entry& entry = m_entries[index];
+    entry.indexed = false;
+    --m_indexedCount;
+
+    auto erase = [index](std::vector<BoxIndex>& list) {
+        auto it = std::find(list.begin(), list.end(), index);
+        if (it != list.end()) {
+            *it = list.back();
+            list.pop_back();
+        }
+    };
+
+    if (entry.oversized) {
+        erase(m_oversized);
+        return;
+    }
+    CellRange range = cellRange(entry.rect);
+    for (int64_t y = range.y0; y <= range.y1; ++y) {
+        for (int64_t x = range.x0; x <= range.x1; ++x) {
+            auto cell = m_cells.find(cellKey(x, y));
+            if (cell == m_cells.end()) {
+                continue;
+            }
+            erase(cell->second);
+            if (cell->second.empty()) {
+                m_cells.erase(cell);
+            }
+        }
+    }
+}
+
+Box* SpatialIndex::hitTest(const LayoutTree& tree, float x, float y) const {
+    const Entry* top = nullptr;
+    BoxIndex topIndex = noBox;
+    auto consider = [&](BoxIndex index) {
+        const Entry& entry = m_entries[index];
+        if (contains(entry.rect, x, y) && (!top || entry.order > top->order)) {
+            top = &entry;
+            topIndex = index;
+        }
+    };
+
+    auto cell = m_cells.find(cellKey(static_cast<int64_t>(std::floor(x / m_cellSize)),
+                                     static_cast<int64_t>(std::floor(y / m_cellSize))));
+    if (cell != m_cells.end()) {
+        for (BoxIndex index : cell->second) {
+            consider(index);
+        }
+    }
+    for (BoxIndex index : m_oversized) {
+        consider(index);
+    }
+    return top ? tree.box(topIndex) : nullptr;
+}
+
+void SpatialIndex::query(const LayoutTree& tree, const Rect& rect, std::vector<Box*>& boxes) const {
+    std::vector<BoxIndex> found;
+    auto collect = [&](const std::vector<BoxIndex>& list) {
+        for (BoxIndex index : list) {
+            if (intersects(m_entries[index].rect, rect)) {
+                found.push_back(index);
+            }
+        }
+    };
+
+    // Visit the occupied cells instead when the rect covers more
+    CellRange range = cellRange(rect);
+    if (range.count() > m_cells.size()) {
+        for (const auto& cell : m_cells) {
+            collect(cell.second);
+        }
+    } else {
+        for (int64_t y = range.y0; y <= range.y1; ++y) {
+            for (int64_t x = range.x0; x <= range.x1; ++x) {
+                auto cell = m_cells.find(cellKey(x, y));
+                if (cell != m_cells.end()) {
+                    collect(cell->second);
+                }
+            }
+        }
+    }
+    collect(m_oversized);
+
+    // Boxes in several cells were found once per cell
+    std::sort(found.begin(), found.end(), [this](BoxIndex a, BoxIndex b) {
+        return m_entries[a].order < m_entries[b].order;
+    });
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    for (BoxIndex index : found) {
+        boxes.push_back(tree.box(index));
+    }
+}
+
+void SpatialIndex::clear() {
+    m_entries.clear();
+    m_cells.clear();
+    m_oversized.clear();
+    m_indexedCount = 0;
+}
+
+} // namespace layout
+} // namespace browser
@@ -0,0 +1,83 @@
+#ifndef BROWSER_SPATIAL_INDEX_H
+#define BROWSER_SPATIAL_INDEX_H
+
+#include "layout_tree.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace layout {
+
+// Uniform grid over the border boxes of a laid out box tree, for hit
+// testing and rect queries. Each box is listed in the cells its border box
+// overlaps; boxes spanning more than maxCellsPerBox cells (the root, long
+// containers) are kept in a short list checked on every query instead.
+// update() syncs the grid with the tree, touching only the cells of boxes
+// whose rects changed, appeared or went away; the same comparison gives
+// the area those boxes covered before and after, which is what needs
+// repainting.
+class SpatialIndex {
+public:
+    static constexpr float defaultCellSize = 128.0f;
+    static constexpr size_t maxCellsPerBox = 64;
+
+    explicit SpatialIndex(float cellSize = defaultCellSize);
+    ~SpatialIndex();
+
+    // Sync with the geometry of root's subtree. Boxes with display: none,
+    // deferred boxes and their descendants aren't listed. With damage,
+    // the old and new border boxes of boxes that moved, resized, appeared,
+    // went away or were marked changed are united into it.
+    void update(const LayoutTree& tree, BoxIndex root, Rect* damage = nullptr);
+
+    // Count the box at index as changed at the next update even if its
+    // rect is the same, as for a box rebuilt in a reused slot
+    void markChanged(BoxIndex index);
+
+    // Topmost box, in paint order, whose border box contains (x, y)
+    Box* hitTest(const LayoutTree& tree, float x, float y) const;
+
+    // Boxes whose border boxes intersect rect, in paint order
+    void query(const LayoutTree& tree, const Rect& rect, std::vector<Box*>& boxes) const;
+
+    // Boxes listed
+    size_t size() const { return m_indexedCount; }
+
+    // Forget every box; needed when the tree is cleared
+    void clear();
+
+private:
+    struct Entry {
+        Rect rect;
+        uint32_t order = 0;       // Paint order at the last update
+        uint32_t generation = 0;  // Update the box was last seen by
+        bool indexed = false;
+        bool oversized = false;
+        bool changed = false;     // Marked since the last update
+    };
+
+    struct CellRange {
+        int64_t x0, y0, x1, y1;
+        size_t count() const { return static_cast<size_t>((x1 - x0 + 1) * (y1 - y0 + 1)); }
+    };
+
+    CellRange cellRange(const Rect& rect) const;
+    static uint64_t cellKey(int64_t x, int64_t y);
+
+    void visit(const LayoutTree& tree, BoxIndex index, uint32_t& order, Rect* damage);
+    void insert(BoxIndex index);
+    void remove(BoxIndex index);
+
+    float m_cellSize;
+    std::vector<Entry> m_entries;
+    std::unordered_map<uint64_t, std::vector<BoxIndex>> m_cells;
+    std::vector<BoxIndex> m_oversized;
+    uint32_t m_generation;
+    size_t m_indexedCount;
+};
+
+} // namespace layout
+} // namespace browser
+
+#endif // BROWSER_SPATIAL_INDEX_H
@@ -0,0 +1,97 @@
+#include "text_metrics.h"
+#include <mutex>
+
+namespace browser {
+namespace layout {
+
+TextMeasurementCache::TextMeasurementCache(size_t capacity)
+    : m_entryCount(0)
+    , m_capacity(capacity > 0 ? capacity : 1)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+TextMeasurementCache::~TextMeasurementCache() {
+}
+
+TextMeasurementCache& TextMeasurementCache::shared() {
+    static TextMeasurementCache cache;
+    return cache;
+}
+
+TextMeasurementCache::Font* TextMeasurementCache::findFont(const std::string& fontFamily, float fontSize) const {
+    // A page uses a handful of fonts
+    for (const auto& font : m_fonts) {
+        if (font->size == fontSize && font->family == fontFamily) {
+            return font.get();
+        }
+    }
+    return nullptr;
+}
+
+float TextMeasurementCache::measure(const std::string& fontFamily, float fontSize, std::string_view text) {
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        Font* font = findFont(fontFamily, fontSize);
+        if (font) {
+            auto it = font->widths.find(text);
+            if (it != font->widths.end()) {
+                ++m_hits;
+                return it->second;
+            }
+        }
+    }
+
+    ++m_misses;
+    float width = measureUncached(fontFamily, fontSize, text);
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (m_entryCount >= m_capacity) {
+        m_fonts.clear();
+        m_entryCount = 0;
+    }
+
+    Font* font = findFont(fontFamily, fontSize);
+    if (!font) {
+        m_fonts.push_back(std::unique_ptr<Font>(new Font{fontFamily, fontSize, {}, {}}));
+        font = m_fonts.back().get();
+    }
+
+    // Another thread may have added it meanwhile
+    if (font->widths.find(text) == font->widths.end()) {
+        font->words.emplace_back(text);
+        font->widths.emplace(font->words.back(), width);
+        ++m_entryCount;
+    }
+    return width;
+}
+
+float TextMeasurementCache::measureUncached(const std::string& /*fontFamily*/, float fontSize,
+                                            std::string_view text) {
+    return text.size() * fontSize * 0.5f;
+}
+
+double TextMeasurementCache::hitRate() const {
+    size_t lookups = m_hits + m_misses;
+    return lookups ? static_cast<double>(m_hits) / lookups : 0.0;
+}
+
+void TextMeasurementCache::resetCounters() {
+    m_hits = 0;
+    m_misses = 0;
+}
+
+size_t TextMeasurementCache::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_entryCount;
+}
+
+void TextMeasurementCache::clear() {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_fonts.clear();
+    m_entryCount = 0;
+}
+
+} // namespace layout
+} // namespace browser
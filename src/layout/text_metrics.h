@@ -0,0 +1,74 @@
+#ifndef BROWSER_TEXT_METRICS_H
+#define BROWSER_TEXT_METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace layout {
+
+// Advance widths of words, keyed by (font family, font size, word). Text
+// layout measures every word of every text box on each pass, and the same
+// words recur across boxes, passes and documents, so one cache is shared
+// process-wide. Lookups take a shared lock; past the capacity the whole
+// cache is dropped and refilled.
+class TextMeasurementCache {
+public:
+    static constexpr size_t defaultCapacity = 64 * 1024;
+
+    explicit TextMeasurementCache(size_t capacity = defaultCapacity);
+    ~TextMeasurementCache();
+
+    TextMeasurementCache(const TextMeasurementCache&) = delete;
+    TextMeasurementCache& operator=(const TextMeasurementCache&) = delete;
+
+    // Cache used by text layout
+    static TextMeasurementCache& shared();
+
+    // Advance width of text in the font, measured on a miss
+    float measure(const std::string& fontFamily, float fontSize, std::string_view text);
+
+    // Uncached measurement. Without font data every character advances
+    // half the font size.
+    static float measureUncached(const std::string& fontFamily, float fontSize, std::string_view text);
+
+    // Lookup counters since construction or resetCounters()
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    double hitRate() const;
+    void resetCounters();
+
+    size_t size() const;
+    size_t capacity() const { return m_capacity; }
+    void clear();
+
+private:
+    // Words measured in one font; the index keys view into words
+    struct Font {
+        std::string family;
+        float size;
+        std::deque<std::string> words;
+        std::unordered_map<std::string_view, float> widths;
+    };
+
+    Font* findFont(const std::string& fontFamily, float fontSize) const;
+
+    mutable std::shared_mutex m_mutex;
+    std::vector<std::unique_ptr<Font>> m_fonts;
+    size_t m_entryCount;
+    size_t m_capacity;
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_misses;
+};
+
+} // namespace layout
+} // namespace browser
+
+#endif // BROWSER_TEXT_METRICS_H
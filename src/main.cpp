@@ -2,6 +2,7 @@
 
 #include "browser/browser.h"
 #include "ui/browser_window.h"
+#include "tracing/trace.h"
 #include <iostream>
 #include <string>
 #include <memory>
@@ -18,6 +19,9 @@ namespace fs = std::filesystem;
 std::shared_ptr<browser::Browser> g_browser;
 std::shared_ptr<browser::ui::BrowserWindow> g_window;
 
+// Chrome trace written on exit (--trace)
+std::string g_traceFile;
+
 // Print usage information
 void printUsage(const char* programName) {
     std::cout << "Simple Browser - A web browser built from scratch\n\n";
@@ -32,6 +36,9 @@ void printUsage(const char* programName) {
     std::cout << "  --no-cache           Disable caching\n";
     std::cout << "  --incognito          Start in incognito mode (no persistent storage)\n";
     std::cout << "  --debug              Enable debug output\n";
+    std::cout << "  --trace <file>       Record page-load stages to a Chrome trace file\n";
+    std::cout << "  --trace-summary      Keep stage timings for about:tracing only\n";
+    std::cout << "  --parallel-layout    Lay out large independent blocks on worker threads\n";
     std::cout << "\nExamples:\n";
     std::cout << "  " << programName << " https://example.com\n";
     std::cout << "  " << programName << " --width 1280 --height 720 https://example.com\n";
@@ -47,6 +54,9 @@ struct CommandLineArgs {
     bool noCache = false;
     bool incognito = false;
     bool debug = false;
+    std::string traceFile;
+    bool traceSummary = false;
+    bool parallelLayout = false;
     bool showHelp = false;
     bool showVersion = false;
 };
@@ -84,6 +94,15 @@ CommandLineArgs parseCommandLine(int argc, char* argv[]) {
         else if (arg == "--debug") {
             args.debug = true;
         }
+        else if (arg == "--trace" && i + 1 < argc) {
+            args.traceFile = argv[++i];
+        }
+        else if (arg == "--trace-summary") {
+            args.traceSummary = true;
+        }
+        else if (arg == "--parallel-layout") {
+            args.parallelLayout = true;
+        }
         else if (arg[0] != '-') {
             // Assume it's a URL
             args.initialUrl = arg;
@@ -151,6 +170,20 @@ void initializeLogging(bool debug) {
     }
 }
 
+// Write the Chrome trace, if one was requested
+void writeTraceFile() {
+    if (g_traceFile.empty()) {
+        return;
+    }
+    
+    if (browser::tracing::Tracer::instance().writeChromeTrace(g_traceFile)) {
+        std::cout << "Trace written to " << g_traceFile << std::endl;
+    } else {
+        std::cerr << "Warning: Failed to write trace to " << g_traceFile << std::endl;
+    }
+    g_traceFile.clear();
+}
+
 // Clean shutdown handler
 void shutdownHandler(int signal) {
     std::cout << "\nShutting down browser..." << std::endl;
@@ -159,6 +192,7 @@ void shutdownHandler(int signal) {
         g_window->close();
     }
     
+    writeTraceFile();
     std::exit(0);
 }
 
@@ -182,6 +216,14 @@ int main(int argc, char* argv[]) {
         // Initialize logging
         initializeLogging(args.debug);
         
+        // Enable tracing before anything is loaded
+        if (!args.traceFile.empty()) {
+            g_traceFile = args.traceFile;
+            browser::tracing::Tracer::instance().setMode(browser::tracing::TraceMode::FULL);
+        } else if (args.traceSummary) {
+            browser::tracing::Tracer::instance().setMode(browser::tracing::TraceMode::SUMMARY);
+        }
+        
         // Set up signal handlers
 #ifdef _WIN32
         SetConsoleCtrlHandler([](DWORD) -> BOOL {
@@ -196,14 +238,6 @@ int main(int argc, char* argv[]) {
         // Create browser instance
         g_browser = std::make_shared<browser::Browser>();
         
-        // Initialize browser
-        std::cout << "Initializing browser engine..." << std::endl;
-        if (!g_browser->initialize()) {
-            std::cerr << "Failed to initialize browser engine" << std::endl;
-            return 1;
-        }
-        
-        
         // Configure cache
         if (!args.noCache && !args.incognito) {
             std::string cacheDir = args.cacheDir.empty() ? getDefaultCacheDir() : args.cacheDir;
@@ -214,8 +248,19 @@ int main(int argc, char* argv[]) {
             } catch (const std::exception& e) {
                 std::cerr << "Warning: Failed to create cache directory: " << e.what() << std::endl;
             }
+            g_browser->setCacheDirectory(cacheDir);
+        }
+        
+        // Initialize browser; networking and scripting finish starting in the
+        // background
+        std::cout << "Initializing browser engine..." << std::endl;
+        if (!g_browser->initialize()) {
+            std::cerr << "Failed to initialize browser engine" << std::endl;
+            return 1;
         }
         
+        g_browser->layoutEngine()->setParallelLayout(args.parallelLayout);
+        
         // Configure storage
         if (!args.incognito) {
             std::string storageDir = getDefaultStorageDir();
@@ -290,6 +335,7 @@ int main(int argc, char* argv[]) {
         std::cout << "Browser closed." << std::endl;
         g_window.reset();
         g_browser.reset();
+        writeTraceFile();
 
         
         return 0;
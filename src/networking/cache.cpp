@@ -1,16 +1,11 @@
 #include "cache.h"
+#include "disk_cache_storage.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
 #include <cstring>
-#include <filesystem>
 #include <functional>
-#include <iomanip>
-#include <fstream>
-
-// For cross-platform filesystem operations
-namespace fs = std::filesystem;
 
 namespace browser {
 namespace networking {
@@ -22,16 +17,32 @@ static int strcasecmp(const char* s1, const char* s2) {
 }
 #endif
 
+// Parse a delta-seconds directive value; invalid ones are ignored
+static void parseSeconds(const std::string& value, std::chrono::seconds& seconds) {
+    try {
+        seconds = std::chrono::seconds(std::stoi(value));
+    } catch (const std::exception&) {
+    }
+}
+
 //-----------------------------------------------------------------------------
 // CacheEntry Implementation
 //-----------------------------------------------------------------------------
 
-CacheEntry::CacheEntry() {
+CacheEntry::CacheEntry()
+    : m_data(emptySharedBytes())
+{
 }
 
 CacheEntry::CacheEntry(const std::string& url, const std::vector<uint8_t>& data,
                      const std::map<std::string, std::string>& headers)
-    : m_data(data)
+    : CacheEntry(url, std::make_shared<const std::vector<uint8_t>>(data), headers)
+{
+}
+
+CacheEntry::CacheEntry(const std::string& url, SharedBytes data,
+                     const std::map<std::string, std::string>& headers)
+    : m_data(data ? std::move(data) : emptySharedBytes())
 {
     m_metadata.url = url;
     m_metadata.headers = headers;
@@ -57,6 +68,14 @@ bool CacheEntry::isExpired() const {
     return std::chrono::system_clock::now() > m_metadata.expires;
 }
 
+bool CacheEntry::canServeStale() const {
+    return std::chrono::system_clock::now() <= m_metadata.expires + m_metadata.staleWhileRevalidate;
+}
+
+bool CacheEntry::canServeStaleOnError() const {
+    return std::chrono::system_clock::now() <= m_metadata.expires + m_metadata.staleIfError;
+}
+
 bool CacheEntry::canBeValidated() const {
     return !m_metadata.etag.empty() || !m_metadata.lastModified.empty();
 }
@@ -75,8 +94,28 @@ std::map<std::string, std::string> CacheEntry::getValidationHeaders() const {
     return headers;
 }
 
-void CacheEntry::update(const std::vector<uint8_t>& data, const std::map<std::string, std::string>& headers) {
-    m_data = data;
+void CacheEntry::refresh(const std::map<std::string, std::string>& headers) {
+    // Headers of a 304 replace the stored ones of the same name; the body
+    // and its length stay
+    std::map<std::string, std::string> merged = m_metadata.headers;
+    for (const auto& header : headers) {
+        if (strcasecmp(header.first.c_str(), "Content-Length") == 0) {
+            continue;
+        }
+        for (auto it = merged.begin(); it != merged.end();) {
+            if (strcasecmp(it->first.c_str(), header.first.c_str()) == 0) {
+                it = merged.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        merged[header.first] = header.second;
+    }
+    update(m_data, merged);
+}
+
+void CacheEntry::update(SharedBytes data, const std::map<std::string, std::string>& headers) {
+    m_data = data ? std::move(data) : emptySharedBytes();
     m_metadata.headers = headers;
     m_metadata.timestamp = std::chrono::system_clock::now();
     
@@ -97,8 +136,10 @@ void CacheEntry::update(const std::vector<uint8_t>& data, const std::map<std::st
 }
 
 void CacheEntry::parseCacheControlHeaders(const std::map<std::string, std::string>& headers) {
-    // Default expiry (1 hour)
+    // Default expiry (1 hour), and no serving stale unless allowed
     m_metadata.expires = m_metadata.timestamp + std::chrono::hours(1);
+    m_metadata.staleWhileRevalidate = std::chrono::seconds(0);
+    m_metadata.staleIfError = std::chrono::seconds(0);
     
     // Look for Expires header
     for (const auto& header : headers) {
@@ -126,8 +167,10 @@ void CacheEntry::parseCacheControlHeaders(const std::map<std::string, std::strin
                                [](unsigned char c) { return std::tolower(c); });
                 
                 if (directive == "no-cache" || directive == "no-store") {
-                    // Don't cache
+                    // Don't cache, nor serve stale
                     m_metadata.expires = m_metadata.timestamp;
+                    m_metadata.staleWhileRevalidate = std::chrono::seconds(0);
+                    m_metadata.staleIfError = std::chrono::seconds(0);
                     return;
                 } else if (directive.find("max-age=") == 0) {
                     // Parse max-age value
@@ -135,10 +178,13 @@ void CacheEntry::parseCacheControlHeaders(const std::map<std::string, std::strin
                     try {
                         int maxAge = std::stoi(maxAgeValue);
                         m_metadata.expires = m_metadata.timestamp + std::chrono::seconds(maxAge);
-                        return;
                     } catch (const std::exception&) {
                         // Ignore invalid max-age value
                     }
+                } else if (directive.find("stale-while-revalidate=") == 0) {
+                    parseSeconds(directive.substr(23), m_metadata.staleWhileRevalidate);
+                } else if (directive.find("stale-if-error=") == 0) {
+                    parseSeconds(directive.substr(15), m_metadata.staleIfError);
                 }
             }
             
@@ -175,7 +221,7 @@ bool MemoryCacheStorage::load(const std::string& url, CacheEntry& entry) {
         return false;
     }
     
-    // Copy entry
+    // Copy entry; the data is shared, not copied
     entry = it->second;
     
     return true;
@@ -224,302 +270,50 @@ std::vector<std::string> MemoryCacheStorage::getAllUrls() {
 }
 
 //-----------------------------------------------------------------------------
-// DiskCacheStorage Implementation
+// CacheIndex Implementation
 //-----------------------------------------------------------------------------
 
-DiskCacheStorage::DiskCacheStorage(const std::string& directory)
-    : m_directory(directory)
+CacheIndex::CacheIndex()
+    : m_bytes(0)
 {
 }
 
-DiskCacheStorage::~DiskCacheStorage() {
-}
-
-bool DiskCacheStorage::initialize() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    try {
-        // Create directory if it doesn't exist
-        if (!fs::exists(m_directory)) {
-            if (!fs::create_directories(m_directory)) {
-                std::cerr << "Failed to create cache directory: " << m_directory << std::endl;
-                return false;
-            }
-        }
-        
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error initializing disk cache: " << e.what() << std::endl;
-        return false;
+void CacheIndex::touch(const std::string& url, size_t size) {
+    auto found = m_nodes.find(url);
+    if (found != m_nodes.end()) {
+        m_bytes -= found->second->size;
+        found->second->size = size;
+        m_order.splice(m_order.begin(), m_order, found->second);
+    } else {
+        m_order.push_front(Node{url, size});
+        m_nodes.emplace(url, m_order.begin());
     }
+    m_bytes += size;
 }
 
-bool DiskCacheStorage::store(const CacheEntry& entry) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    try {
-        // Save metadata
-        if (!saveMetadata(entry.metadata().url, entry.metadata())) {
-            return false;
-        }
-        
-        // Save data
-        std::string filePath = getFilePath(entry.metadata().url);
-        std::ofstream file(filePath, std::ios::binary);
-        if (!file) {
-            return false;
-        }
-        
-        file.write(reinterpret_cast<const char*>(entry.data().data()), entry.data().size());
-        
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error storing cache entry: " << e.what() << std::endl;
+bool CacheIndex::touch(const std::string& url) {
+    auto found = m_nodes.find(url);
+    if (found == m_nodes.end()) {
         return false;
     }
+    m_order.splice(m_order.begin(), m_order, found->second);
+    return true;
 }
 
-bool DiskCacheStorage::load(const std::string& url, CacheEntry& entry) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    try {
-        // Load metadata
-        CacheEntryMetadata metadata;
-        if (!loadMetadata(url, metadata)) {
-            return false;
-        }
-        
-        // Load data
-        std::string filePath = getFilePath(url);
-        std::ifstream file(filePath, std::ios::binary | std::ios::ate);
-        if (!file) {
-            return false;
-        }
-        
-        // Get file size
-        std::streamsize fileSize = file.tellg();
-        file.seekg(0, std::ios::beg);
-        
-        // Read data
-        std::vector<uint8_t> data(fileSize);
-        if (!file.read(reinterpret_cast<char*>(data.data()), fileSize)) {
-            return false;
-        }
-        
-        // Create entry
-        entry = CacheEntry(url, data, metadata.headers);
-        
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error loading cache entry: " << e.what() << std::endl;
-        return false;
-    }
-}
-
-bool DiskCacheStorage::remove(const std::string& url) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    try {
-        // Remove data file
-        std::string filePath = getFilePath(url);
-        if (fs::exists(filePath)) {
-            if (!fs::remove(filePath)) {
-                return false;
-            }
-        }
-        
-        // Remove metadata file
-        std::string metadataPath = getMetadataPath(url);
-        if (fs::exists(metadataPath)) {
-            if (!fs::remove(metadataPath)) {
-                return false;
-            }
-        }
-        
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error removing cache entry: " << e.what() << std::endl;
-        return false;
-    }
-}
-
-void DiskCacheStorage::clear() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    try {
-        // Remove all files in cache directory
-        for (const auto& entry : fs::directory_iterator(m_directory)) {
-            fs::remove_all(entry.path());
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error clearing cache: " << e.what() << std::endl;
-    }
-}
-
-bool DiskCacheStorage::exists(const std::string& url) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    try {
-        // Check if files exist
-        std::string filePath = getFilePath(url);
-        std::string metadataPath = getMetadataPath(url);
-        
-        return fs::exists(filePath) && fs::exists(metadataPath);
-    } catch (const std::exception& e) {
-        std::cerr << "Error checking cache entry: " << e.what() << std::endl;
-        return false;
-    }
-}
-
-std::vector<std::string> DiskCacheStorage::getAllUrls() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    std::vector<std::string> urls;
-    
-    try {
-        // Find all metadata files
-        for (const auto& entry : fs::directory_iterator(m_directory)) {
-            if (entry.path().extension() == ".meta") {
-                // Extract URL from filename
-                std::string filename = entry.path().stem().string();
-                
-                // Append to list
-                urls.push_back(filename);
-            }
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error getting cache URLs: " << e.what() << std::endl;
-    }
-    
-    return urls;
-}
-
-std::string DiskCacheStorage::getFilePath(const std::string& url) const {
-    return m_directory + "/" + urlToFilename(url) + ".data";
-}
-
-std::string DiskCacheStorage::getMetadataPath(const std::string& url) const {
-    return m_directory + "/" + urlToFilename(url) + ".meta";
-}
-
-std::string DiskCacheStorage::urlToFilename(const std::string& url) const {
-    // Hash the URL to create a valid filename
-    std::hash<std::string> hasher;
-    size_t hash = hasher(url);
-    
-    std::stringstream ss;
-    ss << std::hex << hash;
-    
-    return ss.str();
-}
-
-bool DiskCacheStorage::saveMetadata(const std::string& url, const CacheEntryMetadata& metadata) {
-    try {
-        // Create metadata file
-        std::string metadataPath = getMetadataPath(url);
-        std::ofstream file(metadataPath);
-        if (!file) {
-            return false;
-        }
-        
-        // Write metadata
-        file << "URL: " << metadata.url << std::endl;
-        file << "ETag: " << metadata.etag << std::endl;
-        file << "Last-Modified: " << metadata.lastModified << std::endl;
-        
-        // Write timestamp and expires
-        auto timestampTime = std::chrono::system_clock::to_time_t(metadata.timestamp);
-        auto expiresTime = std::chrono::system_clock::to_time_t(metadata.expires);
-        
-        file << "Timestamp: " << timestampTime << std::endl;
-        file << "Expires: " << expiresTime << std::endl;
-        
-        // Write headers
-        file << "Headers: " << metadata.headers.size() << std::endl;
-        for (const auto& header : metadata.headers) {
-            file << header.first << ": " << header.second << std::endl;
-        }
-        
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error saving metadata: " << e.what() << std::endl;
-        return false;
+void CacheIndex::erase(const std::string& url) {
+    auto found = m_nodes.find(url);
+    if (found == m_nodes.end()) {
+        return;
     }
+    m_bytes -= found->second->size;
+    m_order.erase(found->second);
+    m_nodes.erase(found);
 }
 
-bool DiskCacheStorage::loadMetadata(const std::string& url, CacheEntryMetadata& metadata) {
-    try {
-        // Open metadata file
-        std::string metadataPath = getMetadataPath(url);
-        std::ifstream file(metadataPath);
-        if (!file) {
-            return false;
-        }
-        
-        // Read metadata
-        std::string line;
-        
-        // URL
-        if (!std::getline(file, line) || line.substr(0, 5) != "URL: ") {
-            return false;
-        }
-        metadata.url = line.substr(5);
-        
-        // ETag
-        if (!std::getline(file, line) || line.substr(0, 6) != "ETag: ") {
-            return false;
-        }
-        metadata.etag = line.substr(6);
-        
-        // Last-Modified
-        if (!std::getline(file, line) || line.substr(0, 15) != "Last-Modified: ") {
-            return false;
-        }
-        metadata.lastModified = line.substr(15);
-        
-        // Timestamp
-        if (!std::getline(file, line) || line.substr(0, 11) != "Timestamp: ") {
-            return false;
-        }
-        time_t timestampTime = std::stoll(line.substr(11));
-        metadata.timestamp = std::chrono::system_clock::from_time_t(timestampTime);
-        
-        // Expires
-        if (!std::getline(file, line) || line.substr(0, 9) != "Expires: ") {
-            return false;
-        }
-        time_t expiresTime = std::stoll(line.substr(9));
-        metadata.expires = std::chrono::system_clock::from_time_t(expiresTime);
-        
-        // Headers
-        if (!std::getline(file, line) || line.substr(0, 9) != "Headers: ") {
-            return false;
-        }
-        int headerCount = std::stoi(line.substr(9));
-        
-        metadata.headers.clear();
-        
-        for (int i = 0; i < headerCount; i++) {
-            if (!std::getline(file, line)) {
-                return false;
-            }
-            
-            size_t colonPos = line.find(": ");
-            if (colonPos == std::string::npos) {
-                return false;
-            }
-            
-            std::string name = line.substr(0, colonPos);
-            std::string value = line.substr(colonPos + 2);
-            
-            metadata.headers[name] = value;
-        }
-        
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error loading metadata: " << e.what() << std::endl;
-        return false;
-    }
+void CacheIndex::clear() {
+    m_order.clear();
+    m_nodes.clear();
+    m_bytes = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -529,8 +323,11 @@ bool DiskCacheStorage::loadMetadata(const std::string& url, CacheEntryMetadata&
 Cache::Cache()
     : m_maxMemoryCacheSize(10 * 1024 * 1024)  // 10 MB
     , m_maxDiskCacheSize(100 * 1024 * 1024)   // 100 MB
-    , m_currentMemoryCacheSize(0)
-    , m_currentDiskCacheSize(0)
+    , m_memoryHits(0)
+    , m_diskHits(0)
+    , m_misses(0)
+    , m_memoryEvictions(0)
+    , m_diskEvictions(0)
 {
 }
 
@@ -540,6 +337,8 @@ Cache::~Cache() {
 bool Cache::initialize(const std::string& cacheDirectory) {
     // Initialize memory cache
     m_memoryCache = std::make_unique<MemoryCacheStorage>();
+    m_memoryIndex.clear();
+    m_diskIndex.clear();
     
     // Initialize disk cache if directory provided
     if (!cacheDirectory.empty()) {
@@ -548,6 +347,13 @@ bool Cache::initialize(const std::string& cacheDirectory) {
             m_diskCache.reset();
             return false;
         }
+        
+        // Index what earlier sessions left, the most recently written
+        // counting as the most recently used
+        for (const auto& stored : m_diskCache->storedEntries()) {
+            m_diskIndex.touch(stored.first, stored.second);
+        }
+        enforceDiskCacheSize();
     }
     
     return true;
@@ -556,23 +362,23 @@ bool Cache::initialize(const std::string& cacheDirectory) {
 bool Cache::get(const std::string& url, CacheEntry& entry) {
     // Try memory cache first
     if (m_memoryCache && m_memoryCache->load(url, entry)) {
+        m_memoryIndex.touch(url);
+        m_diskIndex.touch(url);
+        ++m_memoryHits;
         return true;
     }
     
     // Then try disk cache
     if (m_diskCache && m_diskCache->load(url, entry)) {
-        // Add to memory cache for faster access next time
-        if (m_memoryCache) {
-            m_memoryCache->store(entry);
-            
-            // Update memory cache size
-            m_currentMemoryCacheSize += entry.data().size();
-            enforceMemoryCacheSize();
-        }
+        m_diskIndex.touch(url, entry.data().size());
+        ++m_diskHits;
         
+        // Add to memory cache for faster access next time
+        storeInMemory(entry);
         return true;
     }
     
+    ++m_misses;
     return false;
 }
 
@@ -582,41 +388,84 @@ bool Cache::put(const CacheEntry& entry) {
         return false;
     }
     
-    // Store in memory cache
-    if (m_memoryCache) {
-        m_memoryCache->store(entry);
-        
-        // Update memory cache size
-        m_currentMemoryCacheSize += entry.data().size();
-        enforceMemoryCacheSize();
+    storeInMemory(entry);
+    storeOnDisk(entry);
+    return true;
+}
+
+void Cache::storeInMemory(const CacheEntry& entry) {
+    if (!m_memoryCache) {
+        return;
     }
     
-    // Store in disk cache
-    if (m_diskCache) {
-        m_diskCache->store(entry);
-        
-        // Update disk cache size
-        m_currentDiskCacheSize += entry.data().size();
-        enforceDiskCacheSize();
+    const std::string& url = entry.metadata().url;
+    if (entry.data().size() > m_maxMemoryCacheSize) {
+        m_memoryCache->remove(url);
+        m_memoryIndex.erase(url);
+        return;
     }
     
-    return true;
+    m_memoryCache->store(entry);
+    m_memoryIndex.touch(url, entry.data().size());
+    enforceMemoryCacheSize();
+}
+
+void Cache::storeOnDisk(const CacheEntry& entry) {
+    if (!m_diskCache) {
+        return;
+    }
+    
+    const std::string& url = entry.metadata().url;
+    if (entry.data().size() > m_maxDiskCacheSize || !m_diskCache->store(entry)) {
+        m_diskCache->remove(url);
+        m_diskIndex.erase(url);
+        return;
+    }
+    
+    m_diskIndex.touch(url, entry.data().size());
+    enforceDiskCacheSize();
 }
 
 void Cache::clear() {
     // Clear memory cache
     if (m_memoryCache) {
         m_memoryCache->clear();
-        m_currentMemoryCacheSize = 0;
+        m_memoryIndex.clear();
     }
     
     // Clear disk cache
     if (m_diskCache) {
         m_diskCache->clear();
-        m_currentDiskCacheSize = 0;
+        m_diskIndex.clear();
     }
 }
 
+std::string Cache::diskCacheDirectory() const {
+    return m_diskCache ? m_diskCache->directory() : std::string();
+}
+
+CacheStats Cache::stats() const {
+    CacheStats stats;
+    stats.memoryHits = m_memoryHits;
+    stats.diskHits = m_diskHits;
+    stats.misses = m_misses;
+    stats.memoryEvictions = m_memoryEvictions;
+    stats.diskEvictions = m_diskEvictions;
+    stats.memoryEntries = m_memoryIndex.count();
+    stats.memoryBytes = m_memoryIndex.bytes();
+    stats.diskEntries = m_diskIndex.count();
+    stats.diskBytes = m_diskIndex.bytes();
+    return stats;
+}
+
+void Cache::resetCounters() {
+    m_memoryHits = 0;
+    m_diskHits = 0;
+    m_misses = 0;
+    m_memoryEvictions = 0;
+    m_diskEvictions = 0;
+}
+
 void Cache::setMaxMemoryCacheSize(size_t bytes) {
     m_maxMemoryCacheSize = bytes;
     enforceMemoryCacheSize();
@@ -627,55 +476,35 @@ void Cache::setMaxDiskCacheSize(size_t bytes) {
     enforceDiskCacheSize();
 }
 
-void Cache::enforceMemoryCacheSize() {
-    if (!m_memoryCache || m_currentMemoryCacheSize <= m_maxMemoryCacheSize) {
+void Cache::trimMemoryCache(size_t bytes) {
+    if (!m_memoryCache) {
         return;
     }
     
-    // Get all URLs
-    std::vector<std::string> urls = m_memoryCache->getAllUrls();
-    
-    // Remove oldest entries until size is below limit
-    for (const std::string& url : urls) {
-        CacheEntry entry;
-        if (m_memoryCache->load(url, entry)) {
-            // Remove entry
-            m_memoryCache->remove(url);
-            
-            // Update size
-            m_currentMemoryCacheSize -= entry.data().size();
-            
-            // Check if size is below limit
-            if (m_currentMemoryCacheSize <= m_maxMemoryCacheSize) {
-                break;
-            }
-        }
+    // Remove least recently used entries until size is below limit
+    while (m_memoryIndex.bytes() > bytes && !m_memoryIndex.empty()) {
+        std::string url = m_memoryIndex.leastRecent();
+        m_memoryCache->remove(url);
+        m_memoryIndex.erase(url);
+        ++m_memoryEvictions;
     }
 }
 
+void Cache::enforceMemoryCacheSize() {
+    trimMemoryCache(m_maxMemoryCacheSize);
+}
+
 void Cache::enforceDiskCacheSize() {
-    if (!m_diskCache || m_currentDiskCacheSize <= m_maxDiskCacheSize) {
+    if (!m_diskCache) {
         return;
     }
     
-    // Get all URLs
-    std::vector<std::string> urls = m_diskCache->getAllUrls();
-    
-    // Remove oldest entries until size is below limit
-    for (const std::string& url : urls) {
-        CacheEntry entry;
-        if (m_diskCache->load(url, entry)) {
-            // Remove entry
-            m_diskCache->remove(url);
-            
-            // Update size
-            m_currentDiskCacheSize -= entry.data().size();
-            
-            // Check if size is below limit
-            if (m_currentDiskCacheSize <= m_maxDiskCacheSize) {
-                break;
-            }
-        }
+    // Remove least recently used entries until size is below limit
+    while (m_diskIndex.bytes() > m_maxDiskCacheSize && !m_diskIndex.empty()) {
+        std::string url = m_diskIndex.leastRecent();
+        m_diskCache->remove(url);
+        m_diskIndex.erase(url);
+        ++m_diskEvictions;
     }
 }
 
@@ -4,10 +4,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
+#include <unordered_map>
 #include <mutex>
 #include <chrono>
 #include <memory>
 #include <functional>
+#include "shared_bytes.h"
 
 namespace browser {
 namespace networking {
@@ -21,6 +24,11 @@ struct CacheEntryMetadata {
     std::chrono::system_clock::time_point expires;
     std::chrono::system_clock::time_point timestamp;
     
+    // How long past expires the entry may still be used: while it is
+    // revalidated in the background, and when revalidation fails
+    std::chrono::seconds staleWhileRevalidate{0};
+    std::chrono::seconds staleIfError{0};
+    
     bool operator==(const CacheEntryMetadata& other) const {
         return url == other.url;
     }
@@ -32,17 +40,26 @@ public:
     CacheEntry();
     CacheEntry(const std::string& url, const std::vector<uint8_t>& data,
               const std::map<std::string, std::string>& headers);
+    CacheEntry(const std::string& url, SharedBytes data,
+              const std::map<std::string, std::string>& headers);
     ~CacheEntry();
     
     // Get metadata
     const CacheEntryMetadata& metadata() const { return m_metadata; }
     
-    // Get data
-    const std::vector<uint8_t>& data() const { return m_data; }
+    // Get data. Copies of an entry share it; sharedData() hands it out
+    // without a copy.
+    const std::vector<uint8_t>& data() const { return *m_data; }
+    const SharedBytes& sharedData() const { return m_data; }
     
     // Check if entry is expired
     bool isExpired() const;
     
+    // Whether an expired entry is within its stale-while-revalidate or
+    // stale-if-error window
+    bool canServeStale() const;
+    bool canServeStaleOnError() const;
+    
     // Check if entry can be validated (has ETag or Last-Modified)
     bool canBeValidated() const;
     
@@ -50,11 +67,14 @@ public:
     std::map<std::string, std::string> getValidationHeaders() const;
     
     // Update entry with new data and headers
-    void update(const std::vector<uint8_t>& data, const std::map<std::string, std::string>& headers);
+    void update(SharedBytes data, const std::map<std::string, std::string>& headers);
+    
+    // Make the entry fresh again with the headers of a 304 response
+    void refresh(const std::map<std::string, std::string>& headers);
     
 private:
     CacheEntryMetadata m_metadata;
-    std::vector<uint8_t> m_data;
+    SharedBytes m_data;
     
     // Parse cache control headers
     void parseCacheControlHeaders(const std::map<std::string, std::string>& headers);
@@ -113,47 +133,59 @@ private:
     std::mutex m_mutex;
 };
 
-// Disk-based cache storage (persistent)
-class DiskCacheStorage : public CacheStorage {
+class DiskCacheStorage;
+
+// Which entries of a cache tier were used least recently, with each
+// entry's body size, so the tier can be kept within its limit without
+// loading anything. All operations are O(1).
+class CacheIndex {
 public:
-    DiskCacheStorage(const std::string& directory);
-    virtual ~DiskCacheStorage();
+    CacheIndex();
     
-    // Initialize storage
-    bool initialize();
+    // Record a use of url, adding it or changing its size
+    void touch(const std::string& url, size_t size);
     
-    // Store entry
-    virtual bool store(const CacheEntry& entry) override;
+    // Record a use of url if indexed; false if not
+    bool touch(const std::string& url);
     
-    // Load entry
-    virtual bool load(const std::string& url, CacheEntry& entry) override;
-    
-    // Delete entry
-    virtual bool remove(const std::string& url) override;
-    
-    // Clear all entries
-    virtual void clear() override;
+    void erase(const std::string& url);
+    void clear();
     
-    // Check if entry exists
-    virtual bool exists(const std::string& url) override;
+    bool empty() const { return m_order.empty(); }
+    size_t count() const { return m_order.size(); }
+    size_t bytes() const { return m_bytes; }
     
-    // Get all URLs in cache
-    virtual std::vector<std::string> getAllUrls() override;
+    // The entry to evict next; the index must not be empty
+    const std::string& leastRecent() const { return m_order.back().url; }
     
 private:
-    std::string m_directory;
-    std::mutex m_mutex;
-    
-    // Helpers
-    std::string getFilePath(const std::string& url) const;
-    std::string getMetadataPath(const std::string& url) const;
-    std::string urlToFilename(const std::string& url) const;
-    
-    bool saveMetadata(const std::string& url, const CacheEntryMetadata& metadata);
-    bool loadMetadata(const std::string& url, CacheEntryMetadata& metadata);
+    struct Node {
+        std::string url;
+        size_t size;
+    };
+    
+    // Most recently used first
+    std::list<Node> m_order;
+    std::unordered_map<std::string, std::list<Node>::iterator> m_nodes;
+    size_t m_bytes;
+};
+
+// Cache counters since construction or resetCounters(), and what each
+// tier holds
+struct CacheStats {
+    size_t memoryHits = 0;
+    size_t diskHits = 0;
+    size_t misses = 0;
+    size_t memoryEvictions = 0;
+    size_t diskEvictions = 0;
+    size_t memoryEntries = 0;
+    size_t memoryBytes = 0;
+    size_t diskEntries = 0;
+    size_t diskBytes = 0;
 };
 
-// Cache manager
+// Cache manager. Each tier evicts its least recently used entries once
+// it holds more than its maximum size. Not thread-safe.
 class Cache {
 public:
     Cache();
@@ -177,6 +209,16 @@ public:
     // Set maximum disk cache size (in bytes)
     void setMaxDiskCacheSize(size_t bytes);
     
+    // Drop least recently used entries from memory until it holds at most
+    // bytes. Copies on disk are kept, and the maximum size is unchanged.
+    void trimMemoryCache(size_t bytes);
+    
+    // Disk cache directory, or empty without a disk cache
+    std::string diskCacheDirectory() const;
+    
+    CacheStats stats() const;
+    void resetCounters();
+    
 private:
     // Cache storages
     std::unique_ptr<MemoryCacheStorage> m_memoryCache;
@@ -185,8 +227,22 @@ private:
     // Cache sizes
     size_t m_maxMemoryCacheSize;
     size_t m_maxDiskCacheSize;
-    size_t m_currentMemoryCacheSize;
-    size_t m_currentDiskCacheSize;
+    
+    // Recency and size of what each storage holds
+    CacheIndex m_memoryIndex;
+    CacheIndex m_diskIndex;
+    
+    // Counters
+    size_t m_memoryHits;
+    size_t m_diskHits;
+    size_t m_misses;
+    size_t m_memoryEvictions;
+    size_t m_diskEvictions;
+    
+    // Store in one tier, or drop an older version there if the entry is
+    // bigger than the whole tier
+    void storeInMemory(const CacheEntry& entry);
+    void storeOnDisk(const CacheEntry& entry);
     
     // Enforce cache size limits
     void enforceMemoryCacheSize();
@@ -0,0 +1,174 @@
+#include "connection_pool.h"
+#include "tls_transport.h"
+#include "../tracing/trace.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+namespace browser {
+namespace networking {
+
+//-----------------------------------------------------------------------------
+// Helper Functions
+//-----------------------------------------------------------------------------
+
+// An idle connection has nothing to read; if it's readable the server
+// closed it, or sent something no request asked for
+static bool idleConnectionUsable(socket_t socket) {
+#ifdef _WIN32
+    WSAPOLLFD fd = {};
+    fd.fd = socket;
+    fd.events = POLLIN;
+    return WSAPoll(&fd, 1, 0) == 0;
+#else
+    struct pollfd fd = {};
+    fd.fd = socket;
+    fd.events = POLLIN;
+    return poll(&fd, 1, 0) == 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ConnectionPool Implementation
+//-----------------------------------------------------------------------------
+
+ConnectionPool::ConnectionPool()
+    : m_maxPerOrigin(6)
+    , m_idleTimeout(15)
+    , m_reused(0)
+    , m_opened(0)
+{
+}
+
+ConnectionPool::~ConnectionPool() {
+    closeIdle();
+}
+
+std::string ConnectionPool::originKey(const std::string& protocol, const std::string& host, int port) {
+    return protocol + "://" + host + ":" + std::to_string(port);
+}
+
+void ConnectionPool::setMaxConnectionsPerOrigin(size_t count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxPerOrigin = count > 0 ? count : 1;
+    m_released.notify_all();
+}
+
+size_t ConnectionPool::maxConnectionsPerOrigin() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_maxPerOrigin;
+}
+
+void ConnectionPool::setIdleTimeout(std::chrono::seconds timeout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idleTimeout = timeout;
+}
+
+bool ConnectionPool::tryAcquire(const std::string& origin, socket_t& socket, std::unique_ptr<TlsStream>* tls) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return tryAcquireLocked(origin, socket, tls);
+}
+
+socket_t ConnectionPool::acquire(const std::string& origin, std::unique_ptr<TlsStream>* tls) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    socket_t socket = INVALID_SOCKET;
+    m_released.wait(lock, [&] { return tryAcquireLocked(origin, socket, tls); });
+    return socket;
+}
+
+void ConnectionPool::release(const std::string& origin, socket_t socket, bool reusable,
+                             std::unique_ptr<TlsStream> tls) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Origin& entry = m_origins[origin];
+        if (entry.inUse > 0) {
+            --entry.inUse;
+        }
+        if (reusable && socket != INVALID_SOCKET) {
+            entry.idle.push_back({socket, std::move(tls), std::chrono::steady_clock::now()});
+            socket = INVALID_SOCKET;
+        }
+    }
+    m_released.notify_all();
+
+    if (socket != INVALID_SOCKET) {
+        closesocket(socket);
+    }
+}
+
+void ConnectionPool::closeIdle() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& origin : m_origins) {
+        for (const IdleConnection& connection : origin.second.idle) {
+            closesocket(connection.socket);
+        }
+        origin.second.idle.clear();
+    }
+    m_released.notify_all();
+}
+
+size_t ConnectionPool::idleCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    for (const auto& origin : m_origins) {
+        count += origin.second.idle.size();
+    }
+    return count;
+}
+
+size_t ConnectionPool::reusedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reused;
+}
+
+size_t ConnectionPool::openedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_opened;
+}
+
+void ConnectionPool::pruneIdle(Origin& origin, std::chrono::steady_clock::time_point now) {
+    for (auto it = origin.idle.begin(); it != origin.idle.end();) {
+        if (now - it->since >= m_idleTimeout || !idleConnectionUsable(it->socket)) {
+            closesocket(it->socket);
+            it = origin.idle.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool ConnectionPool::tryAcquireLocked(const std::string& origin, socket_t& socket, std::unique_ptr<TlsStream>* tls) {
+    Origin& entry = m_origins[origin];
+    pruneIdle(entry, std::chrono::steady_clock::now());
+
+    // The most recently used connection is the least likely to have been
+    // closed by the server
+    if (!entry.idle.empty()) {
+        socket = entry.idle.back().socket;
+        if (tls) {
+            *tls = std::move(entry.idle.back().tls);
+        }
+        entry.idle.pop_back();
+        ++entry.inUse;
+        ++m_reused;
+        TRACE_COUNTER("net", "connectionsReused", static_cast<int64_t>(m_reused));
+        return true;
+    }
+
+    if (entry.inUse < m_maxPerOrigin) {
+        socket = INVALID_SOCKET;
+        if (tls) {
+            tls->reset();
+        }
+        ++entry.inUse;
+        ++m_opened;
+        TRACE_COUNTER("net", "connectionsOpened", static_cast<int64_t>(m_opened));
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace networking
+} // namespace browser
@@ -0,0 +1,94 @@
+#ifndef BROWSER_CONNECTION_POOL_H
+#define BROWSER_CONNECTION_POOL_H
+
+#include "http_client.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace browser {
+namespace networking {
+
+class TlsStream;
+
+// Persistent HTTP/1.1 connections, kept per origin (scheme, host and port)
+// between requests so they skip the TCP handshake. Each origin has a limit
+// on the connections open to it, idle or in use; idle ones are closed after
+// a timeout. An HTTPS connection keeps its TLS stream with it, so reuse
+// skips the TLS handshake as well. Thread-safe, so clients on different
+// threads can share one.
+class ConnectionPool {
+public:
+    ConnectionPool();
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    static std::string originKey(const std::string& protocol, const std::string& host, int port);
+
+    // Connections open to one origin at most
+    void setMaxConnectionsPerOrigin(size_t count);
+    size_t maxConnectionsPerOrigin() const;
+
+    // How long a connection may sit idle before it's closed
+    void setIdleTimeout(std::chrono::seconds timeout);
+
+    // Claim a connection to origin: an idle one to reuse in socket, with
+    // its TLS stream in tls if it has one, or INVALID_SOCKET with a slot
+    // reserved for the caller to open a new one. False if the origin is at
+    // its limit. Every claim is given back with release().
+    bool tryAcquire(const std::string& origin, socket_t& socket, std::unique_ptr<TlsStream>* tls = nullptr);
+
+    // tryAcquire(), waiting for the origin to drop below its limit
+    socket_t acquire(const std::string& origin, std::unique_ptr<TlsStream>* tls = nullptr);
+
+    // Give a claimed connection back, to be reused if reusable, otherwise
+    // closed. socket may be INVALID_SOCKET if a new one was never opened.
+    void release(const std::string& origin, socket_t socket, bool reusable,
+                 std::unique_ptr<TlsStream> tls = nullptr);
+
+    // Close every idle connection
+    void closeIdle();
+
+    size_t idleCount() const;
+
+    // Connections handed out for reuse, and slots handed out for new ones
+    size_t reusedCount() const;
+    size_t openedCount() const;
+
+private:
+    struct IdleConnection {
+        socket_t socket;
+        std::unique_ptr<TlsStream> tls;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    struct Origin {
+        size_t inUse = 0;
+        std::deque<IdleConnection> idle;    // Most recently used last
+    };
+
+    // Close idle connections that timed out or that the server closed
+    void pruneIdle(Origin& origin, std::chrono::steady_clock::time_point now);
+
+    bool tryAcquireLocked(const std::string& origin, socket_t& socket, std::unique_ptr<TlsStream>* tls);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::map<std::string, Origin> m_origins;
+    size_t m_maxPerOrigin;
+    std::chrono::seconds m_idleTimeout;
+    size_t m_reused;
+    size_t m_opened;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_CONNECTION_POOL_H
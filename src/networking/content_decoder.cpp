@@ -0,0 +1,195 @@
+#include "content_decoder.h"
+#include <algorithm>
+#include <cctype>
+
+#ifdef BROWSER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef BROWSER_HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+namespace browser {
+namespace networking {
+
+// Decoded bytes are handed on in pieces of this size
+static const size_t kOutputBufferSize = 16384;
+
+#ifdef BROWSER_HAVE_ZLIB
+
+//-----------------------------------------------------------------------------
+// ZlibDecoder Implementation
+//-----------------------------------------------------------------------------
+
+// gzip, and deflate as servers send it: zlib-wrapped, or raw from the ones
+// that misread the spec
+class ZlibDecoder : public ContentDecoder {
+public:
+    ZlibDecoder()
+        : m_initialized(false)
+        , m_done(false)
+        , m_triedRaw(false)
+    {
+        m_stream = z_stream();
+        // 32 lets zlib tell gzip and zlib headers apart
+        m_initialized = inflateInit2(&m_stream, 15 + 32) == Z_OK;
+    }
+
+    ~ZlibDecoder() override {
+        if (m_initialized) {
+            inflateEnd(&m_stream);
+        }
+    }
+
+    bool decode(const uint8_t* data, size_t length, const Output& output) override {
+        if (!m_initialized) {
+            return false;
+        }
+
+        m_stream.next_in = const_cast<Bytef*>(data);
+        m_stream.avail_in = static_cast<uInt>(length);
+        while (m_stream.avail_in > 0 && !m_done) {
+            m_stream.next_out = m_buffer;
+            m_stream.avail_out = sizeof(m_buffer);
+
+            int result = inflate(&m_stream, Z_NO_FLUSH);
+            if (result == Z_DATA_ERROR && !m_triedRaw && m_stream.total_out == 0) {
+                // Headerless deflate; start over on the same bytes
+                m_triedRaw = true;
+                inflateEnd(&m_stream);
+                m_stream = z_stream();
+                m_initialized = inflateInit2(&m_stream, -15) == Z_OK;
+                return m_initialized && decode(data, length, output);
+            }
+            if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+                return false;
+            }
+
+            size_t produced = sizeof(m_buffer) - m_stream.avail_out;
+            if (produced > 0) {
+                output(m_buffer, produced);
+            }
+            if (result == Z_STREAM_END) {
+                m_done = true;
+            } else if (result == Z_BUF_ERROR && produced == 0) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool finish() override {
+        return m_done;
+    }
+
+private:
+    z_stream m_stream;
+    bool m_initialized;
+    bool m_done;
+    bool m_triedRaw;
+    Bytef m_buffer[kOutputBufferSize];
+};
+
+#endif
+
+#ifdef BROWSER_HAVE_BROTLI
+
+//-----------------------------------------------------------------------------
+// BrotliDecoder Implementation
+//-----------------------------------------------------------------------------
+
+class BrotliDecoder : public ContentDecoder {
+public:
+    BrotliDecoder()
+        : m_state(BrotliDecoderCreateInstance(nullptr, nullptr, nullptr))
+        , m_done(false)
+    {
+    }
+
+    ~BrotliDecoder() override {
+        if (m_state) {
+            BrotliDecoderDestroyInstance(m_state);
+        }
+    }
+
+    bool decode(const uint8_t* data, size_t length, const Output& output) override {
+        if (!m_state) {
+            return false;
+        }
+
+        size_t availableIn = length;
+        const uint8_t* nextIn = data;
+        while (!m_done) {
+            size_t availableOut = sizeof(m_buffer);
+            uint8_t* nextOut = m_buffer;
+            BrotliDecoderResult result = BrotliDecoderDecompressStream(
+                m_state, &availableIn, &nextIn, &availableOut, &nextOut, nullptr);
+            if (result == BROTLI_DECODER_RESULT_ERROR) {
+                return false;
+            }
+
+            size_t produced = sizeof(m_buffer) - availableOut;
+            if (produced > 0) {
+                output(m_buffer, produced);
+            }
+            if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+                m_done = true;
+            } else if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool finish() override {
+        return m_done;
+    }
+
+private:
+    BrotliDecoderState* m_state;
+    bool m_done;
+    uint8_t m_buffer[kOutputBufferSize];
+};
+
+#endif
+
+//-----------------------------------------------------------------------------
+// ContentDecoder Implementation
+//-----------------------------------------------------------------------------
+
+std::unique_ptr<ContentDecoder> ContentDecoder::create(const std::string& encoding) {
+    std::string name = encoding;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t") + 1);
+
+#ifdef BROWSER_HAVE_ZLIB
+    if (name == "gzip" || name == "x-gzip" || name == "deflate") {
+        return std::make_unique<ZlibDecoder>();
+    }
+#endif
+#ifdef BROWSER_HAVE_BROTLI
+    if (name == "br") {
+        return std::make_unique<BrotliDecoder>();
+    }
+#endif
+    return nullptr;
+}
+
+const std::string& ContentDecoder::acceptEncoding() {
+    static const std::string encodings = [] {
+        std::string list;
+#ifdef BROWSER_HAVE_ZLIB
+        list += "gzip, deflate";
+#endif
+#ifdef BROWSER_HAVE_BROTLI
+        list += list.empty() ? "br" : ", br";
+#endif
+        return list.empty() ? std::string("identity") : list;
+    }();
+    return encodings;
+}
+
+} // namespace networking
+} // namespace browser
@@ -0,0 +1,41 @@
+#ifndef BROWSER_CONTENT_DECODER_H
+#define BROWSER_CONTENT_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace browser {
+namespace networking {
+
+// Undoes a response's Content-Encoding a piece at a time, so a compressed
+// body is decoded as it arrives instead of after the whole of it is in.
+// gzip and deflate need zlib (BROWSER_HAVE_ZLIB), br needs the Brotli
+// decoder (BROWSER_HAVE_BROTLI).
+class ContentDecoder {
+public:
+    using Output = std::function<void(const uint8_t*, size_t)>;
+
+    // Decoder for a Content-Encoding value, or null for identity and for
+    // encodings this build can't decode
+    static std::unique_ptr<ContentDecoder> create(const std::string& encoding);
+
+    // The encodings create() decodes, as an Accept-Encoding value
+    static const std::string& acceptEncoding();
+
+    virtual ~ContentDecoder() = default;
+
+    // Decode the next piece of the body, handing the decoded bytes to
+    // output. False if the data is corrupt.
+    virtual bool decode(const uint8_t* data, size_t length, const Output& output) = 0;
+
+    // The body is done. False if it stopped partway through the stream.
+    virtual bool finish() = 0;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_CONTENT_DECODER_H
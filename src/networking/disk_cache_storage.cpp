@@ -0,0 +1,868 @@
+#include "disk_cache_storage.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace browser {
+namespace networking {
+
+namespace {
+
+// "BCCR" and "BCIX" read as little-endian words; files written on a
+// machine of the other byte order fail these checks
+constexpr uint32_t kRecordMagic = 0x52434342;
+constexpr uint32_t kIndexMagic = 0x58494342;
+constexpr uint32_t kIndexVersion = 1;
+
+// Record: magic, kind, URL, header and body lengths, a checksum of the
+// URL and headers and, for tombstones, the segment written to when the
+// entry was removed; then the URL, headers and body
+constexpr uint64_t kRecordHeaderSize = 32;
+constexpr uint8_t kPutRecord = 1;
+constexpr uint8_t kRemoveRecord = 2;
+
+// Changes after which the index snapshot is saved again, bounding what
+// opening the storage has to replay
+constexpr size_t kSnapshotChanges = 1024;
+
+// Records moved between letting other callers at the storage
+constexpr size_t kCompactionBatch = 64;
+
+template <typename T>
+void appendWord(std::vector<uint8_t>& out, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T readWord(const uint8_t* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+uint32_t checksum(const uint8_t* data, size_t length, uint32_t hash = 2166136261u) {
+    // FNV-1a
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Reads words and bytes from a buffer, failing past its end
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t size) : m_data(data), m_size(size), m_offset(0) {}
+
+    template <typename T>
+    bool word(T& value) {
+        if (m_size - m_offset < sizeof(T)) {
+            return false;
+        }
+        value = readWord<T>(m_data + m_offset);
+        m_offset += sizeof(T);
+        return true;
+    }
+
+    bool bytes(uint64_t length, const uint8_t*& data) {
+        if (m_size - m_offset < length) {
+            return false;
+        }
+        data = m_data + m_offset;
+        m_offset += static_cast<size_t>(length);
+        return true;
+    }
+
+    size_t remaining() const { return m_size - m_offset; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset;
+};
+
+std::vector<uint8_t> serializeHeaders(const std::map<std::string, std::string>& headers) {
+    std::vector<uint8_t> out;
+    appendWord<uint32_t>(out, static_cast<uint32_t>(headers.size()));
+    for (const auto& header : headers) {
+        appendWord<uint32_t>(out, static_cast<uint32_t>(header.first.size()));
+        out.insert(out.end(), header.first.begin(), header.first.end());
+        appendWord<uint32_t>(out, static_cast<uint32_t>(header.second.size()));
+        out.insert(out.end(), header.second.begin(), header.second.end());
+    }
+    return out;
+}
+
+bool parseHeaders(const uint8_t* data, size_t size, std::map<std::string, std::string>& headers) {
+    ByteReader reader(data, size);
+    uint32_t count;
+    if (!reader.word(count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t nameLength, valueLength;
+        const uint8_t* name;
+        const uint8_t* value;
+        if (!reader.word(nameLength) || !reader.bytes(nameLength, name) ||
+            !reader.word(valueLength) || !reader.bytes(valueLength, value)) {
+            return false;
+        }
+        headers[std::string(reinterpret_cast<const char*>(name), nameLength)] =
+            std::string(reinterpret_cast<const char*>(value), valueLength);
+    }
+    return true;
+}
+
+// Everything of a record but its body
+std::vector<uint8_t> recordHead(uint8_t kind, const std::string& url,
+                                const std::vector<uint8_t>& headers, uint64_t bodyLength,
+                                uint32_t origin = 0) {
+    std::vector<uint8_t> head;
+    head.reserve(kRecordHeaderSize + url.size() + headers.size());
+    appendWord<uint32_t>(head, kRecordMagic);
+    appendWord<uint32_t>(head, kind);
+    appendWord<uint32_t>(head, static_cast<uint32_t>(url.size()));
+    appendWord<uint32_t>(head, static_cast<uint32_t>(headers.size()));
+    appendWord<uint64_t>(head, bodyLength);
+    uint32_t sum = checksum(reinterpret_cast<const uint8_t*>(url.data()), url.size());
+    sum = checksum(headers.data(), headers.size(), sum);
+    appendWord<uint32_t>(head, sum);
+    appendWord<uint32_t>(head, origin);
+    head.insert(head.end(), url.begin(), url.end());
+    head.insert(head.end(), headers.begin(), headers.end());
+    return head;
+}
+
+} // namespace
+
+// Read-only mapping of a whole file, which may still be appended to
+class DiskCacheStorage::MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+            return;
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) {
+            return;
+        }
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        m_size = m_data ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                m_data = static_cast<const uint8_t*>(data);
+                m_size = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+        if (m_data) {
+            ::munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
+//-----------------------------------------------------------------------------
+// DiskCacheStorage Implementation
+//-----------------------------------------------------------------------------
+
+uint64_t DiskCacheStorage::Location::recordSize() const {
+    return kRecordHeaderSize + urlLength + headersLength + bodyLength;
+}
+
+DiskCacheStorage::DiskCacheStorage(const std::string& directory, uint64_t segmentSize)
+    : m_directory(directory)
+    , m_segmentSize(segmentSize)
+    , m_activeSegment(1)
+    , m_generation(0)
+    , m_changesSinceSnapshot(0)
+    , m_initialized(false)
+    , m_stopping(false)
+{
+}
+
+DiskCacheStorage::~DiskCacheStorage() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_maintenanceCondition.notify_all();
+    if (m_maintenanceThread.joinable()) {
+        m_maintenanceThread.join();
+    }
+    saveIndex();
+}
+
+bool DiskCacheStorage::initialize() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_initialized) {
+        return true;
+    }
+
+    try {
+        // Create directory if it doesn't exist
+        if (!fs::exists(m_directory) && !fs::create_directories(m_directory)) {
+            std::cerr << "Failed to create cache directory: " << m_directory << std::endl;
+            return false;
+        }
+
+        // Find the segments. Files of the old one-file-per-URL layout
+        // aren't read any more.
+        for (const auto& entry : fs::directory_iterator(m_directory)) {
+            std::string extension = entry.path().extension().string();
+            std::string stem = entry.path().stem().string();
+            if (extension == ".data" || extension == ".meta") {
+                std::error_code error;
+                fs::remove(entry.path(), error);
+            } else if (extension == ".log" && stem.compare(0, 8, "segment-") == 0) {
+                uint32_t id = static_cast<uint32_t>(std::strtoul(stem.c_str() + 8, nullptr, 10));
+                if (id > 0) {
+                    m_segments[id].size = fs::file_size(entry.path());
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error initializing disk cache: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Start from the snapshot, or from nothing if it's missing or doesn't
+    // match the segments, then replay what was written after it
+    std::map<uint32_t, uint64_t> covered;
+    if (!loadIndexLocked(covered)) {
+        m_index.clear();
+        covered.clear();
+        for (auto& segment : m_segments) {
+            segment.second.liveBytes = 0;
+        }
+    }
+    for (auto& segment : m_segments) {
+        uint32_t id = segment.first;
+        auto found = covered.find(id);
+        uint64_t end = replaySegmentLocked(id, found != covered.end() ? found->second : 0);
+        if (end == segment.second.size) {
+            continue;
+        }
+
+        // A record cut short, by a crash most likely. The last segment is
+        // cut back to before it so appends follow whole records.
+        segment.second.size = end;
+        segment.second.map.reset();
+        if (id == m_segments.rbegin()->first) {
+            std::error_code error;
+            fs::resize_file(segmentPath(id), end, error);
+        }
+    }
+
+    uint32_t active = m_segments.empty() ? 1 : m_segments.rbegin()->first;
+    if (!m_segments.empty() && m_segments.rbegin()->second.size >= m_segmentSize) {
+        ++active;
+    }
+    if (!openWriterLocked(active)) {
+        return false;
+    }
+
+    m_initialized = true;
+    m_maintenanceThread = std::thread(&DiskCacheStorage::runMaintenance, this);
+    return true;
+}
+
+bool DiskCacheStorage::store(const CacheEntry& entry) {
+    const std::string& url = entry.metadata().url;
+    const std::vector<uint8_t>& body = entry.data();
+    std::vector<uint8_t> head = recordHead(kPutRecord, url, serializeHeaders(entry.metadata().headers), body.size());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_initialized) {
+        return false;
+    }
+
+    Location location;
+    if (!appendLocked(head, body.data(), body.size(), location)) {
+        return false;
+    }
+    setLocationLocked(url, location);
+    noteChangeLocked();
+    return true;
+}
+
+bool DiskCacheStorage::load(const std::string& url, CacheEntry& entry) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_index.find(url);
+    if (found == m_index.end()) {
+        return false;
+    }
+
+    const Location& location = found->second;
+    const uint8_t* record = viewLocked(location.segment, location.offset, location.recordSize());
+    if (!record) {
+        return false;
+    }
+
+    std::map<std::string, std::string> headers;
+    const uint8_t* headerData = record + kRecordHeaderSize + location.urlLength;
+    if (!parseHeaders(headerData, location.headersLength, headers)) {
+        return false;
+    }
+
+    // The one copy: out of the mapping into the buffer the entry shares
+    const uint8_t* body = headerData + location.headersLength;
+    entry = CacheEntry(url, std::make_shared<const std::vector<uint8_t>>(body, body + location.bodyLength), headers);
+    return true;
+}
+
+bool DiskCacheStorage::remove(const std::string& url) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_index.find(url) == m_index.end()) {
+        return true;
+    }
+
+    // Without the tombstone the entry would be back after a restart that
+    // replays its record
+    bool recorded = appendTombstoneLocked(url);
+    eraseLocationLocked(url);
+    noteChangeLocked();
+    return recorded;
+}
+
+void DiskCacheStorage::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_writer.close();
+    m_writer.clear();
+    m_segments.clear();
+    m_index.clear();
+    ++m_generation;
+    m_changesSinceSnapshot = 0;
+
+    try {
+        // Remove all files in cache directory
+        for (const auto& entry : fs::directory_iterator(m_directory)) {
+            fs::remove_all(entry.path());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error clearing cache: " << e.what() << std::endl;
+    }
+
+    if (m_initialized) {
+        openWriterLocked(1);
+    }
+}
+
+bool DiskCacheStorage::exists(const std::string& url) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.find(url) != m_index.end();
+}
+
+std::vector<std::string> DiskCacheStorage::getAllUrls() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<std::string> urls;
+    urls.reserve(m_index.size());
+    for (const auto& entry : m_index) {
+        urls.push_back(entry.first);
+    }
+    return urls;
+}
+
+std::vector<std::pair<std::string, size_t>> DiskCacheStorage::storedEntries() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Records are appended, so their place in the segments is the order
+    // they were written in
+    std::vector<const std::pair<const std::string, Location>*> entries;
+    entries.reserve(m_index.size());
+    for (const auto& entry : m_index) {
+        entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto* a, const auto* b) {
+        if (a->second.segment != b->second.segment) {
+            return a->second.segment < b->second.segment;
+        }
+        return a->second.offset < b->second.offset;
+    });
+
+    std::vector<std::pair<std::string, size_t>> stored;
+    stored.reserve(entries.size());
+    for (const auto* entry : entries) {
+        stored.emplace_back(entry->first, static_cast<size_t>(entry->second.bodyLength));
+    }
+    return stored;
+}
+
+bool DiskCacheStorage::saveIndex() {
+    // One snapshot written at a time, so an older one never replaces a
+    // newer one
+    std::lock_guard<std::mutex> snapshotLock(m_snapshotMutex);
+    std::vector<uint8_t> data;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_initialized) {
+            return false;
+        }
+        data = serializeIndexLocked();
+        m_changesSinceSnapshot = 0;
+    }
+    return writeFile(indexPath(), data);
+}
+
+void DiskCacheStorage::compact() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (uint32_t id = compactableSegmentLocked()) {
+        if (!compactSegment(lock, id)) {
+            break;
+        }
+    }
+}
+
+size_t DiskCacheStorage::segmentCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_segments.size();
+}
+
+uint64_t DiskCacheStorage::deadBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t dead = 0;
+    for (const auto& segment : m_segments) {
+        dead += segment.second.size - segment.second.liveBytes;
+    }
+    return dead;
+}
+
+std::string DiskCacheStorage::segmentPath(uint32_t id) const {
+    return m_directory + "/segment-" + std::to_string(id) + ".log";
+}
+
+std::string DiskCacheStorage::indexPath() const {
+    return m_directory + "/index";
+}
+
+bool DiskCacheStorage::loadIndexLocked(std::map<uint32_t, uint64_t>& covered) {
+    MappedFile file(indexPath());
+    if (!file.data() || file.size() < sizeof(uint32_t)) {
+        return false;
+    }
+
+    size_t bodySize = file.size() - sizeof(uint32_t);
+    if (checksum(file.data(), bodySize) != readWord<uint32_t>(file.data() + bodySize)) {
+        return false;
+    }
+
+    ByteReader reader(file.data(), bodySize);
+    uint32_t magic, version, segmentCount;
+    if (!reader.word(magic) || magic != kIndexMagic ||
+        !reader.word(version) || version != kIndexVersion ||
+        !reader.word(segmentCount)) {
+        return false;
+    }
+
+    // Every segment the snapshot knows must still hold what it did
+    for (uint32_t i = 0; i < segmentCount; ++i) {
+        uint32_t id;
+        uint64_t length;
+        if (!reader.word(id) || !reader.word(length)) {
+            return false;
+        }
+        auto segment = m_segments.find(id);
+        if (segment == m_segments.end() || segment->second.size < length) {
+            return false;
+        }
+        covered[id] = length;
+    }
+
+    uint64_t entryCount;
+    if (!reader.word(entryCount)) {
+        return false;
+    }
+    m_index.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, reader.remaining())));
+    for (uint64_t i = 0; i < entryCount; ++i) {
+        Location location;
+        const uint8_t* url;
+        if (!reader.word(location.segment) || !reader.word(location.offset) ||
+            !reader.word(location.urlLength) || !reader.word(location.headersLength) ||
+            !reader.word(location.bodyLength) || !reader.bytes(location.urlLength, url)) {
+            return false;
+        }
+        auto segment = covered.find(location.segment);
+        if (segment == covered.end() || location.offset > segment->second ||
+            location.bodyLength > segment->second || location.recordSize() > segment->second - location.offset) {
+            return false;
+        }
+        setLocationLocked(std::string(reinterpret_cast<const char*>(url), location.urlLength), location);
+    }
+    return reader.remaining() == 0;
+}
+
+uint64_t DiskCacheStorage::replaySegmentLocked(uint32_t id, uint64_t from) {
+    uint64_t size = m_segments[id].size;
+    uint64_t offset = from;
+
+    while (size - offset >= kRecordHeaderSize) {
+        const uint8_t* header = viewLocked(id, offset, kRecordHeaderSize);
+        if (!header || readWord<uint32_t>(header) != kRecordMagic) {
+            break;
+        }
+
+        Location location;
+        uint32_t kind = readWord<uint32_t>(header + 4);
+        location.segment = id;
+        location.offset = offset;
+        location.urlLength = readWord<uint32_t>(header + 8);
+        location.headersLength = readWord<uint32_t>(header + 12);
+        location.bodyLength = readWord<uint64_t>(header + 16);
+        uint32_t sum = readWord<uint32_t>(header + 24);
+        if (location.bodyLength > size || location.recordSize() > size - offset) {
+            break;
+        }
+
+        const uint8_t* record = viewLocked(id, offset, kRecordHeaderSize + location.urlLength + location.headersLength);
+        if (!record ||
+            checksum(record + kRecordHeaderSize, location.urlLength + location.headersLength) != sum) {
+            break;
+        }
+
+        std::string url(reinterpret_cast<const char*>(record + kRecordHeaderSize), location.urlLength);
+        if (kind == kPutRecord) {
+            setLocationLocked(url, location);
+        } else if (kind == kRemoveRecord) {
+            eraseLocationLocked(url);
+        } else {
+            break;
+        }
+        offset += location.recordSize();
+    }
+    return offset;
+}
+
+std::vector<uint8_t> DiskCacheStorage::serializeIndexLocked() const {
+    std::vector<uint8_t> out;
+    appendWord<uint32_t>(out, kIndexMagic);
+    appendWord<uint32_t>(out, kIndexVersion);
+
+    appendWord<uint32_t>(out, static_cast<uint32_t>(m_segments.size()));
+    for (const auto& segment : m_segments) {
+        appendWord<uint32_t>(out, segment.first);
+        appendWord<uint64_t>(out, segment.second.size);
+    }
+
+    appendWord<uint64_t>(out, m_index.size());
+    for (const auto& entry : m_index) {
+        const Location& location = entry.second;
+        appendWord<uint32_t>(out, location.segment);
+        appendWord<uint64_t>(out, location.offset);
+        appendWord<uint32_t>(out, location.urlLength);
+        appendWord<uint32_t>(out, location.headersLength);
+        appendWord<uint64_t>(out, location.bodyLength);
+        out.insert(out.end(), entry.first.begin(), entry.first.end());
+    }
+
+    appendWord<uint32_t>(out, checksum(out.data(), out.size()));
+    return out;
+}
+
+bool DiskCacheStorage::openWriterLocked(uint32_t id) {
+    m_writer.close();
+    m_writer.clear();
+    m_activeSegment = id;
+    m_segments[id];
+
+    m_writer.open(segmentPath(id), std::ios::binary | std::ios::app);
+    if (!m_writer) {
+        std::cerr << "Failed to open cache segment: " << segmentPath(id) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DiskCacheStorage::appendLocked(const std::vector<uint8_t>& head, const uint8_t* body,
+                                    uint64_t bodyLength, Location& location) {
+    uint64_t size = head.size() + bodyLength;
+    Segment& active = m_segments[m_activeSegment];
+    if (active.size > 0 && active.size + size > m_segmentSize) {
+        if (!openWriterLocked(m_activeSegment + 1)) {
+            return false;
+        }
+    } else if (!m_writer.is_open() && !openWriterLocked(m_activeSegment)) {
+        return false;
+    }
+
+    m_writer.write(reinterpret_cast<const char*>(head.data()), head.size());
+    if (bodyLength > 0) {
+        m_writer.write(reinterpret_cast<const char*>(body), static_cast<std::streamsize>(bodyLength));
+    }
+    m_writer.flush();
+    if (!m_writer) {
+        // The segment may end in part of this record now; later records go
+        // to a new one
+        openWriterLocked(m_activeSegment + 1);
+        return false;
+    }
+
+    Segment& segment = m_segments[m_activeSegment];
+    location.segment = m_activeSegment;
+    location.offset = segment.size;
+    location.urlLength = readWord<uint32_t>(head.data() + 8);
+    location.headersLength = readWord<uint32_t>(head.data() + 12);
+    location.bodyLength = bodyLength;
+    segment.size += size;
+    return true;
+}
+
+bool DiskCacheStorage::appendTombstoneLocked(const std::string& url) {
+    Location location;
+    return appendLocked(recordHead(kRemoveRecord, url, std::vector<uint8_t>(), 0, m_activeSegment),
+                        nullptr, 0, location);
+}
+
+void DiskCacheStorage::setLocationLocked(const std::string& url, const Location& location) {
+    auto inserted = m_index.emplace(url, location);
+    if (!inserted.second) {
+        const Location& previous = inserted.first->second;
+        m_segments[previous.segment].liveBytes -= previous.recordSize();
+        inserted.first->second = location;
+    }
+    m_segments[location.segment].liveBytes += location.recordSize();
+}
+
+void DiskCacheStorage::eraseLocationLocked(const std::string& url) {
+    auto found = m_index.find(url);
+    if (found == m_index.end()) {
+        return;
+    }
+    m_segments[found->second.segment].liveBytes -= found->second.recordSize();
+    m_index.erase(found);
+}
+
+const uint8_t* DiskCacheStorage::viewLocked(uint32_t id, uint64_t offset, uint64_t length) {
+    auto found = m_segments.find(id);
+    if (found == m_segments.end() || offset > found->second.size || length > found->second.size - offset) {
+        return nullptr;
+    }
+
+    // Appends grow a segment past its mapping; map it again to see them
+    Segment& segment = found->second;
+    if (!segment.map || segment.map->size() < offset + length) {
+        segment.map.reset();
+        segment.map = std::make_unique<MappedFile>(segmentPath(id));
+        if (segment.map->size() < offset + length) {
+            return nullptr;
+        }
+    }
+    return segment.map->data() + offset;
+}
+
+void DiskCacheStorage::deleteSegmentLocked(uint32_t id) {
+    auto found = m_segments.find(id);
+    if (found == m_segments.end()) {
+        return;
+    }
+    found->second.map.reset();
+    m_segments.erase(found);
+
+    std::error_code error;
+    fs::remove(segmentPath(id), error);
+}
+
+uint32_t DiskCacheStorage::compactableSegmentLocked() const {
+    // Segments no longer written to that are more than half dead
+    for (const auto& segment : m_segments) {
+        if (segment.first != m_activeSegment && segment.second.size > 0 &&
+            segment.second.liveBytes < segment.second.size / 2) {
+            return segment.first;
+        }
+    }
+    return 0;
+}
+
+bool DiskCacheStorage::compactSegment(std::unique_lock<std::mutex>& lock, uint32_t id) {
+    uint64_t generation = m_generation;
+    uint64_t offset = 0;
+    size_t visited = 0;
+
+    // Copy the records the index still points at to the active segment
+    while (m_segments.count(id) > 0 && offset < m_segments[id].size) {
+        const uint8_t* header = viewLocked(id, offset, kRecordHeaderSize);
+        if (!header) {
+            return false;
+        }
+        Location location;
+        uint32_t kind = readWord<uint32_t>(header + 4);
+        location.segment = id;
+        location.offset = offset;
+        location.urlLength = readWord<uint32_t>(header + 8);
+        location.headersLength = readWord<uint32_t>(header + 12);
+        location.bodyLength = readWord<uint64_t>(header + 16);
+        const uint8_t* record = viewLocked(id, offset, location.recordSize());
+        if (!record) {
+            return false;
+        }
+
+        std::string url(reinterpret_cast<const char*>(record + kRecordHeaderSize), location.urlLength);
+        size_t headSize = static_cast<size_t>(kRecordHeaderSize + location.urlLength + location.headersLength);
+        if (kind == kPutRecord) {
+            auto found = m_index.find(url);
+            if (found != m_index.end() && found->second.segment == id && found->second.offset == offset) {
+                std::vector<uint8_t> head(record, record + headSize);
+                Location moved;
+                if (!appendLocked(head, record + headSize, location.bodyLength, moved)) {
+                    return false;
+                }
+                setLocationLocked(url, moved);
+            }
+        } else if (kind == kRemoveRecord && m_index.find(url) == m_index.end()) {
+            // A tombstone still matters while a segment older than the one
+            // it was written to could hold the entry it removed; a full
+            // replay would bring that back without it
+            uint32_t origin = readWord<uint32_t>(header + 28);
+            auto oldest = m_segments.begin();
+            if (oldest->first == id) {
+                ++oldest;
+            }
+            if (oldest != m_segments.end() && oldest->first <= origin) {
+                std::vector<uint8_t> head(record, record + headSize);
+                Location moved;
+                if (!appendLocked(head, nullptr, 0, moved)) {
+                    return false;
+                }
+            }
+        }
+        offset += location.recordSize();
+
+        if (++visited % kCompactionBatch == 0) {
+            lock.unlock();
+            lock.lock();
+            if (m_stopping || generation != m_generation) {
+                return false;
+            }
+        }
+    }
+
+    auto segment = m_segments.find(id);
+    if (segment == m_segments.end() || segment->second.liveBytes > 0) {
+        return false;
+    }
+
+    // Only once a snapshot points at the copies can the segment go;
+    // opening the storage then never looks for it
+    lock.unlock();
+    bool saved = saveIndex();
+    lock.lock();
+    if (!saved || generation != m_generation) {
+        return false;
+    }
+    segment = m_segments.find(id);
+    if (segment != m_segments.end() && segment->second.liveBytes == 0) {
+        deleteSegmentLocked(id);
+    }
+    return true;
+}
+
+void DiskCacheStorage::noteChangeLocked() {
+    ++m_changesSinceSnapshot;
+    if (m_changesSinceSnapshot >= kSnapshotChanges || compactableSegmentLocked() != 0) {
+        m_maintenanceCondition.notify_one();
+    }
+}
+
+bool DiskCacheStorage::writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    // Write under another name and rename, so a crash never leaves a
+    // partly written file
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporary, path, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+void DiskCacheStorage::runMaintenance() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        m_maintenanceCondition.wait(lock, [this] {
+            return m_stopping || m_changesSinceSnapshot >= kSnapshotChanges || compactableSegmentLocked() != 0;
+        });
+        if (m_stopping) {
+            break;
+        }
+
+        if (uint32_t id = compactableSegmentLocked()) {
+            if (!compactSegment(lock, id) && !m_stopping) {
+                // Out of disk space or the like; try again later
+                m_maintenanceCondition.wait_for(lock, std::chrono::seconds(5), [this] { return m_stopping; });
+            }
+            continue;
+        }
+
+        lock.unlock();
+        saveIndex();
+        lock.lock();
+    }
+}
+
+} // namespace networking
+} // namespace browser
@@ -0,0 +1,136 @@
+#ifndef BROWSER_DISK_CACHE_STORAGE_H
+#define BROWSER_DISK_CACHE_STORAGE_H
+
+#include "cache.h"
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace networking {
+
+// Disk-based cache storage (persistent). Entries are appended as records
+// to a few large segment files, read back through memory mappings, and
+// found through an index in memory, so lookups and removals never touch
+// the directory. The index is saved to a snapshot file in the background
+// and on close; opening the storage reads that file and replays only the
+// records written after it. Removing an entry appends a tombstone, and a
+// background thread rewrites segments that are mostly dead records.
+class DiskCacheStorage : public CacheStorage {
+public:
+    static constexpr uint64_t defaultSegmentSize = 64 * 1024 * 1024;
+
+    explicit DiskCacheStorage(const std::string& directory, uint64_t segmentSize = defaultSegmentSize);
+    virtual ~DiskCacheStorage();
+
+    DiskCacheStorage(const DiskCacheStorage&) = delete;
+    DiskCacheStorage& operator=(const DiskCacheStorage&) = delete;
+
+    // Initialize storage: create the directory, load the index and start
+    // the background thread
+    bool initialize();
+
+    // Store entry
+    virtual bool store(const CacheEntry& entry) override;
+
+    // Load entry
+    virtual bool load(const std::string& url, CacheEntry& entry) override;
+
+    // Delete entry
+    virtual bool remove(const std::string& url) override;
+
+    // Clear all entries
+    virtual void clear() override;
+
+    // Check if entry exists
+    virtual bool exists(const std::string& url) override;
+
+    // Get all URLs in cache
+    virtual std::vector<std::string> getAllUrls() override;
+
+    const std::string& directory() const { return m_directory; }
+
+    // URL and body size of each stored entry, least recently written first
+    std::vector<std::pair<std::string, size_t>> storedEntries();
+
+    // Save the index snapshot now rather than in the background
+    bool saveIndex();
+
+    // Rewrite every segment that is mostly dead records now rather than in
+    // the background
+    void compact();
+
+    // Segment files, and the bytes in them that no entry uses any more
+    size_t segmentCount();
+    uint64_t deadBytes();
+
+private:
+    class MappedFile;
+
+    // Where an entry's record is
+    struct Location {
+        uint32_t segment;
+        uint64_t offset;
+        uint32_t urlLength;
+        uint32_t headersLength;
+        uint64_t bodyLength;
+
+        uint64_t recordSize() const;
+    };
+
+    struct Segment {
+        uint64_t size = 0;         // Bytes of whole records
+        uint64_t liveBytes = 0;    // Bytes of records the index points at
+        std::unique_ptr<MappedFile> map;
+    };
+
+    // Index, segments and writer; guarded by m_mutex
+    std::string segmentPath(uint32_t id) const;
+    std::string indexPath() const;
+    bool loadIndexLocked(std::map<uint32_t, uint64_t>& covered);
+    uint64_t replaySegmentLocked(uint32_t id, uint64_t from);
+    std::vector<uint8_t> serializeIndexLocked() const;
+    bool openWriterLocked(uint32_t id);
+    bool appendLocked(const std::vector<uint8_t>& head, const uint8_t* body, uint64_t bodyLength,
+                      Location& location);
+    bool appendTombstoneLocked(const std::string& url);
+    void setLocationLocked(const std::string& url, const Location& location);
+    void eraseLocationLocked(const std::string& url);
+    const uint8_t* viewLocked(uint32_t segment, uint64_t offset, uint64_t length);
+    void deleteSegmentLocked(uint32_t id);
+    uint32_t compactableSegmentLocked() const;
+    bool compactSegment(std::unique_lock<std::mutex>& lock, uint32_t id);
+    void noteChangeLocked();
+
+    static bool writeFile(const std::string& path, const std::vector<uint8_t>& data);
+
+    // Background compaction and index snapshots
+    void runMaintenance();
+
+    std::string m_directory;
+    uint64_t m_segmentSize;
+    std::unordered_map<std::string, Location> m_index;
+    std::map<uint32_t, Segment> m_segments;
+    uint32_t m_activeSegment;
+    std::ofstream m_writer;
+    uint64_t m_generation;               // Bumped by clear()
+    size_t m_changesSinceSnapshot;
+    bool m_initialized;
+    bool m_stopping;
+    std::mutex m_mutex;
+    std::mutex m_snapshotMutex;          // Taken before m_mutex
+    std::condition_variable m_maintenanceCondition;
+    std::thread m_maintenanceThread;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_DISK_CACHE_STORAGE_H
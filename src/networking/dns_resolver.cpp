@@ -1,4 +1,5 @@
 #include "dns_resolver.h"
+#include "../tracing/trace.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
@@ -153,12 +154,24 @@ std::string DnsCNameRecord::toString() const {
 // DnsResolver Implementation
 //-----------------------------------------------------------------------------
 
-DnsResolver::DnsResolver()
+DnsResolver::DnsResolver(size_t workerCount)
     : m_maxCacheTimeSeconds(300) // 5 minutes default
+    , m_stopping(false)
+    , m_workerCount(workerCount > 0 ? workerCount : 1)
 {
 }
 
 DnsResolver::~DnsResolver() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    
+    // A worker still inside the platform resolver finishes its lookup first
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
 }
 
 bool DnsResolver::initialize() {
@@ -196,52 +209,154 @@ bool DnsResolver::resolve(const std::string& hostname, DnsRecordType type,
     }
     
     // Check cache first
-    if (getFromCache(hostname, type, records)) {
-        return true;
+    if (getFromCache(hostname, type, records, error)) {
+        return !records.empty();
     }
     
-    // Perform actual DNS resolution
-    if (!resolveWithPlatformApi(hostname, type, records, error)) {
-        return false;
+    // Wait for the resolver threads, sharing a lookup already in flight
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::shared_ptr<Lookup> lookup = startLookupLocked(hostname, type);
+    m_lookupDone.wait(lock, [&lookup] { return lookup->done.load(); });
+    
+    records = lookup->records;
+    error = lookup->error;
+    return !records.empty();
+}
+
+bool DnsResolver::resolveHost(const std::string& hostname, std::vector<IpAddress>& addresses, std::string& error) {
+    std::shared_ptr<HostLookup> lookup = resolveHostAsync(hostname);
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_lookupDone.wait(lock, [&lookup] { return lookup->ready(); });
     }
+    return lookup->result(addresses, error);
+}
+
+std::shared_ptr<DnsResolver::HostLookup> DnsResolver::resolveHostAsync(const std::string& hostname) {
+    auto hostLookup = std::make_shared<HostLookup>();
     
-    // Add to cache
-    addToCache(hostname, type, records);
+    IpAddress ipAddr;
+    if (isIpAddress(hostname, ipAddr)) {
+        int family = ipAddr.isIpv6 ? 0 : 1;
+        if (ipAddr.isIpv6) {
+            hostLookup->m_records[family].push_back(std::make_shared<DnsAAAARecord>(hostname, 86400, ipAddr));
+        } else {
+            hostLookup->m_records[family].push_back(std::make_shared<DnsARecord>(hostname, 86400, ipAddr));
+        }
+        return hostLookup;
+    }
     
-    return true;
+    // Both families go to the resolver threads together unless cached
+    const DnsRecordType types[2] = { DnsRecordType::AAAA, DnsRecordType::A };
+    bool cached[2];
+    for (int family = 0; family < 2; ++family) {
+        cached[family] = getFromCache(hostname, types[family], hostLookup->m_records[family],
+                                      hostLookup->m_errors[family]);
+    }
+    if (!cached[0] || !cached[1]) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int family = 0; family < 2; ++family) {
+            if (!cached[family]) {
+                hostLookup->m_lookups[family] = startLookupLocked(hostname, types[family]);
+            }
+        }
+    }
+    return hostLookup;
+}
+
+void DnsResolver::prefetch(const std::string& hostname) {
+    resolveHostAsync(hostname);
 }
 
 void DnsResolver::resolveAsync(const std::string& hostname, DnsRecordType type, DnsResolverCallback callback) {
-    // Add to pending resolutions queue
-    AsyncResolution asyncResolution;
-    asyncResolution.hostname = hostname;
-    asyncResolution.type = type;
-    asyncResolution.callback = callback;
-    asyncResolution.inProgress = false;
-    
-    m_pendingResolutions.push_back(asyncResolution);
+    // Literal addresses and cached names still answer through
+    // processPendingResolutions, like any other
+    std::vector<std::shared_ptr<DnsRecord>> records;
+    std::string error;
+    IpAddress ipAddr;
+    bool answered = isIpAddress(hostname, ipAddr);
+    if (answered) {
+        resolve(hostname, type, records, error);
+    } else {
+        answered = getFromCache(hostname, type, records, error);
+    }
+    if (answered) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_completed.push_back([callback, records, error] { callback(records, error); });
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    startLookupLocked(hostname, type)->callbacks.push_back(std::move(callback));
 }
 
 void DnsResolver::processPendingResolutions() {
-    // Process one pending resolution
-    for (auto& asyncResolution : m_pendingResolutions) {
-        if (!asyncResolution.inProgress) {
-            asyncResolution.inProgress = true;
-            
-            // Process the resolution
-            std::vector<std::shared_ptr<DnsRecord>> records;
-            std::string error;
-            bool result = resolve(asyncResolution.hostname, asyncResolution.type, records, error);
-            
-            // Call the callback
-            asyncResolution.callback(records, error);
-            
-            // Remove the resolution
-            asyncResolution = m_pendingResolutions.back();
-            m_pendingResolutions.pop_back();
-            break;
+    std::vector<std::function<void()>> completed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        completed.swap(m_completed);
+    }
+    
+    for (const auto& complete : completed) {
+        complete();
+    }
+}
+
+std::shared_ptr<DnsResolver::Lookup> DnsResolver::startLookupLocked(const std::string& hostname, DnsRecordType type) {
+    LookupKey key(hostname, type);
+    auto found = m_lookups.find(key);
+    if (found != m_lookups.end()) {
+        return found->second;
+    }
+    
+    auto lookup = std::make_shared<Lookup>();
+    lookup->hostname = hostname;
+    lookup->type = type;
+    m_lookups.emplace(key, lookup);
+    m_queue.push_back(lookup);
+    
+    if (m_workers.empty()) {
+        for (size_t i = 0; i < m_workerCount; ++i) {
+            m_workers.emplace_back(&DnsResolver::workerLoop, this);
         }
     }
+    m_workAvailable.notify_one();
+    return lookup;
+}
+
+void DnsResolver::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_workAvailable.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        if (m_stopping) {
+            return;
+        }
+        
+        std::shared_ptr<Lookup> lookup = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        
+        std::vector<std::shared_ptr<DnsRecord>> records;
+        std::string error;
+        {
+            TRACE_SCOPE_DETAIL("net", "DnsResolver::resolve", lookup->hostname);
+            if (!resolveWithPlatformApi(lookup->hostname, lookup->type, records, error) && error.empty()) {
+                error = "DNS resolution failed: no records";
+            }
+        }
+        addToCache(lookup->hostname, lookup->type, records, error);
+        
+        lock.lock();
+        lookup->records = std::move(records);
+        lookup->error = std::move(error);
+        lookup->done = true;
+        m_lookups.erase(LookupKey(lookup->hostname, lookup->type));
+        for (auto& callback : lookup->callbacks) {
+            m_completed.push_back([lookup, callback] { callback(lookup->records, lookup->error); });
+        }
+        lookup->callbacks.clear();
+        m_lookupDone.notify_all();
+    }
 }
 
 void DnsResolver::clearCache() {
@@ -268,7 +383,7 @@ bool DnsResolver::isIpAddress(const std::string& hostname, IpAddress& address) {
 }
 
 bool DnsResolver::getFromCache(const std::string& hostname, DnsRecordType type, 
-                            std::vector<std::shared_ptr<DnsRecord>>& records) {
+                            std::vector<std::shared_ptr<DnsRecord>>& records, std::string& error) {
     std::lock_guard<std::mutex> lock(m_cacheMutex);
     
     // Check if hostname is in cache
@@ -286,9 +401,11 @@ bool DnsResolver::getFromCache(const std::string& hostname, DnsRecordType type,
     // Check if cache entry is expired
     auto& entry = typeIt->second;
     auto now = std::chrono::system_clock::now();
+    int maxAge = entry.records.empty() ? std::min(m_maxCacheTimeSeconds, kNegativeCacheSeconds)
+                                       : m_maxCacheTimeSeconds;
     
     if (m_maxCacheTimeSeconds > 0 && 
-        (now - entry.timestamp) > std::chrono::seconds(m_maxCacheTimeSeconds)) {
+        (now - entry.timestamp) > std::chrono::seconds(maxAge)) {
         // Cache entry is expired, remove it
         hostIt->second.erase(typeIt);
         if (hostIt->second.empty()) {
@@ -297,6 +414,13 @@ bool DnsResolver::getFromCache(const std::string& hostname, DnsRecordType type,
         return false;
     }
     
+    // A failed lookup
+    if (entry.records.empty()) {
+        records.clear();
+        error = entry.error;
+        return true;
+    }
+    
     // Check if individual records are expired
     bool allExpired = true;
     records.clear();
@@ -321,8 +445,8 @@ bool DnsResolver::getFromCache(const std::string& hostname, DnsRecordType type,
 }
 
 void DnsResolver::addToCache(const std::string& hostname, DnsRecordType type, 
-                          const std::vector<std::shared_ptr<DnsRecord>>& records) {
-    if (m_maxCacheTimeSeconds <= 0 || records.empty()) {
+                          const std::vector<std::shared_ptr<DnsRecord>>& records, const std::string& error) {
+    if (m_maxCacheTimeSeconds <= 0) {
         return;
     }
     
@@ -331,11 +455,58 @@ void DnsResolver::addToCache(const std::string& hostname, DnsRecordType type,
     // Add to cache
     CacheEntry entry;
     entry.records = records;
+    entry.error = error;
     entry.timestamp = std::chrono::system_clock::now();
     
     m_cache[hostname][type] = entry;
 }
 
+//-----------------------------------------------------------------------------
+// DnsResolver::HostLookup Implementation
+//-----------------------------------------------------------------------------
+
+bool DnsResolver::HostLookup::ready() const {
+    for (const auto& lookup : m_lookups) {
+        if (lookup && !lookup->done) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DnsResolver::HostLookup::result(std::vector<IpAddress>& addresses, std::string& error) const {
+    std::vector<IpAddress> families[2];
+    for (int family = 0; family < 2; ++family) {
+        const auto& records = m_lookups[family] ? m_lookups[family]->records : m_records[family];
+        for (const auto& record : records) {
+            if (record->type() == DnsRecordType::AAAA) {
+                families[family].push_back(static_cast<const DnsAAAARecord&>(*record).address());
+            } else if (record->type() == DnsRecordType::A) {
+                families[family].push_back(static_cast<const DnsARecord&>(*record).address());
+            }
+        }
+    }
+    
+    // Interleave, so a family that doesn't work costs one attempt
+    addresses.clear();
+    for (size_t i = 0; i < std::max(families[0].size(), families[1].size()); ++i) {
+        for (int family = 0; family < 2; ++family) {
+            if (i < families[family].size()) {
+                addresses.push_back(families[family][i]);
+            }
+        }
+    }
+    
+    if (addresses.empty()) {
+        error = m_lookups[1] ? m_lookups[1]->error : m_errors[1];
+        if (error.empty()) {
+            error = "DNS resolution failed: no addresses";
+        }
+        return false;
+    }
+    return true;
+}
+
 bool DnsResolver::resolveWithPlatformApi(const std::string& hostname, DnsRecordType type, 
                                       std::vector<std::shared_ptr<DnsRecord>>& records, std::string& error) {
     // Determine address family based on record type
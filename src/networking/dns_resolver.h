@@ -4,10 +4,14 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <atomic>
 
 namespace browser {
 namespace networking {
@@ -114,12 +118,19 @@ private:
 // DNS resolver callback
 using DnsResolverCallback = std::function<void(const std::vector<std::shared_ptr<DnsRecord>>&, const std::string&)>;
 
-// DNS resolver class
+// DNS resolver class. Lookups run on a pool of resolver threads, so
+// several hosts, and both address families of one host, resolve at once;
+// requests for a name already being looked up share that lookup.
 class DnsResolver {
 public:
-    DnsResolver();
+    static constexpr size_t defaultWorkerCount = 4;
+    
+    explicit DnsResolver(size_t workerCount = defaultWorkerCount);
     ~DnsResolver();
     
+    DnsResolver(const DnsResolver&) = delete;
+    DnsResolver& operator=(const DnsResolver&) = delete;
+    
     // Initialize the resolver
     bool initialize();
     
@@ -127,10 +138,24 @@ public:
     bool resolve(const std::string& hostname, DnsRecordType type, 
                 std::vector<std::shared_ptr<DnsRecord>>& records, std::string& error);
     
+    // Resolve hostname's IPv6 and IPv4 addresses in parallel (synchronous).
+    // They come back in the order to try connecting to them: alternating
+    // families, IPv6 first.
+    bool resolveHost(const std::string& hostname, std::vector<IpAddress>& addresses, std::string& error);
+    
+    // As resolveHost, without waiting: poll the answer with ready()
+    class HostLookup;
+    std::shared_ptr<HostLookup> resolveHostAsync(const std::string& hostname);
+    
+    // Start resolving hostname in the background so a later request for it
+    // finds the answer cached
+    void prefetch(const std::string& hostname);
+    
     // Resolve hostname (asynchronous)
     void resolveAsync(const std::string& hostname, DnsRecordType type, DnsResolverCallback callback);
     
-    // Process pending asynchronous resolutions (for event loop integration)
+    // Call the callbacks of asynchronous resolutions that have finished (for
+    // event loop integration), on the calling thread
     void processPendingResolutions();
     
     // Set maximum cache time in seconds (0 to disable cache)
@@ -140,9 +165,11 @@ public:
     void clearCache();
     
 private:
-    // Cache entry
+    // Cache entry; failed lookups are kept briefly too, so a host without
+    // IPv6 addresses isn't asked for them on every connection
     struct CacheEntry {
         std::vector<std::shared_ptr<DnsRecord>> records;
+        std::string error;
         std::chrono::system_clock::time_point timestamp;
     };
     
@@ -153,29 +180,76 @@ private:
     // Maximum cache time in seconds
     int m_maxCacheTimeSeconds;
     
+    // How long failed lookups are cached
+    static constexpr int kNegativeCacheSeconds = 30;
+    
     // Check if a hostname is already an IP address
     bool isIpAddress(const std::string& hostname, IpAddress& address);
     
-    // Get records from cache
+    // Get records from cache: true if the answer is known, which may be
+    // that there are none
     bool getFromCache(const std::string& hostname, DnsRecordType type, 
-                     std::vector<std::shared_ptr<DnsRecord>>& records);
+                     std::vector<std::shared_ptr<DnsRecord>>& records, std::string& error);
     
     // Add records to cache
     void addToCache(const std::string& hostname, DnsRecordType type, 
-                   const std::vector<std::shared_ptr<DnsRecord>>& records);
+                   const std::vector<std::shared_ptr<DnsRecord>>& records, const std::string& error);
     
     // Platform-specific DNS resolution
     bool resolveWithPlatformApi(const std::string& hostname, DnsRecordType type, 
                                std::vector<std::shared_ptr<DnsRecord>>& records, std::string& error);
     
-    // Pending asynchronous resolutions
-    struct AsyncResolution {
+    // A lookup queued or running on the resolver threads, shared by
+    // everyone waiting for its name and type
+    struct Lookup {
         std::string hostname;
         DnsRecordType type;
-        DnsResolverCallback callback;
-        bool inProgress;
+        std::atomic<bool> done{false};      // Set after records and error
+        std::vector<std::shared_ptr<DnsRecord>> records;
+        std::string error;
+        std::vector<DnsResolverCallback> callbacks;
     };
-    std::vector<AsyncResolution> m_pendingResolutions;
+    using LookupKey = std::pair<std::string, DnsRecordType>;
+    
+    // The lookup for hostname and type, queued if none is in flight;
+    // called with m_mutex held
+    std::shared_ptr<Lookup> startLookupLocked(const std::string& hostname, DnsRecordType type);
+    
+    void workerLoop();
+    
+    // Queued and running lookups, and finished asynchronous resolutions
+    // waiting for processPendingResolutions; guarded by m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_lookupDone;
+    std::deque<std::shared_ptr<Lookup>> m_queue;
+    std::map<LookupKey, std::shared_ptr<Lookup>> m_lookups;
+    std::vector<std::function<void()>> m_completed;
+    bool m_stopping;
+    
+    // Started with the first lookup
+    size_t m_workerCount;
+    std::vector<std::thread> m_workers;
+};
+
+// Both address families of one host, resolving at once
+class DnsResolver::HostLookup {
+public:
+    // Both answers are in
+    bool ready() const;
+    
+    // Once ready: the addresses in the order to try connecting to them,
+    // alternating families with IPv6 first. False, with error saying why,
+    // if neither family resolved.
+    bool result(std::vector<IpAddress>& addresses, std::string& error) const;
+    
+private:
+    friend class DnsResolver;
+    
+    // AAAA, then A: a lookup in flight, or the answer from the cache
+    std::shared_ptr<Lookup> m_lookups[2];
+    std::vector<std::shared_ptr<DnsRecord>> m_records[2];
+    std::string m_errors[2];
 };
 
 } // namespace networking
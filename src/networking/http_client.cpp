@@ -1,9 +1,22 @@
 #include "http_client.h"
+#include "io_poller.h"
+#include "connection_pool.h"
+#include "dns_resolver.h"
+#include "response_reader.h"
+#include "content_decoder.h"
+#include "tls_transport.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
 #include <iostream>
 #include <sstream>
 #include <cstring>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#endif
 
 namespace browser {
 namespace networking {
@@ -21,12 +34,281 @@ int strcasecmp(const char* s1, const char* s2) {
     #endif
 }
 
+// Serialize a request for the wire
+static std::vector<uint8_t> buildRequestData(const HttpRequest& request,
+                                             const std::string& host, const std::string& path) {
+    std::ostringstream requestStream;
+    
+    // Request line
+    switch (request.method()) {
+        case HttpMethod::GET:
+            requestStream << "GET ";
+            break;
+        case HttpMethod::POST:
+            requestStream << "POST ";
+            break;
+        case HttpMethod::HEAD:
+            requestStream << "HEAD ";
+            break;
+        case HttpMethod::PUT:
+            requestStream << "PUT ";
+            break;
+        case HttpMethod::DELETE_:
+            requestStream << "DELETE ";
+            break;
+        case HttpMethod::OPTIONS:
+            requestStream << "OPTIONS ";
+            break;
+    }
+    
+    requestStream << path << " HTTP/1.1\r\n";
+    
+    // Host header is required for HTTP/1.1
+    if (!request.hasHeader("Host")) {
+        requestStream << "Host: " << host << "\r\n";
+    }
+    
+    // Add headers
+    for (const auto& header : request.headers()) {
+        requestStream << header.first << ": " << header.second << "\r\n";
+    }
+    
+    // Offer the encodings the body can be decoded from as it arrives
+    const std::string& acceptEncoding = ContentDecoder::acceptEncoding();
+    if (!request.hasHeader("Accept-Encoding") && acceptEncoding != "identity") {
+        requestStream << "Accept-Encoding: " << acceptEncoding << "\r\n";
+    }
+    
+    // Add Content-Length for request with body
+    if (!request.body().empty() && !request.hasHeader("Content-Length")) {
+        requestStream << "Content-Length: " << request.body().size() << "\r\n";
+    }
+    
+    // End of headers
+    requestStream << "\r\n";
+    
+    // Request as string
+    std::string requestString = requestStream.str();
+    
+    // Convert to bytes
+    std::vector<uint8_t> requestData(requestString.begin(), requestString.end());
+    
+    // Add body
+    if (!request.body().empty()) {
+        requestData.insert(requestData.end(), request.body().begin(), request.body().end());
+    }
+    
+    return requestData;
+}
+
+// The request to follow a redirect response with, if it is one
+static bool redirectRequestFor(const HttpRequest& request, const HttpResponse& response,
+                               const std::string& protocol, const std::string& host, int port,
+                               const std::string& path, HttpRequest& redirectRequest) {
+    int statusCode = response.statusCode();
+    if (!(statusCode == 301 || statusCode == 302 || statusCode == 303 || statusCode == 307 || statusCode == 308) ||
+        !response.hasHeader("Location")) {
+        return false;
+    }
+    
+    // Get redirect URL
+    std::string location = response.getHeader("Location");
+    
+    // Create new request
+    redirectRequest = request;
+    
+    // Relative locations stay on the same origin, port included
+    std::string origin = protocol + "://" + host;
+    if (port != ((protocol == "https") ? 443 : 80)) {
+        origin += ":" + std::to_string(port);
+    }
+    
+    // Set new URL
+    if (location.find("://") != std::string::npos) {
+        // Absolute URL
+        redirectRequest.setUrl(location);
+    } else if (!location.empty() && location[0] == '/') {
+        // Absolute path
+        redirectRequest.setUrl(origin + location);
+    } else {
+        // Relative path
+        // Extract the directory from the current path
+        size_t lastSlash = path.find_last_of('/');
+        std::string directory = (lastSlash != std::string::npos) ? path.substr(0, lastSlash + 1) : "/";
+        redirectRequest.setUrl(origin + directory + location);
+    }
+    
+    // For 303 See Other, change method to GET
+    if (statusCode == 303) {
+        redirectRequest.setMethod(HttpMethod::GET);
+        redirectRequest.setBody(std::vector<uint8_t>());
+    }
+    
+    return true;
+}
+
+// Requests a server may see twice, which alone may go as TLS early data:
+// an attacker can replay those (RFC 8470)
+static bool safeToReplay(const HttpRequest& request) {
+    HttpMethod method = request.method();
+    return (method == HttpMethod::GET || method == HttpMethod::HEAD || method == HttpMethod::OPTIONS) &&
+           request.body().empty();
+}
+
+// The last socket call failed only because it would have blocked
+static bool socketWouldBlock() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS;
+#endif
+}
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+// How long a connection attempt has to itself before the next address is
+// tried alongside it (RFC 8305)
+static const int kConnectionAttemptDelayMs = 250;
+
+// How often connections waiting on the resolver threads are checked
+static const int kResolvePollMs = 5;
+
+// Socket address of address and port
+static socklen_t socketAddressFor(const IpAddress& address, int port, sockaddr_storage& storage) {
+    std::memset(&storage, 0, sizeof(storage));
+    if (address.isIpv6) {
+        sockaddr_in6* ipv6 = reinterpret_cast<sockaddr_in6*>(&storage);
+        ipv6->sin6_family = AF_INET6;
+        ipv6->sin6_port = htons(static_cast<uint16_t>(port));
+        std::memcpy(&ipv6->sin6_addr, address.ipv6, sizeof(address.ipv6));
+        return sizeof(sockaddr_in6);
+    }
+    sockaddr_in* ipv4 = reinterpret_cast<sockaddr_in*>(&storage);
+    ipv4->sin_family = AF_INET;
+    ipv4->sin_port = htons(static_cast<uint16_t>(port));
+    std::memcpy(&ipv4->sin_addr, address.ipv4, sizeof(address.ipv4));
+    return sizeof(sockaddr_in);
+}
+
+// Start a non-blocking connect to address; INVALID_SOCKET if it failed
+// outright. connected is set if it completed at once.
+static socket_t startConnect(const IpAddress& address, int port, bool& connected) {
+    sockaddr_storage storage;
+    socklen_t length = socketAddressFor(address, port, storage);
+    
+    socket_t attempt = socket(storage.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (attempt == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    if (!IoPoller::setNonBlocking(attempt)) {
+        closesocket(attempt);
+        return INVALID_SOCKET;
+    }
+    
+    int connectResult = connect(attempt, reinterpret_cast<const sockaddr*>(&storage), static_cast<int>(length));
+    if (connectResult == SOCKET_ERROR && !socketWouldBlock()) {
+        closesocket(attempt);
+        return INVALID_SOCKET;
+    }
+    connected = connectResult != SOCKET_ERROR;
+    return attempt;
+}
+
+// The pending connect on socket failed
+static bool connectFailed(socket_t socket) {
+    int socketError = 0;
+    socklen_t length = sizeof(socketError);
+    getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&socketError), &length);
+    return socketError != 0;
+}
+
+// Connect to whichever of addresses answers first, Happy Eyeballs style:
+// attempts start in order, each kConnectionAttemptDelayMs after the last
+// unless that one failed sooner, and run side by side. Returns the
+// connected socket, still non-blocking, or INVALID_SOCKET.
+static socket_t raceConnections(const std::vector<IpAddress>& addresses, int port, int timeoutMs) {
+    using Clock = std::chrono::steady_clock;
+    
+    IoPoller poller;
+    std::vector<socket_t> attempts;
+    size_t nextAddress = 0;
+    size_t pending = 0;
+    socket_t winner = INVALID_SOCKET;
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    Clock::time_point nextStart = Clock::now();
+    std::vector<IoEvent> events;
+    
+    while (winner == INVALID_SOCKET) {
+        Clock::time_point now = Clock::now();
+        if (nextAddress < addresses.size() && (pending == 0 || now >= nextStart)) {
+            bool connected = false;
+            socket_t attempt = startConnect(addresses[nextAddress++], port, connected);
+            if (connected) {
+                winner = attempt;
+            } else if (attempt != INVALID_SOCKET) {
+                if (poller.add(attempt, IO_WRITE, reinterpret_cast<void*>(static_cast<uintptr_t>(attempts.size())))) {
+                    attempts.push_back(attempt);
+                    ++pending;
+                    nextStart = now + std::chrono::milliseconds(kConnectionAttemptDelayMs);
+                } else {
+                    closesocket(attempt);
+                }
+            }
+            continue;
+        }
+        if (pending == 0 || now >= deadline) {
+            break;
+        }
+        
+        // Until an attempt finishes, the next is due, or time is up
+        Clock::time_point until = (nextAddress < addresses.size() && nextStart < deadline) ? nextStart : deadline;
+        int waitMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count()) + 1;
+        if (!poller.wait(waitMs, events)) {
+            break;
+        }
+        for (const IoEvent& event : events) {
+            socket_t& attempt = attempts[reinterpret_cast<uintptr_t>(event.token)];
+            if (attempt == INVALID_SOCKET || winner != INVALID_SOCKET) {
+                continue;
+            }
+            poller.remove(attempt);
+            if (connectFailed(attempt)) {
+                closesocket(attempt);
+            } else {
+                winner = attempt;
+            }
+            attempt = INVALID_SOCKET;
+            --pending;
+        }
+    }
+    
+    // The losers
+    for (socket_t attempt : attempts) {
+        if (attempt != INVALID_SOCKET) {
+            poller.remove(attempt);
+            closesocket(attempt);
+        }
+    }
+    return winner;
+}
+
 //-----------------------------------------------------------------------------
 // HttpResponse Implementation
 //-----------------------------------------------------------------------------
 
+// Body of responses that haven't got one; shared, so copied on first append
+static const std::shared_ptr<std::vector<uint8_t>>& emptyBody() {
+    static const std::shared_ptr<std::vector<uint8_t>> body = std::make_shared<std::vector<uint8_t>>();
+    return body;
+}
+
 HttpResponse::HttpResponse()
     : m_statusCode(0)
+    , m_body(emptyBody())
 {
 }
 
@@ -54,11 +336,11 @@ std::string HttpResponse::getHeader(const std::string& name) const {
 }
 
 std::string HttpResponse::bodyAsString() const {
-    if (m_body.empty()) {
+    if (m_body->empty()) {
         return "";
     }
     
-    return std::string(m_body.begin(), m_body.end());
+    return std::string(m_body->begin(), m_body->end());
 }
 
 void HttpResponse::setHeader(const std::string& name, const std::string& value) {
@@ -79,7 +361,20 @@ void HttpResponse::appendToBody(const uint8_t* data, size_t length) {
         return;
     }
     
-    m_body.insert(m_body.end(), data, data + length);
+    // Others holding the buffer keep what they were given
+    if (m_body.use_count() > 1) {
+        m_body = std::make_shared<std::vector<uint8_t>>(*m_body);
+    }
+    m_body->insert(m_body->end(), data, data + length);
+}
+
+void HttpResponse::removeHeader(const std::string& name) {
+    for (auto it = m_headers.begin(); it != m_headers.end(); ++it) {
+        if (strcasecmp(it->first.c_str(), name.c_str()) == 0) {
+            m_headers.erase(it);
+            return;
+        }
+    }
 }
 
 bool HttpResponse::parseResponse(const std::vector<uint8_t>& data) {
@@ -87,24 +382,23 @@ bool HttpResponse::parseResponse(const std::vector<uint8_t>& data) {
         return false;
     }
     
-    // Convert data to string for easier parsing
-    std::string responseStr(data.begin(), data.end());
-    
-    // Find the separator between headers and body
-    size_t headerEnd = responseStr.find("\r\n\r\n");
-    if (headerEnd == std::string::npos) {
+    // The same framing and decoding as a response read off a socket
+    ResponseReader reader(HttpMethod::GET);
+    std::string error;
+    if (!reader.feed(data.data(), data.size(), error)) {
+        return false;
+    }
+    if (!reader.complete() && !reader.finishAtEof(error)) {
         return false;
     }
     
-    // Extract headers section
-    std::string headersSection = responseStr.substr(0, headerEnd);
-    
-    // Extract body section
-    std::vector<uint8_t> bodyData(data.begin() + headerEnd + 4, data.end());
-    m_body = bodyData;
-    
+    *this = std::move(reader.response());
+    return true;
+}
+
+bool HttpResponse::parseHead(const std::string& head) {
     // Parse status line and headers
-    std::istringstream headersStream(headersSection);
+    std::istringstream headersStream(head);
     std::string line;
     
     // Parse status line
@@ -167,64 +461,6 @@ bool HttpResponse::parseResponse(const std::vector<uint8_t>& data) {
         }
     }
     
-    // Handle specific headers
-    if (hasHeader("Content-Length")) {
-        try {
-            size_t contentLength = std::stoul(getHeader("Content-Length"));
-            if (m_body.size() > contentLength) {
-                m_body.resize(contentLength);
-            }
-        }
-        catch (const std::exception&) {
-            // Ignore invalid content length
-        }
-    }
-    
-    // Handle chunked transfer encoding
-    if (getHeader("Transfer-Encoding") == "chunked") {
-        std::vector<uint8_t> decodedBody;
-        size_t pos = 0;
-        
-        while (pos < m_body.size()) {
-            // Find chunk size line end
-            size_t lineEnd = pos;
-            while (lineEnd < m_body.size() && 
-                   !(m_body[lineEnd] == '\r' && lineEnd + 1 < m_body.size() && m_body[lineEnd + 1] == '\n')) {
-                lineEnd++;
-            }
-            
-            if (lineEnd >= m_body.size()) {
-                break;
-            }
-            
-            // Parse chunk size (hex)
-            std::string sizeHex(m_body.begin() + pos, m_body.begin() + lineEnd);
-            size_t chunkSize = std::stoul(sizeHex, nullptr, 16);
-            
-            // End of chunks
-            if (chunkSize == 0) {
-                break;
-            }
-            
-            // Move past the chunk size line
-            pos = lineEnd + 2;
-            
-            // Copy chunk data
-            if (pos + chunkSize <= m_body.size()) {
-                decodedBody.insert(decodedBody.end(), 
-                                  m_body.begin() + pos, 
-                                  m_body.begin() + pos + chunkSize);
-                
-                // Move past the chunk data and its trailing CRLF
-                pos += chunkSize + 2;
-            } else {
-                break;
-            }
-        }
-        
-        m_body = decodedBody;
-    }
-    
     return true;
 }
 
@@ -234,18 +470,28 @@ bool HttpResponse::parseResponse(const std::vector<uint8_t>& data) {
 
 HttpRequest::HttpRequest()
     : m_method(HttpMethod::GET)
+    , m_bufferBody(true)
 {
 }
 
 HttpRequest::HttpRequest(const std::string& url)
     : m_method(HttpMethod::GET)
     , m_url(url)
+    , m_bufferBody(true)
 {
 }
 
 HttpRequest::HttpRequest(HttpMethod method, const std::string& url)
     : m_method(method)
     , m_url(url)
+    , m_bufferBody(true)
+{
+}
+
+HttpRequest::HttpRequest(HttpMethod method, const security::Url& url)
+    : m_method(method)
+    , m_url(url)
+    , m_bufferBody(true)
 {
 }
 
@@ -291,55 +537,15 @@ void HttpRequest::setBody(const std::string& body) {
 
 bool HttpRequest::parseUrl(std::string& protocol, std::string& host, 
                          std::string& path, int& port) const {
-    if (m_url.empty()) {
+    // Parsed once, when the URL was set
+    if (!m_url.isValid() || (m_url.scheme() != "http" && m_url.scheme() != "https")) {
         return false;
     }
     
-    // Find protocol (http:// or https://)
-    size_t protocolEnd = m_url.find("://");
-    if (protocolEnd == std::string::npos) {
-        return false;
-    }
-    
-    protocol = m_url.substr(0, protocolEnd);
-    
-    // Convert protocol to lowercase
-    std::transform(protocol.begin(), protocol.end(), protocol.begin(), 
-                   [](unsigned char c) { return std::tolower(c); });
-    
-    // Validate protocol
-    if (protocol != "http" && protocol != "https") {
-        return false;
-    }
-    
-    // Set default port
-    port = (protocol == "https") ? 443 : 80;
-    
-    // Parse host and path
-    size_t hostStart = protocolEnd + 3;
-    size_t pathStart = m_url.find('/', hostStart);
-    
-    if (pathStart == std::string::npos) {
-        // No path specified, use root path
-        host = m_url.substr(hostStart);
-        path = "/";
-    } else {
-        host = m_url.substr(hostStart, pathStart - hostStart);
-        path = m_url.substr(pathStart);
-    }
-    
-    // Check for port in host
-    size_t portPos = host.find(':');
-    if (portPos != std::string::npos) {
-        try {
-            port = std::stoi(host.substr(portPos + 1));
-            host = host.substr(0, portPos);
-        }
-        catch (const std::exception&) {
-            return false;
-        }
-    }
-    
+    protocol = m_url.scheme();
+    host = m_url.host();
+    port = m_url.port();
+    path = m_url.pathAndQuery();
     return true;
 }
 
@@ -347,16 +553,88 @@ bool HttpRequest::parseUrl(std::string& protocol, std::string& host,
 // HttpClient Implementation
 //-----------------------------------------------------------------------------
 
+// What a socket's token in the poller names: a connection, or one of the
+// sockets racing to connect it
+struct HttpClient::SocketWatch {
+    AsyncConnection* connection;
+    socket_t socket;        // An attempt's; INVALID_SOCKET once it is over
+    bool attempt;
+};
+
+// A request in flight on a non-blocking socket, advanced by socket
+// readiness: connect, write the request, read the response
+struct HttpClient::AsyncConnection {
+    enum class State {
+        RESOLVING,
+        CONNECTING,
+        HANDSHAKING,        // TLS
+        SENDING,
+        RECEIVING,
+        DONE
+    };
+    
+    HttpRequest request;
+    HttpResponseCallback callback;
+    int redirectCount = 0;
+    std::string protocol;
+    std::string host;
+    int port = 0;
+    std::string path;
+    
+    // Pooled connection, and whether it carried an earlier request
+    std::string origin;
+    socket_t socket = INVALID_SOCKET;
+    std::unique_ptr<TlsStream> tls;
+    bool reused = false;
+    State state = State::CONNECTING;
+    SocketWatch watch{this, INVALID_SOCKET, false};
+    uint32_t watchedEvents = IO_WRITE;
+    
+    // TLS reads and writes can each need the socket either way
+    void watchFor(IoPoller& poller, uint32_t events) {
+        if (events != watchedEvents) {
+            poller.modify(socket, events, &watch);
+            watchedEvents = events;
+        }
+    }
+    
+    // The host's addresses once the resolver threads have them. Each
+    // connect attempt gets a head start before the next address joins the
+    // race (RFC 8305). Attempts that are over stay until the connection
+    // goes, since the poller may still have events for them.
+    std::shared_ptr<DnsResolver::HostLookup> lookup;
+    std::vector<IpAddress> addresses;
+    size_t nextAddress = 0;
+    std::vector<std::unique_ptr<SocketWatch>> attempts;
+    size_t pendingAttempts = 0;
+    std::chrono::steady_clock::time_point nextAttemptAt;
+    std::chrono::steady_clock::time_point deadline;
+    
+    std::vector<uint8_t> output;
+    size_t sent = 0;
+    std::unique_ptr<ResponseReader> reader;
+    
+    // Set when the request failed
+    std::string error;
+    bool timedOut = false;
+};
+
 HttpClient::HttpClient()
     : m_socket(INVALID_SOCKET)
     , m_timeoutSeconds(30)
     , m_maxRedirects(5)
-    , m_useSSL(false)
-    , m_sslContext(nullptr)
+    , m_maxConcurrentRequests(256)
+    , m_connectionPool(std::make_shared<ConnectionPool>())
+    , m_dnsResolver(std::make_shared<DnsResolver>())
 {
 }
 
 HttpClient::~HttpClient() {
+    // Requests still in flight are dropped without their callbacks
+    for (auto& connection : m_connections) {
+        closeAttempts(*connection);
+        m_connectionPool->release(connection->origin, connection->socket, false);
+    }
     closeConnection();
 }
 
@@ -375,7 +653,11 @@ bool HttpClient::initialize() {
 }
 
 HttpResponse HttpClient::sendRequest(const HttpRequest& request, std::string& error) {
-    return sendRequestInternal(request, 0, error);
+    TRACE_SCOPE_DETAIL("net", "HttpClient::sendRequest", request.url());
+    ALLOC_SCOPE(NETWORKING);
+    HttpResponse response = sendRequestInternal(request, 0, error);
+    TRACE_COUNTER("net", "responseBytes", static_cast<int64_t>(response.body().size()));
+    return response;
 }
 
 HttpResponse HttpClient::get(const std::string& url, std::string& error) {
@@ -397,7 +679,7 @@ void HttpClient::sendRequestAsync(const HttpRequest& request, HttpResponseCallba
     AsyncRequest asyncRequest;
     asyncRequest.request = request;
     asyncRequest.callback = callback;
-    asyncRequest.inProgress = false;
+    asyncRequest.redirectCount = 0;
     
     m_pendingRequests.push_back(asyncRequest);
 }
@@ -416,164 +698,508 @@ void HttpClient::postAsync(const std::string& url, const std::string& body,
     sendRequestAsync(request, callback);
 }
 
-void HttpClient::processPendingRequests() {
-    // Process one pending request
-    if (m_pendingRequests.empty()) {
-        return;
+//-----------------------------------------------------------------------------
+// Asynchronous Requests
+//-----------------------------------------------------------------------------
+
+void HttpClient::processPendingRequests(int timeoutMs) {
+    ALLOC_SCOPE(NETWORKING);
+    
+    if (!m_poller) {
+        m_poller = std::make_unique<IoPoller>();
     }
     
-    AsyncRequest& asyncRequest = m_pendingRequests.front();
-    if (!asyncRequest.inProgress) {
-        asyncRequest.inProgress = true;
-        
-        // Process the request
+    // Start queued requests while there are free slots. Ones whose origin
+    // is at its connection limit wait their turn; ones that fail before
+    // reaching the network complete right away.
+    for (auto it = m_pendingRequests.begin();
+         it != m_pendingRequests.end() && m_connections.size() < m_maxConcurrentRequests;) {
         std::string error;
-        HttpResponse response = sendRequest(asyncRequest.request, error);
-        
-        // Call the callback
-        asyncRequest.callback(response, error);
+        StartResult result = startConnection(*it, error);
+        if (result == StartResult::WAITING) {
+            ++it;
+            continue;
+        }
         
-        // Remove the request
-        m_pendingRequests.erase(m_pendingRequests.begin());
+        AsyncRequest pending = std::move(*it);
+        it = m_pendingRequests.erase(it);
+        if (result == StartResult::FAILED) {
+            pending.callback(HttpResponse(), error);
+            it = m_pendingRequests.begin();
+        }
+    }
+    
+    // Connect the ones whose hosts have resolved since, and race another
+    // address against connect attempts that have had their head start
+    bool resolving = false;
+    auto now = std::chrono::steady_clock::now();
+    for (auto& connection : m_connections) {
+        if (connection->state == AsyncConnection::State::RESOLVING) {
+            advanceResolution(*connection);
+            resolving = resolving || connection->state == AsyncConnection::State::RESOLVING;
+        } else if (connection->state == AsyncConnection::State::CONNECTING &&
+                   connection->nextAddress < connection->addresses.size() && now >= connection->nextAttemptAt) {
+            startAttempt(*connection);
+        }
+    }
+    
+    if (m_connections.empty()) {
+        // Waiting for connections other clients of the pool hold
+        if (!m_pendingRequests.empty() && timeoutMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        }
+        return;
+    }
+    TRACE_COUNTER("net", "requestsInFlight", static_cast<int64_t>(m_connections.size()));
+    
+    // Don't sleep past the first deadline, or the next connect attempt
+    now = std::chrono::steady_clock::now();
+    for (const auto& connection : m_connections) {
+        auto until = connection->deadline;
+        if (connection->state == AsyncConnection::State::CONNECTING &&
+            connection->nextAddress < connection->addresses.size() && connection->nextAttemptAt < until) {
+            until = connection->nextAttemptAt;
+        }
+        int64_t remaining = std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count());
+        if (timeoutMs < 0 || remaining < timeoutMs) {
+            timeoutMs = static_cast<int>(remaining);
+        }
+    }
+    if (resolving && (timeoutMs < 0 || timeoutMs > kResolvePollMs)) {
+        timeoutMs = kResolvePollMs;
+    }
+    
+    std::vector<IoEvent> events;
+    if (m_poller->size() == 0) {
+        // Only waiting on the resolver
+        if (timeoutMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        }
+    } else if (!m_poller->wait(timeoutMs, events)) {
+        cancelPendingRequests("Failed to wait for sockets");
+        return;
+    }
+    for (const IoEvent& event : events) {
+        SocketWatch& watch = *static_cast<SocketWatch*>(event.token);
+        if (watch.attempt) {
+            advanceAttempt(watch, event.events);
+        } else {
+            advanceConnection(*watch.connection, event.events);
+        }
+    }
+    
+    // Time out requests that are still going
+    now = std::chrono::steady_clock::now();
+    for (auto& connection : m_connections) {
+        if (connection->state != AsyncConnection::State::DONE && now >= connection->deadline) {
+            connection->state = AsyncConnection::State::DONE;
+            connection->error = "Request timed out: " + connection->request.url();
+            connection->timedOut = true;
+        }
+    }
+    
+    // Take the finished connections out before their callbacks run, since
+    // those may queue more requests, and give their sockets back to the pool
+    std::vector<std::unique_ptr<AsyncConnection>> finished;
+    for (auto it = m_connections.begin(); it != m_connections.end();) {
+        AsyncConnection& connection = **it;
+        if (connection.state == AsyncConnection::State::DONE) {
+            closeAttempts(connection);
+            if (connection.socket != INVALID_SOCKET) {
+                m_poller->remove(connection.socket);
+            }
+            bool reusable = connection.error.empty() && connection.reader->connectionReusable() &&
+                            connection.request.getHeader("Connection") != "close";
+            m_connectionPool->release(connection.origin, connection.socket, reusable, std::move(connection.tls));
+            finished.push_back(std::move(*it));
+            it = m_connections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto& connection : finished) {
+        finishConnection(*connection);
     }
 }
 
-HttpResponse HttpClient::sendRequestInternal(const HttpRequest& request, int redirectCount, std::string& error) {
-    HttpResponse response;
-    
-    // Check for too many redirects
-    if (redirectCount > m_maxRedirects) {
+void HttpClient::cancelPendingRequests(const std::string& error) {
+    std::deque<AsyncRequest> pending;
+    pending.swap(m_pendingRequests);
+    std::vector<std::unique_ptr<AsyncConnection>> connections;
+    connections.swap(m_connections);
+    
+    for (auto& connection : connections) {
+        // Connections only exist once the poller does
+        closeAttempts(*connection);
+        if (connection->socket != INVALID_SOCKET) {
+            m_poller->remove(connection->socket);
+        }
+        m_connectionPool->release(connection->origin, connection->socket, false);
+    }
+    for (auto& connection : connections) {
+        connection->callback(HttpResponse(), error);
+    }
+    for (AsyncRequest& request : pending) {
+        request.callback(HttpResponse(), error);
+    }
+}
+
+HttpClient::StartResult HttpClient::startConnection(AsyncRequest& pending, std::string& error) {
+    if (pending.redirectCount > m_maxRedirects) {
         error = "Too many redirects";
-        return response;
+        return StartResult::FAILED;
     }
     
-    // Parse URL
-    std::string protocol, host, path;
-    int port;
+    auto connection = std::make_unique<AsyncConnection>();
+    if (!pending.request.parseUrl(connection->protocol, connection->host, connection->path, connection->port)) {
+        error = "Invalid URL: " + pending.request.url();
+        return StartResult::FAILED;
+    }
     
-    if (!request.parseUrl(protocol, host, path, port)) {
-        error = "Invalid URL: " + request.url();
-        return response;
+    // A pooled connection goes straight to sending; otherwise open one
+    connection->origin = ConnectionPool::originKey(connection->protocol, connection->host, connection->port);
+    if (!m_connectionPool->tryAcquire(connection->origin, connection->socket, &connection->tls)) {
+        return StartResult::WAITING;
+    }
+    connection->reused = connection->socket != INVALID_SOCKET;
+    
+    connection->request = std::move(pending.request);
+    connection->callback = std::move(pending.callback);
+    connection->redirectCount = pending.redirectCount;
+    connection->deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_timeoutSeconds);
+    connection->output = buildRequestData(connection->request, connection->host, connection->path);
+    connection->reader = std::make_unique<ResponseReader>(connection->request.method(),
+                                                          connection->request.dataCallback(),
+                                                          connection->request.bufferBody(),
+                                                          connection->request.headersCallback());
+    
+    if (connection->reused) {
+        IoPoller::setNonBlocking(connection->socket);
+        connection->state = AsyncConnection::State::SENDING;
+        
+        // Writable at once
+        if (!m_poller->add(connection->socket, IO_WRITE, &connection->watch)) {
+            error = "Failed to watch socket";
+            m_connectionPool->release(connection->origin, connection->socket, false);
+            return StartResult::FAILED;
+        }
+    } else {
+        // The resolver threads look the host up, unless it is cached
+        connection->state = AsyncConnection::State::RESOLVING;
+        connection->lookup = m_dnsResolver->resolveHostAsync(connection->host);
+        advanceResolution(*connection);
+    }
+    m_connections.push_back(std::move(connection));
+    return StartResult::STARTED;
+}
+
+void HttpClient::advanceResolution(AsyncConnection& connection) {
+    if (!connection.lookup->ready()) {
+        return;
     }
     
-    // Set SSL flag
-    m_useSSL = (protocol == "https");
+    std::string error;
+    bool resolved = connection.lookup->result(connection.addresses, error);
+    connection.lookup.reset();
+    if (!resolved) {
+        connection.state = AsyncConnection::State::DONE;
+        connection.error = "Failed to resolve host: " + connection.host;
+        return;
+    }
+    connection.state = AsyncConnection::State::CONNECTING;
+    startAttempt(connection);
+}
+
+void HttpClient::startAttempt(AsyncConnection& connection) {
+    // Writable once connected, which may be at once
+    while (connection.nextAddress < connection.addresses.size()) {
+        bool connected = false;
+        socket_t attempt = startConnect(connection.addresses[connection.nextAddress++], connection.port, connected);
+        if (attempt == INVALID_SOCKET) {
+            continue;
+        }
+        
+        auto watch = std::make_unique<SocketWatch>(SocketWatch{&connection, attempt, true});
+        if (!m_poller->add(attempt, IO_WRITE, watch.get())) {
+            closesocket(attempt);
+            continue;
+        }
+        connection.attempts.push_back(std::move(watch));
+        ++connection.pendingAttempts;
+        connection.nextAttemptAt = std::chrono::steady_clock::now() +
+                                   std::chrono::milliseconds(kConnectionAttemptDelayMs);
+        return;
+    }
     
-    // Open connection
-    if (!openConnection(host, port, error)) {
-        return response;
+    if (connection.pendingAttempts == 0) {
+        connection.state = AsyncConnection::State::DONE;
+        connection.error = "Failed to connect to host: " + connection.host;
+    }
+}
+
+void HttpClient::advanceAttempt(SocketWatch& watch, uint32_t events) {
+    AsyncConnection& connection = *watch.connection;
+    if (watch.socket == INVALID_SOCKET || connection.state != AsyncConnection::State::CONNECTING ||
+        !(events & (IO_WRITE | IO_ERROR))) {
+        return;
     }
     
-    // Build request
-    std::ostringstream requestStream;
+    socket_t attempt = watch.socket;
+    m_poller->remove(attempt);
+    watch.socket = INVALID_SOCKET;
+    --connection.pendingAttempts;
     
-    // Request line
-    switch (request.method()) {
-        case HttpMethod::GET:
-            requestStream << "GET ";
-            break;
-        case HttpMethod::POST:
-            requestStream << "POST ";
-            break;
-        case HttpMethod::HEAD:
-            requestStream << "HEAD ";
-            break;
-        case HttpMethod::PUT:
-            requestStream << "PUT ";
-            break;
-        case HttpMethod::DELETE_:
-            requestStream << "DELETE ";
-            break;
-        case HttpMethod::OPTIONS:
-            requestStream << "OPTIONS ";
-            break;
+    // The next address takes over at once if nothing else is racing
+    if (connectFailed(attempt)) {
+        closesocket(attempt);
+        if (connection.pendingAttempts == 0) {
+            startAttempt(connection);
+        }
+        return;
     }
     
-    requestStream << path << " HTTP/1.1\r\n";
+    // The winner carries the request; the rest are dropped
+    closeAttempts(connection);
+    connection.socket = attempt;
+    connection.state = AsyncConnection::State::SENDING;
+    if (!m_poller->add(attempt, IO_WRITE, &connection.watch)) {
+        connection.state = AsyncConnection::State::DONE;
+        connection.error = "Failed to watch socket";
+        return;
+    }
     
-    // Host header is required for HTTP/1.1
-    if (!request.hasHeader("Host")) {
-        requestStream << "Host: " << host << "\r\n";
+    // HTTPS starts with the TLS handshake, which can carry the request as
+    // early data when resuming
+    if (connection.protocol == "https") {
+        connection.tls = tls().createStream(attempt, connection.host, connection.origin, connection.error);
+        if (!connection.tls) {
+            connection.state = AsyncConnection::State::DONE;
+            return;
+        }
+        if (safeToReplay(connection.request)) {
+            connection.tls->setEarlyData(connection.output.data(), connection.output.size());
+        }
+        connection.state = AsyncConnection::State::HANDSHAKING;
     }
     
-    // Add headers
-    for (const auto& header : request.headers()) {
-        requestStream << header.first << ": " << header.second << "\r\n";
+    advanceConnection(connection, IO_WRITE);
+}
+
+void HttpClient::closeAttempts(AsyncConnection& connection) {
+    for (auto& watch : connection.attempts) {
+        if (watch->socket != INVALID_SOCKET) {
+            m_poller->remove(watch->socket);
+            closesocket(watch->socket);
+            watch->socket = INVALID_SOCKET;
+        }
     }
+    connection.pendingAttempts = 0;
+}
+
+void HttpClient::advanceConnection(AsyncConnection& connection, uint32_t events) {
+    using State = AsyncConnection::State;
     
-    // Add Content-Length for request with body
-    if (!request.body().empty() && !request.hasHeader("Content-Length")) {
-        requestStream << "Content-Length: " << request.body().size() << "\r\n";
+    if (connection.state == State::HANDSHAKING) {
+        TlsResult result = connection.tls->handshake(connection.error);
+        if (result != TlsResult::DONE) {
+            waitForTls(connection, result);
+            return;
+        }
+        
+        // Early data the server took was the request
+        if (connection.tls->earlyDataAccepted()) {
+            connection.sent = connection.output.size();
+        }
+        connection.state = State::SENDING;
     }
     
-    // End of headers
-    requestStream << "\r\n";
+    if (connection.state == State::SENDING) {
+        while (connection.sent < connection.output.size()) {
+            size_t bytesSent = 0;
+            if (connection.tls) {
+                TlsResult result = connection.tls->write(&connection.output[connection.sent],
+                                                         connection.output.size() - connection.sent,
+                                                         bytesSent, connection.error);
+                if (result != TlsResult::DONE) {
+                    waitForTls(connection, result);
+                    return;
+                }
+            } else {
+                int socketSent = send(connection.socket, reinterpret_cast<const char*>(&connection.output[connection.sent]),
+                                      static_cast<int>(connection.output.size() - connection.sent), kSendFlags);
+                if (socketSent == SOCKET_ERROR) {
+                    if (socketWouldBlock()) {
+                        return;
+                    }
+                    connection.state = State::DONE;
+                    connection.error = "Failed to send data";
+                    return;
+                }
+                bytesSent = socketSent;
+            }
+            connection.sent += bytesSent;
+        }
+        
+        // The request is out; wait for the response
+        connection.output.clear();
+        connection.output.shrink_to_fit();
+        connection.state = State::RECEIVING;
+        connection.watchFor(*m_poller, IO_READ);
+        return;
+    }
     
-    // Request as string
-    std::string requestString = requestStream.str();
+    uint32_t ready = connection.tls ? IO_READ | IO_WRITE | IO_ERROR : IO_READ | IO_ERROR;
+    if (connection.state != State::RECEIVING || !(events & ready)) {
+        return;
+    }
     
-    // Convert to bytes
-    std::vector<uint8_t> requestData(requestString.begin(), requestString.end());
+    const size_t bufferSize = 8192;
+    uint8_t buffer[bufferSize];
+    while (true) {
+        size_t bytesRead = 0;
+        if (connection.tls) {
+            TlsResult result = connection.tls->read(buffer, bufferSize, bytesRead, connection.error);
+            if (result != TlsResult::DONE && result != TlsResult::CLOSED) {
+                waitForTls(connection, result);
+                return;
+            }
+        } else {
+            int socketRead = recv(connection.socket, reinterpret_cast<char*>(buffer), bufferSize, 0);
+            if (socketRead == SOCKET_ERROR) {
+                if (socketWouldBlock()) {
+                    return;
+                }
+                connection.state = State::DONE;
+                connection.error = "Failed to receive data";
+                return;
+            }
+            bytesRead = socketRead;
+        }
+        if (bytesRead == 0) {
+            // Connection closed
+            connection.state = State::DONE;
+            connection.reader->finishAtEof(connection.error);
+            return;
+        }
+        
+        if (!connection.reader->feed(buffer, bytesRead, connection.error) || connection.reader->complete()) {
+            connection.state = State::DONE;
+            return;
+        }
+    }
+}
+
+void HttpClient::waitForTls(AsyncConnection& connection, TlsResult result) {
+    if (result == TlsResult::WANT_READ || result == TlsResult::WANT_WRITE) {
+        connection.watchFor(*m_poller, result == TlsResult::WANT_READ ? IO_READ : IO_WRITE);
+        return;
+    }
+    connection.state = AsyncConnection::State::DONE;
+    if (connection.error.empty()) {
+        connection.error = "Connection closed";
+    }
+}
+
+void HttpClient::finishConnection(AsyncConnection& connection) {
+    // A reused connection the server closed in the meantime fails before
+    // any response arrives; the request goes back to the front of the queue
+    if (!connection.error.empty() && connection.reused && !connection.reader->receivedAny() && !connection.timedOut) {
+        AsyncRequest retry;
+        retry.request = std::move(connection.request);
+        retry.callback = std::move(connection.callback);
+        retry.redirectCount = connection.redirectCount;
+        m_pendingRequests.push_front(std::move(retry));
+        return;
+    }
     
-    // Add body
-    if (!request.body().empty()) {
-        requestData.insert(requestData.end(), request.body().begin(), request.body().end());
+    if (!connection.error.empty()) {
+        connection.callback(HttpResponse(), connection.error);
+        return;
     }
     
-    // Send request
-    if (!sendData(requestData, error)) {
-        closeConnection();
-        return response;
+    HttpResponse response = std::move(connection.reader->response());
+    TRACE_COUNTER("net", "responseBytes", static_cast<int64_t>(response.body().size()));
+    
+    // Redirects go back through the queue as a new request
+    HttpRequest redirectRequest;
+    if (redirectRequestFor(connection.request, response, connection.protocol,
+                           connection.host, connection.port, connection.path, redirectRequest)) {
+        AsyncRequest redirect;
+        redirect.request = std::move(redirectRequest);
+        redirect.callback = std::move(connection.callback);
+        redirect.redirectCount = connection.redirectCount + 1;
+        m_pendingRequests.push_back(std::move(redirect));
+        return;
     }
     
-    // Receive response
-    std::vector<uint8_t> responseData;
-    if (!receiveData(responseData, error)) {
-        closeConnection();
+    connection.callback(response, "");
+}
+
+HttpResponse HttpClient::sendRequestInternal(const HttpRequest& request, int redirectCount, std::string& error) {
+    HttpResponse response;
+    
+    // Check for too many redirects
+    if (redirectCount > m_maxRedirects) {
+        error = "Too many redirects";
         return response;
     }
     
-    // Close connection
-    closeConnection();
+    // Parse URL
+    std::string protocol, host, path;
+    int port;
     
-    // Parse response
-    if (!response.parseResponse(responseData)) {
-        error = "Failed to parse response";
+    if (!request.parseUrl(protocol, host, path, port)) {
+        error = "Invalid URL: " + request.url();
         return response;
     }
     
-    // Handle redirects
-    int statusCode = response.statusCode();
-    if ((statusCode == 301 || statusCode == 302 || statusCode == 303 || statusCode == 307 || statusCode == 308) && 
-        response.hasHeader("Location")) {
+    // Build request
+    std::vector<uint8_t> requestData = buildRequestData(request, host, path);
+    std::unique_ptr<ResponseReader> reader;
+    
+    // Reuse a pooled connection to the origin, or open one. A reused one
+    // the server closed in the meantime fails before any response arrives;
+    // the request is then tried on the next.
+    std::string origin = ConnectionPool::originKey(protocol, host, port);
+    while (true) {
+        m_socket = m_connectionPool->acquire(origin, &m_tls);
+        bool reused = m_socket != INVALID_SOCKET;
+        bool requestSent = false;
+        if (reused) {
+            IoPoller::setNonBlocking(m_socket, false);
+            setSocketTimeouts();
+        } else if (!openConnection(host, port, error) ||
+                   (protocol == "https" &&
+                    !startTls(host, origin, safeToReplay(request) ? &requestData : nullptr, requestSent, error))) {
+            closeConnection();
+            m_connectionPool->release(origin, INVALID_SOCKET, false);
+            return response;
+        }
         
-        // Get redirect URL
-        std::string location = response.getHeader("Location");
+        // Send request and receive response
+        reader = std::make_unique<ResponseReader>(request.method(), request.dataCallback(), request.bufferBody(),
+                                                  request.headersCallback());
+        bool exchanged = (requestSent || sendData(requestData, error)) && receiveData(*reader, error);
         
-        // Create new request
-        HttpRequest redirectRequest = request;
+        // Back to the pool, or closed
+        bool reusable = exchanged && reader->connectionReusable() && request.getHeader("Connection") != "close";
+        m_connectionPool->release(origin, m_socket, reusable, std::move(m_tls));
+        m_socket = INVALID_SOCKET;
         
-        // Set new URL
-        if (location.find("://") != std::string::npos) {
-            // Absolute URL
-            redirectRequest.setUrl(location);
-        } else if (!location.empty() && location[0] == '/') {
-            // Absolute path
-            redirectRequest.setUrl(protocol + "://" + host + location);
-        } else {
-            // Relative path
-            // Extract the directory from the current path
-            size_t lastSlash = path.find_last_of('/');
-            std::string directory = (lastSlash != std::string::npos) ? path.substr(0, lastSlash + 1) : "/";
-            redirectRequest.setUrl(protocol + "://" + host + directory + location);
+        if (exchanged) {
+            break;
         }
-        
-        // For 303 See Other, change method to GET
-        if (statusCode == 303) {
-            redirectRequest.setMethod(HttpMethod::GET);
-            redirectRequest.setBody(std::vector<uint8_t>());
+        if (!reused || reader->receivedAny()) {
+            return response;
         }
-        
+        error.clear();
+    }
+    response = std::move(reader->response());
+    
+    // Handle redirects
+    HttpRequest redirectRequest;
+    if (redirectRequestFor(request, response, protocol, host, port, path, redirectRequest)) {
         // Follow redirect
         return sendRequestInternal(redirectRequest, redirectCount + 1, error);
     }
@@ -585,14 +1211,64 @@ bool HttpClient::openConnection(const std::string& host, int port, std::string&
     // Close any existing connection
     closeConnection();
     
-    // Create socket
-    m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    // Resolve host name, both address families at once
+    std::vector<IpAddress> addresses;
+    bool resolved;
+    {
+        TRACE_SCOPE_DETAIL("net", "HttpClient::resolveHost", host);
+        resolved = m_dnsResolver->resolveHost(host, addresses, error);
+    }
+    if (!resolved) {
+        error = "Failed to resolve host: " + host;
+        return false;
+    }
+    
+    // Connect to server over whichever address answers first
+    {
+        TRACE_SCOPE("net", "HttpClient::connect");
+        m_socket = raceConnections(addresses, port, m_timeoutSeconds * 1000);
+    }
     if (m_socket == INVALID_SOCKET) {
-        error = "Failed to create socket";
+        error = "Failed to connect to host: " + host;
         return false;
     }
     
-    // Set timeout
+    // Blocking again, with timeouts
+    IoPoller::setNonBlocking(m_socket, false);
+    setSocketTimeouts();
+    
+    return true;
+}
+
+TlsContext& HttpClient::tls() {
+    if (!m_tlsContext) {
+        m_tlsContext = std::make_shared<TlsContext>();
+    }
+    return *m_tlsContext;
+}
+
+bool HttpClient::startTls(const std::string& host, const std::string& origin, const std::vector<uint8_t>* earlyData,
+                          bool& earlyDataSent, std::string& error) {
+    m_tls = tls().createStream(m_socket, host, origin, error);
+    if (!m_tls) {
+        return false;
+    }
+    if (earlyData) {
+        m_tls->setEarlyData(earlyData->data(), earlyData->size());
+    }
+    
+    // Blocking, so anything but DONE is a failure or the timeout
+    if (m_tls->handshake(error) != TlsResult::DONE) {
+        if (error.empty()) {
+            error = "TLS handshake timed out: " + host;
+        }
+        return false;
+    }
+    earlyDataSent = m_tls->earlyDataAccepted();
+    return true;
+}
+
+void HttpClient::setSocketTimeouts() {
     #ifdef _WIN32
     DWORD timeout = m_timeoutSeconds * 1000;
     setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
@@ -604,36 +1280,6 @@ bool HttpClient::openConnection(const std::string& host, int port, std::string&
     setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
     setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
     #endif
-    
-    // Resolve host name
-    struct addrinfo hints = {0};
-    struct addrinfo* result = nullptr;
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    
-    int addrResult = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
-    if (addrResult != 0) {
-        error = "Failed to resolve host: " + host;
-        closesocket(m_socket);
-        m_socket = INVALID_SOCKET;
-        return false;
-    }
-    
-    // Connect to server
-    int connectResult = connect(m_socket, result->ai_addr, (int)result->ai_addrlen);
-    freeaddrinfo(result);
-    
-    if (connectResult == SOCKET_ERROR) {
-        error = "Failed to connect to host: " + host;
-        closesocket(m_socket);
-        m_socket = INVALID_SOCKET;
-        return false;
-    }
-    
-    // TODO: For HTTPS, initialize SSL
-    
-    return true;
 }
 
 bool HttpClient::sendData(const std::vector<uint8_t>& data, std::string& error) {
@@ -642,11 +1288,22 @@ bool HttpClient::sendData(const std::vector<uint8_t>& data, std::string& error)
         return false;
     }
     
-    // TODO: For HTTPS, use SSL_write
-    
     size_t totalSent = 0;
     while (totalSent < data.size()) {
-        int bytesSent = send(m_socket, (const char*)&data[totalSent], (int)(data.size() - totalSent), 0);
+        if (m_tls) {
+            // Blocking, so anything but DONE is a failure or the timeout
+            size_t bytesSent = 0;
+            if (m_tls->write(&data[totalSent], data.size() - totalSent, bytesSent, error) != TlsResult::DONE) {
+                if (error.empty()) {
+                    error = "Failed to send data";
+                }
+                return false;
+            }
+            totalSent += bytesSent;
+            continue;
+        }
+        
+        int bytesSent = send(m_socket, (const char*)&data[totalSent], (int)(data.size() - totalSent), kSendFlags);
         
         if (bytesSent == SOCKET_ERROR) {
             error = "Failed to send data";
@@ -659,19 +1316,33 @@ bool HttpClient::sendData(const std::vector<uint8_t>& data, std::string& error)
     return true;
 }
 
-bool HttpClient::receiveData(std::vector<uint8_t>& data, std::string& error) {
+bool HttpClient::receiveData(ResponseReader& reader, std::string& error) {
     if (m_socket == INVALID_SOCKET) {
         error = "Socket not connected";
         return false;
     }
     
-    // TODO: For HTTPS, use SSL_read
-    
     const size_t bufferSize = 8192;
-    char buffer[bufferSize];
-    
-    while (true) {
-        int bytesRead = recv(m_socket, buffer, bufferSize, 0);
+    uint8_t buffer[bufferSize];
+    
+    // Read until the message is complete, or the server closes the
+    // connection if its framing doesn't say where the message ends. The
+    // body goes on as it arrives; only the reader's state is held here.
+    while (!reader.complete()) {
+        int bytesRead;
+        if (m_tls) {
+            size_t tlsRead = 0;
+            TlsResult result = m_tls->read(buffer, bufferSize, tlsRead, error);
+            if (result != TlsResult::DONE && result != TlsResult::CLOSED) {
+                if (error.empty()) {
+                    error = "Failed to receive data";
+                }
+                return false;
+            }
+            bytesRead = static_cast<int>(tlsRead);
+        } else {
+            bytesRead = recv(m_socket, reinterpret_cast<char*>(buffer), bufferSize, 0);
+        }
         
         if (bytesRead == SOCKET_ERROR) {
             error = "Failed to receive data";
@@ -680,17 +1351,19 @@ bool HttpClient::receiveData(std::vector<uint8_t>& data, std::string& error) {
         
         if (bytesRead == 0) {
             // Connection closed
-            break;
+            return reader.finishAtEof(error);
         }
         
-        data.insert(data.end(), buffer, buffer + bytesRead);
+        if (!reader.feed(buffer, bytesRead, error)) {
+            return false;
+        }
     }
     
     return true;
 }
 
 void HttpClient::closeConnection() {
-    // TODO: For HTTPS, clean up SSL
+    m_tls.reset();
     
     if (m_socket != INVALID_SOCKET) {
         closesocket(m_socket);
@@ -6,7 +6,10 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <deque>
 #include <cstdint> // For uint8_t
+#include "shared_bytes.h"
+#include "../security/url.h"
 
 // Forward declare addrinfo struct to avoid redefinition issues
 #ifdef _WIN32
@@ -38,6 +41,12 @@ typedef int socket_t;
 namespace browser {
 namespace networking {
 
+// Receives response body bytes as they arrive from the socket
+using HttpDataCallback = std::function<void(const uint8_t*, size_t)>;
+
+// Receives a response's headers as soon as they have arrived
+using HttpHeadersCallback = std::function<void(const std::map<std::string, std::string>&)>;
+
 // HTTP request method enum
 enum class HttpMethod {
     GET,
@@ -63,25 +72,35 @@ public:
     bool hasHeader(const std::string& name) const;
     std::string getHeader(const std::string& name) const;
     
-    // Response body
-    const std::vector<uint8_t>& body() const { return m_body; }
+    // Response body. sharedBody() hands out the buffer itself; the
+    // response copies it before changing it again.
+    const std::vector<uint8_t>& body() const { return *m_body; }
+    SharedBytes sharedBody() const { return m_body; }
     std::string bodyAsString() const;
     
     // Set response properties
     void setStatusCode(int code) { m_statusCode = code; }
     void setStatusText(const std::string& text) { m_statusText = text; }
     void setHeader(const std::string& name, const std::string& value);
-    void setBody(const std::vector<uint8_t>& body) { m_body = body; }
+    void removeHeader(const std::string& name);
+    void setBody(const std::vector<uint8_t>& body) { m_body = std::make_shared<std::vector<uint8_t>>(body); }
+    void setBody(std::vector<uint8_t>&& body) { m_body = std::make_shared<std::vector<uint8_t>>(std::move(body)); }
     void appendToBody(const uint8_t* data, size_t length);
     
     // Parse response from raw data
     bool parseResponse(const std::vector<uint8_t>& data);
     
+    // Parse the status line and headers alone, up to the blank line
+    bool parseHead(const std::string& head);
+    
 private:
     int m_statusCode;
     std::string m_statusText;
     std::map<std::string, std::string> m_headers;
-    std::vector<uint8_t> m_body;
+    
+    // Never null; shared with copies of the response and sharedBody()
+    // callers until it is next changed
+    std::shared_ptr<std::vector<uint8_t>> m_body;
 };
 
 // HTTP request class
@@ -90,14 +109,18 @@ public:
     HttpRequest();
     explicit HttpRequest(const std::string& url);
     HttpRequest(HttpMethod method, const std::string& url);
+    HttpRequest(HttpMethod method, const security::Url& url);
     ~HttpRequest();
     
     // Request properties
     HttpMethod method() const { return m_method; }
     void setMethod(HttpMethod method) { m_method = method; }
     
-    std::string url() const { return m_url; }
-    void setUrl(const std::string& url) { m_url = url; }
+    const std::string& url() const { return m_url.spec(); }
+    void setUrl(const std::string& url) { m_url = security::Url(url); }
+    
+    // The URL, parsed when it was set
+    const security::Url& parsedUrl() const { return m_url; }
     
     // Request headers
     const std::map<std::string, std::string>& headers() const { return m_headers; }
@@ -110,17 +133,43 @@ public:
     void setBody(const std::vector<uint8_t>& body) { m_body = body; }
     void setBody(const std::string& body);
     
+    // Optional streaming of the response body. The body of successful
+    // (2xx) responses is streamed as it arrives, de-chunked and decoded.
+    const HttpDataCallback& dataCallback() const { return m_dataCallback; }
+    void setDataCallback(HttpDataCallback callback) { m_dataCallback = callback; }
+    
+    // Optional: the headers of a successful (2xx) response, before any of
+    // its body is streamed
+    const HttpHeadersCallback& headersCallback() const { return m_headersCallback; }
+    void setHeadersCallback(HttpHeadersCallback callback) { m_headersCallback = callback; }
+    
+    // Whether the HttpResponse keeps the body as well (the default). Turn
+    // off when the data callback is all that needs it.
+    bool bufferBody() const { return m_bufferBody; }
+    void setBufferBody(bool buffer) { m_bufferBody = buffer; }
+    
     // Parse URL into components
     bool parseUrl(std::string& protocol, std::string& host, 
                  std::string& path, int& port) const;
     
 private:
     HttpMethod m_method;
-    std::string m_url;
+    security::Url m_url;
     std::map<std::string, std::string> m_headers;
     std::vector<uint8_t> m_body;
+    HttpDataCallback m_dataCallback;
+    HttpHeadersCallback m_headersCallback;
+    bool m_bufferBody;
 };
 
+class IoPoller;
+class ConnectionPool;
+class DnsResolver;
+class ResponseReader;
+class TlsContext;
+class TlsStream;
+enum class TlsResult;
+
 // Callback types for asynchronous operations
 using HttpResponseCallback = std::function<void(const HttpResponse&, const std::string&)>;
 
@@ -151,8 +200,38 @@ public:
     // Set maximum redirects to follow
     void setMaxRedirects(int maxRedirects) { m_maxRedirects = maxRedirects; }
     
-    // Process any pending asynchronous requests (for event loop integration)
-    void processPendingRequests();
+    // Most asynchronous requests with a connection open at once; the rest
+    // wait their turn
+    void setMaxConcurrentRequests(size_t count) { m_maxConcurrentRequests = count > 0 ? count : 1; }
+    
+    // Keep-alive connections, reused across requests to the same origin.
+    // Each client has its own unless given one to share with others.
+    void setConnectionPool(std::shared_ptr<ConnectionPool> pool) { if (pool) m_connectionPool = pool; }
+    std::shared_ptr<ConnectionPool> connectionPool() const { return m_connectionPool; }
+    
+    // Resolves host names, in parallel and cached. Each client has its own
+    // unless given one to share with others.
+    void setDnsResolver(std::shared_ptr<DnsResolver> resolver) { if (resolver) m_dnsResolver = resolver; }
+    std::shared_ptr<DnsResolver> dnsResolver() const { return m_dnsResolver; }
+    
+    // TLS configuration and the sessions kept for resuming HTTPS
+    // connections. Each client creates its own with its first HTTPS
+    // request unless given one to share with others.
+    void setTlsContext(std::shared_ptr<TlsContext> context) { if (context) m_tlsContext = context; }
+    std::shared_ptr<TlsContext> tlsContext() const { return m_tlsContext; }
+    
+    // Drive the asynchronous requests (for event loop integration): start
+    // queued ones, then wait up to timeoutMs for their sockets and advance
+    // each as far as it can go without blocking. Callbacks run on the
+    // calling thread, which must be the one that queued the requests.
+    void processPendingRequests(int timeoutMs = 0);
+    
+    // Asynchronous requests queued or in flight
+    bool hasPendingRequests() const { return !m_pendingRequests.empty() || !m_connections.empty(); }
+    size_t activeRequestCount() const { return m_connections.size(); }
+    
+    // Fail every asynchronous request that hasn't completed with error
+    void cancelPendingRequests(const std::string& error);
     
 private:
     // Internal request processing
@@ -160,28 +239,64 @@ private:
     
     // Platform-specific socket handling
     bool openConnection(const std::string& host, int port, std::string& error);
+    
+    // TLS handshake on the new connection, sending earlyData with it if
+    // the server will take that; earlyDataSent says whether it did
+    bool startTls(const std::string& host, const std::string& origin, const std::vector<uint8_t>* earlyData,
+                  bool& earlyDataSent, std::string& error);
     bool sendData(const std::vector<uint8_t>& data, std::string& error);
-    bool receiveData(std::vector<uint8_t>& data, std::string& error);
+    void setSocketTimeouts();
+    
+    // Read one response into reader, up to the end its framing gives, or
+    // to EOF if it has none
+    bool receiveData(ResponseReader& reader, std::string& error);
     void closeConnection();
     
-    // Connection socket
+    // Connection socket of the synchronous request in progress, taken
+    // from m_connectionPool
     socket_t m_socket;
     
     // Configuration
     int m_timeoutSeconds;
     int m_maxRedirects;
     
-    // Thread pool for async requests (simplified in this implementation)
+    // Asynchronous requests waiting for a connection slot
     struct AsyncRequest {
         HttpRequest request;
         HttpResponseCallback callback;
-        bool inProgress;
+        int redirectCount;
+    };
+    std::deque<AsyncRequest> m_pendingRequests;
+    
+    // One non-blocking socket per request in flight, multiplexed through
+    // m_poller; see http_client.cpp
+    struct AsyncConnection;
+    struct SocketWatch;
+    std::vector<std::unique_ptr<AsyncConnection>> m_connections;
+    std::unique_ptr<IoPoller> m_poller;
+    size_t m_maxConcurrentRequests;
+    std::shared_ptr<ConnectionPool> m_connectionPool;
+    
+    std::shared_ptr<DnsResolver> m_dnsResolver;
+    
+    enum class StartResult {
+        STARTED,
+        WAITING,            // The origin is at its connection limit
+        FAILED
     };
-    std::vector<AsyncRequest> m_pendingRequests;
+    StartResult startConnection(AsyncRequest& pending, std::string& error);
+    void advanceResolution(AsyncConnection& connection);
+    void startAttempt(AsyncConnection& connection);
+    void advanceAttempt(SocketWatch& attempt, uint32_t events);
+    void closeAttempts(AsyncConnection& connection);
+    void advanceConnection(AsyncConnection& connection, uint32_t events);
+    void waitForTls(AsyncConnection& connection, TlsResult result);
+    void finishConnection(AsyncConnection& connection);
     
-    // Platform-specific SSL handling
-    bool m_useSSL;
-    void* m_sslContext;  // Opaque pointer to SSL context
+    // TLS stream of the synchronous request's connection, if HTTPS
+    std::shared_ptr<TlsContext> m_tlsContext;
+    std::unique_ptr<TlsStream> m_tls;
+    TlsContext& tls();
 };
 
 } // namespace networking
@@ -0,0 +1,276 @@
+#include "io_poller.h"
+#include <algorithm>
+
+#if defined(BROWSER_IO_POLLER_EPOLL)
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <cerrno>
+#elif defined(BROWSER_IO_POLLER_KQUEUE)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <cerrno>
+#elif !defined(_WIN32)
+#include <poll.h>
+#include <fcntl.h>
+#include <cerrno>
+#endif
+
+namespace browser {
+namespace networking {
+
+//-----------------------------------------------------------------------------
+// IoPoller Implementation
+//-----------------------------------------------------------------------------
+
+bool IoPoller::setNonBlocking(socket_t socket, bool nonBlocking) {
+#ifdef _WIN32
+    u_long mode = nonBlocking ? 1 : 0;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+    flags = nonBlocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    return fcntl(socket, F_SETFL, flags) != -1;
+#endif
+}
+
+#if defined(BROWSER_IO_POLLER_EPOLL)
+
+static uint32_t toEpollEvents(uint32_t events) {
+    uint32_t result = 0;
+    if (events & IO_READ) result |= EPOLLIN | EPOLLRDHUP;
+    if (events & IO_WRITE) result |= EPOLLOUT;
+    return result;
+}
+
+IoPoller::IoPoller()
+    : m_fd(epoll_create1(EPOLL_CLOEXEC))
+    , m_count(0)
+{
+}
+
+IoPoller::~IoPoller() {
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool IoPoller::isValid() const {
+    return m_fd != -1;
+}
+
+bool IoPoller::add(socket_t socket, uint32_t events, void* token) {
+    struct epoll_event event = {};
+    event.events = toEpollEvents(events);
+    event.data.ptr = token;
+    if (epoll_ctl(m_fd, EPOLL_CTL_ADD, socket, &event) != 0) {
+        return false;
+    }
+    ++m_count;
+    return true;
+}
+
+bool IoPoller::modify(socket_t socket, uint32_t events, void* token) {
+    struct epoll_event event = {};
+    event.events = toEpollEvents(events);
+    event.data.ptr = token;
+    return epoll_ctl(m_fd, EPOLL_CTL_MOD, socket, &event) == 0;
+}
+
+void IoPoller::remove(socket_t socket) {
+    struct epoll_event event = {};
+    if (epoll_ctl(m_fd, EPOLL_CTL_DEL, socket, &event) == 0) {
+        --m_count;
+    }
+}
+
+bool IoPoller::wait(int timeoutMs, std::vector<IoEvent>& events) {
+    events.clear();
+    if (m_count == 0) {
+        return true;
+    }
+
+    std::vector<struct epoll_event> ready(m_count);
+    int count = epoll_wait(m_fd, ready.data(), static_cast<int>(ready.size()), timeoutMs);
+    if (count < 0) {
+        return errno == EINTR;
+    }
+
+    // The socket isn't needed by callers that get a token, and epoll
+    // doesn't hand it back
+    for (int i = 0; i < count; ++i) {
+        uint32_t result = IO_NONE;
+        if (ready[i].events & (EPOLLIN | EPOLLRDHUP)) result |= IO_READ;
+        if (ready[i].events & EPOLLOUT) result |= IO_WRITE;
+        if (ready[i].events & (EPOLLERR | EPOLLHUP)) result |= IO_ERROR;
+        events.push_back({INVALID_SOCKET, result, ready[i].data.ptr});
+    }
+    return true;
+}
+
+#elif defined(BROWSER_IO_POLLER_KQUEUE)
+
+IoPoller::IoPoller()
+    : m_fd(kqueue())
+    , m_count(0)
+{
+}
+
+IoPoller::~IoPoller() {
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool IoPoller::isValid() const {
+    return m_fd != -1;
+}
+
+bool IoPoller::add(socket_t socket, uint32_t events, void* token) {
+    if (!modify(socket, events, token)) {
+        return false;
+    }
+    ++m_count;
+    return true;
+}
+
+bool IoPoller::modify(socket_t socket, uint32_t events, void* token) {
+    // A filter per direction; deleting one that isn't there is harmless
+    struct kevent changes[2];
+    EV_SET(&changes[0], socket, EVFILT_READ, (events & IO_READ) ? EV_ADD | EV_ENABLE : EV_DELETE, 0, 0, token);
+    EV_SET(&changes[1], socket, EVFILT_WRITE, (events & IO_WRITE) ? EV_ADD | EV_ENABLE : EV_DELETE, 0, 0, token);
+    for (struct kevent& change : changes) {
+        if (kevent(m_fd, &change, 1, nullptr, 0, nullptr) != 0 && errno != ENOENT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void IoPoller::remove(socket_t socket) {
+    modify(socket, IO_NONE, nullptr);
+    if (m_count > 0) {
+        --m_count;
+    }
+}
+
+bool IoPoller::wait(int timeoutMs, std::vector<IoEvent>& events) {
+    events.clear();
+    if (m_count == 0) {
+        return true;
+    }
+
+    struct timespec timeout;
+    struct timespec* timeoutPtr = nullptr;
+    if (timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        timeoutPtr = &timeout;
+    }
+
+    // Up to two filters per socket
+    std::vector<struct kevent> ready(m_count * 2);
+    int count = kevent(m_fd, nullptr, 0, ready.data(), static_cast<int>(ready.size()), timeoutPtr);
+    if (count < 0) {
+        return errno == EINTR;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        uint32_t result = ready[i].filter == EVFILT_READ ? IO_READ : IO_WRITE;
+        if (ready[i].flags & (EV_EOF | EV_ERROR)) result |= IO_ERROR;
+        events.push_back({static_cast<socket_t>(ready[i].ident), result, ready[i].udata});
+    }
+    return true;
+}
+
+#else
+
+IoPoller::IoPoller()
+    : m_count(0)
+{
+}
+
+IoPoller::~IoPoller() {
+}
+
+bool IoPoller::isValid() const {
+    return true;
+}
+
+bool IoPoller::add(socket_t socket, uint32_t events, void* token) {
+    m_watches.push_back({socket, events, token});
+    m_count = m_watches.size();
+    return true;
+}
+
+bool IoPoller::modify(socket_t socket, uint32_t events, void* token) {
+    for (Watch& watch : m_watches) {
+        if (watch.socket == socket) {
+            watch.events = events;
+            watch.token = token;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IoPoller::remove(socket_t socket) {
+    m_watches.erase(std::remove_if(m_watches.begin(), m_watches.end(),
+                                   [socket](const Watch& watch) { return watch.socket == socket; }),
+                    m_watches.end());
+    m_count = m_watches.size();
+}
+
+bool IoPoller::wait(int timeoutMs, std::vector<IoEvent>& events) {
+    events.clear();
+    if (m_watches.empty()) {
+        return true;
+    }
+
+#ifdef _WIN32
+    std::vector<WSAPOLLFD> fds(m_watches.size());
+#else
+    std::vector<struct pollfd> fds(m_watches.size());
+#endif
+    for (size_t i = 0; i < m_watches.size(); ++i) {
+        fds[i].fd = m_watches[i].socket;
+        fds[i].events = 0;
+        if (m_watches[i].events & IO_READ) fds[i].events |= POLLIN;
+        if (m_watches[i].events & IO_WRITE) fds[i].events |= POLLOUT;
+        fds[i].revents = 0;
+    }
+
+#ifdef _WIN32
+    int count = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeoutMs);
+    if (count == SOCKET_ERROR) {
+        return false;
+    }
+#else
+    int count = poll(fds.data(), fds.size(), timeoutMs);
+    if (count < 0) {
+        return errno == EINTR;
+    }
+#endif
+
+    for (size_t i = 0; i < fds.size() && count > 0; ++i) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+        --count;
+        uint32_t result = IO_NONE;
+        if (fds[i].revents & POLLIN) result |= IO_READ;
+        if (fds[i].revents & POLLOUT) result |= IO_WRITE;
+        if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) result |= IO_ERROR;
+        events.push_back({m_watches[i].socket, result, m_watches[i].token});
+    }
+    return true;
+}
+
+#endif
+
+} // namespace networking
+} // namespace browser
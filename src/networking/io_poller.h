@@ -0,0 +1,85 @@
+#ifndef BROWSER_IO_POLLER_H
+#define BROWSER_IO_POLLER_H
+
+#include "http_client.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_WIN32)
+#define BROWSER_IO_POLLER_POLL
+#elif defined(__linux__)
+#define BROWSER_IO_POLLER_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#define BROWSER_IO_POLLER_KQUEUE
+#else
+#define BROWSER_IO_POLLER_POLL
+#endif
+
+namespace browser {
+namespace networking {
+
+// Readiness a socket is watched for, or reported with
+enum IoEvents : uint32_t {
+    IO_NONE = 0,
+    IO_READ = 1 << 0,
+    IO_WRITE = 1 << 1,
+    IO_ERROR = 1 << 2      // Reported only: hang-up or socket error
+};
+
+// A socket that became ready, with the token it was added with
+struct IoEvent {
+    socket_t socket;
+    uint32_t events;
+    void* token;
+};
+
+// Waits on many non-blocking sockets at once: epoll on Linux, kqueue on
+// macOS and the BSDs, and WSAPoll (or poll elsewhere) as the fallback.
+// Not thread-safe; one thread adds sockets and waits.
+class IoPoller {
+public:
+    IoPoller();
+    ~IoPoller();
+
+    IoPoller(const IoPoller&) = delete;
+    IoPoller& operator=(const IoPoller&) = delete;
+
+    // False if the platform's poller couldn't be created
+    bool isValid() const;
+
+    // Watch a socket for events; modify() replaces what it's watched for.
+    // The token comes back with its events.
+    bool add(socket_t socket, uint32_t events, void* token);
+    bool modify(socket_t socket, uint32_t events, void* token);
+
+    // Stop watching a socket; call before closing it
+    void remove(socket_t socket);
+
+    // Wait up to timeoutMs (-1 waits indefinitely) for watched sockets to
+    // become ready, replacing the contents of events. False on error.
+    bool wait(int timeoutMs, std::vector<IoEvent>& events);
+
+    size_t size() const { return m_count; }
+
+    // Make a socket non-blocking, or blocking again
+    static bool setNonBlocking(socket_t socket, bool nonBlocking = true);
+
+private:
+#if defined(BROWSER_IO_POLLER_EPOLL) || defined(BROWSER_IO_POLLER_KQUEUE)
+    int m_fd;
+#else
+    struct Watch {
+        socket_t socket;
+        uint32_t events;
+        void* token;
+    };
+    std::vector<Watch> m_watches;
+#endif
+    size_t m_count;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_IO_POLLER_H
@@ -0,0 +1,128 @@
+#include "request_scheduler.h"
+#include "connection_pool.h"
+#include "http_client.h"
+
+namespace browser {
+namespace networking {
+
+//-----------------------------------------------------------------------------
+// RequestScheduler Implementation
+//-----------------------------------------------------------------------------
+
+RequestScheduler::RequestScheduler()
+    : m_maxPerHost(6)
+    , m_reservedPerHost(1)
+    , m_sequence(0)
+{
+}
+
+RequestScheduler::~RequestScheduler() {
+}
+
+void RequestScheduler::setMaxRequestsPerHost(size_t count) {
+    m_maxPerHost = count > 0 ? count : 1;
+}
+
+std::string RequestScheduler::hostKey(const security::Url& url) {
+    // The same key the connection pool limits connections by; a URL that
+    // doesn't parse fails as soon as it starts, so it is its own host
+    if (!url.isValid()) {
+        return url.spec();
+    }
+    return ConnectionPool::originKey(url.scheme(), url.host(), url.port());
+}
+
+void RequestScheduler::enqueue(std::shared_ptr<ResourceRequest> request) {
+    if (!request || m_queued.count(request.get()) > 0) {
+        return;
+    }
+
+    Entry entry;
+    entry.priority = request->priority();
+    entry.sequence = m_sequence++;
+    entry.host = hostKey(request->parsedUrl());
+    entry.request = request;
+    m_queued[request.get()] = m_queue.insert(std::move(entry)).first;
+}
+
+bool RequestScheduler::reprioritize(const std::shared_ptr<ResourceRequest>& request, int priority) {
+    request->setPriority(priority);
+
+    auto found = m_queued.find(request.get());
+    if (found == m_queued.end()) {
+        return false;
+    }
+    if (found->second->priority == priority) {
+        return true;
+    }
+
+    // Set keys can't change in place; reinserting with the same sequence
+    // keeps its queue order among requests of the new priority
+    Entry entry = *found->second;
+    m_queue.erase(found->second);
+    entry.priority = priority;
+    found->second = m_queue.insert(std::move(entry)).first;
+    return true;
+}
+
+bool RequestScheduler::remove(const std::shared_ptr<ResourceRequest>& request) {
+    auto found = m_queued.find(request.get());
+    if (found == m_queued.end()) {
+        return false;
+    }
+    m_queue.erase(found->second);
+    m_queued.erase(found);
+    return true;
+}
+
+size_t RequestScheduler::slotsFor(int priority) const {
+    if (priority >= PRIORITY_MEDIUM || m_reservedPerHost >= m_maxPerHost) {
+        return m_maxPerHost;
+    }
+    return m_maxPerHost - m_reservedPerHost;
+}
+
+std::shared_ptr<ResourceRequest> RequestScheduler::next() {
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        auto load = m_hostLoad.find(it->host);
+        size_t inFlight = load != m_hostLoad.end() ? load->second : 0;
+        if (inFlight >= slotsFor(it->priority)) {
+            continue;
+        }
+
+        std::shared_ptr<ResourceRequest> request = it->request;
+        ++m_hostLoad[it->host];
+        m_inFlight[request.get()] = it->host;
+        m_queued.erase(request.get());
+        m_queue.erase(it);
+        return request;
+    }
+    return nullptr;
+}
+
+void RequestScheduler::finished(const std::shared_ptr<ResourceRequest>& request) {
+    auto found = m_inFlight.find(request.get());
+    if (found == m_inFlight.end()) {
+        return;
+    }
+
+    auto load = m_hostLoad.find(found->second);
+    if (load != m_hostLoad.end() && --load->second == 0) {
+        m_hostLoad.erase(load);
+    }
+    m_inFlight.erase(found);
+}
+
+std::vector<std::shared_ptr<ResourceRequest>> RequestScheduler::takeQueued() {
+    std::vector<std::shared_ptr<ResourceRequest>> requests;
+    requests.reserve(m_queue.size());
+    for (const Entry& entry : m_queue) {
+        requests.push_back(entry.request);
+    }
+    m_queue.clear();
+    m_queued.clear();
+    return requests;
+}
+
+} // namespace networking
+} // namespace browser
@@ -0,0 +1,94 @@
+#ifndef BROWSER_REQUEST_SCHEDULER_H
+#define BROWSER_REQUEST_SCHEDULER_H
+
+#include "resource_request.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace browser {
+namespace networking {
+
+// Decides which queued resource requests start next: the highest priority
+// first, in the order they were queued within a priority, with a limit on
+// the requests in flight to each host (origin). Requests below
+// PRIORITY_MEDIUM can't take a host's last reserved slots, so what blocks
+// rendering never waits behind image downloads. Queued requests can be
+// reprioritized or taken out. Not thread-safe; ResourceLoader guards it.
+class RequestScheduler {
+public:
+    RequestScheduler();
+    ~RequestScheduler();
+
+    RequestScheduler(const RequestScheduler&) = delete;
+    RequestScheduler& operator=(const RequestScheduler&) = delete;
+
+    // Requests in flight to one host at most, and how many of those slots
+    // only requests of PRIORITY_MEDIUM and up may take
+    void setMaxRequestsPerHost(size_t count);
+    size_t maxRequestsPerHost() const { return m_maxPerHost; }
+    void setReservedSlotsPerHost(size_t count) { m_reservedPerHost = count; }
+
+    // Queue a request at its current priority
+    void enqueue(std::shared_ptr<ResourceRequest> request);
+
+    // Give a request a new priority, moving it if it is queued. False if
+    // it isn't queued (it started, or was never queued).
+    bool reprioritize(const std::shared_ptr<ResourceRequest>& request, int priority);
+
+    // Take a queued request out. False if it isn't queued.
+    bool remove(const std::shared_ptr<ResourceRequest>& request);
+
+    // The first queued request whose host has a slot for it, counted as in
+    // flight until finished(); null if none can start
+    std::shared_ptr<ResourceRequest> next();
+    void finished(const std::shared_ptr<ResourceRequest>& request);
+
+    // Take every queued request out, in priority order
+    std::vector<std::shared_ptr<ResourceRequest>> takeQueued();
+
+    bool hasQueued() const { return !m_queue.empty(); }
+    size_t queuedCount() const { return m_queue.size(); }
+    size_t inFlightCount() const { return m_inFlight.size(); }
+
+private:
+    struct Entry {
+        int priority;
+        uint64_t sequence;
+        std::string host;
+        std::shared_ptr<ResourceRequest> request;
+    };
+
+    // Highest priority first, then first queued
+    struct EntryOrder {
+        bool operator()(const Entry& a, const Entry& b) const {
+            if (a.priority != b.priority) {
+                return a.priority > b.priority;
+            }
+            return a.sequence < b.sequence;
+        }
+    };
+    using Queue = std::set<Entry, EntryOrder>;
+
+    // In-flight requests a host may have for one of priority to start
+    size_t slotsFor(int priority) const;
+
+    static std::string hostKey(const security::Url& url);
+
+    Queue m_queue;
+    std::map<const ResourceRequest*, Queue::iterator> m_queued;
+    std::map<const ResourceRequest*, std::string> m_inFlight;    // Host of each
+    std::map<std::string, size_t> m_hostLoad;                    // In flight per host
+    size_t m_maxPerHost;
+    size_t m_reservedPerHost;
+    uint64_t m_sequence;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_REQUEST_SCHEDULER_H
@@ -1,7 +1,14 @@
+#ifndef BROWSER_RESOURCE_LOADER_H
+#define BROWSER_RESOURCE_LOADER_H
+
 #include "http_client.h"
+#include "connection_pool.h"
+#include "request_scheduler.h"
 #include "dns_resolver.h"
+#include "tls_transport.h"
 #include "cache.h"
 #include <iostream>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <thread>
@@ -9,67 +16,29 @@
 #include <condition_variable>
 #include <queue>
 #include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
 
 namespace browser {
 namespace networking {
 
-// Resource type enum
-enum class ResourceType {
-    HTML,
-    CSS,
-    JAVASCRIPT,
-    IMAGE,
-    FONT,
-    OTHER
-};
-
-// Resource request class
-class ResourceRequest {
-public:
-    ResourceRequest(const std::string& url, ResourceType type)
-        : m_url(url)
-        , m_type(type)
-        , m_priority(0)
-        , m_isComplete(false)
-    {
-    }
-    
-    // Getters
-    std::string url() const { return m_url; }
-    ResourceType type() const { return m_type; }
-    int priority() const { return m_priority; }
-    bool isComplete() const { return m_isComplete; }
-    
-    // Setters
-    void setPriority(int priority) { m_priority = priority; }
-    void setComplete(bool complete) { m_isComplete = complete; }
-    
-    // Set completion callback
-    void setCompletionCallback(std::function<void(const std::vector<uint8_t>&, const std::map<std::string, std::string>&)> callback) {
-        m_completionCallback = callback;
-    }
-    
-    // Call completion callback
-    void notifyCompletion(const std::vector<uint8_t>& data, const std::map<std::string, std::string>& headers) {
-        if (m_completionCallback) {
-            m_completionCallback(data, headers);
-        }
-    }
-    
-private:
-    std::string m_url;
-    ResourceType m_type;
-    int m_priority;
-    std::atomic<bool> m_isComplete;
-    std::function<void(const std::vector<uint8_t>&, const std::map<std::string, std::string>&)> m_completionCallback;
-};
-
 // Resource loader class
 class ResourceLoader {
 public:
     ResourceLoader()
-        : m_isRunning(false)
+        : m_connectionPool(std::make_shared<ConnectionPool>())
+        , m_dnsResolver(std::make_shared<DnsResolver>())
+        , m_tlsContext(std::make_shared<TlsContext>())
+        , m_isRunning(false)
+        , m_staleWhileRevalidate(true)
+        , m_fetchWorkerCount(6)
     {
+        m_httpClient.setConnectionPool(m_connectionPool);
+        m_httpClient.setDnsResolver(m_dnsResolver);
+        m_httpClient.setTlsContext(m_tlsContext);
+        m_scheduler.setMaxRequestsPerHost(m_connectionPool->maxConnectionsPerOrigin());
     }
     
     ~ResourceLoader() {
@@ -83,7 +52,7 @@ public:
             return false;
         }
         
-        if (!m_dnsResolver.initialize()) {
+        if (!m_dnsResolver->initialize()) {
             return false;
         }
         
@@ -94,7 +63,25 @@ public:
         return true;
     }
     
-    // Start the resource loader thread
+    // Number of worker threads started by start() to run fetch() callbacks
+    void setFetchWorkerCount(size_t count) { m_fetchWorkerCount = count > 0 ? count : 1; }
+    size_t fetchWorkerCount() const { return m_fetchWorkerCount; }
+    
+    // Requests in flight to one host at most; see RequestScheduler
+    void setMaxRequestsPerHost(size_t count) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_scheduler.setMaxRequestsPerHost(count);
+    }
+    
+    // Serve expired entries within their stale-while-revalidate window at
+    // once, refreshing them in the background while the loader runs. On
+    // by default; off, such loads wait for the revalidation.
+    void setStaleWhileRevalidate(bool enabled) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_staleWhileRevalidate = enabled;
+    }
+    
+    // Start the resource loader thread and the fetch workers
     void start() {
         if (m_isRunning) {
             return;
@@ -102,55 +89,271 @@ public:
         
         m_isRunning = true;
         m_thread = std::thread(&ResourceLoader::run, this);
+        for (size_t i = 0; i < m_fetchWorkerCount; ++i) {
+            m_fetchWorkers.emplace_back(&ResourceLoader::runFetchWorker, this);
+        }
     }
     
-    // Stop the resource loader thread
+    // Stop the resource loader thread and the fetch workers. Requests that
+    // have not completed fail.
     void stop() {
         if (!m_isRunning) {
             return;
         }
         
-        m_isRunning = false;
+        {
+            std::scoped_lock lock(m_mutex, m_fetchMutex);
+            m_isRunning = false;
+        }
         m_condition.notify_all();
+        m_fetchCondition.notify_all();
         
         if (m_thread.joinable()) {
             m_thread.join();
         }
+        m_httpClient.cancelPendingRequests("Resource loader stopped");
+        for (auto& worker : m_fetchWorkers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        m_fetchWorkers.clear();
+        
+        // Requests that never started, then callbacks the workers didn't get to
+        std::vector<std::shared_ptr<ResourceRequest>> queued;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            queued = m_scheduler.takeQueued();
+            m_revalidations.clear();
+            m_revalidating.clear();
+        }
+        for (const auto& request : queued) {
+            finishRequest(request, false, emptyBody(), emptyHeaders(), "Resource loader stopped");
+        }
+        
+        std::queue<std::function<void()>> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(m_fetchMutex);
+            abandoned.swap(m_fetchQueue);
+        }
+        while (!abandoned.empty()) {
+            abandoned.front()();
+            abandoned.pop();
+        }
     }
     
-    // Queue a resource request
+    // Load a resource through the scheduler, at type's priority. The
+    // callback runs on a fetch worker (or on the calling thread if the
+    // loader is not running, which loads it there and then). The request
+    // returned can be reprioritized or cancelled.
+    std::shared_ptr<ResourceRequest> fetch(const std::string& url, FetchCallback callback,
+                                           ResourceType type = ResourceType::OTHER) {
+        if (!callback) {
+            return nullptr;
+        }
+        
+        auto request = std::make_shared<ResourceRequest>(url, type);
+        request->setFetchCallback(std::move(callback));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_isRunning) {
+                queueRequestLocked(request);
+                return request;
+            }
+        }
+        
+        ResourceBody data;
+        std::map<std::string, std::string> headers;
+        std::string error;
+        bool success = loadResource(url, data, headers, error);
+        request->fetchCallback()(success, success ? data : emptyBody(), headers, error);
+        request->setComplete(true);
+        return request;
+    }
+    
+    // Queue a resource request; it starts when the scheduler gets to it.
+    // A request for a URL already queued or loading waits for that load
+    // and shares its result instead.
     void queueRequest(std::shared_ptr<ResourceRequest> request) {
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_requestQueue.push(request);
-        m_condition.notify_one();
+        queueRequestLocked(std::move(request));
+    }
+    
+    // Change a request's priority, e.g. once an image scrolls into view.
+    // Only moves it while it is queued.
+    void setPriority(const std::shared_ptr<ResourceRequest>& request, int priority) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        request->setPriority(priority);
+        
+        // A waiter can only hurry the fetch it shares
+        auto found = m_flights.find(request->url());
+        const std::shared_ptr<ResourceRequest>& primary =
+            found != m_flights.end() && found->second->primary ? found->second->primary : request;
+        if (primary == request || priority > primary->priority()) {
+            m_scheduler.reprioritize(primary, priority);
+        }
+    }
+    
+    // Cancel a request. A queued one is dropped and a request already in
+    // flight is left to finish; either way it fails with "Request
+    // cancelled" and an image's completion callback isn't called. A fetch
+    // others wait on goes ahead for them.
+    void cancel(const std::shared_ptr<ResourceRequest>& request) {
+        request->setCancelled(true);
+        bool removed = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_flights.find(request->url());
+            if (found != m_flights.end()) {
+                Flight& flight = *found->second;
+                auto waiter = std::find(flight.waiters.begin(), flight.waiters.end(), request);
+                if (waiter != flight.waiters.end()) {
+                    flight.waiters.erase(waiter);
+                    removed = true;
+                } else if (flight.primary == request && flight.waiters.empty() && flight.loadWaiters == 0 &&
+                           m_scheduler.remove(request)) {
+                    m_flights.erase(found);
+                    removed = true;
+                }
+            }
+        }
+        if (removed) {
+            completeRequest(request, false, emptyBody(), emptyHeaders(), "Request cancelled");
+        }
+    }
+    
+    // Keep-alive connections shared by every fetch, so subresources from one
+    // origin reuse a few sockets
+    std::shared_ptr<ConnectionPool> connectionPool() const { return m_connectionPool; }
+    
+    // Host name lookups shared by every fetch
+    std::shared_ptr<DnsResolver> dnsResolver() const { return m_dnsResolver; }
+    
+    // TLS sessions shared by every fetch, so HTTPS connections resume
+    std::shared_ptr<TlsContext> tlsContext() const { return m_tlsContext; }
+    
+    // Start resolving the host of url in the background, so fetching it
+    // later doesn't wait on DNS
+    void prefetchDns(const std::string& url) {
+        prefetchDns(security::Url(url));
+    }
+    
+    void prefetchDns(const security::Url& url) {
+        if (url.isValid() && (url.scheme() == "http" || url.scheme() == "https") && !url.host().empty()) {
+            m_dnsResolver->prefetch(url.host());
+        }
     }
     
     // Check if a resource is in the cache
     bool isResourceCached(const std::string& url) {
         CacheEntry entry;
-        return m_cache.get(url, entry) && !entry.isExpired();
+        return cacheGet(url, entry) && !entry.isExpired();
+    }
+    
+    // Directory of the disk cache, or empty if responses are only cached
+    // in memory
+    std::string cacheDirectory() {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_cache.diskCacheDirectory();
+    }
+    
+    // Cache hits, misses and evictions, and what the cache holds
+    CacheStats cacheStats() {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_cache.stats();
+    }
+    
+    // Shrink the memory tier of the cache to at most bytes
+    void trimMemoryCache(size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        m_cache.trimMemoryCache(bytes);
     }
     
     // Get a resource from the cache
-    bool getResourceFromCache(const std::string& url, std::vector<uint8_t>& data, std::map<std::string, std::string>& headers) {
+    bool getResourceFromCache(const std::string& url, ResourceBody& data, std::map<std::string, std::string>& headers) {
         CacheEntry entry;
-        if (m_cache.get(url, entry) && !entry.isExpired()) {
-            data = entry.data();
+        if (cacheGet(url, entry) && !entry.isExpired()) {
+            data = entry.sharedData();
             headers = entry.metadata().headers;
             return true;
         }
         return false;
     }
     
-    // Load a resource (synchronous)
-    bool loadResource(const std::string& url, std::vector<uint8_t>& data, 
+    // Load a resource (synchronous). data is never null and shares its
+    // bytes with the cache. When onData is set, body bytes of a network
+    // fetch are also passed to it as they arrive, after onHeaders is given
+    // the response's headers; cached responses are only returned through
+    // data and headers. While the URL is already loading, this waits for
+    // that load's result instead, which comes only through them.
+    bool loadResource(const std::string& url, ResourceBody& data, 
                      std::map<std::string, std::string>& headers,
-                     std::string& error) {
+                     std::string& error,
+                     const HttpDataCallback& onData = nullptr,
+                     const HttpHeadersCallback& onHeaders = nullptr) {
+        std::shared_ptr<Flight> flight;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto found = m_flights.find(url);
+            if (found != m_flights.end()) {
+                flight = found->second;
+                ++flight->loadWaiters;
+                m_flightDone.wait(lock, [&flight] { return flight->done; });
+                data = flight->body;
+                headers = *flight->headers;
+                error = flight->error;
+                return flight->success;
+            }
+            
+            flight = std::make_shared<Flight>();
+            m_flights[url] = flight;
+        }
+        
+        // A client per call: HttpClient holds one connection at a time. The
+        // connection itself comes from the shared pool.
+        HttpClient client;
+        client.setConnectionPool(m_connectionPool);
+        client.setDnsResolver(m_dnsResolver);
+        client.setTlsContext(m_tlsContext);
+        bool success = loadResourceWith(client, url, data, headers, error, onData, onHeaders);
+        if (!data) {
+            data = emptyBody();
+        }
+        
+        // What queued behind this load shares its body
+        SharedHeaders sharedHeaders = emptyHeaders();
+        std::vector<std::shared_ptr<ResourceRequest>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (flight->loadWaiters > 0 || !flight->waiters.empty()) {
+                sharedHeaders = std::make_shared<const std::map<std::string, std::string>>(headers);
+            }
+            waiters = settleFlightLocked(url, nullptr, success, data, sharedHeaders, error);
+        }
+        for (const auto& waiter : waiters) {
+            completeRequest(waiter, success, data, sharedHeaders, error);
+        }
+        return success;
+    }
+    
+private:
+    bool loadResourceWith(HttpClient& client, const std::string& url, ResourceBody& data,
+                          std::map<std::string, std::string>& headers,
+                          std::string& error,
+                          const HttpDataCallback& onData,
+                          const HttpHeadersCallback& onHeaders) {
         // Check cache first
         CacheEntry cacheEntry;
-        if (m_cache.get(url, cacheEntry)) {
+        if (cacheGet(url, cacheEntry)) {
             // Check if expired
             if (cacheEntry.isExpired()) {
+                // Within stale-while-revalidate, answer now and refresh later
+                if (cacheEntry.canServeStale() && revalidateInBackground(cacheEntry)) {
+                    data = cacheEntry.sharedData();
+                    headers = cacheEntry.metadata().headers;
+                    return true;
+                }
+                
                 // If entry can be validated, add validation headers
                 if (cacheEntry.canBeValidated()) {
                     HttpRequest request(HttpMethod::GET, url);
@@ -162,38 +365,54 @@ public:
                     }
                     
                     // Send request
-                    HttpResponse response = m_httpClient.sendRequest(request, error);
+                    HttpResponse response = client.sendRequest(request, error);
                     
                     // Check if not modified
                     if (response.statusCode() == 304) {
                         // Resource not modified, use cache
-                        data = cacheEntry.data();
+                        cacheEntry.refresh(response.headers());
+                        cachePut(cacheEntry);
+                        
+                        data = cacheEntry.sharedData();
                         headers = cacheEntry.metadata().headers;
                         return true;
                     } else if (response.statusCode() == 200) {
                         // Resource modified, update cache
-                        cacheEntry.update(response.body(), response.headers());
-                        m_cache.put(cacheEntry);
+                        cacheEntry.update(response.sharedBody(), response.headers());
+                        cachePut(cacheEntry);
                         
-                        data = response.body();
+                        data = response.sharedBody();
                         headers = response.headers();
                         return true;
+                    } else if (canUseStaleOnError(cacheEntry, response, error)) {
+                        data = cacheEntry.sharedData();
+                        headers = cacheEntry.metadata().headers;
+                        error.clear();
+                        return true;
                     } else {
                         error = "HTTP request failed: " + std::to_string(response.statusCode()) + " " + response.statusText();
                         return false;
                     }
                 } else {
                     // Refetch without validation
-                    HttpResponse response = m_httpClient.get(url, error);
+                    HttpRequest request(HttpMethod::GET, url);
+                    request.setDataCallback(onData);
+                    request.setHeadersCallback(onHeaders);
+                    HttpResponse response = client.sendRequest(request, error);
                     
                     if (response.statusCode() == 200) {
                         // Update cache
-                        cacheEntry = CacheEntry(url, response.body(), response.headers());
-                        m_cache.put(cacheEntry);
+                        cacheEntry = CacheEntry(url, response.sharedBody(), response.headers());
+                        cachePut(cacheEntry);
                         
-                        data = response.body();
+                        data = response.sharedBody();
                         headers = response.headers();
                         return true;
+                    } else if (canUseStaleOnError(cacheEntry, response, error)) {
+                        data = cacheEntry.sharedData();
+                        headers = cacheEntry.metadata().headers;
+                        error.clear();
+                        return true;
                     } else {
                         error = "HTTP request failed: " + std::to_string(response.statusCode()) + " " + response.statusText();
                         return false;
@@ -201,20 +420,23 @@ public:
                 }
             } else {
                 // Cache entry valid, use cache
-                data = cacheEntry.data();
+                data = cacheEntry.sharedData();
                 headers = cacheEntry.metadata().headers;
                 return true;
             }
         } else {
             // Not found in cache, fetch
-            HttpResponse response = m_httpClient.get(url, error);
+            HttpRequest request(HttpMethod::GET, url);
+            request.setDataCallback(onData);
+            request.setHeadersCallback(onHeaders);
+            HttpResponse response = client.sendRequest(request, error);
             
             if (response.statusCode() == 200) {
                 // Cache response
-                cacheEntry = CacheEntry(url, response.body(), response.headers());
-                m_cache.put(cacheEntry);
+                cacheEntry = CacheEntry(url, response.sharedBody(), response.headers());
+                cachePut(cacheEntry);
                 
-                data = response.body();
+                data = response.sharedBody();
                 headers = response.headers();
                 return true;
             } else {
@@ -223,118 +445,372 @@ public:
             }
         }
     }
+
+    using SharedHeaders = std::shared_ptr<const std::map<std::string, std::string>>;
+    
+    // One load of a URL, and the requests and loadResource() calls waiting
+    // on it. Guarded by m_mutex.
+    struct Flight {
+        std::shared_ptr<ResourceRequest> primary;      // null for a loadResource() call
+        std::vector<std::shared_ptr<ResourceRequest>> waiters;
+        size_t loadWaiters = 0;
+        
+        // Set once the load is done, for loadResource() waiters
+        bool done = false;
+        bool success = false;
+        ResourceBody body;
+        SharedHeaders headers;
+        std::string error;
+    };
+    
+    static const ResourceBody& emptyBody() {
+        return emptySharedBytes();
+    }
+    
+    static const SharedHeaders& emptyHeaders() {
+        static const SharedHeaders headers = std::make_shared<const std::map<std::string, std::string>>();
+        return headers;
+    }
+    
+    // Start url's load, or have request wait on the one in flight.
+    // Called with m_mutex held.
+    void queueRequestLocked(std::shared_ptr<ResourceRequest> request) {
+        auto found = m_flights.find(request->url());
+        if (found != m_flights.end()) {
+            found->second->waiters.push_back(request);
+            
+            // The shared load goes at its most urgent waiter's priority
+            const auto& primary = found->second->primary;
+            if (primary && request->priority() > primary->priority()) {
+                m_scheduler.reprioritize(primary, request->priority());
+            }
+            return;
+        }
+        
+        auto flight = std::make_shared<Flight>();
+        flight->primary = request;
+        m_flights[request->url()] = flight;
+        m_scheduler.enqueue(std::move(request));
+        m_condition.notify_one();
+    }
+    
+    // Record the outcome of the load of url primary started, wake the
+    // loadResource() calls waiting on it and return the requests that
+    // were. Called with m_mutex held.
+    std::vector<std::shared_ptr<ResourceRequest>> settleFlightLocked(const std::string& url,
+                                                                     const ResourceRequest* primary, bool success,
+                                                                     const ResourceBody& body,
+                                                                     const SharedHeaders& headers,
+                                                                     const std::string& error) {
+        auto found = m_flights.find(url);
+        if (found == m_flights.end() || found->second->primary.get() != primary) {
+            return {};
+        }
+        
+        std::shared_ptr<Flight> flight = found->second;
+        m_flights.erase(found);
+        flight->done = true;
+        flight->success = success;
+        flight->body = body;
+        flight->headers = headers;
+        flight->error = error;
+        if (flight->loadWaiters > 0) {
+            m_flightDone.notify_all();
+        }
+        return std::move(flight->waiters);
+    }
+    
+    // Hand a request's outcome on: fetch() callbacks go to a fetch worker,
+    // or run here once the workers are stopped; completion callbacks run
+    // here, on success only
+    void completeRequest(const std::shared_ptr<ResourceRequest>& request, bool success,
+                         const ResourceBody& body, const SharedHeaders& headers,
+                         const std::string& error) {
+        if (request->isCancelled()) {
+            success = false;
+        }
+        std::string outcome = request->isCancelled() ? std::string("Request cancelled") : error;
+        
+        if (!request->fetchCallback()) {
+            if (success) {
+                request->notifyCompletion(body, *headers);
+            }
+            request->setComplete(true);
+            return;
+        }
+        
+        std::function<void()> task = [request, success, body, headers, outcome]() {
+            request->fetchCallback()(success, success ? body : emptyBody(), *headers, outcome);
+            request->setComplete(true);
+        };
+        {
+            std::lock_guard<std::mutex> lock(m_fetchMutex);
+            if (m_isRunning) {
+                m_fetchQueue.push(std::move(task));
+                m_fetchCondition.notify_one();
+                return;
+            }
+        }
+        task();
+    }
+    
+    // A started request is done: its host slot goes to the next one, and
+    // it and the requests sharing its fetch get the one result
+    void finishRequest(const std::shared_ptr<ResourceRequest>& request, bool success,
+                       const ResourceBody& body, const SharedHeaders& headers,
+                       const std::string& error) {
+        std::vector<std::shared_ptr<ResourceRequest>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_scheduler.finished(request);
+            waiters = settleFlightLocked(request->url(), request.get(), success, body, headers, error);
+        }
+        completeRequest(request, success, body, headers, error);
+        for (const auto& waiter : waiters) {
+            completeRequest(waiter, success, body, headers, error);
+        }
+    }
+    
+    // Finish a request with bytes from a response or the cache, which it
+    // and the requests sharing its fetch hold without copying
+    void finishRequest(const std::shared_ptr<ResourceRequest>& request, bool success,
+                       const ResourceBody& data, const std::map<std::string, std::string>& headers,
+                       const std::string& error) {
+        finishRequest(request, success, data ? data : emptyBody(),
+                      std::make_shared<const std::map<std::string, std::string>>(headers), error);
+    }
+    
+    // Fetch worker thread function; runs fetch() callbacks
+    void runFetchWorker() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_fetchMutex);
+                m_fetchCondition.wait(lock, [this] { return !m_isRunning || !m_fetchQueue.empty(); });
+                
+                if (!m_isRunning) {
+                    break;
+                }
+                
+                task = std::move(m_fetchQueue.front());
+                m_fetchQueue.pop();
+            }
+            
+            task();
+        }
+    }
+    
+    // Cache access, shared by the loader thread, fetch workers and callers
+    bool cacheGet(const std::string& url, CacheEntry& entry) {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_cache.get(url, entry);
+    }
+    
+    bool cachePut(const CacheEntry& entry) {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_cache.put(entry);
+    }
     
-private:
     // Thread function
     void run() {
         while (m_isRunning) {
-            std::shared_ptr<ResourceRequest> request;
+            std::vector<std::shared_ptr<ResourceRequest>> starting;
+            std::vector<CacheEntry> revalidations;
             
-            // Get a request from the queue
+            // Take the requests the scheduler lets start. Only block while
+            // no fetch is in flight; otherwise the sockets need pumping.
             {
                 std::unique_lock<std::mutex> lock(m_mutex);
-                m_condition.wait(lock, [this] { return !m_isRunning || !m_requestQueue.empty(); });
+                if (!m_httpClient.hasPendingRequests()) {
+                    m_condition.wait(lock, [this] {
+                        return !m_isRunning || m_scheduler.hasQueued() || !m_revalidations.empty();
+                    });
+                }
                 
                 if (!m_isRunning) {
                     break;
                 }
                 
-                if (m_requestQueue.empty()) {
-                    continue;
+                while (std::shared_ptr<ResourceRequest> request = m_scheduler.next()) {
+                    starting.push_back(std::move(request));
                 }
-                
-                request = m_requestQueue.front();
-                m_requestQueue.pop();
+                revalidations.swap(m_revalidations);
             }
             
-            // Process the request
-            if (request) {
-                // Check cache first
-                CacheEntry cacheEntry;
-                if (m_cache.get(request->url(), cacheEntry)) {
-                    // Check if expired
-                    if (cacheEntry.isExpired()) {
-                        // If entry can be validated, add validation headers
-                        if (cacheEntry.canBeValidated()) {
-                            // Asynchronously validate
-                            HttpRequest httpRequest(HttpMethod::GET, request->url());
-                            
-                            // Add validation headers
-                            std::map<std::string, std::string> validationHeaders = cacheEntry.getValidationHeaders();
-                            for (const auto& header : validationHeaders) {
-                                httpRequest.setHeader(header.first, header.second);
-                            }
-                            
-                            // Send request asynchronously
-                            m_httpClient.sendRequestAsync(httpRequest, [this, request, cacheEntry](const HttpResponse& response, const std::string& error) {
-                                // Check if not modified
-                                if (response.statusCode() == 304) {
-                                    // Resource not modified, use cache
-                                    request->notifyCompletion(cacheEntry.data(), cacheEntry.metadata().headers);
-                                } else if (response.statusCode() == 200) {
-                                    // Resource modified, update cache
-                                    CacheEntry newEntry(request->url(), response.body(), response.headers());
-                                    m_cache.put(newEntry);
-                                    
-                                    request->notifyCompletion(response.body(), response.headers());
-                                } else {
-                                    // Request failed, use stale cache entry
-                                    request->notifyCompletion(cacheEntry.data(), cacheEntry.metadata().headers);
-                                }
-                                
-                                request->setComplete(true);
-                            });
-                        } else {
-                            // Refetch without validation
-                            m_httpClient.getAsync(request->url(), [this, request](const HttpResponse& response, const std::string& error) {
-                                if (response.statusCode() == 200) {
-                                    // Cache response
-                                    CacheEntry entry(request->url(), response.body(), response.headers());
-                                    m_cache.put(entry);
-                                    
-                                    request->notifyCompletion(response.body(), response.headers());
-                                }
-                                
-                                request->setComplete(true);
-                            });
-                        }
-                    } else {
-                        // Cache entry valid, use cache
-                        request->notifyCompletion(cacheEntry.data(), cacheEntry.metadata().headers);
-                        request->setComplete(true);
+            // In priority order, which the client keeps when it opens their
+            // connections; revalidations, which nobody waits on, go last
+            for (const auto& request : starting) {
+                startRequest(request);
+            }
+            for (const auto& entry : revalidations) {
+                startRevalidation(entry);
+            }
+            
+            // Advance the fetches in flight. With nothing new to start, wait
+            // a little for their sockets; new requests are picked up after.
+            m_httpClient.processPendingRequests(starting.empty() && revalidations.empty() ? kSocketPollMs : 0);
+            m_dnsResolver->processPendingResolutions();
+        }
+    }
+    
+    // Serve a request from the cache, or send it on the loader's client
+    void startRequest(const std::shared_ptr<ResourceRequest>& request) {
+        // Check cache first
+        CacheEntry cacheEntry;
+        bool stale = false;
+        if (cacheGet(request->url(), cacheEntry)) {
+            // Check if expired
+            if (cacheEntry.isExpired()) {
+                // Within stale-while-revalidate, answer now and refresh later
+                if (cacheEntry.canServeStale() && revalidateInBackground(cacheEntry)) {
+                    finishRequest(request, true, cacheEntry.sharedData(), cacheEntry.metadata().headers, "");
+                    return;
+                }
+                
+                // If entry can be validated, add validation headers
+                if (cacheEntry.canBeValidated()) {
+                    // Asynchronously validate
+                    HttpRequest httpRequest(HttpMethod::GET, request->parsedUrl());
+                    
+                    // Add validation headers
+                    std::map<std::string, std::string> validationHeaders = cacheEntry.getValidationHeaders();
+                    for (const auto& header : validationHeaders) {
+                        httpRequest.setHeader(header.first, header.second);
                     }
-                } else {
-                    // Not found in cache, fetch
-                    m_httpClient.getAsync(request->url(), [this, request](const HttpResponse& response, const std::string& error) {
+                    
+                    // Send request asynchronously
+                    m_httpClient.sendRequestAsync(httpRequest, [this, request, cacheEntry](const HttpResponse& response, const std::string& error) mutable {
+                        if (response.statusCode() == 304) {
+                            cacheEntry.refresh(response.headers());
+                            cachePut(cacheEntry);
+                        }
                         if (response.statusCode() == 200) {
-                            // Cache response
-                            CacheEntry entry(request->url(), response.body(), response.headers());
-                            m_cache.put(entry);
+                            // Resource modified, update cache
+                            CacheEntry newEntry(request->url(), response.sharedBody(), response.headers());
+                            cachePut(newEntry);
                             
-                            request->notifyCompletion(response.body(), response.headers());
+                            finishRequest(request, true, response.sharedBody(), response.headers(), "");
+                        } else {
+                            // Not modified, or the request failed: use the cache entry
+                            finishRequest(request, true, cacheEntry.sharedData(), cacheEntry.metadata().headers, "");
                         }
-                        
-                        request->setComplete(true);
                     });
+                    return;
                 }
+                
+                // Refetch without validation, below
+                stale = true;
+            } else {
+                // Cache entry valid, use cache
+                finishRequest(request, true, cacheEntry.sharedData(), cacheEntry.metadata().headers, "");
+                return;
             }
-            
-            // Process any pending requests
-            m_httpClient.processPendingRequests();
-            m_dnsResolver.processPendingResolutions();
         }
+        
+        // Not found in cache, fetch
+        m_httpClient.getAsync(request->url(), [this, request, stale, cacheEntry](const HttpResponse& response, const std::string& error) {
+            if (response.statusCode() == 200) {
+                // Cache response
+                CacheEntry entry(request->url(), response.sharedBody(), response.headers());
+                cachePut(entry);
+                
+                finishRequest(request, true, response.sharedBody(), response.headers(), "");
+            } else if (stale && canUseStaleOnError(cacheEntry, response, error)) {
+                finishRequest(request, true, cacheEntry.sharedData(), cacheEntry.metadata().headers, "");
+            } else if (!error.empty()) {
+                finishRequest(request, false, response.sharedBody(), response.headers(), error);
+            } else {
+                finishRequest(request, false, response.sharedBody(), response.headers(),
+                              "HTTP request failed: " + std::to_string(response.statusCode()) + " " + response.statusText());
+            }
+        });
+    }
+    
+    // Whether a failed refetch of an expired entry can fall back on it:
+    // within its stale-if-error window, when the server errs or can't be
+    // reached
+    static bool canUseStaleOnError(const CacheEntry& entry, const HttpResponse& response, const std::string& error) {
+        return entry.canServeStaleOnError() && (!error.empty() || response.statusCode() >= 500);
+    }
+    
+    // Have the loader thread refetch entry's URL, unless it already is.
+    // False if that can't happen: the loader isn't running, or serving
+    // stale entries is turned off.
+    bool revalidateInBackground(const CacheEntry& entry) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_isRunning || !m_staleWhileRevalidate) {
+            return false;
+        }
+        
+        if (m_revalidating.insert(entry.metadata().url).second) {
+            m_revalidations.push_back(entry);
+            m_condition.notify_one();
+        }
+        return true;
     }
     
+    // Send a background revalidation on the loader's client; the response
+    // only updates the cache. Runs on the loader thread.
+    void startRevalidation(const CacheEntry& entry) {
+        HttpRequest httpRequest(HttpMethod::GET, entry.metadata().url);
+        for (const auto& header : entry.getValidationHeaders()) {
+            httpRequest.setHeader(header.first, header.second);
+        }
+        
+        m_httpClient.sendRequestAsync(httpRequest, [this, stale = entry](const HttpResponse& response, const std::string& error) mutable {
+            if (response.statusCode() == 304) {
+                stale.refresh(response.headers());
+                cachePut(stale);
+            } else if (response.statusCode() == 200) {
+                cachePut(CacheEntry(stale.metadata().url, response.sharedBody(), response.headers()));
+            }
+            
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_revalidating.erase(stale.metadata().url);
+        });
+    }
+    
+    // How long the loader thread waits on the sockets of queued requests
+    // before checking for new ones
+    static constexpr int kSocketPollMs = 10;
+    
+    // Declared before the clients that give connections back to it
+    std::shared_ptr<ConnectionPool> m_connectionPool;
+    std::shared_ptr<DnsResolver> m_dnsResolver;
+    std::shared_ptr<TlsContext> m_tlsContext;
+    
+    // Runs queued requests concurrently on the loader thread
     HttpClient m_httpClient;
-    DnsResolver m_dnsResolver;
     Cache m_cache;
     
     std::thread m_thread;
     std::atomic<bool> m_isRunning;
+    
+    // Queued requests and loads in flight by URL, guarded by m_mutex
     std::mutex m_mutex;
     std::condition_variable m_condition;
-    std::queue<std::shared_ptr<ResourceRequest>> m_requestQueue;
+    RequestScheduler m_scheduler;
+    std::map<std::string, std::shared_ptr<Flight>> m_flights;
+    std::condition_variable m_flightDone;
+    
+    // Background revalidations due to start, and the URLs being
+    // revalidated; guarded by m_mutex
+    bool m_staleWhileRevalidate;
+    std::vector<CacheEntry> m_revalidations;
+    std::set<std::string> m_revalidating;
+    
+    // Cache, guarded by m_cacheMutex
+    std::mutex m_cacheMutex;
+    
+    // Workers running fetch() callbacks, and the callbacks due
+    size_t m_fetchWorkerCount;
+    std::vector<std::thread> m_fetchWorkers;
+    std::mutex m_fetchMutex;
+    std::condition_variable m_fetchCondition;
+    std::queue<std::function<void()>> m_fetchQueue;
 };
 
 } // namespace networking
-} // namespace browser
\ No newline at end of file
+} // namespace browser
+
+#endif // BROWSER_RESOURCE_LOADER_H
@@ -0,0 +1,122 @@
+#ifndef BROWSER_RESOURCE_REQUEST_H
+#define BROWSER_RESOURCE_REQUEST_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include "shared_bytes.h"
+#include "../security/url.h"
+
+namespace browser {
+namespace networking {
+
+// Resource type enum
+enum class ResourceType {
+    HTML,
+    CSS,
+    JAVASCRIPT,
+    IMAGE,
+    FONT,
+    OTHER
+};
+
+// Request priorities; higher ones start first
+enum ResourcePriority {
+    PRIORITY_LOWEST = 0,
+    PRIORITY_LOW = 1,
+    PRIORITY_MEDIUM = 2,
+    PRIORITY_HIGH = 3,
+    PRIORITY_HIGHEST = 4
+};
+
+// Where a type of resource starts out: what blocks rendering first, then
+// fonts, then images and the rest
+inline int defaultPriorityFor(ResourceType type) {
+    switch (type) {
+        case ResourceType::HTML:
+        case ResourceType::CSS:
+            return PRIORITY_HIGHEST;
+        case ResourceType::JAVASCRIPT:
+            return PRIORITY_HIGH;
+        case ResourceType::FONT:
+            return PRIORITY_MEDIUM;
+        case ResourceType::IMAGE:
+            return PRIORITY_LOW;
+        case ResourceType::OTHER:
+            break;
+    }
+    return PRIORITY_LOW;
+}
+
+// A fetched body, shared read-only by every request for its URL; never
+// null, and empty when the fetch failed
+using ResourceBody = SharedBytes;
+
+// Called with the outcome of a fetch, successful or not. Keep the body
+// pointer to hold on to the bytes without copying them.
+using FetchCallback = std::function<void(bool success, const ResourceBody& body,
+                                         const std::map<std::string, std::string>& headers,
+                                         const std::string& error)>;
+
+// Resource request class
+class ResourceRequest {
+public:
+    ResourceRequest(const std::string& url, ResourceType type)
+        : m_url(url)
+        , m_type(type)
+        , m_priority(defaultPriorityFor(type))
+        , m_isComplete(false)
+        , m_isCancelled(false)
+    {
+    }
+
+    // Getters
+    const std::string& url() const { return m_url.spec(); }
+    
+    // The URL and its origin, parsed once for the life of the request
+    const security::Url& parsedUrl() const { return m_url; }
+    ResourceType type() const { return m_type; }
+    int priority() const { return m_priority; }
+    bool isComplete() const { return m_isComplete; }
+    bool isCancelled() const { return m_isCancelled; }
+
+    // Setters. Once the request is queued, change its priority through
+    // ResourceLoader::setPriority so the queue is reordered.
+    void setPriority(int priority) { m_priority = priority; }
+    void setComplete(bool complete) { m_isComplete = complete; }
+    void setCancelled(bool cancelled) { m_isCancelled = cancelled; }
+
+    // Set completion callback; only called on success
+    void setCompletionCallback(std::function<void(const ResourceBody&, const std::map<std::string, std::string>&)> callback) {
+        m_completionCallback = callback;
+    }
+
+    // Call completion callback
+    void notifyCompletion(const ResourceBody& data, const std::map<std::string, std::string>& headers) {
+        if (m_completionCallback) {
+            m_completionCallback(data, headers);
+        }
+    }
+
+    // Set instead of a completion callback to hear about failures too
+    void setFetchCallback(FetchCallback callback) { m_fetchCallback = std::move(callback); }
+    const FetchCallback& fetchCallback() const { return m_fetchCallback; }
+
+private:
+    security::Url m_url;
+    ResourceType m_type;
+    std::atomic<int> m_priority;
+    std::atomic<bool> m_isComplete;
+    std::atomic<bool> m_isCancelled;
+    std::function<void(const ResourceBody&, const std::map<std::string, std::string>&)> m_completionCallback;
+    FetchCallback m_fetchCallback;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_RESOURCE_REQUEST_H
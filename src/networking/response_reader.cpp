@@ -0,0 +1,313 @@
+#include "response_reader.h"
+#include <algorithm>
+#include <cctype>
+
+namespace browser {
+namespace networking {
+
+// Heads and chunk-size or trailer lines longer than these are refused
+// rather than buffered without end
+static const size_t kMaxHeadSize = 256 * 1024;
+static const size_t kMaxLineSize = 8 * 1024;
+
+//-----------------------------------------------------------------------------
+// ResponseReader Implementation
+//-----------------------------------------------------------------------------
+
+ResponseReader::ResponseReader(HttpMethod method, HttpDataCallback onBody, bool bufferBody,
+                               HttpHeadersCallback onHeaders)
+    : m_method(method)
+    , m_onBody(std::move(onBody))
+    , m_onHeaders(std::move(onHeaders))
+    , m_bufferBody(bufferBody)
+    , m_streamBody(false)
+    , m_state(State::HEAD)
+    , m_remaining(0)
+    , m_keepAlive(false)
+    , m_bytesReceived(0)
+    , m_extraBytes(0)
+{
+}
+
+ResponseReader::~ResponseReader() {
+}
+
+bool ResponseReader::feed(const uint8_t* data, size_t length, std::string& error) {
+    m_bytesReceived += length;
+
+    while (length > 0) {
+        switch (m_state) {
+            case State::HEAD: {
+                // Look for the end of the head, allowing for a split separator
+                size_t searchFrom = m_head.size() >= 3 ? m_head.size() - 3 : 0;
+                size_t previousSize = m_head.size();
+                m_head.append(reinterpret_cast<const char*>(data), length);
+                size_t headEnd = m_head.find("\r\n\r\n", searchFrom);
+                if (headEnd == std::string::npos) {
+                    if (m_head.size() > kMaxHeadSize) {
+                        error = "Response headers too large";
+                        return false;
+                    }
+                    return true;
+                }
+
+                // What follows the head goes on to the body
+                size_t consumed = headEnd + 4 - previousSize;
+                data += consumed;
+                length -= consumed;
+                m_head.resize(headEnd + 4);
+                if (!parseHead(error)) {
+                    return false;
+                }
+                break;
+            }
+
+            case State::BODY_LENGTH: {
+                size_t take = std::min(length, m_remaining);
+                if (!deliver(data, take, error)) {
+                    return false;
+                }
+                data += take;
+                length -= take;
+                m_remaining -= take;
+                if (m_remaining == 0 && !finishBody(error)) {
+                    return false;
+                }
+                break;
+            }
+
+            case State::BODY_TO_EOF:
+                if (!deliver(data, length, error)) {
+                    return false;
+                }
+                length = 0;
+                break;
+
+            case State::CHUNK_SIZE:
+            case State::CHUNK_DATA:
+            case State::CHUNK_DATA_END:
+            case State::CHUNK_TRAILER:
+                if (!readChunked(data, length, error)) {
+                    return false;
+                }
+                break;
+
+            case State::DONE:
+                // Nothing asked for these; the connection can't be reused
+                m_extraBytes += length;
+                length = 0;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool ResponseReader::finishAtEof(std::string& error) {
+    if (m_state == State::HEAD) {
+        error = m_bytesReceived > 0 ? "Failed to parse response" : "Connection closed before a response";
+        return false;
+    }
+    if (m_state != State::DONE) {
+        // Ended by EOF, or cut short; either way the connection is gone and
+        // the body stays as far as it got
+        std::string ignored;
+        finishBody(ignored);
+        m_keepAlive = false;
+    }
+    return true;
+}
+
+bool ResponseReader::parseHead(std::string& error) {
+    HttpResponse response;
+    if (!response.parseHead(m_head)) {
+        error = "Failed to parse response";
+        return false;
+    }
+
+    // Interim responses such as 100 Continue come before the real one
+    int statusCode = response.statusCode();
+    if (statusCode >= 100 && statusCode < 200 && statusCode != 101) {
+        m_head.clear();
+        return true;
+    }
+
+    std::string lowerHead = m_head;
+    std::transform(lowerHead.begin(), lowerHead.end(), lowerHead.begin(), ::tolower);
+    m_head.clear();
+    m_head.shrink_to_fit();
+
+    // HTTP/1.1 connections persist unless either side says otherwise;
+    // HTTP/1.0 ones only when the server says so
+    std::string connection = response.getHeader("Connection");
+    std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+    if (lowerHead.compare(0, 8, "http/1.1") == 0) {
+        m_keepAlive = connection.find("close") == std::string::npos;
+    } else {
+        m_keepAlive = connection.find("keep-alive") != std::string::npos;
+    }
+
+    m_streamBody = m_onBody && statusCode >= 200 && statusCode < 300;
+
+    std::string transferEncoding = response.getHeader("Transfer-Encoding");
+    std::transform(transferEncoding.begin(), transferEncoding.end(), transferEncoding.begin(), ::tolower);
+    bool hasBody = m_method != HttpMethod::HEAD && statusCode != 204 && statusCode != 304;
+
+    // Undo the Content-Encoding as the body arrives; the body handed on is
+    // then no longer encoded
+    if (hasBody && response.hasHeader("Content-Encoding")) {
+        m_decoder = ContentDecoder::create(response.getHeader("Content-Encoding"));
+        if (m_decoder) {
+            response.removeHeader("Content-Encoding");
+        }
+    }
+    m_response = std::move(response);
+    if (m_onHeaders && statusCode >= 200 && statusCode < 300) {
+        m_onHeaders(m_response.headers());
+    }
+
+    // Framing: no body, chunks, a length, or whatever comes before EOF
+    if (!hasBody) {
+        return finishBody(error);
+    }
+    if (transferEncoding.find("chunked") != std::string::npos) {
+        m_state = State::CHUNK_SIZE;
+        return true;
+    }
+    if (transferEncoding.empty() && m_response.hasHeader("Content-Length")) {
+        try {
+            m_remaining = std::stoul(m_response.getHeader("Content-Length"));
+            m_state = State::BODY_LENGTH;
+            return m_remaining > 0 || finishBody(error);
+        }
+        catch (const std::exception&) {
+            // Read to the end of the connection instead
+        }
+    }
+    m_state = State::BODY_TO_EOF;
+    m_keepAlive = false;
+    return true;
+}
+
+bool ResponseReader::readChunked(const uint8_t*& data, size_t& length, std::string& error) {
+    switch (m_state) {
+        case State::CHUNK_SIZE: {
+            if (!readLine(data, length, error)) {
+                return error.empty();
+            }
+
+            // Chunk size in hex, maybe followed by extensions
+            size_t chunkSize;
+            try {
+                chunkSize = std::stoul(m_line, nullptr, 16);
+            }
+            catch (const std::exception&) {
+                error = "Malformed chunk size";
+                return false;
+            }
+            m_line.clear();
+
+            m_remaining = chunkSize;
+            m_state = chunkSize > 0 ? State::CHUNK_DATA : State::CHUNK_TRAILER;
+            return true;
+        }
+
+        case State::CHUNK_DATA: {
+            size_t take = std::min(length, m_remaining);
+            if (!deliver(data, take, error)) {
+                return false;
+            }
+            data += take;
+            length -= take;
+            m_remaining -= take;
+            if (m_remaining == 0) {
+                m_state = State::CHUNK_DATA_END;
+            }
+            return true;
+        }
+
+        case State::CHUNK_DATA_END:
+            if (!readLine(data, length, error)) {
+                return error.empty();
+            }
+            if (!m_line.empty()) {
+                error = "Malformed chunk";
+                return false;
+            }
+            m_state = State::CHUNK_SIZE;
+            return true;
+
+        case State::CHUNK_TRAILER:
+            // Trailer fields are skipped; an empty line ends the message
+            if (!readLine(data, length, error)) {
+                return error.empty();
+            }
+            if (m_line.empty()) {
+                return finishBody(error);
+            }
+            m_line.clear();
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+bool ResponseReader::readLine(const uint8_t*& data, size_t& length, std::string& error) {
+    const uint8_t* newline = std::find(data, data + length, static_cast<uint8_t>('\n'));
+    size_t take = static_cast<size_t>(newline - data);
+    m_line.append(reinterpret_cast<const char*>(data), take);
+
+    if (newline == data + length) {
+        data += length;
+        length = 0;
+        if (m_line.size() > kMaxLineSize) {
+            error = "Chunk line too long";
+        }
+        return false;
+    }
+
+    data += take + 1;
+    length -= take + 1;
+    if (!m_line.empty() && m_line.back() == '\r') {
+        m_line.pop_back();
+    }
+    return true;
+}
+
+bool ResponseReader::deliver(const uint8_t* data, size_t length, std::string& error) {
+    if (length == 0) {
+        return true;
+    }
+    if (!m_decoder) {
+        emit(data, length);
+        return true;
+    }
+    if (!m_decoder->decode(data, length, [this](const uint8_t* bytes, size_t count) { emit(bytes, count); })) {
+        error = "Failed to decode response body";
+        return false;
+    }
+    return true;
+}
+
+bool ResponseReader::finishBody(std::string& error) {
+    m_state = State::DONE;
+    m_line.clear();
+    if (m_decoder && !m_decoder->finish()) {
+        error = "Response body ended partway through its encoding";
+        return false;
+    }
+    return true;
+}
+
+void ResponseReader::emit(const uint8_t* data, size_t length) {
+    if (m_streamBody) {
+        m_onBody(data, length);
+    }
+    if (m_bufferBody) {
+        m_response.appendToBody(data, length);
+    }
+}
+
+} // namespace networking
+} // namespace browser
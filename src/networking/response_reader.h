@@ -0,0 +1,94 @@
+#ifndef BROWSER_RESPONSE_READER_H
+#define BROWSER_RESPONSE_READER_H
+
+#include "http_client.h"
+#include "content_decoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace browser {
+namespace networking {
+
+// Reads one HTTP response off a connection as its bytes arrive. It parses
+// the status line and headers, follows the body's framing (none,
+// Content-Length, chunked, or up to EOF) and undoes its Content-Encoding,
+// handing the decoded body to a callback piece by piece. Only the headers
+// and a partial chunk-size line are ever held back, so without a buffered
+// body the memory a response takes doesn't grow with its size.
+class ResponseReader {
+public:
+    // onBody gets the decoded body of 2xx responses, and onHeaders their
+    // headers first. bufferBody keeps the body in response() as well.
+    explicit ResponseReader(HttpMethod method, HttpDataCallback onBody = nullptr,
+                            bool bufferBody = true, HttpHeadersCallback onHeaders = nullptr);
+    ~ResponseReader();
+
+    ResponseReader(const ResponseReader&) = delete;
+    ResponseReader& operator=(const ResponseReader&) = delete;
+
+    // Take the next bytes read from the connection. False if the response
+    // is malformed or its body can't be decoded; error says why.
+    bool feed(const uint8_t* data, size_t length, std::string& error);
+
+    // The connection closed. That ends a body framed by EOF; a body cut
+    // short elsewhere is kept as far as it got. False if no complete head
+    // arrived.
+    bool finishAtEof(std::string& error);
+
+    bool headersDone() const { return m_state != State::HEAD; }
+    bool complete() const { return m_state == State::DONE; }
+    bool receivedAny() const { return m_bytesReceived > 0; }
+
+    // Whether the connection can carry another request: the response is
+    // complete, nothing followed it, and the server keeps it open
+    bool connectionReusable() const { return complete() && m_keepAlive && m_extraBytes == 0; }
+
+    HttpResponse& response() { return m_response; }
+
+private:
+    enum class State {
+        HEAD,
+        BODY_LENGTH,        // m_remaining bytes to go
+        BODY_TO_EOF,
+        CHUNK_SIZE,
+        CHUNK_DATA,         // m_remaining bytes of the chunk to go
+        CHUNK_DATA_END,     // The CRLF after a chunk
+        CHUNK_TRAILER,
+        DONE
+    };
+
+    bool parseHead(std::string& error);
+    bool readChunked(const uint8_t*& data, size_t& length, std::string& error);
+
+    // Consume bytes up to the end of a line; true once m_line holds it
+    bool readLine(const uint8_t*& data, size_t& length, std::string& error);
+
+    // Framed body bytes, and the end of the body
+    bool deliver(const uint8_t* data, size_t length, std::string& error);
+    bool finishBody(std::string& error);
+    void emit(const uint8_t* data, size_t length);
+
+    HttpMethod m_method;
+    HttpDataCallback m_onBody;
+    HttpHeadersCallback m_onHeaders;
+    bool m_bufferBody;
+    bool m_streamBody;
+
+    State m_state;
+    std::string m_head;
+    std::string m_line;
+    size_t m_remaining;
+    std::unique_ptr<ContentDecoder> m_decoder;
+    bool m_keepAlive;
+
+    size_t m_bytesReceived;
+    size_t m_extraBytes;
+    HttpResponse m_response;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_RESPONSE_READER_H
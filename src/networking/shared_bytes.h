@@ -0,0 +1,25 @@
+#ifndef BROWSER_SHARED_BYTES_H
+#define BROWSER_SHARED_BYTES_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace browser {
+namespace networking {
+
+// Immutable bytes shared without copying: a response body is received
+// into one buffer, which the response, the cache, waiting requests and a
+// parser then all hold
+using SharedBytes = std::shared_ptr<const std::vector<uint8_t>>;
+
+// An empty buffer, shared
+inline const SharedBytes& emptySharedBytes() {
+    static const SharedBytes bytes = std::make_shared<const std::vector<uint8_t>>();
+    return bytes;
+}
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_SHARED_BYTES_H
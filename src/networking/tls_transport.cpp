@@ -0,0 +1,663 @@
+#include "tls_transport.h"
+#include "../security/certificate_validator.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#ifndef _WIN32
+#include <cerrno>
+#endif
+
+#ifdef BROWSER_HAVE_OPENSSL
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+namespace browser {
+namespace networking {
+
+#ifdef BROWSER_HAVE_OPENSSL
+
+//-----------------------------------------------------------------------------
+// Helper Functions
+//-----------------------------------------------------------------------------
+
+// The last socket call failed only because it would have blocked
+static bool socketWouldBlock() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+// OpenSSL's own socket BIO writes with write(), which raises SIGPIPE when
+// the server has gone; this one sends like the rest of the client does
+static socket_t bioSocket(BIO* bio) {
+    return static_cast<socket_t>(reinterpret_cast<intptr_t>(BIO_get_data(bio)));
+}
+
+static int socketBioWrite(BIO* bio, const char* data, int length) {
+    BIO_clear_retry_flags(bio);
+    int sent = send(bioSocket(bio), data, length, kSendFlags);
+    if (sent == SOCKET_ERROR && socketWouldBlock()) {
+        BIO_set_retry_write(bio);
+    }
+    return sent;
+}
+
+static int socketBioRead(BIO* bio, char* buffer, int size) {
+    BIO_clear_retry_flags(bio);
+    int received = recv(bioSocket(bio), buffer, size, 0);
+    if (received == SOCKET_ERROR && socketWouldBlock()) {
+        BIO_set_retry_read(bio);
+    }
+    return received;
+}
+
+static long socketBioCtrl(BIO*, int command, long, void*) {
+    return command == BIO_CTRL_FLUSH ? 1 : 0;
+}
+
+static int socketBioCreate(BIO* bio) {
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+static BIO_METHOD* socketBioMethod() {
+    static BIO_METHOD* method = [] {
+        BIO_METHOD* created = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "browser socket");
+        BIO_meth_set_write(created, socketBioWrite);
+        BIO_meth_set_read(created, socketBioRead);
+        BIO_meth_set_ctrl(created, socketBioCtrl);
+        BIO_meth_set_create(created, socketBioCreate);
+        return created;
+    }();
+    return method;
+}
+
+// The errors OpenSSL queued, after what failed
+static std::string sslError(const std::string& what) {
+    std::string error = what;
+    char buffer[256];
+    while (unsigned long code = ERR_get_error()) {
+        ERR_error_string_n(code, buffer, sizeof(buffer));
+        error += error.size() == what.size() ? ": " : "; ";
+        error += buffer;
+    }
+    return error;
+}
+
+static bool isIpAddress(const std::string& host) {
+    unsigned char address[16];
+    return inet_pton(AF_INET, host.c_str(), address) == 1 || inet_pton(AF_INET6, host.c_str(), address) == 1;
+}
+
+// A certificate in the "Label: value" form security::Certificate reads
+static std::string describeCertificate(X509* certificate) {
+    auto nameString = [](const X509_NAME* name) {
+        std::string text;
+        BIO* bio = BIO_new(BIO_s_mem());
+        if (bio && X509_NAME_print_ex(bio, name, 0, XN_FLAG_RFC2253 & ~ASN1_STRFLGS_ESC_MSB) >= 0) {
+            char* data = nullptr;
+            long length = BIO_get_mem_data(bio, &data);
+            text.assign(data, length);
+        }
+        BIO_free(bio);
+        return text;
+    };
+    auto timeString = [](const ASN1_TIME* time) {
+        struct tm parts = {};
+        char text[64] = "";
+        if (time && ASN1_TIME_to_tm(time, &parts) == 1 &&
+            std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &parts) == 0) {
+            text[0] = '\0';
+        }
+        return std::string(text);
+    };
+    auto hex = [](const unsigned char* data, size_t length) {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string text;
+        for (size_t i = 0; i < length; i++) {
+            text += digits[data[i] >> 4];
+            text += digits[data[i] & 0xf];
+        }
+        return text;
+    };
+
+    std::string text;
+    text += "Subject: " + nameString(X509_get_subject_name(certificate)) + "\n";
+    text += "Issuer: " + nameString(X509_get_issuer_name(certificate)) + "\n";
+
+    const ASN1_INTEGER* serial = X509_get0_serialNumber(certificate);
+    text += "Serial Number: " + hex(ASN1_STRING_get0_data(serial), ASN1_STRING_length(serial)) + "\n";
+    text += "Not Before: " + timeString(X509_get0_notBefore(certificate)) + "\n";
+    text += "Not After: " + timeString(X509_get0_notAfter(certificate)) + "\n";
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digestLength = 0;
+    if (X509_pubkey_digest(certificate, EVP_sha256(), digest, &digestLength) == 1) {
+        text += "Public Key: " + hex(digest, digestLength) + "\n";
+    }
+
+    auto* names = static_cast<GENERAL_NAMES*>(X509_get_ext_d2i(certificate, NID_subject_alt_name, nullptr, nullptr));
+    if (names) {
+        std::string altNames;
+        for (int i = 0; i < sk_GENERAL_NAME_num(names); i++) {
+            const GENERAL_NAME* name = sk_GENERAL_NAME_value(names, i);
+            if (name->type == GEN_DNS) {
+                const ASN1_STRING* dns = name->d.dNSName;
+                altNames += altNames.empty() ? "DNS:" : ", DNS:";
+                altNames.append(reinterpret_cast<const char*>(ASN1_STRING_get0_data(dns)), ASN1_STRING_length(dns));
+            }
+        }
+        GENERAL_NAMES_free(names);
+        if (!altNames.empty()) {
+            text += "Subject Alternative Name: " + altNames + "\n";
+        }
+    }
+    return text;
+}
+
+static const char* verificationResultName(security::CertificateVerificationResult result) {
+    using Result = security::CertificateVerificationResult;
+    switch (result) {
+        case Result::VALID: return "valid";
+        case Result::EXPIRED: return "expired";
+        case Result::REVOKED: return "revoked";
+        case Result::UNTRUSTED_ROOT: return "untrusted root";
+        case Result::INVALID_SIGNATURE: return "invalid signature";
+        case Result::NAME_MISMATCH: return "name mismatch";
+        case Result::SELF_SIGNED: return "self-signed";
+        case Result::OTHER_ERROR: break;
+    }
+    return "invalid";
+}
+
+//-----------------------------------------------------------------------------
+// TlsStream Implementation
+//-----------------------------------------------------------------------------
+
+TlsStream::TlsStream(TlsContext& context, ssl_st* ssl, const std::string& host, const std::string& origin)
+    : m_context(context)
+    , m_ssl(ssl)
+    , m_host(host)
+    , m_origin(origin)
+    , m_earlyData(nullptr)
+    , m_earlyDataLength(0)
+    , m_earlyDataSent(0)
+    , m_offeredEarlyData(false)
+    , m_handshakeDone(false)
+    , m_earlyDataAccepted(false)
+    , m_failed(false)
+    , m_startedUs(tracing::Tracer::now())
+{
+}
+
+TlsStream::~TlsStream() {
+    // Connections are closed without close_notify, which OpenSSL takes to
+    // mean the session is bad, unless told it was shut down
+    if (m_handshakeDone && !m_failed) {
+        SSL_set_shutdown(m_ssl, SSL_SENT_SHUTDOWN);
+    }
+    SSL_free(m_ssl);
+}
+
+void TlsStream::setEarlyData(const uint8_t* data, size_t length) {
+    if (m_handshakeDone || m_offeredEarlyData) {
+        return;
+    }
+    m_earlyData = data;
+    m_earlyDataLength = length;
+}
+
+bool TlsStream::resumed() const {
+    return SSL_session_reused(m_ssl) == 1;
+}
+
+TlsResult TlsStream::handshake(std::string& error) {
+    if (m_handshakeDone) {
+        return TlsResult::DONE;
+    }
+    ERR_clear_error();
+
+    // Early data goes out with the ClientHello, if the session being
+    // resumed allows that much of it
+    if (m_earlyData && !m_offeredEarlyData) {
+        SSL_SESSION* session = SSL_get_session(m_ssl);
+        if (!m_context.earlyDataEnabled() || !session ||
+            SSL_SESSION_get_max_early_data(session) < m_earlyDataLength) {
+            m_earlyData = nullptr;
+        }
+    }
+    while (m_earlyData && m_earlyDataSent < m_earlyDataLength) {
+        m_offeredEarlyData = true;
+        size_t written = 0;
+        if (SSL_write_early_data(m_ssl, m_earlyData + m_earlyDataSent, m_earlyDataLength - m_earlyDataSent,
+                                 &written) != 1) {
+            TlsResult result = resultFor(0, error, "TLS handshake failed");
+            if (result == TlsResult::FAILED || result == TlsResult::CLOSED) {
+                m_context.recordFailure();
+            }
+            return result;
+        }
+        m_earlyDataSent += written;
+    }
+
+    int ret = SSL_do_handshake(m_ssl);
+    if (ret != 1) {
+        TlsResult result = resultFor(ret, error, "TLS handshake failed");
+        if (result == TlsResult::CLOSED) {
+            error = "TLS handshake failed: connection closed";
+            result = TlsResult::FAILED;
+        }
+        if (result == TlsResult::FAILED) {
+            m_context.recordFailure();
+        }
+        return result;
+    }
+
+    // A resumed session was verified when it was new
+    if (!resumed() && m_context.m_validator && !verifyWithValidator(error)) {
+        m_context.recordFailure();
+        return TlsResult::FAILED;
+    }
+
+    finishHandshake();
+    return TlsResult::DONE;
+}
+
+void TlsStream::finishHandshake() {
+    m_handshakeDone = true;
+    m_earlyDataAccepted = m_offeredEarlyData && SSL_get_early_data_status(m_ssl) == SSL_EARLY_DATA_ACCEPTED;
+    m_earlyData = nullptr;
+
+    uint64_t durationUs = tracing::Tracer::now() - m_startedUs;
+    m_context.recordHandshake(resumed(), m_offeredEarlyData, m_earlyDataAccepted, durationUs);
+
+#ifndef BROWSER_DISABLE_TRACING
+    if (tracing::Tracer::isEnabled()) {
+        tracing::Tracer::instance().recordDuration("net", resumed() ? "TlsHandshake (resumed)" : "TlsHandshake",
+                                                   m_startedUs, durationUs,
+                                                   tracing::Tracer::mode() == tracing::TraceMode::FULL ? m_host
+                                                                                                        : std::string());
+    }
+#endif
+}
+
+bool TlsStream::verifyWithValidator(std::string& error) {
+    // The chain OpenSSL verified, from the server's certificate up to the
+    // trusted root it found
+    STACK_OF(X509)* verified = SSL_get0_verified_chain(m_ssl);
+    if (!verified || sk_X509_num(verified) == 0) {
+        error = "TLS handshake failed: no verified certificate chain";
+        return false;
+    }
+
+    security::CertificateChain chain;
+    for (int i = 0; i < sk_X509_num(verified); i++) {
+        chain.addCertificate(std::make_shared<security::Certificate>(describeCertificate(sk_X509_value(verified, i)),
+                                                                     security::CertificateType::X509));
+    }
+
+    // The chain ends at a root OpenSSL trusts; the validator's own roots
+    // only add to those
+    security::CertificateVerificationResult result = m_context.m_validator->verify(chain, m_host);
+    if (result != security::CertificateVerificationResult::VALID &&
+        result != security::CertificateVerificationResult::UNTRUSTED_ROOT) {
+        error = std::string("Certificate for ") + m_host + " rejected: " + verificationResultName(result);
+        return false;
+    }
+    return true;
+}
+
+TlsResult TlsStream::write(const uint8_t* data, size_t length, size_t& written, std::string& error) {
+    written = 0;
+    ERR_clear_error();
+    if (SSL_write_ex(m_ssl, data, length, &written) == 1) {
+        return TlsResult::DONE;
+    }
+    return resultFor(0, error, "Failed to send data");
+}
+
+TlsResult TlsStream::read(uint8_t* buffer, size_t size, size_t& bytesRead, std::string& error) {
+    bytesRead = 0;
+    ERR_clear_error();
+    if (SSL_read_ex(m_ssl, buffer, size, &bytesRead) == 1) {
+        return TlsResult::DONE;
+    }
+    return resultFor(0, error, "Failed to receive data");
+}
+
+TlsResult TlsStream::resultFor(int ret, std::string& error, const char* what) {
+    switch (SSL_get_error(m_ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            return TlsResult::WANT_READ;
+        case SSL_ERROR_WANT_WRITE:
+            return TlsResult::WANT_WRITE;
+        case SSL_ERROR_ZERO_RETURN:
+            return TlsResult::CLOSED;
+        default:
+            break;
+    }
+
+    m_failed = true;
+    error = sslError(what);
+    long verifyResult = SSL_get_verify_result(m_ssl);
+    if (verifyResult != X509_V_OK) {
+        error += std::string(" (") + X509_verify_cert_error_string(verifyResult) + ")";
+    }
+    return TlsResult::FAILED;
+}
+
+//-----------------------------------------------------------------------------
+// TlsContext Implementation
+//-----------------------------------------------------------------------------
+
+TlsContext::TlsContext()
+    : m_context(nullptr)
+    , m_validator(nullptr)
+    , m_earlyDataEnabled(true)
+{
+    m_context = SSL_CTX_new(TLS_client_method());
+    if (!m_context) {
+        m_initError = sslError("Failed to create TLS context");
+        return;
+    }
+
+    SSL_CTX_set_min_proto_version(m_context, TLS1_2_VERSION);
+    SSL_CTX_set_verify(m_context, SSL_VERIFY_PEER, nullptr);
+    SSL_CTX_set_default_verify_paths(m_context);
+    SSL_CTX_set_mode(m_context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // Servers often close without close_notify; the response's framing
+    // says whether it was cut short
+    SSL_CTX_set_options(m_context, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+    // Only HTTP/1.1 is spoken; resumed sessions must agree on it for early
+    // data to be accepted
+    static const unsigned char alpn[] = "\x08http/1.1";
+    SSL_CTX_set_alpn_protos(m_context, alpn, sizeof(alpn) - 1);
+
+    // Sessions are kept here, per origin, rather than in OpenSSL's cache;
+    // TLS 1.3 sends them after the handshake
+    SSL_CTX_set_session_cache_mode(m_context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(m_context, onNewSession);
+}
+
+TlsContext::~TlsContext() {
+    clearSessions();
+    SSL_CTX_free(m_context);
+}
+
+bool TlsContext::supported() {
+    return true;
+}
+
+bool TlsContext::addTrustedCertificates(const std::string& pemFile, std::string& error) {
+    if (!m_context) {
+        error = m_initError;
+        return false;
+    }
+    ERR_clear_error();
+    if (SSL_CTX_load_verify_locations(m_context, pemFile.c_str(), nullptr) != 1) {
+        error = sslError("Failed to load certificates from " + pemFile);
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<TlsStream> TlsContext::createStream(socket_t socket, const std::string& host,
+                                                    const std::string& origin, std::string& error) {
+    if (!m_context) {
+        error = m_initError;
+        return nullptr;
+    }
+    ERR_clear_error();
+
+    SSL* ssl = SSL_new(m_context);
+    BIO* bio = ssl ? BIO_new(socketBioMethod()) : nullptr;
+    if (!bio) {
+        SSL_free(ssl);
+        error = sslError("Failed to set up TLS");
+        return nullptr;
+    }
+    BIO_set_data(bio, reinterpret_cast<void*>(static_cast<intptr_t>(socket)));
+    SSL_set_bio(ssl, bio, bio);
+    SSL_set_connect_state(ssl);
+
+    // The certificate must name the host; names also go in the ClientHello
+    // (SNI), addresses don't
+    std::string name = host;
+    if (name.size() > 2 && name.front() == '[' && name.back() == ']') {
+        name = name.substr(1, name.size() - 2);
+    }
+    bool named = isIpAddress(name) ? X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), name.c_str()) == 1
+                                   : SSL_set_tlsext_host_name(ssl, name.c_str()) == 1 &&
+                                     SSL_set1_host(ssl, name.c_str()) == 1;
+    if (!named) {
+        SSL_free(ssl);
+        error = sslError("Invalid TLS host name " + host);
+        return nullptr;
+    }
+
+    std::unique_ptr<TlsStream> stream(new TlsStream(*this, ssl, name, origin));
+    SSL_set_app_data(ssl, stream.get());
+
+    if (SSL_SESSION* session = takeSession(origin)) {
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+    return stream;
+}
+
+void TlsContext::clearSessions() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (!m_sessions.empty()) {
+        eraseSessionsLocked(m_sessions.begin());
+    }
+}
+
+size_t TlsContext::sessionCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    for (const auto& origin : m_sessions) {
+        count += origin.second.sessions.size();
+    }
+    return count;
+}
+
+TlsStats TlsContext::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+int TlsContext::onNewSession(ssl_st* ssl, ssl_session_st* session) {
+    // Arrives while the stream is reading or handshaking
+    auto* stream = static_cast<TlsStream*>(SSL_get_app_data(ssl));
+    if (!stream || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+    stream->m_context.storeSession(stream->m_origin, session);
+    return 1;
+}
+
+void TlsContext::storeSession(const std::string& origin, ssl_session_st* session) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The origin becomes the most recently stored; the least recently
+    // stored one goes when there are too many
+    auto it = m_sessions.find(origin);
+    if (it == m_sessions.end()) {
+        if (m_sessions.size() >= kMaxSessionOrigins) {
+            eraseSessionsLocked(m_sessions.find(m_sessionOrder.front()));
+        }
+        it = m_sessions.emplace(origin, OriginSessions()).first;
+        it->second.order = m_sessionOrder.insert(m_sessionOrder.end(), origin);
+    } else {
+        m_sessionOrder.splice(m_sessionOrder.end(), m_sessionOrder, it->second.order);
+    }
+
+    std::vector<ssl_session_st*>& sessions = it->second.sessions;
+    sessions.push_back(session);
+    if (sessions.size() > kMaxSessionsPerOrigin) {
+        SSL_SESSION_free(sessions.front());
+        sessions.erase(sessions.begin());
+    }
+}
+
+ssl_session_st* TlsContext::takeSession(const std::string& origin) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_sessions.find(origin);
+    if (it == m_sessions.end()) {
+        return nullptr;
+    }
+
+    // Newest first; ones past their lifetime are dropped on the way
+    std::vector<ssl_session_st*>& sessions = it->second.sessions;
+    SSL_SESSION* session = nullptr;
+    long now = static_cast<long>(std::time(nullptr));
+    while (!session && !sessions.empty()) {
+        SSL_SESSION* candidate = sessions.back();
+        if (now >= SSL_SESSION_get_time(candidate) + SSL_SESSION_get_timeout(candidate)) {
+            SSL_SESSION_free(candidate);
+            sessions.pop_back();
+            continue;
+        }
+
+        // TLS 1.3 tickets are used once (RFC 8446 C.4); earlier versions'
+        // sessions can be resumed by several connections
+        if (SSL_SESSION_get_protocol_version(candidate) >= TLS1_3_VERSION) {
+            sessions.pop_back();
+        } else {
+            SSL_SESSION_up_ref(candidate);
+        }
+        session = candidate;
+    }
+
+    if (sessions.empty()) {
+        eraseSessionsLocked(it);
+    }
+    return session;
+}
+
+void TlsContext::eraseSessionsLocked(std::map<std::string, OriginSessions>::iterator it) {
+    for (SSL_SESSION* session : it->second.sessions) {
+        SSL_SESSION_free(session);
+    }
+    m_sessionOrder.erase(it->second.order);
+    m_sessions.erase(it);
+}
+
+void TlsContext::recordHandshake(bool resumed, bool offeredEarlyData, bool earlyDataAccepted, uint64_t durationUs) {
+    TlsStats stats;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (resumed) {
+            ++m_stats.resumedHandshakes;
+            m_stats.resumedHandshakeUs += durationUs;
+        } else {
+            ++m_stats.fullHandshakes;
+            m_stats.fullHandshakeUs += durationUs;
+        }
+        if (offeredEarlyData) {
+            ++(earlyDataAccepted ? m_stats.earlyDataAccepted : m_stats.earlyDataRejected);
+        }
+        stats = m_stats;
+    }
+    TRACE_COUNTER("net", "tlsFullHandshakes", static_cast<int64_t>(stats.fullHandshakes));
+    TRACE_COUNTER("net", "tlsResumedHandshakes", static_cast<int64_t>(stats.resumedHandshakes));
+    TRACE_COUNTER("net", "tlsEarlyDataAccepted", static_cast<int64_t>(stats.earlyDataAccepted));
+}
+
+void TlsContext::recordFailure() {
+    size_t failed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        failed = ++m_stats.failedHandshakes;
+    }
+    TRACE_COUNTER("net", "tlsFailedHandshakes", static_cast<int64_t>(failed));
+}
+
+#else // BROWSER_HAVE_OPENSSL
+
+//-----------------------------------------------------------------------------
+// Without OpenSSL: no stream is ever created
+//-----------------------------------------------------------------------------
+
+TlsStream::~TlsStream() {
+}
+
+void TlsStream::setEarlyData(const uint8_t*, size_t) {
+}
+
+bool TlsStream::resumed() const {
+    return false;
+}
+
+TlsResult TlsStream::handshake(std::string& error) {
+    error = "HTTPS is not supported in this build";
+    return TlsResult::FAILED;
+}
+
+TlsResult TlsStream::write(const uint8_t*, size_t, size_t& written, std::string& error) {
+    written = 0;
+    return handshake(error);
+}
+
+TlsResult TlsStream::read(uint8_t*, size_t, size_t& bytesRead, std::string& error) {
+    bytesRead = 0;
+    return handshake(error);
+}
+
+TlsContext::TlsContext()
+    : m_context(nullptr)
+    , m_initError("HTTPS is not supported in this build")
+    , m_validator(nullptr)
+    , m_earlyDataEnabled(false)
+{
+}
+
+TlsContext::~TlsContext() {
+}
+
+bool TlsContext::supported() {
+    return false;
+}
+
+bool TlsContext::addTrustedCertificates(const std::string&, std::string& error) {
+    error = m_initError;
+    return false;
+}
+
+std::unique_ptr<TlsStream> TlsContext::createStream(socket_t, const std::string&, const std::string&,
+                                                    std::string& error) {
+    error = m_initError;
+    return nullptr;
+}
+
+void TlsContext::clearSessions() {
+}
+
+size_t TlsContext::sessionCount() const {
+    return 0;
+}
+
+TlsStats TlsContext::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+#endif // BROWSER_HAVE_OPENSSL
+
+} // namespace networking
+} // namespace browser
@@ -0,0 +1,172 @@
+#ifndef BROWSER_TLS_TRANSPORT_H
+#define BROWSER_TLS_TRANSPORT_H
+
+#include "http_client.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// OpenSSL's types, kept out of the header
+struct ssl_ctx_st;
+struct ssl_st;
+struct ssl_session_st;
+
+namespace browser {
+namespace security {
+class CertificateValidator;
+}
+
+namespace networking {
+
+// What a TLS operation on a non-blocking socket came to
+enum class TlsResult {
+    DONE,
+    WANT_READ,          // Call again once the socket is readable
+    WANT_WRITE,         // Call again once the socket is writable
+    CLOSED,             // The peer closed the connection
+    FAILED
+};
+
+// Handshakes since the context was created
+struct TlsStats {
+    size_t fullHandshakes = 0;
+    size_t resumedHandshakes = 0;
+    size_t failedHandshakes = 0;
+    size_t earlyDataAccepted = 0;
+    size_t earlyDataRejected = 0;
+    uint64_t fullHandshakeUs = 0;       // Total time spent in each kind
+    uint64_t resumedHandshakeUs = 0;
+};
+
+class TlsContext;
+
+// TLS over one connected socket, blocking or not. Created by TlsContext;
+// kept with its socket in the connection pool between requests.
+class TlsStream {
+public:
+    ~TlsStream();
+
+    TlsStream(const TlsStream&) = delete;
+    TlsStream& operator=(const TlsStream&) = delete;
+
+    // Data to send as TLS 1.3 early data (0-RTT) with the first flight of
+    // the handshake, if the session being resumed allows it. Only for
+    // requests that are safe to replay. data must outlive the handshake.
+    void setEarlyData(const uint8_t* data, size_t length);
+
+    // Advance the handshake. Once it's DONE, earlyDataAccepted() says
+    // whether the early data was taken or has to be sent again.
+    TlsResult handshake(std::string& error);
+    bool handshakeDone() const { return m_handshakeDone; }
+    bool resumed() const;
+    bool earlyDataAccepted() const { return m_earlyDataAccepted; }
+
+    // Send or receive application data; written and bytesRead are what
+    // was done when the result is DONE
+    TlsResult write(const uint8_t* data, size_t length, size_t& written, std::string& error);
+    TlsResult read(uint8_t* buffer, size_t size, size_t& bytesRead, std::string& error);
+
+private:
+    friend class TlsContext;
+
+    TlsStream(TlsContext& context, ssl_st* ssl, const std::string& host, const std::string& origin);
+
+    TlsResult resultFor(int ret, std::string& error, const char* what);
+    bool verifyWithValidator(std::string& error);
+    void finishHandshake();
+
+    TlsContext& m_context;
+    ssl_st* m_ssl;
+    std::string m_host;
+    std::string m_origin;
+    const uint8_t* m_earlyData;
+    size_t m_earlyDataLength;
+    size_t m_earlyDataSent;
+    bool m_offeredEarlyData;
+    bool m_handshakeDone;
+    bool m_earlyDataAccepted;
+    bool m_failed;
+    uint64_t m_startedUs;           // Tracer clock
+};
+
+// Client TLS configuration shared by connections: trusted roots, the
+// sessions servers gave out for resumption, and handshake statistics.
+// Certificates are checked by OpenSSL against the system's roots and the
+// hostname, then by the CertificateValidator, if one is set, for the
+// browser's own policy (revocation and the like). Needs OpenSSL
+// (BROWSER_HAVE_OPENSSL); without it createStream() always fails.
+// Thread-safe, so clients on different threads can share one.
+class TlsContext {
+public:
+    TlsContext();
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    // Whether this build can speak TLS
+    static bool supported();
+
+    // Trust the certificates in a PEM file as well as the system's roots
+    bool addTrustedCertificates(const std::string& pemFile, std::string& error);
+
+    // Consulted after OpenSSL has verified a new server's chain; must
+    // outlive the context
+    void setCertificateValidator(security::CertificateValidator* validator) { m_validator = validator; }
+
+    // Whether to offer early data (0-RTT) when resuming; on by default
+    void setEarlyDataEnabled(bool enabled) { m_earlyDataEnabled = enabled; }
+    bool earlyDataEnabled() const { return m_earlyDataEnabled; }
+
+    // TLS over a connected socket to host, resuming a session origin was
+    // given before if there is one. Null if it can't be set up.
+    std::unique_ptr<TlsStream> createStream(socket_t socket, const std::string& host,
+                                            const std::string& origin, std::string& error);
+
+    // Forget the sessions kept for resumption
+    void clearSessions();
+    size_t sessionCount() const;
+
+    TlsStats stats() const;
+
+    // Sessions kept per origin, and origins kept
+    static constexpr size_t kMaxSessionsPerOrigin = 4;
+    static constexpr size_t kMaxSessionOrigins = 256;
+
+private:
+    friend class TlsStream;
+
+    // Sessions for an origin, newest last, and its place in m_sessionOrder
+    struct OriginSessions {
+        std::vector<ssl_session_st*> sessions;
+        std::list<std::string>::iterator order;
+    };
+
+    static int onNewSession(ssl_st* ssl, ssl_session_st* session);
+    void storeSession(const std::string& origin, ssl_session_st* session);
+    ssl_session_st* takeSession(const std::string& origin);
+    void eraseSessionsLocked(std::map<std::string, OriginSessions>::iterator it);
+    void recordHandshake(bool resumed, bool offeredEarlyData, bool earlyDataAccepted, uint64_t durationUs);
+    void recordFailure();
+
+    ssl_ctx_st* m_context;
+    std::string m_initError;
+    security::CertificateValidator* m_validator;
+    std::atomic<bool> m_earlyDataEnabled;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, OriginSessions> m_sessions;
+    std::list<std::string> m_sessionOrder;      // Least recently stored first
+    TlsStats m_stats;
+};
+
+} // namespace networking
+} // namespace browser
+
+#endif // BROWSER_TLS_TRANSPORT_H
@@ -0,0 +1,211 @@
+#include "compositor.h"
+#include "raster_kernels.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <cmath>
+
+namespace browser {
+namespace rendering {
+
+namespace {
+
+// A premultiplied pixel faded to alpha / 255
+uint32_t fadePixel(uint32_t pixel, uint32_t alpha) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t channel = (pixel >> shift) & 0xFF;
+        result |= ((channel * alpha + 127) / 255) << shift;
+    }
+    return result;
+}
+
+bool contains(const layout::Rect& outer, const layout::Rect& inner) {
+    return inner.x >= outer.x && inner.y >= outer.y && inner.right() <= outer.right() &&
+           inner.bottom() <= outer.bottom();
+}
+
+layout::Rect intersect(const layout::Rect& a, const layout::Rect& b) {
+    float x0 = std::max(a.x, b.x);
+    float y0 = std::max(a.y, b.y);
+    float x1 = std::min(a.right(), b.right());
+    float y1 = std::min(a.bottom(), b.bottom());
+    if (x1 <= x0 || y1 <= y0) {
+        return layout::Rect();
+    }
+    return layout::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// Layer Implementation
+//-----------------------------------------------------------------------------
+
+Layer::Layer(layout::Box* box, const LayerProperties& properties)
+    : m_box(box)
+    , m_properties(properties)
+{
+}
+
+//-----------------------------------------------------------------------------
+// LayerTree Implementation
+//-----------------------------------------------------------------------------
+
+LayerTree::LayerTree()
+    : m_retained(0)
+{
+}
+
+LayerTree::~LayerTree() {
+}
+
+void LayerTree::beginUpdate() {
+    m_previous.swap(m_layers);
+    m_layers.clear();
+}
+
+Layer& LayerTree::addLayer(layout::Box* box, const LayerProperties& properties) {
+    m_layers.push_back(std::make_unique<Layer>(box, properties));
+    return *m_layers.back();
+}
+
+void LayerTree::endUpdate() {
+    m_layers.erase(std::remove_if(m_layers.begin(), m_layers.end(),
+                                  [](std::unique_ptr<Layer>& layer) {
+                                      layer->m_bounds = layer->displayList().bounds();
+                                      return layer->m_bounds.isEmpty();
+                                  }),
+                   m_layers.end());
+
+    // Pixels depend on the display list alone; properties apply when
+    // compositing
+    m_retained = 0;
+    for (size_t i = 0; i < m_layers.size() && i < m_previous.size(); ++i) {
+        Layer& layer = *m_layers[i];
+        Layer& previous = *m_previous[i];
+        if (previous.m_rasterRect.isEmpty() || layer.displayList() != previous.displayList()) {
+            continue;
+        }
+        std::swap(layer.m_pixels, previous.m_pixels);
+        layer.m_rasterRect = previous.m_rasterRect;
+        ++m_retained;
+    }
+    m_previous.clear();
+    TRACE_COUNTER("compositor", "layers", static_cast<int64_t>(m_layers.size()));
+    TRACE_COUNTER("compositor", "retainedLayers", static_cast<int64_t>(m_retained));
+}
+
+void LayerTree::invalidate() {
+    for (std::unique_ptr<Layer>& layer : m_layers) {
+        layer->m_rasterRect = layout::Rect();
+    }
+}
+
+void LayerTree::clear() {
+    m_layers.clear();
+    m_previous.clear();
+    m_retained = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Compositor Implementation
+//-----------------------------------------------------------------------------
+
+Compositor::Compositor()
+    : m_layersRasterized(0)
+{
+}
+
+Compositor::~Compositor() {
+}
+
+void Compositor::composite(LayerTree& layers, Framebuffer& target, float scrollX, float scrollY,
+                           const Color& background) {
+    TRACE_SCOPE("compositor", "Compositor::composite");
+    ALLOC_SCOPE(RENDERING);
+
+    target.clear(Framebuffer::pack(background));
+    m_layersRasterized = 0;
+    float width = static_cast<float>(target.width());
+    float height = static_cast<float>(target.height());
+
+    for (size_t i = 0; i < layers.size(); ++i) {
+        Layer& layer = layers[i];
+        if (layer.properties().opacity <= 0) {
+            continue;
+        }
+
+        // The page area on screen, in the layer's coordinates
+        int offsetX, offsetY;
+        layerOffset(layer, scrollX, scrollY, offsetX, offsetY);
+        layout::Rect visible(static_cast<float>(-offsetX), static_cast<float>(-offsetY), width, height);
+        layout::Rect needed = intersect(visible, layer.bounds());
+        if (needed.isEmpty()) {
+            continue;
+        }
+
+        if (!contains(layer.rasterRect(), needed)) {
+            layout::Rect interest(visible.x - width * interestMargin, visible.y - height * interestMargin,
+                                  width * (1 + 2 * interestMargin), height * (1 + 2 * interestMargin));
+            rasterizeLayer(layer, intersect(interest, layer.bounds()));
+            ++m_layersRasterized;
+        }
+        blendLayer(layer, target, offsetX, offsetY);
+    }
+    TRACE_COUNTER("compositor", "layersRasterized", static_cast<int64_t>(m_layersRasterized));
+}
+
+void Compositor::layerOffset(const Layer& layer, float scrollX, float scrollY, int& x, int& y) {
+    // Whole pixels, so retained pixels line up with a fresh rasterization
+    const LayerProperties& properties = layer.properties();
+    x = static_cast<int>(std::lround(properties.translateX - (properties.fixed ? 0 : scrollX)));
+    y = static_cast<int>(std::lround(properties.translateY - (properties.fixed ? 0 : scrollY)));
+}
+
+void Compositor::rasterizeLayer(Layer& layer, const layout::Rect& area) {
+    TRACE_SCOPE("compositor", "Compositor::rasterizeLayer");
+
+    int x0 = static_cast<int>(std::floor(area.x));
+    int y0 = static_cast<int>(std::floor(area.y));
+    int x1 = static_cast<int>(std::ceil(area.right()));
+    int y1 = static_cast<int>(std::ceil(area.bottom()));
+    layer.m_pixels.resize(x1 - x0, y1 - y0);
+    m_rasterizer.rasterize(layer.displayList(), layer.m_pixels, Color(0, 0, 0, 0.0f),
+                           static_cast<float>(x0), static_cast<float>(y0));
+    layer.m_rasterRect = layout::Rect(static_cast<float>(x0), static_cast<float>(y0),
+                                      static_cast<float>(x1 - x0), static_cast<float>(y1 - y0));
+}
+
+void Compositor::blendLayer(const Layer& layer, Framebuffer& target, int offsetX, int offsetY) {
+    const RasterKernels& kernels = rasterKernels();
+    const Framebuffer& pixels = layer.pixels();
+    int left = static_cast<int>(layer.rasterRect().x) + offsetX;
+    int top = static_cast<int>(layer.rasterRect().y) + offsetY;
+    int x0 = std::max(left, 0);
+    int y0 = std::max(top, 0);
+    int x1 = std::min(left + pixels.width(), target.width());
+    int y1 = std::min(top + pixels.height(), target.height());
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    size_t count = static_cast<size_t>(x1 - x0);
+    uint32_t alpha = static_cast<uint32_t>(std::lround(std::min(layer.properties().opacity, 1.0f) * 255));
+    if (alpha < 255) {
+        m_scaled.resize(count);
+    }
+    for (int y = y0; y < y1; ++y) {
+        const uint32_t* src = pixels.row(y - top) + (x0 - left);
+        if (alpha < 255) {
+            for (size_t i = 0; i < count; ++i) {
+                m_scaled[i] = fadePixel(src[i], alpha);
+            }
+            src = m_scaled.data();
+        }
+        kernels.blend(target.row(y) + x0, src, count);
+    }
+}
+
+} // namespace rendering
+} // namespace browser
@@ -0,0 +1,147 @@
+#ifndef BROWSER_RENDERING_COMPOSITOR_H
+#define BROWSER_RENDERING_COMPOSITOR_H
+
+#include "framebuffer.h"
+#include "paint_system.h"
+#include "tile_rasterizer.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace browser {
+namespace threading {
+class WorkPool;
+}
+
+namespace rendering {
+
+// How a layer's pixels are put on screen
+struct LayerProperties {
+    bool fixed = false;        // Stays put when the page scrolls
+    float opacity = 1.0f;
+    float translateX = 0;      // From transform: translate()
+    float translateY = 0;
+};
+
+// Part of the page painted into a display list of its own and rasterized
+// into its own retained pixels, which are composited every frame. Display
+// lists are in page coordinates.
+class Layer {
+public:
+    Layer(layout::Box* box, const LayerProperties& properties);
+
+    Layer(const Layer&) = delete;
+    Layer& operator=(const Layer&) = delete;
+
+    // The box whose subtree started the layer; null for the root's
+    layout::Box* box() const { return m_box; }
+    const LayerProperties& properties() const { return m_properties; }
+
+    PaintContext& context() { return m_context; }
+    const DisplayList& displayList() const { return m_context.displayList(); }
+
+    // Page area the display list draws to
+    const layout::Rect& bounds() const { return m_bounds; }
+
+    // Rasterized pixels, and the page area they hold (empty until the
+    // layer is first composited)
+    const Framebuffer& pixels() const { return m_pixels; }
+    const layout::Rect& rasterRect() const { return m_rasterRect; }
+
+private:
+    friend class LayerTree;
+    friend class Compositor;
+
+    layout::Box* m_box;
+    LayerProperties m_properties;
+    PaintContext m_context;
+    layout::Rect m_bounds;
+    Framebuffer m_pixels;
+    layout::Rect m_rasterRect;
+};
+
+// The layers of a page in paint order, rebuilt by PaintSystem::paintLayers.
+// A layer painted with the same display list as the layer at its place in
+// the last update takes over that layer's pixels, so only layers whose
+// content changed are rasterized again.
+class LayerTree {
+public:
+    LayerTree();
+    ~LayerTree();
+
+    LayerTree(const LayerTree&) = delete;
+    LayerTree& operator=(const LayerTree&) = delete;
+
+    // Start painting a new set of layers
+    void beginUpdate();
+
+    // Append a layer to paint into
+    Layer& addLayer(layout::Box* box, const LayerProperties& properties);
+
+    // Finish: drop layers that draw nothing and keep the pixels of the
+    // unchanged ones
+    void endUpdate();
+
+    size_t size() const { return m_layers.size(); }
+    Layer& operator[](size_t index) { return *m_layers[index]; }
+    const Layer& operator[](size_t index) const { return *m_layers[index]; }
+
+    // Layers that kept their pixels in the last update
+    size_t retainedLayers() const { return m_retained; }
+
+    // Drop every layer's pixels, for changes their display lists don't
+    // show, e.g. images decoded since they were rasterized
+    void invalidate();
+    void clear();
+
+private:
+    std::vector<std::unique_ptr<Layer>> m_layers;
+    std::vector<std::unique_ptr<Layer>> m_previous;
+    size_t m_retained;
+};
+
+// Puts a layer tree on screen at a scroll position. Each layer keeps the
+// pixels of its interest area, the visible part of the page plus a
+// viewport's worth of margin on every side (interestMargin), so scrolling
+// blends the retained pixels at new offsets and only rasterizes again when
+// the view nears the edge of a layer's pixels.
+class Compositor {
+public:
+    static constexpr float interestMargin = 1.0f;  // In viewports
+
+    Compositor();
+    ~Compositor();
+
+    Compositor(const Compositor&) = delete;
+    Compositor& operator=(const Compositor&) = delete;
+
+    // Pool for rasterizing layers; defaults to WorkPool::shared()
+    void setWorkPool(threading::WorkPool* pool) { m_rasterizer.setWorkPool(pool); }
+
+    TileRasterizer& rasterizer() { return m_rasterizer; }
+
+    // Draw the layers over background into target as seen scrolled to
+    // (scrollX, scrollY), rasterizing layers that don't hold their visible
+    // area
+    void composite(LayerTree& layers, Framebuffer& target, float scrollX, float scrollY,
+                   const Color& background = Color(255, 255, 255));
+
+    // Layers rasterized by the last composite()
+    size_t layersRasterized() const { return m_layersRasterized; }
+
+private:
+    // Screen position of a layer's page origin
+    static void layerOffset(const Layer& layer, float scrollX, float scrollY, int& x, int& y);
+
+    void rasterizeLayer(Layer& layer, const layout::Rect& area);
+    void blendLayer(const Layer& layer, Framebuffer& target, int offsetX, int offsetY);
+
+    TileRasterizer m_rasterizer;
+    std::vector<uint32_t> m_scaled;  // Translucent layer rows
+    size_t m_layersRasterized;
+};
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_COMPOSITOR_H
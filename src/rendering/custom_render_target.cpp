@@ -39,6 +39,20 @@ int CustomRenderTarget::height() const {
     return m_height;
 }
 
+void CustomRenderTarget::rasterize(const DisplayList& displayList, const Color& background) {
+    if (m_framebuffer.width() != m_width || m_framebuffer.height() != m_height) {
+        m_framebuffer.resize(m_width, m_height);
+    }
+    m_rasterizer.rasterize(displayList, m_framebuffer, background);
+}
+
+void CustomRenderTarget::composite(LayerTree& layers, float scrollX, float scrollY, const Color& background) {
+    if (m_framebuffer.width() != m_width || m_framebuffer.height() != m_height) {
+        m_framebuffer.resize(m_width, m_height);
+    }
+    m_compositor.composite(layers, m_framebuffer, scrollX, scrollY, background);
+}
+
 std::string CustomRenderTarget::toString() {
     // Render to ASCII representation
     if (m_renderingContext) {
@@ -99,7 +113,7 @@ void CustomRenderingContext::setTextColor(const Color& color) {
     m_textColor = color;
 }
 
-void CustomRenderingContext::drawText(const std::string& text, float x, float y, const std::string& fontFamily, float fontSize) {
+void CustomRenderingContext::drawText(std::string_view text, float x, float y, std::string_view fontFamily, float fontSize) {
     if (!m_context) return;
     
     m_context->setFont(Font(fontFamily, fontSize));
@@ -3,6 +3,9 @@
 
 #include "render_target.h"
 #include "custom_renderer.h"
+#include "compositor.h"
+#include "framebuffer.h"
+#include "tile_rasterizer.h"
 #include <memory>
 #include <string>
 
@@ -27,6 +30,19 @@ public:
     // Get the custom context
     CustomRenderContext* getCustomContext() const { return m_context.get(); }
     
+    // Rasterize a display list into the framebuffer, sized to the target
+    void rasterize(const DisplayList& displayList, const Color& background = Color(255, 255, 255));
+    
+    // Composite layers into the framebuffer as seen scrolled to
+    // (scrollX, scrollY); scrolling an unchanged layer tree only blends
+    // retained layer pixels
+    void composite(LayerTree& layers, float scrollX, float scrollY, const Color& background = Color(255, 255, 255));
+    
+    // Pixels of the last rasterize() or composite()
+    const Framebuffer& framebuffer() const { return m_framebuffer; }
+    TileRasterizer& rasterizer() { return m_rasterizer; }
+    Compositor& compositor() { return m_compositor; }
+    
     // Convert to string representation (ASCII art)
     virtual std::string toString() override;
     
@@ -35,6 +51,9 @@ private:
     int m_height;
     std::shared_ptr<CustomRenderContext> m_context;
     std::shared_ptr<RenderingContext> m_renderingContext;
+    Framebuffer m_framebuffer;
+    TileRasterizer m_rasterizer;
+    Compositor m_compositor;
 };
 
 // Adapter to bridge CustomRenderContext with RenderingContext
@@ -51,8 +70,8 @@ public:
     void strokeRect(float x, float y, float width, float height, float lineWidth = 1.0f);
     
     void setTextColor(const Color& color);
-    void drawText(const std::string& text, float x, float y, 
-                  const std::string& fontFamily = "Arial", float fontSize = 12.0f);
+    void drawText(std::string_view text, float x, float y, 
+                  std::string_view fontFamily = "Arial", float fontSize = 12.0f);
     
     // Transform operations
     void save();
@@ -1,5 +1,6 @@
 // src/rendering/custom_renderer.cpp
 #include "custom_renderer.h"
+#include "path_cache.h"
 #include <cmath>
 #include <algorithm>
 #include <iostream>
@@ -348,7 +349,8 @@ bool Image::save(const std::string& filename) const {
 
 
 CustomRenderContext::CustomRenderContext()
-    : m_nextImageId(1)
+    : m_pathCache(std::make_unique<PathCache>())
+    , m_nextImageId(1)
     , m_width(0)
     , m_height(0)
     , m_devicePixelRatio(1.0f)
@@ -546,16 +548,79 @@ void CustomRenderContext::fill() {
     // Store the current path for rendering
     m_paths.push_back(m_currentPath);
     
-    // In a real implementation, we would actually render the path here
-    // using the current fill paint
+    float x, y, w, h;
+    if (currentPathRect(x, y, w, h)) {
+        PathShape shape;
+        shape.kind = PathShape::Kind::FILL_RECT;
+        shape.x = x;
+        shape.y = y;
+        shape.width = w;
+        shape.height = h;
+        shape.paint = m_currentState.fillPaint;
+        m_shapes.push_back(std::move(shape));
+        return;
+    }
+    addPolygon(PathShape::Kind::FILL_POLYGON, m_currentState.fillPaint, 0);
 }
 
 void CustomRenderContext::stroke() {
     // Store the current path for rendering
     m_paths.push_back(m_currentPath);
     
-    // In a real implementation, we would actually render the path here
-    // using the current stroke paint and stroke width
+    addPolygon(PathShape::Kind::STROKE_POLYGON, m_currentState.strokePaint, m_currentState.strokeWidth);
+}
+
+bool CustomRenderContext::currentPathRect(float& x, float& y, float& w, float& h) const {
+    // moveTo, three or four lineTos (the last back to the start) and an
+    // optional close, alternating horizontal and vertical edges
+    const std::vector<Path::Command>& commands = m_currentPath.commands();
+    float px[5], py[5];
+    size_t count = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        Path::CommandType type = commands[i].type;
+        if (type == Path::CommandType::CLOSE && i + 1 == commands.size()) {
+            break;
+        }
+        bool expected = i == 0 ? type == Path::CommandType::MOVE_TO : type == Path::CommandType::LINE_TO;
+        if (!expected || count == 5) {
+            return false;
+        }
+        px[count] = commands[i].points[0];
+        py[count] = commands[i].points[1];
+        ++count;
+    }
+    if (count == 5 && px[4] == px[0] && py[4] == py[0]) {
+        count = 4;
+    }
+    if (count != 4) {
+        return false;
+    }
+    
+    bool horizontalFirst = py[0] == py[1] && px[1] == px[2] && py[2] == py[3] && px[3] == px[0];
+    bool verticalFirst = px[0] == px[1] && py[1] == py[2] && px[2] == px[3] && py[3] == py[0];
+    if (!horizontalFirst && !verticalFirst) {
+        return false;
+    }
+    x = std::min(px[0], px[2]);
+    y = std::min(py[0], py[2]);
+    w = std::abs(px[2] - px[0]);
+    h = std::abs(py[2] - py[0]);
+    return true;
+}
+
+void CustomRenderContext::addPolygon(PathShape::Kind kind, const Paint& paint, float strokeWidth) {
+    if (m_currentPath.isEmpty()) {
+        return;
+    }
+    
+    // Flatten to a quarter of a device pixel
+    float tolerance = 0.25f / std::max(m_devicePixelRatio, 0.01f);
+    PathShape shape;
+    shape.kind = kind;
+    shape.polygon = m_pathCache->get(m_currentPath, tolerance, shape.x, shape.y);
+    shape.paint = paint;
+    shape.strokeWidth = strokeWidth;
+    m_shapes.push_back(std::move(shape));
 }
 
 void CustomRenderContext::setFillPaint(const Paint& paint) {
@@ -574,7 +639,7 @@ void CustomRenderContext::setFont(const Font& font) {
     m_currentState.font = font;
 }
 
-float CustomRenderContext::text(float x, float y, const std::string& string) {
+float CustomRenderContext::text(float x, float y, std::string_view string) {
     // Transform text position
     m_currentState.transform.apply(x, y);
     
@@ -674,56 +739,8 @@ void CustomRenderContext::deleteImage(int image) {
 }
 
 Color Color::fromCssColor(const css::Value& value) {
-    std::string colorStr = value.stringValue();
-    
-    // Handle named colors
-    if (colorStr == "black") return Color(0, 0, 0);
-    if (colorStr == "white") return Color(255, 255, 255);
-    if (colorStr == "red") return Color(255, 0, 0);
-    if (colorStr == "green") return Color(0, 128, 0);
-    if (colorStr == "blue") return Color(0, 0, 255);
-    if (colorStr == "yellow") return Color(255, 255, 0);
-    if (colorStr == "purple") return Color(128, 0, 128);
-    if (colorStr == "gray" || colorStr == "grey") return Color(128, 128, 128);
-    if (colorStr == "transparent") return Color(0, 0, 0, 0);
-    
-    // Handle hex colors
-    if (colorStr.size() >= 7 && colorStr[0] == '#') {
-        int r = std::stoi(colorStr.substr(1, 2), nullptr, 16);
-        int g = std::stoi(colorStr.substr(3, 2), nullptr, 16);
-        int b = std::stoi(colorStr.substr(5, 2), nullptr, 16);
-        return Color(r, g, b);
-    } else if (colorStr.size() >= 4 && colorStr[0] == '#') {
-        int r = std::stoi(colorStr.substr(1, 1) + colorStr.substr(1, 1), nullptr, 16);
-        int g = std::stoi(colorStr.substr(2, 1) + colorStr.substr(2, 1), nullptr, 16);
-        int b = std::stoi(colorStr.substr(3, 1) + colorStr.substr(3, 1), nullptr, 16);
-        return Color(r, g, b);
-    }
-    
-    // Handle rgb/rgba
-    if (colorStr.substr(0, 4) == "rgb(") {
-        // This is a very simplified RGB parser
-        std::string values = colorStr.substr(4, colorStr.length() - 5);
-        std::stringstream ss(values);
-        int r, g, b;
-        char comma;
-        ss >> r >> comma >> g >> comma >> b;
-        return Color(r, g, b);
-    }
-    
-    if (colorStr.substr(0, 5) == "rgba(") {
-        // This is a very simplified RGBA parser
-        std::string values = colorStr.substr(5, colorStr.length() - 6);
-        std::stringstream ss(values);
-        int r, g, b;
-        float a;
-        char comma;
-        ss >> r >> comma >> g >> comma >> b >> comma >> a;
-        return Color(r, g, b, a);
-    }
-    
-    // Default to black
-    return Color(0, 0, 0);
+    // Colors are decoded when the value is parsed; anything else is black
+    return fromRGBA(value.rgba());
 }
 
 void CustomRenderContext::scissor(float x, float y, float w, float h) {
@@ -756,6 +773,7 @@ void CustomRenderContext::beginFrame(int windowWidth, int windowHeight, float de
     
     // Clear path data
     m_paths.clear();
+    m_shapes.clear();
     m_currentPath.clear();
     
     // Reset state
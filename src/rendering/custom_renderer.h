@@ -3,6 +3,7 @@
 #define BROWSER_CUSTOM_RENDERER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <map>
@@ -16,6 +17,8 @@ namespace rendering {
 class Path;
 class Font;
 class Image;
+class PathCache;
+struct FlattenedPath;
 
 // Color class (RGBA)
 class Color {
@@ -27,18 +30,9 @@ public:
     Color(unsigned char red, unsigned char green, unsigned char blue, float alpha = 1.0f)
         : r(red), g(green), b(blue), a(alpha) {}
     
-    // Copy constructor
-    Color(const Color& other) 
-        : r(other.r), g(other.g), b(other.b), a(other.a) {}
-        
-    // Assignment operator
-    Color& operator=(const Color& other) {
-        r = other.r;
-        g = other.g;
-        b = other.b;
-        a = other.a;
-        return *this;
-    }
+    // Trivially copyable, so display items can hold colors
+    Color(const Color& other) = default;
+    Color& operator=(const Color& other) = default;
     
     // Color components
     unsigned char r, g, b;
@@ -181,7 +175,7 @@ private:
 class Font {
 public:
     Font() : m_size(12.0f) {}
-    Font(const std::string& name, float size) : m_name(name), m_size(size) {}
+    Font(std::string_view name, float size) : m_name(name), m_size(size) {}
     
     const std::string& name() const { return m_name; }
     float size() const { return m_size; }
@@ -216,6 +210,23 @@ private:
     std::vector<unsigned char> m_data; // RGBA data
 };
 
+// A filled or stroked path as a frame hands it to a backend: an
+// axis-aligned rect, or a flattened polygon placed with its origin at (x, y)
+struct PathShape {
+    enum class Kind {
+        FILL_RECT,
+        FILL_POLYGON,
+        STROKE_POLYGON
+    };
+    
+    Kind kind;
+    float x, y;
+    float width = 0, height = 0;  // Rects
+    std::shared_ptr<const FlattenedPath> polygon;
+    Paint paint;
+    float strokeWidth = 0;
+};
+
 // Custom renderer context (replacement for NVGcontext)
 class CustomRenderContext {
 public:
@@ -257,7 +268,7 @@ public:
     
     // Text operations
     void setFont(const Font& font);
-    float text(float x, float y, const std::string& string);
+    float text(float x, float y, std::string_view string);
     float textBounds(float x, float y, const std::string& string, float* bounds);
     void textMetrics(float* ascender, float* descender, float* lineHeight);
     
@@ -282,6 +293,13 @@ public:
     const std::vector<Path>& paths() const { return m_paths; }
     const Path& currentPath() const { return m_currentPath; }
     
+    // Shapes filled and stroked this frame. Axis-aligned rect fills skip
+    // flattening; other paths are flattened through the path cache, so a
+    // shape drawn every frame (like a control's rounded rect) is
+    // subdivided once.
+    const std::vector<PathShape>& shapes() const { return m_shapes; }
+    PathCache& pathCache() { return *m_pathCache; }
+    
     // Get window dimensions
     int getWindowWidth() const { return m_width; }
     int getWindowHeight() const { return m_height; }
@@ -338,9 +356,15 @@ private:
     std::vector<State> m_stateStack;
     State m_currentState;
     
+    // The current path as a rect, if it's a closed axis-aligned one
+    bool currentPathRect(float& x, float& y, float& w, float& h) const;
+    void addPolygon(PathShape::Kind kind, const Paint& paint, float strokeWidth);
+    
     // Path data
     Path m_currentPath;
     std::vector<Path> m_paths;
+    std::vector<PathShape> m_shapes;
+    std::unique_ptr<PathCache> m_pathCache;
     
     // Image storage
     std::map<int, std::shared_ptr<Image>> m_images;
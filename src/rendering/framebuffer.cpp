@@ -0,0 +1,52 @@
+#include "framebuffer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace browser {
+namespace rendering {
+
+Framebuffer::Framebuffer()
+    : m_width(0)
+    , m_height(0)
+{
+}
+
+Framebuffer::Framebuffer(int width, int height)
+    : m_width(0)
+    , m_height(0)
+{
+    resize(width, height);
+}
+
+void Framebuffer::resize(int width, int height) {
+    m_width = std::max(width, 0);
+    m_height = std::max(height, 0);
+    m_pixels.resize(static_cast<size_t>(m_width) * m_height);
+}
+
+void Framebuffer::clear(uint32_t pixel) {
+    std::fill(m_pixels.begin(), m_pixels.end(), pixel);
+}
+
+uint32_t Framebuffer::pack(const Color& color) {
+    uint32_t a = static_cast<uint32_t>(std::lround(std::min(std::max(color.a, 0.0f), 1.0f) * 255.0f));
+    uint32_t r = (color.r * a + 127) / 255;
+    uint32_t g = (color.g * a + 127) / 255;
+    uint32_t b = (color.b * a + 127) / 255;
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+Color Framebuffer::unpack(uint32_t pixel) {
+    uint32_t a = pixel >> 24;
+    if (a == 0) {
+        return Color(0, 0, 0, 0.0f);
+    }
+    auto channel = [a](uint32_t value) {
+        return static_cast<unsigned char>(std::min<uint32_t>((value * 255 + a / 2) / a, 255));
+    };
+    return Color(channel(pixel & 0xFF), channel((pixel >> 8) & 0xFF), channel((pixel >> 16) & 0xFF),
+                 a / 255.0f);
+}
+
+} // namespace rendering
+} // namespace browser
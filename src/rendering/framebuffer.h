@@ -0,0 +1,46 @@
+#ifndef BROWSER_RENDERING_FRAMEBUFFER_H
+#define BROWSER_RENDERING_FRAMEBUFFER_H
+
+#include "custom_renderer.h"
+#include <cstdint>
+#include <vector>
+
+namespace browser {
+namespace rendering {
+
+// Pixels of a software render target. Each pixel is one uint32_t holding
+// premultiplied RGBA8 with red in the low byte, so the bytes in memory read
+// R, G, B, A; rows are packed.
+class Framebuffer {
+public:
+    Framebuffer();
+    Framebuffer(int width, int height);
+
+    // Reallocate for a new size; the contents are undefined afterwards
+    void resize(int width, int height);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    uint32_t* row(int y) { return m_pixels.data() + static_cast<size_t>(y) * m_width; }
+    const uint32_t* row(int y) const { return m_pixels.data() + static_cast<size_t>(y) * m_width; }
+    uint32_t pixel(int x, int y) const { return row(y)[x]; }
+    const std::vector<uint32_t>& pixels() const { return m_pixels; }
+
+    // Fill every pixel with a packed color
+    void clear(uint32_t pixel);
+
+    // A color as a premultiplied pixel, and back (unpremultiplied)
+    static uint32_t pack(const Color& color);
+    static Color unpack(uint32_t pixel);
+
+private:
+    int m_width;
+    int m_height;
+    std::vector<uint32_t> m_pixels;
+};
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_FRAMEBUFFER_H
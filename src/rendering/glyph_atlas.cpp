@@ -0,0 +1,190 @@
+#include "glyph_atlas.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace browser {
+namespace rendering {
+
+namespace {
+
+float overlap(float a0, float a1, float b0, float b1) {
+    return std::max(0.0f, std::min(a1, b1) - std::max(a0, b0));
+}
+
+} // namespace
+
+GlyphAtlas::GlyphAtlas(int size)
+    : m_pixels(static_cast<size_t>(std::max(size, maxCellSize)) * std::max(size, maxCellSize))
+    , m_size(std::max(size, maxCellSize))
+    , m_nextShelf(0)
+    , m_frame(0)
+    , m_empty{0, 0, 0, 0, 0, 0}
+    , m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+}
+
+GlyphAtlas::~GlyphAtlas() {
+}
+
+uint32_t GlyphAtlas::fontId(std::string_view family) {
+    auto it = m_fonts.find(std::string(family));
+    if (it != m_fonts.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(m_fonts.size());
+    m_fonts.emplace(std::string(family), id);
+    return id;
+}
+
+GlyphKey GlyphAtlas::key(uint32_t font, uint32_t glyph, float fontSize, float penOffset) {
+    GlyphKey key;
+    key.font = font;
+    key.glyph = glyph;
+    key.size = static_cast<uint16_t>(std::min(std::max(std::lround(fontSize * 4.0f), 0L), 65535L));
+    key.subpixel = static_cast<uint8_t>(
+        std::min(std::max(static_cast<int>(penOffset * subpixelPositions), 0), subpixelPositions - 1));
+    return key;
+}
+
+void GlyphAtlas::beginFrame() {
+    ++m_frame;
+}
+
+const GlyphMask* GlyphAtlas::find(const GlyphKey& key) {
+    auto found = m_entries.find(key);
+    if (found != m_entries.end()) {
+        ++m_hits;
+        EntryList::iterator entry = found->second;
+        entry->lastUsed = m_frame;
+        EntryList& list = m_lru[sizeClass(std::max(entry->mask.width, entry->mask.height))];
+        list.splice(list.begin(), list, entry);
+        return &entry->mask;
+    }
+
+    ++m_misses;
+    GlyphMask mask;
+    rasterize(key, mask, m_scratch);
+    if (mask.width == 0 || mask.height == 0) {
+        return &m_empty;
+    }
+    int cls = sizeClass(std::max(mask.width, mask.height));
+    Cell cell;
+    if (cls < 0 || !allocate(cls, cell)) {
+        return nullptr;
+    }
+
+    mask.atlasX = cell.x;
+    mask.atlasY = cell.y;
+    for (int y = 0; y < mask.height; ++y) {
+        std::memcpy(m_pixels.data() + static_cast<size_t>(cell.y + y) * m_size + cell.x,
+                    m_scratch.data() + static_cast<size_t>(y) * mask.width, mask.width);
+    }
+
+    EntryList& list = m_lru[cls];
+    list.push_front(Entry{key, mask, m_frame});
+    m_entries.emplace(key, list.begin());
+    return &list.front().mask;
+}
+
+void GlyphAtlas::rasterize(const GlyphKey& key, GlyphMask& mask, std::vector<uint8_t>& coverage) {
+    // There's no font data: glyphs are greeked, one bar per character at
+    // the advance text layout assumes, x-height, ascender or descender tall
+    float size = key.size / 4.0f;
+    float advance = size * 0.5f;
+    float pen = static_cast<float>(key.subpixel) / subpixelPositions;
+    uint32_t c = key.glyph;
+
+    float top = 0.5f;
+    float bottom = 0.0f;
+    if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80 ||
+        c == 'b' || c == 'd' || c == 'f' || c == 'h' || c == 'k' || c == 'l' || c == 't') {
+        top = 0.7f;
+    } else if (c == 'g' || c == 'j' || c == 'p' || c == 'q' || c == 'y') {
+        bottom = 0.2f;
+    } else if (c == '.' || c == ',' || c == '_') {
+        top = 0.1f;
+    }
+
+    mask = GlyphMask{0, 0, 0, 0, 0, 0};
+    coverage.clear();
+    if (c <= ' ' || c == 0x7F || size <= 0) {
+        return;
+    }
+
+    // Coverage is the area of each pixel inside the bar
+    float x0 = pen + advance * 0.15f;
+    float x1 = pen + advance * 0.85f;
+    float y0 = -size * top;
+    float y1 = size * bottom;
+    mask.left = static_cast<int>(std::floor(x0));
+    mask.top = static_cast<int>(std::floor(y0));
+    mask.width = static_cast<int>(std::ceil(x1)) - mask.left;
+    mask.height = static_cast<int>(std::ceil(y1)) - mask.top;
+    coverage.resize(static_cast<size_t>(mask.width) * mask.height);
+    for (int y = 0; y < mask.height; ++y) {
+        float py = static_cast<float>(mask.top + y);
+        float rowCover = overlap(py, py + 1, y0, y1);
+        for (int x = 0; x < mask.width; ++x) {
+            float px = static_cast<float>(mask.left + x);
+            float cover = overlap(px, px + 1, x0, x1) * rowCover;
+            coverage[static_cast<size_t>(y) * mask.width + x] = static_cast<uint8_t>(std::lround(cover * 255.0f));
+        }
+    }
+}
+
+void GlyphAtlas::resetCounters() {
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+void GlyphAtlas::clear() {
+    for (int cls = 0; cls < classCount; ++cls) {
+        m_lru[cls].clear();
+        m_freeCells[cls].clear();
+    }
+    m_entries.clear();
+    m_nextShelf = 0;
+}
+
+int GlyphAtlas::sizeClass(int extent) {
+    int cls = 0;
+    for (int cell = minCellSize; cell < extent; cell *= 2) {
+        ++cls;
+    }
+    return cls < classCount ? cls : -1;
+}
+
+bool GlyphAtlas::allocate(int cls, Cell& cell) {
+    std::vector<Cell>& free = m_freeCells[cls];
+    int cellSize = minCellSize << cls;
+    if (free.empty() && m_nextShelf + cellSize <= m_size) {
+        // A new shelf, its cells taken from the left
+        for (int x = m_size - cellSize; x >= 0; x -= cellSize) {
+            free.push_back(Cell{x, m_nextShelf});
+        }
+        m_nextShelf += cellSize;
+    }
+    if (!free.empty()) {
+        cell = free.back();
+        free.pop_back();
+        return true;
+    }
+
+    EntryList& list = m_lru[cls];
+    if (list.empty() || list.back().lastUsed == m_frame) {
+        return false;
+    }
+    const Entry& victim = list.back();
+    cell = Cell{victim.mask.atlasX, victim.mask.atlasY};
+    m_entries.erase(victim.key);
+    list.pop_back();
+    ++m_evictions;
+    return true;
+}
+
+} // namespace rendering
+} // namespace browser
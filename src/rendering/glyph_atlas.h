@@ -0,0 +1,139 @@
+#ifndef BROWSER_RENDERING_GLYPH_ATLAS_H
+#define BROWSER_RENDERING_GLYPH_ATLAS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace rendering {
+
+// A rasterized glyph: font, size, code point and horizontal pen offset
+struct GlyphKey {
+    uint32_t font;      // GlyphAtlas::fontId
+    uint32_t glyph;     // Code point
+    uint16_t size;      // Font size in quarter pixels
+    uint8_t subpixel;   // Pen offset in 1 / subpixelPositions of a pixel
+
+    bool operator==(const GlyphKey& other) const {
+        return font == other.font && glyph == other.glyph && size == other.size && subpixel == other.subpixel;
+    }
+};
+
+struct GlyphKeyHash {
+    size_t operator()(const GlyphKey& key) const {
+        uint64_t h = (static_cast<uint64_t>(key.font) << 32) ^ key.glyph;
+        h ^= (static_cast<uint64_t>(key.size) << 8 | key.subpixel) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+};
+
+// A glyph's coverage mask: width x height 8-bit coverage with its top left
+// pixel at (pen pixel + left, baseline + top)
+struct GlyphMask {
+    int left;
+    int top;
+    int width;
+    int height;
+    int atlasX;  // Position in the atlas, when cached
+    int atlasY;
+};
+
+// Coverage masks of rasterized glyphs packed into one 8-bit atlas, so text
+// drawing blits masks instead of going through the font path for every
+// glyph. The atlas is cut into shelves of square cells in power-of-two size
+// classes; a glyph takes a cell of the smallest class it fits. When a class
+// has no free cell and there's no room for another shelf, its least
+// recently used glyph is evicted, except glyphs found this frame: masks
+// returned since beginFrame() stay valid until the next beginFrame().
+//
+// Not thread-safe; the atlas pixels may be read concurrently while nothing
+// is being found.
+class GlyphAtlas {
+public:
+    static constexpr int defaultSize = 1024;
+    static constexpr int subpixelPositions = 4;
+    static constexpr int minCellSize = 8;
+    static constexpr int maxCellSize = 128;
+
+    explicit GlyphAtlas(int size = defaultSize);
+    ~GlyphAtlas();
+
+    GlyphAtlas(const GlyphAtlas&) = delete;
+    GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+    // Small id for a font family name
+    uint32_t fontId(std::string_view family);
+
+    // Key for a glyph at a font size and a pen offset in [0, 1)
+    static GlyphKey key(uint32_t font, uint32_t glyph, float fontSize, float penOffset);
+
+    // Start a frame; glyphs from earlier frames become evictable
+    void beginFrame();
+
+    // The glyph's mask, rasterized into the atlas on a miss. Null when it is
+    // larger than a cell or every cell of its class holds a glyph found this
+    // frame; rasterize() it directly then.
+    const GlyphMask* find(const GlyphKey& key);
+
+    // The font path: the glyph's mask placement and coverage, width values
+    // per row
+    static void rasterize(const GlyphKey& key, GlyphMask& mask, std::vector<uint8_t>& coverage);
+
+    // Atlas pixels, size() square
+    int size() const { return m_size; }
+    const uint8_t* row(int y) const { return m_pixels.data() + static_cast<size_t>(y) * m_size; }
+
+    // Glyphs cached, and counters since construction or resetCounters()
+    size_t glyphCount() const { return m_entries.size(); }
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    size_t evictions() const { return m_evictions; }
+    void resetCounters();
+    void clear();
+
+private:
+    static constexpr int classCount = 5;  // minCellSize to maxCellSize
+
+    struct Entry {
+        GlyphKey key;
+        GlyphMask mask;
+        uint64_t lastUsed;  // Frame
+    };
+    using EntryList = std::list<Entry>;
+
+    struct Cell {
+        int x;
+        int y;
+    };
+
+    // Smallest class whose cells hold extent pixels, or -1
+    static int sizeClass(int extent);
+
+    // A free cell of the class: from the free list, a new shelf, or the
+    // class's least recently used glyph. False if all are in use this frame.
+    bool allocate(int cls, Cell& cell);
+
+    std::vector<uint8_t> m_pixels;
+    int m_size;
+    int m_nextShelf;  // Top of the unused space below the shelves
+    uint64_t m_frame;
+    GlyphMask m_empty;  // Found for glyphs with no pixels
+    EntryList m_lru[classCount];  // Most recently used first
+    std::vector<Cell> m_freeCells[classCount];
+    std::unordered_map<GlyphKey, EntryList::iterator, GlyphKeyHash> m_entries;
+    std::unordered_map<std::string, uint32_t> m_fonts;
+    std::vector<uint8_t> m_scratch;
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_evictions;
+};
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_GLYPH_ATLAS_H
@@ -0,0 +1,267 @@
+#include "image_cache.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+
+namespace browser {
+namespace rendering {
+
+ImageCache::ImageCache(size_t budget, size_t decodeThreads)
+    : m_activeDecodes(0)
+    , m_bytes(0)
+    , m_budget(budget)
+    , m_threadCount(std::max<size_t>(decodeThreads, 1))
+    , m_stopping(false)
+    , m_hits(0)
+    , m_misses(0)
+    , m_decodes(0)
+    , m_evictions(0)
+{
+}
+
+ImageCache::~ImageCache() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queueCondition.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+ImageCache& ImageCache::shared() {
+    static ImageCache cache;
+    return cache;
+}
+
+void ImageCache::setEncoded(const std::string& url, std::vector<uint8_t> data) {
+    setEncoded(url, std::make_shared<const std::vector<uint8_t>>(std::move(data)));
+}
+
+void ImageCache::setEncoded(const std::string& url, std::shared_ptr<const std::vector<uint8_t>> encoded) {
+    if (!encoded) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Key key{url, 0, 0};
+    auto found = m_index.find(key);
+    EntryList::iterator entry;
+    if (found != m_index.end()) {
+        entry = found->second;
+        m_bytes -= entry->bytes;
+        touch(entry);
+    } else {
+        m_entries.push_front(Entry{key, State::ENCODED, nullptr, nullptr, 0});
+        entry = m_entries.begin();
+        m_index.emplace(key, entry);
+    }
+    entry->encoded = encoded;
+    entry->bytes = encoded->size();
+    m_bytes += entry->bytes;
+
+    // Sizes asked for so far are decoded from these bytes
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->key.url != url || it == entry) {
+            continue;
+        }
+        m_bytes -= it->bytes;
+        it->bytes = 0;
+        it->image.reset();
+        queueDecode(it, encoded);
+    }
+    evict();
+}
+
+std::shared_ptr<const DecodedImage> ImageCache::find(const std::string& url, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Key key{url, width, height};
+    auto found = m_index.find(key);
+    if (found != m_index.end()) {
+        EntryList::iterator entry = found->second;
+        touch(entry);
+        if (entry->state == State::DECODED) {
+            ++m_hits;
+            return entry->image;
+        }
+        ++m_misses;
+        return nullptr;
+    }
+
+    ++m_misses;
+    m_entries.push_front(Entry{key, State::WAITING, nullptr, nullptr, 0});
+    EntryList::iterator entry = m_entries.begin();
+    m_index.emplace(key, entry);
+
+    auto encoded = m_index.find(Key{url, 0, 0});
+    if (encoded != m_index.end()) {
+        touch(encoded->second);
+        queueDecode(entry, encoded->second->encoded);
+    }
+    return nullptr;
+}
+
+void ImageCache::setDecodedCallback(DecodedCallback callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_decodedCallback = std::move(callback);
+}
+
+void ImageCache::waitForDecodes() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleCondition.wait(lock, [this] { return m_queue.empty() && m_activeDecodes == 0; });
+}
+
+size_t ImageCache::bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+size_t ImageCache::budget() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+void ImageCache::setBudget(size_t budget) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budget;
+    evict();
+}
+
+void ImageCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void ImageCache::trim(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    evictTo(bytes);
+}
+
+size_t ImageCache::hits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+size_t ImageCache::misses() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+size_t ImageCache::decodes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_decodes;
+}
+
+size_t ImageCache::evictions() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_evictions;
+}
+
+void ImageCache::resetCounters() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hits = 0;
+    m_misses = 0;
+    m_decodes = 0;
+    m_evictions = 0;
+}
+
+void ImageCache::queueDecode(EntryList::iterator entry, std::shared_ptr<const std::vector<uint8_t>> encoded) {
+    // The entry remembers which bytes it waits on, so a decode of bytes
+    // replaced since is dropped
+    entry->state = State::QUEUED;
+    entry->encoded = encoded;
+    m_queue.emplace_back(entry->key, std::move(encoded));
+    startThreads();
+    m_queueCondition.notify_one();
+}
+
+void ImageCache::touch(EntryList::iterator entry) {
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+}
+
+void ImageCache::evictTo(size_t bytes) {
+    // Decoded images and encoded bytes, oldest first; the newest entry is
+    // kept even if it alone is over the limit
+    auto it = m_entries.end();
+    while (m_bytes > bytes && it != m_entries.begin()) {
+        --it;
+        if (it == m_entries.begin()) {
+            break;
+        }
+        if (it->bytes == 0 || (it->state != State::DECODED && it->state != State::ENCODED)) {
+            continue;
+        }
+        m_bytes -= it->bytes;
+        m_index.erase(it->key);
+        it = m_entries.erase(it);
+        ++m_evictions;
+    }
+}
+
+void ImageCache::startThreads() {
+    if (!m_threads.empty() || m_stopping) {
+        return;
+    }
+    for (size_t i = 0; i < m_threadCount; ++i) {
+        m_threads.emplace_back(&ImageCache::runDecodeThread, this);
+    }
+}
+
+void ImageCache::runDecodeThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_queueCondition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        if (m_stopping) {
+            break;
+        }
+
+        Key key = std::move(m_queue.front().first);
+        std::shared_ptr<const std::vector<uint8_t>> encoded = std::move(m_queue.front().second);
+        m_queue.pop_front();
+        ++m_activeDecodes;
+        lock.unlock();
+
+        auto image = std::make_shared<DecodedImage>();
+        bool decoded = decodeImage(*encoded, key.width, key.height, *image);
+
+        lock.lock();
+        --m_activeDecodes;
+        ++m_decodes;
+        DecodedCallback callback;
+        auto found = m_index.find(key);
+        if (found != m_index.end() && found->second->state == State::QUEUED &&
+            found->second->encoded == encoded) {
+            Entry& entry = *found->second;
+            entry.encoded.reset();
+            if (decoded) {
+                entry.state = State::DECODED;
+                entry.bytes = image->bytes();
+                entry.image = std::move(image);
+                m_bytes += entry.bytes;
+                evict();
+                callback = m_decodedCallback;
+            } else {
+                entry.state = State::FAILED;
+            }
+        }
+        TRACE_COUNTER("image", "imageCacheBytes", static_cast<int64_t>(m_bytes));
+        if (m_queue.empty() && m_activeDecodes == 0) {
+            m_idleCondition.notify_all();
+        }
+
+        if (callback) {
+            lock.unlock();
+            callback(key.url);
+            lock.lock();
+        }
+    }
+}
+
+} // namespace rendering
+} // namespace browser
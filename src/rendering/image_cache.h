@@ -0,0 +1,143 @@
+#ifndef BROWSER_RENDERING_IMAGE_CACHE_H
+#define BROWSER_RENDERING_IMAGE_CACHE_H
+
+#include "image_decoder.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace rendering {
+
+// Decoded images shared by everything that paints, keyed by URL and the
+// size they're displayed at. Loaders hand over the encoded bytes once a
+// fetch completes (setEncoded); painters ask for an image at its display
+// size (find), which never blocks: on a miss the image is decoded on a
+// background thread, straight to the display size, and the painter draws a
+// placeholder until a later frame finds it. Decoded images and the encoded
+// bytes they come from share a byte budget; past it the least recently
+// used are evicted.
+class ImageCache {
+public:
+    using DecodedCallback = std::function<void(const std::string& url)>;
+
+    static constexpr size_t defaultBudget = 64 * 1024 * 1024;  // Bytes
+    static constexpr size_t defaultDecodeThreads = 2;
+
+    explicit ImageCache(size_t budget = defaultBudget, size_t decodeThreads = defaultDecodeThreads);
+    ~ImageCache();
+
+    ImageCache(const ImageCache&) = delete;
+    ImageCache& operator=(const ImageCache&) = delete;
+
+    // Process-wide cache
+    static ImageCache& shared();
+
+    // Encoded bytes of url. Decodes asked for before they arrived start
+    // now; images decoded from older bytes are dropped.
+    // The shared overload keeps the buffer it is given instead of copying.
+    void setEncoded(const std::string& url, std::vector<uint8_t> data);
+    void setEncoded(const std::string& url, std::shared_ptr<const std::vector<uint8_t>> data);
+
+    // The image for url decoded for display at width x height, or null
+    // until it has been decoded (or if it can't be)
+    std::shared_ptr<const DecodedImage> find(const std::string& url, int width, int height);
+
+    // Called on a decode thread after each decode, e.g. to repaint
+    void setDecodedCallback(DecodedCallback callback);
+
+    // Block until the queued decodes are done
+    void waitForDecodes();
+
+    // Bytes held, and the budget they're kept within
+    size_t bytes() const;
+    size_t budget() const;
+    void setBudget(size_t budget);
+    void clear();
+
+    // Evict least recently used images until at most bytes are held,
+    // leaving the budget as it is
+    void trim(size_t bytes);
+
+    // Counters since construction or resetCounters()
+    size_t hits() const;
+    size_t misses() const;
+    size_t decodes() const;
+    size_t evictions() const;
+    void resetCounters();
+
+private:
+    struct Key {
+        std::string url;
+        int width;   // 0 x 0 for the encoded bytes
+        int height;
+
+        bool operator==(const Key& other) const {
+            return width == other.width && height == other.height && url == other.url;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<std::string>()(key.url) ^ (static_cast<size_t>(key.width) * 31 + key.height) * 0x9E3779B9u;
+        }
+    };
+
+    enum class State {
+        ENCODED,  // Holds the encoded bytes
+        WAITING,  // For the encoded bytes
+        QUEUED,   // For a decode thread
+        DECODED,
+        FAILED
+    };
+
+    struct Entry {
+        Key key;
+        State state;
+        std::shared_ptr<const std::vector<uint8_t>> encoded;
+        std::shared_ptr<const DecodedImage> image;
+        size_t bytes;
+    };
+    using EntryList = std::list<Entry>;
+
+    // With m_mutex held
+    void queueDecode(EntryList::iterator entry, std::shared_ptr<const std::vector<uint8_t>> encoded);
+    void touch(EntryList::iterator entry);
+    void evict() { evictTo(m_budget); }
+    void evictTo(size_t bytes);
+    void startThreads();
+
+    void runDecodeThread();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueCondition;
+    std::condition_variable m_idleCondition;
+    EntryList m_entries;  // Most recently used first
+    std::unordered_map<Key, EntryList::iterator, KeyHash> m_index;
+    std::deque<std::pair<Key, std::shared_ptr<const std::vector<uint8_t>>>> m_queue;
+    size_t m_activeDecodes;
+    size_t m_bytes;
+    size_t m_budget;
+    size_t m_threadCount;
+    std::vector<std::thread> m_threads;
+    bool m_stopping;
+    DecodedCallback m_decodedCallback;
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_decodes;
+    size_t m_evictions;
+};
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_IMAGE_CACHE_H
@@ -0,0 +1,239 @@
+#include "image_decoder.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <cctype>
+
+namespace browser {
+namespace rendering {
+
+namespace {
+
+const int maxDimension = 32768;
+
+enum class Format {
+    BMP,
+    PPM,  // P6, RGB
+    PGM   // P5, gray
+};
+
+// Where the rows of an encoded image are
+struct Source {
+    Format format;
+    const uint8_t* data;
+    int width;
+    int height;
+    size_t offset;   // First stored row
+    size_t stride;   // Bytes per stored row
+    int bytesPerPixel;
+    bool bottomUp;
+    bool hasAlpha;
+};
+
+uint32_t readLE16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t readLE32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint32_t pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    if (a != 255) {
+        r = (r * a + 127) / 255;
+        g = (g * a + 127) / 255;
+        b = (b * a + 127) / 255;
+    }
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+bool parseBmp(const std::vector<uint8_t>& data, Source& source) {
+    if (data.size() < 54) {
+        return false;
+    }
+    const uint8_t* p = data.data();
+    uint32_t headerSize = readLE32(p + 14);
+    int32_t width = static_cast<int32_t>(readLE32(p + 18));
+    int32_t height = static_cast<int32_t>(readLE32(p + 22));
+    uint32_t bitsPerPixel = readLE16(p + 28);
+    uint32_t compression = readLE32(p + 30);
+    if (headerSize < 40 || (bitsPerPixel != 24 && bitsPerPixel != 32)) {
+        return false;
+    }
+
+    // BI_RGB, or BI_BITFIELDS with the usual BGRA masks
+    source.hasAlpha = false;
+    if (compression == 3) {
+        if (bitsPerPixel != 32 || data.size() < 66 || readLE32(p + 54) != 0x00FF0000 || readLE32(p + 58) != 0x0000FF00 ||
+            readLE32(p + 62) != 0x000000FF) {
+            return false;
+        }
+        source.hasAlpha = headerSize >= 56 && data.size() >= 70 && readLE32(p + 66) == 0xFF000000;
+    } else if (compression != 0) {
+        return false;
+    }
+
+    source.format = Format::BMP;
+    source.width = width;
+    source.bottomUp = height > 0;
+    source.height = height > 0 ? height : -height;
+    source.bytesPerPixel = static_cast<int>(bitsPerPixel / 8);
+    source.stride = ((static_cast<size_t>(bitsPerPixel) * width + 31) / 32) * 4;
+    source.offset = readLE32(p + 10);
+    return true;
+}
+
+// Next whitespace-separated number of a PNM header, skipping comments
+bool readPnmNumber(const std::vector<uint8_t>& data, size_t& pos, int& value) {
+    while (pos < data.size()) {
+        if (data[pos] == '#') {
+            while (pos < data.size() && data[pos] != '\n') {
+                ++pos;
+            }
+        } else if (std::isspace(data[pos])) {
+            ++pos;
+        } else {
+            break;
+        }
+    }
+    if (pos >= data.size() || !std::isdigit(data[pos])) {
+        return false;
+    }
+    value = 0;
+    while (pos < data.size() && std::isdigit(data[pos]) && value <= maxDimension) {
+        value = value * 10 + (data[pos++] - '0');
+    }
+    return true;
+}
+
+bool parsePnm(const std::vector<uint8_t>& data, Source& source) {
+    size_t pos = 2;
+    int maxValue = 0;
+    if (!readPnmNumber(data, pos, source.width) || !readPnmNumber(data, pos, source.height) ||
+        !readPnmNumber(data, pos, maxValue) || maxValue != 255 || pos >= data.size()) {
+        return false;
+    }
+    source.format = data[1] == '6' ? Format::PPM : Format::PGM;
+    source.bytesPerPixel = source.format == Format::PPM ? 3 : 1;
+    source.stride = static_cast<size_t>(source.width) * source.bytesPerPixel;
+    source.offset = pos + 1;  // One whitespace byte ends the header
+    source.bottomUp = false;
+    source.hasAlpha = false;
+    return true;
+}
+
+bool parse(const std::vector<uint8_t>& data, Source& source) {
+    bool parsed = false;
+    if (data.size() >= 2 && data[0] == 'B' && data[1] == 'M') {
+        parsed = parseBmp(data, source);
+    } else if (data.size() >= 2 && data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+        parsed = parsePnm(data, source);
+    }
+    if (!parsed || source.width <= 0 || source.height <= 0 || source.width > maxDimension ||
+        source.height > maxDimension) {
+        return false;
+    }
+    source.data = data.data();
+    return source.offset + source.stride * source.height <= data.size();
+}
+
+// Source row y, top first, as packed premultiplied pixels
+void readRow(const Source& source, int y, uint32_t* out) {
+    int stored = source.bottomUp ? source.height - 1 - y : y;
+    const uint8_t* p = source.data + source.offset + source.stride * stored;
+    switch (source.format) {
+        case Format::BMP:
+            for (int x = 0; x < source.width; ++x, p += source.bytesPerPixel) {
+                uint32_t alpha = source.hasAlpha ? p[3] : 255;
+                out[x] = pack(p[2], p[1], p[0], alpha);
+            }
+            break;
+        case Format::PPM:
+            for (int x = 0; x < source.width; ++x, p += 3) {
+                out[x] = pack(p[0], p[1], p[2], 255);
+            }
+            break;
+        case Format::PGM:
+            for (int x = 0; x < source.width; ++x, ++p) {
+                out[x] = pack(p[0], p[0], p[0], 255);
+            }
+            break;
+    }
+}
+
+} // namespace
+
+bool imageSize(const std::vector<uint8_t>& data, int& width, int& height) {
+    Source source;
+    if (!parse(data, source)) {
+        return false;
+    }
+    width = source.width;
+    height = source.height;
+    return true;
+}
+
+bool decodeImage(const std::vector<uint8_t>& data, int targetWidth, int targetHeight, DecodedImage& image) {
+    TRACE_SCOPE("image", "decodeImage");
+    ALLOC_SCOPE(RENDERING);
+
+    Source source;
+    if (!parse(data, source)) {
+        return false;
+    }
+    int width = targetWidth > 0 && targetWidth < source.width ? targetWidth : source.width;
+    int height = targetHeight > 0 && targetHeight < source.height ? targetHeight : source.height;
+    image.width = width;
+    image.height = height;
+    image.sourceWidth = source.width;
+    image.sourceHeight = source.height;
+    image.pixels.assign(static_cast<size_t>(width) * height, 0);
+
+    if (width == source.width && height == source.height) {
+        for (int y = 0; y < height; ++y) {
+            readRow(source, y, image.pixels.data() + static_cast<size_t>(y) * width);
+        }
+        return true;
+    }
+
+    // Each target pixel averages the block of source pixels it covers
+    std::vector<uint32_t> row(source.width);
+    std::vector<uint64_t> sums(static_cast<size_t>(width) * 4);
+    std::vector<int> firstColumn(width + 1);
+    for (int x = 0; x <= width; ++x) {
+        firstColumn[x] = static_cast<int>(static_cast<int64_t>(x) * source.width / width);
+    }
+    for (int y = 0; y < height; ++y) {
+        int sy0 = static_cast<int>(static_cast<int64_t>(y) * source.height / height);
+        int sy1 = static_cast<int>(static_cast<int64_t>(y + 1) * source.height / height);
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int sy = sy0; sy < sy1; ++sy) {
+            readRow(source, sy, row.data());
+            for (int x = 0; x < width; ++x) {
+                uint64_t* sum = &sums[static_cast<size_t>(x) * 4];
+                for (int sx = firstColumn[x]; sx < firstColumn[x + 1]; ++sx) {
+                    uint32_t pixel = row[sx];
+                    sum[0] += pixel & 0xFF;
+                    sum[1] += (pixel >> 8) & 0xFF;
+                    sum[2] += (pixel >> 16) & 0xFF;
+                    sum[3] += pixel >> 24;
+                }
+            }
+        }
+
+        uint32_t* out = image.pixels.data() + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            const uint64_t* sum = &sums[static_cast<size_t>(x) * 4];
+            uint64_t count = static_cast<uint64_t>(firstColumn[x + 1] - firstColumn[x]) * (sy1 - sy0);
+            uint32_t channels[4];
+            for (int c = 0; c < 4; ++c) {
+                channels[c] = static_cast<uint32_t>((sum[c] + count / 2) / count);
+            }
+            out[x] = channels[0] | (channels[1] << 8) | (channels[2] << 16) | (channels[3] << 24);
+        }
+    }
+    return true;
+}
+
+} // namespace rendering
+} // namespace browser
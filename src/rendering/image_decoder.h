@@ -0,0 +1,36 @@
+#ifndef BROWSER_RENDERING_IMAGE_DECODER_H
+#define BROWSER_RENDERING_IMAGE_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace browser {
+namespace rendering {
+
+// A decoded image: premultiplied pixels packed as in Framebuffer
+struct DecodedImage {
+    int width = 0;
+    int height = 0;
+    int sourceWidth = 0;   // Intrinsic size
+    int sourceHeight = 0;
+    std::vector<uint32_t> pixels;
+
+    size_t bytes() const { return sizeof(DecodedImage) + pixels.size() * sizeof(uint32_t); }
+};
+
+// Intrinsic size of an encoded image; false if the format isn't supported
+// or the header is malformed
+bool imageSize(const std::vector<uint8_t>& data, int& width, int& height);
+
+// Decode an image straight to targetWidth x targetHeight, box filtering
+// source rows into the target as they're decoded so the full-size image is
+// never held. Targets larger than the source (or <= 0) decode at the
+// source size on that axis. Supports uncompressed BMP (24 and 32 bit) and
+// binary PPM/PGM.
+bool decodeImage(const std::vector<uint8_t>& data, int targetWidth, int targetHeight, DecodedImage& image);
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_IMAGE_DECODER_H
@@ -0,0 +1,336 @@
+#include "image_encoder.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+namespace browser {
+namespace rendering {
+
+namespace {
+
+const size_t windowSize = 32768;   // Deflate's largest distance
+const size_t minMatch = 3;
+const size_t maxMatch = 258;
+const int hashBits = 15;
+const int maxChain = 16;           // Hash chain candidates tried per position
+
+const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                   193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                   6145, 8193, 12289, 16385, 24577};
+const uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                   6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+uint32_t reverseBits(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    return reversed;
+}
+
+// Deflate's fixed literal/length code, bit-reversed for LSB-first output
+struct FixedCode {
+    uint16_t bits;
+    uint8_t length;
+};
+
+const std::array<FixedCode, 288>& fixedCodes() {
+    static const std::array<FixedCode, 288> codes = [] {
+        std::array<FixedCode, 288> table{};
+        for (uint32_t symbol = 0; symbol < 288; ++symbol) {
+            uint32_t code;
+            int length;
+            if (symbol < 144) {
+                code = 0x30 + symbol;
+                length = 8;
+            } else if (symbol < 256) {
+                code = 0x190 + (symbol - 144);
+                length = 9;
+            } else if (symbol < 280) {
+                code = symbol - 256;
+                length = 7;
+            } else {
+                code = 0xC0 + (symbol - 280);
+                length = 8;
+            }
+            table[symbol] = FixedCode{static_cast<uint16_t>(reverseBits(code, length)),
+                                      static_cast<uint8_t>(length)};
+        }
+        return table;
+    }();
+    return codes;
+}
+
+const std::array<uint32_t, 256>& crcTable() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+        return entries;
+    }();
+    return table;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    const std::array<uint32_t, 256>& table = crcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t adler32(const uint8_t* data, size_t size) {
+    // 5552 bytes is the most that can be summed before b overflows
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t chunk = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < chunk; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += chunk;
+        size -= chunk;
+    }
+    return (b << 16) | a;
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : m_out(out), m_buffer(0), m_count(0) {}
+
+    void write(uint32_t bits, int count) {
+        m_buffer |= static_cast<uint64_t>(bits) << m_count;
+        m_count += count;
+        while (m_count >= 8) {
+            m_out.push_back(static_cast<uint8_t>(m_buffer));
+            m_buffer >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    void flush() {
+        if (m_count > 0) {
+            m_out.push_back(static_cast<uint8_t>(m_buffer));
+        }
+        m_buffer = 0;
+        m_count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& m_out;
+    uint64_t m_buffer;
+    int m_count;
+};
+
+uint32_t hash3(const uint8_t* p) {
+    uint32_t key = (static_cast<uint32_t>(p[0]) << 16) | (p[1] << 8) | p[2];
+    return (key * 2654435761u) >> (32 - hashBits);
+}
+
+size_t matchLength(const uint8_t* data, size_t position, size_t distance, size_t limit) {
+    const uint8_t* a = data + position;
+    const uint8_t* b = a - distance;
+    size_t length = 0;
+    while (length < limit && a[length] == b[length]) {
+        ++length;
+    }
+    return length;
+}
+
+// A zlib stream of data in one fixed Huffman block. stride is the distance
+// to the byte above in the image, tried along with the pixel to the left.
+void deflate(const uint8_t* data, size_t size, size_t stride, std::vector<uint8_t>& out) {
+    const std::array<FixedCode, 288>& codes = fixedCodes();
+    out.push_back(0x78);  // Deflate, 32K window
+    out.push_back(0x01);
+
+    BitWriter writer(out);
+    writer.write(1, 1);   // Final block
+    writer.write(1, 2);   // Fixed Huffman codes
+
+    std::vector<int32_t> head(size_t(1) << hashBits, -1);
+    std::vector<int32_t> previous(windowSize, -1);
+    auto insert = [&](size_t position) {
+        if (position + minMatch <= size) {
+            uint32_t h = hash3(data + position);
+            previous[position & (windowSize - 1)] = head[h];
+            head[h] = static_cast<int32_t>(position);
+        }
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        size_t limit = std::min(maxMatch, size - i);
+        size_t best = 0;
+        size_t bestDistance = 0;
+        auto tryDistance = [&](size_t distance) {
+            if (distance == 0 || distance > i || distance > windowSize) {
+                return;
+            }
+            size_t length = matchLength(data, i, distance, limit);
+            if (length > best) {
+                best = length;
+                bestDistance = distance;
+            }
+        };
+
+        if (limit >= minMatch) {
+            tryDistance(4);
+            if (best < limit) {
+                tryDistance(stride);
+            }
+            if (best < limit) {
+                int32_t candidate = head[hash3(data + i)];
+                for (int probe = 0; probe < maxChain && candidate >= 0 && best < limit; ++probe) {
+                    size_t distance = i - static_cast<size_t>(candidate);
+                    if (distance > windowSize) {
+                        break;
+                    }
+                    tryDistance(distance);
+                    // Slots are reused every window; a later position means
+                    // the chain has ended
+                    int32_t next = previous[candidate & (windowSize - 1)];
+                    if (next >= candidate) {
+                        break;
+                    }
+                    candidate = next;
+                }
+            }
+        }
+
+        if (best >= minMatch) {
+            int lengthCode = static_cast<int>(std::upper_bound(lengthBase, lengthBase + 29, best) - lengthBase) - 1;
+            const FixedCode& code = codes[257 + lengthCode];
+            writer.write(code.bits, code.length);
+            writer.write(static_cast<uint32_t>(best - lengthBase[lengthCode]), lengthExtra[lengthCode]);
+
+            int distanceCode = static_cast<int>(
+                std::upper_bound(distanceBase, distanceBase + 30, bestDistance) - distanceBase) - 1;
+            writer.write(reverseBits(static_cast<uint32_t>(distanceCode), 5), 5);
+            writer.write(static_cast<uint32_t>(bestDistance - distanceBase[distanceCode]), distanceExtra[distanceCode]);
+
+            for (size_t end = i + best; i < end; ++i) {
+                insert(i);
+            }
+        } else {
+            const FixedCode& code = codes[data[i]];
+            writer.write(code.bits, code.length);
+            insert(i);
+            ++i;
+        }
+    }
+
+    const FixedCode& endOfBlock = codes[256];
+    writer.write(endOfBlock.bits, endOfBlock.length);
+    writer.flush();
+
+    uint32_t checksum = adler32(data, size);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(checksum >> shift));
+    }
+}
+
+void writeBE32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void writeChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data) {
+    writeBE32(png, static_cast<uint32_t>(data.size()));
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    writeBE32(png, crc32(png.data() + start, png.size() - start));
+}
+
+} // namespace
+
+bool encodePNG(const Framebuffer& framebuffer, std::vector<uint8_t>& png) {
+    TRACE_SCOPE("image", "encodePNG");
+    ALLOC_SCOPE(RENDERING);
+
+    png.clear();
+    int width = framebuffer.width();
+    int height = framebuffer.height();
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    // Filter type 0 (none) rows of unpremultiplied RGBA
+    size_t stride = static_cast<size_t>(width) * 4 + 1;
+    std::vector<uint8_t> raw(stride * height);
+    for (int y = 0; y < height; ++y) {
+        uint8_t* out = raw.data() + stride * y;
+        *out++ = 0;
+        const uint32_t* row = framebuffer.row(y);
+        for (int x = 0; x < width; ++x) {
+            uint32_t pixel = row[x];
+            uint32_t alpha = pixel >> 24;
+            if (alpha == 255 || alpha == 0) {
+                uint32_t value = alpha == 0 ? 0 : pixel;
+                out[0] = static_cast<uint8_t>(value);
+                out[1] = static_cast<uint8_t>(value >> 8);
+                out[2] = static_cast<uint8_t>(value >> 16);
+                out[3] = static_cast<uint8_t>(alpha);
+            } else {
+                for (int channel = 0; channel < 3; ++channel) {
+                    uint32_t value = (pixel >> (channel * 8)) & 0xFF;
+                    out[channel] = static_cast<uint8_t>(std::min<uint32_t>((value * 255 + alpha / 2) / alpha, 255));
+                }
+                out[3] = static_cast<uint8_t>(alpha);
+            }
+            out += 4;
+        }
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    png.insert(png.end(), signature, signature + 8);
+
+    std::vector<uint8_t> header;
+    writeBE32(header, static_cast<uint32_t>(width));
+    writeBE32(header, static_cast<uint32_t>(height));
+    header.push_back(8);  // Bits per channel
+    header.push_back(6);  // RGBA
+    header.push_back(0);  // Deflate
+    header.push_back(0);  // Adaptive filtering
+    header.push_back(0);  // Not interlaced
+    writeChunk(png, "IHDR", header);
+
+    std::vector<uint8_t> compressed;
+    compressed.reserve(raw.size() / 8);
+    deflate(raw.data(), raw.size(), stride, compressed);
+    writeChunk(png, "IDAT", compressed);
+    writeChunk(png, "IEND", std::vector<uint8_t>());
+    return true;
+}
+
+bool writePNG(const Framebuffer& framebuffer, const std::string& path) {
+    std::vector<uint8_t> png;
+    if (!encodePNG(framebuffer, png)) {
+        return false;
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+    return static_cast<bool>(file);
+}
+
+} // namespace rendering
+} // namespace browser
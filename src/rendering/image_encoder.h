@@ -0,0 +1,25 @@
+#ifndef BROWSER_RENDERING_IMAGE_ENCODER_H
+#define BROWSER_RENDERING_IMAGE_ENCODER_H
+
+#include "framebuffer.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace browser {
+namespace rendering {
+
+// Encode a framebuffer as an 8-bit RGBA PNG (unpremultiplied) into png;
+// false if it has no pixels. Rows are deflated with fixed Huffman codes and
+// a matcher that tries the pixel to the left and the pixel above before a
+// hash chain, which suits rendered pages: long runs of flat color and rows
+// repeating the one above.
+bool encodePNG(const Framebuffer& framebuffer, std::vector<uint8_t>& png);
+
+// Encode and write to path; false if the file can't be written
+bool writePNG(const Framebuffer& framebuffer, const std::string& path);
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_IMAGE_ENCODER_H
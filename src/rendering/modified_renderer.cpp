@@ -58,28 +58,10 @@ void Renderer::render(layout::Box* rootBox, RenderTarget* target) {
         return;
     }
     
-    // Check if target is a CustomRenderTarget
-    auto customTarget = dynamic_cast<CustomRenderTarget*>(target);
-    if (customTarget) {
-        // Begin rendering frame
-        auto ctx = customTarget->getCustomContext();
-        if (ctx) {
-            ctx->beginFrame(target->width(), target->height(), 1.0f);
-            
-            // Create a paint context for the root box
-            PaintContext context = m_paintSystem->createContext(rootBox);
-            m_paintSystem->paintBox(rootBox, context);
-            renderCustomDisplayList(context.displayList(), ctx);
-            
-            // End rendering frame
-            ctx->endFrame();
-        }
-    } else {
-        // Create a paint context for the root box
-        PaintContext context = m_paintSystem->createContext(rootBox);
-        m_paintSystem->paintBox(rootBox, context);
-        renderDisplayList(context.displayList(), target);
-    }
+    // Create a paint context for the root box
+    PaintContext context = m_paintSystem->createContext(rootBox);
+    m_paintSystem->paintBox(rootBox, context);
+    renderDisplayList(context.displayList(), target);
 }
 
 void Renderer::renderDisplayList(const DisplayList& displayList, RenderTarget* target) {
@@ -87,6 +69,12 @@ void Renderer::renderDisplayList(const DisplayList& displayList, RenderTarget* t
         return;
     }
     
+    // Custom targets rasterize the list into their framebuffer
+    if (auto customTarget = dynamic_cast<CustomRenderTarget*>(target)) {
+        customTarget->rasterize(displayList);
+        return;
+    }
+    
     // Get the rendering context from the target
     RenderingContext* baseContext = target->context();
     if (!baseContext) {
@@ -108,77 +96,76 @@ void Renderer::renderDisplayList(const DisplayList& displayList, RenderTarget* t
     // Render the display list to the context
     if (m_paintSystem) {
         // Paint each display item manually since we're using our custom context
-        for (const auto& item : displayList.items()) {
-            if (!item) continue;
-            
-            switch (item->type()) {
+        for (const DisplayItem& item : displayList) {
+            switch (item.type) {
                 case DisplayItemType::BACKGROUND: {
-                    auto bgItem = static_cast<BackgroundDisplayItem*>(item.get());
-                    context->setFillColor(bgItem->color());
-                    context->fillRect(bgItem->rect().x, bgItem->rect().y, 
-                                    bgItem->rect().width, bgItem->rect().height);
+                    const auto& bgItem = item.as<BackgroundDisplayItem>();
+                    context->setFillColor(bgItem.color);
+                    context->fillRect(bgItem.rect.x, bgItem.rect.y, 
+                                    bgItem.rect.width, bgItem.rect.height);
                     break;
                 }
                 
                 case DisplayItemType::BORDER: {
-                    auto borderItem = static_cast<BorderDisplayItem*>(item.get());
-                    context->setStrokeColor(borderItem->color());
-                    float maxWidth = std::max({borderItem->topWidth(), borderItem->rightWidth(), 
-                                             borderItem->bottomWidth(), borderItem->leftWidth()});
-                    context->strokeRect(borderItem->rect().x, borderItem->rect().y, 
-                                      borderItem->rect().width, borderItem->rect().height, maxWidth);
+                    const auto& borderItem = item.as<BorderDisplayItem>();
+                    context->setStrokeColor(borderItem.color);
+                    float maxWidth = std::max({borderItem.topWidth, borderItem.rightWidth, 
+                                             borderItem.bottomWidth, borderItem.leftWidth});
+                    context->strokeRect(borderItem.rect.x, borderItem.rect.y, 
+                                      borderItem.rect.width, borderItem.rect.height, maxWidth);
                     break;
                 }
                 
                 case DisplayItemType::TEXT: {
-                    auto textItem = static_cast<TextDisplayItem*>(item.get());
-                    context->setTextColor(textItem->color());
-                    context->drawText(textItem->text(), textItem->x(), textItem->y(), 
-                                    textItem->fontFamily(), textItem->fontSize());
+                    const auto& textItem = item.as<TextDisplayItem>();
+                    context->setTextColor(textItem.color);
+                    context->drawText(displayList.string(textItem.text), textItem.x, textItem.y, 
+                                    displayList.string(textItem.fontFamily), textItem.fontSize);
                     break;
                 }
                 
                 case DisplayItemType::IMAGE: {
                     // Draw a placeholder for images
-                    auto imageItem = static_cast<ImageDisplayItem*>(item.get());
+                    const auto& imageItem = item.as<ImageDisplayItem>();
                     context->setFillColor(Color(200, 200, 200)); // Light gray
-                    context->fillRect(imageItem->rect().x, imageItem->rect().y, 
-                                    imageItem->rect().width, imageItem->rect().height);
+                    context->fillRect(imageItem.rect.x, imageItem.rect.y, 
+                                    imageItem.rect.width, imageItem.rect.height);
                     
                     context->setStrokeColor(Color(100, 100, 100)); // Dark gray
-                    context->strokeRect(imageItem->rect().x, imageItem->rect().y, 
-                                      imageItem->rect().width, imageItem->rect().height, 1.0f);
+                    context->strokeRect(imageItem.rect.x, imageItem.rect.y, 
+                                      imageItem.rect.width, imageItem.rect.height, 1.0f);
                     
                     // Draw image URL as text
                     context->setTextColor(Color(0, 0, 0));
-                    context->drawText("Image: " + imageItem->url(), 
-                                    imageItem->rect().x + 5, imageItem->rect().y + 15, 
+                    context->drawText("Image: " + std::string(displayList.string(imageItem.url)), 
+                                    imageItem.rect.x + 5, imageItem.rect.y + 15, 
                                     "sans", 10.0f);
                     break;
                 }
                 
                 case DisplayItemType::RECT: {
-                    auto rectItem = static_cast<RectDisplayItem*>(item.get());
-                    if (rectItem->filled()) {
-                        context->setFillColor(rectItem->color());
-                        context->fillRect(rectItem->rect().x, rectItem->rect().y, 
-                                        rectItem->rect().width, rectItem->rect().height);
+                    const auto& rectItem = item.as<RectDisplayItem>();
+                    if (rectItem.filled) {
+                        context->setFillColor(rectItem.color);
+                        context->fillRect(rectItem.rect.x, rectItem.rect.y, 
+                                        rectItem.rect.width, rectItem.rect.height);
                     } else {
-                        context->setStrokeColor(rectItem->color());
-                        context->strokeRect(rectItem->rect().x, rectItem->rect().y, 
-                                          rectItem->rect().width, rectItem->rect().height, 1.0f);
+                        context->setStrokeColor(rectItem.color);
+                        context->strokeRect(rectItem.rect.x, rectItem.rect.y, 
+                                          rectItem.rect.width, rectItem.rect.height, 1.0f);
                     }
                     break;
                 }
                 
                 case DisplayItemType::TRANSFORM: {
-                    auto transformItem = static_cast<TransformDisplayItem*>(item.get());
-                    context->translate(transformItem->dx(), transformItem->dy());
+                    const auto& transformItem = item.as<TransformDisplayItem>();
+                    context->translate(transformItem.dx, transformItem.dy);
                     break;
                 }
                 
-                case DisplayItemType::CLIP: {
-                    // Clipping not implemented in our simple context
+                case DisplayItemType::CLIP:
+                case DisplayItemType::LINE: {
+                    // Clipping and lines not implemented in our simple context
                     break;
                 }
             }
@@ -200,60 +187,58 @@ void Renderer::renderCustomDisplayList(const DisplayList& displayList, CustomRen
     ctx->fill();
     
     // Render each display item
-    for (const auto& item : displayList.items()) {
-        if (!item) continue;
-        
-        switch (item->type()) {
+    for (const DisplayItem& item : displayList) {
+        switch (item.type) {
             case DisplayItemType::BACKGROUND: {
-                auto bgItem = static_cast<BackgroundDisplayItem*>(item.get());
+                const auto& bgItem = item.as<BackgroundDisplayItem>();
                 ctx->beginPath();
-                ctx->rect(bgItem->rect().x, bgItem->rect().y, 
-                          bgItem->rect().width, bgItem->rect().height);
+                ctx->rect(bgItem.rect.x, bgItem.rect.y, 
+                          bgItem.rect.width, bgItem.rect.height);
                 Paint bgPaint;
-                bgPaint.setColor(bgItem->color());
+                bgPaint.setColor(bgItem.color);
                 ctx->setFillPaint(bgPaint);
                 ctx->fill();
                 break;
             }
             
             case DisplayItemType::BORDER: {
-                auto borderItem = static_cast<BorderDisplayItem*>(item.get());
+                const auto& borderItem = item.as<BorderDisplayItem>();
                 ctx->beginPath();
-                ctx->rect(borderItem->rect().x, borderItem->rect().y, 
-                         borderItem->rect().width, borderItem->rect().height);
+                ctx->rect(borderItem.rect.x, borderItem.rect.y, 
+                         borderItem.rect.width, borderItem.rect.height);
                 Paint borderPaint;
-                borderPaint.setColor(borderItem->color());
+                borderPaint.setColor(borderItem.color);
                 ctx->setStrokePaint(borderPaint);
-                ctx->setStrokeWidth(std::max({borderItem->topWidth(), borderItem->rightWidth(), 
-                                            borderItem->bottomWidth(), borderItem->leftWidth()}));
+                ctx->setStrokeWidth(std::max({borderItem.topWidth, borderItem.rightWidth, 
+                                            borderItem.bottomWidth, borderItem.leftWidth}));
                 ctx->stroke();
                 break;
             }
             
             case DisplayItemType::TEXT: {
-                auto textItem = static_cast<TextDisplayItem*>(item.get());
-                ctx->setFont(Font(textItem->fontFamily(), textItem->fontSize()));
+                const auto& textItem = item.as<TextDisplayItem>();
+                ctx->setFont(Font(displayList.string(textItem.fontFamily), textItem.fontSize));
                 Paint textPaint;
-                textPaint.setColor(textItem->color());
+                textPaint.setColor(textItem.color);
                 ctx->setFillPaint(textPaint);
-                ctx->text(textItem->x(), textItem->y(), textItem->text());
+                ctx->text(textItem.x, textItem.y, displayList.string(textItem.text));
                 break;
             }
             
             case DisplayItemType::IMAGE: {
-                auto imageItem = static_cast<ImageDisplayItem*>(item.get());
+                const auto& imageItem = item.as<ImageDisplayItem>();
                 // Draw a placeholder for images
                 ctx->beginPath();
-                ctx->rect(imageItem->rect().x, imageItem->rect().y, 
-                         imageItem->rect().width, imageItem->rect().height);
+                ctx->rect(imageItem.rect.x, imageItem.rect.y, 
+                         imageItem.rect.width, imageItem.rect.height);
                 Paint grayPaint;
                 grayPaint.setColor(Color(200, 200, 200)); // Light gray
                 ctx->setFillPaint(grayPaint);
                 ctx->fill();
                 
                 ctx->beginPath();
-                ctx->rect(imageItem->rect().x, imageItem->rect().y, 
-                         imageItem->rect().width, imageItem->rect().height);
+                ctx->rect(imageItem.rect.x, imageItem.rect.y, 
+                         imageItem.rect.width, imageItem.rect.height);
                 Paint darkGrayPaint;
                 darkGrayPaint.setColor(Color(100, 100, 100)); // Dark gray
                 ctx->setStrokePaint(darkGrayPaint);
@@ -265,19 +250,19 @@ void Renderer::renderCustomDisplayList(const DisplayList& displayList, CustomRen
                 Paint blackPaint;
                 blackPaint.setColor(Color(0, 0, 0));
                 ctx->setFillPaint(blackPaint);
-                ctx->text(imageItem->rect().x + 5, imageItem->rect().y + 15, 
-                         "Image: " + imageItem->url());
+                ctx->text(imageItem.rect.x + 5, imageItem.rect.y + 15, 
+                         "Image: " + std::string(displayList.string(imageItem.url)));
                 break;
             }
             
             case DisplayItemType::RECT: {
-                auto rectItem = static_cast<RectDisplayItem*>(item.get());
+                const auto& rectItem = item.as<RectDisplayItem>();
                 ctx->beginPath();
-                ctx->rect(rectItem->rect().x, rectItem->rect().y, 
-                         rectItem->rect().width, rectItem->rect().height);
+                ctx->rect(rectItem.rect.x, rectItem.rect.y, 
+                         rectItem.rect.width, rectItem.rect.height);
                 Paint rectPaint;
-                rectPaint.setColor(rectItem->color());
-                if (rectItem->filled()) {
+                rectPaint.setColor(rectItem.color);
+                if (rectItem.filled) {
                     ctx->setFillPaint(rectPaint);
                     ctx->fill();
                 } else {
@@ -289,15 +274,20 @@ void Renderer::renderCustomDisplayList(const DisplayList& displayList, CustomRen
             }
             
             case DisplayItemType::TRANSFORM: {
-                auto transformItem = static_cast<TransformDisplayItem*>(item.get());
-                ctx->translate(transformItem->dx(), transformItem->dy());
+                const auto& transformItem = item.as<TransformDisplayItem>();
+                ctx->translate(transformItem.dx, transformItem.dy);
                 break;
             }
             
             case DisplayItemType::CLIP: {
-                auto clipItem = static_cast<ClipDisplayItem*>(item.get());
-                ctx->scissor(clipItem->rect().x, clipItem->rect().y, 
-                            clipItem->rect().width, clipItem->rect().height);
+                const auto& clipItem = item.as<ClipDisplayItem>();
+                ctx->scissor(clipItem.rect.x, clipItem.rect.y, 
+                            clipItem.rect.width, clipItem.rect.height);
+                break;
+            }
+            
+            case DisplayItemType::LINE: {
+                // Lines not implemented here
                 break;
             }
         }
@@ -324,7 +314,7 @@ Color Renderer::getBoxBackgroundColor(layout::Box* box) {
     }
     
     // Get background color from style
-    css::Value bgColorValue = box->style().getProperty("background-color");
+    const css::Value& bgColorValue = box->style().getProperty(css::PropertyId::BACKGROUND_COLOR);
     return Color::fromCssColor(bgColorValue);
 }
 
@@ -334,7 +324,7 @@ Color Renderer::getBoxBorderColor(layout::Box* box) {
     }
     
     // Get border color from style
-    css::Value borderColorValue = box->style().getProperty("border-color");
+    const css::Value& borderColorValue = box->style().getProperty(css::PropertyId::BORDER_COLOR);
     return Color::fromCssColor(borderColorValue);
 }
 
@@ -344,7 +334,7 @@ Color Renderer::getBoxTextColor(layout::Box* box) {
     }
     
     // Get text color from style
-    css::Value textColorValue = box->style().getProperty("color");
+    const css::Value& textColorValue = box->style().getProperty(css::PropertyId::COLOR);
     return Color::fromCssColor(textColorValue);
 }
 
@@ -1,390 +1,658 @@
 #include "paint_system.h"
 #include "custom_render_target.h"
+#include "compositor.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
 namespace browser {
 namespace rendering {
 
-//-----------------------------------------------------------------------------
-// DisplayItem Implementation
-//-----------------------------------------------------------------------------
+namespace {
 
-DisplayItem::DisplayItem(DisplayItemType type)
-    : m_type(type)
-{
+bool sameRect(const layout::Rect& a, const layout::Rect& b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
 }
 
-DisplayItem::~DisplayItem() {
+bool sameColor(const Color& a, const Color& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
 }
 
-//-----------------------------------------------------------------------------
-// BackgroundDisplayItem Implementation
-//-----------------------------------------------------------------------------
-
-BackgroundDisplayItem::BackgroundDisplayItem(const layout::Rect& rect, const Color& color)
-    : DisplayItem(DisplayItemType::BACKGROUND)
-    , m_rect(rect)
-    , m_color(color)
-{
-}
-
-BackgroundDisplayItem::~BackgroundDisplayItem() {
-}
-
-void BackgroundDisplayItem::paint(RenderingContext* context) {
-    if (!context) {
-        return;
+// Items are compared field by field; their padding bytes are undefined
+bool sameItem(const DisplayList& list, const DisplayItem& item,
+              const DisplayList& otherList, const DisplayItem& other) {
+    if (item.type != other.type) {
+        return false;
     }
-    
-    // Try to cast to our custom context type
-    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        // Set fill color and draw rectangle
-        customContext->setFillColor(m_color);
-        customContext->fillRect(m_rect.x, m_rect.y, m_rect.width, m_rect.height);
+    switch (item.type) {
+        case DisplayItemType::BACKGROUND: {
+            const auto& a = item.as<BackgroundDisplayItem>();
+            const auto& b = other.as<BackgroundDisplayItem>();
+            return sameRect(a.rect, b.rect) && sameColor(a.color, b.color);
+        }
+        case DisplayItemType::BORDER: {
+            const auto& a = item.as<BorderDisplayItem>();
+            const auto& b = other.as<BorderDisplayItem>();
+            return sameRect(a.rect, b.rect) && sameColor(a.color, b.color) && a.topWidth == b.topWidth &&
+                   a.rightWidth == b.rightWidth && a.bottomWidth == b.bottomWidth && a.leftWidth == b.leftWidth;
+        }
+        case DisplayItemType::TEXT: {
+            const auto& a = item.as<TextDisplayItem>();
+            const auto& b = other.as<TextDisplayItem>();
+            return a.x == b.x && a.y == b.y && a.fontSize == b.fontSize && sameColor(a.color, b.color) &&
+                   list.string(a.text) == otherList.string(b.text) &&
+                   list.string(a.fontFamily) == otherList.string(b.fontFamily);
+        }
+        case DisplayItemType::IMAGE: {
+            const auto& a = item.as<ImageDisplayItem>();
+            const auto& b = other.as<ImageDisplayItem>();
+            return sameRect(a.rect, b.rect) && list.string(a.url) == otherList.string(b.url);
+        }
+        case DisplayItemType::RECT: {
+            const auto& a = item.as<RectDisplayItem>();
+            const auto& b = other.as<RectDisplayItem>();
+            return sameRect(a.rect, b.rect) && sameColor(a.color, b.color) && a.filled == b.filled;
+        }
+        case DisplayItemType::TRANSFORM: {
+            const auto& a = item.as<TransformDisplayItem>();
+            const auto& b = other.as<TransformDisplayItem>();
+            return a.dx == b.dx && a.dy == b.dy;
+        }
+        case DisplayItemType::CLIP:
+            return sameRect(item.as<ClipDisplayItem>().rect, other.as<ClipDisplayItem>().rect);
+        case DisplayItemType::LINE: {
+            const auto& a = item.as<LineDisplayItem>();
+            const auto& b = other.as<LineDisplayItem>();
+            return a.x1 == b.x1 && a.y1 == b.y1 && a.x2 == b.x2 && a.y2 == b.y2 &&
+                   sameColor(a.color, b.color) && a.thickness == b.thickness;
+        }
     }
+    return false;
 }
 
-//-----------------------------------------------------------------------------
-// BorderDisplayItem Implementation
-//-----------------------------------------------------------------------------
+// count items of two lists from first and otherFirst on are the same
+bool sameItems(const DisplayList& list, size_t first, const DisplayList& otherList, size_t otherFirst,
+               size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (!sameItem(list, list.item(first + i), otherList, otherList.item(otherFirst + i))) {
+            return false;
+        }
+    }
+    return true;
+}
 
-BorderDisplayItem::BorderDisplayItem(const layout::Rect& rect, const Color& color, 
-                                 float top, float right, float bottom, float left)
-    : DisplayItem(DisplayItemType::BORDER)
-    , m_rect(rect)
-    , m_color(color)
-    , m_topWidth(top)
-    , m_rightWidth(right)
-    , m_bottomWidth(bottom)
-    , m_leftWidth(left)
-{
+// Where items [first, last) of a list draw
+layout::Rect itemsBounds(const DisplayList& list, size_t first, size_t last) {
+    layout::Rect bounds;
+    for (size_t index = first; index < last; ++index) {
+        bounds.unite(list.itemBounds(index).rect);
+    }
+    return bounds;
 }
 
-BorderDisplayItem::~BorderDisplayItem() {
+bool intersects(const layout::Rect& a, const layout::Rect& b) {
+    return !a.isEmpty() && !b.isEmpty() && a.x < b.right() && b.x < a.right() && a.y < b.bottom() &&
+           b.y < a.bottom();
 }
 
-void BorderDisplayItem::paint(RenderingContext* context) {
-    if (!context) {
-        return;
-    }
-    
-    // Try to cast to our custom context type
-    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        // Set stroke color
-        customContext->setStrokeColor(m_color);
-        
-        // Draw border rectangle
-        float maxWidth = std::max({m_topWidth, m_rightWidth, m_bottomWidth, m_leftWidth});
-        customContext->strokeRect(m_rect.x, m_rect.y, m_rect.width, m_rect.height, maxWidth);
+layout::Rect intersect(const layout::Rect& a, const layout::Rect& b) {
+    if (!intersects(a, b)) {
+        return layout::Rect();
     }
+    float x0 = std::max(a.x, b.x);
+    float y0 = std::max(a.y, b.y);
+    return layout::Rect(x0, y0, std::min(a.right(), b.right()) - x0, std::min(a.bottom(), b.bottom()) - y0);
 }
 
-//-----------------------------------------------------------------------------
-// TextDisplayItem Implementation
-//-----------------------------------------------------------------------------
-
-TextDisplayItem::TextDisplayItem(const std::string& text, float x, float y, 
-                             const Color& color, const std::string& fontFamily, float fontSize)
-    : DisplayItem(DisplayItemType::TEXT)
-    , m_text(text)
-    , m_x(x)
-    , m_y(y)
-    , m_color(color)
-    , m_fontFamily(fontFamily)
-    , m_fontSize(fontSize)
-{
+// Glyphs advance half a font size per byte at most, and stay within a font
+// size above the baseline and a quarter of one below it; two pixels more
+// for baseline snapping and antialiasing
+layout::Rect textBounds(float x, float baseline, float fontSize, size_t length) {
+    if (length == 0) {
+        return layout::Rect();
+    }
+    return layout::Rect(x - 2, baseline - fontSize - 2, fontSize * 0.5f * length + 4, fontSize * 1.25f + 4);
 }
 
-TextDisplayItem::~TextDisplayItem() {
+// A number or length in px from a transform function's arguments, e.g.
+// the "10px" of translate(10px, 5px); advances text past it
+bool parseTranslateArgument(const char*& text, float& value) {
+    char* end = nullptr;
+    value = std::strtof(text, &end);
+    if (end == text) {
+        return false;
+    }
+    if (end[0] == 'p' && end[1] == 'x') {
+        end += 2;
+    }
+    while (*end == ' ' || *end == ',') {
+        ++end;
+    }
+    text = end;
+    return true;
 }
 
-void TextDisplayItem::paint(RenderingContext* context) {
-    if (!context) {
+// Offset of a translate(), translateX() or translateY() transform. Other
+// transforms still get a layer but are composited untransformed.
+void parseTranslate(const std::string& transform, float& x, float& y) {
+    x = 0;
+    y = 0;
+    size_t open = transform.find('(');
+    if (open == std::string::npos) {
         return;
     }
-    
-    // Try to cast to our custom context type
-    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        // Set text color
-        customContext->setTextColor(m_color);
-        
-        // Draw text
-        customContext->drawText(m_text, m_x, m_y, m_fontFamily, m_fontSize);
+    std::string function = transform.substr(0, open);
+    const char* args = transform.c_str() + open + 1;
+    if (function == "translate") {
+        if (parseTranslateArgument(args, x)) {
+            parseTranslateArgument(args, y);
+        }
+    } else if (function == "translateX") {
+        parseTranslateArgument(args, x);
+    } else if (function == "translateY") {
+        parseTranslateArgument(args, y);
     }
 }
 
-//-----------------------------------------------------------------------------
-// ImageDisplayItem Implementation
-//-----------------------------------------------------------------------------
-
-ImageDisplayItem::ImageDisplayItem(const std::string& url, const layout::Rect& rect)
-    : DisplayItem(DisplayItemType::IMAGE)
-    , m_url(url)
-    , m_rect(rect)
-{
-}
-
-ImageDisplayItem::~ImageDisplayItem() {
-}
-
-void ImageDisplayItem::paint(RenderingContext* context) {
-    if (!context) {
-        return;
+// Apply a box's compositing properties on top of its parent's; true if
+// they call for a layer of its own. Text boxes share their element's style,
+// which has already applied.
+bool applyLayerProperties(layout::Box* box, LayerProperties& properties) {
+    if (dynamic_cast<layout::TextBox*>(box)) {
+        return false;
     }
     
-    // Try to cast to our custom context type
-    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        // In a real implementation, we would load the image and draw it here
-        // For now, just draw a placeholder rectangle
-        customContext->setFillColor(Color(200, 200, 200)); // Light gray
-        customContext->fillRect(m_rect.x, m_rect.y, m_rect.width, m_rect.height);
+    bool ownLayer = false;
+    if (box->positionType() == layout::PositionType::FIXED) {
+        properties.fixed = true;
+        ownLayer = true;
+    }
+    
+    const css::Value& opacity = box->style().getProperty("opacity");
+    if (!opacity.stringValue().empty()) {
+        float value = opacity.type() == css::ValueType::LENGTH
+            ? static_cast<float>(opacity.numericValue()) : std::strtof(opacity.stringValue().c_str(), nullptr);
+        value = std::max(0.0f, std::min(value, 1.0f));
+        if (value < 1.0f) {
+            properties.opacity *= value;
+            ownLayer = true;
+        }
+    }
+    
+    const css::Value& transform = box->style().getProperty("transform");
+    if (!transform.stringValue().empty() && transform.stringValue() != "none") {
+        float x, y;
+        parseTranslate(transform.stringValue(), x, y);
+        properties.translateX += x;
+        properties.translateY += y;
+        ownLayer = true;
+    }
+    return ownLayer;
+}
+
+// Draw one item; TRANSFORM and CLIP items are left to the caller
+void paintItem(const DisplayList& list, CustomRenderingContext* context, const DisplayItem& item) {
+    switch (item.type) {
+        case DisplayItemType::BACKGROUND: {
+            const auto& background = item.as<BackgroundDisplayItem>();
+            context->setFillColor(background.color);
+            context->fillRect(background.rect.x, background.rect.y,
+                              background.rect.width, background.rect.height);
+            break;
+        }
+        
+        case DisplayItemType::BORDER: {
+            const auto& border = item.as<BorderDisplayItem>();
+            context->setStrokeColor(border.color);
+            float maxWidth = std::max({border.topWidth, border.rightWidth,
+                                       border.bottomWidth, border.leftWidth});
+            context->strokeRect(border.rect.x, border.rect.y,
+                                border.rect.width, border.rect.height, maxWidth);
+            break;
+        }
+        
+        case DisplayItemType::TEXT: {
+            const auto& text = item.as<TextDisplayItem>();
+            context->setTextColor(text.color);
+            context->drawText(list.string(text.text), text.x, text.y,
+                              list.string(text.fontFamily), text.fontSize);
+            break;
+        }
+        
+        case DisplayItemType::IMAGE: {
+            // In a real implementation, we would load the image and draw it here
+            // For now, just draw a placeholder rectangle
+            const auto& image = item.as<ImageDisplayItem>();
+            context->setFillColor(Color(200, 200, 200)); // Light gray
+            context->fillRect(image.rect.x, image.rect.y, image.rect.width, image.rect.height);
+            
+            context->setStrokeColor(Color(100, 100, 100)); // Dark gray
+            context->strokeRect(image.rect.x, image.rect.y, image.rect.width, image.rect.height, 1.0f);
+            
+            // Draw image URL as text
+            context->setTextColor(Color(0, 0, 0));
+            context->drawText("Image: " + std::string(list.string(image.url)),
+                              image.rect.x + 5, image.rect.y + 15, "Arial", 10.0f);
+            break;
+        }
         
-        customContext->setStrokeColor(Color(100, 100, 100)); // Dark gray
-        customContext->strokeRect(m_rect.x, m_rect.y, m_rect.width, m_rect.height, 1.0f);
+        case DisplayItemType::RECT: {
+            const auto& rect = item.as<RectDisplayItem>();
+            if (rect.filled) {
+                context->setFillColor(rect.color);
+                context->fillRect(rect.rect.x, rect.rect.y, rect.rect.width, rect.rect.height);
+            } else {
+                context->setStrokeColor(rect.color);
+                context->strokeRect(rect.rect.x, rect.rect.y, rect.rect.width, rect.rect.height, 1.0f);
+            }
+            break;
+        }
         
-        // Draw image URL as text
-        customContext->setTextColor(Color(0, 0, 0));
-        customContext->drawText("Image: " + m_url, m_rect.x + 5, m_rect.y + 15, "Arial", 10.0f);
+        case DisplayItemType::LINE: {
+            // Drawn as a rectangle covering the line
+            const auto& line = item.as<LineDisplayItem>();
+            context->setFillColor(line.color);
+            float dx = line.x2 - line.x1;
+            float dy = line.y2 - line.y1;
+            if (dx * dx + dy * dy > 0) {
+                context->fillRect(std::min(line.x1, line.x2), std::min(line.y1, line.y2),
+                                  std::abs(dx) + line.thickness, std::abs(dy) + line.thickness);
+            }
+            break;
+        }
+        
+        case DisplayItemType::TRANSFORM:
+        case DisplayItemType::CLIP:
+            break;
     }
 }
 
+} // namespace
+
 //-----------------------------------------------------------------------------
-// RectDisplayItem Implementation
+// DisplayList Implementation
 //-----------------------------------------------------------------------------
 
-RectDisplayItem::RectDisplayItem(const layout::Rect& rect, const Color& color, bool fill)
-    : DisplayItem(DisplayItemType::RECT)
-    , m_rect(rect)
-    , m_color(color)
-    , m_fill(fill)
+DisplayList::DisplayList()
+    : m_size(0)
+    , m_dx(0)
+    , m_dy(0)
+    , m_clip(-1)
 {
 }
 
-RectDisplayItem::~RectDisplayItem() {
+DisplayList::~DisplayList() {
 }
 
-void RectDisplayItem::paint(RenderingContext* context) {
-    if (!context) {
+size_t DisplayList::itemSize(DisplayItemType type) {
+    switch (type) {
+        case DisplayItemType::BACKGROUND: return sizeof(BackgroundDisplayItem);
+        case DisplayItemType::BORDER: return sizeof(BorderDisplayItem);
+        case DisplayItemType::TEXT: return sizeof(TextDisplayItem);
+        case DisplayItemType::IMAGE: return sizeof(ImageDisplayItem);
+        case DisplayItemType::RECT: return sizeof(RectDisplayItem);
+        case DisplayItemType::TRANSFORM: return sizeof(TransformDisplayItem);
+        case DisplayItemType::CLIP: return sizeof(ClipDisplayItem);
+        case DisplayItemType::LINE: return sizeof(LineDisplayItem);
+    }
+    return 0;
+}
+
+DisplayString DisplayList::addString(std::string_view text) {
+    DisplayString result;
+    result.offset = static_cast<uint32_t>(m_strings.size());
+    result.length = static_cast<uint32_t>(text.size());
+    m_strings.append(text.data(), text.size());
+    return result;
+}
+
+void DisplayList::reserve(size_t commandBytes, size_t stringBytes, size_t itemCount) {
+    m_commands.reserve(commandBytes);
+    m_strings.reserve(stringBytes);
+    m_itemBounds.reserve(itemCount);
+}
+
+void DisplayList::append(const DisplayList& source, size_t first, size_t last) {
+    if (m_size == 0 && first == 0 && last == source.m_size) {
+        m_commands = source.m_commands;
+        m_strings = source.m_strings;
+        m_size = source.m_size;
+        m_itemBounds = source.m_itemBounds;
+        m_clips = source.m_clips;
+        m_bvh = source.m_bvh;
+        m_openLeaf = source.m_openLeaf;
+        m_dx = source.m_dx;
+        m_dy = source.m_dy;
+        m_clip = source.m_clip;
         return;
     }
     
-    // Try to cast to our custom context type
-    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        if (m_fill) {
-            customContext->setFillColor(m_color);
-            customContext->fillRect(m_rect.x, m_rect.y, m_rect.width, m_rect.height);
-        } else {
-            customContext->setStrokeColor(m_color);
-            customContext->strokeRect(m_rect.x, m_rect.y, m_rect.width, m_rect.height, 1.0f);
+    if (first >= last) {
+        return;
+    }
+    
+    // The items are copied in one piece, then their text is pooled and
+    // their bounds recorded one by one
+    const unsigned char* begin = source.m_commands.data() + source.m_itemBounds[first].offset;
+    const unsigned char* end = last < source.m_size ? source.m_commands.data() + source.m_itemBounds[last].offset
+                                                    : source.m_commands.data() + source.m_commands.size();
+    size_t base = m_commands.size() - source.m_itemBounds[first].offset;
+    m_commands.insert(m_commands.end(), begin, end);
+    m_itemBounds.reserve(m_itemBounds.size() + (last - first));
+    
+    // Runs of text share their font family, as when painted
+    DisplayString sourceFamily{0, 0};
+    DisplayString family{0, 0};
+    for (size_t index = first; index < last; ++index) {
+        size_t offset = base + source.m_itemBounds[index].offset;
+        unsigned char* copy = m_commands.data() + offset;
+        const DisplayItem& item = *reinterpret_cast<const DisplayItem*>(copy);
+        if (item.type == DisplayItemType::TEXT) {
+            auto& text = *reinterpret_cast<TextDisplayItem*>(copy);
+            text.text = addString(source.string(text.text));
+            if (family.length == 0 || text.fontFamily.offset != sourceFamily.offset ||
+                text.fontFamily.length != sourceFamily.length) {
+                sourceFamily = text.fontFamily;
+                family = addString(source.string(sourceFamily));
+            }
+            text.fontFamily = family;
+        } else if (item.type == DisplayItemType::IMAGE) {
+            auto& image = *reinterpret_cast<ImageDisplayItem*>(copy);
+            image.url = addString(source.string(image.url));
         }
+        ++m_size;
+        record(offset);
     }
 }
 
-//-----------------------------------------------------------------------------
-// TransformDisplayItem Implementation
-//-----------------------------------------------------------------------------
-
-TransformDisplayItem::TransformDisplayItem(float dx, float dy)
-    : DisplayItem(DisplayItemType::TRANSFORM)
-    , m_dx(dx)
-    , m_dy(dy)
-{
-}
-
-TransformDisplayItem::~TransformDisplayItem() {
-}
-
-void TransformDisplayItem::paint(RenderingContext* context) {
+void DisplayList::paint(RenderingContext* context) const {
     if (!context) {
         return;
     }
     
     // Try to cast to our custom context type
     auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        // Apply translation
-        customContext->translate(m_dx, m_dy);
+    if (!customContext) {
+        return;
     }
+    
+    // Save the context state
+    customContext->save();
+    
+    // Paint all items in order. Clipping is not implemented in the console
+    // rendering context.
+    for (const DisplayItem& item : *this) {
+        if (item.type == DisplayItemType::TRANSFORM) {
+            const auto& transform = item.as<TransformDisplayItem>();
+            customContext->translate(transform.dx, transform.dy);
+        } else {
+            paintItem(*this, customContext, item);
+        }
+    }
+    
+    // Restore the context state
+    customContext->restore();
 }
 
-//-----------------------------------------------------------------------------
-// ClipDisplayItem Implementation
-//-----------------------------------------------------------------------------
-
-ClipDisplayItem::ClipDisplayItem(const layout::Rect& rect)
-    : DisplayItem(DisplayItemType::CLIP)
-    , m_rect(rect)
-{
-}
-
-ClipDisplayItem::~ClipDisplayItem() {
-}
-
-void ClipDisplayItem::paint(RenderingContext* context) {
-    if (!context) {
+void DisplayList::paint(RenderingContext* context, const layout::Rect& damage) const {
+    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
+    if (!customContext) {
         return;
     }
     
-    // In a real implementation, we would set a clipping region here
-    // For simplicity, this is not implemented in the console rendering context
-}
-
-//-----------------------------------------------------------------------------
-// LineDisplayItem Implementation
-//-----------------------------------------------------------------------------
-
-LineDisplayItem::LineDisplayItem(float x1, float y1, float x2, float y2, const Color& color, float thickness)
-    : DisplayItem(DisplayItemType::LINE)
-    , m_x1(x1)
-    , m_y1(y1)
-    , m_x2(x2)
-    , m_y2(y2)
-    , m_color(color)
-    , m_thickness(thickness)
-{
-}
-
-LineDisplayItem::~LineDisplayItem() {
+    TRACE_SCOPE("paint", "DisplayList::paint");
+    std::vector<uint32_t> visible;
+    cull(damage, visible);
+    TRACE_COUNTER("paint", "culledItems", static_cast<int64_t>(m_size - visible.size()));
+    
+    // Skipped transforms are caught up with before each item
+    customContext->save();
+    float dx = 0;
+    float dy = 0;
+    for (uint32_t index : visible) {
+        const DisplayItemBounds& bounds = m_itemBounds[index];
+        if (bounds.dx != dx || bounds.dy != dy) {
+            customContext->translate(bounds.dx - dx, bounds.dy - dy);
+            dx = bounds.dx;
+            dy = bounds.dy;
+        }
+        paintItem(*this, customContext, item(index));
+    }
+    customContext->restore();
 }
 
-void LineDisplayItem::paint(RenderingContext* context) {
-    if (!context) {
+void DisplayList::clear() {
+    m_commands.clear();
+    m_strings.clear();
+    m_size = 0;
+    m_itemBounds.clear();
+    m_clips.clear();
+    m_bvh.clear();
+    m_openLeaf = layout::Rect();
+    m_dx = 0;
+    m_dy = 0;
+    m_clip = -1;
+}
+
+layout::Rect DisplayList::bounds() const {
+    layout::Rect result = m_openLeaf;
+    if (!m_bvh.empty()) {
+        result.unite(m_bvh.back().front());
+    }
+    return result;
+}
+
+void DisplayList::record(size_t offset) {
+    // Transforms and clips are tracked as the rasterizers do: translations
+    // accumulate and a clip replaces the one before
+    const DisplayItem& item = *reinterpret_cast<const DisplayItem*>(m_commands.data() + offset);
+    layout::Rect rect;
+    switch (item.type) {
+        case DisplayItemType::BACKGROUND:
+            rect = item.as<BackgroundDisplayItem>().rect;
+            break;
+        case DisplayItemType::BORDER:
+            rect = item.as<BorderDisplayItem>().rect;
+            break;
+        case DisplayItemType::TEXT: {
+            const auto& text = item.as<TextDisplayItem>();
+            rect = textBounds(text.x, text.y, text.fontSize, text.text.length);
+            break;
+        }
+        case DisplayItemType::IMAGE: {
+            // Placeholders are labelled "Image: <url>", which may run past them
+            const auto& image = item.as<ImageDisplayItem>();
+            rect = image.rect;
+            rect.unite(textBounds(image.rect.x + 5, image.rect.y + 15, 10.0f, image.url.length + 7));
+            break;
+        }
+        case DisplayItemType::RECT:
+            rect = item.as<RectDisplayItem>().rect;
+            break;
+        case DisplayItemType::LINE: {
+            // Rasterized centered on the line, painted as a rect reaching a
+            // thickness past its end
+            const auto& line = item.as<LineDisplayItem>();
+            float thickness = std::max(line.thickness, 1.0f) + 1.0f;
+            float x0 = std::min(line.x1, line.x2) - thickness;
+            float y0 = std::min(line.y1, line.y2) - thickness;
+            rect = layout::Rect(x0, y0, std::max(line.x1, line.x2) + thickness - x0,
+                                std::max(line.y1, line.y2) + thickness - y0);
+            break;
+        }
+        case DisplayItemType::TRANSFORM:
+            m_dx += item.as<TransformDisplayItem>().dx;
+            m_dy += item.as<TransformDisplayItem>().dy;
+            break;
+        case DisplayItemType::CLIP: {
+            layout::Rect clip = item.as<ClipDisplayItem>().rect;
+            clip.x += m_dx;
+            clip.y += m_dy;
+            m_clip = static_cast<int32_t>(m_clips.size());
+            m_clips.push_back(clip);
+            break;
+        }
+    }
+    
+    if (!rect.isEmpty()) {
+        rect.x += m_dx;
+        rect.y += m_dy;
+        if (m_clip >= 0) {
+            rect = intersect(rect, m_clips[m_clip]);
+        }
+    }
+    m_itemBounds.push_back(DisplayItemBounds{rect, static_cast<uint32_t>(offset), m_clip, m_dx, m_dy});
+    m_openLeaf.unite(rect);
+    if (m_itemBounds.size() % bvhFanout != 0) {
         return;
     }
     
-    // Try to cast to our custom context type
-    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        // For now, we'll implement this as a thin rectangle
-        // In a real implementation, we'd have a proper line drawing method
-        customContext->setFillColor(m_color);
-        
-        // Calculate line as a rectangle
-        float dx = m_x2 - m_x1;
-        float dy = m_y2 - m_y1;
-        float length = std::sqrt(dx * dx + dy * dy);
-        
-        if (length > 0) {
-            // Normalize direction
-            dx /= length;
-            dy /= length;
-            
-            // Perpendicular vector for thickness
-            float px = -dy * m_thickness * 0.5f;
-            float py = dx * m_thickness * 0.5f;
-            
-            // Draw as a filled rectangle
-            // This is a simplified approach
-            customContext->fillRect(
-                std::min(m_x1, m_x2), 
-                std::min(m_y1, m_y2),
-                std::abs(m_x2 - m_x1) + m_thickness,
-                std::abs(m_y2 - m_y1) + m_thickness
-            );
+    // The leaf is full: add it to the tree, growing its ancestors to hold
+    // it. A top level that reaches two nodes gets a root above it.
+    if (m_bvh.empty()) {
+        m_bvh.emplace_back();
+    }
+    m_bvh[0].push_back(m_openLeaf);
+    size_t node = m_bvh[0].size() - 1;
+    for (size_t level = 1; level < m_bvh.size(); ++level) {
+        node /= bvhFanout;
+        std::vector<layout::Rect>& nodes = m_bvh[level];
+        if (nodes.size() <= node) {
+            nodes.resize(node + 1);
         }
+        nodes[node].unite(m_openLeaf);
     }
+    if (m_bvh.back().size() > 1) {
+        layout::Rect root;
+        for (const layout::Rect& child : m_bvh.back()) {
+            root.unite(child);
+        }
+        m_bvh.emplace_back(1, root);
+    }
+    m_openLeaf = layout::Rect();
 }
 
-//-----------------------------------------------------------------------------
-// DisplayList Implementation
-//-----------------------------------------------------------------------------
-
-DisplayList::DisplayList() {
-}
-
-DisplayList::~DisplayList() {
-    clear();
-}
-
-void DisplayList::appendItem(std::unique_ptr<DisplayItem> item) {
-    if (item) {
-        m_items.push_back(std::move(item));
+void DisplayList::cull(const layout::Rect& rect, std::vector<uint32_t>& items) const {
+    items.clear();
+    if (!m_bvh.empty()) {
+        cullNode(m_bvh.size() - 1, 0, rect, items);
+    }
+    
+    // Items after the last full leaf
+    if (intersects(m_openLeaf, rect)) {
+        for (size_t index = m_bvh.empty() ? 0 : m_bvh[0].size() * bvhFanout; index < m_itemBounds.size(); ++index) {
+            if (intersects(m_itemBounds[index].rect, rect)) {
+                items.push_back(static_cast<uint32_t>(index));
+            }
+        }
     }
 }
 
-void DisplayList::paint(RenderingContext* context) const {
-    if (!context) {
+void DisplayList::cullNode(size_t level, size_t node, const layout::Rect& rect,
+                           std::vector<uint32_t>& items) const {
+    if (!intersects(m_bvh[level][node], rect)) {
         return;
     }
-    
-    // Try to cast to our custom context type
-    auto customContext = dynamic_cast<CustomRenderingContext*>(context);
-    if (customContext) {
-        // Save the context state
-        customContext->save();
-        
-        // Paint all items in order
-        for (const auto& item : m_items) {
-            if (item) {
-                item->paint(context);
+    size_t first = node * bvhFanout;
+    if (level == 0) {
+        size_t last = std::min(first + bvhFanout, m_itemBounds.size());
+        for (size_t index = first; index < last; ++index) {
+            if (intersects(m_itemBounds[index].rect, rect)) {
+                items.push_back(static_cast<uint32_t>(index));
             }
         }
-        
-        // Restore the context state
-        customContext->restore();
+        return;
+    }
+    size_t last = std::min(first + bvhFanout, m_bvh[level - 1].size());
+    for (size_t child = first; child < last; ++child) {
+        cullNode(level - 1, child, rect, items);
     }
 }
 
-void DisplayList::clear() {
-    m_items.clear();
+bool DisplayList::operator==(const DisplayList& other) const {
+    if (m_size != other.m_size || m_commands.size() != other.m_commands.size()) {
+        return false;
+    }
+    for (const_iterator a = begin(), b = other.begin(); a != end(); ++a, ++b) {
+        if (!sameItem(*this, *a, other, *b)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 //-----------------------------------------------------------------------------
 // PaintContext Implementation
 //-----------------------------------------------------------------------------
 
-PaintContext::PaintContext() {
+PaintContext::PaintContext()
+    : m_fontFamily{0, 0}
+{
 }
 
 PaintContext::~PaintContext() {
 }
 
 void PaintContext::drawBackground(const layout::Rect& rect, const Color& color) {
-    m_displayList.appendItem(std::make_unique<BackgroundDisplayItem>(rect, color));
+    m_displayList.append(BackgroundDisplayItem{{}, rect, color});
 }
 
 void PaintContext::drawBorder(const layout::Rect& rect, const Color& color, 
                            float top, float right, float bottom, float left) {
-    m_displayList.appendItem(std::make_unique<BorderDisplayItem>(rect, color, top, right, bottom, left));
+    m_displayList.append(BorderDisplayItem{{}, rect, color, top, right, bottom, left});
 }
 
-void PaintContext::drawText(const std::string& text, float x, float y, 
-                         const Color& color, const std::string& fontFamily, float fontSize) {
-    m_displayList.appendItem(std::make_unique<TextDisplayItem>(text, x, y, color, fontFamily, fontSize));
+void PaintContext::drawText(std::string_view text, float x, float y, 
+                         const Color& color, std::string_view fontFamily, float fontSize) {
+    if (m_displayList.string(m_fontFamily) != fontFamily) {
+        m_fontFamily = m_displayList.addString(fontFamily);
+    }
+    DisplayString pooledText = m_displayList.addString(text);
+    m_displayList.append(TextDisplayItem{{}, pooledText, m_fontFamily, x, y, color, fontSize});
 }
 
-void PaintContext::drawImage(const std::string& url, const layout::Rect& rect) {
-    m_displayList.appendItem(std::make_unique<ImageDisplayItem>(url, rect));
+void PaintContext::drawImage(std::string_view url, const layout::Rect& rect) {
+    m_displayList.append(ImageDisplayItem{{}, m_displayList.addString(url), rect});
 }
 
 void PaintContext::drawRect(const layout::Rect& rect, const Color& color, bool fill) {
-    m_displayList.appendItem(std::make_unique<RectDisplayItem>(rect, color, fill));
+    m_displayList.append(RectDisplayItem{{}, rect, color, fill});
 }
 
 void PaintContext::drawLine(float x1, float y1, float x2, float y2, const Color& color, float thickness) {
-    m_displayList.appendItem(std::make_unique<LineDisplayItem>(x1, y1, x2, y2, color, thickness));
+    m_displayList.append(LineDisplayItem{{}, x1, y1, x2, y2, color, thickness});
 }
 
 void PaintContext::transform(float dx, float dy) {
-    m_displayList.appendItem(std::make_unique<TransformDisplayItem>(dx, dy));
+    m_displayList.append(TransformDisplayItem{{}, dx, dy});
 }
 
 void PaintContext::clip(const layout::Rect& rect) {
-    m_displayList.appendItem(std::make_unique<ClipDisplayItem>(rect));
+    m_displayList.append(ClipDisplayItem{{}, rect});
+}
+
+void PaintContext::append(const DisplayList& list, size_t first, size_t last) {
+    m_displayList.append(list, first, last);
+}
+
+void PaintContext::clear() {
+    m_displayList.clear();
+    m_fontFamily = DisplayString{0, 0};
 }
 
 //-----------------------------------------------------------------------------
 // PaintSystem Implementation
 //-----------------------------------------------------------------------------
 
-PaintSystem::PaintSystem() {
+PaintSystem::PaintSystem()
+    : m_commandBytesHint(0)
+    , m_stringBytesHint(0)
+    , m_itemCountHint(0)
+    , m_reusedItems(0)
+{
 }
 
 PaintSystem::~PaintSystem() {
@@ -397,6 +665,7 @@ bool PaintSystem::initialize() {
 PaintContext PaintSystem::createContext(layout::Box* box) {
     // Create an empty paint context
     PaintContext context;
+    context.reserve(m_commandBytesHint, m_stringBytesHint, m_itemCountHint);
     
     // Add a transform to offset to the box position
     if (box) {
@@ -407,22 +676,143 @@ PaintContext PaintSystem::createContext(layout::Box* box) {
 }
 
 void PaintSystem::paintBox(layout::Box* box, PaintContext& context) {
-    if (!box) {
+    TRACE_SCOPE("paint", "PaintSystem::paintBox");
+    ALLOC_SCOPE(RENDERING);
+    m_paintDamage = layout::Rect();
+    m_reusedItems = 0;
+    
+    // Boxes changed after this paint get a generation newer than any read
+    // below
+    if (box) {
+        box->tree().advancePaintGeneration();
+    }
+    
+    if (box && !m_retainedBoxes.empty() && m_retainedBoxes.front().box == box &&
+        m_retainedBoxes.front().generation == box->paintGeneration()) {
+        m_reusedItems = m_retained.displayList().size();
+    } else {
+        std::swap(m_retained, m_previous);
+        m_retainedBoxes.swap(m_previousBoxes);
+        m_retained.clear();
+        m_retainedBoxes.clear();
+        m_reachedBoxes.clear();
+        
+        // A new root is another tree, or one rebuilt: nothing carries over
+        bool sameRoot = box && !m_previousBoxes.empty() && m_previousBoxes.front().box == box;
+        m_previousIndex.clear();
+        if (sameRoot) {
+            m_previousIndex.resize(box->tree().size(), noEntry);
+            for (uint32_t entry = 0; entry < m_previousBoxes.size(); ++entry) {
+                layout::BoxIndex index = m_previousBoxes[entry].index;
+                if (index < m_previousIndex.size()) {
+                    m_previousIndex[index] = entry;
+                }
+            }
+        }
+        
+        paintBoxTree(box);
+        if (sameRoot) {
+            addRemovedDamage();
+        } else {
+            m_paintDamage.unite(m_previous.displayList().bounds());
+        }
+    }
+    TRACE_COUNTER("paint", "reusedItems", static_cast<int64_t>(m_reusedItems));
+    
+    context.append(m_retained.displayList(), 0, m_retained.displayList().size());
+    m_commandBytesHint = context.displayList().commandBytes();
+    m_stringBytesHint = context.displayList().stringBytes();
+    m_itemCountHint = context.displayList().size();
+}
+
+void PaintSystem::paintBoxTree(layout::Box* box) {
+    if (!box || box->displayType() == layout::DisplayType::NONE || box->layoutDeferred()) {
         return;
     }
     
-    // Skip boxes with display: none
-    if (box->displayType() == layout::DisplayType::NONE) {
+    const DisplayList& list = m_retained.displayList();
+    const DisplayList& previousList = m_previous.displayList();
+    uint32_t previousEntry = box->index() < m_previousIndex.size() ? m_previousIndex[box->index()] : noEntry;
+    const PaintedBox* previous = nullptr;
+    if (previousEntry != noEntry && m_previousBoxes[previousEntry].box == box) {
+        previous = &m_previousBoxes[previousEntry];
+    }
+    
+    // An unchanged subtree is copied along with its boxes' entries
+    if (previous && previous->generation == box->paintGeneration()) {
+        uint32_t firstItem = static_cast<uint32_t>(list.size());
+        uint32_t firstEntry = static_cast<uint32_t>(m_retainedBoxes.size());
+        m_retained.append(previousList, previous->firstItem, previous->endItem);
+        for (uint32_t entry = previousEntry; entry < previous->endEntry; ++entry) {
+            PaintedBox painted = m_previousBoxes[entry];
+            painted.firstItem = painted.firstItem - previous->firstItem + firstItem;
+            painted.childItem = painted.childItem - previous->firstItem + firstItem;
+            painted.endItem = painted.endItem - previous->firstItem + firstItem;
+            painted.endEntry = painted.endEntry - previousEntry + firstEntry;
+            m_retainedBoxes.push_back(painted);
+        }
+        m_reachedBoxes.emplace_back(previousEntry, previous->endEntry);
+        m_reusedItems += previous->endItem - previous->firstItem;
         return;
     }
     
-    // Get box dimensions
-    layout::Rect contentRect = box->contentRect();
-    layout::Rect borderBox = box->borderBox();
+    uint32_t entry = static_cast<uint32_t>(m_retainedBoxes.size());
+    uint32_t firstItem = static_cast<uint32_t>(list.size());
+    paintBoxContents(box, m_retained);
+    uint32_t childItem = static_cast<uint32_t>(list.size());
+    m_retainedBoxes.push_back(PaintedBox{box, box->index(), box->paintGeneration(), firstItem, childItem, 0, 0});
+    
+    float x = box->contentRect().x;
+    float y = box->contentRect().y;
+    m_retained.transform(x, y);
+    for (layout::Box* child : box->children()) {
+        paintBoxTree(child);
+    }
+    m_retained.transform(-x, -y);
     
-    // Save the current position to create a local coordinate system
-    float x = contentRect.x;
-    float y = contentRect.y;
+    uint32_t endItem = static_cast<uint32_t>(list.size());
+    m_retainedBoxes[entry].endItem = endItem;
+    m_retainedBoxes[entry].endEntry = static_cast<uint32_t>(m_retainedBoxes.size());
+    
+    // The box's own items where they changed, and its whole subtree where
+    // it moved its children
+    if (!previous) {
+        m_paintDamage.unite(itemsBounds(list, firstItem, childItem));
+        return;
+    }
+    m_reachedBoxes.emplace_back(previousEntry, previousEntry + 1);
+    if (childItem - firstItem != previous->childItem - previous->firstItem ||
+        !sameItems(list, firstItem, previousList, previous->firstItem, childItem - firstItem)) {
+        m_paintDamage.unite(itemsBounds(list, firstItem, childItem));
+        m_paintDamage.unite(itemsBounds(previousList, previous->firstItem, previous->childItem));
+    }
+    if (!sameItems(list, childItem, previousList, previous->childItem, 1)) {
+        m_paintDamage.unite(itemsBounds(list, firstItem, endItem));
+        m_paintDamage.unite(itemsBounds(previousList, previous->firstItem, previous->endItem));
+    }
+}
+
+void PaintSystem::addRemovedDamage() {
+    // Entries outside the reached ranges are boxes gone from the tree, or
+    // no longer painted
+    const DisplayList& previousList = m_previous.displayList();
+    std::sort(m_reachedBoxes.begin(), m_reachedBoxes.end());
+    uint32_t entry = 0;
+    auto damageUpTo = [&](uint32_t end) {
+        for (; entry < end; ++entry) {
+            const PaintedBox& removed = m_previousBoxes[entry];
+            m_paintDamage.unite(itemsBounds(previousList, removed.firstItem, removed.childItem));
+        }
+    };
+    for (const std::pair<uint32_t, uint32_t>& reached : m_reachedBoxes) {
+        damageUpTo(reached.first);
+        entry = std::max(entry, reached.second);
+    }
+    damageUpTo(static_cast<uint32_t>(m_previousBoxes.size()));
+}
+
+void PaintSystem::paintBoxContents(layout::Box* box, PaintContext& context) {
+    layout::Rect borderBox = box->borderBox();
     
     // Draw background
     Color bgColor = getBackgroundColor(box);
@@ -443,17 +833,56 @@ void PaintSystem::paintBox(layout::Box* box, PaintContext& context) {
     if (auto textBox = dynamic_cast<layout::TextBox*>(box)) {
         paintText(textBox, context);
     }
+}
+
+void PaintSystem::paintLayers(layout::Box* root, LayerTree& layers) {
+    TRACE_SCOPE("paint", "PaintSystem::paintLayers");
+    ALLOC_SCOPE(RENDERING);
     
-    // Add a transform to position children relative to this box
-    context.transform(x, y);
+    layers.beginUpdate();
+    Layer* layer = &layers.addLayer(nullptr, LayerProperties());
+    paintLayerTree(root, layers, layer, 0, 0);
+    layers.endUpdate();
+}
+
+void PaintSystem::paintLayerTree(layout::Box* box, LayerTree& layers, Layer*& layer,
+                                 float originX, float originY) {
+    if (!box || box->displayType() == layout::DisplayType::NONE || box->layoutDeferred()) {
+        return;
+    }
+    
+    Layer* parent = layer;
+    LayerProperties properties = parent->properties();
+    bool ownLayer = applyLayerProperties(box, properties);
+    
+    if (ownLayer) {
+        layer = &layers.addLayer(box, properties);
+        if (originX != 0 || originY != 0) {
+            layer->context().transform(originX, originY);
+        }
+    }
     
-    // Paint children
-    for (const auto& child : box->children()) {
-        paintBox(child.get(), context);
+    float x = box->contentRect().x;
+    float y = box->contentRect().y;
+    
+    paintBoxContents(box, layer->context());
+    layer->context().transform(x, y);
+    
+    // Children may leave a later layer to paint into
+    for (layout::Box* child : box->children()) {
+        paintLayerTree(child, layers, layer, originX + x, originY + y);
     }
     
-    // Reset transform
-    context.transform(-x, -y);
+    layer->context().transform(-x, -y);
+    
+    // What's painted after the subtree goes above it, with the parent's
+    // properties
+    if (ownLayer) {
+        layer = &layers.addLayer(parent->box(), parent->properties());
+        if (originX != 0 || originY != 0) {
+            layer->context().transform(originX, originY);
+        }
+    }
 }
 
 void PaintSystem::paintText(layout::TextBox* textBox, PaintContext& context) {
@@ -462,17 +891,16 @@ void PaintSystem::paintText(layout::TextBox* textBox, PaintContext& context) {
     }
     
     // Get text properties
-    std::string text = textBox->textNode()->nodeValue();
+    const std::string& text = textBox->textNode()->nodeValue();
     Color textColor = getTextColor(textBox);
     
     // Get font properties
-    css::Value fontFamilyValue = textBox->style().getProperty("font-family");
-    css::Value fontSizeValue = textBox->style().getProperty("font-size");
+    const css::Value& fontFamilyValue = textBox->style().getProperty(css::PropertyId::FONT_FAMILY);
+    const css::Value& fontSizeValue = textBox->style().getProperty(css::PropertyId::FONT_SIZE);
     
-    std::string fontFamily = fontFamilyValue.stringValue();
-    if (fontFamily.empty()) {
-        fontFamily = "Arial";
-    }
+    static const std::string defaultFontFamily = "Arial";
+    const std::string& fontFamily = fontFamilyValue.stringValue().empty()
+        ? defaultFontFamily : fontFamilyValue.stringValue();
     
     float fontSize = 16.0f; // Default
     if (fontSizeValue.type() == css::ValueType::LENGTH) {
@@ -492,7 +920,7 @@ Color PaintSystem::getBackgroundColor(layout::Box* box) {
     }
     
     // Get background color from style
-    css::Value bgColorValue = box->style().getProperty("background-color");
+    const css::Value& bgColorValue = box->style().getProperty(css::PropertyId::BACKGROUND_COLOR);
     return Color::fromCssColor(bgColorValue);
 }
 
@@ -502,7 +930,7 @@ Color PaintSystem::getBorderColor(layout::Box* box) {
     }
     
     // Get border color from style
-    css::Value borderColorValue = box->style().getProperty("border-color");
+    const css::Value& borderColorValue = box->style().getProperty(css::PropertyId::BORDER_COLOR);
     if (borderColorValue.stringValue().empty()) {
         // Default to black if not specified
         return Color(0, 0, 0);
@@ -516,7 +944,7 @@ Color PaintSystem::getTextColor(layout::Box* box) {
     }
     
     // Get text color from style
-    css::Value textColorValue = box->style().getProperty("color");
+    const css::Value& textColorValue = box->style().getProperty(css::PropertyId::COLOR);
     if (textColorValue.stringValue().empty()) {
         // Default to black if not specified
         return Color(0, 0, 0);
@@ -529,6 +957,9 @@ void PaintSystem::paintDisplayList(const DisplayList& displayList, RenderingCont
         return;
     }
     
+    TRACE_SCOPE("paint", "PaintSystem::paintDisplayList");
+    ALLOC_SCOPE(RENDERING);
+    
     // Paint the display list to the context
     displayList.paint(context);
 }
@@ -4,15 +4,24 @@
 #include "../layout/box_model.h"
 #include "render_target.h"
 #include "custom_renderer.h"
+#include <cstdint>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <map>
 
 namespace browser {
 namespace rendering {
 
-// Display item types
-enum class DisplayItemType {
+class Layer;
+class LayerTree;
+
+// Display item types; the tag every display item starts with
+enum class DisplayItemType : uint8_t {
     BACKGROUND,
     BORDER,
     TEXT,
@@ -23,192 +32,139 @@ enum class DisplayItemType {
     LINE
 };
 
-// Base display item class
-class DisplayItem {
-public:
-    DisplayItem(DisplayItemType type);
-    virtual ~DisplayItem();
-    
-    // Get item type
-    DisplayItemType type() const { return m_type; }
-    
-    // Paint method (to be overridden by derived classes)
-    virtual void paint(RenderingContext* context) = 0;
-    
-private:
-    DisplayItemType m_type;
+// Text in a display list's string pool (DisplayList::string)
+struct DisplayString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// Display items are plain records stored back to back in a display list's
+// command buffer, with their text in its string pool. Each starts with its
+// type tag; readers switch on the tag and view the record as its type.
+struct DisplayItem {
+    DisplayItemType type;
+    
+    template <typename Item>
+    const Item& as() const {
+        return *reinterpret_cast<const Item*>(this);
+    }
 };
 
 // Background display item
-class BackgroundDisplayItem : public DisplayItem {
-public:
-    BackgroundDisplayItem(const layout::Rect& rect, const Color& color);
-    virtual ~BackgroundDisplayItem();
-    
-    // Getters
-    const layout::Rect& rect() const { return m_rect; }
-    const Color& color() const { return m_color; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    layout::Rect m_rect;
-    Color m_color;
+struct BackgroundDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::BACKGROUND;
+    DisplayItem header;
+    layout::Rect rect;
+    Color color;
 };
 
 // Border display item
-class BorderDisplayItem : public DisplayItem {
-public:
-    BorderDisplayItem(const layout::Rect& rect, const Color& color, 
-                     float top, float right, float bottom, float left);
-    virtual ~BorderDisplayItem();
-    
-    // Getters
-    const layout::Rect& rect() const { return m_rect; }
-    const Color& color() const { return m_color; }
-    float topWidth() const { return m_topWidth; }
-    float rightWidth() const { return m_rightWidth; }
-    float bottomWidth() const { return m_bottomWidth; }
-    float leftWidth() const { return m_leftWidth; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    layout::Rect m_rect;
-    Color m_color;
-    float m_topWidth;
-    float m_rightWidth;
-    float m_bottomWidth;
-    float m_leftWidth;
+struct BorderDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::BORDER;
+    DisplayItem header;
+    layout::Rect rect;
+    Color color;
+    float topWidth;
+    float rightWidth;
+    float bottomWidth;
+    float leftWidth;
 };
 
 // Text display item
-class TextDisplayItem : public DisplayItem {
-public:
-    TextDisplayItem(const std::string& text, float x, float y, 
-                   const Color& color, const std::string& fontFamily, float fontSize);
-    virtual ~TextDisplayItem();
-    
-    // Getters
-    const std::string& text() const { return m_text; }
-    float x() const { return m_x; }
-    float y() const { return m_y; }
-    const Color& color() const { return m_color; }
-    const std::string& fontFamily() const { return m_fontFamily; }
-    float fontSize() const { return m_fontSize; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    std::string m_text;
-    float m_x;
-    float m_y;
-    Color m_color;
-    std::string m_fontFamily;
-    float m_fontSize;
+struct TextDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::TEXT;
+    DisplayItem header;
+    DisplayString text;
+    DisplayString fontFamily;
+    float x;
+    float y;
+    Color color;
+    float fontSize;
 };
 
 // Image display item
-class ImageDisplayItem : public DisplayItem {
-public:
-    ImageDisplayItem(const std::string& url, const layout::Rect& rect);
-    virtual ~ImageDisplayItem();
-    
-    // Getters
-    const std::string& url() const { return m_url; }
-    const layout::Rect& rect() const { return m_rect; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    std::string m_url;
-    layout::Rect m_rect;
+struct ImageDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::IMAGE;
+    DisplayItem header;
+    DisplayString url;
+    layout::Rect rect;
 };
 
 // Rectangle display item
-class RectDisplayItem : public DisplayItem {
-public:
-    RectDisplayItem(const layout::Rect& rect, const Color& color, bool fill);
-    virtual ~RectDisplayItem();
-    
-    // Getters
-    const layout::Rect& rect() const { return m_rect; }
-    const Color& color() const { return m_color; }
-    bool filled() const { return m_fill; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    layout::Rect m_rect;
-    Color m_color;
-    bool m_fill;
+struct RectDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::RECT;
+    DisplayItem header;
+    layout::Rect rect;
+    Color color;
+    bool filled;
 };
 
 // Transform display item
-class TransformDisplayItem : public DisplayItem {
-public:
-    TransformDisplayItem(float dx, float dy);
-    virtual ~TransformDisplayItem();
-    
-    // Getters
-    float dx() const { return m_dx; }
-    float dy() const { return m_dy; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    float m_dx;
-    float m_dy;
+struct TransformDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::TRANSFORM;
+    DisplayItem header;
+    float dx;
+    float dy;
 };
 
 // Clip display item
-class ClipDisplayItem : public DisplayItem {
-public:
-    ClipDisplayItem(const layout::Rect& rect);
-    virtual ~ClipDisplayItem();
-    
-    // Getters
-    const layout::Rect& rect() const { return m_rect; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    layout::Rect m_rect;
+struct ClipDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::CLIP;
+    DisplayItem header;
+    layout::Rect rect;
 };
 
 // Line display item
-class LineDisplayItem : public DisplayItem {
-public:
-    LineDisplayItem(float x1, float y1, float x2, float y2, const Color& color, float thickness);
-    virtual ~LineDisplayItem();
-    
-    // Getters
-    float x1() const { return m_x1; }
-    float y1() const { return m_y1; }
-    float x2() const { return m_x2; }
-    float y2() const { return m_y2; }
-    const Color& color() const { return m_color; }
-    float thickness() const { return m_thickness; }
-    
-    // Paint method
-    virtual void paint(RenderingContext* context) override;
-    
-private:
-    float m_x1, m_y1, m_x2, m_y2;
-    Color m_color;
-    float m_thickness;
+struct LineDisplayItem {
+    static constexpr DisplayItemType itemType = DisplayItemType::LINE;
+    DisplayItem header;
+    float x1, y1, x2, y2;
+    Color color;
+    float thickness;
 };
 
-// Display list class - a list of display items to be painted
+// Where a display item draws: its bounds in the list's coordinates, with
+// the transforms before it applied and clipped by the clip in effect, and
+// the translation and clip it is drawn with. TRANSFORM and CLIP items have
+// empty bounds.
+struct DisplayItemBounds {
+    layout::Rect rect;
+    uint32_t offset;  // Of the item in the command buffer
+    int32_t clip;     // DisplayList::clipRect() index, -1 for none
+    float dx;         // Translation in effect
+    float dy;
+};
+
+// Display list class - display items in one contiguous command buffer and
+// their text in one string pool, so building a list costs a couple of
+// allocations (none once reserved) rather than one per item.
+//
+// Appending an item also records its bounds, building a bounding volume
+// hierarchy over the items in list order: each leaf covers bvhFanout
+// consecutive items and each node above bvhFanout consecutive nodes of the
+// level below. A leaf joins the tree once full. cull() walks the tree to
+// find the items that reach a rect without visiting the rest, so replaying
+// part of a long document costs what's in that part.
 class DisplayList {
 public:
+    // Walks the items in order
+    class const_iterator {
+    public:
+        explicit const_iterator(const unsigned char* position) : m_position(position) {}
+        
+        const DisplayItem& operator*() const { return *reinterpret_cast<const DisplayItem*>(m_position); }
+        const DisplayItem* operator->() const { return &**this; }
+        const_iterator& operator++() {
+            m_position += itemSize((**this).type);
+            return *this;
+        }
+        bool operator==(const const_iterator& other) const { return m_position == other.m_position; }
+        bool operator!=(const const_iterator& other) const { return m_position != other.m_position; }
+        
+    private:
+        const unsigned char* m_position;
+    };
+    
     DisplayList();
     ~DisplayList();
     
@@ -217,28 +173,99 @@ public:
     DisplayList& operator=(const DisplayList&) = delete;
     
     // Define move constructor and move assignment operator
-    DisplayList(DisplayList&& other) noexcept : m_items(std::move(other.m_items)) {}
-    DisplayList& operator=(DisplayList&& other) noexcept {
-        if (this != &other) {
-            m_items = std::move(other.m_items);
-        }
-        return *this;
+    DisplayList(DisplayList&& other) noexcept = default;
+    DisplayList& operator=(DisplayList&& other) noexcept = default;
+    
+    // Add an item to the list; its header is tagged here
+    template <typename Item>
+    void append(Item item) {
+        static_assert(std::is_trivially_copyable<Item>::value, "display items are copied as bytes");
+        static_assert(alignof(Item) <= itemAlignment && sizeof(Item) % itemAlignment == 0,
+                      "display items must keep the items after them aligned");
+        item.header.type = Item::itemType;
+        size_t offset = m_commands.size();
+        m_commands.resize(offset + sizeof(Item));
+        std::memcpy(m_commands.data() + offset, &item, sizeof(Item));
+        ++m_size;
+        record(offset);
+    }
+    
+    // Copy text into the string pool
+    DisplayString addString(std::string_view text);
+    std::string_view string(DisplayString text) const {
+        return std::string_view(m_strings.data() + text.offset, text.length);
     }
     
-    // Add an item to the list
-    void appendItem(std::unique_ptr<DisplayItem> item);
+    // Items in order
+    const_iterator begin() const { return const_iterator(m_commands.data()); }
+    const_iterator end() const { return const_iterator(m_commands.data() + m_commands.size()); }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    
+    // Bytes of commands and pooled text, and room for them and the bounds
+    // of itemCount items
+    size_t commandBytes() const { return m_commands.size(); }
+    size_t stringBytes() const { return m_strings.size(); }
+    void reserve(size_t commandBytes, size_t stringBytes, size_t itemCount = 0);
     
-    // Get all items
-    const std::vector<std::unique_ptr<DisplayItem>>& items() const { return m_items; }
+    // Append items [first, last) of another list, pooling their text here.
+    // They're drawn with the translation and clip in effect at the end of
+    // this list; a whole list appended to an empty one is copied as is.
+    void append(const DisplayList& source, size_t first, size_t last);
     
     // Paint all items to a context
     void paint(RenderingContext* context) const;
     
-    // Clear the list
+    // Area the items draw to, in the list's coordinates: transforms
+    // applied, clipped by the clips in effect
+    layout::Rect bounds() const;
+    
+    // Paint the items that reach damage, a rect in the list's coordinates
+    void paint(RenderingContext* context, const layout::Rect& damage) const;
+    
+    // Item by index, and where it draws
+    const DisplayItem& item(size_t index) const {
+        return *reinterpret_cast<const DisplayItem*>(m_commands.data() + m_itemBounds[index].offset);
+    }
+    const DisplayItemBounds& itemBounds(size_t index) const { return m_itemBounds[index]; }
+    
+    // A clip items are drawn with, in the list's coordinates
+    const layout::Rect& clipRect(int32_t clip) const { return m_clips[clip]; }
+    
+    // Indices of the items whose bounds intersect rect, in list order
+    void cull(const layout::Rect& rect, std::vector<uint32_t>& items) const;
+    
+    // Same items with the same values and text, in the same order
+    bool operator==(const DisplayList& other) const;
+    bool operator!=(const DisplayList& other) const { return !(*this == other); }
+    
+    // Clear the list, keeping its buffers
     void clear();
     
+    // Size of an item of the given type in the command buffer
+    static size_t itemSize(DisplayItemType type);
+    
+    // Children per bounding volume hierarchy node
+    static constexpr size_t bvhFanout = 16;
+    
 private:
-    std::vector<std::unique_ptr<DisplayItem>> m_items;
+    static constexpr size_t itemAlignment = alignof(float);
+    
+    // Record the bounds of the item just appended at offset
+    void record(size_t offset);
+    void cullNode(size_t level, size_t node, const layout::Rect& rect, std::vector<uint32_t>& items) const;
+    
+    std::vector<unsigned char> m_commands;
+    std::string m_strings;
+    size_t m_size;
+    
+    std::vector<DisplayItemBounds> m_itemBounds;
+    std::vector<layout::Rect> m_clips;
+    std::vector<std::vector<layout::Rect>> m_bvh;  // Node bounds per level, full leaves first
+    layout::Rect m_openLeaf;  // Items after the last full leaf
+    float m_dx;  // Translation and clip the next item is drawn with
+    float m_dy;
+    int32_t m_clip;
 };
 
 // Paint context class - provides methods for building a display list
@@ -258,20 +285,32 @@ public:
     // Get the display list
     const DisplayList& displayList() const { return m_displayList; }
     
+    // Room for a display list of this size
+    void reserve(size_t commandBytes, size_t stringBytes, size_t itemCount = 0) {
+        m_displayList.reserve(commandBytes, stringBytes, itemCount);
+    }
+    
     // Drawing methods
     void drawBackground(const layout::Rect& rect, const Color& color);
     void drawBorder(const layout::Rect& rect, const Color& color, 
                    float top, float right, float bottom, float left);
-    void drawText(const std::string& text, float x, float y, 
-                 const Color& color, const std::string& fontFamily, float fontSize);
-    void drawImage(const std::string& url, const layout::Rect& rect);
+    void drawText(std::string_view text, float x, float y, 
+                 const Color& color, std::string_view fontFamily, float fontSize);
+    void drawImage(std::string_view url, const layout::Rect& rect);
     void drawRect(const layout::Rect& rect, const Color& color, bool fill);
     void drawLine(float x1, float y1, float x2, float y2, const Color& color, float thickness);
     void transform(float dx, float dy);
     void clip(const layout::Rect& rect);
     
+    // Append items [first, last) of another display list
+    void append(const DisplayList& list, size_t first, size_t last);
+    
+    // Empty the display list, keeping its buffers
+    void clear();
+    
 private:
     DisplayList m_displayList;
+    DisplayString m_fontFamily;  // Last font family pooled; runs of text share it
 };
 
 // Paint system class - responsible for painting the layout tree
@@ -286,9 +325,28 @@ public:
     // Create a paint context for a box
     PaintContext createContext(layout::Box* box);
     
-    // Paint a box and its children to a context
+    // Paint a box and its children to a context. The items painted for
+    // each box's subtree are kept, tagged with the box's paint generation
+    // (layout::Box::paintGeneration), and copied into the next paint of
+    // the tree while the subtree is unchanged; painting an unchanged tree
+    // again copies the last display list.
     void paintBox(layout::Box* box, PaintContext& context);
     
+    // Area the last paintBox() painted differently from the one before it:
+    // the old and new bounds of items that changed, appeared or went away,
+    // in the painted tree's coordinates (without the transform the context
+    // was given). Empty when nothing changed.
+    const layout::Rect& paintDamage() const { return m_paintDamage; }
+    
+    // Items the last paintBox() copied instead of painting
+    size_t reusedItems() const { return m_reusedItems; }
+    
+    // Paint a box and its children into compositor layers: fixed-position
+    // boxes and boxes with opacity or a transform get layers of their own,
+    // and content painted after them continues in a new layer above. Layers
+    // whose display list is unchanged keep their pixels.
+    void paintLayers(layout::Box* root, LayerTree& layers);
+    
     // Paint a text box
     void paintText(layout::TextBox* textBox, PaintContext& context);
     
@@ -296,10 +354,55 @@ public:
     void paintDisplayList(const DisplayList& displayList, RenderingContext* context);
     
 private:
+    // Background, border and text of a box, without its children
+    void paintBoxContents(layout::Box* box, PaintContext& context);
+    
+    // The items of a box's subtree in the retained list: its background,
+    // border and text, the translation to its children, their items and
+    // the translation back. Entries are in paint order, so a subtree's
+    // boxes follow its root.
+    struct PaintedBox {
+        const layout::Box* box;
+        layout::BoxIndex index;
+        uint64_t generation;  // The box's paint generation when painted
+        uint32_t firstItem;
+        uint32_t childItem;   // The translation to the children
+        uint32_t endItem;
+        uint32_t endEntry;    // Past the subtree's entries
+    };
+    static constexpr uint32_t noEntry = UINT32_MAX;
+    
+    // Paint a box and its descendants into m_retained, copying the
+    // subtrees unchanged since the last paint from m_previous and
+    // gathering damage; paintBox traces the whole walk
+    void paintBoxTree(layout::Box* box);
+    
+    // Damage the old items of boxes the last paint didn't reach
+    void addRemovedDamage();
+    
+    // paintBoxTree into layers; layer is the one being painted, and may be
+    // replaced by a later one. originX/Y is the translation in effect.
+    void paintLayerTree(layout::Box* box, LayerTree& layers, Layer*& layer, float originX, float originY);
+    
     // Helper methods
     Color getBackgroundColor(layout::Box* box);
     Color getBorderColor(layout::Box* box);
     Color getTextColor(layout::Box* box);
+    
+    // Sizes of the last display list painted, reserved up front for the next
+    size_t m_commandBytesHint;
+    size_t m_stringBytesHint;
+    size_t m_itemCountHint;
+    
+    // Items of the last paintBox() and the one before, and their boxes
+    PaintContext m_retained;
+    PaintContext m_previous;
+    std::vector<PaintedBox> m_retainedBoxes;
+    std::vector<PaintedBox> m_previousBoxes;
+    std::vector<uint32_t> m_previousIndex;  // m_previousBoxes entry by box index
+    std::vector<std::pair<uint32_t, uint32_t>> m_reachedBoxes;  // Ranges of m_previousBoxes
+    layout::Rect m_paintDamage;
+    size_t m_reusedItems;
 };
 
 } // namespace rendering
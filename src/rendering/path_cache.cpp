@@ -0,0 +1,315 @@
+#include "path_cache.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace browser {
+namespace rendering {
+
+namespace {
+
+const int maxSegments = 128;  // Per curve
+
+// Appends points and contours to a flattened path, tracking the pen
+class Flattener {
+public:
+    Flattener(FlattenedPath& flattened, float tolerance)
+        : m_flattened(flattened)
+        , m_tolerance(std::max(tolerance, 0.01f))
+        , m_x(0), m_y(0), m_startX(0), m_startY(0)
+        , m_contourStart(0)
+    {
+    }
+
+    void moveTo(float x, float y) {
+        endContour(false);
+        addPoint(x, y);
+        m_startX = x;
+        m_startY = y;
+    }
+
+    void lineTo(float x, float y) {
+        startIfNeeded();
+        addPoint(x, y);
+    }
+
+    void quadTo(float cx, float cy, float x, float y) {
+        startIfNeeded();
+        float x0 = m_x, y0 = m_y;
+        // Chord error of n segments is |p0 - 2c + p1| / (4 n^2)
+        float dd = std::hypot(x0 - 2 * cx + x, y0 - 2 * cy + y);
+        int n = segments(std::sqrt(dd / (4 * m_tolerance)));
+        for (int i = 1; i <= n; ++i) {
+            float t = static_cast<float>(i) / n;
+            float mt = 1 - t;
+            addPoint(mt * mt * x0 + 2 * mt * t * cx + t * t * x,
+                     mt * mt * y0 + 2 * mt * t * cy + t * t * y);
+        }
+    }
+
+    void bezierTo(float c1x, float c1y, float c2x, float c2y, float x, float y) {
+        startIfNeeded();
+        float x0 = m_x, y0 = m_y;
+        // Chord error of n segments is at most 3/4 of the largest second
+        // difference of the control points over n^2
+        float dd = std::max(std::hypot(x0 - 2 * c1x + c2x, y0 - 2 * c1y + c2y),
+                            std::hypot(c1x - 2 * c2x + x, c1y - 2 * c2y + y));
+        int n = segments(std::sqrt(0.75f * dd / m_tolerance));
+        for (int i = 1; i <= n; ++i) {
+            float t = static_cast<float>(i) / n;
+            float mt = 1 - t;
+            float a = mt * mt * mt, b = 3 * mt * mt * t, c = 3 * mt * t * t, d = t * t * t;
+            addPoint(a * x0 + b * c1x + c * c2x + d * x, a * y0 + b * c1y + c * c2y + d * y);
+        }
+    }
+
+    // As canvas arcTo: a line to where the circle of the radius touches the
+    // tangents pen -> (x1, y1) -> (x2, y2), then the arc to where it
+    // touches the second
+    void arcTo(float x1, float y1, float x2, float y2, float radius) {
+        startIfNeeded();
+        float ax = m_x - x1, ay = m_y - y1;
+        float bx = x2 - x1, by = y2 - y1;
+        float aLength = std::hypot(ax, ay);
+        float bLength = std::hypot(bx, by);
+        if (radius <= 0 || aLength == 0 || bLength == 0) {
+            addPoint(x1, y1);
+            return;
+        }
+        ax /= aLength; ay /= aLength;
+        bx /= bLength; by /= bLength;
+        float cosine = std::max(-1.0f, std::min(1.0f, ax * bx + ay * by));
+        float half = std::acos(cosine) * 0.5f;
+        if (half < 1e-4f || std::abs(half - static_cast<float>(M_PI) * 0.5f) < 1e-4f) {
+            // Collinear tangents
+            addPoint(x1, y1);
+            return;
+        }
+
+        float tangent = radius / std::tan(half);
+        float t1x = x1 + ax * tangent, t1y = y1 + ay * tangent;
+        float t2x = x1 + bx * tangent, t2y = y1 + by * tangent;
+        float mx = ax + bx, my = ay + by;
+        float mLength = std::hypot(mx, my);
+        float centerDistance = radius / std::sin(half);
+        float cx = x1 + mx / mLength * centerDistance;
+        float cy = y1 + my / mLength * centerDistance;
+
+        addPoint(t1x, t1y);
+        float a0 = std::atan2(t1y - cy, t1x - cx);
+        float a1 = std::atan2(t2y - cy, t2x - cx);
+        float sweep = a1 - a0;
+        if (sweep > static_cast<float>(M_PI)) sweep -= 2 * static_cast<float>(M_PI);
+        if (sweep < -static_cast<float>(M_PI)) sweep += 2 * static_cast<float>(M_PI);
+
+        // Each segment's sagitta stays within the tolerance
+        float step = 2 * std::acos(std::max(-1.0f, 1 - m_tolerance / radius));
+        int n = segments(std::abs(sweep) / std::max(step, 1e-3f));
+        for (int i = 1; i < n; ++i) {
+            float angle = a0 + sweep * i / n;
+            addPoint(cx + radius * std::cos(angle), cy + radius * std::sin(angle));
+        }
+        addPoint(t2x, t2y);
+    }
+
+    void closePath() {
+        endContour(true);
+        m_x = m_startX;
+        m_y = m_startY;
+    }
+
+    void finish() {
+        endContour(false);
+        const std::vector<float>& points = m_flattened.points;
+        if (points.empty()) {
+            return;
+        }
+        m_flattened.minX = m_flattened.maxX = points[0];
+        m_flattened.minY = m_flattened.maxY = points[1];
+        for (size_t i = 2; i < points.size(); i += 2) {
+            m_flattened.minX = std::min(m_flattened.minX, points[i]);
+            m_flattened.maxX = std::max(m_flattened.maxX, points[i]);
+            m_flattened.minY = std::min(m_flattened.minY, points[i + 1]);
+            m_flattened.maxY = std::max(m_flattened.maxY, points[i + 1]);
+        }
+    }
+
+private:
+    static int segments(float estimate) {
+        if (!(estimate > 1)) {
+            return 1;
+        }
+        return std::min(maxSegments, static_cast<int>(std::ceil(estimate)));
+    }
+
+    void addPoint(float x, float y) {
+        m_flattened.points.push_back(x);
+        m_flattened.points.push_back(y);
+        m_x = x;
+        m_y = y;
+    }
+
+    // Drawing without a moveTo starts at the pen
+    void startIfNeeded() {
+        if (m_flattened.pointCount() == m_contourStart) {
+            addPoint(m_x, m_y);
+            m_startX = m_x;
+            m_startY = m_y;
+        }
+    }
+
+    void endContour(bool closed) {
+        uint32_t end = static_cast<uint32_t>(m_flattened.pointCount());
+        if (end > m_contourStart) {
+            m_flattened.contours.push_back(FlattenedPath::Contour{end, closed});
+            m_contourStart = end;
+        }
+    }
+
+    FlattenedPath& m_flattened;
+    float m_tolerance;
+    float m_x, m_y;
+    float m_startX, m_startY;
+    size_t m_contourStart;
+};
+
+// The first point, which flattened points are relative to
+void pathOrigin(const Path& path, float& x, float& y) {
+    const std::vector<Path::Command>& commands = path.commands();
+    if (!commands.empty() && commands[0].type == Path::CommandType::MOVE_TO) {
+        x = commands[0].points[0];
+        y = commands[0].points[1];
+    } else {
+        x = y = 0;
+    }
+}
+
+uint64_t hashFloats(const std::vector<float>& values) {
+    uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (float value : values) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash = (hash ^ ((bits >> shift) & 0xFF)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+} // namespace
+
+void flattenPath(const Path& path, float originX, float originY, float tolerance, FlattenedPath& flattened) {
+    flattened = FlattenedPath();
+    Flattener flattener(flattened, tolerance);
+    for (const Path::Command& command : path.commands()) {
+        const float* p = command.points;
+        switch (command.type) {
+            case Path::CommandType::MOVE_TO:
+                flattener.moveTo(p[0] - originX, p[1] - originY);
+                break;
+            case Path::CommandType::LINE_TO:
+                flattener.lineTo(p[0] - originX, p[1] - originY);
+                break;
+            case Path::CommandType::BEZIER_TO:
+                flattener.bezierTo(p[0] - originX, p[1] - originY, p[2] - originX, p[3] - originY,
+                                   p[4] - originX, p[5] - originY);
+                break;
+            case Path::CommandType::QUAD_TO:
+                flattener.quadTo(p[0] - originX, p[1] - originY, p[2] - originX, p[3] - originY);
+                break;
+            case Path::CommandType::ARC_TO:
+                flattener.arcTo(p[0] - originX, p[1] - originY, p[2] - originX, p[3] - originY, p[4]);
+                break;
+            case Path::CommandType::CLOSE:
+                flattener.closePath();
+                break;
+        }
+    }
+    flattener.finish();
+}
+
+//-----------------------------------------------------------------------------
+// PathCache Implementation
+//-----------------------------------------------------------------------------
+
+PathCache::PathCache(size_t capacity)
+    : m_capacity(std::max<size_t>(capacity, 1))
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+PathCache::~PathCache() {
+}
+
+std::shared_ptr<const FlattenedPath> PathCache::get(const Path& path, float tolerance,
+                                                    float& originX, float& originY) {
+    pathOrigin(path, originX, originY);
+
+    // Points relative to the origin; a radius isn't a point
+    std::vector<float>& geometry = m_lookup.geometry;
+    geometry.clear();
+    geometry.push_back(tolerance);
+    for (const Path::Command& command : path.commands()) {
+        const float* p = command.points;
+        geometry.push_back(static_cast<float>(command.type));
+        switch (command.type) {
+            case Path::CommandType::MOVE_TO:
+            case Path::CommandType::LINE_TO:
+                geometry.insert(geometry.end(), {p[0] - originX, p[1] - originY});
+                break;
+            case Path::CommandType::BEZIER_TO:
+                geometry.insert(geometry.end(), {p[0] - originX, p[1] - originY, p[2] - originX,
+                                                 p[3] - originY, p[4] - originX, p[5] - originY});
+                break;
+            case Path::CommandType::QUAD_TO:
+                geometry.insert(geometry.end(), {p[0] - originX, p[1] - originY, p[2] - originX, p[3] - originY});
+                break;
+            case Path::CommandType::ARC_TO:
+                geometry.insert(geometry.end(), {p[0] - originX, p[1] - originY, p[2] - originX,
+                                                 p[3] - originY, p[4]});
+                break;
+            case Path::CommandType::CLOSE:
+                break;
+        }
+    }
+    m_lookup.hash = hashFloats(geometry);
+
+    auto found = m_index.find(m_lookup);
+    if (found != m_index.end()) {
+        ++m_hits;
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        return found->second->flattened;
+    }
+
+    ++m_misses;
+    TRACE_SCOPE("rendering", "PathCache::flatten");
+    auto flattened = std::make_shared<FlattenedPath>();
+    flattenPath(path, originX, originY, tolerance, *flattened);
+
+    m_entries.push_front(Entry{m_lookup, flattened});
+    m_index.emplace(m_lookup, m_entries.begin());
+    while (m_entries.size() > m_capacity) {
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+    }
+    return flattened;
+}
+
+void PathCache::clear() {
+    m_entries.clear();
+    m_index.clear();
+}
+
+void PathCache::resetCounters() {
+    m_hits = 0;
+    m_misses = 0;
+}
+
+} // namespace rendering
+} // namespace browser
@@ -0,0 +1,88 @@
+#ifndef BROWSER_RENDERING_PATH_CACHE_H
+#define BROWSER_RENDERING_PATH_CACHE_H
+
+#include "custom_renderer.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace browser {
+namespace rendering {
+
+// A path with its curves flattened to line segments: the points of each
+// subpath in order, relative to the path's origin (its first point)
+struct FlattenedPath {
+    struct Contour {
+        uint32_t end;  // Past the contour's last point
+        bool closed;
+    };
+
+    std::vector<float> points;  // x, y pairs
+    std::vector<Contour> contours;
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+
+    size_t pointCount() const { return points.size() / 2; }
+};
+
+// Flatten path, relative to (originX, originY), so no segment strays more
+// than tolerance from the curve it replaces
+void flattenPath(const Path& path, float originX, float originY, float tolerance, FlattenedPath& flattened);
+
+// Flattened paths keyed by their geometry relative to the first point and
+// the flattening tolerance (which follows the device scale), so a shape
+// drawn again, wherever it's placed, skips curve subdivision. The least
+// recently used are dropped past capacity.
+class PathCache {
+public:
+    static constexpr size_t defaultCapacity = 512;  // Paths
+
+    explicit PathCache(size_t capacity = defaultCapacity);
+    ~PathCache();
+
+    PathCache(const PathCache&) = delete;
+    PathCache& operator=(const PathCache&) = delete;
+
+    // path flattened, and where its origin is
+    std::shared_ptr<const FlattenedPath> get(const Path& path, float tolerance, float& originX, float& originY);
+
+    size_t size() const { return m_entries.size(); }
+    void clear();
+
+    // Counters since construction or resetCounters()
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    void resetCounters();
+
+private:
+    struct Key {
+        uint64_t hash;
+        std::vector<float> geometry;  // Command types and relative points
+
+        bool operator==(const Key& other) const { return hash == other.hash && geometry == other.geometry; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return static_cast<size_t>(key.hash); }
+    };
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const FlattenedPath> flattened;
+    };
+    using EntryList = std::list<Entry>;
+
+    size_t m_capacity;
+    EntryList m_entries;  // Most recently used first
+    std::unordered_map<Key, EntryList::iterator, KeyHash> m_index;
+    Key m_lookup;         // Reused for each lookup's key
+    size_t m_hits;
+    size_t m_misses;
+};
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_PATH_CACHE_H
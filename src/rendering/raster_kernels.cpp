@@ -0,0 +1,377 @@
+#include "raster_kernels.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BROWSER_RASTER_SSE2 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <immintrin.h>
+#include <intrin.h>
+#define BROWSER_RASTER_AVX2 1
+#define BROWSER_TARGET_AVX2
+#elif defined(__GNUC__) || defined(__clang__)
+#include <immintrin.h>
+#define BROWSER_RASTER_AVX2 1
+#define BROWSER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BROWSER_RASTER_NEON 1
+#endif
+
+namespace browser {
+namespace rendering {
+
+namespace {
+
+//-----------------------------------------------------------------------------
+// Scalar
+//-----------------------------------------------------------------------------
+
+// src + dst * (255 - srcAlpha) / 255, two channels at a time
+inline uint32_t blendPixel(uint32_t dst, uint32_t src) {
+    uint32_t inverse = 255 - (src >> 24);
+    uint32_t rb = (dst & 0x00FF00FF) * inverse + 0x00800080;
+    uint32_t ag = ((dst >> 8) & 0x00FF00FF) * inverse + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+    return src + (rb | ag);
+}
+
+// Every channel of a pixel scaled by coverage / 255
+inline uint32_t scalePixel(uint32_t pixel, uint32_t coverage) {
+    uint32_t rb = (pixel & 0x00FF00FF) * coverage + 0x00800080;
+    uint32_t ag = ((pixel >> 8) & 0x00FF00FF) * coverage + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+    return rb | ag;
+}
+
+void scalarBlend(uint32_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t alpha = src[i] >> 24;
+        if (alpha == 255) {
+            dst[i] = src[i];
+        } else if (alpha != 0) {
+            dst[i] = blendPixel(dst[i], src[i]);
+        }
+    }
+}
+
+void scalarFill(uint32_t* dst, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 255) {
+        std::fill(dst, dst + count, color);
+    } else if (alpha != 0) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = blendPixel(dst[i], color);
+        }
+    }
+}
+
+void scalarMask(uint32_t* dst, const uint8_t* coverage, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; ++i) {
+        if (coverage[i] == 255) {
+            dst[i] = blendPixel(dst[i], color);
+        } else if (coverage[i] != 0) {
+            dst[i] = blendPixel(dst[i], scalePixel(color, coverage[i]));
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// SSE2: four pixels per step, widened to 16 bits per channel
+//-----------------------------------------------------------------------------
+
+#ifdef BROWSER_RASTER_SSE2
+inline __m128i div255x8(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(0x80));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Two widened pixels blended: src + dst * (255 - srcAlpha) / 255
+inline __m128i blend2(__m128i dst, __m128i src) {
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    return _mm_add_epi16(src, div255x8(_mm_mullo_epi16(dst, inverse)));
+}
+
+inline __m128i blend4(__m128i dst, __m128i src) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = blend2(_mm_unpacklo_epi8(dst, zero), _mm_unpacklo_epi8(src, zero));
+    __m128i hi = blend2(_mm_unpackhi_epi8(dst, zero), _mm_unpackhi_epi8(src, zero));
+    return _mm_packus_epi16(lo, hi);
+}
+
+void sse2Blend(uint32_t* dst, const uint32_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), blend4(d, s));
+    }
+    scalarBlend(dst + i, src + i, count - i);
+}
+
+void sse2Fill(uint32_t* dst, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0) {
+        return;
+    }
+    size_t i = 0;
+    __m128i s = _mm_set1_epi32(static_cast<int>(color));
+    if (alpha == 255) {
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+        }
+    } else {
+        for (; i + 4 <= count; i += 4) {
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), blend4(d, s));
+        }
+    }
+    scalarFill(dst + i, count - i, color);
+}
+
+void sse2Mask(uint32_t* dst, const uint8_t* coverage, size_t count, uint32_t color) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color)), zero);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int bytes;
+        std::memcpy(&bytes, coverage + i, 4);
+        if (bytes == 0) {
+            continue;
+        }
+
+        // Coverage repeated across the channels of pixels 0-1 and 2-3
+        __m128i c = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        c = _mm_unpacklo_epi16(c, c);
+        __m128i c01 = _mm_unpacklo_epi32(c, c);
+        __m128i c23 = _mm_unpackhi_epi32(c, c);
+
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i lo = blend2(_mm_unpacklo_epi8(d, zero), div255x8(_mm_mullo_epi16(color16, c01)));
+        __m128i hi = blend2(_mm_unpackhi_epi8(d, zero), div255x8(_mm_mullo_epi16(color16, c23)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    scalarMask(dst + i, coverage + i, count - i, color);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// AVX2: the SSE2 kernels at eight pixels per step. Unpacks and packs work
+// within 128-bit lanes, so pixels 0-1 and 4-5 share a register, then 2-3
+// and 6-7, and the pack puts them back in order.
+//-----------------------------------------------------------------------------
+
+#ifdef BROWSER_RASTER_AVX2
+BROWSER_TARGET_AVX2 inline __m256i div255x16(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(0x80));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+BROWSER_TARGET_AVX2 inline __m256i blend4x2(__m256i dst, __m256i src) {
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xFF), 0xFF);
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+    return _mm256_add_epi16(src, div255x16(_mm256_mullo_epi16(dst, inverse)));
+}
+
+BROWSER_TARGET_AVX2 inline __m256i blend8(__m256i dst, __m256i src) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = blend4x2(_mm256_unpacklo_epi8(dst, zero), _mm256_unpacklo_epi8(src, zero));
+    __m256i hi = blend4x2(_mm256_unpackhi_epi8(dst, zero), _mm256_unpackhi_epi8(src, zero));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+BROWSER_TARGET_AVX2 void avx2Blend(uint32_t* dst, const uint32_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), blend8(d, s));
+    }
+    scalarBlend(dst + i, src + i, count - i);
+}
+
+BROWSER_TARGET_AVX2 void avx2Fill(uint32_t* dst, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0) {
+        return;
+    }
+    size_t i = 0;
+    __m256i s = _mm256_set1_epi32(static_cast<int>(color));
+    if (alpha == 255) {
+        for (; i + 8 <= count; i += 8) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s);
+        }
+    } else {
+        for (; i + 8 <= count; i += 8) {
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), blend8(d, s));
+        }
+    }
+    scalarFill(dst + i, count - i, color);
+}
+
+BROWSER_TARGET_AVX2 void avx2Mask(uint32_t* dst, const uint8_t* coverage, size_t count, uint32_t color) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i color16 = _mm256_unpacklo_epi8(_mm256_set1_epi32(static_cast<int>(color)), zero);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint64_t bytes;
+        std::memcpy(&bytes, coverage + i, 8);
+        if (bytes == 0) {
+            continue;
+        }
+
+        // Coverage per pixel in both 16-bit halves of its 32-bit lane, then
+        // repeated across the channels in the unpack order
+        __m256i c = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(coverage + i)));
+        c = _mm256_or_si256(c, _mm256_slli_epi32(c, 16));
+        __m256i cLo = _mm256_unpacklo_epi32(c, c);
+        __m256i cHi = _mm256_unpackhi_epi32(c, c);
+
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i lo = blend4x2(_mm256_unpacklo_epi8(d, zero), div255x16(_mm256_mullo_epi16(color16, cLo)));
+        __m256i hi = blend4x2(_mm256_unpackhi_epi8(d, zero), div255x16(_mm256_mullo_epi16(color16, cHi)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    scalarMask(dst + i, coverage + i, count - i, color);
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    // AVX2 in CPUID leaf 7, and the OS saving YMM state
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// NEON: eight pixels per step, split into channel planes
+//-----------------------------------------------------------------------------
+
+#ifdef BROWSER_RASTER_NEON
+// x / 255 rounded, narrowed to 8 bits
+inline uint8x8_t div255x8(uint16x8_t x) {
+    return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+inline uint8x8x4_t blend8(uint8x8x4_t dst, uint8x8x4_t src) {
+    uint8x8_t inverse = vmvn_u8(src.val[3]);
+    for (int c = 0; c < 4; ++c) {
+        dst.val[c] = vadd_u8(src.val[c], div255x8(vmull_u8(dst.val[c], inverse)));
+    }
+    return dst;
+}
+
+void neonBlend(uint32_t* dst, const uint32_t* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8_t*>(src + i));
+        uint8x8x4_t d = vld4_u8(reinterpret_cast<const uint8_t*>(dst + i));
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + i), blend8(d, s));
+    }
+    scalarBlend(dst + i, src + i, count - i);
+}
+
+void neonFill(uint32_t* dst, size_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 0) {
+        return;
+    }
+    size_t i = 0;
+    if (alpha == 255) {
+        uint32x4_t s = vdupq_n_u32(color);
+        for (; i + 4 <= count; i += 4) {
+            vst1q_u32(dst + i, s);
+        }
+    } else {
+        uint8x8x4_t s;
+        for (int c = 0; c < 4; ++c) {
+            s.val[c] = vdup_n_u8(static_cast<uint8_t>(color >> (c * 8)));
+        }
+        for (; i + 8 <= count; i += 8) {
+            uint8x8x4_t d = vld4_u8(reinterpret_cast<const uint8_t*>(dst + i));
+            vst4_u8(reinterpret_cast<uint8_t*>(dst + i), blend8(d, s));
+        }
+    }
+    scalarFill(dst + i, count - i, color);
+}
+
+void neonMask(uint32_t* dst, const uint8_t* coverage, size_t count, uint32_t color) {
+    uint8x8_t channels[4];
+    for (int c = 0; c < 4; ++c) {
+        channels[c] = vdup_n_u8(static_cast<uint8_t>(color >> (c * 8)));
+    }
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8_t cover = vld1_u8(coverage + i);
+        if (vget_lane_u64(vreinterpret_u64_u8(cover), 0) == 0) {
+            continue;
+        }
+        uint8x8x4_t s;
+        for (int c = 0; c < 4; ++c) {
+            s.val[c] = div255x8(vmull_u8(channels[c], cover));
+        }
+        uint8x8x4_t d = vld4_u8(reinterpret_cast<const uint8_t*>(dst + i));
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + i), blend8(d, s));
+    }
+    scalarMask(dst + i, coverage + i, count - i, color);
+}
+#endif
+
+const RasterKernels scalarKernels = { "scalar", scalarFill, scalarBlend, scalarMask };
+#ifdef BROWSER_RASTER_SSE2
+const RasterKernels sse2Kernels = { "sse2", sse2Fill, sse2Blend, sse2Mask };
+#endif
+#ifdef BROWSER_RASTER_AVX2
+const RasterKernels avx2Kernels = { "avx2", avx2Fill, avx2Blend, avx2Mask };
+#endif
+#ifdef BROWSER_RASTER_NEON
+const RasterKernels neonKernels = { "neon", neonFill, neonBlend, neonMask };
+#endif
+
+} // namespace
+
+const RasterKernels& scalarRasterKernels() {
+    return scalarKernels;
+}
+
+std::vector<const RasterKernels*> availableRasterKernels() {
+    std::vector<const RasterKernels*> kernels = { &scalarKernels };
+#ifdef BROWSER_RASTER_SSE2
+    kernels.push_back(&sse2Kernels);
+#endif
+#ifdef BROWSER_RASTER_AVX2
+    if (cpuHasAvx2()) {
+        kernels.push_back(&avx2Kernels);
+    }
+#endif
+#ifdef BROWSER_RASTER_NEON
+    kernels.push_back(&neonKernels);
+#endif
+    return kernels;
+}
+
+const RasterKernels& rasterKernels() {
+    static const RasterKernels* kernels = availableRasterKernels().back();
+    return *kernels;
+}
+
+} // namespace rendering
+} // namespace browser
@@ -0,0 +1,41 @@
+#ifndef BROWSER_RENDERING_RASTER_KERNELS_H
+#define BROWSER_RENDERING_RASTER_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace browser {
+namespace rendering {
+
+// Span kernels over Framebuffer pixels (premultiplied RGBA8, red in the low
+// byte). Blending is source-over with exact rounding of x / 255, so every
+// kernel set produces the same bytes as the scalar one.
+struct RasterKernels {
+    const char* name;
+
+    // Fill count pixels with a packed color: stored when opaque, blended
+    // when translucent, skipped when transparent
+    void (*fill)(uint32_t* dst, size_t count, uint32_t color);
+
+    // Blend a span of packed pixels over dst
+    void (*blend)(uint32_t* dst, const uint32_t* src, size_t count);
+
+    // Blend a packed color over dst with 8-bit coverage per pixel, as for a
+    // glyph mask
+    void (*mask)(uint32_t* dst, const uint8_t* coverage, size_t count, uint32_t color);
+};
+
+// The fastest kernels this CPU runs, chosen on first use
+const RasterKernels& rasterKernels();
+
+// Plain C++ kernels
+const RasterKernels& scalarRasterKernels();
+
+// Every kernel set this build and CPU can run, scalar first
+std::vector<const RasterKernels*> availableRasterKernels();
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_RASTER_KERNELS_H
@@ -0,0 +1,510 @@
+#include "tile_rasterizer.h"
+#include "raster_kernels.h"
+#include "../threading/work_pool.h"
+#include "../tracing/alloc_tracker.h"
+#include "../tracing/trace.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace browser {
+namespace rendering {
+
+namespace {
+
+// Pixel edge nearest to a coordinate; pixels whose centers fall inside a
+// rect are covered
+int snap(float v) {
+    return static_cast<int>(std::floor(v + 0.5f));
+}
+
+// Code point of the UTF-8 sequence at text[i], advancing i past it;
+// U+FFFD for malformed input
+uint32_t decodeUtf8(std::string_view text, size_t& i) {
+    unsigned char lead = static_cast<unsigned char>(text[i++]);
+    if (lead < 0x80) {
+        return lead;
+    }
+    int length = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+    if (length < 0) {
+        return 0xFFFD;
+    }
+    uint32_t code = lead & (0x3F >> length);
+    for (int n = 0; n < length; ++n) {
+        if (i >= text.size() || (static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) {
+            return 0xFFFD;
+        }
+        code = (code << 6) | (static_cast<unsigned char>(text[i++]) & 0x3F);
+    }
+    return code;
+}
+
+// Fill the part of [x0, x1) x [y0, y1) inside area
+template <typename Area>
+void fillRect(Framebuffer& target, const Area& area, int x0, int y0, int x1, int y1, uint32_t color) {
+    const RasterKernels& kernels = rasterKernels();
+    x0 = std::max(x0, area.x0);
+    y0 = std::max(y0, area.y0);
+    x1 = std::min(x1, area.x1);
+    y1 = std::min(y1, area.y1);
+    if (x0 >= x1) {
+        return;
+    }
+    for (int y = y0; y < y1; ++y) {
+        kernels.fill(target.row(y) + x0, static_cast<size_t>(x1 - x0), color);
+    }
+}
+
+} // namespace
+
+TileRasterizer::TileRasterizer()
+    : m_workPool(&threading::WorkPool::shared())
+    , m_imageCache(&ImageCache::shared())
+    , m_tilesX(0)
+    , m_tilesY(0)
+    , m_binnedOps(0)
+{
+}
+
+TileRasterizer::~TileRasterizer() {
+}
+
+void TileRasterizer::rasterize(const DisplayList& displayList, Framebuffer& target, const Color& background,
+                               float originX, float originY) {
+    TRACE_SCOPE("raster", "TileRasterizer::rasterize");
+    ALLOC_SCOPE(RENDERING);
+
+    int width = target.width();
+    int height = target.height();
+    m_tilesX = (width + tileSize - 1) / tileSize;
+    m_tilesY = (height + tileSize - 1) / tileSize;
+    if (width <= 0 || height <= 0) {
+        m_ops.clear();
+        return;
+    }
+
+    size_t glyphHits = m_glyphAtlas.hits();
+    size_t glyphMisses = m_glyphAtlas.misses();
+    buildOps(displayList, width, height, originX, originY);
+    binOps();
+    TRACE_COUNTER("raster", "culledItems", static_cast<int64_t>(displayList.size() - m_visibleItems.size()));
+    TRACE_COUNTER("raster", "rasterOps", static_cast<int64_t>(m_ops.size()));
+    TRACE_COUNTER("raster", "binnedOps", static_cast<int64_t>(m_binnedOps));
+    TRACE_COUNTER("raster", "glyphCacheHits", static_cast<int64_t>(m_glyphAtlas.hits() - glyphHits));
+    TRACE_COUNTER("raster", "glyphCacheMisses", static_cast<int64_t>(m_glyphAtlas.misses() - glyphMisses));
+
+    uint32_t clear = Framebuffer::pack(background);
+    size_t tiles = tileCount();
+    if (!m_workPool || m_workPool->workerCount() == 0 || tiles < minParallelTiles) {
+        for (size_t tile = 0; tile < tiles; ++tile) {
+            rasterizeTile(tile, target, clear);
+        }
+        return;
+    }
+
+    threading::TaskGroup group(*m_workPool);
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        group.run([this, tile, &target, clear] {
+            rasterizeTile(tile, target, clear);
+        });
+    }
+    group.wait();
+}
+
+void TileRasterizer::buildOps(const DisplayList& displayList, int width, int height, float originX, float originY) {
+    m_ops.clear();
+    m_glyphs.clear();
+    m_uncachedGlyphs.clear();
+    m_images.clear();
+    m_glyphAtlas.beginFrame();
+
+    // Only items reaching the target are resolved, each with the
+    // translation and clip the list recorded for it
+    displayList.cull(layout::Rect(originX, originY, static_cast<float>(width), static_cast<float>(height)),
+                     m_visibleItems);
+    ClipRect clip = {0, 0, width, height};
+    int32_t clipIndex = -1;
+
+    for (uint32_t index : m_visibleItems) {
+        const DisplayItem& item = displayList.item(index);
+        const DisplayItemBounds& bounds = displayList.itemBounds(index);
+        float dx = bounds.dx - originX;
+        float dy = bounds.dy - originY;
+        if (bounds.clip != clipIndex) {
+            clipIndex = bounds.clip;
+            clip = {0, 0, width, height};
+            if (clipIndex >= 0) {
+                const layout::Rect& rect = displayList.clipRect(clipIndex);
+                clip.x0 = std::max(snap(rect.x - originX), 0);
+                clip.y0 = std::max(snap(rect.y - originY), 0);
+                clip.x1 = std::min(snap(rect.x - originX + rect.width), width);
+                clip.y1 = std::min(snap(rect.y - originY + rect.height), height);
+            }
+        }
+
+        switch (item.type) {
+            case DisplayItemType::BACKGROUND: {
+                const auto& background = item.as<BackgroundDisplayItem>();
+                const layout::Rect& r = background.rect;
+                addFill(r.x + dx, r.y + dy, r.width, r.height, background.color, clip);
+                break;
+            }
+
+            case DisplayItemType::BORDER: {
+                // Each edge inside the border box at its own width
+                const auto& border = item.as<BorderDisplayItem>();
+                const layout::Rect& r = border.rect;
+                float x = r.x + dx;
+                float y = r.y + dy;
+                float middle = r.height - border.topWidth - border.bottomWidth;
+                addFill(x, y, r.width, border.topWidth, border.color, clip);
+                addFill(x, y + r.height - border.bottomWidth, r.width, border.bottomWidth, border.color, clip);
+                addFill(x, y + border.topWidth, border.leftWidth, middle, border.color, clip);
+                addFill(x + r.width - border.rightWidth, y + border.topWidth, border.rightWidth, middle,
+                        border.color, clip);
+                break;
+            }
+
+            case DisplayItemType::TEXT: {
+                const auto& text = item.as<TextDisplayItem>();
+                addText(displayList.string(text.text), displayList.string(text.fontFamily), text.x + dx,
+                        text.y + dy, text.fontSize, text.color, clip);
+                break;
+            }
+
+            case DisplayItemType::IMAGE:
+                addImage(displayList, item.as<ImageDisplayItem>(), dx, dy, clip);
+                break;
+
+            case DisplayItemType::RECT: {
+                const auto& rect = item.as<RectDisplayItem>();
+                const layout::Rect& r = rect.rect;
+                float x = r.x + dx;
+                float y = r.y + dy;
+                if (rect.filled) {
+                    addFill(x, y, r.width, r.height, rect.color, clip);
+                } else {
+                    addFill(x, y, r.width, 1, rect.color, clip);
+                    addFill(x, y + r.height - 1, r.width, 1, rect.color, clip);
+                    addFill(x, y + 1, 1, r.height - 2, rect.color, clip);
+                    addFill(x + r.width - 1, y + 1, 1, r.height - 2, rect.color, clip);
+                }
+                break;
+            }
+
+            case DisplayItemType::TRANSFORM:
+            case DisplayItemType::CLIP:
+                // Applied through the item bounds; never culled in
+                break;
+
+            case DisplayItemType::LINE: {
+                const auto& line = item.as<LineDisplayItem>();
+                addLine(line.x1 + dx, line.y1 + dy, line.x2 + dx, line.y2 + dy, line.thickness, line.color, clip);
+                break;
+            }
+        }
+    }
+}
+
+bool TileRasterizer::clipBounds(Op& op, const ClipRect& clip) const {
+    op.x0 = std::max(op.x0, clip.x0);
+    op.y0 = std::max(op.y0, clip.y0);
+    op.x1 = std::min(op.x1, clip.x1);
+    op.y1 = std::min(op.y1, clip.y1);
+    return op.x0 < op.x1 && op.y0 < op.y1 && (op.color >> 24) != 0;
+}
+
+void TileRasterizer::addFill(float x, float y, float width, float height, const Color& color,
+                             const ClipRect& clip) {
+    Op op = {};
+    op.type = OpType::FILL;
+    op.color = Framebuffer::pack(color);
+    op.x0 = snap(x);
+    op.y0 = snap(y);
+    op.x1 = snap(x + width);
+    op.y1 = snap(y + height);
+    if (clipBounds(op, clip)) {
+        m_ops.push_back(op);
+    }
+}
+
+void TileRasterizer::addText(std::string_view text, std::string_view fontFamily, float x, float y,
+                             float fontSize, const Color& color, const ClipRect& clip) {
+    // Pens advance by the width text layout assumes per byte
+    // (layout::TextMeasurementCache::measureUncached); baselines snap to
+    // pixels, pens to quarter pixels
+    float advance = fontSize * 0.5f;
+    int baseline = snap(y);
+    if (text.empty() || baseline - fontSize >= clip.y1 || baseline + fontSize <= clip.y0) {
+        return;
+    }
+
+    uint32_t font = m_glyphAtlas.fontId(fontFamily);
+    Op op = {};
+    op.type = OpType::TEXT;
+    op.color = Framebuffer::pack(color);
+    op.x0 = INT_MAX;
+    op.y0 = INT_MAX;
+    op.x1 = INT_MIN;
+    op.y1 = INT_MIN;
+    op.firstGlyph = static_cast<uint32_t>(m_glyphs.size());
+    for (size_t i = 0; i < text.size();) {
+        float pen = x + advance * i;
+        uint32_t glyph = decodeUtf8(text, i);
+        if (pen >= clip.x1) {
+            break;
+        }
+        if (glyph <= ' ' || pen + advance + 1 <= clip.x0) {
+            continue;
+        }
+
+        float penPixel = std::floor(pen);
+        GlyphKey key = GlyphAtlas::key(font, glyph, fontSize, pen - penPixel);
+        PlacedGlyph placed;
+        const GlyphMask* mask = m_glyphAtlas.find(key);
+        GlyphMask uncached;
+        if (mask) {
+            placed.coverage = m_glyphAtlas.row(mask->atlasY) + mask->atlasX;
+            placed.stride = m_glyphAtlas.size();
+        } else {
+            m_uncachedGlyphs.emplace_back();
+            GlyphAtlas::rasterize(key, uncached, m_uncachedGlyphs.back());
+            mask = &uncached;
+            placed.coverage = m_uncachedGlyphs.back().data();
+            placed.stride = uncached.width;
+        }
+        if (mask->width == 0 || mask->height == 0) {
+            continue;
+        }
+        placed.x = static_cast<int>(penPixel) + mask->left;
+        placed.y = baseline + mask->top;
+        placed.width = mask->width;
+        placed.height = mask->height;
+        op.x0 = std::min(op.x0, placed.x);
+        op.y0 = std::min(op.y0, placed.y);
+        op.x1 = std::max(op.x1, placed.x + placed.width);
+        op.y1 = std::max(op.y1, placed.y + placed.height);
+        m_glyphs.push_back(placed);
+    }
+
+    op.glyphCount = static_cast<uint32_t>(m_glyphs.size()) - op.firstGlyph;
+    if (op.glyphCount > 0 && clipBounds(op, clip)) {
+        m_ops.push_back(op);
+    } else {
+        m_glyphs.resize(op.firstGlyph);
+    }
+}
+
+void TileRasterizer::addImage(const DisplayList& displayList, const ImageDisplayItem& image, float dx,
+                              float dy, const ClipRect& clip) {
+    const layout::Rect& r = image.rect;
+    int left = snap(r.x + dx);
+    int top = snap(r.y + dy);
+    int right = snap(r.x + dx + r.width);
+    int bottom = snap(r.y + dy + r.height);
+    if (left >= right || top >= bottom || right <= clip.x0 || left >= clip.x1 || bottom <= clip.y0 ||
+        top >= clip.y1) {
+        return;
+    }
+
+    // Only images on screen are asked for, so only they are decoded
+    std::shared_ptr<const DecodedImage> decoded;
+    if (m_imageCache) {
+        decoded = m_imageCache->find(std::string(displayList.string(image.url)), right - left, bottom - top);
+    }
+    if (decoded) {
+        Op op = {};
+        op.type = OpType::IMAGE;
+        op.color = 0xFF000000;
+        op.x0 = left;
+        op.y0 = top;
+        op.x1 = right;
+        op.y1 = bottom;
+        op.x = static_cast<float>(left);
+        op.y = static_cast<float>(top);
+        op.x2 = static_cast<float>(right);
+        op.y2 = static_cast<float>(bottom);
+        op.firstGlyph = static_cast<uint32_t>(m_images.size());
+        if (clipBounds(op, clip)) {
+            m_images.push_back(std::move(decoded));
+            m_ops.push_back(op);
+        }
+        return;
+    }
+
+    // Not decoded yet: a placeholder with the URL, as DisplayList::paint
+    // draws it
+    Color frame(100, 100, 100);
+    addFill(r.x + dx, r.y + dy, r.width, r.height, Color(200, 200, 200), clip);
+    addFill(r.x + dx, r.y + dy, r.width, 1, frame, clip);
+    addFill(r.x + dx, r.y + dy + r.height - 1, r.width, 1, frame, clip);
+    addFill(r.x + dx, r.y + dy + 1, 1, r.height - 2, frame, clip);
+    addFill(r.x + dx + r.width - 1, r.y + dy + 1, 1, r.height - 2, frame, clip);
+    addText(displayList.string(image.url), "Arial", r.x + dx + 5, r.y + dy + 15, 10.0f, Color(0, 0, 0), clip);
+}
+
+void TileRasterizer::addLine(float x1, float y1, float x2, float y2, float thickness, const Color& color,
+                             const ClipRect& clip) {
+    float half = std::max(thickness, 1.0f) * 0.5f;
+
+    // Axis-aligned lines are rects
+    if (x1 == x2 || y1 == y2) {
+        float left = std::min(x1, x2) - (x1 == x2 ? half : 0);
+        float top = std::min(y1, y2) - (y1 == y2 ? half : 0);
+        float right = std::max(x1, x2) + (x1 == x2 ? half : 0);
+        float bottom = std::max(y1, y2) + (y1 == y2 ? half : 0);
+        addFill(left, top, right - left, bottom - top, color, clip);
+        return;
+    }
+
+    Op op = {};
+    op.type = OpType::LINE;
+    op.color = Framebuffer::pack(color);
+    op.x0 = snap(std::min(x1, x2) - half);
+    op.y0 = snap(std::min(y1, y2) - half);
+    op.x1 = snap(std::max(x1, x2) + half);
+    op.y1 = snap(std::max(y1, y2) + half);
+    op.x = x1;
+    op.y = y1;
+    op.x2 = x2;
+    op.y2 = y2;
+    op.size = half * 2;
+    if (clipBounds(op, clip)) {
+        m_ops.push_back(op);
+    }
+}
+
+void TileRasterizer::binOps() {
+    // Bins keep their capacity from frame to frame
+    size_t tiles = tileCount();
+    if (m_bins.size() != tiles) {
+        m_bins.resize(tiles);
+    }
+    for (std::vector<uint32_t>& bin : m_bins) {
+        bin.clear();
+    }
+
+    m_binnedOps = 0;
+    for (uint32_t index = 0; index < m_ops.size(); ++index) {
+        const Op& op = m_ops[index];
+        int tx1 = (op.x1 - 1) / tileSize;
+        int ty1 = (op.y1 - 1) / tileSize;
+        for (int ty = op.y0 / tileSize; ty <= ty1; ++ty) {
+            for (int tx = op.x0 / tileSize; tx <= tx1; ++tx) {
+                m_bins[static_cast<size_t>(ty) * m_tilesX + tx].push_back(index);
+                ++m_binnedOps;
+            }
+        }
+    }
+}
+
+void TileRasterizer::rasterizeTile(size_t tile, Framebuffer& target, uint32_t background) const {
+    int tx = static_cast<int>(tile % m_tilesX);
+    int ty = static_cast<int>(tile / m_tilesX);
+    ClipRect area = {tx * tileSize, ty * tileSize,
+                     std::min((tx + 1) * tileSize, target.width()),
+                     std::min((ty + 1) * tileSize, target.height())};
+
+    for (int y = area.y0; y < area.y1; ++y) {
+        std::fill(target.row(y) + area.x0, target.row(y) + area.x1, background);
+    }
+
+    for (uint32_t index : m_bins[tile]) {
+        const Op& op = m_ops[index];
+        switch (op.type) {
+            case OpType::FILL:
+                fillRect(target, area, op.x0, op.y0, op.x1, op.y1, op.color);
+                break;
+            case OpType::TEXT:
+                drawText(op, area, target);
+                break;
+            case OpType::IMAGE:
+                drawImage(op, area, target);
+                break;
+            case OpType::LINE:
+                drawLine(op, area, target);
+                break;
+        }
+    }
+}
+
+void TileRasterizer::drawText(const Op& op, const ClipRect& area, Framebuffer& target) const {
+    // Drawn within the op's clipped bounds and the tile
+    ClipRect bounds = {std::max(op.x0, area.x0), std::max(op.y0, area.y0),
+                       std::min(op.x1, area.x1), std::min(op.y1, area.y1)};
+    if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1) {
+        return;
+    }
+
+    const RasterKernels& kernels = rasterKernels();
+    for (uint32_t i = op.firstGlyph; i < op.firstGlyph + op.glyphCount; ++i) {
+        const PlacedGlyph& glyph = m_glyphs[i];
+        int x0 = std::max(glyph.x, bounds.x0);
+        int y0 = std::max(glyph.y, bounds.y0);
+        int x1 = std::min(glyph.x + glyph.width, bounds.x1);
+        int y1 = std::min(glyph.y + glyph.height, bounds.y1);
+        if (x0 >= x1) {
+            continue;
+        }
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t* coverage = glyph.coverage + static_cast<size_t>(y - glyph.y) * glyph.stride + (x0 - glyph.x);
+            kernels.mask(target.row(y) + x0, coverage, static_cast<size_t>(x1 - x0), op.color);
+        }
+    }
+}
+
+void TileRasterizer::drawImage(const Op& op, const ClipRect& area, Framebuffer& target) const {
+    ClipRect bounds = {std::max(op.x0, area.x0), std::max(op.y0, area.y0),
+                       std::min(op.x1, area.x1), std::min(op.y1, area.y1)};
+    if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1) {
+        return;
+    }
+
+    // Images are decoded at the destination size, or smaller ones scaled
+    // up nearest neighbor
+    const DecodedImage& image = *m_images[op.firstGlyph];
+    const RasterKernels& kernels = rasterKernels();
+    int left = static_cast<int>(op.x);
+    int top = static_cast<int>(op.y);
+    int64_t width = static_cast<int>(op.x2) - left;
+    int64_t height = static_cast<int>(op.y2) - top;
+    uint32_t scaled[256];
+    for (int y = bounds.y0; y < bounds.y1; ++y) {
+        const uint32_t* source = image.pixels.data() + (y - top) * image.height / height * image.width;
+        uint32_t* row = target.row(y);
+        if (image.width == width) {
+            kernels.blend(row + bounds.x0, source + (bounds.x0 - left), static_cast<size_t>(bounds.x1 - bounds.x0));
+            continue;
+        }
+        for (int x = bounds.x0; x < bounds.x1; x += 256) {
+            int count = std::min(bounds.x1 - x, 256);
+            for (int i = 0; i < count; ++i) {
+                scaled[i] = source[(x + i - left) * image.width / width];
+            }
+            kernels.blend(row + x, scaled, static_cast<size_t>(count));
+        }
+    }
+}
+
+void TileRasterizer::drawLine(const Op& op, const ClipRect& area, Framebuffer& target) const {
+    ClipRect bounds = {std::max(op.x0, area.x0), std::max(op.y0, area.y0),
+                       std::min(op.x1, area.x1), std::min(op.y1, area.y1)};
+    if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1) {
+        return;
+    }
+
+    // A square of the thickness stepped a pixel at a time along the
+    // major axis
+    float dx = op.x2 - op.x;
+    float dy = op.y2 - op.y;
+    int steps = std::max(1, static_cast<int>(std::ceil(std::max(std::abs(dx), std::abs(dy)))));
+    float half = op.size * 0.5f;
+    for (int i = 0; i <= steps; ++i) {
+        float px = op.x + dx * i / steps;
+        float py = op.y + dy * i / steps;
+        fillRect(target, bounds, snap(px - half), snap(py - half), snap(px + half), snap(py + half), op.color);
+    }
+}
+
+} // namespace rendering
+} // namespace browser
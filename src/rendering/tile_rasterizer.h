@@ -0,0 +1,138 @@
+#ifndef BROWSER_RENDERING_TILE_RASTERIZER_H
+#define BROWSER_RENDERING_TILE_RASTERIZER_H
+
+#include "framebuffer.h"
+#include "glyph_atlas.h"
+#include "image_cache.h"
+#include "paint_system.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace browser {
+namespace threading {
+class WorkPool;
+}
+
+namespace rendering {
+
+// Software rasterizer for display lists. The items reaching the target are
+// culled from the list's bounding volume hierarchy and resolved into
+// device-space ops (transforms and clips applied, borders split into
+// edges), each op's bounding box bins it into the tileSize squares it
+// touches, and then every tile is rasterized on its own: cleared, then its
+// ops drawn in list order. Tiles own disjoint parts of the framebuffer, so
+// they run concurrently on the work pool with no locking.
+//
+// Rects snap to pixel centers without antialiasing. Glyphs are looked up in
+// the glyph atlas while the ops are built, and tiles blit their coverage
+// masks. Images come from the image cache at their display size; until one
+// has been decoded its placeholder is drawn.
+class TileRasterizer {
+public:
+    static constexpr int tileSize = 128;
+
+    // Frames with fewer tiles are rasterized on the calling thread
+    static constexpr size_t minParallelTiles = 4;
+
+    TileRasterizer();
+    ~TileRasterizer();
+
+    TileRasterizer(const TileRasterizer&) = delete;
+    TileRasterizer& operator=(const TileRasterizer&) = delete;
+
+    // Pool for the tiles; null rasterizes on the calling thread. Defaults
+    // to WorkPool::shared().
+    void setWorkPool(threading::WorkPool* pool) { m_workPool = pool; }
+    threading::WorkPool* workPool() const { return m_workPool; }
+
+    // Clear target to background and draw the list into it. The target's
+    // top left pixel shows the list at (originX, originY).
+    void rasterize(const DisplayList& displayList, Framebuffer& target, const Color& background,
+                   float originX = 0, float originY = 0);
+
+    // Decoded images; null draws placeholders. Defaults to
+    // ImageCache::shared().
+    void setImageCache(ImageCache* cache) { m_imageCache = cache; }
+    ImageCache* imageCache() const { return m_imageCache; }
+
+    // Glyph masks kept from frame to frame
+    GlyphAtlas& glyphAtlas() { return m_glyphAtlas; }
+
+    // Ops and tiles of the last frame, and op-tile pairs binned
+    size_t opCount() const { return m_ops.size(); }
+    size_t tileCount() const { return static_cast<size_t>(m_tilesX) * m_tilesY; }
+    size_t binnedOps() const { return m_binnedOps; }
+
+private:
+    enum class OpType : uint8_t {
+        FILL,  // The bounds
+        TEXT,  // Glyphs
+        IMAGE,
+        LINE
+    };
+
+    // A display item in device space. Bounds are clipped and exclusive at
+    // the right and bottom; nothing outside them is drawn.
+    struct Op {
+        OpType type;
+        uint32_t color;  // Packed, premultiplied
+        int x0, y0, x1, y1;
+        float x, y;      // LINE: start; IMAGE: top left of the destination
+        float x2, y2;    // LINE: end; IMAGE: bottom right
+        float size;      // LINE: thickness
+        uint32_t firstGlyph;  // TEXT: range in m_glyphs; IMAGE: index in m_images
+        uint32_t glyphCount;
+    };
+
+    // A glyph mask placed in device space
+    struct PlacedGlyph {
+        int x, y;
+        int width, height;
+        const uint8_t* coverage;  // In the atlas or m_uncachedGlyphs
+        int stride;
+    };
+
+    struct ClipRect {
+        int x0, y0, x1, y1;
+    };
+
+    // Resolve the list into m_ops for a width x height target
+    void buildOps(const DisplayList& displayList, int width, int height, float originX, float originY);
+    void addFill(float x, float y, float width, float height, const Color& color, const ClipRect& clip);
+    void addText(std::string_view text, std::string_view fontFamily, float x, float y, float fontSize,
+                 const Color& color, const ClipRect& clip);
+    void addImage(const DisplayList& displayList, const ImageDisplayItem& image, float dx, float dy,
+                  const ClipRect& clip);
+    void addLine(float x1, float y1, float x2, float y2, float thickness, const Color& color,
+                 const ClipRect& clip);
+    bool clipBounds(Op& op, const ClipRect& clip) const;
+
+    // List m_ops in the bins of the tiles they touch
+    void binOps();
+
+    void rasterizeTile(size_t tile, Framebuffer& target, uint32_t background) const;
+    void drawText(const Op& op, const ClipRect& area, Framebuffer& target) const;
+    void drawImage(const Op& op, const ClipRect& area, Framebuffer& target) const;
+    void drawLine(const Op& op, const ClipRect& area, Framebuffer& target) const;
+
+    threading::WorkPool* m_workPool;
+    ImageCache* m_imageCache;
+    std::vector<uint32_t> m_visibleItems;  // Indices of the items culled in
+    std::vector<Op> m_ops;
+    GlyphAtlas m_glyphAtlas;
+    std::vector<PlacedGlyph> m_glyphs;
+    std::vector<std::vector<uint8_t>> m_uncachedGlyphs;  // Masks that didn't fit the atlas
+    std::vector<std::shared_ptr<const DecodedImage>> m_images;  // Held for the frame
+    std::vector<std::vector<uint32_t>> m_bins;  // Op indices per tile, row major
+    int m_tilesX;
+    int m_tilesY;
+    size_t m_binnedOps;
+};
+
+} // namespace rendering
+} // namespace browser
+
+#endif // BROWSER_RENDERING_TILE_RASTERIZER_H
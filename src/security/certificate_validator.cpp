@@ -4,14 +4,59 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <regex>
+#include <cstdio>
 #include <filesystem>
+#include <string_view>
 
 namespace fs = std::filesystem;
 
 namespace browser {
 namespace security {
 
+namespace {
+    // Parse "YYYY-MM-DD HH:MM:SS", taken as UTC
+    bool parseTime(const std::string& text, std::chrono::system_clock::time_point& time) {
+        int year, month, day, hour = 0, minute = 0, second = 0;
+        if (std::sscanf(text.c_str(), "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) < 3 ||
+            month < 1 || month > 12 || day < 1 || day > 31) {
+            return false;
+        }
+        
+        // Days since 1970-01-01 in the proleptic Gregorian calendar
+        int y = year - (month <= 2 ? 1 : 0);
+        int era = (y >= 0 ? y : y - 399) / 400;
+        int yearOfEra = y - era * 400;
+        int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        long long days = static_cast<long long>(era) * 146097 + dayOfEra - 719468;
+        
+        time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(days * 86400 + hour * 3600 + minute * 60 + second)));
+        return true;
+    }
+    
+    // A DNS name, or a "*." wildcard standing for one leftmost label
+    bool matchesName(const std::string& pattern, const std::string& hostname) {
+        auto equal = [](const char* a, const char* b, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        
+        if (pattern.compare(0, 2, "*.") == 0) {
+            // Check hostname is one label followed by the domain
+            size_t domainLength = pattern.length() - 1;
+            size_t labelLength = hostname.length() > domainLength ? hostname.length() - domainLength : 0;
+            return labelLength > 0 && hostname.find('.') == labelLength &&
+                   equal(pattern.data() + 1, hostname.data() + labelLength, domainLength);
+        }
+        return pattern.length() == hostname.length() && equal(pattern.data(), hostname.data(), pattern.length());
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Certificate Implementation
 //-----------------------------------------------------------------------------
@@ -41,6 +86,9 @@ Certificate::~Certificate() {
 }
 
 std::string Certificate::fingerprint(const std::string& algorithm) const {
+    if (algorithm == "SHA-256") {
+        return m_fingerprint;
+    }
     return computeFingerprint(algorithm);
 }
 
@@ -67,33 +115,14 @@ bool Certificate::verifySignature(const Certificate& issuerCert) const {
 
 bool Certificate::matchesHostname(const std::string& hostname) const {
     // Simple hostname matching for demonstration
-    // In a real implementation, this would handle wildcards and other complexities
-    
-    // Example: Find CN in subject
-    std::regex cnRegex("CN=([^,]+)");
-    std::smatch match;
+    // In a real implementation, this would also match IP addresses
     
-    if (std::regex_search(m_subject, match, cnRegex)) {
-        std::string cn = match[1].str();
-        
-        // Check for wildcard certificate
-        if (cn.substr(0, 2) == "*.") {
-            std::string domain = cn.substr(2);
-            
-            // Check if hostname ends with domain
-            if (hostname.length() > domain.length() &&
-                hostname.substr(hostname.length() - domain.length()) == domain &&
-                hostname.substr(0, hostname.length() - domain.length()).find('.') == std::string::npos) {
-                return true;
-            }
-        }
-        else {
-            // Exact match
-            return cn == hostname;
-        }
+    // The CN only counts when there are no alternative names
+    if (!m_altNames.empty()) {
+        return std::any_of(m_altNames.begin(), m_altNames.end(),
+                           [&](const std::string& name) { return matchesName(name, hostname); });
     }
-    
-    return false;
+    return !m_commonName.empty() && matchesName(m_commonName, hostname);
 }
 
 bool Certificate::loadFromFile(const std::string& filename, CertificateType type) {
@@ -124,9 +153,8 @@ bool Certificate::parseCertificate(const std::string& certData, CertificateType
     m_rawData.assign(certData.begin(), certData.end());
     
     // Parse certificate fields
-    parseSubjectAndIssuer(certData);
-    parseValidity(certData);
-    parsePublicKey(certData);
+    parseFields(certData);
+    m_fingerprint = computeFingerprint("SHA-256");
     
     // Set self-signed flag
     m_isSelfSigned = (m_subject == m_issuer);
@@ -137,66 +165,86 @@ bool Certificate::parseCertificate(const std::string& certData, CertificateType
     return m_isValid;
 }
 
-void Certificate::parseSubjectAndIssuer(const std::string& certData) {
-    // For the sake of simplicity, let's assume certData contains subject and issuer fields
+void Certificate::parseFields(const std::string& certData) {
+    // For the sake of simplicity, let's assume certData contains one
+    // "Label: value" field per line
     // In a real implementation, this would parse X.509, DER, or PEM data
     
     // Example subject: "CN=example.com,O=Example Inc,C=US"
     // Example issuer: "CN=Example CA,O=Example Inc,C=US"
-    
-    // Simple regex parsing for demonstration
-    std::regex subjectRegex("Subject: ([^\n]+)");
-    std::regex issuerRegex("Issuer: ([^\n]+)");
-    std::smatch match;
-    
-    if (std::regex_search(certData, match, subjectRegex)) {
-        m_subject = match[1].str();
+    // Example validity: "Not Before: 2020-01-01 00:00:00"
+    
+    struct Field {
+        const char* label;
+        std::string* value;
+    };
+    std::string notBefore, notAfter, altNames;
+    Field fields[] = {
+        { "Subject: ", &m_subject },
+        { "Issuer: ", &m_issuer },
+        { "Serial Number: ", &m_serialNumber },
+        { "Not Before: ", &notBefore },
+        { "Not After: ", &notAfter },
+        { "Public Key: ", &m_publicKey },
+        { "Subject Alternative Name: ", &altNames }
+    };
+    m_subject.clear();
+    m_issuer.clear();
+    m_serialNumber.clear();
+    m_publicKey.clear();
+    
+    // The first occurrence of each label wins
+    size_t lineStart = 0;
+    while (lineStart < certData.size()) {
+        size_t lineEnd = certData.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = certData.size();
+        }
+        
+        std::string_view line(certData.data() + lineStart, lineEnd - lineStart);
+        for (Field& field : fields) {
+            if (!field.value->empty()) {
+                continue;
+            }
+            std::string_view label(field.label);
+            size_t labelPos = line.find(label);
+            if (labelPos != std::string_view::npos && labelPos + label.size() < line.size()) {
+                field.value->assign(line.substr(labelPos + label.size()));
+            }
+        }
+        lineStart = lineEnd + 1;
     }
     
-    if (std::regex_search(certData, match, issuerRegex)) {
-        m_issuer = match[1].str();
+    // CN of the subject, for hostname matching
+    size_t cnPos = m_subject.find("CN=");
+    m_commonName.clear();
+    if (cnPos != std::string::npos) {
+        m_commonName = m_subject.substr(cnPos + 3, m_subject.find(',', cnPos) - cnPos - 3);
     }
     
-    // Extract serial number
-    std::regex serialRegex("Serial Number: ([^\n]+)");
-    if (std::regex_search(certData, match, serialRegex)) {
-        m_serialNumber = match[1].str();
+    // "DNS:" entries of the alternative names
+    m_altNames.clear();
+    size_t namePos = 0;
+    while ((namePos = altNames.find("DNS:", namePos)) != std::string::npos) {
+        namePos += 4;
+        size_t nameEnd = altNames.find(',', namePos);
+        std::string name = altNames.substr(namePos, nameEnd == std::string::npos ? std::string::npos : nameEnd - namePos);
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (!name.empty()) {
+            m_altNames.push_back(std::move(name));
+        }
     }
-}
-
-void Certificate::parseValidity(const std::string& certData) {
-    // Parse validity period
-    // For demonstration, let's use a simple format
-    
-    // Example: "Not Before: 2020-01-01 00:00:00\nNot After: 2025-01-01 00:00:00"
     
-    std::regex notBeforeRegex("Not Before: ([^\n]+)");
-    std::regex notAfterRegex("Not After: ([^\n]+)");
-    std::smatch match;
-    
-    if (std::regex_search(certData, match, notBeforeRegex)) {
-        // In a real implementation, this would parse the date/time string
-        // For simplicity, we'll set it to now minus one year
+    // Validity period; dates that can't be read are taken to be a year
+    // either side of now
+    if (!notBefore.empty() && !parseTime(notBefore, m_notBefore)) {
         m_notBefore = std::chrono::system_clock::now() - std::chrono::hours(24 * 365);
     }
-    
-    if (std::regex_search(certData, match, notAfterRegex)) {
-        // Similarly, set to now plus one year
+    if (!notAfter.empty() && !parseTime(notAfter, m_notAfter)) {
         m_notAfter = std::chrono::system_clock::now() + std::chrono::hours(24 * 365);
     }
-}
-
-void Certificate::parsePublicKey(const std::string& certData) {
-    // For the sake of simplicity, extract public key
-    // In a real implementation, this would parse the actual key data
-    
-    std::regex keyRegex("Public Key: ([^\n]+)");
-    std::smatch match;
     
-    if (std::regex_search(certData, match, keyRegex)) {
-        m_publicKey = match[1].str();
-    }
-    else {
+    if (m_publicKey.empty()) {
         // If no key found, create a placeholder
         m_publicKey = "DUMMY_PUBLIC_KEY_FOR_DEMONSTRATION";
     }
@@ -294,6 +342,19 @@ bool CertificateValidator::initialize() {
 }
 
 CertificateVerificationResult CertificateValidator::verify(const CertificateChain& chain, const std::string& hostname) const {
+    // A chain already found valid for this hostname only needs the
+    // revocation check again
+    auto leaf = chain.leafCertificate();
+    std::string key;
+    if (leaf) {
+        key = leaf->fingerprint();
+        key += '\n';
+        key += hostname;
+        if (isVerified(chain, key)) {
+            return isRevoked(*leaf) ? CertificateVerificationResult::REVOKED : CertificateVerificationResult::VALID;
+        }
+    }
+    
     // First, check the chain itself
     CertificateVerificationResult chainResult = chain.verify(hostname);
     if (chainResult != CertificateVerificationResult::VALID &&
@@ -302,7 +363,6 @@ CertificateVerificationResult CertificateValidator::verify(const CertificateChai
     }
     
     // Get the leaf certificate
-    auto leaf = chain.leafCertificate();
     if (!leaf) {
         return CertificateVerificationResult::OTHER_ERROR;
     }
@@ -318,7 +378,62 @@ CertificateVerificationResult CertificateValidator::verify(const CertificateChai
     }
     
     // Verify the certificate chain against trusted roots
-    return verifyChain(chain);
+    CertificateVerificationResult result = verifyChain(chain);
+    if (result == CertificateVerificationResult::VALID) {
+        rememberVerified(chain, key);
+    }
+    return result;
+}
+
+void CertificateValidator::clearVerificationCache() {
+    std::lock_guard<std::mutex> lock(m_verifiedMutex);
+    m_verifiedChains.clear();
+}
+
+bool CertificateValidator::isVerified(const CertificateChain& chain, const std::string& key) const {
+    std::lock_guard<std::mutex> lock(m_verifiedMutex);
+    auto it = m_verifiedChains.find(key);
+    if (it == m_verifiedChains.end()) {
+        return false;
+    }
+    if (std::chrono::system_clock::now() >= it->second.validUntil) {
+        m_verifiedChains.erase(it);
+        return false;
+    }
+    
+    // The same certificates, whether or not the same objects
+    const auto& certificates = chain.certificates();
+    const auto& verified = it->second.certificates;
+    if (certificates.size() != verified.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < certificates.size(); i++) {
+        if (certificates[i] != verified[i] && certificates[i]->rawData() != verified[i]->rawData()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CertificateValidator::rememberVerified(const CertificateChain& chain, const std::string& key) const {
+    auto now = std::chrono::system_clock::now();
+    VerifiedChain verified;
+    verified.certificates = chain.certificates();
+    verified.validUntil = now + verificationCacheTime;
+    for (const auto& certificate : verified.certificates) {
+        verified.validUntil = std::min(verified.validUntil, certificate->notAfter());
+    }
+    
+    std::lock_guard<std::mutex> lock(m_verifiedMutex);
+    if (m_verifiedChains.size() >= kMaxVerifiedChains) {
+        for (auto it = m_verifiedChains.begin(); it != m_verifiedChains.end();) {
+            it = now >= it->second.validUntil ? m_verifiedChains.erase(it) : std::next(it);
+        }
+        if (m_verifiedChains.size() >= kMaxVerifiedChains) {
+            m_verifiedChains.clear();
+        }
+    }
+    m_verifiedChains[key] = std::move(verified);
 }
 
 void CertificateValidator::addTrustedRoot(std::shared_ptr<Certificate> certificate) {
@@ -355,6 +470,7 @@ bool CertificateValidator::loadTrustedRoots(const std::string& directory) {
             }
         }
         
+        clearVerificationCache();
         return !m_trustedRoots.empty();
     }
     catch (const std::exception& e) {
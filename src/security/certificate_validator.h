@@ -5,7 +5,10 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <chrono>
+#include <cstdint>
+#include <unordered_map>
 
 namespace browser {
 namespace security {
@@ -29,7 +32,8 @@ enum class CertificateVerificationResult {
     OTHER_ERROR
 };
 
-// X.509 Certificate class
+// X.509 Certificate class. Fields are parsed once, when the certificate
+// is loaded.
 class Certificate {
 public:
     Certificate();
@@ -40,15 +44,22 @@ public:
     std::string subject() const { return m_subject; }
     std::string issuer() const { return m_issuer; }
     std::string serialNumber() const { return m_serialNumber; }
+    const std::string& commonName() const { return m_commonName; }
+    
+    // DNS names from the "Subject Alternative Name: DNS:a, DNS:b" field
+    const std::vector<std::string>& altNames() const { return m_altNames; }
     std::chrono::system_clock::time_point notBefore() const { return m_notBefore; }
     std::chrono::system_clock::time_point notAfter() const { return m_notAfter; }
     
     // Get the public key
     std::string publicKey() const { return m_publicKey; }
     
-    // Get the certificate fingerprint
+    // Get the certificate fingerprint; the SHA-256 one is computed on load
     std::string fingerprint(const std::string& algorithm = "SHA-256") const;
     
+    // The certificate as loaded
+    const std::vector<uint8_t>& rawData() const { return m_rawData; }
+    
     // Check if the certificate is valid
     bool isValid() const;
     
@@ -61,7 +72,8 @@ public:
     // Verify the certificate signature
     bool verifySignature(const Certificate& issuerCert) const;
     
-    // Check if the certificate is issued for a specific hostname
+    // Check if the certificate is issued for a specific hostname: one of
+    // its alternative names if it has any, otherwise its CN
     bool matchesHostname(const std::string& hostname) const;
     
     // Load certificate from file
@@ -77,6 +89,9 @@ private:
     std::chrono::system_clock::time_point m_notBefore;
     std::chrono::system_clock::time_point m_notAfter;
     std::string m_publicKey;
+    std::string m_commonName;     // CN of the subject
+    std::vector<std::string> m_altNames;
+    std::string m_fingerprint;    // SHA-256
     bool m_isValid;
     bool m_isSelfSigned;
     
@@ -86,10 +101,8 @@ private:
     // Parse certificate data
     bool parseCertificate(const std::string& certData, CertificateType type);
     
-    // Parse certificate fields
-    void parseSubjectAndIssuer(const std::string& certData);
-    void parseValidity(const std::string& certData);
-    void parsePublicKey(const std::string& certData);
+    // Parse every field in one pass over the lines of the data
+    void parseFields(const std::string& certData);
     
     // Compute fingerprint
     std::string computeFingerprint(const std::string& algorithm) const;
@@ -126,9 +139,17 @@ public:
     // Initialize the validator
     bool initialize();
     
-    // Verify a certificate chain for a hostname
+    // Verify a certificate chain for a hostname. A chain found valid for a
+    // hostname is remembered until its first certificate expires (or for
+    // verificationCacheTime at most), so verifying the same chain again
+    // skips the chain checks.
     CertificateVerificationResult verify(const CertificateChain& chain, const std::string& hostname) const;
     
+    static constexpr std::chrono::minutes verificationCacheTime{ 60 };
+    
+    // Forget remembered verifications
+    void clearVerificationCache();
+    
     // Add a trusted root certificate
     void addTrustedRoot(std::shared_ptr<Certificate> certificate);
     
@@ -142,6 +163,20 @@ private:
     // Certificate revocation lists (CRLs)
     std::map<std::string, std::vector<std::string>> m_revocationLists;
     
+    // Chains found valid, by leaf fingerprint and hostname. The chain's
+    // certificates are kept to compare, since a fingerprint only
+    // identifies a certificate when it is a real digest.
+    struct VerifiedChain {
+        std::vector<std::shared_ptr<Certificate>> certificates;
+        std::chrono::system_clock::time_point validUntil;
+    };
+    mutable std::mutex m_verifiedMutex;
+    mutable std::unordered_map<std::string, VerifiedChain> m_verifiedChains;
+    static constexpr size_t kMaxVerifiedChains = 256;
+    
+    bool isVerified(const CertificateChain& chain, const std::string& key) const;
+    void rememberVerified(const CertificateChain& chain, const std::string& key) const;
+    
     // Check if a certificate is revoked
     bool isRevoked(const Certificate& certificate) const;
     
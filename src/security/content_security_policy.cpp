@@ -3,118 +3,328 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <regex>
 
 namespace browser {
 namespace security {
 
+namespace {
+    std::string lowercase(std::string_view text) {
+        std::string result(text);
+        std::transform(result.begin(), result.end(), result.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        return result;
+    }
+
+    int defaultPort(std::string_view scheme) {
+        if (scheme == "http" || scheme == "ws") return 80;
+        if (scheme == "https" || scheme == "wss") return 443;
+        if (scheme == "ftp") return 21;
+        return -1;
+    }
+
+    // A source with scheme from also allows the secure version of it
+    bool schemeMatches(std::string_view from, std::string_view to) {
+        return from == to || (from == "http" && to == "https") || (from == "ws" && to == "wss");
+    }
+
+    // Browsers read a backslash in these places as a slash
+    bool startsWithTwoSlashes(std::string_view url) {
+        return url.size() >= 2 && (url[0] == '/' || url[0] == '\\') && (url[1] == '/' || url[1] == '\\');
+    }
+
+    // Fill in the host, port and path from what follows "//"; the scheme
+    // is already set
+    void parseAuthority(std::string_view rest, CspUrl& result) {
+        // The authority ends at the first of these, before any '@' is
+        // looked for, so "evil.com\@site.com" is evil.com's
+        size_t authorityEnd = rest.find_first_of("/\\?#");
+        std::string_view authority = rest.substr(0, authorityEnd);
+        size_t at = authority.rfind('@');
+        if (at != std::string_view::npos) {
+            authority.remove_prefix(at + 1);
+        }
+        
+        size_t portColon = authority.rfind(':');
+        if (portColon != std::string_view::npos && authority.find(']', portColon) == std::string_view::npos) {
+            int port = 0;
+            for (char c : authority.substr(portColon + 1)) {
+                if (!std::isdigit(static_cast<unsigned char>(c)) || port > 65535) {
+                    port = -1;
+                    break;
+                }
+                port = port * 10 + (c - '0');
+            }
+            result.port = port;
+            authority = authority.substr(0, portColon);
+        } else {
+            result.port = defaultPort(result.scheme);
+        }
+        result.host = lowercase(authority);
+        
+        if (authorityEnd != std::string_view::npos) {
+            std::string_view path = rest.substr(authorityEnd);
+            result.path = path.substr(0, path.find_first_of("?#"));
+        }
+    }
+
+    bool isSchemeSource(const std::string& value) {
+        if (value.size() < 2 || value.back() != ':' || !std::isalpha(static_cast<unsigned char>(value[0]))) {
+            return false;
+        }
+        return std::all_of(value.begin(), value.end() - 1, [](unsigned char c) {
+            return std::isalnum(c) || c == '+' || c == '-' || c == '.';
+        });
+    }
+}
+
+//-----------------------------------------------------------------------------
+// CspUrl Implementation
+//-----------------------------------------------------------------------------
+
+CspUrl CspUrl::parse(std::string_view url, const Origin& pageOrigin) {
+    CspUrl result;
+    if (startsWithTwoSlashes(url)) {
+        // Scheme-relative: the page's scheme, but a host of its own
+        result.scheme = pageOrigin.scheme();
+        parseAuthority(url.substr(2), result);
+        return result;
+    }
+    
+    size_t colon = url.find(':');
+    size_t delimiter = url.find_first_of("/\\?#");
+    if (colon == std::string_view::npos || colon == 0 || (delimiter != std::string_view::npos && delimiter < colon)) {
+        // Relative to the page
+        result.scheme = pageOrigin.scheme();
+        result.host = pageOrigin.host();
+        result.port = pageOrigin.port();
+        result.path = url.substr(0, url.find_first_of("?#"));
+        return result;
+    }
+    
+    result.scheme = lowercase(url.substr(0, colon));
+    std::string_view rest = url.substr(colon + 1);
+    if (!startsWithTwoSlashes(rest)) {
+        // data:, blob: and the like have no host
+        return result;
+    }
+    parseAuthority(rest.substr(2), result);
+    return result;
+}
+
 //-----------------------------------------------------------------------------
 // CspDirective Implementation
 //-----------------------------------------------------------------------------
 
 CspDirective::CspDirective(CspResourceType type)
     : m_type(type)
+    , m_self(false)
+    , m_unsafeInline(false)
+    , m_unsafeEval(false)
+    , m_hasPathSources(false)
+    , m_schemes(0)
 {
 }
 
 void CspDirective::addSource(CspSource source, const std::string& value) {
     m_sources.push_back(std::make_pair(source, value));
+    
+    switch (source) {
+        case CspSource::SELF: m_self = true; break;
+        case CspSource::UNSAFE_INLINE: m_unsafeInline = true; break;
+        case CspSource::UNSAFE_EVAL: m_unsafeEval = true; break;
+        case CspSource::NONCE: m_nonces.insert(value); break;
+        case CspSource::HASH: m_hashes.insert(value); break;
+        case CspSource::CUSTOM:
+            if (isSchemeSource(value)) {
+                std::string scheme = lowercase(std::string_view(value).substr(0, value.size() - 1));
+                uint32_t bit = schemeBit(scheme);
+                if (bit) {
+                    m_schemes |= bit;
+                } else {
+                    m_otherSchemes.insert(scheme);
+                }
+            } else {
+                addHostSource(value);
+            }
+            break;
+        case CspSource::NONE:
+        case CspSource::STRICT_DYNAMIC:
+            break;
+    }
 }
 
-bool CspDirective::allowsSource(const std::string& source, const Origin& pageOrigin) const {
-    // If no sources specified, nothing is allowed
-    if (m_sources.empty()) {
-        return false;
+void CspDirective::addHostSource(const std::string& value) {
+    std::string_view rest(value);
+    HostSource source;
+    source.port = kDefaultPort;
+    
+    size_t schemeEnd = rest.find("://");
+    if (schemeEnd != std::string_view::npos) {
+        source.scheme = lowercase(rest.substr(0, schemeEnd));
+        rest.remove_prefix(schemeEnd + 3);
     }
     
-    // Check if any source in the directive matches
-    for (const auto& directiveSource : m_sources) {
-        if (sourceMatches(source, pageOrigin, directiveSource.first, directiveSource.second)) {
-            return true;
-        }
+    size_t pathStart = rest.find('/');
+    if (pathStart != std::string_view::npos) {
+        source.path = std::string(rest.substr(pathStart));
+        rest = rest.substr(0, pathStart);
+        m_hasPathSources = true;
     }
     
-    // If 'none' is present, nothing is allowed
-    for (const auto& directiveSource : m_sources) {
-        if (directiveSource.first == CspSource::NONE) {
-            return false;
+    size_t portColon = rest.rfind(':');
+    if (portColon != std::string_view::npos) {
+        std::string_view port = rest.substr(portColon + 1);
+        if (port == "*") {
+            source.port = kAnyPort;
+        } else {
+            source.port = 0;
+            for (char c : port) {
+                if (!std::isdigit(static_cast<unsigned char>(c)) || source.port > 65535) {
+                    return; // Not a valid source; matches nothing
+                }
+                source.port = source.port * 10 + (c - '0');
+            }
         }
+        rest = rest.substr(0, portColon);
     }
     
-    return false;
+    std::string host = lowercase(rest);
+    if (host == "*") {
+        m_anyHost.push_back(std::move(source));
+    } else if (host.size() > 2 && host[0] == '*' && host[1] == '.') {
+        m_hostSuffixes[host.substr(2)].push_back(std::move(source));
+    } else if (!host.empty()) {
+        m_hosts[host].push_back(std::move(source));
+    }
 }
 
-bool CspDirective::allowsInline() const {
-    // Check for 'unsafe-inline'
-    for (const auto& source : m_sources) {
-        if (source.first == CspSource::UNSAFE_INLINE) {
-            return true;
+uint32_t CspDirective::schemeBit(std::string_view scheme) {
+    static const char* const schemes[] = {
+        "http", "https", "ws", "wss", "ftp", "data", "blob", "filesystem", "mediastream"
+    };
+    for (size_t i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++) {
+        if (scheme == schemes[i]) {
+            return 1u << i;
         }
     }
-    
-    return false;
+    return 0;
 }
 
-bool CspDirective::allowsEval() const {
-    // Check for 'unsafe-eval'
-    for (const auto& source : m_sources) {
-        if (source.first == CspSource::UNSAFE_EVAL) {
-            return true;
-        }
-    }
-    
-    return false;
+bool CspDirective::allowsSource(const std::string& source, const Origin& pageOrigin) const {
+    return allowsUrl(CspUrl::parse(source, pageOrigin), pageOrigin);
 }
 
-bool CspDirective::sourceMatches(const std::string& source, const Origin& pageOrigin, 
-                               CspSource directiveSource, const std::string& directiveValue) const {
-    // Process special keywords
-    if (directiveSource == CspSource::NONE) {
-        return false;
+bool CspDirective::allowsUrl(const CspUrl& url, const Origin& pageOrigin) const {
+    // Scheme sources, with http: also allowing https and ws: wss
+    if (schemeAllowed(url.scheme)) {
+        return true;
     }
-    else if (directiveSource == CspSource::SELF) {
-        // Same origin check
-        Origin sourceOrigin(source);
-        return sourceOrigin == pageOrigin;
+    
+    // URLs without a host only match scheme sources
+    if (url.host.empty()) {
+        return false;
     }
-    else if (directiveSource == CspSource::CUSTOM) {
-        // Handle custom source formats
-        
-        // Exact match
-        if (directiveValue == source) {
+    
+    // 'self', which an upgrade to https also matches
+    if (m_self && url.host == pageOrigin.host()) {
+        std::string pageScheme = pageOrigin.scheme();
+        if ((url.scheme == pageScheme && url.port == pageOrigin.port()) ||
+            (pageScheme == "http" && url.scheme == "https" && url.port == 443)) {
             return true;
         }
-        
-        // Domain match (*.example.com)
-        if (directiveValue.size() > 2 && directiveValue[0] == '*' && directiveValue[1] == '.') {
-            std::string domain = directiveValue.substr(2);
-            
-            // Check if source ends with domain
-            if (source.length() > domain.length() &&
-                source.substr(source.length() - domain.length()) == domain) {
+    }
+    
+    // Host sources for the host itself, for each domain above it, and for
+    // any host
+    auto matchesAny = [&](const std::vector<HostSource>& sources) {
+        for (const HostSource& source : sources) {
+            if (hostSourceMatches(source, url, pageOrigin)) {
                 return true;
             }
         }
-        
-        // Scheme match (https:)
-        if (directiveValue.back() == ':') {
-            std::string scheme = directiveValue.substr(0, directiveValue.length() - 1);
-            
-            // Check if source starts with scheme://
-            if (source.substr(0, scheme.length() + 3) == scheme + "://") {
+        return false;
+    };
+    
+    auto hostIt = m_hosts.find(url.host);
+    if (hostIt != m_hosts.end() && matchesAny(hostIt->second)) {
+        return true;
+    }
+    if (!m_hostSuffixes.empty()) {
+        std::string_view host(url.host);
+        for (size_t dot = host.find('.'); dot != std::string_view::npos; dot = host.find('.', dot + 1)) {
+            auto suffixIt = m_hostSuffixes.find(host.substr(dot + 1));
+            if (suffixIt != m_hostSuffixes.end() && matchesAny(suffixIt->second)) {
                 return true;
             }
         }
     }
+    return matchesAny(m_anyHost);
+}
+
+bool CspDirective::schemeAllowed(std::string_view scheme) const {
+    if (m_schemes == 0 && m_otherSchemes.empty()) {
+        return false;
+    }
+    uint32_t bit = schemeBit(scheme);
+    if (bit) {
+        uint32_t allowing = m_schemes & bit;
+        if (scheme == "https") allowing |= m_schemes & schemeBit("http");
+        if (scheme == "wss") allowing |= m_schemes & schemeBit("ws");
+        return allowing != 0;
+    }
+    return m_otherSchemes.find(std::string(scheme)) != m_otherSchemes.end();
+}
+
+bool CspDirective::hostSourceMatches(const HostSource& source, const CspUrl& url, const Origin& pageOrigin) {
+    // Without a scheme, the page's; an http page's sources allow https too
+    if (!schemeMatches(source.scheme.empty() ? std::string_view(pageOrigin.scheme()) : source.scheme, url.scheme)) {
+        return false;
+    }
     
-    return false;
+    if (source.port == kDefaultPort) {
+        if (url.port != defaultPort(url.scheme)) {
+            return false;
+        }
+    } else if (source.port != kAnyPort && source.port != url.port) {
+        return false;
+    }
+    
+    // A path ending in '/' covers what is under it; any other, just itself
+    if (!source.path.empty()) {
+        std::string_view path = url.path.empty() ? std::string_view("/") : url.path;
+        if (source.path.back() == '/' ? path.compare(0, source.path.size(), source.path) != 0
+                                      : path != source.path) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CspDirective::allowsInline() const {
+    // Check for 'unsafe-inline'
+    return m_unsafeInline && m_nonces.empty() && m_hashes.empty();
+}
+
+bool CspDirective::allowsEval() const {
+    // Check for 'unsafe-eval'
+    return m_unsafeEval;
+}
+
+bool CspDirective::allowsNonce(const std::string& nonce) const {
+    return !nonce.empty() && m_nonces.find(nonce) != m_nonces.end();
+}
+
+bool CspDirective::allowsHash(const std::string& hash) const {
+    return m_hashes.find(hash) != m_hashes.end();
 }
 
 //-----------------------------------------------------------------------------
 // ContentSecurityPolicy Implementation
 //-----------------------------------------------------------------------------
 
-ContentSecurityPolicy::ContentSecurityPolicy() {
+ContentSecurityPolicy::ContentSecurityPolicy()
+    : m_decisionPage(Origin::null())
+{
     // Create default directive
     m_defaultDirective = std::make_shared<CspDirective>(CspResourceType::DEFAULT);
     m_directives[CspResourceType::DEFAULT] = m_defaultDirective;
@@ -128,6 +338,12 @@ bool ContentSecurityPolicy::parse(const std::string& policyHeader) {
         return false;
     }
     
+    // Decisions made under the old policy no longer hold
+    {
+        std::lock_guard<std::mutex> lock(m_decisionMutex);
+        m_decisions.clear();
+    }
+    
     // Split policy header into directives
     std::istringstream policyStream(policyHeader);
     std::string directive;
@@ -145,15 +361,50 @@ bool ContentSecurityPolicy::parse(const std::string& policyHeader) {
     return true;
 }
 
-bool ContentSecurityPolicy::allowsResource(CspResourceType type, const std::string& source, const Origin& pageOrigin) const {
+const CspDirective& ContentSecurityPolicy::directiveFor(CspResourceType type) const {
     // Check specific directive
     auto it = m_directives.find(type);
     if (it != m_directives.end() && it->second) {
-        return it->second->allowsSource(source, pageOrigin);
+        return *it->second;
     }
     
     // Fall back to default directive
-    return m_defaultDirective->allowsSource(source, pageOrigin);
+    return *m_defaultDirective;
+}
+
+bool ContentSecurityPolicy::allowsResource(CspResourceType type, const std::string& source, const Origin& pageOrigin) const {
+    const CspDirective& directive = directiveFor(type);
+    CspUrl url = CspUrl::parse(source, pageOrigin);
+    if (directive.hasPathSources()) {
+        return directive.allowsUrl(url, pageOrigin);
+    }
+    
+    // Every URL of an origin gets the same answer
+    std::string key;
+    key.reserve(url.scheme.size() + url.host.size() + 12);
+    key += static_cast<char>('a' + static_cast<int>(type));
+    key += url.scheme;
+    key += ':';
+    key += url.host;
+    key += ':';
+    key += std::to_string(url.port);
+    
+    std::lock_guard<std::mutex> lock(m_decisionMutex);
+    if (m_decisionPage != pageOrigin) {
+        m_decisions.clear();
+        m_decisionPage = pageOrigin;
+    }
+    auto it = m_decisions.find(key);
+    if (it != m_decisions.end()) {
+        return it->second;
+    }
+    
+    bool allowed = directive.allowsUrl(url, pageOrigin);
+    if (m_decisions.size() >= kMaxDecisions) {
+        m_decisions.clear();
+    }
+    m_decisions.emplace(std::move(key), allowed);
+    return allowed;
 }
 
 bool ContentSecurityPolicy::allowsInlineScript() const {
@@ -189,6 +440,14 @@ bool ContentSecurityPolicy::allowsEval() const {
     return m_defaultDirective->allowsEval();
 }
 
+bool ContentSecurityPolicy::allowsNonce(CspResourceType type, const std::string& nonce) const {
+    return directiveFor(type).allowsNonce(nonce);
+}
+
+bool ContentSecurityPolicy::allowsHash(CspResourceType type, const std::string& hash) const {
+    return directiveFor(type).allowsHash(hash);
+}
+
 std::string ContentSecurityPolicy::toString() const {
     std::ostringstream oss;
     
@@ -291,6 +550,14 @@ std::pair<CspSource, std::string> ContentSecurityPolicy::parseSource(const std::
     else if (source == "'strict-dynamic'") {
         return std::make_pair(CspSource::STRICT_DYNAMIC, "");
     }
+    else if (source.size() > 8 && source.compare(0, 7, "'nonce-") == 0 && source.back() == '\'') {
+        return std::make_pair(CspSource::NONCE, source.substr(7, source.size() - 8));
+    }
+    else if (source.size() > 9 && source.front() == '\'' && source.back() == '\'' &&
+             (source.compare(1, 7, "sha256-") == 0 || source.compare(1, 7, "sha384-") == 0 ||
+              source.compare(1, 7, "sha512-") == 0)) {
+        return std::make_pair(CspSource::HASH, source.substr(1, source.size() - 2));
+    }
     
     // Custom source
     return std::make_pair(CspSource::CUSTOM, source);
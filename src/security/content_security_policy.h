@@ -2,10 +2,14 @@
 #define BROWSER_CONTENT_SECURITY_POLICY_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <set>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
 #include "same_origin.h"
 
 namespace browser {
@@ -18,6 +22,8 @@ enum class CspSource {
     UNSAFE_INLINE,  // 'unsafe-inline'
     UNSAFE_EVAL,    // 'unsafe-eval'
     STRICT_DYNAMIC, // 'strict-dynamic'
+    NONCE,          // 'nonce-<value>'; the value is kept
+    HASH,           // 'sha256-<value>' etc.; "sha256-<value>" is kept
     CUSTOM          // Custom source (e.g., domain name)
 };
 
@@ -36,7 +42,23 @@ enum class CspResourceType {
     WORKER      // worker-src
 };
 
-// Content Security Policy directive
+// A resource URL split into the parts source expressions look at: the
+// scheme and host lowercased, and the path a view into the URL
+struct CspUrl {
+    std::string scheme;
+    std::string host;
+    int port = -1;
+    std::string_view path;
+    
+    // Parse an absolute URL, or resolve anything else against the page
+    static CspUrl parse(std::string_view url, const Origin& pageOrigin);
+};
+
+// Content Security Policy directive. Sources are compiled as they are
+// added: keywords into flags, scheme sources into a bitset, host sources
+// into tables by host and by the domain a "*." wildcard stands under, and
+// nonces and hashes into sets, so a check costs a few lookups whatever the
+// number of sources.
 class CspDirective {
 public:
     CspDirective(CspResourceType type);
@@ -46,13 +68,23 @@ public:
     
     // Check if a source is allowed by this directive
     bool allowsSource(const std::string& source, const Origin& pageOrigin) const;
+    bool allowsUrl(const CspUrl& url, const Origin& pageOrigin) const;
     
-    // Check if inline scripts/styles are allowed
+    // Check if inline scripts/styles are allowed; 'unsafe-inline' doesn't
+    // count once there are nonces or hashes
     bool allowsInline() const;
     
     // Check if eval() is allowed
     bool allowsEval() const;
     
+    // Check an inline element's nonce, or its hash as "sha256-<base64>"
+    bool allowsNonce(const std::string& nonce) const;
+    bool allowsHash(const std::string& hash) const;
+    
+    // Whether some source limits paths, so a decision for one URL of an
+    // origin doesn't hold for all of them
+    bool hasPathSources() const { return m_hasPathSources; }
+    
     // Get the resource type
     CspResourceType type() const { return m_type; }
     
@@ -60,11 +92,38 @@ public:
     const std::vector<std::pair<CspSource, std::string>>& sources() const { return m_sources; }
     
 private:
+    // A host source: [scheme://]host[:port][/path]
+    struct HostSource {
+        std::string scheme;     // Empty to follow the page's scheme
+        int port;               // kDefaultPort or kAnyPort if not a number
+        std::string path;       // Empty for any
+    };
+    static constexpr int kDefaultPort = -1;
+    static constexpr int kAnyPort = -2;
+    
+    using HostTable = std::map<std::string, std::vector<HostSource>, std::less<>>;
+    
     CspResourceType m_type;
     std::vector<std::pair<CspSource, std::string>> m_sources;
     
+    // Compiled sources
+    bool m_self;
+    bool m_unsafeInline;
+    bool m_unsafeEval;
+    bool m_hasPathSources;
+    uint32_t m_schemes;                    // Bits of schemeBit() for scheme sources
+    std::set<std::string> m_otherSchemes;  // Scheme sources without a bit
+    HostTable m_hosts;                     // By exact host
+    HostTable m_hostSuffixes;              // "*.example.com" under "example.com"
+    std::vector<HostSource> m_anyHost;     // "*" and "scheme://*"
+    std::set<std::string> m_nonces;
+    std::set<std::string> m_hashes;
+    
     // Helper methods
-    bool sourceMatches(const std::string& source, const Origin& pageOrigin, CspSource directiveSource, const std::string& directiveValue) const;
+    void addHostSource(const std::string& value);
+    bool schemeAllowed(std::string_view scheme) const;
+    static bool hostSourceMatches(const HostSource& source, const CspUrl& url, const Origin& pageOrigin);
+    static uint32_t schemeBit(std::string_view scheme);
 };
 
 // Content Security Policy class
@@ -76,7 +135,8 @@ public:
     // Parse a CSP header value
     bool parse(const std::string& policyHeader);
     
-    // Check if a resource is allowed by the policy
+    // Check if a resource is allowed by the policy. Decisions are cached by
+    // resource type and origin, unless the directive limits paths.
     bool allowsResource(CspResourceType type, const std::string& source, const Origin& pageOrigin) const;
     
     // Check if inline scripts are allowed
@@ -88,6 +148,11 @@ public:
     // Check if eval() is allowed
     bool allowsEval() const;
     
+    // Check an inline script or style element's nonce, or its hash as
+    // "sha256-<base64>"
+    bool allowsNonce(CspResourceType type, const std::string& nonce) const;
+    bool allowsHash(CspResourceType type, const std::string& hash) const;
+    
     // Get a string representation of the policy
     std::string toString() const;
     
@@ -98,7 +163,15 @@ private:
     // Default directive (default-src)
     std::shared_ptr<CspDirective> m_defaultDirective;
     
+    // Decisions by resource type and origin for the page they were made
+    // for; emptied when the policy or the page changes
+    mutable std::mutex m_decisionMutex;
+    mutable std::unordered_map<std::string, bool> m_decisions;
+    mutable Origin m_decisionPage;
+    static constexpr size_t kMaxDecisions = 512;
+    
     // Helper methods
+    const CspDirective& directiveFor(CspResourceType type) const;
     void parseDirective(const std::string& directive);
     CspResourceType resourceTypeFromString(const std::string& typeStr) const;
     std::pair<CspSource, std::string> parseSource(const std::string& source) const;
@@ -241,12 +241,162 @@ std::string Cookie::toString() const {
 // CookieJar Implementation
 //-----------------------------------------------------------------------------
 
-CookieJar::CookieJar() {
+namespace {
+    // Take the last label off a domain
+    std::string_view popLabel(std::string_view& domain) {
+        size_t dot = domain.rfind('.');
+        std::string_view label = dot == std::string_view::npos ? domain : domain.substr(dot + 1);
+        domain = dot == std::string_view::npos ? std::string_view() : domain.substr(0, dot);
+        return label;
+    }
+
+    // A cookie's domain without the leading dot that makes it apply to
+    // subdomains too
+    std::string_view trieDomain(const std::string& domain, bool& subdomains) {
+        subdomains = !domain.empty() && domain[0] == '.';
+        return subdomains ? std::string_view(domain).substr(1) : std::string_view(domain);
+    }
+}
+
+CookieJar::CookieJar()
+    : m_cookieCount(0)
+{
 }
 
 CookieJar::~CookieJar() {
 }
 
+CookieJar::PathCookies& CookieJar::cookiesFor(const std::string& domain) {
+    bool subdomains;
+    std::string_view rest = trieDomain(domain, subdomains);
+    DomainNode* node = &m_root;
+    while (!rest.empty()) {
+        std::string_view label = popLabel(rest);
+        auto it = node->children.find(label);
+        if (it == node->children.end()) {
+            it = node->children.emplace(std::string(label), std::make_unique<DomainNode>()).first;
+        }
+        node = it->second.get();
+    }
+    return subdomains ? node->domainCookies : node->hostCookies;
+}
+
+const CookieJar::PathCookies* CookieJar::findCookies(const std::string& domain) const {
+    bool subdomains;
+    std::string_view rest = trieDomain(domain, subdomains);
+    const DomainNode* node = &m_root;
+    while (!rest.empty()) {
+        auto it = node->children.find(popLabel(rest));
+        if (it == node->children.end()) {
+            return nullptr;
+        }
+        node = it->second.get();
+    }
+    return subdomains ? &node->domainCookies : &node->hostCookies;
+}
+
+const Cookie* CookieJar::findCookie(const std::string& domain, const std::string& path, const std::string& name) const {
+    const PathCookies* paths = findCookies(domain);
+    if (!paths) {
+        return nullptr;
+    }
+    auto pathIt = paths->find(path);
+    if (pathIt == paths->end()) {
+        return nullptr;
+    }
+    auto nameIt = pathIt->second.find(name);
+    return nameIt != pathIt->second.end() ? &nameIt->second : nullptr;
+}
+
+bool CookieJar::eraseCookie(const std::string& domain, const std::string& path, const std::string& name) {
+    // Walk down, remembering the way back up to prune emptied nodes
+    bool subdomains;
+    std::string_view rest = trieDomain(domain, subdomains);
+    std::vector<std::pair<DomainNode*, std::string_view>> trail;
+    DomainNode* node = &m_root;
+    while (!rest.empty()) {
+        std::string_view label = popLabel(rest);
+        auto it = node->children.find(label);
+        if (it == node->children.end()) {
+            return false;
+        }
+        trail.emplace_back(node, label);
+        node = it->second.get();
+    }
+    
+    PathCookies& paths = subdomains ? node->domainCookies : node->hostCookies;
+    auto pathIt = paths.find(path);
+    if (pathIt == paths.end() || !pathIt->second.erase(name)) {
+        return false;
+    }
+    m_cookieCount--;
+    
+    // Clean up empty containers
+    if (pathIt->second.empty()) {
+        paths.erase(pathIt);
+    }
+    while (!trail.empty() && node->children.empty() && node->hostCookies.empty() && node->domainCookies.empty()) {
+        DomainNode* parent = trail.back().first;
+        parent->children.erase(parent->children.find(trail.back().second));
+        trail.pop_back();
+        node = parent;
+    }
+    return true;
+}
+
+template <typename Visitor>
+void CookieJar::forEachCookie(const std::string& domain, const std::string& path, bool secure, Visitor&& visit) const {
+    if (path.empty()) {
+        return;
+    }
+    auto now = std::chrono::system_clock::now();
+    
+    // Cookie paths that match are the request path and its prefixes that
+    // end at a '/' or are followed by one
+    auto visitPaths = [&](const PathCookies& paths) {
+        if (paths.empty()) {
+            return;
+        }
+        std::string_view requestPath(path);
+        for (size_t length = 1; length <= requestPath.size(); length++) {
+            if (length < requestPath.size() && requestPath[length - 1] != '/' && requestPath[length] != '/') {
+                continue;
+            }
+            auto pathIt = paths.find(requestPath.substr(0, length));
+            if (pathIt == paths.end()) {
+                continue;
+            }
+            for (const auto& nameEntry : pathIt->second) {
+                const Cookie& cookie = nameEntry.second;
+                
+                // Check expiry and Secure flag
+                if (now > cookie.expiresAt() || (cookie.isSecure() && !secure)) {
+                    continue;
+                }
+                visit(cookie);
+            }
+        }
+    };
+    
+    // Domain cookies of every parent domain on the way down, then the host
+    // cookies of the domain itself
+    const DomainNode* node = &m_root;
+    visitPaths(m_root.hostCookies);
+    visitPaths(m_root.domainCookies);
+    std::string_view rest(domain);
+    while (!rest.empty()) {
+        auto it = node->children.find(popLabel(rest));
+        if (it == node->children.end()) {
+            return;
+        }
+        node = it->second.get();
+        visitPaths(node->domainCookies);
+    }
+    if (node != &m_root) {
+        visitPaths(node->hostCookies);
+    }
+}
+
 void CookieJar::addCookie(const Cookie& cookie) {
     // Don't add expired cookies
     if (cookie.isExpired()) {
@@ -254,7 +404,14 @@ void CookieJar::addCookie(const Cookie& cookie) {
     }
     
     // Add or update cookie
-    m_cookies[cookie.domain()][cookie.path()][cookie.name()] = cookie;
+    auto& names = cookiesFor(cookie.domain())[cookie.path()];
+    auto result = names.insert_or_assign(cookie.name(), cookie);
+    if (result.second) {
+        m_cookieCount++;
+    }
+    if (cookie.expiresAt() != std::chrono::system_clock::time_point::max()) {
+        m_expiries.push({ cookie.expiresAt(), cookie.domain(), cookie.path(), cookie.name() });
+    }
     
     // Clean up expired cookies periodically
     clearExpired();
@@ -264,102 +421,92 @@ std::vector<Cookie> CookieJar::getCookies(const std::string& domain, const std::
     std::vector<Cookie> cookies;
     
     // Get all cookies that apply to the domain and path
-    for (const auto& domainEntry : m_cookies) {
-        Cookie tempCookie;
-        if (domainEntry.first.empty() || (tempCookie.setDomain(domainEntry.first), tempCookie.appliesTo(domain))) {
-            for (const auto& pathEntry : domainEntry.second) {
-                Cookie pathCookie;
-                if ((pathCookie.setDomain(domainEntry.first), pathCookie.setPath(pathEntry.first), pathCookie.appliesToPath(path))) {
-                    for (const auto& nameEntry : pathEntry.second) {
-                        const Cookie& cookie = nameEntry.second;
-                        
-                        // Check if cookie is expired
-                        if (cookie.isExpired()) {
-                            continue;
-                        }
-                        
-                        // Check Secure flag
-                        if (cookie.isSecure() && !secure) {
-                            continue;
-                        }
-                        
-                        cookies.push_back(cookie);
-                    }
-                }
-            }
-        }
-    }
+    forEachCookie(domain, path, secure, [&](const Cookie& cookie) {
+        cookies.push_back(cookie);
+    });
     
     return cookies;
 }
 
 Cookie CookieJar::getCookie(const std::string& domain, const std::string& path, const std::string& name, bool secure) const {
-    // Get matching cookies
-    std::vector<Cookie> cookies = getCookies(domain, path, secure);
-    
-    // Find cookie with the specified name
-    for (const Cookie& cookie : cookies) {
-        if (cookie.name() == name) {
-            return cookie;
+    // Find cookie with the specified name among the matching ones
+    const Cookie* found = nullptr;
+    forEachCookie(domain, path, secure, [&](const Cookie& cookie) {
+        if (!found && cookie.name() == name) {
+            found = &cookie;
         }
-    }
+    });
     
     // Return empty cookie if not found
-    return Cookie();
+    return found ? *found : Cookie();
 }
 
-void CookieJar::removeCookie(const std::string& domain, const std::string& path, const std::string& name) {
-    // Find and remove the cookie
-    auto domainIt = m_cookies.find(domain);
-    if (domainIt != m_cookies.end()) {
-        auto pathIt = domainIt->second.find(path);
-        if (pathIt != domainIt->second.end()) {
-            pathIt->second.erase(name);
-            
-            // Clean up empty containers
-            if (pathIt->second.empty()) {
-                domainIt->second.erase(pathIt);
-                
-                if (domainIt->second.empty()) {
-                    m_cookies.erase(domainIt);
-                }
-            }
+std::string CookieJar::getCookieHeader(const std::string& domain, const std::string& path, bool secure) const {
+    std::string header;
+    forEachCookie(domain, path, secure, [&](const Cookie& cookie) {
+        if (!header.empty()) {
+            header += "; ";
         }
-    }
+        header += cookie.name();
+        header += '=';
+        header += cookie.value();
+    });
+    return header;
+}
+
+void CookieJar::removeCookie(const std::string& domain, const std::string& path, const std::string& name) {
+    // Find and remove the cookie; its expiry entry is dropped when it comes
+    // up
+    eraseCookie(domain, path, name);
 }
 
 void CookieJar::clear() {
-    m_cookies.clear();
+    m_root = DomainNode();
+    m_cookieCount = 0;
+    m_expiries = decltype(m_expiries)();
 }
 
 void CookieJar::clearExpired() {
-    // Iterate through all cookies and remove expired ones
-    for (auto domainIt = m_cookies.begin(); domainIt != m_cookies.end();) {
-        for (auto pathIt = domainIt->second.begin(); pathIt != domainIt->second.end();) {
-            for (auto nameIt = pathIt->second.begin(); nameIt != pathIt->second.end();) {
-                if (nameIt->second.isExpired()) {
-                    nameIt = pathIt->second.erase(nameIt);
-                }
-                else {
-                    ++nameIt;
+    // Remove cookies from the earliest expiry on, until one that hasn't
+    // expired yet
+    auto now = std::chrono::system_clock::now();
+    while (!m_expiries.empty() && now > m_expiries.top().expiresAt) {
+        const Expiry& expiry = m_expiries.top();
+        const Cookie* cookie = findCookie(expiry.domain, expiry.path, expiry.name);
+        if (cookie && cookie->expiresAt() == expiry.expiresAt) {
+            eraseCookie(expiry.domain, expiry.path, expiry.name);
+        }
+        m_expiries.pop();
+    }
+    
+    // Cookies set again and again leave entries for expiry times they no
+    // longer have
+    if (m_expiries.size() > 2 * m_cookieCount + 64) {
+        rebuildExpiries();
+    }
+}
+
+void CookieJar::rebuildExpiries() {
+    std::vector<Expiry> expiries;
+    std::vector<const DomainNode*> nodes = { &m_root };
+    while (!nodes.empty()) {
+        const DomainNode* node = nodes.back();
+        nodes.pop_back();
+        for (const PathCookies* paths : { &node->hostCookies, &node->domainCookies }) {
+            for (const auto& pathEntry : *paths) {
+                for (const auto& nameEntry : pathEntry.second) {
+                    const Cookie& cookie = nameEntry.second;
+                    if (cookie.expiresAt() != std::chrono::system_clock::time_point::max()) {
+                        expiries.push_back({ cookie.expiresAt(), cookie.domain(), cookie.path(), cookie.name() });
+                    }
                 }
             }
-            
-            if (pathIt->second.empty()) {
-                pathIt = domainIt->second.erase(pathIt);
-            }
-            else {
-                ++pathIt;
-            }
-        }
-        
-        if (domainIt->second.empty()) {
-            domainIt = m_cookies.erase(domainIt);
         }
-        else {
-            ++domainIt;
+        for (const auto& child : node->children) {
+            nodes.push_back(child.second.get());
         }
     }
+    m_expiries = decltype(m_expiries)(ExpiresLater(), std::move(expiries));
 }
 
 //-----------------------------------------------------------------------------
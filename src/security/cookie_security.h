@@ -2,7 +2,10 @@
 #define BROWSER_COOKIE_SECURITY_H
 
 #include <string>
+#include <string_view>
 #include <map>
+#include <memory>
+#include <queue>
 #include <vector>
 #include <chrono>
 #include "same_origin.h"
@@ -76,7 +79,9 @@ private:
     std::chrono::system_clock::time_point m_expiresAt;
 };
 
-// Cookie Jar class
+// Cookie Jar class. Cookies are found through a trie of domain labels and,
+// under each domain, an index of paths, so a lookup only visits the
+// domains and paths that match the request.
 class CookieJar {
 public:
     CookieJar();
@@ -91,6 +96,10 @@ public:
     // Get a specific cookie by name
     Cookie getCookie(const std::string& domain, const std::string& path, const std::string& name, bool secure = false) const;
     
+    // Cookie request header value ("name=value; name2=value2") for a
+    // domain and path; empty if no cookie applies
+    std::string getCookieHeader(const std::string& domain, const std::string& path, bool secure = false) const;
+    
     // Remove a cookie
     void removeCookie(const std::string& domain, const std::string& path, const std::string& name);
     
@@ -100,9 +109,49 @@ public:
     // Clear expired cookies
     void clearExpired();
     
+    // Number of cookies stored
+    size_t size() const { return m_cookieCount; }
+    
 private:
-    // Map of domain -> path -> name -> cookie
-    std::map<std::string, std::map<std::string, std::map<std::string, Cookie>>> m_cookies;
+    // Map of path -> name -> cookie
+    using PathCookies = std::map<std::string, std::map<std::string, Cookie>, std::less<>>;
+    
+    // Trie node for a domain, under the node of its parent domain: labels
+    // are taken from the last, so "www.example.com" is com -> example ->
+    // www. Host cookies apply to exactly that host, domain cookies
+    // (Domain=.example.com) to it and its subdomains. At the root, the
+    // host cookies are those with no domain, which apply everywhere.
+    struct DomainNode {
+        std::map<std::string, std::unique_ptr<DomainNode>, std::less<>> children;
+        PathCookies hostCookies;
+        PathCookies domainCookies;
+    };
+    
+    // When a cookie expires; entries whose cookie has since been replaced
+    // or removed are skipped
+    struct Expiry {
+        std::chrono::system_clock::time_point expiresAt;
+        std::string domain;
+        std::string path;
+        std::string name;
+    };
+    struct ExpiresLater {
+        bool operator()(const Expiry& a, const Expiry& b) const { return a.expiresAt > b.expiresAt; }
+    };
+    
+    PathCookies& cookiesFor(const std::string& domain);
+    const PathCookies* findCookies(const std::string& domain) const;
+    const Cookie* findCookie(const std::string& domain, const std::string& path, const std::string& name) const;
+    bool eraseCookie(const std::string& domain, const std::string& path, const std::string& name);
+    template <typename Visitor>
+    void forEachCookie(const std::string& domain, const std::string& path, bool secure, Visitor&& visit) const;
+    void rebuildExpiries();
+    
+    DomainNode m_root;
+    size_t m_cookieCount;
+    
+    // Min-heap of expiry times of cookies that have one
+    std::priority_queue<Expiry, std::vector<Expiry>, ExpiresLater> m_expiries;
 };
 
 // Cookie Security Manager
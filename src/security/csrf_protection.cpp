@@ -118,11 +118,11 @@ bool CsrfProtection::validateToken(const std::string& token, const std::string&
 }
 
 void CsrfProtection::addTrustedOrigin(const Origin& origin) {
-    m_trustedOrigins.insert(origin.toString());
+    m_trustedOrigins.insert(origin.id());
 }
 
 bool CsrfProtection::isTrustedOrigin(const Origin& origin) const {
-    return m_trustedOrigins.find(origin.toString()) != m_trustedOrigins.end();
+    return m_trustedOrigins.count(origin.id()) > 0;
 }
 
 bool CsrfProtection::checkSameOrigin(const std::string& targetUrl, const std::map<std::string, std::string>& headers) const {
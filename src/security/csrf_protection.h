@@ -7,6 +7,7 @@
 #include <set>
 #include <chrono>
 #include <random>
+#include <unordered_set>
 #include "same_origin.h"
 
 namespace browser {
@@ -78,7 +79,7 @@ public:
 private:
     CsrfProtectionMode m_mode;
     CsrfToken m_tokenGenerator;
-    std::set<std::string> m_trustedOrigins;
+    std::unordered_set<uint32_t> m_trustedOrigins;      // Origin ids
     
     // Helper methods for CSRF checks
     bool checkSameOrigin(const std::string& targetUrl, const std::map<std::string, std::string>& headers) const;
@@ -1,8 +1,13 @@
 #include "same_origin.h"
+#include "url.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 
 namespace browser {
 namespace security {
@@ -11,137 +16,94 @@ namespace security {
 // Origin Implementation
 //-----------------------------------------------------------------------------
 
-Origin::Origin(const std::string& scheme, const std::string& host, int port)
-    : m_scheme(scheme)
-    , m_host(host)
-    , m_port(port)
-{
-    normalize();
-}
-
-Origin::Origin(const std::string& url) 
-    : m_scheme("")
-    , m_host("")
-    , m_port(0)
-{
-    // Parse URL to extract origin components
-    if (url.empty()) {
-        *this = null();
-        return;
-    }
+// Every origin seen so far, keyed by scheme, host and port. Entries are
+// never removed, so pointers to them stay valid; the null origin is the
+// first.
+struct Origin::Table {
+    std::shared_mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
     
-    // Extract scheme
-    size_t schemeEnd = url.find("://");
-    if (schemeEnd == std::string::npos) {
-        *this = null();
-        return;
+    Table() {
+        entries.emplace(key("", "", 0), std::unique_ptr<Entry>(new Entry{ "", "", 0, 0, "null" }));
     }
     
-    m_scheme = url.substr(0, schemeEnd);
-    
-    // Extract host and port
-    size_t hostStart = schemeEnd + 3;
-    size_t hostEnd = url.find('/', hostStart);
-    if (hostEnd == std::string::npos) {
-        hostEnd = url.length();
+    static std::string key(const std::string& scheme, const std::string& host, int port) {
+        return scheme + "://" + host + ":" + std::to_string(port);
     }
-    
-    std::string hostAndPort = url.substr(hostStart, hostEnd - hostStart);
-    
-    // Check for port specification
-    size_t portPos = hostAndPort.find(':');
-    if (portPos != std::string::npos) {
-        m_host = hostAndPort.substr(0, portPos);
-        
-        try {
-            m_port = std::stoi(hostAndPort.substr(portPos + 1));
-        }
-        catch (const std::exception&) {
-            // Default to standard ports if parsing fails
-            if (m_scheme == "http") {
-                m_port = 80;
-            }
-            else if (m_scheme == "https") {
-                m_port = 443;
-            }
-        }
+};
+
+Origin::Table& Origin::table() {
+    static Table instance;
+    return instance;
+}
+
+const Origin::Entry* Origin::intern(std::string scheme, std::string host, int port) {
+    // Normalize the origin components
+    std::transform(scheme.begin(), scheme.end(), scheme.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (scheme == "http" && port == 0) {
+        port = 80;
     }
-    else {
-        m_host = hostAndPort;
-        
-        // Set default ports
-        if (m_scheme == "http") {
-            m_port = 80;
-        }
-        else if (m_scheme == "https") {
-            m_port = 443;
+    else if (scheme == "https" && port == 0) {
+        port = 443;
+    }
+    
+    Table& origins = table();
+    std::string key = Table::key(scheme, host, port);
+    {
+        std::shared_lock<std::shared_mutex> lock(origins.mutex);
+        auto it = origins.entries.find(key);
+        if (it != origins.entries.end()) {
+            return it->second.get();
         }
     }
     
-    normalize();
-}
-
-std::string Origin::toString() const {
-    if (isNull()) {
-        return "null";
+    std::unique_lock<std::shared_mutex> lock(origins.mutex);
+    auto it = origins.entries.find(key);
+    if (it != origins.entries.end()) {
+        return it->second.get();
     }
     
-    std::ostringstream oss;
-    oss << m_scheme << "://" << m_host;
+    std::unique_ptr<Entry> entry(new Entry{ scheme, host, port, static_cast<uint32_t>(origins.entries.size()), "" });
+    entry->serialized = scheme + "://" + host;
     
     // Only include port if it's non-standard
-    if ((m_scheme == "http" && m_port != 80) || 
-        (m_scheme == "https" && m_port != 443)) {
-        oss << ":" << m_port;
+    if ((scheme == "http" && port != 80) || 
+        (scheme == "https" && port != 443)) {
+        entry->serialized += ":" + std::to_string(port);
     }
     
-    return oss.str();
+    const Entry* interned = entry.get();
+    origins.entries.emplace(std::move(key), std::move(entry));
+    return interned;
 }
 
-bool Origin::equals(const Origin& other) const {
-    return m_scheme == other.m_scheme && 
-           m_host == other.m_host && 
-           m_port == other.m_port;
-}
-
-bool Origin::operator==(const Origin& other) const {
-    return equals(other);
-}
-
-bool Origin::operator!=(const Origin& other) const {
-    return !equals(other);
+Origin::Origin(const std::string& scheme, const std::string& host, int port)
+    : m_entry(intern(scheme, host, port))
+{
 }
 
-bool Origin::isNull() const {
-    return m_scheme.empty() && m_host.empty() && m_port == 0;
+Origin::Origin(const std::string& url) 
+    : Origin(Url(url).origin())
+{
 }
 
 Origin Origin::null() {
-    return Origin("", "", 0);
+    return Origin(intern("", "", 0));
 }
 
 Origin Origin::opaque() {
     // Create a unique opaque origin
-    static int uniqueId = 0;
+    static std::atomic<int> uniqueId{0};
     return Origin("opaque", "unique-origin-" + std::to_string(++uniqueId), 0);
 }
 
-void Origin::normalize() {
-    // Convert scheme to lowercase
-    std::transform(m_scheme.begin(), m_scheme.end(), m_scheme.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
-    
-    // Convert host to lowercase
-    std::transform(m_host.begin(), m_host.end(), m_host.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
-    
-    // Handle default ports
-    if (m_scheme == "http" && m_port == 0) {
-        m_port = 80;
-    }
-    else if (m_scheme == "https" && m_port == 0) {
-        m_port = 443;
-    }
+size_t Origin::internedCount() {
+    Table& origins = table();
+    std::shared_lock<std::shared_mutex> lock(origins.mutex);
+    return origins.entries.size();
 }
 
 //-----------------------------------------------------------------------------
@@ -185,11 +147,11 @@ bool SameOriginPolicy::canExecuteScript(const Origin& source, const Origin& targ
 }
 
 void SameOriginPolicy::addTrustedOrigin(const Origin& origin) {
-    m_trustedOrigins[origin.toString()] = true;
+    m_trustedOrigins.insert(origin.id());
 }
 
 bool SameOriginPolicy::isTrustedOrigin(const Origin& origin) const {
-    return m_trustedOrigins.find(origin.toString()) != m_trustedOrigins.end();
+    return !m_trustedOrigins.empty() && m_trustedOrigins.count(origin.id()) > 0;
 }
 
 } // namespace security
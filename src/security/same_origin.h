@@ -1,47 +1,73 @@
 #ifndef BROWSER_SAME_ORIGIN_H
 #define BROWSER_SAME_ORIGIN_H
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
+#include <string>
+#include <unordered_set>
 
 namespace browser {
 namespace security {
 
 // Represents a web origin as defined by the same-origin policy
 // An origin is defined by the triplet (scheme, host, port)
+//
+// Origins are interned: each distinct triplet is stored once for the life
+// of the process, and an Origin is a pointer to its entry. Copying one is
+// free, comparing two is a pointer compare, and id() is a small integer
+// that can stand for the origin in tables.
 class Origin {
 public:
     Origin(const std::string& scheme, const std::string& host, int port);
     Origin(const std::string& url); // Construct from URL string
     
     // Get the components of the origin
-    std::string scheme() const { return m_scheme; }
-    std::string host() const { return m_host; }
-    int port() const { return m_port; }
+    const std::string& scheme() const { return m_entry->scheme; }
+    const std::string& host() const { return m_entry->host; }
+    int port() const { return m_entry->port; }
+    
+    // Equal origins have equal ids; the null origin's is 0
+    uint32_t id() const { return m_entry->id; }
     
     // Get the serialized origin string
-    std::string toString() const;
+    const std::string& toString() const { return m_entry->serialized; }
     
     // Compare origins
-    bool equals(const Origin& other) const;
-    bool operator==(const Origin& other) const;
-    bool operator!=(const Origin& other) const;
+    bool equals(const Origin& other) const { return m_entry == other.m_entry; }
+    bool operator==(const Origin& other) const { return m_entry == other.m_entry; }
+    bool operator!=(const Origin& other) const { return m_entry != other.m_entry; }
     
     // Check if this is a null origin (represents an opaque origin)
-    bool isNull() const;
+    bool isNull() const { return m_entry->id == 0; }
     
     // Predefined origins
     static Origin null();  // The "null" origin
     static Origin opaque(); // An opaque unique origin
     
+    // Distinct origins interned so far
+    static size_t internedCount();
+    
 private:
-    std::string m_scheme;
-    std::string m_host;
-    int m_port;
+    struct Entry {
+        std::string scheme;
+        std::string host;
+        int port;
+        uint32_t id;
+        std::string serialized;
+    };
+    
+    struct Table;
+    static Table& table();
     
-    // Normalize the origin components
-    void normalize();
+    explicit Origin(const Entry* entry) : m_entry(entry) {}
+    
+    // The entry for the normalized triplet, added on first use
+    static const Entry* intern(std::string scheme, std::string host, int port);
+    
+    const Entry* m_entry;
 };
 
 // Same-origin policy enforcer
@@ -72,11 +98,21 @@ public:
     bool isTrustedOrigin(const Origin& origin) const;
     
 private:
-    // List of trusted origins (for development/testing)
-    std::map<std::string, bool> m_trustedOrigins;
+    // Ids of trusted origins (for development/testing)
+    std::unordered_set<uint32_t> m_trustedOrigins;
 };
 
 } // namespace security
 } // namespace browser
 
+// Origins as keys of unordered containers
+namespace std {
+template<>
+struct hash<browser::security::Origin> {
+    size_t operator()(const browser::security::Origin& origin) const noexcept {
+        return origin.id();
+    }
+};
+} // namespace std
+
 #endif // BROWSER_SAME_ORIGIN_H
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "url.h"
+#include <algorithm>
+#include <cctype>
+
+namespace browser {
+namespace security {
+
+namespace {
+
+bool isSchemeChar(char c, bool first) {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (std::isalpha(u)) {
+        return true;
+    }
+    return !first && (std::isdigit(u) || c == '+' || c == '-' || c == '.');
+}
+
+// Length of the scheme reference starts with, or 0 if it doesn't
+size_t schemeLength(const std::string& reference) {
+    size_t i = 0;
+    while (i < reference.size() && isSchemeChar(reference[i], i == 0)) {
+        ++i;
+    }
+    return i > 0 && i < reference.size() && reference[i] == ':' ? i : 0;
+}
+
+void toLower(std::string& text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// Url Implementation
+//-----------------------------------------------------------------------------
+
+Url::Url()
+    : m_port(0)
+    , m_pathStart(0)
+    , m_queryStart(0)
+    , m_fragmentStart(0)
+    , m_valid(false)
+    , m_origin(Origin::null())
+{
+}
+
+Url::Url(const std::string& spec)
+    : m_spec(spec)
+    , m_port(0)
+    , m_pathStart(spec.size())
+    , m_queryStart(spec.size())
+    , m_fragmentStart(spec.size())
+    , m_valid(false)
+    , m_origin(Origin::null())
+{
+    size_t schemeEnd = schemeLength(spec);
+    if (schemeEnd == 0 || spec.compare(schemeEnd, 3, "://") != 0) {
+        return;
+    }
+    m_scheme = spec.substr(0, schemeEnd);
+    toLower(m_scheme);
+
+    size_t hostStart = schemeEnd + 3;
+    size_t authorityEnd = spec.find_first_of("/?#", hostStart);
+    if (authorityEnd == std::string::npos) {
+        authorityEnd = spec.size();
+    }
+
+    // An IPv6 literal keeps its brackets and colons
+    size_t hostEnd = authorityEnd;
+    size_t portSearch = hostStart;
+    if (hostStart < authorityEnd && spec[hostStart] == '[') {
+        size_t bracket = spec.find(']', hostStart);
+        if (bracket == std::string::npos || bracket >= authorityEnd) {
+            return;
+        }
+        portSearch = bracket + 1;
+    }
+    size_t colon = spec.find(':', portSearch);
+    if (colon != std::string::npos && colon < authorityEnd) {
+        hostEnd = colon;
+        size_t digits = authorityEnd - colon - 1;
+        if (digits > 5) {
+            return;
+        }
+        for (size_t i = colon + 1; i < authorityEnd; ++i) {
+            if (!std::isdigit(static_cast<unsigned char>(spec[i]))) {
+                return;
+            }
+            m_port = m_port * 10 + (spec[i] - '0');
+        }
+        if (m_port > 65535) {
+            return;
+        }
+    }
+    if (m_port == 0) {
+        m_port = m_scheme == "https" ? 443 : m_scheme == "http" ? 80 : 0;
+    }
+
+    m_host = spec.substr(hostStart, hostEnd - hostStart);
+    toLower(m_host);
+
+    m_pathStart = authorityEnd;
+    m_fragmentStart = std::min(spec.find('#', m_pathStart), spec.size());
+    m_queryStart = std::min(spec.find('?', m_pathStart), m_fragmentStart);
+    m_valid = true;
+    m_origin = Origin(m_scheme, m_host, m_port);
+}
+
+std::string Url::pathAndQuery() const {
+    if (!m_valid || m_pathStart == m_fragmentStart) {
+        return "/";
+    }
+    std::string path = m_spec.substr(m_pathStart, m_fragmentStart - m_pathStart);
+    if (path[0] == '?') {
+        path.insert(path.begin(), '/');
+    }
+    return path;
+}
+
+Url Url::resolve(const std::string& reference) const {
+    if (!m_valid || schemeLength(reference) > 0) {
+        return Url(reference);
+    }
+
+    if (reference.empty()) {
+        return Url(m_spec.substr(0, m_fragmentStart));
+    }
+    if (reference.compare(0, 2, "//") == 0) {
+        return Url(m_scheme + ":" + reference);
+    }
+    switch (reference[0]) {
+        case '/':
+            return Url(m_spec.substr(0, m_pathStart) + reference);
+        case '?':
+            return Url(m_spec.substr(0, m_queryStart) + reference);
+        case '#':
+            return Url(m_spec.substr(0, m_fragmentStart) + reference);
+        default:
+            break;
+    }
+
+    // Relative to the directory of the path
+    size_t lastSlash = m_queryStart > m_pathStart ? m_spec.rfind('/', m_queryStart - 1) : std::string::npos;
+    if (lastSlash == std::string::npos || lastSlash < m_pathStart) {
+        return Url(m_spec.substr(0, m_pathStart) + "/" + reference);
+    }
+    return Url(m_spec.substr(0, lastSlash + 1) + reference);
+}
+
+} // namespace security
+} // namespace browser
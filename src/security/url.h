@@ -0,0 +1,57 @@
+#ifndef BROWSER_URL_H
+#define BROWSER_URL_H
+
+#include "same_origin.h"
+#include <cstddef>
+#include <string>
+
+namespace browser {
+namespace security {
+
+// An absolute URL of the form scheme://host[:port][/path][?query][#fragment],
+// parsed once. The scheme and host are kept lowercase, the port is filled
+// in for http and https when it isn't given, and the origin is interned
+// as the URL is parsed, so it can be compared without parsing again.
+// Anything else (no authority, a bad port) is invalid and has the null
+// origin.
+class Url {
+public:
+    Url();
+    explicit Url(const std::string& spec);
+
+    bool isValid() const { return m_valid; }
+
+    // The URL as given
+    const std::string& spec() const { return m_spec; }
+
+    const std::string& scheme() const { return m_scheme; }
+    const std::string& host() const { return m_host; }
+    int port() const { return m_port; }
+    const Origin& origin() const { return m_origin; }
+
+    // What goes in a request line: the path and query, never empty, and
+    // without the fragment
+    std::string pathAndQuery() const;
+
+    // The URL a reference found in a document at this URL points to.
+    // Handles absolute URLs and references starting with "//", "/", "?"
+    // or "#" as well as paths relative to this URL's directory. Against an
+    // invalid URL the reference is taken as it is.
+    Url resolve(const std::string& reference) const;
+
+private:
+    std::string m_spec;
+    std::string m_scheme;
+    std::string m_host;
+    int m_port;
+    size_t m_pathStart;         // Where the path, query and fragment begin in m_spec
+    size_t m_queryStart;
+    size_t m_fragmentStart;
+    bool m_valid;
+    Origin m_origin;
+};
+
+} // namespace security
+} // namespace browser
+
+#endif // BROWSER_URL_H
@@ -1,13 +1,111 @@
 #include "xss_protection.h"
+#include "../html/html_tokenizer.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <regex>
 
 namespace browser {
 namespace security {
 
+namespace {
+    void lowercaseInto(std::string_view input, std::string& output) {
+        output.assign(input);
+        std::transform(output.begin(), output.end(), output.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+    }
+
+    // Elements BASIC sanitization drops: scripts, and what embeds other
+    // documents or changes how the page's URLs and refreshes work
+    bool isBlockedTag(const std::string& tag) {
+        static const std::set<std::string> blockedTags = {
+            "script", "iframe", "frame", "frameset", "object", "embed", "applet", "base", "meta"
+        };
+        return blockedTags.count(tag) > 0;
+    }
+
+    // Elements whose content browsers read as text while the tokenizer
+    // reads it as markup, so an attribute can hide their end tag and what
+    // follows it. They're dropped with everything up to their end tag.
+    bool isDroppedWithContent(const std::string& tag) {
+        static const std::set<std::string> tags = {
+            "noscript", "noembed", "noframes", "xmp", "plaintext", "iframe"
+        };
+        return tags.count(tag) > 0;
+    }
+
+    // Whether a data: URL holds an image other than SVG, which can carry
+    // script; value is the URL after "data:"
+    bool isDataImage(std::string_view value) {
+        std::string type;
+        for (char c : value) {
+            if (c == ';' || c == ',') {
+                break;
+            }
+            if (static_cast<unsigned char>(c) > ' ') {
+                type += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        return type.compare(0, 6, "image/") == 0 && type != "image/svg+xml";
+    }
+
+    bool isUrlAttribute(const std::string& attribute) {
+        static const std::set<std::string> urlAttributes = {
+            "href", "src", "action", "formaction", "data", "poster", "background", "cite",
+            "lowsrc", "dynsrc", "xlink:href"
+        };
+        return urlAttributes.count(attribute) > 0;
+    }
+
+    // The scheme of a URL attribute value, lowercased, with the whitespace
+    // and control characters browsers ignore taken out. Returns false if
+    // the value has a character reference before the scheme ends, which
+    // could hide one.
+    bool urlScheme(std::string_view value, std::string& scheme) {
+        scheme.clear();
+        for (char c : value) {
+            if (c == ':') {
+                return true;
+            }
+            if (c == '/' || c == '?' || c == '#') {
+                break;
+            }
+            if (c == '&') {
+                return false;
+            }
+            if (static_cast<unsigned char>(c) > ' ') {
+                scheme += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        
+        // Relative URL
+        scheme.clear();
+        return true;
+    }
+
+    // "+=" then an escaped quote, '+' and another escaped quote, as in
+    // string building that hides a payload
+    bool hasConcatenatedEscapedQuotes(const std::string& content) {
+        auto skipSpace = [&](size_t i) {
+            while (i < content.size() && std::isspace(static_cast<unsigned char>(content[i]))) i++;
+            return i;
+        };
+        auto escapedQuote = [&](size_t i) {
+            return i + 1 < content.size() && content[i] == '\\' && (content[i + 1] == '"' || content[i + 1] == '\'');
+        };
+        for (size_t pos = content.find("+="); pos != std::string::npos; pos = content.find("+=", pos + 2)) {
+            size_t i = skipSpace(pos + 2);
+            if (!escapedQuote(i)) continue;
+            i = skipSpace(i + 2);
+            if (i >= content.size() || content[i] != '+') continue;
+            if (escapedQuote(skipSpace(i + 1))) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
 //-----------------------------------------------------------------------------
 // XssProtection Implementation
 //-----------------------------------------------------------------------------
@@ -120,125 +218,133 @@ std::string XssProtection::sanitizeHtml(const std::string& html, SanitizationLev
         return escapeHtml(html);
     }
     
-    // For BASIC and STRICT sanitization, we need to parse the HTML and filter tags/attributes
-    
-    // In a real implementation, this would use a proper HTML parser
-    // For simplicity, we'll use a regex-based approach for demonstration
+    // For BASIC and STRICT sanitization, tags and attributes are filtered
+    // as the tokenizer produces them, in one pass over the input. BASIC
+    // drops script and embedding elements, event handlers and script URLs;
+    // STRICT keeps only whitelisted tags, attributes and URL protocols.
+    const bool strict = level == SanitizationLevel::STRICT_LEVEL;
+    std::string sanitized;
+    sanitized.reserve(html.size());
     
-    std::string sanitized = html;
+    html::HTMLTokenizer tokenizer(html);
+    html::TokenView token;
+    std::string tagName;
+    std::string attributeName;
+    bool keptRawText = false;      // Next text is the content of a kept raw text element
+    bool droppedRawText = false;   // Next text is the content of a dropped one
+    std::string droppedElement;    // Everything is dropped until its end tag
+    int foreignDepth = 0;          // Kept <svg> and <math> elements open
     
-    if (level == SanitizationLevel::BASIC) {
-        // Remove script tags and event handlers
-        // Fix: removed dotall flag, use [\\s\\S]* which matches all characters including newlines
-        std::regex scriptTagRegex("<script[^>]*>[\\s\\S]*?</script>", std::regex::icase);
-        sanitized = std::regex_replace(sanitized, scriptTagRegex, "");
-        
-        // Remove javascript: URLs
-        std::regex jsUrlRegex("(href|src|action)\\s*=\\s*[\"']\\s*javascript:", std::regex::icase);
-        sanitized = std::regex_replace(sanitized, jsUrlRegex, "data-removed=");
+    while (tokenizer.next(token)) {
+        if (!droppedElement.empty()) {
+            if (token.type == html::TokenType::END_TAG) {
+                lowercaseInto(token.name, tagName);
+                if (tagName == droppedElement) {
+                    droppedElement.clear();
+                }
+            }
+            continue;
+        }
         
-        // Remove on* event handlers
-        std::regex eventHandlerRegex("\\s+on[a-z]+\\s*=", std::regex::icase);
-        sanitized = std::regex_replace(sanitized, eventHandlerRegex, " data-removed=");
-    }
-    else if (level == SanitizationLevel::STRICT_LEVEL) {
-        // In strict mode, we'd whitelist tags and attributes
-        // This would require a proper HTML parser
-        // For demonstration, we'll use a simplified approach
+        bool rawText = keptRawText || droppedRawText;
+        bool dropText = droppedRawText;
+        keptRawText = droppedRawText = false;
         
-        // Replace all tags with stripped versions
-        std::regex tagRegex("<([^>]+)>");
-        std::string result;
-        std::string::const_iterator searchStart(sanitized.cbegin());
-        std::sregex_iterator iter(sanitized.begin(), sanitized.end(), tagRegex);
-        std::sregex_iterator end;
-        size_t lastPos = 0;
-        for (; iter != end; ++iter) {
-            const std::smatch& match = *iter;
-            result.append(sanitized, lastPos, match.position() - lastPos);
-
-            std::string tag = match[1].str();
-
-            // Get tag name
-            size_t spacePos = tag.find_first_of(" \t\n\r\f\v");
-            std::string tagName = spacePos != std::string::npos ? tag.substr(0, spacePos) : tag;
-
-            // Check if closing tag
-            bool isClosingTag = false;
-            if (!tagName.empty() && tagName[0] == '/') {
-                isClosingTag = true;
-                tagName = tagName.substr(1);
-            }
-
-            // Convert to lowercase
-            std::transform(tagName.begin(), tagName.end(), tagName.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-
-            // Check if allowed
-            if (!isAllowedTag(tagName)) {
-                // skip this tag
-                lastPos = match.position() + match.length();
-                continue;
-            }
-
-            // If closing tag, just return it
-            if (isClosingTag) {
-                result += "</" + tagName + ">";
-                lastPos = match.position() + match.length();
-                continue;
-            }
-
-            // Parse attributes
-            std::string tagResult = "<" + tagName;
-
-            if (spacePos != std::string::npos) {
-                std::string attrStr = tag.substr(spacePos + 1);
-                std::regex attrRegex("([a-zA-Z0-9_-]+)\\s*=\\s*[\"']([^\"']*)[\"']");
-
-                std::string::const_iterator attrSearchStart(attrStr.begin());
-                std::smatch attrMatch;
-
-                while (std::regex_search(attrSearchStart, attrStr.cend(), attrMatch, attrRegex)) {
-                    std::string attrName = attrMatch[1].str();
-                    std::string attrValue = attrMatch[2].str();
-
-                    // Convert to lowercase
-                    std::transform(attrName.begin(), attrName.end(), attrName.begin(),
-                                   [](unsigned char c) { return std::tolower(c); });
-
-                    // Check if allowed
-                    if (isAllowedAttribute(tagName, attrName)) {
-                        // Check for URL attributes
-                        if (attrName == "href" || attrName == "src" || attrName == "action") {
-                            // Check protocol
-                            size_t colonPos = attrValue.find(':');
-                            if (colonPos != std::string::npos) {
-                                std::string protocol = attrValue.substr(0, colonPos);
-
-                                // Convert to lowercase
-                                std::transform(protocol.begin(), protocol.end(), protocol.begin(),
-                                               [](unsigned char c) { return std::tolower(c); });
-
-                                if (!isAllowedProtocol(protocol)) {
-                                    attrSearchStart = attrMatch[0].second;
-                                    continue;
-                                }
-                            }
+        switch (token.type) {
+            case html::TokenType::TEXT:
+                if (dropText) {
+                    break;
+                }
+                if (rawText && foreignDepth == 0) {
+                    sanitized.append(token.data);
+                    break;
+                }
+                
+                // A '<' left from malformed markup must not join up with
+                // the text after a dropped tag into a new one. Inside SVG
+                // and MathML, <style> and the like hold markup, not raw
+                // text, so theirs is escaped the same way.
+                for (char c : token.data) {
+                    if (c == '<') {
+                        sanitized += "&lt;";
+                    } else {
+                        sanitized += c;
+                    }
+                }
+                break;
+                
+            case html::TokenType::START_TAG:
+            case html::TokenType::END_TAG: {
+                lowercaseInto(token.name, tagName);
+                bool allowed = strict ? isAllowedTag(tagName) : !isBlockedTag(tagName);
+                bool foreign = tagName == "svg" || tagName == "math";
+                if (token.type == html::TokenType::END_TAG) {
+                    if (allowed) {
+                        if (foreign && foreignDepth > 0) {
+                            --foreignDepth;
                         }
-
-                        tagResult += " " + attrName + "=\"" + attrValue + "\"";
+                        sanitized += "</";
+                        sanitized += tagName;
+                        sanitized += '>';
                     }
-
-                    attrSearchStart = attrMatch[0].second;
+                    break;
+                }
+                
+                // The tokenizer returns the content of these as one text
+                // token, which goes or stays with the element
+                bool rawTextElement = !token.selfClosing && (tagName == "script" || tagName == "style" ||
+                                                            tagName == "title" || tagName == "textarea");
+                if (isDroppedWithContent(tagName)) {
+                    droppedElement = tagName;
+                    break;
+                }
+                if (!allowed) {
+                    droppedRawText = rawTextElement;
+                    break;
+                }
+                keptRawText = rawTextElement;
+                if (foreign && !token.selfClosing) {
+                    ++foreignDepth;
                 }
+                
+                sanitized += '<';
+                sanitized += tagName;
+                for (const auto& attribute : tokenizer.attributes()) {
+                    lowercaseInto(attribute.name, attributeName);
+                    if (!isAllowedAttributeValue(tagName, attributeName, attribute.value, strict)) {
+                        continue;
+                    }
+                    sanitized += ' ';
+                    sanitized += attributeName;
+                    sanitized += "=\"";
+                    for (char c : attribute.value) {
+                        if (c == '"') {
+                            sanitized += "&quot;";
+                        } else {
+                            sanitized += c;
+                        }
+                    }
+                    sanitized += '"';
+                }
+                sanitized += token.selfClosing ? " />" : ">";
+                break;
             }
-
-            tagResult += ">";
-            result += tagResult;
-            lastPos = match.position() + match.length();
+            
+            case html::TokenType::DOCTYPE:
+                if (!strict) {
+                    sanitized += "<!DOCTYPE ";
+                    sanitized.append(token.name);
+                    sanitized += '>';
+                }
+                break;
+                
+            case html::TokenType::COMMENT:
+                // Comments are dropped; conditional comments can hold markup
+                break;
+                
+            case html::TokenType::EOF_TOKEN:
+                break;
         }
-        result.append(sanitized, lastPos, sanitized.length() - lastPos);
-        sanitized = result;
     }
     
     return sanitized;
@@ -335,6 +441,48 @@ bool XssProtection::isAllowedProtocol(const std::string& protocol) const {
     return m_allowedProtocols.find(protocol) != m_allowedProtocols.end();
 }
 
+bool XssProtection::isAllowedAttributeValue(const std::string& tag, const std::string& attribute,
+                                            std::string_view value, bool strict) const {
+    // Names are written back unquoted, so only plain ones can be kept
+    bool plainName = !attribute.empty() && std::all_of(attribute.begin(), attribute.end(), [](unsigned char c) {
+        return std::isalnum(c) || c == '-' || c == '_' || c == ':' || c == '.';
+    });
+    if (!plainName) {
+        return false;
+    }
+    
+    if (strict) {
+        if (!isAllowedAttribute(tag, attribute)) {
+            return false;
+        }
+    } else if ((attribute.size() > 2 && attribute.compare(0, 2, "on") == 0) || attribute == "srcdoc") {
+        // Event handlers, and documents given inline
+        return false;
+    }
+    
+    if (!isUrlAttribute(attribute)) {
+        return true;
+    }
+    
+    // Relative URLs are fine; absolute ones need an allowed protocol, or
+    // for BASIC one that doesn't run script
+    std::string scheme;
+    if (!urlScheme(value, scheme)) {
+        return false;
+    }
+    if (scheme.empty()) {
+        return true;
+    }
+    if (strict) {
+        return isAllowedProtocol(scheme);
+    }
+    if (scheme == "data") {
+        // Only images, which don't run script where src loads them
+        return attribute == "src" && isDataImage(value.substr(value.find(':') + 1));
+    }
+    return scheme != "javascript" && scheme != "vbscript" && scheme != "livescript";
+}
+
 bool XssProtection::detectXssPatterns(const std::string& content) const {
     // Convert to lowercase for case-insensitive checks
     std::string lowerContent = content;
@@ -369,22 +517,29 @@ bool XssProtection::detectXssPatterns(const std::string& content) const {
         }
     }
     
-    // Check for more complex patterns with regex
-    // Fix: Use explicit regex::icase flag only, removed dotall
-    std::vector<std::regex> xssRegexPatterns = {
-        std::regex("<\\s*script[^>]*>[\\s\\S]*?<\\s*/\\s*script\\s*>", std::regex::icase),
-        std::regex("<\\s*iframe[^>]*>[\\s\\S]*?<\\s*/\\s*iframe\\s*>", std::regex::icase),
-        std::regex("<[^>]*\\s+on[a-z]+\\s*=", std::regex::icase),
-        std::regex("<[^>]*\\s+dynsrc\\s*=", std::regex::icase),
-        std::regex("<[^>]*\\s+lowsrc\\s*=", std::regex::icase),
-        std::regex("\\+=\\s*\\\\[\"']\\s*\\+\\s*\\\\[\"']", std::regex::icase)
-    };
-    
-    for (const auto& regex : xssRegexPatterns) {
-        // Fix: Use proper regex_search with content as string
-        if (std::regex_search(content, regex)) {
+    // Then the markup itself: script and iframe elements, and event
+    // handlers and old image source attributes on any tag
+    html::HTMLTokenizer tokenizer(content);
+    html::TokenView token;
+    std::string name;
+    while (tokenizer.next(token)) {
+        if (token.type != html::TokenType::START_TAG) {
+            continue;
+        }
+        lowercaseInto(token.name, name);
+        if (name == "script" || name == "iframe") {
             return true;
         }
+        for (const auto& attribute : tokenizer.attributes()) {
+            lowercaseInto(attribute.name, name);
+            if ((name.size() > 2 && name.compare(0, 2, "on") == 0) || name == "dynsrc" || name == "lowsrc") {
+                return true;
+            }
+        }
+    }
+    
+    if (hasConcatenatedEscapedQuotes(content)) {
+        return true;
     }
     
     return false;
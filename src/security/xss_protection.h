@@ -2,6 +2,7 @@
 #define BROWSER_XSS_PROTECTION_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <set>
@@ -58,7 +59,8 @@ public:
     // Check if HTML content might contain XSS
     bool isHtmlPotentialXss(const std::string& html) const;
     
-    // Sanitize HTML content to remove potential XSS
+    // Sanitize HTML content to remove potential XSS, in one pass over the
+    // tokenized input
     std::string sanitizeHtml(const std::string& html, SanitizationLevel level = SanitizationLevel::BASIC) const;
     
     // Sanitize a URL to remove potential XSS
@@ -84,6 +86,8 @@ private:
     bool isAllowedTag(const std::string& tag) const;
     bool isAllowedAttribute(const std::string& tag, const std::string& attribute) const;
     bool isAllowedProtocol(const std::string& protocol) const;
+    bool isAllowedAttributeValue(const std::string& tag, const std::string& attribute,
+                                 std::string_view value, bool strict) const;
     
     // Detect XSS attack patterns
     bool detectXssPatterns(const std::string& content) const;
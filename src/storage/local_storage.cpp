@@ -5,41 +5,27 @@
 #include <filesystem>
 #include <algorithm>
 #include <cctype>
-#include <iomanip>
+#include <cstring>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
 namespace browser {
 namespace storage {
 
-// Simple JSON serialization helpers
+// Storage file helpers
 namespace {
-    // Escape a string for JSON output
-    std::string escapeJsonString(const std::string& str) {
-        std::ostringstream oss;
-        for (auto c : str) {
-            switch (c) {
-                case '\"': oss << "\\\""; break;
-                case '\\': oss << "\\\\"; break;
-                case '\b': oss << "\\b"; break;
-                case '\f': oss << "\\f"; break;
-                case '\n': oss << "\\n"; break;
-                case '\r': oss << "\\r"; break;
-                case '\t': oss << "\\t"; break;
-                default:
-                    if ('\x00' <= c && c <= '\x1f') {
-                        // Control character - use \uXXXX format
-                        oss << "\\u" 
-                            << std::hex << std::setw(4) << std::setfill('0') 
-                            << static_cast<int>(c);
-                    } else {
-                        oss << c;
-                    }
-            }
-        }
-        return oss.str();
-    }
-
     // Unescape a JSON string
     std::string unescapeJsonString(const std::string& str) {
         std::ostringstream oss;
@@ -239,8 +225,413 @@ namespace {
         
         return result;
     }
+
+    // Binary snapshot and log encoding, native byte order. A snapshot is
+    // an index of keys with the length, timestamp, offset and checksum of
+    // each value, covered by one checksum, followed by the values. The
+    // first version had the values inline and one checksum at the end.
+
+    const char kSnapshotMagic[4] = { 'B', 'S', 'S', '2' };
+    const char kSnapshotMagicV1[4] = { 'B', 'S', 'S', '1' };
+    const size_t kIndexEntryHeaderSize = 28;
+
+    // Log record operations
+    enum : uint8_t {
+        OP_SET = 1,
+        OP_REMOVE = 2,
+        OP_CLEAR = 3
+    };
+
+    // Log record: payload length and checksum, then the payload of
+    // operation, timestamp, key length, key and value
+    const size_t kRecordHeaderSize = 8;
+    const size_t kPayloadHeaderSize = 13;
+
+    // Once the log is this big and bigger than twice the data, it is
+    // folded into a new snapshot
+    const uint64_t kMinCompactLogSize = 1024 * 1024;
+
+    uint32_t fnv1a(const uint8_t* data, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    void appendValue(std::vector<uint8_t>& out, T value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void appendBytes(std::vector<uint8_t>& out, const std::string& bytes) {
+        out.insert(out.end(), bytes.begin(), bytes.end());
+    }
+
+    // Reads values from a buffer, failing once it runs past the end
+    class Reader {
+    public:
+        Reader(const uint8_t* data, size_t length) : m_data(data), m_length(length), m_offset(0) {}
+
+        template <typename T>
+        bool read(T& value) {
+            if (m_length - m_offset < sizeof(T)) return false;
+            std::memcpy(&value, m_data + m_offset, sizeof(T));
+            m_offset += sizeof(T);
+            return true;
+        }
+
+        bool read(std::string& value, size_t length) {
+            if (m_length - m_offset < length) return false;
+            value.assign(reinterpret_cast<const char*>(m_data + m_offset), length);
+            m_offset += length;
+            return true;
+        }
+
+        size_t offset() const { return m_offset; }
+
+    private:
+        const uint8_t* m_data;
+        size_t m_length;
+        size_t m_offset;
+    };
+
+    bool readWholeFile(const std::string& path, std::vector<uint8_t>& data) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // Flush a stdio stream all the way to the disk
+    bool syncFile(std::FILE* file) {
+        if (std::fflush(file) != 0) {
+            return false;
+        }
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    // Make a rename in directory durable
+    void syncDirectory(const std::string& directory) {
+#ifndef _WIN32
+        int fd = open(directory.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+#else
+        (void)directory;
+#endif
+    }
+
+    // Put an item in or take it out, keeping the total size of keys and
+    // values
+    void putItem(std::map<std::string, StorageItem>& items, size_t& size,
+                 const std::string& key, StorageItem item) {
+        auto it = items.find(key);
+        if (it != items.end()) {
+            size -= key.size() + it->second.length();
+            it->second = std::move(item);
+        } else {
+            it = items.emplace(key, std::move(item)).first;
+        }
+        size += key.size() + it->second.length();
+    }
+
+    void dropItem(std::map<std::string, StorageItem>& items, size_t& size, const std::string& key) {
+        auto it = items.find(key);
+        if (it != items.end()) {
+            size -= key.size() + it->second.length();
+            items.erase(it);
+        }
+    }
+
+    const uint8_t* valueBytes(const StorageItem& item) {
+        return item.mappedValue ? item.mappedValue : reinterpret_cast<const uint8_t*>(item.value.data());
+    }
+
+    std::chrono::system_clock::time_point timeFromSeconds(int64_t seconds) {
+        return std::chrono::system_clock::from_time_t(static_cast<std::time_t>(seconds));
+    }
+
+    int64_t secondsFromTime(std::chrono::system_clock::time_point time) {
+        return static_cast<int64_t>(std::chrono::system_clock::to_time_t(time));
+    }
+
+    // Read a storage file in the JSON format used before snapshots: 1 if
+    // items were read, 0 if there is none, -1 if it belongs to another
+    // origin
+    int readLegacyJson(const std::string& filePath, const std::string& origin,
+                       std::map<std::string, StorageItem>& items, size_t& size) {
+        std::ifstream file(filePath);
+        if (!file.is_open()) {
+            return 0;
+        }
+        
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string jsonContent = buffer.str();
+        
+        // Parse JSON manually
+        std::map<std::string, std::string> jsonObj = parseJsonObject(jsonContent);
+        
+        // Verify origin matches; string values come back unquoted and
+        // unescaped
+        auto originIt = jsonObj.find("origin");
+        if (originIt == jsonObj.end() || originIt->second != origin) {
+            return -1;
+        }
+        
+        // Load items
+        auto itemObjs = parseJsonArray(jsonContent, "items");
+        for (const auto& itemObj : itemObjs) {
+            std::string key;
+            StorageItem item;
+            
+            // Get key
+            auto keyIt = itemObj.find("key");
+            if (keyIt != itemObj.end()) {
+                key = keyIt->second;
+            }
+            
+            // Get value
+            auto valueIt = itemObj.find("value");
+            if (valueIt != itemObj.end()) {
+                item.value = valueIt->second;
+            }
+            
+            // Get timestamp if present
+            auto timestampIt = itemObj.find("timestamp");
+            if (timestampIt != itemObj.end()) {
+                try {
+                    item.timestamp = timeFromSeconds(std::stoll(timestampIt->second));
+                } catch (const std::exception&) {
+                    // Use current time if parsing fails
+                    item.timestamp = std::chrono::system_clock::now();
+                }
+            }
+            
+            // Add item to storage
+            if (!key.empty()) {
+                putItem(items, size, key, std::move(item));
+            }
+        }
+        
+        return 1;
+    }
+
+    // Read a snapshot of the first version, copying the values
+    int readSnapshotV1(const uint8_t* data, size_t length, const std::string& origin,
+                       std::map<std::string, StorageItem>& items, size_t& size) {
+        size_t checkedLength = length - sizeof(uint32_t);
+        uint32_t checksum;
+        std::memcpy(&checksum, data + checkedLength, sizeof(checksum));
+        if (fnv1a(data, checkedLength) != checksum) {
+            return 0;
+        }
+        
+        Reader reader(data + sizeof(kSnapshotMagicV1), checkedLength - sizeof(kSnapshotMagicV1));
+        uint32_t originLength;
+        std::string storedOrigin;
+        uint64_t count;
+        if (!reader.read(originLength) || !reader.read(storedOrigin, originLength) || !reader.read(count)) {
+            return 0;
+        }
+        if (storedOrigin != origin) {
+            return -1;
+        }
+        
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t keyLength, valueLength;
+            int64_t timestamp;
+            std::string key;
+            StorageItem item;
+            if (!reader.read(keyLength) || !reader.read(valueLength) || !reader.read(timestamp) ||
+                !reader.read(key, keyLength) || !reader.read(item.value, valueLength)) {
+                return 0;
+            }
+            item.timestamp = timeFromSeconds(timestamp);
+            putItem(items, size, key, std::move(item));
+        }
+        return 1;
+    }
+
+    // Read a snapshot's index into items, which point at their values in
+    // data: 1 if it was read, 0 if it is damaged, -1 if it belongs to
+    // another origin. The values themselves are checked when read.
+    int readSnapshot(const uint8_t* data, size_t length, const std::string& origin,
+                     std::map<std::string, StorageItem>& items, size_t& size) {
+        if (length < sizeof(kSnapshotMagic) + sizeof(uint32_t)) {
+            return 0;
+        }
+        if (std::memcmp(data, kSnapshotMagicV1, sizeof(kSnapshotMagicV1)) == 0) {
+            return readSnapshotV1(data, length, origin, items, size);
+        }
+        if (std::memcmp(data, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+            return 0;
+        }
+        
+        Reader reader(data, length);
+        char magic[sizeof(kSnapshotMagic)];
+        uint32_t originLength;
+        std::string storedOrigin;
+        uint64_t count;
+        if (!reader.read(magic) || !reader.read(originLength) || !reader.read(storedOrigin, originLength) ||
+            !reader.read(count)) {
+            return 0;
+        }
+        
+        std::map<std::string, StorageItem> indexed;
+        size_t indexedSize = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t keyLength;
+            int64_t timestamp;
+            uint64_t valueOffset;
+            std::string key;
+            StorageItem item;
+            if (!reader.read(keyLength) || !reader.read(item.mappedLength) || !reader.read(timestamp) ||
+                !reader.read(valueOffset) || !reader.read(item.mappedChecksum) || !reader.read(key, keyLength) ||
+                valueOffset > length || length - valueOffset < item.mappedLength) {
+                return 0;
+            }
+            item.mappedValue = data + valueOffset;
+            item.timestamp = timeFromSeconds(timestamp);
+            putItem(indexed, indexedSize, key, std::move(item));
+        }
+        
+        uint32_t checksum;
+        size_t indexLength = reader.offset();
+        if (!reader.read(checksum) || fnv1a(data, indexLength) != checksum) {
+            return 0;
+        }
+        if (storedOrigin != origin) {
+            return -1;
+        }
+        items.swap(indexed);
+        size = indexedSize;
+        return 1;
+    }
+
+    // Apply the log's records to items, up to the first one that is
+    // incomplete or damaged; returns where that is. Replaying records the
+    // snapshot already has leaves the same items, so a crash between
+    // writing a snapshot and emptying the log loses nothing.
+    size_t replayLog(const std::vector<uint8_t>& data, std::map<std::string, StorageItem>& items, size_t& size) {
+        size_t offset = 0;
+        while (data.size() - offset >= kRecordHeaderSize) {
+            uint32_t payloadLength, checksum;
+            std::memcpy(&payloadLength, &data[offset], sizeof(payloadLength));
+            std::memcpy(&checksum, &data[offset + sizeof(payloadLength)], sizeof(checksum));
+            if (payloadLength < kPayloadHeaderSize || data.size() - offset - kRecordHeaderSize < payloadLength) {
+                break;
+            }
+            
+            const uint8_t* payload = &data[offset + kRecordHeaderSize];
+            if (fnv1a(payload, payloadLength) != checksum) {
+                break;
+            }
+            
+            Reader reader(payload, payloadLength);
+            uint8_t op;
+            int64_t timestamp;
+            uint32_t keyLength;
+            std::string key, value;
+            if (!reader.read(op) || !reader.read(timestamp) || !reader.read(keyLength) ||
+                !reader.read(key, keyLength) || !reader.read(value, payloadLength - reader.offset())) {
+                break;
+            }
+            
+            if (op == OP_SET) {
+                StorageItem item;
+                item.value = std::move(value);
+                item.timestamp = timeFromSeconds(timestamp);
+                putItem(items, size, key, std::move(item));
+            } else if (op == OP_REMOVE) {
+                dropItem(items, size, key);
+            } else if (op == OP_CLEAR) {
+                items.clear();
+                size = 0;
+            } else {
+                break;
+            }
+            offset += kRecordHeaderSize + payloadLength;
+        }
+        return offset;
+    }
 }
 
+// Read-only mapping of a snapshot file. Snapshots are replaced by renaming
+// a new file over them, never written in place.
+class StorageArea::MappedSnapshot {
+public:
+    explicit MappedSnapshot(const std::string& path) {
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+            return;
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) {
+            return;
+        }
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        m_size = m_data ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                m_data = static_cast<const uint8_t*>(data);
+                m_size = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedSnapshot() {
+#ifdef _WIN32
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+        if (m_data) {
+            ::munmap(const_cast<uint8_t*>(m_data), m_size);
+        }
+#endif
+    }
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
 //-----------------------------------------------------------------------------
 // StorageArea Implementation
 //-----------------------------------------------------------------------------
@@ -248,76 +639,134 @@ namespace {
 StorageArea::StorageArea(const security::Origin& origin)
     : m_origin(origin)
     , m_size(0)
+    , m_changeCount(0)
+    , m_journaled(false)
+    , m_log(nullptr)
+    , m_logSize(0)
 {
 }
 
 StorageArea::~StorageArea() {
+    commit();
+    
+    std::lock_guard<std::mutex> commitLock(m_commitMutex);
+    closeLogLocked();
 }
 
 std::string StorageArea::getItem(const std::string& key) const {
     std::lock_guard<std::mutex> lock(m_mutex);
     
     auto it = m_items.find(key);
-    if (it != m_items.end()) {
-        // Update access timestamp
-        const_cast<StorageItem&>(it->second).timestamp = std::chrono::system_clock::now();
-        return it->second.value;
+    if (it == m_items.end()) {
+        return "";
     }
     
-    return "";
+    // Update access timestamp
+    StorageItem& item = const_cast<StorageItem&>(it->second);
+    item.timestamp = std::chrono::system_clock::now();
+    if (!item.mappedValue) {
+        return item.value;
+    }
+    
+    // Only the snapshot's index was checked when it was loaded
+    if (fnv1a(item.mappedValue, item.mappedLength) != item.mappedChecksum) {
+        std::cerr << "Damaged storage value for key: " << key << std::endl;
+        return "";
+    }
+    return std::string(reinterpret_cast<const char*>(item.mappedValue), item.mappedLength);
 }
 
 bool StorageArea::setItem(const std::string& key, const std::string& value) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    // Check if updating an existing item
-    auto it = m_items.find(key);
-    if (it != m_items.end()) {
-        // Calculate size change
-        size_t oldSize = it->first.size() + it->second.value.size();
-        size_t newSize = key.size() + value.size();
-        
-        // Update the item
-        it->second.value = value;
-        it->second.timestamp = std::chrono::system_clock::now();
+    ChangeCallback changeCallback;
+    bool backlog = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
         
-        // Update total size
-        m_size = m_size - oldSize + newSize;
+        // Check if updating an existing item
+        auto it = m_items.find(key);
+        if (it != m_items.end()) {
+            // Calculate size change
+            size_t oldSize = it->first.size() + it->second.length();
+            size_t newSize = key.size() + value.size();
+            
+            // Update the item
+            it->second.value = value;
+            it->second.mappedValue = nullptr;
+            it->second.timestamp = std::chrono::system_clock::now();
+            
+            // Update total size
+            m_size = m_size - oldSize + newSize;
+        }
+        else {
+            // Add new item
+            m_items.emplace(key, StorageItem(value));
+            
+            // Update total size
+            m_size += (key.size() + value.size());
+        }
+        m_changeCount++;
         
-        return true;
+        if (logChangeLocked(OP_SET, key, value)) {
+            changeCallback = m_changeCallback;
+            backlog = m_pending.size() >= commitBacklogBytes;
+        }
     }
-    else {
-        // Add new item
-        StorageItem item(key, value);
-        m_items[key] = item;
-        
-        // Update total size
-        m_size += (key.size() + value.size());
-        
-        return true;
+    
+    if (changeCallback) {
+        changeCallback(backlog);
     }
+    return true;
 }
 
 bool StorageArea::removeItem(const std::string& key) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    auto it = m_items.find(key);
-    if (it != m_items.end()) {
+    ChangeCallback changeCallback;
+    bool backlog = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        auto it = m_items.find(key);
+        if (it == m_items.end()) {
+            return false;
+        }
+        
         // Subtract size of removed item
-        m_size -= (it->first.size() + it->second.value.size());
+        m_size -= (it->first.size() + it->second.length());
         
         // Remove item
         m_items.erase(it);
-        return true;
+        m_changeCount++;
+        
+        if (logChangeLocked(OP_REMOVE, key, "")) {
+            changeCallback = m_changeCallback;
+            backlog = m_pending.size() >= commitBacklogBytes;
+        }
     }
     
-    return false;
+    if (changeCallback) {
+        changeCallback(backlog);
+    }
+    return true;
 }
 
 void StorageArea::clear() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_items.clear();
-    m_size = 0;
+    ChangeCallback changeCallback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_items.clear();
+        m_size = 0;
+        m_changeCount++;
+        
+        // Nothing logged before the clear matters any more
+        bool hadPending = !m_pending.empty();
+        m_pending.clear();
+        if (logChangeLocked(OP_CLEAR, "", "") && !hadPending) {
+            changeCallback = m_changeCallback;
+        }
+    }
+    
+    if (changeCallback) {
+        changeCallback(false);
+    }
 }
 
 size_t StorageArea::length() const {
@@ -342,141 +791,305 @@ bool StorageArea::contains(const std::string& key) const {
     return m_items.find(key) != m_items.end();
 }
 
-void StorageArea::updateSize() {
-    m_size = 0;
-    for (const auto& item : m_items) {
-        m_size += (item.first.size() + item.second.value.size());
-    }
+bool StorageArea::hasUncommittedChanges() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_pending.empty();
+}
+
+size_t StorageArea::uncommittedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending.size();
 }
 
-bool StorageArea::saveToFile(const std::string& filePath) const {
+void StorageArea::setChangeCallback(ChangeCallback callback) {
     std::lock_guard<std::mutex> lock(m_mutex);
+    m_changeCallback = std::move(callback);
+}
+
+uint64_t StorageArea::logSize() const {
+    std::lock_guard<std::mutex> commitLock(m_commitMutex);
+    return m_logSize;
+}
+
+bool StorageArea::logChangeLocked(uint8_t op, const std::string& key, const std::string& value) {
+    if (!m_journaled) {
+        return false;
+    }
+    
+    bool first = m_pending.empty();
+    size_t start = m_pending.size();
+    bool backlogBefore = start >= commitBacklogBytes;
+    uint32_t payloadLength = static_cast<uint32_t>(kPayloadHeaderSize + key.size() + value.size());
+    
+    appendValue<uint32_t>(m_pending, payloadLength);
+    appendValue<uint32_t>(m_pending, 0); // Checksum, filled in below
+    appendValue<uint8_t>(m_pending, op);
+    appendValue<int64_t>(m_pending, secondsFromTime(std::chrono::system_clock::now()));
+    appendValue<uint32_t>(m_pending, static_cast<uint32_t>(key.size()));
+    appendBytes(m_pending, key);
+    appendBytes(m_pending, value);
+    
+    uint32_t checksum = fnv1a(&m_pending[start + kRecordHeaderSize], payloadLength);
+    std::memcpy(&m_pending[start + sizeof(uint32_t)], &checksum, sizeof(checksum));
+    return first || (!backlogBefore && m_pending.size() >= commitBacklogBytes);
+}
+
+bool StorageArea::saveToFile(const std::string& filePath) {
+    std::lock_guard<std::mutex> commitLock(m_commitMutex);
+    if (filePath == m_path) {
+        return commitLocked();
+    }
+    
+    // Log to the new path from a snapshot of everything
+    commitLocked();
+    closeLogLocked();
+    m_path = filePath;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.clear();
+        m_journaled = true;
+    }
+    return compactLocked();
+}
+
+bool StorageArea::loadFromFile(const std::string& filePath) {
+    std::lock_guard<std::mutex> commitLock(m_commitMutex);
     
     try {
-        // Create output file
-        std::ofstream file(filePath);
-        if (!file.is_open()) {
+        std::map<std::string, StorageItem> items;
+        size_t size = 0;
+        std::string origin = m_origin.toString();
+        bool found = false;
+        int result = 0;
+        
+        // The snapshot, or the JSON file of older versions
+        std::unique_ptr<MappedSnapshot> snapshot;
+        std::string snapshotPath = filePath + ".snapshot";
+        if (fs::exists(snapshotPath)) {
+            snapshot = std::make_unique<MappedSnapshot>(snapshotPath);
+            result = snapshot->data() ? readSnapshot(snapshot->data(), snapshot->size(), origin, items, size) : 0;
+            if (result == 0) {
+                std::cerr << "Damaged storage snapshot: " << snapshotPath << std::endl;
+            }
+        } else {
+            result = readLegacyJson(filePath + ".json", origin, items, size);
+        }
+        if (result < 0) {
+            std::cerr << "Origin mismatch in storage file: " << filePath << std::endl;
             return false;
         }
+        found = result > 0;
         
-        // Create JSON structure manually
-        file << "{\n";
-        file << "    \"origin\": \"" << escapeJsonString(m_origin.toString()) << "\",\n";
-        file << "    \"items\": [\n";
-        
-        size_t itemCount = 0;
-        for (const auto& item : m_items) {
-            file << "        {\n";
-            file << "            \"key\": \"" << escapeJsonString(item.first) << "\",\n";
-            file << "            \"value\": \"" << escapeJsonString(item.second.value) << "\",\n";
-            
-            // Store timestamp
-            auto timestamp = std::chrono::system_clock::to_time_t(item.second.timestamp);
-            file << "            \"timestamp\": " << timestamp << "\n";
-            
-            file << "        }";
-            
-            if (++itemCount < m_items.size()) {
-                file << ",";
+        // Then what changed after it. A record cut short by a crash is
+        // dropped, so the next one is appended after the last whole one.
+        uint64_t logSize = 0;
+        std::string logPath = filePath + ".log";
+        std::vector<uint8_t> data;
+        if (readWholeFile(logPath, data)) {
+            logSize = replayLog(data, items, size);
+            if (logSize < data.size()) {
+                std::cerr << "Dropping incomplete storage log records: " << logPath << std::endl;
+                fs::resize_file(logPath, logSize);
             }
-            file << "\n";
+            found = found || logSize > 0;
         }
         
-        file << "    ]\n";
-        file << "}\n";
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_items.swap(items);
+            m_size = size;
+            m_changeCount++;
+            m_snapshots.clear();
+            if (result > 0) {
+                m_snapshots.push_back(std::move(snapshot));
+            }
+            m_pending.clear();
+            m_journaled = true;
+        }
+        closeLogLocked();
+        m_path = filePath;
+        m_logSize = logSize;
         
-        return true;
+        return found;
     }
     catch (const std::exception& e) {
-        std::cerr << "Error saving storage: " << e.what() << std::endl;
+        std::cerr << "Error loading storage: " << e.what() << std::endl;
         return false;
     }
 }
 
-bool StorageArea::loadFromFile(const std::string& filePath) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+bool StorageArea::commit() {
+    std::lock_guard<std::mutex> commitLock(m_commitMutex);
+    return commitLocked();
+}
+
+bool StorageArea::commitLocked() {
+    // Writes made from here on wait for the next commit
+    std::vector<uint8_t> pending;
+    size_t dataSize;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending.swap(m_pending);
+        dataSize = m_size;
+    }
+    if (m_path.empty()) {
+        return true;
+    }
     
-    try {
-        // Check if file exists
-        if (!fs::exists(filePath)) {
+    if (!pending.empty()) {
+        if ((!m_log && !openLogLocked(false)) ||
+            std::fwrite(pending.data(), 1, pending.size(), m_log) != pending.size() || !syncFile(m_log)) {
+            std::cerr << "Error committing storage: " << m_path << std::endl;
+            
+            // Cut off whatever part made it, and keep the records for the
+            // next commit
+            closeLogLocked();
+            std::error_code ignored;
+            fs::resize_file(m_path + ".log", m_logSize, ignored);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            pending.insert(pending.end(), m_pending.begin(), m_pending.end());
+            m_pending.swap(pending);
             return false;
         }
-        
-        // Read file content
-        std::ifstream file(filePath);
-        if (!file.is_open()) {
-            return false;
+        m_logSize += pending.size();
+    }
+    
+    // Fold a log that outgrew the data into a new snapshot
+    if (m_logSize >= kMinCompactLogSize && m_logSize > 2 * static_cast<uint64_t>(dataSize)) {
+        return compactLocked();
+    }
+    return true;
+}
+
+bool StorageArea::compact() {
+    std::lock_guard<std::mutex> commitLock(m_commitMutex);
+    if (m_path.empty()) {
+        return false;
+    }
+    commitLocked();
+    return compactLocked();
+}
+
+bool StorageArea::compactLocked() {
+    if (!writeSnapshotLocked()) {
+        return false;
+    }
+    
+    // The snapshot has everything the log had
+    closeLogLocked();
+    return openLogLocked(true);
+}
+
+bool StorageArea::writeSnapshotLocked() {
+    // Changes made after this are pending, not in the log, so the snapshot
+    // and the emptied log agree
+    std::vector<uint8_t> data(kSnapshotMagic, kSnapshotMagic + sizeof(kSnapshotMagic));
+    std::vector<uint32_t> checksums;
+    uint64_t changeCount;
+    size_t indexLength;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        changeCount = m_changeCount;
+        std::string origin = m_origin.toString();
+        indexLength = data.size() + sizeof(uint32_t) + origin.size() + sizeof(uint64_t) + sizeof(uint32_t);
+        for (const auto& item : m_items) {
+            indexLength += kIndexEntryHeaderSize + item.first.size();
         }
+        data.reserve(indexLength + m_size);
+        checksums.reserve(m_items.size());
         
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        std::string jsonContent = buffer.str();
-        
-        // Parse JSON manually
-        std::map<std::string, std::string> jsonObj = parseJsonObject(jsonContent);
-        
-        // Verify origin matches
-        auto originIt = jsonObj.find("origin");
-        if (originIt == jsonObj.end() || originIt->second != "\"" + m_origin.toString() + "\"") {
-            std::cerr << "Origin mismatch in storage file: " << filePath << std::endl;
-            return false;
+        // The index, then the values in the same order
+        appendValue<uint32_t>(data, static_cast<uint32_t>(origin.size()));
+        appendBytes(data, origin);
+        appendValue<uint64_t>(data, m_items.size());
+        uint64_t valueOffset = indexLength;
+        for (const auto& item : m_items) {
+            size_t length = item.second.length();
+            checksums.push_back(item.second.mappedValue ? item.second.mappedChecksum
+                                                        : fnv1a(valueBytes(item.second), length));
+            appendValue<uint32_t>(data, static_cast<uint32_t>(item.first.size()));
+            appendValue<uint32_t>(data, static_cast<uint32_t>(length));
+            appendValue<int64_t>(data, secondsFromTime(item.second.timestamp));
+            appendValue<uint64_t>(data, valueOffset);
+            appendValue<uint32_t>(data, checksums.back());
+            appendBytes(data, item.first);
+            valueOffset += length;
         }
-        
-        // Clear existing items
-        m_items.clear();
-        
-        // Load items
-        auto items = parseJsonArray(jsonContent, "items");
-        for (const auto& itemObj : items) {
-            StorageItem item;
-            
-            // Get key
-            auto keyIt = itemObj.find("key");
-            if (keyIt != itemObj.end()) {
-                // Remove quotes
-                std::string keyStr = keyIt->second;
-                if (keyStr.size() >= 2 && keyStr.front() == '\"' && keyStr.back() == '\"') {
-                    item.key = unescapeJsonString(keyStr.substr(1, keyStr.size() - 2));
-                }
-            }
-            
-            // Get value
-            auto valueIt = itemObj.find("value");
-            if (valueIt != itemObj.end()) {
-                // Remove quotes
-                std::string valueStr = valueIt->second;
-                if (valueStr.size() >= 2 && valueStr.front() == '\"' && valueStr.back() == '\"') {
-                    item.value = unescapeJsonString(valueStr.substr(1, valueStr.size() - 2));
-                }
-            }
-            
-            // Get timestamp if present
-            auto timestampIt = itemObj.find("timestamp");
-            if (timestampIt != itemObj.end()) {
-                try {
-                    std::time_t timestamp = std::stoll(timestampIt->second);
-                    item.timestamp = std::chrono::system_clock::from_time_t(timestamp);
-                } catch (const std::exception&) {
-                    // Use current time if parsing fails
-                    item.timestamp = std::chrono::system_clock::now();
-                }
-            }
-            
-            // Add item to storage
-            if (!item.key.empty()) {
-                m_items[item.key] = item;
+        appendValue<uint32_t>(data, fnv1a(data.data(), data.size()));
+        for (const auto& item : m_items) {
+            const uint8_t* value = valueBytes(item.second);
+            data.insert(data.end(), value, value + item.second.length());
+        }
+    }
+    
+    // Written aside and renamed over the old one, so there always is one
+    // whole snapshot
+    std::string tempPath = m_path + ".snapshot.tmp";
+    std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Error saving storage: " << tempPath << std::endl;
+        return false;
+    }
+    bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size() && syncFile(file);
+    std::fclose(file);
+    
+    std::error_code error;
+    if (written) {
+        fs::rename(tempPath, m_path + ".snapshot", error);
+    }
+    if (!written || error) {
+        std::cerr << "Error saving storage: " << m_path << ".snapshot" << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    
+    fs::path directory = fs::path(m_path).parent_path();
+    syncDirectory(directory.empty() ? "." : directory.string());
+    
+    // If nothing changed meanwhile, values can be read from the new
+    // snapshot, letting go of the memory and mappings they were in
+    auto snapshot = std::make_unique<MappedSnapshot>(m_path + ".snapshot");
+    if (snapshot->size() == data.size()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_changeCount == changeCount) {
+            const uint8_t* value = snapshot->data() + indexLength;
+            size_t index = 0;
+            for (auto& item : m_items) {
+                item.second.mappedLength = static_cast<uint32_t>(item.second.length());
+                item.second.mappedChecksum = checksums[index++];
+                item.second.mappedValue = value;
+                std::string().swap(item.second.value);
+                value += item.second.mappedLength;
             }
+            m_snapshots.clear();
+            m_snapshots.push_back(std::move(snapshot));
         }
-        
-        // Update size
-        updateSize();
-        
-        return true;
     }
-    catch (const std::exception& e) {
-        std::cerr << "Error loading storage: " << e.what() << std::endl;
+    
+    // The JSON file of older versions is superseded
+    fs::remove(m_path + ".json", error);
+    return true;
+}
+
+bool StorageArea::openLogLocked(bool truncate) {
+    std::string logPath = m_path + ".log";
+    m_log = std::fopen(logPath.c_str(), truncate ? "wb" : "ab");
+    if (!m_log) {
+        std::cerr << "Error opening storage log: " << logPath << std::endl;
         return false;
     }
+    if (truncate) {
+        m_logSize = 0;
+        return syncFile(m_log);
+    }
+    return true;
+}
+
+void StorageArea::closeLogLocked() {
+    if (m_log) {
+        std::fclose(m_log);
+        m_log = nullptr;
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -485,14 +1098,100 @@ bool StorageArea::loadFromFile(const std::string& filePath) {
 
 StorageManager::StorageManager()
     : m_quotaPerOrigin(5 * 1024 * 1024) // Default 5MB per origin
+    , m_commitInterval(100)
+    , m_flushNow(false)
+    , m_stopping(false)
 {
+    m_commitThread = std::thread(&StorageManager::runCommits, this);
 }
 
 StorageManager::~StorageManager() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        
+        // Areas still held elsewhere stop reporting to this manager
+        for (const auto& entry : m_storageAreas) {
+            entry.second->setChangeCallback(nullptr);
+        }
+    }
+    m_commitCondition.notify_all();
+    m_commitThread.join();
+    
     // Persist all storage on shutdown
+    for (const auto& storageArea : m_clearedAreas) {
+        storageArea->compact();
+    }
     persistAllStorage();
 }
 
+void StorageManager::setCommitInterval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_commitInterval = interval;
+}
+
+void StorageManager::flushSoon() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& entry : m_storageAreas) {
+        if (entry.second->hasUncommittedChanges()) {
+            m_changedAreas.insert(entry.second);
+        }
+    }
+    m_flushNow = true;
+    m_commitCondition.notify_all();
+}
+
+void StorageManager::runCommits() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_commitCondition.wait(lock, [this] {
+            return m_stopping || !m_changedAreas.empty() || !m_clearedAreas.empty();
+        });
+        if (m_stopping) {
+            return;
+        }
+        
+        // Let the writes that follow join this commit, unless it's wanted now
+        m_commitCondition.wait_for(lock, m_commitInterval, [this] { return m_stopping || m_flushNow; });
+        m_flushNow = false;
+        std::set<std::shared_ptr<StorageArea>> changedAreas;
+        std::set<std::shared_ptr<StorageArea>> clearedAreas;
+        changedAreas.swap(m_changedAreas);
+        clearedAreas.swap(m_clearedAreas);
+        lock.unlock();
+        
+        for (const auto& storageArea : changedAreas) {
+            if (!clearedAreas.count(storageArea)) {
+                storageArea->commit();
+            }
+        }
+        
+        // Cleared data goes from the disk too, not only from the log's view
+        for (const auto& storageArea : clearedAreas) {
+            storageArea->compact();
+        }
+        changedAreas.clear();
+        clearedAreas.clear();
+        lock.lock();
+    }
+}
+
+void StorageManager::watchChanges(const std::shared_ptr<StorageArea>& storageArea) {
+    std::weak_ptr<StorageArea> weakArea = storageArea;
+    storageArea->setChangeCallback([this, weakArea](bool backlog) {
+        std::shared_ptr<StorageArea> changedArea = weakArea.lock();
+        if (!changedArea) {
+            return;
+        }
+        
+        // A backlog is committed without waiting out the interval
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_changedAreas.insert(changedArea);
+        m_flushNow = m_flushNow || backlog;
+        m_commitCondition.notify_all();
+    });
+}
+
 bool StorageManager::initialize(const std::string& storageDirectory) {
     m_storageDir = storageDirectory;
     
@@ -502,20 +1201,18 @@ bool StorageManager::initialize(const std::string& storageDirectory) {
         return false;
     }
     
-    // Try to load existing storage areas
+    // Note which origins have storage; each is loaded on first access
     try {
+        std::set<std::string> filenames;
         for (const auto& entry : fs::directory_iterator(m_storageDir)) {
-            if (entry.is_regular_file() && entry.path().extension() == ".json") {
-                // Extract origin from filename
-                std::string filename = entry.path().stem().string();
-                
-                // Simple origin extraction from filename (in practice, this would be more robust)
-                security::Origin origin(filename);
-                
-                // Load storage area
-                loadStorageArea(origin);
+            std::string extension = entry.path().extension().string();
+            if (entry.is_regular_file() && (extension == ".snapshot" || extension == ".log" || extension == ".json")) {
+                filenames.insert(entry.path().stem().string());
             }
         }
+        
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_storedFiles.swap(filenames);
     }
     catch (const std::exception& e) {
         std::cerr << "Error scanning storage directory: " << e.what() << std::endl;
@@ -528,70 +1225,73 @@ bool StorageManager::initialize(const std::string& storageDirectory) {
 std::shared_ptr<StorageArea> StorageManager::getStorageArea(const security::Origin& origin) {
     std::lock_guard<std::mutex> lock(m_mutex);
     
-    std::string originStr = origin.toString();
-    
     // Check if we already have this storage area
-    auto it = m_storageAreas.find(originStr);
+    auto it = m_storageAreas.find(origin);
     if (it != m_storageAreas.end()) {
         return it->second;
     }
     
-    // Create new storage area
-    auto storageArea = std::make_shared<StorageArea>(origin);
-    
-    // Try to load existing data from disk
-    std::string filePath = getStorageFilePath(origin);
-    storageArea->loadFromFile(filePath);
+    // Load what is on disk, or create new storage area
+    auto storageArea = loadStorageArea(origin);
     
     // Store in map
-    m_storageAreas[originStr] = storageArea;
+    m_storageAreas[origin] = storageArea;
     
     return storageArea;
 }
 
 bool StorageManager::hasStorageArea(const security::Origin& origin) const {
     std::lock_guard<std::mutex> lock(m_mutex);
-    return m_storageAreas.find(origin.toString()) != m_storageAreas.end();
+    return m_storageAreas.find(origin) != m_storageAreas.end() ||
+           m_storedFiles.count(getStorageFileName(origin)) > 0;
 }
 
 bool StorageManager::clearOriginStorage(const security::Origin& origin) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    std::string originStr = origin.toString();
-    
-    // Check if we have this storage area
-    auto it = m_storageAreas.find(originStr);
-    if (it != m_storageAreas.end()) {
-        // Clear storage area
-        it->second->clear();
-        
-        // Remove storage file
-        std::string filePath = getStorageFilePath(origin);
-        try {
-            if (fs::exists(filePath)) {
-                fs::remove(filePath);
+    std::shared_ptr<StorageArea> storageArea;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        
+        // Check if we have this storage area
+        auto it = m_storageAreas.find(origin);
+        if (it == m_storageAreas.end()) {
+            // Storage never loaded is removed without reading it
+            if (!m_storedFiles.erase(getStorageFileName(origin))) {
+                return false;
             }
+            std::error_code ignored;
+            std::string filePath = getStorageFilePath(origin);
+            for (const char* extension : { ".snapshot", ".log", ".json" }) {
+                fs::remove(filePath + extension, ignored);
+            }
+            return true;
         }
-        catch (const std::exception& e) {
-            std::cerr << "Error removing storage file: " << e.what() << std::endl;
-            return false;
-        }
-        
-        return true;
+        storageArea = it->second;
+    }
+    
+    // Clear storage area; the background thread replaces its files with an
+    // empty snapshot and log
+    storageArea->clear();
+    if (!m_storageDir.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_clearedAreas.insert(storageArea);
+        m_commitCondition.notify_all();
     }
     
-    return false;
+    return true;
 }
 
 bool StorageManager::persistAllStorage() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::pair<security::Origin, std::shared_ptr<StorageArea>>> storageAreas;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        storageAreas.assign(m_storageAreas.begin(), m_storageAreas.end());
+    }
     
+    // Only what changed since the last commit is written
     bool success = true;
-    
-    for (const auto& [originStr, storageArea] : m_storageAreas) {
-        std::string filePath = getStorageFilePath(storageArea->origin());
-        if (!storageArea->saveToFile(filePath)) {
-            std::cerr << "Failed to save storage for origin: " << originStr << std::endl;
+    for (const auto& [origin, storageArea] : storageAreas) {
+        if (!storageArea->commit()) {
+            std::cerr << "Failed to save storage for origin: " << origin.toString() << std::endl;
             success = false;
         }
     }
@@ -603,10 +1303,21 @@ size_t StorageManager::getTotalStorageSize() const {
     std::lock_guard<std::mutex> lock(m_mutex);
     
     size_t totalSize = 0;
-    for (const auto& [originStr, storageArea] : m_storageAreas) {
+    for (const auto& [origin, storageArea] : m_storageAreas) {
         totalSize += storageArea->size();
     }
     
+    // Origins not loaded yet are estimated from their files
+    for (const std::string& filename : m_storedFiles) {
+        std::error_code error;
+        for (const char* extension : { ".snapshot", ".log", ".json" }) {
+            uint64_t fileSize = fs::file_size(m_storageDir + "/" + filename + extension, error);
+            if (!error) {
+                totalSize += static_cast<size_t>(fileSize);
+            }
+        }
+    }
+    
     return totalSize;
 }
 
@@ -614,6 +1325,10 @@ std::string StorageManager::getStorageFilePath(const security::Origin& origin) c
     // Create a filename from the origin
     // In a real implementation, we'd need to properly encode the origin
     
+    return m_storageDir + "/" + getStorageFileName(origin);
+}
+
+std::string StorageManager::getStorageFileName(const security::Origin& origin) const {
     // Convert origin to safe filename
     std::string filename = origin.toString();
     
@@ -621,7 +1336,7 @@ std::string StorageManager::getStorageFilePath(const security::Origin& origin) c
     std::replace(filename.begin(), filename.end(), ':', '_');
     std::replace(filename.begin(), filename.end(), '/', '_');
     
-    return m_storageDir + "/" + filename + ".json";
+    return filename;
 }
 
 bool StorageManager::ensureDirectoryExists(const std::string& directory) const {
@@ -640,33 +1355,25 @@ bool StorageManager::ensureDirectoryExists(const std::string& directory) const {
     }
 }
 
-bool StorageManager::loadStorageArea(const security::Origin& origin) {
-    std::string filePath = getStorageFilePath(origin);
-    
-    // Check if file exists
-    if (!fs::exists(filePath)) {
-        return false;
-    }
-    
+std::shared_ptr<StorageArea> StorageManager::loadStorageArea(const security::Origin& origin) {
     // Create storage area
     auto storageArea = std::make_shared<StorageArea>(origin);
-    
-    // Load from file
-    if (!storageArea->loadFromFile(filePath)) {
-        return false;
+    if (m_storageDir.empty()) {
+        return storageArea;
     }
     
-    // Add to map
-    m_storageAreas[origin.toString()] = storageArea;
+    // Load what is on disk, and log changes there
+    std::string filename = getStorageFileName(origin);
+    m_storedFiles.erase(filename);
+    storageArea->loadFromFile(m_storageDir + "/" + filename);
+    watchChanges(storageArea);
     
-    return true;
+    return storageArea;
 }
 
 bool StorageManager::saveStorageArea(const security::Origin& origin) {
-    std::string originStr = origin.toString();
-    
     // Check if we have this storage area
-    auto it = m_storageAreas.find(originStr);
+    auto it = m_storageAreas.find(origin);
     if (it == m_storageAreas.end()) {
         return false;
     }
@@ -3,11 +3,17 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <unordered_map>
 #include <chrono>
 #include <memory>
 #include <functional>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
 #include "../security/same_origin.h"
 
 namespace browser {
@@ -17,18 +23,31 @@ namespace storage {
 class StorageArea;
 class StorageManager;
 
-// Local Storage item
+// Local Storage item, kept under its key. A value loaded from a snapshot
+// is left in the snapshot's mapping and only copied out when it is read.
 struct StorageItem {
-    std::string key;
     std::string value;
     std::chrono::system_clock::time_point timestamp;
+    const uint8_t* mappedValue;    // Set while the value is only in the snapshot
+    uint32_t mappedLength;
+    uint32_t mappedChecksum;
 
-    StorageItem() : timestamp(std::chrono::system_clock::now()) {}
-    StorageItem(const std::string& k, const std::string& v) 
-        : key(k), value(v), timestamp(std::chrono::system_clock::now()) {}
+    StorageItem()
+        : timestamp(std::chrono::system_clock::now()), mappedValue(nullptr), mappedLength(0), mappedChecksum(0) {}
+    explicit StorageItem(const std::string& v)
+        : value(v), timestamp(std::chrono::system_clock::now()), mappedValue(nullptr), mappedLength(0), mappedChecksum(0) {}
+
+    // Length of the value, wherever it is
+    size_t length() const { return mappedValue ? mappedLength : value.size(); }
 };
 
-// Storage Area for a specific origin
+// Storage Area for a specific origin. Once loaded from (or saved to) a
+// path, each change is appended to an operation log there (path + ".log")
+// when it is committed, so a write costs disk space and time in proportion
+// to its own size. The log is folded into a binary snapshot
+// (path + ".snapshot") once it outgrows the data. Loading maps the
+// snapshot and reads only its index of keys; values are read from the
+// mapping by getItem.
 class StorageArea {
 public:
     StorageArea(const security::Origin& origin);
@@ -46,21 +65,74 @@ public:
     // Get the associated origin
     const security::Origin& origin() const { return m_origin; }
 
-    // Get the total size of data stored (in bytes)
+    // Get the total size of keys and values stored (in bytes), kept up to
+    // date by each change
     size_t size() const { return m_size; }
 
-    // Serialize and deserialize the storage area
-    bool saveToFile(const std::string& filePath) const;
+    // Load the snapshot and replay the log after it, dropping a record
+    // torn by a crash; a legacy JSON file (path + ".json") is read if
+    // there is no snapshot. Later changes are logged to path either way,
+    // unless the stored origin doesn't match. False if nothing was stored.
     bool loadFromFile(const std::string& filePath);
 
+    // Commit the changes not yet on disk; to a new path, write a snapshot
+    // there first and log to it from then on
+    bool saveToFile(const std::string& filePath);
+
+    // Append the changes made since the last commit to the log and sync it
+    bool commit();
+
+    // Write a snapshot of everything and empty the log
+    bool compact();
+
+    // Changes made but not yet committed
+    bool hasUncommittedChanges() const;
+    size_t uncommittedBytes() const;
+
+    // Uncommitted bytes past which they should be committed without delay
+    static constexpr size_t commitBacklogBytes = 1024 * 1024;
+
+    // Called, outside the area's lock, when a change is made while none
+    // were waiting to be committed, and with backlog set once the changes
+    // waiting pass commitBacklogBytes
+    using ChangeCallback = std::function<void(bool backlog)>;
+    void setChangeCallback(ChangeCallback callback);
+
+    // Bytes in the log file
+    uint64_t logSize() const;
+
 private:
+    class MappedSnapshot;
+
     security::Origin m_origin;
     std::map<std::string, StorageItem> m_items; // Using map for ordered keys
     size_t m_size; // Total size in bytes
     mutable std::mutex m_mutex;
 
-    // Update size calculation after storage changes
-    void updateSize();
+    // Snapshots that items' mapped values point into, and a count of
+    // changes to tell whether items still match a snapshot being written;
+    // guarded by m_mutex
+    std::vector<std::unique_ptr<MappedSnapshot>> m_snapshots;
+    uint64_t m_changeCount;
+
+    // Log records of changes not yet committed, and what to call when the
+    // first one arrives; guarded by m_mutex
+    std::vector<uint8_t> m_pending;
+    ChangeCallback m_changeCallback;
+    bool m_journaled;          // Set once there is a log to write to
+    bool logChangeLocked(uint8_t op, const std::string& key, const std::string& value);
+
+    // Where the log and snapshot are (empty until loaded or saved), and the
+    // open log; guarded by m_commitMutex, which is taken before m_mutex
+    mutable std::mutex m_commitMutex;
+    std::string m_path;
+    std::FILE* m_log;
+    uint64_t m_logSize;
+    bool commitLocked();
+    bool openLogLocked(bool truncate);
+    void closeLogLocked();
+    bool writeSnapshotLocked();
+    bool compactLocked();
 };
 
 // Storage Manager - handles multiple storage areas
@@ -69,34 +141,51 @@ public:
     StorageManager();
     ~StorageManager();
 
-    // Initialize with storage directory
+    // Initialize with storage directory. Only the names of the files there
+    // are read; an origin's data is loaded when it is first asked for.
     bool initialize(const std::string& storageDirectory);
 
-    // Get storage area for origin (creates if doesn't exist)
+    // Get storage area for origin (loads or creates it if needed)
     std::shared_ptr<StorageArea> getStorageArea(const security::Origin& origin);
 
-    // Check if origin has storage area
+    // Check if origin has storage area, loaded or on disk
     bool hasStorageArea(const security::Origin& origin) const;
 
     // Clear all storage for origin
     bool clearOriginStorage(const security::Origin& origin);
 
-    // Persist all storage to disk
+    // Commit every origin's uncommitted changes to disk, on the calling
+    // thread
     bool persistAllStorage();
 
+    // Have the background thread commit every origin's changes now rather
+    // than after the commit interval, without waiting for it
+    void flushSoon();
+
+    // Free what uncommitted changes hold in memory by committing them now
+    void onMemoryPressure() { flushSoon(); }
+
+    // How long changes wait to be committed, so that writes close together
+    // share one log append and sync. Storage calls never wait on the disk;
+    // the background thread does the writing.
+    void setCommitInterval(std::chrono::milliseconds interval);
+
     // Get/set storage quota per origin (in bytes)
     size_t getQuota() const { return m_quotaPerOrigin; }
     void setQuota(size_t bytes) { m_quotaPerOrigin = bytes; }
 
-    // Estimate total storage size
+    // Estimate total storage size; origins not loaded yet count the size of
+    // their files
     size_t getTotalStorageSize() const;
 
 private:
     // Storage areas by origin
-    std::unordered_map<std::string, std::shared_ptr<StorageArea>> m_storageAreas;
+    std::unordered_map<security::Origin, std::shared_ptr<StorageArea>> m_storageAreas;
     
-    // Storage directory on disk
+    // Storage directory on disk, and the names (without extension) of the
+    // files in it for origins not loaded yet
     std::string m_storageDir;
+    std::set<std::string> m_storedFiles;
     
     // Storage quota per origin (default: 5MB)
     size_t m_quotaPerOrigin;
@@ -104,10 +193,24 @@ private:
     // Mutex for thread safety
     mutable std::mutex m_mutex;
 
-    // Helper methods
+    // Background group commit of the areas with changes waiting; guarded
+    // by m_mutex
+    std::set<std::shared_ptr<StorageArea>> m_changedAreas;
+    std::set<std::shared_ptr<StorageArea>> m_clearedAreas;    // Compacted, not only committed
+    std::chrono::milliseconds m_commitInterval;
+    bool m_flushNow;
+    bool m_stopping;
+    std::condition_variable m_commitCondition;
+    std::thread m_commitThread;
+    void runCommits();
+    void watchChanges(const std::shared_ptr<StorageArea>& storageArea);
+
+    // Helper methods. The file path is that of the origin's snapshot and
+    // log without their extensions.
     std::string getStorageFilePath(const security::Origin& origin) const;
+    std::string getStorageFileName(const security::Origin& origin) const;
     bool ensureDirectoryExists(const std::string& directory) const;
-    bool loadStorageArea(const security::Origin& origin);
+    std::shared_ptr<StorageArea> loadStorageArea(const security::Origin& origin);
     bool saveStorageArea(const security::Origin& origin);
 };
 
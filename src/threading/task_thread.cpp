@@ -0,0 +1,92 @@
+#include "task_thread.h"
+#include "../tracing/alloc_tracker.h"
+
+namespace browser {
+namespace threading {
+
+//-----------------------------------------------------------------------------
+// TaskThread Implementation
+//-----------------------------------------------------------------------------
+
+TaskThread::TaskThread()
+    : m_running(false)
+    , m_stopping(false)
+    , m_thread(&TaskThread::run, this)
+{
+}
+
+TaskThread::~TaskThread() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void TaskThread::post(Task task) {
+#ifdef BROWSER_ALLOC_TRACKING
+    // Charge the task's allocations to the posting thread's subsystem
+    tracing::AllocTag tag = tracing::AllocTracker::currentTag();
+    task = [tag, inner = std::move(task)] {
+        tracing::ScopedAllocTag scope(tag);
+        inner();
+    };
+#endif
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+}
+
+size_t TaskThread::cancelPending() {
+    std::deque<Task> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cancelled.swap(m_tasks);
+    }
+    if (!cancelled.empty()) {
+        m_idle.notify_all();
+    }
+    // The tasks are destroyed outside the lock
+    return cancelled.size();
+}
+
+void TaskThread::waitIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return !m_running && m_tasks.empty(); });
+}
+
+bool TaskThread::idle() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_running && m_tasks.empty();
+}
+
+void TaskThread::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+            return;
+        }
+        
+        Task task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_running = true;
+        lock.unlock();
+        
+        task();
+        task = nullptr;
+        
+        lock.lock();
+        m_running = false;
+        if (m_tasks.empty()) {
+            m_idle.notify_all();
+        }
+    }
+}
+
+} // namespace threading
+} // namespace browser
@@ -0,0 +1,58 @@
+#ifndef BROWSER_TASK_THREAD_H
+#define BROWSER_TASK_THREAD_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace browser {
+namespace threading {
+
+// A thread of its own that runs posted tasks one at a time, in the order
+// they were posted. For work that must stay on one thread, like a
+// JavaScript engine, whose values aren't safe to share between threads.
+class TaskThread {
+public:
+    using Task = std::function<void()>;
+    
+    TaskThread();
+    
+    // Runs the tasks still queued, then joins the thread
+    ~TaskThread();
+    
+    TaskThread(const TaskThread&) = delete;
+    TaskThread& operator=(const TaskThread&) = delete;
+    
+    void post(Task task);
+    
+    // Drop the tasks that haven't started; returns how many
+    size_t cancelPending();
+    
+    // Wait until every task posted so far has run. Not from a task.
+    void waitIdle();
+    
+    // No task queued or running
+    bool idle() const;
+    
+    // Whether the calling thread is this one
+    bool isCurrent() const { return std::this_thread::get_id() == m_thread.get_id(); }
+    
+private:
+    void run();
+    
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<Task> m_tasks;
+    bool m_running;
+    bool m_stopping;
+    std::thread m_thread;   // Last, so it starts after the members above
+};
+
+} // namespace threading
+} // namespace browser
+
+#endif // BROWSER_TASK_THREAD_H
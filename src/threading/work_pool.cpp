@@ -0,0 +1,180 @@
+#include "work_pool.h"
+#include "../tracing/alloc_tracker.h"
+
+namespace browser {
+namespace threading {
+
+namespace {
+
+// The pool and queue index of the current thread, if it is a worker
+thread_local WorkPool* t_pool = nullptr;
+thread_local size_t t_queueIndex = 0;
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// WorkPool Implementation
+//-----------------------------------------------------------------------------
+
+WorkPool::WorkPool(size_t workerCount)
+    : m_queuedJobs(0)
+    , m_stopping(false)
+{
+    for (size_t i = 0; i <= workerCount; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&WorkPool::workerLoop, this, i);
+    }
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+WorkPool& WorkPool::shared() {
+    static WorkPool pool([] {
+        unsigned cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 0;
+    }());
+    return pool;
+}
+
+void WorkPool::push(Job job) {
+    // Workers keep their own tasks; everyone else uses the shared queue
+    Queue& queue = *m_queues[t_pool == this ? t_queueIndex : m_workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    m_queuedJobs.fetch_add(1);
+    
+    // Taking the lock orders this with a worker about to sleep
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_wake.notify_one();
+}
+
+bool WorkPool::takeJob(Job& job) {
+    auto takeBack = [&job](Queue& queue) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            return false;
+        }
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+        return true;
+    };
+    auto takeFront = [&job](Queue& queue) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            return false;
+        }
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        return true;
+    };
+    
+    // Own newest task first, then the shared queue, then steal the oldest
+    // task of another worker
+    size_t workers = m_workers.size();
+    bool isWorker = t_pool == this;
+    if (isWorker && takeBack(*m_queues[t_queueIndex])) {
+        return true;
+    }
+    if (takeFront(*m_queues[workers])) {
+        return true;
+    }
+    size_t start = isWorker ? t_queueIndex + 1 : 0;
+    for (size_t i = 0; i < workers; ++i) {
+        size_t victim = (start + i) % workers;
+        if ((!isWorker || victim != t_queueIndex) && takeFront(*m_queues[victim])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkPool::runOne() {
+    if (m_queuedJobs.load() == 0) {
+        return false;
+    }
+    
+    Job job;
+    if (!takeJob(job)) {
+        return false;
+    }
+    m_queuedJobs.fetch_sub(1);
+    
+    job.task();
+    job.group->m_pending.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void WorkPool::workerLoop(size_t index) {
+    t_pool = this;
+    t_queueIndex = index;
+    
+    while (true) {
+        if (runOne()) {
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return m_stopping || m_queuedJobs.load() > 0; });
+        if (m_stopping && m_queuedJobs.load() == 0) {
+            return;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// TaskGroup Implementation
+//-----------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(WorkPool& pool)
+    : m_pool(pool)
+    , m_pending(0)
+{
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(WorkPool::Task task) {
+    if (m_pool.workerCount() == 0) {
+        task();
+        return;
+    }
+    
+#ifdef BROWSER_ALLOC_TRACKING
+    // Charge the task's allocations to the queuing thread's subsystem
+    tracing::AllocTag tag = tracing::AllocTracker::currentTag();
+    task = [tag, inner = std::move(task)] {
+        tracing::ScopedAllocTag scope(tag);
+        inner();
+    };
+#endif
+    
+    m_pending.fetch_add(1);
+    m_pool.push({std::move(task), this});
+}
+
+void TaskGroup::wait() {
+    while (m_pending.load(std::memory_order_acquire) > 0) {
+        if (!m_pool.runOne()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+} // namespace threading
+} // namespace browser
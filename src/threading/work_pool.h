@@ -0,0 +1,93 @@
+#ifndef BROWSER_WORK_POOL_H
+#define BROWSER_WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace browser {
+namespace threading {
+
+class TaskGroup;
+
+// Fork-join worker pool with work stealing. Each worker keeps its own
+// deque: tasks it spawns go on the back and are taken from there (depth
+// first), while idle workers steal from the front of the others. Tasks
+// submitted from other threads go through a shared queue.
+class WorkPool {
+public:
+    using Task = std::function<void()>;
+    
+    explicit WorkPool(size_t workerCount);
+    ~WorkPool();
+    
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+    
+    // Process-wide pool with one worker per core beyond the calling thread,
+    // which joins in while it waits
+    static WorkPool& shared();
+    
+    size_t workerCount() const { return m_workers.size(); }
+    
+private:
+    struct Job {
+        Task task;
+        TaskGroup* group;
+    };
+    
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+    
+    void push(Job job);
+    
+    // Run one queued job on the calling thread; false if none was found
+    bool runOne();
+    bool takeJob(Job& job);
+    void workerLoop(size_t index);
+    
+    // One queue per worker, then the shared queue
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_queuedJobs;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stopping;
+    
+    friend class TaskGroup;
+};
+
+// Tasks to wait for together. Tasks may add more tasks to their own group.
+// wait() runs queued tasks on the calling thread until the group is done,
+// so groups can nest inside tasks. With no workers, run() runs the task
+// immediately.
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkPool& pool);
+    ~TaskGroup();
+    
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    
+    void run(WorkPool::Task task);
+    void wait();
+    
+private:
+    WorkPool& m_pool;
+    std::atomic<size_t> m_pending;
+    
+    friend class WorkPool;
+};
+
+} // namespace threading
+} // namespace browser
+
+#endif // BROWSER_WORK_POOL_H
@@ -0,0 +1,135 @@
+#include "alloc_tracker.h"
+#include "trace.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace browser {
+namespace tracing {
+
+namespace {
+
+// One cache line per tag, so threads charging different tags don't contend
+struct alignas(64) TagCounters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+TagCounters g_counters[AllocTracker::tagCount];
+
+// Constant-initialized, so usable from operator new on any thread
+thread_local AllocTag t_tag = AllocTag::OTHER;
+
+const char* const tagNames[AllocTracker::tagCount] = {
+    "other", "html", "css", "layout", "rendering", "networking", "js"
+};
+
+// Counter names must be string literals
+const char* const allocationCounterNames[AllocTracker::tagCount] = {
+    "other.allocations", "html.allocations", "css.allocations", "layout.allocations",
+    "rendering.allocations", "networking.allocations", "js.allocations"
+};
+const char* const byteCounterNames[AllocTracker::tagCount] = {
+    "other.bytes", "html.bytes", "css.bytes", "layout.bytes",
+    "rendering.bytes", "networking.bytes", "js.bytes"
+};
+
+} // namespace
+
+AllocTag AllocTracker::currentTag() {
+    return t_tag;
+}
+
+void AllocTracker::setCurrentTag(AllocTag tag) {
+    t_tag = tag;
+}
+
+void AllocTracker::record(size_t bytes) {
+    TagCounters& counters = g_counters[static_cast<size_t>(t_tag)];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+AllocStats AllocTracker::stats(AllocTag tag) {
+    const TagCounters& counters = g_counters[static_cast<size_t>(tag)];
+    AllocStats stats;
+    stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+    stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+AllocStats AllocTracker::total() {
+    AllocStats total;
+    for (size_t i = 0; i < tagCount; ++i) {
+        AllocStats tagStats = stats(static_cast<AllocTag>(i));
+        total.allocations += tagStats.allocations;
+        total.bytes += tagStats.bytes;
+    }
+    return total;
+}
+
+void AllocTracker::snapshot(AllocStats (&stats)[tagCount]) {
+    for (size_t i = 0; i < tagCount; ++i) {
+        stats[i] = AllocTracker::stats(static_cast<AllocTag>(i));
+    }
+}
+
+void AllocTracker::reset() {
+    for (TagCounters& counters : g_counters) {
+        counters.allocations.store(0, std::memory_order_relaxed);
+        counters.bytes.store(0, std::memory_order_relaxed);
+    }
+}
+
+const char* AllocTracker::tagName(AllocTag tag) {
+    size_t index = static_cast<size_t>(tag);
+    return index < tagCount ? tagNames[index] : "unknown";
+}
+
+void AllocTracker::reportCounters() {
+    if (!isCompiledIn()) {
+        return;
+    }
+    for (size_t i = 0; i < tagCount; ++i) {
+        AllocStats tagStats = stats(static_cast<AllocTag>(i));
+        TRACE_COUNTER("alloc", allocationCounterNames[i], static_cast<int64_t>(tagStats.allocations));
+        TRACE_COUNTER("alloc", byteCounterNames[i], static_cast<int64_t>(tagStats.bytes));
+    }
+}
+
+} // namespace tracing
+} // namespace browser
+
+#ifdef BROWSER_ALLOC_TRACKING
+
+// Replacements for the global allocation functions; the other forms
+// (nothrow, sized delete) forward to these in the standard library
+void* operator new(size_t size) {
+    browser::tracing::AllocTracker::record(size);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+#endif // BROWSER_ALLOC_TRACKING
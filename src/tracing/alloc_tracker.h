@@ -0,0 +1,98 @@
+#ifndef BROWSER_ALLOC_TRACKER_H
+#define BROWSER_ALLOC_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace browser {
+namespace tracing {
+
+// Subsystem that heap allocations are charged to
+enum class AllocTag : uint8_t {
+    OTHER,
+    HTML,
+    CSS,
+    LAYOUT,
+    RENDERING,
+    NETWORKING,
+    JS,
+    COUNT
+};
+
+struct AllocStats {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+// Per-subsystem heap allocation counts. Built with BROWSER_ALLOC_TRACKING
+// (the ENABLE_ALLOC_TRACKING CMake option), the library replaces the global
+// operator new and charges every allocation to the calling thread's current
+// tag, set by ALLOC_SCOPE at the entry points of each subsystem; the
+// innermost scope wins, and work pool tasks take the tag of the thread that
+// queued them. Without it nothing is counted and ALLOC_SCOPE compiles out.
+class AllocTracker {
+public:
+    static constexpr size_t tagCount = static_cast<size_t>(AllocTag::COUNT);
+
+    static constexpr bool isCompiledIn() {
+#ifdef BROWSER_ALLOC_TRACKING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Tag of the calling thread
+    static AllocTag currentTag();
+    static void setCurrentTag(AllocTag tag);
+
+    // Charge an allocation to the current tag; called by operator new
+    static void record(size_t bytes);
+
+    // Counts since start or the last reset()
+    static AllocStats stats(AllocTag tag);
+    static AllocStats total();
+    static void snapshot(AllocStats (&stats)[tagCount]);
+    static void reset();
+
+    // "html", "css", ...
+    static const char* tagName(AllocTag tag);
+
+    // Record the counts as "alloc" trace counters
+    static void reportCounters();
+};
+
+// Charges the allocations of a scope to tag
+class ScopedAllocTag {
+public:
+    explicit ScopedAllocTag(AllocTag tag)
+        : m_previous(AllocTracker::currentTag())
+    {
+        AllocTracker::setCurrentTag(tag);
+    }
+
+    ~ScopedAllocTag() {
+        AllocTracker::setCurrentTag(m_previous);
+    }
+
+    ScopedAllocTag(const ScopedAllocTag&) = delete;
+    ScopedAllocTag& operator=(const ScopedAllocTag&) = delete;
+
+private:
+    AllocTag m_previous;
+};
+
+} // namespace tracing
+} // namespace browser
+
+// ALLOC_SCOPE(HTML) charges the rest of the scope to AllocTag::HTML
+#ifdef BROWSER_ALLOC_TRACKING
+#define BROWSER_ALLOC_CONCAT_INNER(a, b) a##b
+#define BROWSER_ALLOC_CONCAT(a, b) BROWSER_ALLOC_CONCAT_INNER(a, b)
+#define ALLOC_SCOPE(tag) \
+    ::browser::tracing::ScopedAllocTag BROWSER_ALLOC_CONCAT(allocScope_, __LINE__)(::browser::tracing::AllocTag::tag)
+#else
+#define ALLOC_SCOPE(tag) do {} while (0)
+#endif
+
+#endif // BROWSER_ALLOC_TRACKER_H
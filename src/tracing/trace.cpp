@@ -0,0 +1,304 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace browser {
+namespace tracing {
+
+namespace {
+
+// Small sequential id for the calling thread
+uint32_t currentThreadId() {
+    static std::atomic<uint32_t> nextId{1};
+    thread_local uint32_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+const std::chrono::steady_clock::time_point& processStart() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return start;
+}
+
+// Taken while statics initialize, so times count from launch rather than
+// from the first event
+const auto& processStartAnchor = processStart();
+
+void appendJsonString(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+                break;
+        }
+    }
+    out += '"';
+}
+
+void appendHtmlEscaped(std::string& out, const std::string& text) {
+    for (char c : text) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            default: out += c; break;
+        }
+    }
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// Tracer Implementation
+//-----------------------------------------------------------------------------
+
+std::atomic<TraceMode> Tracer::s_mode{TraceMode::OFF};
+
+Tracer::Tracer()
+    : m_eventLimit(1000000)
+    , m_droppedEvents(0)
+{
+    processStart();
+}
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::setMode(TraceMode mode) {
+    processStart();
+    s_mode.store(mode, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::now() {
+    auto elapsed = std::chrono::steady_clock::now() - processStart();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+void Tracer::recordDuration(const char* category, const char* name,
+                            uint64_t startUs, uint64_t durationUs, std::string detail) {
+    TraceMode current = mode();
+    if (current == TraceMode::OFF) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    addSample(category, name, false, static_cast<int64_t>(durationUs));
+
+    if (current == TraceMode::FULL) {
+        if (m_events.size() < m_eventLimit) {
+            m_events.push_back({category, name, 'X', currentThreadId(), startUs, durationUs, 0, std::move(detail)});
+        } else {
+            ++m_droppedEvents;
+        }
+    }
+}
+
+void Tracer::recordCounter(const char* category, const char* name, int64_t value) {
+    TraceMode current = mode();
+    if (current == TraceMode::OFF) {
+        return;
+    }
+
+    uint64_t timestamp = now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    addSample(category, name, true, value);
+
+    if (current == TraceMode::FULL) {
+        if (m_events.size() < m_eventLimit) {
+            m_events.push_back({category, name, 'C', currentThreadId(), timestamp, 0, value, std::string()});
+        } else {
+            ++m_droppedEvents;
+        }
+    }
+}
+
+void Tracer::addSample(const char* category, const char* name, bool isCounter, int64_t sample) {
+    Series& series = m_series[std::make_pair(std::string(category), std::string(name))];
+    series.isCounter = isCounter;
+    series.count++;
+    series.totalValue += sample;
+    series.recent.push_back(sample);
+    if (series.recent.size() > summaryWindow) {
+        series.recent.pop_front();
+    }
+}
+
+void Tracer::setEventLimit(size_t limit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_eventLimit = limit;
+}
+
+size_t Tracer::eventCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_events.size();
+}
+
+size_t Tracer::droppedEventCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_droppedEvents;
+}
+
+std::string Tracer::chromeTraceJson() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string json;
+    json.reserve(64 + m_events.size() * 96);
+    json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for (const auto& event : m_events) {
+        if (!first) {
+            json += ',';
+        }
+        first = false;
+
+        json += "\n{\"name\":";
+        appendJsonString(json, event.name);
+        json += ",\"cat\":";
+        appendJsonString(json, event.category);
+        json += ",\"ph\":\"";
+        json += event.phase;
+        json += "\",\"pid\":1,\"tid\":" + std::to_string(event.threadId);
+        json += ",\"ts\":" + std::to_string(event.timestampUs);
+
+        if (event.phase == 'X') {
+            json += ",\"dur\":" + std::to_string(event.durationUs);
+            if (!event.detail.empty()) {
+                json += ",\"args\":{\"detail\":";
+                appendJsonString(json, event.detail);
+                json += '}';
+            }
+        } else {
+            json += ",\"args\":{\"value\":" + std::to_string(event.value) + '}';
+        }
+        json += '}';
+    }
+
+    json += "\n]}\n";
+    return json;
+}
+
+bool Tracer::writeChromeTrace(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::string json = chromeTraceJson();
+    file.write(json.data(), static_cast<std::streamsize>(json.size()));
+    return static_cast<bool>(file);
+}
+
+std::vector<TraceSummaryEntry> Tracer::summary() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<TraceSummaryEntry> entries;
+    entries.reserve(m_series.size());
+
+    for (const auto& item : m_series) {
+        const Series& series = item.second;
+        if (series.recent.empty()) {
+            continue;
+        }
+
+        // Durations are reported in milliseconds, counters as-is
+        double scale = series.isCounter ? 1.0 : 0.001;
+        int64_t sum = 0;
+        int64_t maximum = series.recent.front();
+        for (int64_t sample : series.recent) {
+            sum += sample;
+            maximum = std::max(maximum, sample);
+        }
+
+        TraceSummaryEntry entry;
+        entry.category = item.first.first;
+        entry.name = item.first.second;
+        entry.isCounter = series.isCounter;
+        entry.count = series.count;
+        entry.last = series.recent.back() * scale;
+        entry.average = static_cast<double>(sum) / series.recent.size() * scale;
+        entry.maximum = maximum * scale;
+        entry.lastValue = series.recent.back();
+        entry.totalValue = series.totalValue;
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+std::string Tracer::summaryHtml() const {
+    std::vector<TraceSummaryEntry> entries = summary();
+    TraceMode current = mode();
+
+    std::ostringstream rows;
+    rows.setf(std::ios::fixed);
+    rows.precision(3);
+    for (const auto& entry : entries) {
+        std::string category, name;
+        appendHtmlEscaped(category, entry.category);
+        appendHtmlEscaped(name, entry.name);
+
+        rows << "<tr><td>" << category << "</td><td>" << name << "</td><td>" << entry.count << "</td>";
+        if (entry.isCounter) {
+            rows << "<td>" << entry.lastValue << "</td><td>" << entry.average
+                 << "</td><td>" << entry.maximum << "</td><td>" << entry.totalValue << "</td></tr>\n";
+        } else {
+            rows << "<td>" << entry.last << " ms</td><td>" << entry.average
+                 << " ms</td><td>" << entry.maximum << " ms</td><td>"
+                 << entry.totalValue / 1000.0 << " ms</td></tr>\n";
+        }
+    }
+
+    std::string html =
+        "<!DOCTYPE html>\n<html>\n<head>\n    <title>Tracing</title>\n"
+        "    <style>\n"
+        "        body { font-family: Arial, sans-serif; margin: 20px; }\n"
+        "        table { border-collapse: collapse; }\n"
+        "        th, td { border: 1px solid #ccc; padding: 4px 8px; text-align: left; }\n"
+        "        th { background: #eee; }\n"
+        "    </style>\n</head>\n<body>\n    <h1>Tracing</h1>\n";
+
+    if (current == TraceMode::OFF) {
+        html += "    <p>Tracing is off. Start the browser with --trace-summary, or with "
+                "--trace &lt;file&gt; to also write a Chrome trace.</p>\n";
+    } else {
+        html += "    <p>Averages and maxima cover the last " + std::to_string(summaryWindow) +
+                " samples of each stage.</p>\n";
+    }
+
+    if (!entries.empty()) {
+        html += "    <table>\n        <tr><th>Category</th><th>Name</th><th>Samples</th>"
+                "<th>Last</th><th>Average</th><th>Max</th><th>Total</th></tr>\n";
+        html += rows.str();
+        html += "    </table>\n";
+    }
+
+    html += "</body>\n</html>\n";
+    return html;
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+    m_droppedEvents = 0;
+    m_series.clear();
+}
+
+} // namespace tracing
+} // namespace browser
@@ -0,0 +1,170 @@
+#ifndef BROWSER_TRACE_H
+#define BROWSER_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace browser {
+namespace tracing {
+
+// What the tracer records. With OFF a trace scope costs one relaxed atomic
+// load; SUMMARY keeps rolling per-name statistics only; FULL also keeps
+// every event for export.
+enum class TraceMode {
+    OFF,
+    SUMMARY,
+    FULL
+};
+
+// A recorded event; category and name must be string literals
+struct TraceEvent {
+    const char* category;
+    const char* name;
+    char phase;             // 'X' complete event, 'C' counter
+    uint32_t threadId;
+    uint64_t timestampUs;
+    uint64_t durationUs;
+    int64_t value;          // counter value
+    std::string detail;     // optional argument, e.g. a URL
+};
+
+// Rolling statistics for one category/name pair
+struct TraceSummaryEntry {
+    std::string category;
+    std::string name;
+    bool isCounter;
+    uint64_t count;         // samples since the summary was last cleared
+    // Milliseconds for durations, values for counters; average and
+    // maximum cover the recent window
+    double last;
+    double average;
+    double maximum;
+    int64_t lastValue;
+    int64_t totalValue;
+};
+
+// Process-wide trace recorder
+class Tracer {
+public:
+    static Tracer& instance();
+
+    static bool isEnabled() { return s_mode.load(std::memory_order_relaxed) != TraceMode::OFF; }
+    static TraceMode mode() { return s_mode.load(std::memory_order_relaxed); }
+    void setMode(TraceMode mode);
+
+    // Microseconds since process start, on a steady clock
+    static uint64_t now();
+
+    // Recording; ignored while tracing is off
+    void recordDuration(const char* category, const char* name,
+                        uint64_t startUs, uint64_t durationUs, std::string detail = std::string());
+    void recordCounter(const char* category, const char* name, int64_t value);
+
+    // Events kept in FULL mode are capped; later ones are counted as dropped
+    void setEventLimit(size_t limit);
+    size_t eventCount() const;
+    size_t droppedEventCount() const;
+
+    // Chrome trace-event JSON, loadable in chrome://tracing or Perfetto
+    std::string chromeTraceJson() const;
+    bool writeChromeTrace(const std::string& path) const;
+
+    // Rolling summary, sorted by category then name
+    std::vector<TraceSummaryEntry> summary() const;
+
+    // Summary as an HTML page (about:tracing)
+    std::string summaryHtml() const;
+
+    // Drop recorded events and statistics
+    void clear();
+
+    // Samples kept per name for the rolling averages
+    static constexpr size_t summaryWindow = 64;
+
+private:
+    Tracer();
+
+    struct Series {
+        bool isCounter = false;
+        uint64_t count = 0;
+        int64_t totalValue = 0;
+        std::deque<int64_t> recent;     // durations in us, or counter values
+    };
+
+    void addSample(const char* category, const char* name, bool isCounter, int64_t sample);
+
+    static std::atomic<TraceMode> s_mode;
+
+    mutable std::mutex m_mutex;
+    std::vector<TraceEvent> m_events;
+    size_t m_eventLimit;
+    size_t m_droppedEvents;
+    std::map<std::pair<std::string, std::string>, Series> m_series;
+};
+
+// Records the lifetime of a scope as a complete event
+class ScopedTrace {
+public:
+    ScopedTrace(const char* category, const char* name)
+        : m_category(Tracer::isEnabled() ? category : nullptr)
+        , m_name(name)
+        , m_start(m_category ? Tracer::now() : 0)
+    {
+    }
+
+    ScopedTrace(const char* category, const char* name, const std::string& detail)
+        : ScopedTrace(category, name)
+    {
+        if (m_category && Tracer::mode() == TraceMode::FULL) {
+            m_detail = detail;
+        }
+    }
+
+    ~ScopedTrace() {
+        if (m_category) {
+            Tracer::instance().recordDuration(m_category, m_name, m_start,
+                                              Tracer::now() - m_start, std::move(m_detail));
+        }
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    const char* m_category;
+    const char* m_name;
+    uint64_t m_start;
+    std::string m_detail;
+};
+
+} // namespace tracing
+} // namespace browser
+
+// Instrumentation macros; define BROWSER_DISABLE_TRACING to compile them out
+#define BROWSER_TRACE_CONCAT_INNER(a, b) a##b
+#define BROWSER_TRACE_CONCAT(a, b) BROWSER_TRACE_CONCAT_INNER(a, b)
+
+#ifndef BROWSER_DISABLE_TRACING
+#define TRACE_SCOPE(category, name) \
+    ::browser::tracing::ScopedTrace BROWSER_TRACE_CONCAT(traceScope_, __LINE__)(category, name)
+#define TRACE_SCOPE_DETAIL(category, name, detail) \
+    ::browser::tracing::ScopedTrace BROWSER_TRACE_CONCAT(traceScope_, __LINE__)(category, name, detail)
+#define TRACE_COUNTER(category, name, value) \
+    do { \
+        if (::browser::tracing::Tracer::isEnabled()) { \
+            ::browser::tracing::Tracer::instance().recordCounter(category, name, value); \
+        } \
+    } while (0)
+#else
+#define TRACE_SCOPE(category, name) do {} while (0)
+#define TRACE_SCOPE_DETAIL(category, name, detail) do {} while (0)
+#define TRACE_COUNTER(category, name, value) do {} while (0)
+#endif
+
+#endif // BROWSER_TRACE_H
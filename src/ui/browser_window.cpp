@@ -7,11 +7,12 @@
 
 #include "browser_window.h"
 #include <iostream>
-#include <sstream>
 #include <chrono>
-#include <thread>
 #include <algorithm>
+#include <cmath>
 #include "rendering/paint_system.h"
+#include "tracing/alloc_tracker.h"
+#include "tracing/trace.h"
 
 namespace browser {
 namespace ui {
@@ -23,7 +24,9 @@ namespace ui {
 BrowserWindow::BrowserWindow(const WindowConfig& config)
     : m_historyIndex(0)
     , m_isLoading(false)
+    , m_inFrame(false)
     , m_initialized(false)
+    , m_firstPaintDone(false)
 {
     // Create platform window
     m_window = createPlatformWindow(config);
@@ -31,8 +34,14 @@ BrowserWindow::BrowserWindow(const WindowConfig& config)
     // Create renderer
     m_renderer = std::make_shared<rendering::Renderer>();
     
-    // Create browser engine instance
+    // Create browser engine instance; only what's near the viewport needs
+    // layout up front
     m_browser = std::make_shared<browser::Browser>();
+    m_browser->layoutEngine()->setLazyLayout(true);
+    
+    // Scripts run on their own thread so the event loop keeps going; their
+    // DOM changes are applied once per frame
+    m_browser->setScriptThreadEnabled(true);
     
     // Create custom render context
     m_customContext = std::make_shared<rendering::CustomRenderContext>();
@@ -42,6 +51,11 @@ BrowserWindow::BrowserWindow(const WindowConfig& config)
 }
 
 BrowserWindow::~BrowserWindow() {
+    // Scripts still running stop waking the window up
+    if (m_browser) {
+        m_browser->setDOMMutationsQueuedCallback(nullptr);
+    }
+    
     // Close window
     if (m_window) {
         m_window->close();
@@ -107,22 +121,42 @@ bool BrowserWindow::initialize() {
     }
     std::cout << "Render target created" << std::endl;
     
-    // Set up window callbacks
+    // Frames start on the display's refresh boundaries
+    m_frameScheduler.setRefreshRate(m_window->refreshRate());
+    
+    // Set up window callbacks; input asks for a frame to show its effects
     m_window->setKeyCallback([this](Key key, KeyAction action) {
         handleKeyEvent(key, action);
+        m_frameScheduler.requestFrame();
     });
     
     m_window->setMouseButtonCallback([this](MouseButton button, MouseAction action, int x, int y) {
         handleMouseEvent(button, action, x, y);
+        m_frameScheduler.requestFrame();
     });
     
     m_window->setResizeCallback([this](int width, int height) {
         handleResizeEvent(width, height);
+        m_frameScheduler.requestFrame();
+    });
+    
+    // Scripts' DOM changes are committed in the next frame; the script
+    // thread wakes the event loop up for it
+    m_browser->setDOMMutationsQueuedCallback([this]() {
+        m_frameScheduler.requestFrame();
+        m_window->wakeUp();
     });
     
     m_window->setCloseCallback([this]() {
         handleCloseEvent();
     });
+    
+    // Pages kept for back and forward are the first thing to give up
+    m_window->setMemoryPressureCallback([this]() {
+        if (m_browser) {
+            m_browser->onMemoryPressure();
+        }
+    });
     std::cout << "Window callbacks set" << std::endl;
     
     // Initialize browser controls
@@ -208,18 +242,9 @@ std::string BrowserWindow::getTitle() const {
 
 void BrowserWindow::processEvents() {
     if (m_window) {
-        // Process window events
+        // Handle what is pending without waiting, then draw if it's time
         m_window->processEvents();
-        
-        // Check if we need to render
-        static int frameCount = 0;
-        frameCount++;
-        
-        // Always render if needed, or periodically to ensure display updates
-        if (m_needsRender || (frameCount % 60 == 0)) {
-            renderPage();
-            m_needsRender = false;
-        }
+        runFrame();
     }
 }
 
@@ -231,41 +256,55 @@ void BrowserWindow::runEventLoop() {
         std::cout << "Window shown" << std::endl;
     }
     
-    int frameCount = 0;
-    auto lastRenderTime = std::chrono::steady_clock::now();
-    
     while (m_initialized && m_window) {
-        // Process window events
-        if (!m_window->processEvents()) {
+        // Input is handled as soon as it arrives, ahead of the next frame.
+        // With nothing to draw the wait has no timeout, so an idle window
+        // doesn't use the CPU.
+        int timeoutMs = m_frameScheduler.timeUntilFrameMs(FrameScheduler::Clock::now());
+        if (!m_window->waitEvents(timeoutMs)) {
             std::cout << "Window closed or error in processEvents" << std::endl;
             break;
         }
-        
-        // Calculate time since last render
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastRenderTime);
-        
-        // Render at 60 FPS or when needed
-        if (m_needsRender || elapsed.count() >= 16) {
-            renderPage();
-            m_needsRender = false;
-            lastRenderTime = now;
-        }
-        
-        frameCount++;
-        
-        // Sleep a bit to reduce CPU usage
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        runFrame();
     }
     
     std::cout << "Exiting event loop" << std::endl;
 }
-// Helper function to render a box recursively
-void renderBox(Canvas* canvas, layout::Box* box, int offsetX, int offsetY) {
-    if (!box || box->displayType() == layout::DisplayType::NONE) {
+
+void BrowserWindow::runFrame() {
+    if (!m_frameScheduler.beginFrame(FrameScheduler::Clock::now())) {
         return;
     }
+    TRACE_SCOPE("paint", "BrowserWindow::runFrame");
     
+    // Damage found while drawing is painted in this frame
+    m_inFrame = true;
+    if (m_browser) {
+        m_browser->commitDOMMutations();
+    }
+    collectLayoutDamage();
+    if (!m_damage.isEmpty()) {
+        renderPage();
+    }
+    m_inFrame = false;
+    
+    if (!m_damage.isEmpty()) {
+        m_frameScheduler.requestFrame();
+    }
+}
+
+// Canvas color of a computed color value, or fallback if it isn't a color
+static unsigned int canvasColor(const css::Value& value, unsigned int fallback) {
+    if (value.type() != css::ValueType::COLOR) {
+        return fallback;
+    }
+    uint32_t rgba = value.rgba();
+    return Canvas::rgb((rgba >> 24) & 0xFF, (rgba >> 16) & 0xFF, (rgba >> 8) & 0xFF);
+}
+
+// Paint a box's own background, border and text; its children are painted
+// as boxes of their own
+static void renderBox(Canvas* canvas, layout::Box* box, int offsetX, int offsetY) {
     // Get box rectangles
     layout::Rect contentRect = box->contentRect();
     layout::Rect borderBox = box->borderBox();
@@ -283,37 +322,10 @@ void renderBox(Canvas* canvas, layout::Box* box, int offsetX, int offsetY) {
     const css::ComputedStyle& style = box->style();
     
     // Draw background
-    css::Value bgColorValue = style.getProperty("background-color");
-    std::string bgColorStr = bgColorValue.stringValue();
+    const css::Value& bgColorValue = style.getProperty(css::PropertyId::BACKGROUND_COLOR);
     
-    if (!bgColorStr.empty() && bgColorStr != "transparent") {
-        unsigned int bgColor = Canvas::rgb(255, 255, 255); // Default white
-        
-        // Parse color (simplified)
-        if (bgColorStr == "black") bgColor = Canvas::rgb(0, 0, 0);
-        else if (bgColorStr == "white") bgColor = Canvas::rgb(255, 255, 255);
-        else if (bgColorStr == "red") bgColor = Canvas::rgb(255, 0, 0);
-        else if (bgColorStr == "green") bgColor = Canvas::rgb(0, 128, 0);
-        else if (bgColorStr == "blue") bgColor = Canvas::rgb(0, 0, 255);
-        else if (bgColorStr[0] == '#' && bgColorStr.length() >= 7) {
-            // Parse hex color
-            int r = std::stoi(bgColorStr.substr(1, 2), nullptr, 16);
-            int g = std::stoi(bgColorStr.substr(3, 2), nullptr, 16);
-            int b = std::stoi(bgColorStr.substr(5, 2), nullptr, 16);
-            bgColor = Canvas::rgb(r, g, b);
-        } else if (bgColorStr.substr(0, 4) == "rgba") {
-            // Parse rgba (simplified)
-            size_t start = bgColorStr.find('(') + 1;
-            size_t end = bgColorStr.find(')');
-            std::string values = bgColorStr.substr(start, end - start);
-            
-            // Extract r, g, b values (simplified parsing)
-            int r = 255, g = 255, b = 255;
-            std::istringstream ss(values);
-            char comma;
-            ss >> r >> comma >> g >> comma >> b;
-            bgColor = Canvas::rgb(r, g, b);
-        }
+    if (!bgColorValue.stringValue().empty() && !bgColorValue.isKeyword(css::Keyword::TRANSPARENT)) {
+        unsigned int bgColor = canvasColor(bgColorValue, Canvas::rgb(255, 255, 255)); // Default white
         
         // Fill background
         canvas->drawRect(borderBox.x, borderBox.y, borderBox.width, borderBox.height, bgColor, true);
@@ -326,21 +338,8 @@ void renderBox(Canvas* canvas, layout::Box* box, int offsetX, int offsetY) {
     float borderLeft = box->borderLeft();
     
     if (borderTop > 0 || borderRight > 0 || borderBottom > 0 || borderLeft > 0) {
-        css::Value borderColorValue = style.getProperty("border-color");
-        std::string borderColorStr = borderColorValue.stringValue();
-        unsigned int borderColor = Canvas::rgb(0, 0, 0); // Default black
-        
-        if (!borderColorStr.empty()) {
-            // Parse border color (simplified)
-            if (borderColorStr == "black") borderColor = Canvas::rgb(0, 0, 0);
-            else if (borderColorStr == "gray" || borderColorStr == "grey") borderColor = Canvas::rgb(128, 128, 128);
-            else if (borderColorStr[0] == '#' && borderColorStr.length() >= 7) {
-                int r = std::stoi(borderColorStr.substr(1, 2), nullptr, 16);
-                int g = std::stoi(borderColorStr.substr(3, 2), nullptr, 16);
-                int b = std::stoi(borderColorStr.substr(5, 2), nullptr, 16);
-                borderColor = Canvas::rgb(r, g, b);
-            }
-        }
+        const css::Value& borderColorValue = style.getProperty(css::PropertyId::BORDER_COLOR);
+        unsigned int borderColor = canvasColor(borderColorValue, Canvas::rgb(0, 0, 0)); // Default black
         
         // Draw border as rectangle outline
         int maxBorder = std::max({borderTop, borderRight, borderBottom, borderLeft});
@@ -353,46 +352,25 @@ void renderBox(Canvas* canvas, layout::Box* box, int offsetX, int offsetY) {
             std::string text = textBox->textNode()->nodeValue();
             
             // Get text color
-            css::Value colorValue = style.getProperty("color");
-            std::string colorStr = colorValue.stringValue();
-            unsigned int textColor = Canvas::rgb(0, 0, 0); // Default black
-            
-            if (!colorStr.empty()) {
-                // Parse text color
-                if (colorStr == "black") textColor = Canvas::rgb(0, 0, 0);
-                else if (colorStr == "white") textColor = Canvas::rgb(255, 255, 255);
-                else if (colorStr == "blue") textColor = Canvas::rgb(0, 0, 255);
-                else if (colorStr == "red") textColor = Canvas::rgb(255, 0, 0);
-                else if (colorStr[0] == '#' && colorStr.length() >= 7) {
-                    int r = std::stoi(colorStr.substr(1, 2), nullptr, 16);
-                    int g = std::stoi(colorStr.substr(3, 2), nullptr, 16);
-                    int b = std::stoi(colorStr.substr(5, 2), nullptr, 16);
-                    textColor = Canvas::rgb(r, g, b);
-                }
-            }
+            const css::Value& colorValue = style.getProperty(css::PropertyId::COLOR);
+            unsigned int textColor = canvasColor(colorValue, Canvas::rgb(0, 0, 0)); // Default black
             
             // Get font properties
-            css::Value fontSizeValue = style.getProperty("font-size");
+            const css::Value& fontSizeValue = style.getProperty(css::PropertyId::FONT_SIZE);
             int fontSize = 16; // Default
             if (fontSizeValue.type() == css::ValueType::LENGTH) {
                 fontSize = static_cast<int>(fontSizeValue.numericValue());
             }
             
-            css::Value fontFamilyValue = style.getProperty("font-family");
-            std::string fontFamily = fontFamilyValue.stringValue();
-            if (fontFamily.empty()) {
-                fontFamily = "Arial";
-            }
+            const css::Value& fontFamilyValue = style.getProperty(css::PropertyId::FONT_FAMILY);
+            static const std::string defaultFontFamily = "Arial";
+            const std::string& fontFamily = fontFamilyValue.stringValue().empty()
+                ? defaultFontFamily : fontFamilyValue.stringValue();
             
             // Draw text
             canvas->drawText(text, contentRect.x, contentRect.y + fontSize, textColor, fontFamily, fontSize);
         }
     }
-    
-    // Render children
-    for (const auto& child : box->children()) {
-        renderBox(canvas, child.get(), offsetX, offsetY);
-    }
 }
 
 void BrowserWindow::renderPage() {
@@ -401,10 +379,24 @@ void BrowserWindow::renderPage() {
         return;
     }
     
+    TRACE_SCOPE("paint", "BrowserWindow::renderPage");
+    ALLOC_SCOPE(RENDERING);
+    
     // Get the window size
     int width, height;
     m_window->getSize(width, height);
     
+    // Paint what's damaged, layout and toolbar changes since the last frame
+    // included
+    collectLayoutDamage();
+    updateToolbar();
+    DamageRect damage = m_damage.intersected(DamageRect(0, 0, width, height));
+    m_damage = DamageRect();
+    if (damage.isEmpty()) {
+        return;
+    }
+    TRACE_COUNTER("paint", "damagePixels", static_cast<int64_t>(damage.width) * damage.height);
+    
     // Begin painting
     m_window->beginPaint();
     
@@ -417,98 +409,220 @@ void BrowserWindow::renderPage() {
         return;
     }
     
-    // Clear the window with white background
+    // Clear the damaged area with white background
+    canvas->setClip(damage.x, damage.y, damage.width, damage.height);
     canvas->clear(Canvas::rgb(255, 255, 255));
     
-    // Draw browser controls (toolbar)
-    int toolbarHeight = 40;
+    // Page content first; the toolbar is drawn over it
+    int contentHeight = height - contentTop;
     
-    // Toolbar background
-    canvas->drawRect(0, 0, width, toolbarHeight, Canvas::rgb(240, 240, 240), true);
-    canvas->drawRect(0, toolbarHeight, width, 1, Canvas::rgb(200, 200, 200), true); // Border
-    
-    // Navigation buttons with better visual feedback
-    int buttonSize = 30;
-    int buttonMargin = 5;
-    int buttonY = 5;
-    
-    // Back button
-    bool canGoBack = m_historyIndex > 0;
-    unsigned int backButtonColor = canGoBack ? Canvas::rgb(220, 220, 220) : Canvas::rgb(240, 240, 240);
-    unsigned int backButtonBorder = canGoBack ? Canvas::rgb(180, 180, 180) : Canvas::rgb(220, 220, 220);
-    unsigned int backButtonText = canGoBack ? Canvas::rgb(0, 0, 0) : Canvas::rgb(180, 180, 180);
-    
-    canvas->drawRect(buttonMargin, buttonY, buttonSize, buttonSize, backButtonColor, true);
-    canvas->drawRect(buttonMargin, buttonY, buttonSize, buttonSize, backButtonBorder, false, 1);
-    canvas->drawText("◀", buttonMargin + 8, buttonY + 20, backButtonText, "Arial", 16);
-    
-    // Forward button
-    bool canGoForward = m_historyIndex < m_history.size() - 1;
-    unsigned int forwardButtonColor = canGoForward ? Canvas::rgb(220, 220, 220) : Canvas::rgb(240, 240, 240);
-    unsigned int forwardButtonBorder = canGoForward ? Canvas::rgb(180, 180, 180) : Canvas::rgb(220, 220, 220);
-    unsigned int forwardButtonText = canGoForward ? Canvas::rgb(0, 0, 0) : Canvas::rgb(180, 180, 180);
-    
-    int forwardX = buttonMargin * 2 + buttonSize;
-    canvas->drawRect(forwardX, buttonY, buttonSize, buttonSize, forwardButtonColor, true);
-    canvas->drawRect(forwardX, buttonY, buttonSize, buttonSize, forwardButtonBorder, false, 1);
-    canvas->drawText("▶", forwardX + 8, buttonY + 20, forwardButtonText, "Arial", 16);
-    
-    // Reload button
-    int reloadX = buttonMargin * 3 + buttonSize * 2;
-    canvas->drawRect(reloadX, buttonY, buttonSize, buttonSize, Canvas::rgb(220, 220, 220), true);
-    canvas->drawRect(reloadX, buttonY, buttonSize, buttonSize, Canvas::rgb(180, 180, 180), false, 1);
-    canvas->drawText("↻", reloadX + 8, buttonY + 20, Canvas::rgb(0, 0, 0), "Arial", 16);
-    
-    // Address bar
-    int addressBarX = buttonMargin * 4 + buttonSize * 3;
-    int addressBarWidth = width - addressBarX - buttonMargin;
-    canvas->drawRect(addressBarX, buttonY, addressBarWidth, buttonSize, Canvas::rgb(255, 255, 255), true);
-    canvas->drawRect(addressBarX, buttonY, addressBarWidth, buttonSize, Canvas::rgb(180, 180, 180), false, 1);
-    
-    // Address text
-    if (!m_currentUrl.empty()) {
-        canvas->drawText(m_currentUrl, addressBarX + 5, buttonY + 20, Canvas::rgb(0, 0, 0), "Arial", 14);
-    } else {
-        canvas->drawText("Enter URL...", addressBarX + 5, buttonY + 20, Canvas::rgb(180, 180, 180), "Arial", 14);
-    }
-    
-    // Calculate content area (below toolbar)
-    int contentY = toolbarHeight + 1; // +1 for border
-    int contentHeight = height - contentY;
-    
-    // Get the layout root from the browser
-    auto layoutRoot = m_browser->layoutRoot();
+    // Get the layout root from the browser; scripts wait while it's painted
+    std::unique_lock<std::mutex> documentLock = m_browser->lockDocument();
+    layout::Box* layoutRoot = m_browser->layoutRoot();
     
     if (layoutRoot) {
-        // We have content to render - render the actual layout tree!
-        std::cout << "Rendering page content from layout tree..." << std::endl;
-        
-        // Create a clipping region for the content area
-        // (In a real implementation, you'd set up proper clipping)
-        
-        // Render the layout tree starting from the root
-        renderBox(canvas, layoutRoot.get(), 0, contentY);
-        
-        // If this is the home page, make sure JavaScript is executed for interactivity
-        if (m_currentUrl == "about:home" && m_browser->jsEngine()) {
-            // The JavaScript should already be executed when the page was loaded
-            // This ensures the clock updates, etc.
+        // Only the boxes under the damage, in paint order, from the
+        // layout's spatial index
+        if (damage.y + damage.height > contentTop) {
+            TRACE_SCOPE("paint", "renderBox");
+            layout::LayoutEngine* layoutEngine = m_browser->layoutEngine();
+            int offsetY = contentTop - static_cast<int>(layoutEngine->scrollY());
+            layout::Rect area(static_cast<float>(damage.x), static_cast<float>(damage.y - offsetY),
+                              static_cast<float>(damage.width), static_cast<float>(damage.height));
+            std::vector<layout::Box*> boxes;
+            layoutEngine->boxesInRect(area, boxes);
+            for (layout::Box* box : boxes) {
+                renderBox(canvas, box, 0, offsetY);
+            }
+            TRACE_COUNTER("paint", "damagedBoxes", static_cast<int64_t>(boxes.size()));
         }
         
     } else {
         // No content - this shouldn't happen if about:home loaded correctly
-        canvas->drawRect(0, contentY, width, contentHeight, Canvas::rgb(250, 250, 250), true);
+        canvas->drawRect(0, contentTop, width, contentHeight, Canvas::rgb(250, 250, 250), true);
         
         std::string message = "Loading page...";
         int textWidth = message.length() * 8;
         int textX = (width - textWidth) / 2;
-        int textY = contentY + (contentHeight / 2);
+        int textY = contentTop + (contentHeight / 2);
         
         canvas->drawText(message, textX, textY, Canvas::rgb(150, 150, 150), "Arial", 16);
     }
     
-    // End painting
-    m_window->endPaint();
+    // Draw browser controls (toolbar) over content scrolled under it
+    if (damage.y < contentTop) {
+        renderToolbar(canvas, width, damage);
+    }
+    
+    // End painting, presenting only the damage
+    canvas->resetClip();
+    m_window->endPaint(damage);
+    
+    // Startup ends with the first frame that shows a page
+    if (layoutRoot && !m_firstPaintDone) {
+        m_firstPaintDone = true;
+        uint64_t elapsedMs = tracing::Tracer::now() / 1000;
+        TRACE_COUNTER("startup", "timeToFirstPaintMs", static_cast<int64_t>(elapsedMs));
+        std::cout << "First paint " << elapsedMs << " ms after start"
+                  << (m_browser->networkingReady() ? "" : " (networking still starting)") << std::endl;
+    }
+}
+
+void BrowserWindow::renderToolbar(Canvas* canvas, int width, const DamageRect& damage) {
+    // Toolbar background
+    unsigned int toolbarColor = Canvas::rgb(240, 240, 240);
+    canvas->drawRect(0, 0, width, toolbarHeight, toolbarColor, true);
+    canvas->drawRect(0, toolbarHeight, width, 1, Canvas::rgb(200, 200, 200), true); // Border
+    
+    // The items under the damage, from their layers; only those whose
+    // state changed are drawn again
+    for (size_t i = 0; i < m_toolbarItems.size(); ++i) {
+        ToolbarItem& item = m_toolbarItems[i];
+        const DamageRect& rect = item.rect;
+        if (rect.isEmpty() || !damage.intersects(rect.x, rect.y, rect.width, rect.height)) {
+            continue;
+        }
+        
+        if (!item.layer || item.layer->width() != rect.width || item.layer->height() != rect.height) {
+            item.layer = canvas->createLayer(rect.width, rect.height);
+            item.stale = true;
+        }
+        if (!item.layer) {
+            drawToolbarItem(canvas, i, rect.x, rect.y);
+            item.stale = false;
+            continue;
+        }
+        
+        if (item.stale) {
+            TRACE_SCOPE("paint", "drawToolbarItem");
+            item.layer->clear(toolbarColor);
+            drawToolbarItem(item.layer.get(), i, 0, 0);
+            item.stale = false;
+        }
+        canvas->drawLayer(*item.layer, rect.x, rect.y);
+    }
+}
+
+void BrowserWindow::drawToolbarItem(Canvas* canvas, size_t index, int x, int y) {
+    const ToolbarItem& item = m_toolbarItems[index];
+    int width = item.rect.width;
+    int height = item.rect.height;
+    
+    if (index == ADDRESS_BAR) {
+        unsigned int border = item.focused ? Canvas::rgb(80, 140, 220) : Canvas::rgb(180, 180, 180);
+        canvas->drawRect(x, y, width, height, Canvas::rgb(255, 255, 255), true);
+        canvas->drawRect(x, y, width, height, border, false, 1);
+        
+        // Address text
+        if (!item.text.empty()) {
+            canvas->drawText(item.text, x + 5, y + 20, Canvas::rgb(0, 0, 0), "Arial", 14);
+        } else if (!item.focused) {
+            canvas->drawText("Enter URL...", x + 5, y + 20, Canvas::rgb(180, 180, 180), "Arial", 14);
+        }
+        return;
+    }
+    
+    // Navigation buttons, greyed out when there's nowhere to go
+    unsigned int buttonColor = item.enabled ? Canvas::rgb(220, 220, 220) : Canvas::rgb(240, 240, 240);
+    unsigned int buttonBorder = item.enabled ? Canvas::rgb(180, 180, 180) : Canvas::rgb(220, 220, 220);
+    unsigned int buttonText = item.enabled ? Canvas::rgb(0, 0, 0) : Canvas::rgb(180, 180, 180);
+    
+    canvas->drawRect(x, y, width, height, buttonColor, true);
+    canvas->drawRect(x, y, width, height, buttonBorder, false, 1);
+    canvas->drawText(item.text, x + 8, y + 20, buttonText, "Arial", 16);
+}
+
+void BrowserWindow::updateToolbar() {
+    int width = 0, height = 0;
+    getSize(width, height);
+    
+    int buttonSize = 30;
+    int buttonMargin = 5;
+    int buttonY = 5;
+    int addressBarX = buttonMargin * 4 + buttonSize * 3;
+    
+    std::string address = m_browserControls ? m_browserControls->getAddressBarText() : m_currentUrl;
+    bool addressFocused = m_browserControls && m_browserControls->isAddressBarFocused();
+    
+    struct State {
+        DamageRect rect;
+        bool enabled;
+        bool focused;
+        const std::string& text;
+    };
+    static const std::string backText = "◀";
+    static const std::string forwardText = "▶";
+    static const std::string reloadText = "↻";
+    State states[TOOLBAR_ITEM_COUNT] = {
+        {DamageRect(buttonMargin, buttonY, buttonSize, buttonSize),
+         m_historyIndex > 0, false, backText},
+        {DamageRect(buttonMargin * 2 + buttonSize, buttonY, buttonSize, buttonSize),
+         m_historyIndex + 1 < m_history.size(), false, forwardText},
+        {DamageRect(buttonMargin * 3 + buttonSize * 2, buttonY, buttonSize, buttonSize),
+         true, false, reloadText},
+        {DamageRect(addressBarX, buttonY, width - addressBarX - buttonMargin, buttonSize),
+         true, addressFocused, address},
+    };
+    
+    for (size_t i = 0; i < m_toolbarItems.size(); ++i) {
+        ToolbarItem& item = m_toolbarItems[i];
+        const State& state = states[i];
+        if (item.rect == state.rect && item.enabled == state.enabled &&
+            item.focused == state.focused && item.text == state.text) {
+            continue;
+        }
+        
+        invalidate(item.rect);
+        invalidate(state.rect);
+        item.rect = state.rect;
+        item.enabled = state.enabled;
+        item.focused = state.focused;
+        item.text = state.text;
+        item.stale = true;
+    }
+}
+
+void BrowserWindow::invalidate(const DamageRect& rect) {
+    m_damage.unite(rect);
+    if (!m_inFrame) {
+        m_frameScheduler.requestFrame();
+    }
+}
+
+void BrowserWindow::invalidateAll() {
+    int width = 0, height = 0;
+    getSize(width, height);
+    invalidate(DamageRect(0, 0, width, height));
+}
+
+void BrowserWindow::collectLayoutDamage() {
+    if (!m_browser || !m_window) {
+        return;
+    }
+    
+    layout::LayoutEngine* layoutEngine = m_browser->layoutEngine();
+    layout::Rect damage;
+    bool full = false;
+    if (!layoutEngine->takeDamage(damage, full)) {
+        return;
+    }
+    
+    int width = 0, height = 0;
+    m_window->getSize(width, height);
+    DamageRect content(0, contentTop, width, height - contentTop);
+    if (full) {
+        invalidate(content);
+        return;
+    }
+    
+    // Document to window pixels, rounded out
+    float top = damage.y + contentTop - layoutEngine->scrollY();
+    int left = static_cast<int>(std::floor(damage.x));
+    int y = static_cast<int>(std::floor(top));
+    DamageRect rect(left, y,
+                    static_cast<int>(std::ceil(damage.right())) - left,
+                    static_cast<int>(std::ceil(top + damage.height)) - y);
+    invalidate(rect.intersected(content));
 }
 
 bool BrowserWindow::loadUrl(const std::string& input) {
@@ -587,23 +701,34 @@ bool BrowserWindow::loadUrlInternal(const std::string& url) {
             m_browserControls->setAddressBarText(url);
         }
         
-        // Add to history if it's a new URL
+        // Add to history if it's a new URL; a reload replaces the entry's page
+        uint64_t pageId = m_browser->currentPageId();
         if (m_currentUrl != url) {
-            // If we're not at the end of history, truncate forward history
+            // If we're not at the end of history, truncate forward history;
+            // its pages can't be gone back to
+            for (size_t i = m_historyIndex + 1; i < m_history.size(); ++i) {
+                m_browser->backForwardCache()->erase(m_history[i].pageId);
+            }
             if (m_historyIndex < m_history.size() - 1) {
                 m_history.resize(m_historyIndex + 1);
             }
             
-            m_history.push_back(url);
+            m_history.push_back({url, pageId});
             m_historyIndex = m_history.size() - 1;
             m_currentUrl = url;
+        } else if (!m_history.empty()) {
+            HistoryEntry& entry = m_history[m_historyIndex];
+            if (entry.pageId != pageId) {
+                m_browser->backForwardCache()->erase(entry.pageId);
+                entry.pageId = pageId;
+            }
         }
         
         // Update UI state
         updateNavigationButtons();
         
         // Render the new page
-        m_needsRender = true;
+        invalidateAll();
     } else {
         // Show error
         showErrorPage(url, error);
@@ -618,34 +743,7 @@ bool BrowserWindow::loadUrlInternal(const std::string& url) {
 
 bool BrowserWindow::goBack() {
     if (m_historyIndex > 0) {
-        m_historyIndex--;
-        std::string url = m_history[m_historyIndex];
-        
-        // Don't add to history when navigating back
-        bool oldIsLoading = m_isLoading;
-        m_isLoading = true;
-        updateLoadingState(true);
-        
-        std::string error;
-        bool success = m_browser->loadUrl(url, error);
-        
-        if (success) {
-            m_currentUrl = url;
-            if (m_browserControls) {
-                m_browserControls->setAddressBarText(url);
-            }
-            
-            updateNavigationButtons();
-            m_needsRender = true;
-        } else {
-            // Show error
-            showErrorPage(url, error);
-        }
-        
-        m_isLoading = oldIsLoading;
-        updateLoadingState(oldIsLoading);
-        
-        return success;
+        return goToHistoryEntry(m_historyIndex - 1);
     }
     
     return false;
@@ -653,37 +751,50 @@ bool BrowserWindow::goBack() {
 
 bool BrowserWindow::goForward() {
     if (m_historyIndex < m_history.size() - 1) {
-        m_historyIndex++;
-        std::string url = m_history[m_historyIndex];
-        
-        // Don't add to history when navigating forward
-        bool oldIsLoading = m_isLoading;
-        m_isLoading = true;
-        updateLoadingState(true);
-        
-        std::string error;
-        bool success = m_browser->loadUrl(url, error);
-        
+        return goToHistoryEntry(m_historyIndex + 1);
+    }
+    
+    return false;
+}
+
+bool BrowserWindow::goToHistoryEntry(size_t index) {
+    m_historyIndex = index;
+    HistoryEntry& entry = m_history[index];
+    std::string url = entry.url;
+    
+    // Don't add to history when navigating back or forward
+    bool oldIsLoading = m_isLoading;
+    m_isLoading = true;
+    updateLoadingState(true);
+    
+    // A page still in the back/forward cache is shown as it was left;
+    // otherwise it's loaded again
+    std::string error;
+    bool success = m_browser->restorePage(entry.pageId);
+    if (!success) {
+        success = m_browser->loadUrl(url, error);
         if (success) {
-            m_currentUrl = url;
-            if (m_browserControls) {
-                m_browserControls->setAddressBarText(url);
-            }
-            
-            updateNavigationButtons();
-            m_needsRender = true;
-        } else {
-            // Show error
-            showErrorPage(url, error);
+            entry.pageId = m_browser->currentPageId();
+        }
+    }
+    
+    if (success) {
+        m_currentUrl = url;
+        if (m_browserControls) {
+            m_browserControls->setAddressBarText(url);
         }
         
-        m_isLoading = oldIsLoading;
-        updateLoadingState(oldIsLoading);
-        
-        return success;
+        updateNavigationButtons();
+        invalidateAll();
+    } else {
+        // Show error
+        showErrorPage(url, error);
     }
     
-    return false;
+    m_isLoading = oldIsLoading;
+    updateLoadingState(oldIsLoading);
+    
+    return success;
 }
 
 bool BrowserWindow::reload() {
@@ -719,7 +830,9 @@ void BrowserWindow::showDefaultPage() {
             int width, height;
             m_window->getSize(width, height);
             
+            m_browser->setViewportSize(static_cast<float>(width), static_cast<float>(height - 40));
             if (m_browser->layoutEngine() && m_browser->currentDocument() && m_browser->styleResolver()) {
+                std::unique_lock<std::mutex> documentLock = m_browser->lockDocument();
                 m_browser->layoutEngine()->layoutDocument(
                     m_browser->currentDocument(),
                     m_browser->styleResolver(),
@@ -732,8 +845,9 @@ void BrowserWindow::showDefaultPage() {
         // Set initial state
         m_currentUrl = "about:home";
         m_history.clear();
-        m_history.push_back(m_currentUrl);
+        m_history.push_back({m_currentUrl, m_browser->currentPageId()});
         m_historyIndex = 0;
+        m_browser->backForwardCache()->clear();
         
         if (m_browserControls) {
             m_browserControls->setAddressBarText(m_currentUrl);
@@ -746,7 +860,7 @@ void BrowserWindow::showDefaultPage() {
         updateNavigationButtons();
         
         // Force a render
-        m_needsRender = true;
+        invalidateAll();
         renderPage();
     }
 }
@@ -809,12 +923,15 @@ void BrowserWindow::showErrorPage(const std::string& url, const std::string& err
         // Don't update history or URL for error pages
         
         // Render the page
-        m_needsRender = true;
+        invalidateAll();
     }
 }
 
 void BrowserWindow::setBrowser(std::shared_ptr<browser::Browser> browser) {
     m_browser = browser;
+    if (m_browser) {
+        m_browser->layoutEngine()->setLazyLayout(true);
+    }
 }
 
 std::shared_ptr<browser::Browser> BrowserWindow::getBrowser() const {
@@ -836,7 +953,7 @@ void BrowserWindow::setLoadingStateCallback(std::function<void(bool)> callback)
 void BrowserWindow::updateNavigationButtons() {
     // Navigation buttons are now properly enabled/disabled based on history
     // The rendering code above handles the visual state
-    m_needsRender = true;
+    updateToolbar();
 }
 
 void BrowserWindow::updateLoadingState(bool isLoading) {
@@ -857,7 +974,7 @@ void BrowserWindow::handleKeyEvent(Key key, KeyAction action) {
         // Pass the Key enum value directly
         if (m_browserControls->handleKeyInput(static_cast<int>(key), 0, 
                                              static_cast<int>(action), 0)) {
-            m_needsRender = true;  // Force re-render after input
+            updateToolbar();  // Repaints only the items the event changed
             return;
         }
     }
@@ -902,6 +1019,34 @@ void BrowserWindow::handleKeyEvent(Key key, KeyAction action) {
                         stopLoading();
                     }
                     break;
+                    
+                // Scrolling
+                case Key::Up:
+                    scrollBy(-scrollStep);
+                    break;
+                    
+                case Key::Down:
+                    scrollBy(scrollStep);
+                    break;
+                    
+                case Key::PageUp:
+                    scrollBy(-pageScrollHeight());
+                    break;
+                    
+                case Key::PageDown:
+                case Key::Space:
+                    scrollBy(pageScrollHeight());
+                    break;
+                    
+                case Key::Home:
+                    scrollTo(0);
+                    break;
+                    
+                case Key::End:
+                    if (m_browser) {
+                        scrollTo(m_browser->layoutEngine()->documentHeight());
+                    }
+                    break;
             }
         }
     }
@@ -912,13 +1057,12 @@ void BrowserWindow::handleMouseEvent(MouseButton button, MouseAction action, int
     if (m_browserControls) {
         if (m_browserControls->handleMouseButton(static_cast<int>(button), 
                                                static_cast<int>(action), 0, x, y)) {
-            m_needsRender = true;  // Force re-render after click
+            updateToolbar();  // Repaints only the items the event changed
             return;
         }
     }
     
     // Check if the click is in the toolbar area
-    int toolbarHeight = 40;
     if (y <= toolbarHeight && button == MouseButton::Left && action == MouseAction::Press) {
         // Handle toolbar button clicks
         int buttonSize = 30;
@@ -951,9 +1095,9 @@ void BrowserWindow::handleMouseEvent(MouseButton button, MouseAction action, int
     
     // Check if the click is in the content area
     if (y > toolbarHeight && m_browser && m_browser->currentDocument()) {
-        // Convert coordinates to content area
+        // Convert coordinates to the scrolled content
         int contentX = x;
-        int contentY = y - toolbarHeight;
+        int contentY = y - toolbarHeight + static_cast<int>(m_browser->layoutEngine()->scrollY());
         
         // Forward event to the browser engine
         // In a real browser, you would have something like:
@@ -961,36 +1105,38 @@ void BrowserWindow::handleMouseEvent(MouseButton button, MouseAction action, int
         
         // For now, just handle basic link clicking
         if (button == MouseButton::Left && action == MouseAction::Press) {
-            // Find the element under the cursor
-            html::Element* clickedElement = findElementAtPosition(contentX, contentY);
-            
-            if (clickedElement) {
-                // Check if it's a link
-                if (clickedElement->tagName() == "a" && 
+            // Find the link under the cursor
+            std::string href;
+            {
+                std::unique_lock<std::mutex> documentLock = m_browser->lockDocument();
+                html::Element* clickedElement = findElementAtPosition(contentX, contentY);
+                if (clickedElement && clickedElement->tagName() == "a" &&
                     clickedElement->hasAttribute("href")) {
-                    std::string href = clickedElement->getAttribute("href");
-                    
-                    // Handle relative URLs
-                    if (href[0] == '/') {
-                        // Absolute path relative to domain
-                        size_t domainEnd = m_currentUrl.find("/", m_currentUrl.find("//") + 2);
-                        if (domainEnd != std::string::npos) {
-                            href = m_currentUrl.substr(0, domainEnd) + href;
-                        } else {
-                            href = m_currentUrl + href;
-                        }
-                    } else if (href.find("://") == std::string::npos) {
-                        // Relative path
-                        size_t lastSlash = m_currentUrl.find_last_of('/');
-                        if (lastSlash != std::string::npos) {
-                            href = m_currentUrl.substr(0, lastSlash + 1) + href;
-                        } else {
-                            href = m_currentUrl + "/" + href;
-                        }
+                    href = clickedElement->getAttribute("href");
+                }
+            }
+            
+            if (!href.empty()) {
+                // Handle relative URLs
+                if (href[0] == '/') {
+                    // Absolute path relative to domain
+                    size_t domainEnd = m_currentUrl.find("/", m_currentUrl.find("//") + 2);
+                    if (domainEnd != std::string::npos) {
+                        href = m_currentUrl.substr(0, domainEnd) + href;
+                    } else {
+                        href = m_currentUrl + href;
+                    }
+                } else if (href.find("://") == std::string::npos) {
+                    // Relative path
+                    size_t lastSlash = m_currentUrl.find_last_of('/');
+                    if (lastSlash != std::string::npos) {
+                        href = m_currentUrl.substr(0, lastSlash + 1) + href;
+                    } else {
+                        href = m_currentUrl + "/" + href;
                     }
-                    
-                    loadUrl(href);
                 }
+                
+                loadUrl(href);
             }
         }
     }
@@ -1007,8 +1153,12 @@ void BrowserWindow::handleResizeEvent(int width, int height) {
         m_renderTarget = std::make_shared<rendering::CustomRenderTarget>(width, height);
     }
     
-    // Re-layout the page
+    // Re-layout the page, in the size later loads and scripts' changes use
+    if (m_browser) {
+        m_browser->setViewportSize(static_cast<float>(width), static_cast<float>(height - 40));
+    }
     if (m_browser && m_browser->currentDocument()) {
+        std::unique_lock<std::mutex> documentLock = m_browser->lockDocument();
         css::StyleResolver* styleResolver = m_browser->styleResolver();
         if (styleResolver) {
             m_browser->layoutEngine()->layoutDocument(
@@ -1018,7 +1168,7 @@ void BrowserWindow::handleResizeEvent(int width, int height) {
     }
     
     // Redraw the page
-    m_needsRender = true;
+    invalidateAll();
 }
 
 void BrowserWindow::handleCloseEvent() {
@@ -1040,31 +1190,57 @@ html::Element* BrowserWindow::findElementAtPosition(int x, int y) {
         return nullptr;
     }
     
-    // This is a very simplified approach
-    // A real browser would traverse the layout tree and do proper hit testing
-    
-    // Get all links in the document
-    html::Document* doc = m_browser->currentDocument();
-    if (!doc) return nullptr;
-    
-    std::vector<html::Element*> links = doc->getElementsByTagName("a");
+    // The topmost box under the point, through the layout's spatial index
+    layout::Box* box = m_browser->layoutEngine()->hitTest(static_cast<float>(x), static_cast<float>(y));
+    if (!box || !box->node()) {
+        return nullptr;
+    }
     
-    for (html::Element* link : links) {
-        // Get the box for this element
-        layout::Box* box = m_browser->layoutEngine()->getBoxForNode(link);
-        if (box) {
-            // Check if point is inside box
-            layout::Rect rect = box->borderBox();
-            if (x >= rect.x && x < rect.x + rect.width &&
-                y >= rect.y && y < rect.y + rect.height) {
-                return link;
-            }
+    // The link it's in, if any
+    html::Node* node = box->node();
+    html::Element* element = node->nodeType() == html::NodeType::ELEMENT_NODE
+        ? static_cast<html::Element*>(node) : node->parentElement();
+    for (; element; element = element->parentElement()) {
+        if (element->tagName() == "a" && element->hasAttribute("href")) {
+            return element;
         }
     }
     
     return nullptr;
 }
 
+void BrowserWindow::scrollTo(float y) {
+    if (!m_browser) {
+        return;
+    }
+    
+    // The engine lays out what comes into view and may correct the position
+    layout::LayoutEngine* layoutEngine = m_browser->layoutEngine();
+    float previous = layoutEngine->scrollY();
+    float scrolled;
+    {
+        std::unique_lock<std::mutex> documentLock = m_browser->lockDocument();
+        scrolled = layoutEngine->scrollTo(y);
+        m_browser->prioritizeVisibleImages();
+    }
+    if (scrolled != previous) {
+        invalidateAll();
+    }
+}
+
+void BrowserWindow::scrollBy(float dy) {
+    if (m_browser) {
+        scrollTo(m_browser->layoutEngine()->scrollY() + dy);
+    }
+}
+
+float BrowserWindow::pageScrollHeight() const {
+    // A page less a step, keeping a line of context
+    int width = 0, height = 0;
+    getSize(width, height);
+    return std::max(scrollStep, static_cast<float>(height - 40) - scrollStep);
+}
+
 // Initialize controls is no longer needed as BrowserControls handles this
 void BrowserWindow::initializeControls() {
     // This method is kept for compatibility but does nothing
@@ -4,9 +4,12 @@
 
 #include "window.h"
 #include "custom_controls.h"
+#include "frame_scheduler.h"
 #include "../browser/browser.h"
 #include "../rendering/renderer.h"
 #include "../rendering/custom_render_target.h"
+#include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <functional>
@@ -74,17 +77,50 @@ private:
     std::shared_ptr<rendering::CustomRenderContext> m_customContext;
     std::shared_ptr<BrowserControls> m_browserControls;
     
-    // Navigation state
+    // Navigation state. Each history entry keeps the id of the page it
+    // showed, which the browser may still have in its back/forward cache.
+    struct HistoryEntry {
+        std::string url;
+        uint64_t pageId;
+    };
     std::string m_currentUrl;
-    std::vector<std::string> m_history;
+    std::vector<HistoryEntry> m_history;
     size_t m_historyIndex;
     bool m_isLoading;
-    bool m_needsRender = false;
+    
+    // Window area to repaint at the next frame, in window pixels
+    DamageRect m_damage;
+    
+    // When frames are drawn; input, damage and scripts' DOM changes ask
+    // for them
+    FrameScheduler m_frameScheduler;
+    bool m_inFrame;
     
     // UI controls (removed individual controls, now managed by BrowserControls)
     
+    // The toolbar's buttons and address bar. Each is drawn into a layer of
+    // its own and copied to the window from there until what it shows
+    // changes, and only then is its rect repainted.
+    enum ToolbarItemIndex {
+        BACK_BUTTON,
+        FORWARD_BUTTON,
+        RELOAD_BUTTON,
+        ADDRESS_BAR,
+        TOOLBAR_ITEM_COUNT
+    };
+    struct ToolbarItem {
+        DamageRect rect;
+        bool enabled = false;
+        bool focused = false;
+        std::string text;
+        std::unique_ptr<Canvas> layer;
+        bool stale = true;  // The layer doesn't show the above yet
+    };
+    std::array<ToolbarItem, TOOLBAR_ITEM_COUNT> m_toolbarItems;
+    
     // UI state
     bool m_initialized;
+    bool m_firstPaintDone;
     
     // Callbacks
     std::function<void(const std::string&)> m_urlChangeCallback;
@@ -102,15 +138,47 @@ private:
     void updateNavigationButtons();
     void updateLoadingState(bool isLoading);
     
-    // Page rendering
+    // Draw a frame if one is due: commit scripts' DOM changes, then paint
+    // what they, the layout and input damaged
+    void runFrame();
+    
+    // Repaint the damaged area: the page boxes intersecting it, found
+    // through the layout's spatial index, and the toolbar if it's touched.
+    // The canvas is clipped to the damage and only it is presented.
     void renderPage();
+    void renderToolbar(Canvas* canvas, int width, const DamageRect& damage);
+    void drawToolbarItem(Canvas* canvas, size_t index, int x, int y);
+    
+    // Mark window areas for the next frame
+    void invalidate(const DamageRect& rect);
+    void invalidateAll();
+    
+    // Bring the toolbar items up to date with the window, the history and
+    // the address bar, damaging the rects of those that changed
+    void updateToolbar();
+    
+    // Add the boxes the layout changed since the last frame, in window
+    // pixels; the content area for a rebuilt tree
+    void collectLayoutDamage();
+    
+    static constexpr int toolbarHeight = 40;
+    static constexpr int contentTop = toolbarHeight + 1;  // Below the border
+    
+    // Page scrolling, in content pixels
+    void scrollTo(float y);
+    void scrollBy(float dy);
+    float pageScrollHeight() const;
+    static constexpr float scrollStep = 40.0f;
     
     // Page loading
     bool loadUrlInternal(const std::string& url);
+    bool goToHistoryEntry(size_t index);
     void showDefaultPage();
     void showErrorPage(const std::string& url, const std::string& error);
     
     // Helper methods
+    
+    // The link under a point in page coordinates, if any
     html::Element* findElementAtPosition(int x, int y);
 
     friend class Win32Window;
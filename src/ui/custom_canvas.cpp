@@ -121,6 +121,19 @@ void CustomCanvas::drawText(const std::string& text, int x, int y, unsigned int
     m_context->text(static_cast<float>(x), static_cast<float>(y), text);
 }
 
+void CustomCanvas::setClip(int x, int y, int width, int height) {
+    if (m_context) {
+        m_context->scissor(static_cast<float>(x), static_cast<float>(y),
+                           static_cast<float>(width), static_cast<float>(height));
+    }
+}
+
+void CustomCanvas::resetClip() {
+    if (m_context) {
+        m_context->resetScissor();
+    }
+}
+
 void CustomCanvas::beginFrame() {
     if (m_context) {
         m_context->save();
@@ -27,6 +27,8 @@ public:
     virtual void drawRect(int x, int y, int width, int height, unsigned int color, bool filled = false, int thickness = 1) override;
     virtual void drawEllipse(int x, int y, int width, int height, unsigned int color, bool filled = false, int thickness = 1) override;
     virtual void drawText(const std::string& text, int x, int y, unsigned int color, const std::string& fontName = "Arial", int fontSize = 12) override;
+    virtual void setClip(int x, int y, int width, int height) override;
+    virtual void resetClip() override;
     
     // Get the rendering context
     rendering::CustomRenderContext* getContext() { return m_context.get(); }
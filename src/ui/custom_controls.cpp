@@ -859,6 +859,10 @@ void BrowserControls::setAddressBarText(const std::string& text) {
     }
 }
 
+bool BrowserControls::isAddressBarFocused() const {
+    return m_addressBar && m_addressBar->hasFocus();
+}
+
 void BrowserControls::setLoading(bool loading) {
     if (m_reloadButton) {
         m_reloadButton->setVisible(!loading);
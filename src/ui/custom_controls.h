@@ -198,6 +198,9 @@ public:
     // Set address bar text
     void setAddressBarText(const std::string& text);
     
+    // Whether typing goes to the address bar
+    bool isAddressBarFocused() const;
+    
     // Show/hide progress bar
     void setLoading(bool loading);
     
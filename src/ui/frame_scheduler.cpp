@@ -0,0 +1,56 @@
+#include "frame_scheduler.h"
+
+namespace browser {
+namespace ui {
+
+//-----------------------------------------------------------------------------
+// FrameScheduler Implementation
+//-----------------------------------------------------------------------------
+
+FrameScheduler::FrameScheduler()
+    : m_interval(std::chrono::microseconds(16667))
+    , m_timebase(Clock::now())
+    , m_lastFrame(m_timebase - m_interval)
+    , m_requested(false)
+    , m_animating(false)
+    , m_frames(0)
+{
+}
+
+void FrameScheduler::setRefreshRate(int hz) {
+    if (hz < 1) {
+        hz = 60;
+    }
+    m_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / hz));
+    m_lastFrame = m_timebase - m_interval;
+}
+
+int FrameScheduler::timeUntilFrameMs(Clock::time_point now) const {
+    if (!wanted()) {
+        return -1;
+    }
+    Clock::time_point due = m_lastFrame + m_interval;
+    if (due <= now) {
+        return 0;
+    }
+
+    // Rounded up, so the wait doesn't end just short of the boundary
+    auto wait = std::chrono::duration_cast<std::chrono::microseconds>(due - now).count();
+    return static_cast<int>((wait + 999) / 1000);
+}
+
+bool FrameScheduler::beginFrame(Clock::time_point now) {
+    if (!wanted() || now < m_lastFrame + m_interval) {
+        return false;
+    }
+    m_requested.store(false, std::memory_order_release);
+
+    // The boundary now falls in; a late frame doesn't move the next one
+    // closer
+    m_lastFrame = m_timebase + ((now - m_timebase) / m_interval) * m_interval;
+    ++m_frames;
+    return true;
+}
+
+} // namespace ui
+} // namespace browser
@@ -0,0 +1,61 @@
+#ifndef BROWSER_UI_FRAME_SCHEDULER_H
+#define BROWSER_UI_FRAME_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace browser {
+namespace ui {
+
+// Decides when the event loop draws a frame. A frame is only drawn when
+// something asked for one, or while an animation runs, and frames start on
+// the display's refresh boundaries: at most one per refresh interval, however
+// many requests arrive in it. The first frame after an idle spell is drawn
+// at once, so input isn't held back waiting for a boundary. Between frames
+// the loop waits on OS events for timeUntilFrameMs(), with no timeout when
+// nothing is pending.
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameScheduler();
+
+    // Refresh rate of the display frames are aligned to; 60 Hz by default
+    void setRefreshRate(int hz);
+    Clock::duration frameInterval() const { return m_interval; }
+
+    // Ask for a frame at the next refresh boundary. Thread-safe; other
+    // threads also wake the event loop up after calling it.
+    void requestFrame() { m_requested.store(true, std::memory_order_release); }
+    bool frameRequested() const { return m_requested.load(std::memory_order_acquire); }
+
+    // While animating a frame is drawn every refresh interval
+    void setAnimating(bool animating) { m_animating = animating; }
+    bool animating() const { return m_animating; }
+
+    // Milliseconds to wait for events before the next frame is due: 0 if
+    // it's due now, negative if no frame is wanted
+    int timeUntilFrameMs(Clock::time_point now) const;
+
+    // Start a frame if one is wanted and due, taking the requests made so
+    // far; later ones are for the next frame
+    bool beginFrame(Clock::time_point now);
+
+    uint64_t frameCount() const { return m_frames; }
+
+private:
+    bool wanted() const { return m_animating || frameRequested(); }
+
+    Clock::duration m_interval;
+    Clock::time_point m_timebase;       // A refresh boundary; the rest are whole intervals from it
+    Clock::time_point m_lastFrame;      // Boundary the last frame was drawn in
+    std::atomic<bool> m_requested;
+    bool m_animating;
+    uint64_t m_frames;
+};
+
+} // namespace ui
+} // namespace browser
+
+#endif // BROWSER_UI_FRAME_SCHEDULER_H
@@ -2,6 +2,8 @@
 
 #include "window.h"
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 #ifdef _WIN32
 #include "window_win32.h"
@@ -28,6 +30,15 @@ Window::~Window() {
     m_controls.clear();
 }
 
+bool Window::waitEvents(int timeoutMs) {
+    const int pollMs = 5;
+    if (timeoutMs != 0) {
+        int sleepMs = timeoutMs < 0 ? pollMs : std::min(timeoutMs, pollMs);
+        std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+    }
+    return processEvents();
+}
+
 void Window::setTitle(const std::string& title) {
     m_config.title = title;
 }
@@ -76,6 +87,10 @@ void Window::setCloseCallback(std::function<void()> callback) {
     m_closeCallback = callback;
 }
 
+void Window::setMemoryPressureCallback(std::function<void()> callback) {
+    m_memoryPressureCallback = callback;
+}
+
 void Window::addControl(std::shared_ptr<UIControl> control) {
     if (control) {
         m_controls.push_back(control);
@@ -153,6 +168,12 @@ void Window::notifyCloseEvent() {
     }
 }
 
+void Window::notifyMemoryPressure() {
+    if (m_memoryPressureCallback) {
+        m_memoryPressureCallback();
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Canvas Implementation
 //-----------------------------------------------------------------------------
@@ -171,6 +192,13 @@ void Canvas::setSize(int width, int height) {
     m_height = height;
 }
 
+std::unique_ptr<Canvas> Canvas::createLayer(int, int) {
+    return nullptr;
+}
+
+void Canvas::drawLayer(const Canvas&, int, int) {
+}
+
 unsigned int Canvas::rgb(unsigned char r, unsigned char g, unsigned char b) {
     return ((unsigned int)r << 16) | ((unsigned int)g << 8) | b;
 }
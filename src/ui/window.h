@@ -3,6 +3,7 @@
 #ifndef BROWSER_UI_WINDOW_H
 #define BROWSER_UI_WINDOW_H
 
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <functional>
@@ -40,6 +41,57 @@ typedef void* NativeWindowHandle; // NSWindow* on macOS
 typedef unsigned long NativeWindowHandle; // Window on X11
 #endif
 
+// Area of a window to repaint, in window pixels
+struct DamageRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    
+    DamageRect() {}
+    DamageRect(int x, int y, int width, int height) : x(x), y(y), width(width), height(height) {}
+    
+    bool isEmpty() const { return width <= 0 || height <= 0; }
+    
+    bool operator==(const DamageRect& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+    bool operator!=(const DamageRect& other) const { return !(*this == other); }
+    
+    bool intersects(int rx, int ry, int rwidth, int rheight) const {
+        return rx < x + width && x < rx + rwidth && ry < y + height && y < ry + rheight;
+    }
+    
+    // Grow to the smallest rect holding both; empty rects add nothing
+    void unite(const DamageRect& other) {
+        if (other.isEmpty()) {
+            return;
+        }
+        if (isEmpty()) {
+            *this = other;
+            return;
+        }
+        int right = std::max(x + width, other.x + other.width);
+        int bottom = std::max(y + height, other.y + other.height);
+        x = std::min(x, other.x);
+        y = std::min(y, other.y);
+        width = right - x;
+        height = bottom - y;
+    }
+    
+    // The part inside other; empty if they don't overlap
+    DamageRect intersected(const DamageRect& other) const {
+        int left = std::max(x, other.x);
+        int top = std::max(y, other.y);
+        int right = std::min(x + width, other.x + other.width);
+        int bottom = std::min(y + height, other.y + other.height);
+        if (right <= left || bottom <= top) {
+            return DamageRect();
+        }
+        return DamageRect(left, top, right - left, bottom - top);
+    }
+};
+
 // Window configuration
 struct WindowConfig {
     std::string title = "Browser";
@@ -118,6 +170,17 @@ public:
     virtual bool processEvents() = 0;
     virtual void* getNativeHandle() const = 0;
     
+    // Wait up to timeoutMs for events (with no limit if negative), then
+    // handle all that are pending, as processEvents() does. Backends that
+    // can't block on their event queue poll it every few milliseconds.
+    virtual bool waitEvents(int timeoutMs);
+    
+    // End a waitEvents() early. Safe to call from any thread.
+    virtual void wakeUp() {}
+    
+    // Refresh rate of the display the window is on, in Hz
+    virtual int refreshRate() const { return 60; }
+    
     // Common window methods
     virtual void setTitle(const std::string& title);
     virtual std::string getTitle() const;
@@ -135,6 +198,10 @@ public:
     void setResizeCallback(std::function<void(int, int)> callback);
     void setCloseCallback(std::function<void()> callback);
     
+    // Called on the event loop's thread when the system runs low on
+    // memory. Backends without a notification never call it.
+    void setMemoryPressureCallback(std::function<void()> callback);
+    
     // UI methods
     void addControl(std::shared_ptr<UIControl> control);
     void removeControl(std::shared_ptr<UIControl> control);
@@ -142,6 +209,10 @@ public:
     // Rendering
     virtual void beginPaint() = 0;
     virtual void endPaint() = 0;
+    
+    // End painting after only damage was drawn, presenting just that area.
+    // Backends that can't limit the present repaint everything.
+    virtual void endPaint(const DamageRect&) { endPaint(); }
     virtual Canvas* getCanvas() = 0;
     
 protected:
@@ -154,6 +225,7 @@ protected:
     std::function<void(int, int)> m_mouseMoveCallback;
     std::function<void(int, int)> m_resizeCallback;
     std::function<void()> m_closeCallback;
+    std::function<void()> m_memoryPressureCallback;
     
     // Protected methods for subclasses to invoke callbacks
     void notifyKeyEvent(Key key, KeyAction action);
@@ -161,6 +233,7 @@ protected:
     void notifyMouseMoveEvent(int x, int y);
     void notifyResizeEvent(int width, int height);
     void notifyCloseEvent();
+    void notifyMemoryPressure();
 };
 
 // Factory function to create platform-specific window implementation
@@ -179,6 +252,16 @@ public:
     virtual void drawEllipse(int x, int y, int width, int height, unsigned int color, bool filled = false, int thickness = 1) = 0;
     virtual void drawText(const std::string& text, int x, int y, unsigned int color, const std::string& fontName = "Arial", int fontSize = 12) = 0;
     
+    // Limit drawing, clear() included, to a rect until resetClip()
+    virtual void setClip(int x, int y, int width, int height) = 0;
+    virtual void resetClip() = 0;
+    
+    // An offscreen canvas to keep a drawing in, and copying one to x, y
+    // within the clip. Null where the platform has none; callers then draw
+    // directly.
+    virtual std::unique_ptr<Canvas> createLayer(int width, int height);
+    virtual void drawLayer(const Canvas& layer, int x, int y);
+    
     // Helper methods for common operations
     void setSize(int width, int height);
     int width() const { return m_width; }
@@ -7,6 +7,7 @@
 #define BROWSER_UI_WINDOW_MACOS_H
 
 #include "window.h"
+#include <dispatch/dispatch.h>
 #include <string>
 #include <map>
 #include <mutex>
@@ -52,6 +53,8 @@ public:
     virtual void drawRect(int x, int y, int width, int height, unsigned int color, bool filled = false, int thickness = 1) override;
     virtual void drawEllipse(int x, int y, int width, int height, unsigned int color, bool filled = false, int thickness = 1) override;
     virtual void drawText(const std::string& text, int x, int y, unsigned int color, const std::string& fontName = "Arial", int fontSize = 12) override;
+    virtual void setClip(int x, int y, int width, int height) override;
+    virtual void resetClip() override;
     
     // Get underlying NSView
     NSView* getView() const { return m_view; }
@@ -66,7 +69,9 @@ public:
             LINE,
             RECT,
             ELLIPSE,
-            TEXT
+            TEXT,
+            CLIP,     // Commands up to the next UNCLIP draw inside the rect
+            UNCLIP
         };
         
         Type type;
@@ -124,6 +129,22 @@ public:
             return cmd;
         }
         
+        static DrawCommand Clip(int x, int y, int width, int height) {
+            DrawCommand cmd;
+            cmd.type = CLIP;
+            cmd.x1 = x;
+            cmd.y1 = y;
+            cmd.width = width;
+            cmd.height = height;
+            return cmd;
+        }
+        
+        static DrawCommand Unclip() {
+            DrawCommand cmd;
+            cmd.type = UNCLIP;
+            return cmd;
+        }
+        
         static DrawCommand Text(const std::string& text, int x, int y, unsigned int color, const std::string& fontName, int fontSize) {
             DrawCommand cmd;
             cmd.type = TEXT;
@@ -147,9 +168,16 @@ public:
     void clearDrawCommands();
     
 private:
+    // The queue is replayed in full on every redraw, so commands a clear
+    // paints over are dropped: all of them for an unclipped clear, the ones
+    // inside the clip rect for a clipped one
+    void dropCommandsInside(const DamageRect& rect);
+    
     NSView* m_view;
     std::vector<DrawCommand> m_drawCommands;
     std::mutex m_drawMutex;
+    DamageRect m_clip;
+    bool m_clipped;
     
     // Color and font caches
     std::map<unsigned int, NSColor*> m_colorCache;
@@ -172,11 +200,15 @@ public:
     virtual void hide() override;
     virtual void close() override;
     virtual bool processEvents() override;
+    virtual bool waitEvents(int timeoutMs) override;
+    virtual void wakeUp() override;
+    virtual int refreshRate() const override;
     virtual void* getNativeHandle() const override;
     
     // Painting methods
     virtual void beginPaint() override;
     virtual void endPaint() override;
+    virtual void endPaint(const DamageRect& damage) override;
     virtual Canvas* getCanvas() override;
     
     // Window property methods
@@ -201,6 +233,9 @@ private:
     // Track if window is being resized
     bool m_resizing;
     
+    // Memory pressure notifications, on the main queue
+    dispatch_source_t m_memoryPressureSource;
+    
     // Key mapping
     Key mapKeyCode(int keyCode);
 };
@@ -1,6 +1,8 @@
 // src/ui/window_macos.mm
 #import <Cocoa/Cocoa.h>
 #include "window_macos.h"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <thread>
@@ -221,6 +223,17 @@
                 [attrString release];
                 break;
             }
+            
+            case browser::ui::MacOSCanvas::DrawCommand::CLIP: {
+                [context saveGraphicsState];
+                NSRectClip(NSMakeRect(cmd.x1, cmd.y1, cmd.width, cmd.height));
+                break;
+            }
+            
+            case browser::ui::MacOSCanvas::DrawCommand::UNCLIP: {
+                [context restoreGraphicsState];
+                break;
+            }
         }
     }
     
@@ -331,6 +344,7 @@ static void initializeApp() {
 MacOSCanvas::MacOSCanvas(int width, int height)
     : Canvas(width, height)
     , m_view(nil)
+    , m_clipped(false)
 {
 }
 
@@ -353,6 +367,11 @@ void MacOSCanvas::initialize(NSView* view) {
 }
 
 void MacOSCanvas::clear(unsigned int color) {
+    if (m_clipped) {
+        dropCommandsInside(m_clip);
+    } else {
+        clearDrawCommands();
+    }
     addDrawCommand(DrawCommand::Clear(color));
 }
 
@@ -372,6 +391,77 @@ void MacOSCanvas::drawText(const std::string& text, int x, int y, unsigned int c
     addDrawCommand(DrawCommand::Text(text, x, y, color, fontName, fontSize));
 }
 
+void MacOSCanvas::setClip(int x, int y, int width, int height) {
+    if (m_clipped) {
+        addDrawCommand(DrawCommand::Unclip());
+    }
+    m_clip = DamageRect(x, y, width, height);
+    m_clipped = true;
+    addDrawCommand(DrawCommand::Clip(x, y, width, height));
+}
+
+void MacOSCanvas::resetClip() {
+    if (m_clipped) {
+        addDrawCommand(DrawCommand::Unclip());
+        m_clipped = false;
+    }
+}
+
+void MacOSCanvas::dropCommandsInside(const DamageRect& rect) {
+    auto inside = [&rect](int x, int y, int width, int height) {
+        return x >= rect.x && y >= rect.y &&
+               x + width <= rect.x + rect.width && y + height <= rect.y + rect.height;
+    };
+    
+    std::lock_guard<std::mutex> lock(m_drawMutex);
+    std::vector<DrawCommand> kept;
+    kept.reserve(m_drawCommands.size());
+    DamageRect groupClip(0, 0, m_width, m_height);
+    bool dropGroup = false;
+    for (const DrawCommand& cmd : m_drawCommands) {
+        bool covered = false;
+        switch (cmd.type) {
+            case DrawCommand::CLIP:
+                groupClip = DamageRect(cmd.x1, cmd.y1, cmd.width, cmd.height);
+                dropGroup = inside(cmd.x1, cmd.y1, cmd.width, cmd.height);
+                covered = dropGroup;
+                break;
+            case DrawCommand::UNCLIP:
+                covered = dropGroup;
+                groupClip = DamageRect(0, 0, m_width, m_height);
+                dropGroup = false;
+                break;
+            case DrawCommand::CLEAR:
+                covered = dropGroup || inside(groupClip.x, groupClip.y, groupClip.width, groupClip.height);
+                break;
+            case DrawCommand::LINE: {
+                int left = std::min(cmd.x1, cmd.x2) - cmd.thickness;
+                int top = std::min(cmd.y1, cmd.y2) - cmd.thickness;
+                covered = dropGroup || inside(left, top,
+                                              std::abs(cmd.x2 - cmd.x1) + 2 * cmd.thickness,
+                                              std::abs(cmd.y2 - cmd.y1) + 2 * cmd.thickness);
+                break;
+            }
+            case DrawCommand::RECT:
+            case DrawCommand::ELLIPSE:
+                covered = dropGroup || inside(cmd.x1 - cmd.thickness, cmd.y1 - cmd.thickness,
+                                              cmd.width + 2 * cmd.thickness, cmd.height + 2 * cmd.thickness);
+                break;
+            case DrawCommand::TEXT:
+                // Glyph extents aren't known here; a font size per character
+                // and a line on either side of the origin is generous
+                covered = dropGroup || inside(cmd.x1, cmd.y1 - cmd.fontSize,
+                                              static_cast<int>(cmd.text.size()) * cmd.fontSize,
+                                              2 * cmd.fontSize);
+                break;
+        }
+        if (!covered) {
+            kept.push_back(cmd);
+        }
+    }
+    m_drawCommands.swap(kept);
+}
+
 void MacOSCanvas::setNeedsDisplay() {
     if (m_view) {
         [m_view setNeedsDisplay:YES];
@@ -379,9 +469,9 @@ void MacOSCanvas::setNeedsDisplay() {
 }
 
 void MacOSCanvas::addDrawCommand(const DrawCommand& cmd) {
+    // The window asks for a redraw of what changed at endPaint
     std::lock_guard<std::mutex> lock(m_drawMutex);
     m_drawCommands.push_back(cmd);
-    setNeedsDisplay();
 }
 
 std::vector<MacOSCanvas::DrawCommand> MacOSCanvas::getDrawCommands() {
@@ -463,14 +553,31 @@ MacOSWindow::MacOSWindow(const WindowConfig& config)
     , m_view(nil)
     , m_delegate(nil)
     , m_resizing(false)
+    , m_memoryPressureSource(nullptr)
 {
     m_canvas = std::make_shared<MacOSCanvas>(config.width, config.height);
     
     // Initialize the application
     initializeApp();
+    
+    // The main queue is drained while the event loop waits for events
+    m_memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                    DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                    dispatch_get_main_queue());
+    if (m_memoryPressureSource) {
+        dispatch_source_set_event_handler(m_memoryPressureSource, ^{
+            notifyMemoryPressure();
+        });
+        dispatch_resume(m_memoryPressureSource);
+    }
 }
 
 MacOSWindow::~MacOSWindow() {
+    if (m_memoryPressureSource) {
+        dispatch_source_cancel(m_memoryPressureSource);
+        dispatch_release(m_memoryPressureSource);
+    }
+    
     // Close window
     close();
 }
@@ -577,6 +684,52 @@ bool MacOSWindow::processEvents() {
     return m_window != nil;
 }
 
+bool MacOSWindow::waitEvents(int timeoutMs) {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    
+    NSDate* until = timeoutMs < 0 ? [NSDate distantFuture]
+                                  : [NSDate dateWithTimeIntervalSinceNow:timeoutMs / 1000.0];
+    NSEvent* event = [NSApp nextEventMatchingMask:NSEventMaskAny
+                                        untilDate:until
+                                           inMode:NSDefaultRunLoopMode
+                                          dequeue:YES];
+    if (event) {
+        [NSApp sendEvent:event];
+    }
+    
+    [pool release];
+    
+    // The rest of what is queued
+    return processEvents();
+}
+
+void MacOSWindow::wakeUp() {
+    // Posting events is allowed from any thread; this one only ends the wait
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    NSEvent* event = [NSEvent otherEventWithType:NSEventTypeApplicationDefined
+                                        location:NSZeroPoint
+                                   modifierFlags:0
+                                       timestamp:0
+                                    windowNumber:0
+                                         context:nil
+                                         subtype:0
+                                           data1:0
+                                           data2:0];
+    [NSApp postEvent:event atStart:NO];
+    [pool release];
+}
+
+int MacOSWindow::refreshRate() const {
+    NSScreen* screen = m_window ? [m_window screen] : [NSScreen mainScreen];
+    if ([screen respondsToSelector:@selector(maximumFramesPerSecond)]) {
+        NSInteger hz = [screen maximumFramesPerSecond];
+        if (hz > 0) {
+            return static_cast<int>(hz);
+        }
+    }
+    return 60;
+}
+
 void* MacOSWindow::getNativeHandle() const {
     return (void*)m_window;
 }
@@ -591,6 +744,12 @@ void MacOSWindow::endPaint() {
     }
 }
 
+void MacOSWindow::endPaint(const DamageRect& damage) {
+    if (m_canvas && m_view) {
+        [m_view setNeedsDisplayInRect:NSMakeRect(damage.x, damage.y, damage.width, damage.height)];
+    }
+}
+
 Canvas* MacOSWindow::getCanvas() {
     return m_canvas.get();
 }
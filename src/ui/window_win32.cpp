@@ -81,6 +81,38 @@ void Win32Canvas::clear(unsigned int color) {
     DeleteObject(brush);
 }
 
+void Win32Canvas::setClip(int x, int y, int width, int height) {
+    if (!m_hdcMem) return;
+    
+    // The DC keeps its own copy of the region
+    HRGN region = CreateRectRgn(x, y, x + width, y + height);
+    SelectClipRgn(m_hdcMem, region);
+    DeleteObject(region);
+}
+
+void Win32Canvas::resetClip() {
+    if (m_hdcMem) {
+        SelectClipRgn(m_hdcMem, NULL);
+    }
+}
+
+std::unique_ptr<Canvas> Win32Canvas::createLayer(int width, int height) {
+    if (!m_hdcMem || width <= 0 || height <= 0) {
+        return nullptr;
+    }
+    
+    auto layer = std::make_unique<Win32Canvas>(width, height);
+    layer->initialize(m_hdcMem);
+    return layer;
+}
+
+void Win32Canvas::drawLayer(const Canvas& layer, int x, int y) {
+    const Win32Canvas* source = dynamic_cast<const Win32Canvas*>(&layer);
+    if (!m_hdcMem || !source || !source->m_hdcMem) return;
+    
+    BitBlt(m_hdcMem, x, y, source->m_width, source->m_height, source->m_hdcMem, 0, 0, SRCCOPY);
+}
+
 void Win32Canvas::drawLine(int x1, int y1, int x2, int y2, unsigned int color, int thickness) {
     if (!m_hdcMem) return;
     
@@ -266,6 +298,9 @@ Win32Window::Win32Window(const WindowConfig& config)
     : Window(config)
     , m_hwnd(NULL)
     , m_hdc(NULL)
+    , m_threadId(GetCurrentThreadId())
+    , m_lowMemory(CreateMemoryResourceNotification(LowMemoryResourceNotification))
+    , m_memoryLow(false)
 {
     m_canvas = std::make_shared<Win32Canvas>(config.width, config.height);
 }
@@ -275,6 +310,10 @@ Win32Window::~Win32Window() {
     if (m_hwnd) {
         s_windowMap.erase(m_hwnd);
     }
+    
+    if (m_lowMemory) {
+        CloseHandle(m_lowMemory);
+    }
 }
 
 bool Win32Window::create() {
@@ -383,10 +422,55 @@ bool Win32Window::processEvents() {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
+    checkMemoryPressure();
     
     return m_hwnd != NULL; // Continue if window still exists
 }
 
+bool Win32Window::waitEvents(int timeoutMs) {
+    if (!m_hwnd) {
+        return false;
+    }
+    
+    // Returns once a message is queued, input that arrived before the call
+    // but hasn't been read yet included
+    DWORD timeout = timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs);
+    
+    // Low memory ends the wait too, unless it's already been reported: the
+    // notification stays signaled for as long as it lasts
+    DWORD handleCount = m_lowMemory && !m_memoryLow ? 1 : 0;
+    MsgWaitForMultipleObjectsEx(handleCount, &m_lowMemory, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+    return processEvents();
+}
+
+void Win32Window::checkMemoryPressure() {
+    BOOL low = FALSE;
+    if (!m_lowMemory || !QueryMemoryResourceNotification(m_lowMemory, &low)) {
+        return;
+    }
+    if (low && !m_memoryLow) {
+        notifyMemoryPressure();
+    }
+    m_memoryLow = low != FALSE;
+}
+
+void Win32Window::wakeUp() {
+    // A thread message, so it doesn't depend on the window still existing
+    PostThreadMessage(m_threadId, WM_NULL, 0, 0);
+}
+
+int Win32Window::refreshRate() const {
+    int hz = 0;
+    if (m_hwnd) {
+        HDC hdc = GetDC(m_hwnd);
+        hz = GetDeviceCaps(hdc, VREFRESH);
+        ReleaseDC(m_hwnd, hdc);
+    }
+    
+    // 0 and 1 mean the hardware's default rate
+    return hz > 1 ? hz : 60;
+}
+
 void* Win32Window::getNativeHandle() const {
     return (void*)m_hwnd;
 }
@@ -457,6 +541,17 @@ void Win32Window::endPaint() {
     }
 }
 
+void Win32Window::endPaint(const DamageRect& damage) {
+    if (m_hwnd && m_hdc) {
+        ReleaseDC(m_hwnd, m_hdc);
+        m_hdc = NULL;
+        
+        // WM_PAINT blits only the invalidated area from the memory DC
+        RECT rect = { damage.x, damage.y, damage.x + damage.width, damage.y + damage.height };
+        InvalidateRect(m_hwnd, &rect, FALSE);
+    }
+}
+
 Canvas* Win32Window::getCanvas() {
     return m_canvas.get();
 }
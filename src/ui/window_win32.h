@@ -29,6 +29,12 @@ public:
     virtual void drawRect(int x, int y, int width, int height, unsigned int color, bool filled = false, int thickness = 1) override;
     virtual void drawEllipse(int x, int y, int width, int height, unsigned int color, bool filled = false, int thickness = 1) override;
     virtual void drawText(const std::string &text, int x, int y, unsigned int color, const std::string &fontName = "Arial", int fontSize = 12) override;
+    virtual void setClip(int x, int y, int width, int height) override;
+    virtual void resetClip() override;
+    
+    // Layers are bitmaps compatible with this one, copied with BitBlt
+    virtual std::unique_ptr<Canvas> createLayer(int width, int height) override;
+    virtual void drawLayer(const Canvas& layer, int x, int y) override;
     
 private:
     HDC m_hdc;            // Device context
@@ -52,6 +58,9 @@ public:
     virtual void hide() override;
     virtual void close() override;
     virtual bool processEvents() override;
+    virtual bool waitEvents(int timeoutMs) override;
+    virtual void wakeUp() override;
+    virtual int refreshRate() const override;
     virtual void* getNativeHandle() const override;
     
     // Window property methods (these were missing!)
@@ -63,6 +72,7 @@ public:
     // Painting methods
     virtual void beginPaint() override;
     virtual void endPaint() override;
+    virtual void endPaint(const DamageRect& damage) override;
     virtual Canvas* getCanvas() override;
     
     // Static window procedure
@@ -73,6 +83,12 @@ private:
     std::shared_ptr<Win32Canvas> m_canvas;    // Canvas for drawing
     HDC m_hdc;                                // Device context
     PAINTSTRUCT m_ps;                         // Paint structure
+    DWORD m_threadId;                         // Thread whose queue the window's messages go to
+    HANDLE m_lowMemory;                       // Signaled while the system is low on memory
+    bool m_memoryLow;                         // Low memory was reported and hasn't ended
+    
+    // Report low memory once each time it starts
+    void checkMemoryPressure();
     
     // Key mapping
     static Key mapVirtualKey(WPARAM wParam);